@@ -17,6 +17,7 @@
 #include <wlr/config.h>
 #include <wlr/util/log.h>
 #include "backend/multi.h"
+#include "util/startup.h"
 
 #if WLR_HAS_X11_BACKEND
 #include <wlr/backend/x11.h>
@@ -210,6 +211,8 @@ static struct wlr_backend *attempt_backend_by_name(struct wl_display *display,
 
 struct wlr_backend *wlr_backend_autocreate(struct wl_display *display,
 		wlr_renderer_create_func_t create_renderer_func) {
+	startup_mark("creating backend");
+
 	struct wlr_backend *backend = wlr_multi_backend_create(display);
 	struct wlr_multi_backend *multi = (struct wlr_multi_backend *)backend;
 	if (!backend) {
@@ -283,6 +286,7 @@ struct wlr_backend *wlr_backend_autocreate(struct wl_display *display,
 		wlr_backend_destroy(backend);
 		return NULL;
 	}
+	startup_mark("session started");
 
 	struct wlr_backend *libinput = wlr_libinput_backend_create(display,
 		multi->session);
@@ -304,5 +308,6 @@ struct wlr_backend *wlr_backend_autocreate(struct wl_display *display,
 		return NULL;
 	}
 
+	startup_mark("backend created");
 	return backend;
 }
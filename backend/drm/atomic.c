@@ -1,80 +1,217 @@
+#include <errno.h>
 #include <gbm.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include "backend/drm/drm.h"
 #include "backend/drm/iface.h"
 #include "backend/drm/util.h"
+#include "util/trace.h"
 
 struct atomic {
-	drmModeAtomicReq *req;
-	int cursor;
+	struct wlr_drm_prop_list *props;
+	size_t cursor;
 	bool failed;
 };
 
 static void atomic_begin(struct wlr_drm_crtc *crtc, struct atomic *atom) {
-	if (!crtc->atomic) {
-		crtc->atomic = drmModeAtomicAlloc();
-		if (!crtc->atomic) {
-			wlr_log_errno(WLR_ERROR, "Allocation failed");
-			atom->failed = true;
-			return;
+	atom->props = &crtc->atomic;
+	atom->cursor = crtc->atomic.len;
+	atom->failed = false;
+}
+
+// Drops the properties added since atomic_begin
+static void atomic_rollback(struct atomic *atom) {
+	atom->props->len = atom->cursor;
+}
+
+static bool prop_list_append(struct wlr_drm_prop_list *list,
+		uint32_t obj_id, uint32_t prop_id, uint64_t value, bool force) {
+	if (list->len == list->cap) {
+		size_t cap = list->cap == 0 ? 32 : list->cap * 2;
+		struct wlr_drm_prop_value *items =
+			realloc(list->items, cap * sizeof(*items));
+		if (items == NULL) {
+			return false;
 		}
+		list->items = items;
+		list->cap = cap;
 	}
 
-	atom->req = crtc->atomic;
-	atom->cursor = drmModeAtomicGetCursor(atom->req);
-	atom->failed = false;
+	list->items[list->len++] = (struct wlr_drm_prop_value){
+		.obj_id = obj_id,
+		.prop_id = prop_id,
+		.value = value,
+		.force = force,
+	};
+	return true;
+}
+
+// Whether a later item of the list sets the same property
+static bool prop_list_superseded(const struct wlr_drm_prop_list *list,
+		size_t i) {
+	const struct wlr_drm_prop_value *prop = &list->items[i];
+	for (size_t j = i + 1; j < list->len; ++j) {
+		if (list->items[j].obj_id == prop->obj_id &&
+				list->items[j].prop_id == prop->prop_id) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static struct wlr_drm_prop_value *find_committed_prop(
+		struct wlr_drm_backend *drm, uint32_t obj_id, uint32_t prop_id) {
+	for (size_t i = 0; i < drm->committed_props.len; ++i) {
+		struct wlr_drm_prop_value *prop = &drm->committed_props.items[i];
+		if (prop->obj_id == obj_id && prop->prop_id == prop_id) {
+			return prop;
+		}
+	}
+	return NULL;
+}
+
+static void record_committed_props(struct wlr_drm_backend *drm,
+		const struct wlr_drm_prop_list *list) {
+	for (size_t i = 0; i < list->len; ++i) {
+		const struct wlr_drm_prop_value *prop = &list->items[i];
+		if (prop->force) {
+			continue;
+		}
+
+		struct wlr_drm_prop_value *committed =
+			find_committed_prop(drm, prop->obj_id, prop->prop_id);
+		if (committed != NULL) {
+			committed->value = prop->value;
+		} else {
+			// If this fails, the property is just committed again next time
+			prop_list_append(&drm->committed_props, prop->obj_id,
+				prop->prop_id, prop->value, false);
+		}
+	}
+}
+
+// Commits the properties of the lists which differ from the last committed
+// values. Modesets commit all of them, a new mode blob may reuse the id of a
+// destroyed one. Returns the result of drmModeAtomicCommit.
+static int commit_props(struct wlr_drm_backend *drm,
+		struct wlr_drm_prop_list **lists, size_t len, uint32_t flags,
+		void *user_data) {
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+	if (req == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return -1;
+	}
+
+	bool modeset = flags & DRM_MODE_ATOMIC_ALLOW_MODESET;
+	int ret = 0;
+	for (size_t i = 0; i < len && ret == 0; ++i) {
+		const struct wlr_drm_prop_list *list = lists[i];
+		for (size_t j = 0; j < list->len; ++j) {
+			const struct wlr_drm_prop_value *prop = &list->items[j];
+			if (prop_list_superseded(list, j)) {
+				continue;
+			}
+			if (!modeset && !prop->force) {
+				struct wlr_drm_prop_value *committed =
+					find_committed_prop(drm, prop->obj_id, prop->prop_id);
+				if (committed != NULL && committed->value == prop->value) {
+					continue;
+				}
+			}
+			if (drmModeAtomicAddProperty(req, prop->obj_id, prop->prop_id,
+					prop->value) < 0) {
+				wlr_log_errno(WLR_ERROR, "Failed to add atomic DRM property");
+				ret = -1;
+				break;
+			}
+		}
+	}
+
+	if (ret == 0) {
+		ret = drmModeAtomicCommit(drm->fd, req, flags, user_data);
+	}
+	int error = errno;
+	drmModeAtomicFree(req);
+
+	if (ret == 0 && !(flags & DRM_MODE_ATOMIC_TEST_ONLY)) {
+		for (size_t i = 0; i < len; ++i) {
+			record_committed_props(drm, lists[i]);
+		}
+	}
+	errno = error;
+	return ret;
 }
 
-static bool atomic_end(int drm_fd, struct atomic *atom) {
+static bool atomic_end(struct wlr_drm_backend *drm, struct atomic *atom) {
 	if (atom->failed) {
+		atomic_rollback(atom);
 		return false;
 	}
 
 	uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_NONBLOCK;
-	if (drmModeAtomicCommit(drm_fd, atom->req, flags, NULL)) {
+	if (commit_props(drm, &atom->props, 1, flags, NULL)) {
 		wlr_log_errno(WLR_ERROR, "Atomic test failed");
-		drmModeAtomicSetCursor(atom->req, atom->cursor);
+		atomic_rollback(atom);
 		return false;
 	}
 
 	return true;
 }
 
-static bool atomic_commit(int drm_fd, struct atomic *atom,
+static bool atomic_commit(struct wlr_drm_backend *drm, struct atomic *atom,
 		struct wlr_drm_connector *conn, uint32_t flags, bool modeset) {
 	if (atom->failed) {
+		atomic_rollback(atom);
 		return false;
 	}
 
-	int ret = drmModeAtomicCommit(drm_fd, atom->req, flags, conn);
+	wlr_trace(drm_atomic_commit_begin, &conn->output, flags, modeset);
+	int ret = commit_props(drm, &atom->props, 1, flags, conn);
+	int error = errno;
+	wlr_trace(drm_atomic_commit_end, &conn->output, ret);
 	if (ret) {
 		wlr_log_errno(WLR_ERROR, "%s: Atomic commit failed (%s)",
 			conn->output.name, modeset ? "modeset" : "pageflip");
 
 		// Try to commit without new changes
-		drmModeAtomicSetCursor(atom->req, atom->cursor);
-		if (drmModeAtomicCommit(drm_fd, atom->req, flags, conn)) {
+		atomic_rollback(atom);
+		if (commit_props(drm, &atom->props, 1, flags, conn)) {
 			wlr_log_errno(WLR_ERROR,
 				"%s: Atomic commit without new changes failed (%s)",
 				conn->output.name, modeset ? "modeset" : "pageflip");
 		}
 	}
 
-	drmModeAtomicSetCursor(atom->req, 0);
+	atom->props->len = 0;
 
+	// Callers classify the failure of the first commit
+	errno = error;
 	return !ret;
 }
 
-static inline void atomic_add(struct atomic *atom, uint32_t id, uint32_t prop, uint64_t val) {
-	if (!atom->failed && drmModeAtomicAddProperty(atom->req, id, prop, val) < 0) {
+static void atomic_add_prop(struct atomic *atom, uint32_t id, uint32_t prop,
+		uint64_t val, bool force) {
+	if (!atom->failed && !prop_list_append(atom->props, id, prop, val, force)) {
 		wlr_log_errno(WLR_ERROR, "Failed to add atomic DRM property");
 		atom->failed = true;
 	}
 }
 
+static inline void atomic_add(struct atomic *atom, uint32_t id, uint32_t prop, uint64_t val) {
+	atomic_add_prop(atom, id, prop, val, false);
+}
+
+// Adds a property which is committed even if unchanged, because committing
+// it has side effects or it may change behind our back
+static inline void atomic_add_forced(struct atomic *atom, uint32_t id,
+		uint32_t prop, uint64_t val) {
+	atomic_add_prop(atom, id, prop, val, true);
+}
+
 static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
 		uint32_t crtc_id, uint32_t fb_id, bool set_crtc_xy) {
 	uint32_t id = plane->id;
@@ -87,7 +224,8 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
 	atomic_add(atom, id, props->src_h, (uint64_t)plane->surf.height << 16);
 	atomic_add(atom, id, props->crtc_w, plane->surf.width);
 	atomic_add(atom, id, props->crtc_h, plane->surf.height);
-	atomic_add(atom, id, props->fb_id, fb_id);
+	// Page-flip events need the plane in the request
+	atomic_add_forced(atom, id, props->fb_id, fb_id);
 	atomic_add(atom, id, props->crtc_id, crtc_id);
 	if (set_crtc_xy) {
 		atomic_add(atom, id, props->crtc_x, 0);
@@ -95,6 +233,105 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
 	}
 }
 
+static void add_crtc_flip_props(struct atomic *atom,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t mode_id, uint32_t fb_id, bool modeset) {
+	atomic_add(atom, conn->id, conn->props.crtc_id, crtc->id);
+	if (modeset && conn->props.link_status != 0) {
+		atomic_add(atom, conn->id, conn->props.link_status,
+			DRM_MODE_LINK_STATUS_GOOD);
+	}
+	atomic_add(atom, crtc->id, crtc->props.mode_id, mode_id);
+	atomic_add(atom, crtc->id, crtc->props.active, 1);
+	set_plane_props(atom, crtc->primary, crtc->id, fb_id, true);
+}
+
+static void add_fence_props(struct atomic *atom,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_plane *plane = crtc->primary;
+	if (conn->in_fence_fd < 0 || plane->props.in_fence_fd == 0) {
+		return;
+	}
+
+	atomic_add_forced(atom, plane->id, plane->props.in_fence_fd,
+		conn->in_fence_fd);
+	if (crtc->props.out_fence_ptr != 0) {
+		// The kernel writes the fence to out_fence_fd on commit
+		conn->out_fence_fd = -1;
+		atomic_add_forced(atom, crtc->id, crtc->props.out_fence_ptr,
+			(uintptr_t)&conn->out_fence_fd);
+	}
+}
+
+static void drop_pending_gamma(struct wlr_drm_crtc *crtc) {
+	free(crtc->pending_gamma);
+	crtc->pending_gamma = NULL;
+	crtc->pending_gamma_len = 0;
+	crtc->gamma_pending = false;
+}
+
+// Returns true if the pending LUT has been added to the request, in which
+// case blob_id is set to its blob, or to 0 for a reset
+static bool add_gamma_props(struct wlr_drm_backend *drm,
+		struct atomic *atom, struct wlr_drm_crtc *crtc, bool modeset,
+		uint32_t *blob_id) {
+	*blob_id = 0;
+	if (crtc->gamma_pending) {
+		if (crtc->pending_gamma_len == 0) {
+			atomic_add(atom, crtc->id, crtc->props.gamma_lut, 0);
+			return true;
+		}
+		if (drmModeCreatePropertyBlob(drm->fd, crtc->pending_gamma,
+				crtc->pending_gamma_len * sizeof(struct drm_color_lut),
+				blob_id) == 0) {
+			atomic_add(atom, crtc->id, crtc->props.gamma_lut, *blob_id);
+			return true;
+		}
+		// Don't try again on each page-flip
+		wlr_log_errno(WLR_ERROR, "Unable to create property blob");
+		*blob_id = 0;
+		drop_pending_gamma(crtc);
+	}
+
+	// The kernel may have lost the LUT while another DRM master was active
+	if (modeset && crtc->gamma_lut != 0) {
+		atomic_add(atom, crtc->id, crtc->props.gamma_lut, crtc->gamma_lut);
+	}
+	return false;
+}
+
+// error is the errno of the failed commit
+static void finish_gamma(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool staged, uint32_t blob_id, bool ok,
+		int error) {
+	if (!staged) {
+		return;
+	}
+
+	if (!ok) {
+		if (blob_id != 0) {
+			drmModeDestroyPropertyBlob(drm->fd, blob_id);
+		}
+		// Drop a LUT the kernel rejected, instead of failing every page-flip.
+		// Other failures, e.g. EBUSY, are transient: retry with the next one.
+		if (error == EINVAL) {
+			drop_pending_gamma(crtc);
+		}
+		return;
+	}
+
+	if (crtc->gamma_lut != 0) {
+		drmModeDestroyPropertyBlob(drm->fd, crtc->gamma_lut);
+	}
+	crtc->gamma_lut = blob_id;
+	free(crtc->gamma_data);
+	crtc->gamma_data = crtc->pending_gamma;
+	crtc->gamma_data_len = crtc->pending_gamma_len;
+	crtc->pending_gamma = NULL;
+	crtc->pending_gamma_len = 0;
+	crtc->gamma_pending = false;
+}
+
 static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn,
 		struct wlr_drm_crtc *crtc,
@@ -116,19 +353,164 @@ static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
 	} else {
 		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+		if (conn->flip_async) {
+			flags |= DRM_MODE_PAGE_FLIP_ASYNC;
+		}
 	}
 
 	struct atomic atom;
 	atomic_begin(crtc, &atom);
-	atomic_add(&atom, conn->id, conn->props.crtc_id, crtc->id);
-	if (mode != NULL && conn->props.link_status != 0) {
-		atomic_add(&atom, conn->id, conn->props.link_status,
-			DRM_MODE_LINK_STATUS_GOOD);
+	add_crtc_flip_props(&atom, conn, crtc, crtc->mode_id, fb_id, mode != NULL);
+	add_fence_props(&atom, conn, crtc);
+	uint32_t gamma_id;
+	bool gamma_staged =
+		add_gamma_props(drm, &atom, crtc, mode != NULL, &gamma_id);
+	bool ok = atomic_commit(drm, &atom, conn, flags, mode);
+	int error = errno;
+	finish_gamma(drm, crtc, gamma_staged, gamma_id, ok, error);
+	errno = error;
+	return ok;
+}
+
+static bool atomic_crtc_adopt_mode(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, drmModeModeInfo *mode) {
+	// The kernel compares the blob contents, a blob matching the current
+	// mode doesn't require a modeset
+	uint32_t mode_id;
+	if (drmModeCreatePropertyBlob(drm->fd, mode, sizeof(*mode), &mode_id)) {
+		wlr_log_errno(WLR_ERROR, "Unable to create property blob");
+		return false;
 	}
-	atomic_add(&atom, crtc->id, crtc->props.mode_id, crtc->mode_id);
-	atomic_add(&atom, crtc->id, crtc->props.active, 1);
-	set_plane_props(&atom, crtc->primary, crtc->id, fb_id, true);
-	return atomic_commit(drm->fd, &atom, conn, flags, mode);
+	if (crtc->mode_id != 0) {
+		drmModeDestroyPropertyBlob(drm->fd, crtc->mode_id);
+	}
+	crtc->mode_id = mode_id;
+	return true;
+}
+
+static bool atomic_crtc_test(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id, drmModeModeInfo *mode) {
+	uint32_t mode_id = crtc->mode_id;
+	if (mode != NULL && drmModeCreatePropertyBlob(drm->fd, mode,
+			sizeof(*mode), &mode_id)) {
+		wlr_log_errno(WLR_ERROR, "Unable to create property blob");
+		return false;
+	}
+
+	// The kernel refuses to send events for test-only commits
+	uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+	if (mode != NULL) {
+		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+	} else {
+		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+	}
+
+	struct atomic atom;
+	atomic_begin(crtc, &atom);
+	add_crtc_flip_props(&atom, conn, crtc, mode_id, fb_id, mode != NULL);
+	bool ok = !atom.failed &&
+		commit_props(drm, &atom.props, 1, flags, NULL) == 0;
+	atomic_rollback(&atom);
+
+	if (mode != NULL) {
+		drmModeDestroyPropertyBlob(drm->fd, mode_id);
+	}
+	return ok;
+}
+
+static bool atomic_group_test(struct wlr_drm_backend *drm, size_t len,
+		struct wlr_drm_connector *conns[static len],
+		const uint32_t fb_ids[static len],
+		drmModeModeInfo *modes[static len]) {
+	struct wlr_drm_prop_list *lists[len];
+	size_t cursors[len];
+	uint32_t mode_ids[len];
+	bool ok = true;
+	size_t n = 0;
+	while (n < len) {
+		struct wlr_drm_crtc *crtc = conns[n]->crtc;
+		if (drmModeCreatePropertyBlob(drm->fd, modes[n], sizeof(*modes[n]),
+				&mode_ids[n])) {
+			wlr_log_errno(WLR_ERROR, "Unable to create property blob");
+			ok = false;
+			break;
+		}
+
+		struct atomic atom;
+		atomic_begin(crtc, &atom);
+		cursors[n] = atom.cursor;
+		add_crtc_flip_props(&atom, conns[n], crtc, mode_ids[n], fb_ids[n],
+			true);
+		lists[n] = atom.props;
+		n++;
+		if (atom.failed) {
+			ok = false;
+			break;
+		}
+	}
+
+	// The kernel refuses to send events for test-only commits
+	uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET;
+	if (ok && commit_props(drm, lists, len, flags, NULL)) {
+		wlr_log_errno(WLR_DEBUG, "Atomic test failed (%zu modesets)", len);
+		ok = false;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		conns[i]->crtc->atomic.len = cursors[i];
+		drmModeDestroyPropertyBlob(drm->fd, mode_ids[i]);
+	}
+	return ok;
+}
+
+static bool atomic_group_pageflip(struct wlr_drm_backend *drm, size_t len,
+		struct wlr_drm_connector *conns[static len],
+		const uint32_t fb_ids[static len]) {
+	// Each CRTC's request may already hold cursor and plane updates waiting
+	// for the next page-flip, commit them all
+	struct wlr_drm_prop_list *lists[len];
+	size_t cursors[len];
+	uint32_t gamma_ids[len];
+	bool gamma_staged[len];
+	bool ok = true;
+	for (size_t i = 0; i < len; ++i) {
+		struct wlr_drm_crtc *crtc = conns[i]->crtc;
+
+		struct atomic atom;
+		atomic_begin(crtc, &atom);
+		cursors[i] = atom.cursor;
+		add_crtc_flip_props(&atom, conns[i], crtc, crtc->mode_id, fb_ids[i],
+			false);
+		add_fence_props(&atom, conns[i], crtc);
+		gamma_staged[i] =
+			add_gamma_props(drm, &atom, crtc, false, &gamma_ids[i]);
+		lists[i] = atom.props;
+		if (atom.failed) {
+			ok = false;
+		}
+	}
+
+	// Events for all CRTCs carry the first connector, page_flip_handler finds
+	// the others through the CRTC id
+	uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
+	int error = 0;
+	if (ok && commit_props(drm, lists, len, flags, conns[0])) {
+		error = errno;
+		wlr_log_errno(WLR_ERROR, "Atomic commit failed (%zu grouped pageflips)",
+			len);
+		ok = false;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		struct wlr_drm_crtc *crtc = conns[i]->crtc;
+		crtc->atomic.len = ok ? 0 : cursors[i];
+		// Each output retries on its own, where a bad LUT is dropped
+		finish_gamma(drm, crtc, gamma_staged[i], gamma_ids[i], ok, 0);
+	}
+	errno = error;
+
+	return ok;
 }
 
 static bool atomic_conn_enable(struct wlr_drm_backend *drm,
@@ -148,10 +530,26 @@ static bool atomic_conn_enable(struct wlr_drm_backend *drm,
 		atomic_add(&atom, conn->id, conn->props.crtc_id, 0);
 		atomic_add(&atom, crtc->id, crtc->props.mode_id, 0);
 	}
-	return atomic_commit(drm->fd, &atom, conn, DRM_MODE_ATOMIC_ALLOW_MODESET,
+	return atomic_commit(drm, &atom, conn, DRM_MODE_ATOMIC_ALLOW_MODESET,
 		true);
 }
 
+static bool atomic_conn_set_dpms(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, bool on) {
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (crtc == NULL) {
+		return false;
+	}
+
+	// Only toggle ACTIVE: the connector, mode and planes stay assigned, so
+	// the kernel doesn't need to redo the whole modeset on wake-up
+	struct atomic atom;
+	atomic_begin(crtc, &atom);
+	atomic_add(&atom, crtc->id, crtc->props.active, on);
+	return atomic_commit(drm, &atom, conn, DRM_MODE_ATOMIC_ALLOW_MODESET,
+		false);
+}
+
 bool legacy_crtc_set_cursor(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, struct gbm_bo *bo);
 
@@ -179,7 +577,41 @@ static bool atomic_crtc_set_cursor(struct wlr_drm_backend *drm,
 		atomic_add(&atom, plane->id, plane->props.crtc_id, 0);
 	}
 
-	return atomic_end(drm->fd, &atom);
+	return atomic_end(drm, &atom);
+}
+
+static bool atomic_crtc_set_overlay(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, uint32_t fb_id,
+		uint32_t src_w, uint32_t src_h, const struct wlr_box *box) {
+	if (!crtc || !crtc->overlay) {
+		return false;
+	}
+
+	struct wlr_drm_plane *plane = crtc->overlay;
+	uint32_t id = plane->id;
+	const union wlr_drm_plane_props *props = &plane->props;
+
+	struct atomic atom;
+	atomic_begin(crtc, &atom);
+
+	if (fb_id != 0) {
+		// The src_* properties are in 16.16 fixed point
+		atomic_add(&atom, id, props->src_x, 0);
+		atomic_add(&atom, id, props->src_y, 0);
+		atomic_add(&atom, id, props->src_w, (uint64_t)src_w << 16);
+		atomic_add(&atom, id, props->src_h, (uint64_t)src_h << 16);
+		atomic_add(&atom, id, props->crtc_x, box->x);
+		atomic_add(&atom, id, props->crtc_y, box->y);
+		atomic_add(&atom, id, props->crtc_w, box->width);
+		atomic_add(&atom, id, props->crtc_h, box->height);
+		atomic_add(&atom, id, props->fb_id, fb_id);
+		atomic_add(&atom, id, props->crtc_id, crtc->id);
+	} else {
+		atomic_add(&atom, id, props->fb_id, 0);
+		atomic_add(&atom, id, props->crtc_id, 0);
+	}
+
+	return atomic_end(drm, &atom);
 }
 
 bool legacy_crtc_move_cursor(struct wlr_drm_backend *drm,
@@ -200,9 +632,10 @@ static bool atomic_crtc_move_cursor(struct wlr_drm_backend *drm,
 	struct atomic atom;
 
 	atomic_begin(crtc, &atom);
-	atomic_add(&atom, plane->id, plane->props.crtc_x, x);
-	atomic_add(&atom, plane->id, plane->props.crtc_y, y);
-	return atomic_end(drm->fd, &atom);
+	// wlr_drm_connector_move_cursor_async moves the cursor behind our back
+	atomic_add_forced(&atom, plane->id, plane->props.crtc_x, x);
+	atomic_add_forced(&atom, plane->id, plane->props.crtc_y, y);
+	return atomic_end(drm, &atom);
 }
 
 static bool atomic_crtc_set_gamma(struct wlr_drm_backend *drm,
@@ -218,6 +651,15 @@ static bool atomic_crtc_set_gamma(struct wlr_drm_backend *drm,
 		return legacy_iface.crtc_set_gamma(drm, crtc, size, r, g, b);
 	}
 
+	// The LUT is only submitted with the next page-flip, so that animated
+	// gamma changes don't each cost an extra commit
+	if (size == 0) {
+		drop_pending_gamma(crtc);
+		// Reset gamma, unless it already is
+		crtc->gamma_pending = crtc->gamma_lut != 0;
+		return true;
+	}
+
 	struct drm_color_lut *gamma = malloc(size * sizeof(struct drm_color_lut));
 	if (gamma == NULL) {
 		wlr_log(WLR_ERROR, "Failed to allocate gamma table");
@@ -230,22 +672,54 @@ static bool atomic_crtc_set_gamma(struct wlr_drm_backend *drm,
 		gamma[i].blue = b[i];
 	}
 
-	if (crtc->gamma_lut != 0) {
-		drmModeDestroyPropertyBlob(drm->fd, crtc->gamma_lut);
+	// A LUT identical to the current one keeps using the existing blob
+	drop_pending_gamma(crtc);
+	if (crtc->gamma_lut != 0 && crtc->gamma_data != NULL &&
+			crtc->gamma_data_len == size &&
+			memcmp(crtc->gamma_data, gamma,
+				size * sizeof(struct drm_color_lut)) == 0) {
+		free(gamma);
+		return true;
 	}
 
-	if (drmModeCreatePropertyBlob(drm->fd, gamma,
-			size * sizeof(struct drm_color_lut), &crtc->gamma_lut)) {
-		free(gamma);
-		wlr_log_errno(WLR_ERROR, "Unable to create property blob");
+	crtc->pending_gamma = gamma;
+	crtc->pending_gamma_len = size;
+	crtc->gamma_pending = true;
+	return true;
+}
+
+static bool atomic_crtc_set_vrr(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool enabled) {
+	if (crtc->props.vrr_enabled == 0) {
 		return false;
 	}
-	free(gamma);
 
 	struct atomic atom;
 	atomic_begin(crtc, &atom);
-	atomic_add(&atom, crtc->id, crtc->props.gamma_lut, crtc->gamma_lut);
-	return atomic_end(drm->fd, &atom);
+	atomic_add(&atom, crtc->id, crtc->props.vrr_enabled, enabled);
+	return atomic_end(drm, &atom);
+}
+
+static bool atomic_crtc_commit_vrr(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool enabled) {
+	// Only this property: the other ones staged on the CRTC wait for the
+	// page-flip they belong to
+	struct wlr_drm_prop_list list = {0};
+	if (!prop_list_append(&list, crtc->id, crtc->props.vrr_enabled, enabled,
+			false)) {
+		wlr_log_errno(WLR_ERROR, "Failed to add atomic DRM property");
+		return false;
+	}
+
+	// Blocking, so that a pending page-flip is waited for instead of failing
+	// with EBUSY
+	struct wlr_drm_prop_list *lists[] = { &list };
+	bool ok = commit_props(drm, lists, 1, 0, NULL) == 0;
+	if (!ok) {
+		wlr_log_errno(WLR_ERROR, "Failed to commit VRR_ENABLED");
+	}
+	free(list.items);
+	return ok;
 }
 
 static size_t atomic_crtc_get_gamma_size(struct wlr_drm_backend *drm,
@@ -266,9 +740,17 @@ static size_t atomic_crtc_get_gamma_size(struct wlr_drm_backend *drm,
 
 const struct wlr_drm_interface atomic_iface = {
 	.conn_enable = atomic_conn_enable,
+	.conn_set_dpms = atomic_conn_set_dpms,
 	.crtc_pageflip = atomic_crtc_pageflip,
+	.crtc_adopt_mode = atomic_crtc_adopt_mode,
+	.crtc_test = atomic_crtc_test,
+	.group_pageflip = atomic_group_pageflip,
+	.group_test = atomic_group_test,
+	.crtc_set_overlay = atomic_crtc_set_overlay,
 	.crtc_set_cursor = atomic_crtc_set_cursor,
 	.crtc_move_cursor = atomic_crtc_move_cursor,
+	.crtc_set_vrr = atomic_crtc_set_vrr,
+	.crtc_commit_vrr = atomic_crtc_commit_vrr,
 	.crtc_set_gamma = atomic_crtc_set_gamma,
 	.crtc_get_gamma_size = atomic_crtc_get_gamma_size,
 };
@@ -14,6 +14,7 @@
 #include <xf86drm.h>
 #include "backend/drm/drm.h"
 #include "util/signal.h"
+#include "util/startup.h"
 
 struct wlr_drm_backend *get_drm_backend_from_backend(
 		struct wlr_backend *wlr_backend) {
@@ -21,9 +22,16 @@ struct wlr_drm_backend *get_drm_backend_from_backend(
 	return (struct wlr_drm_backend *)wlr_backend;
 }
 
+static bool backend_prepare_start(struct wlr_backend *backend) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
+	probe_drm_connectors(drm);
+	return true;
+}
+
 static bool backend_start(struct wlr_backend *backend) {
 	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
-	scan_drm_connectors(drm);
+	scan_drm_connectors(drm, 0);
+	startup_mark("DRM connectors probed");
 	return true;
 }
 
@@ -47,6 +55,12 @@ static void backend_destroy(struct wlr_backend *backend) {
 	wl_list_remove(&drm->session_signal.link);
 	wl_list_remove(&drm->drm_invalidated.link);
 
+	if (drm->group_flush != NULL) {
+		wl_event_source_remove(drm->group_flush);
+	}
+
+	finish_drm_probe_thread(drm);
+	finish_probed_drm_connectors(drm);
 	finish_drm_resources(drm);
 	finish_drm_renderer(&drm->renderer);
 	wlr_session_close_file(drm->session, drm->fd);
@@ -75,6 +89,7 @@ static struct wlr_backend_impl backend_impl = {
 	.destroy = backend_destroy,
 	.get_renderer = backend_get_renderer,
 	.get_presentation_clock = backend_get_presentation_clock,
+	.prepare_start = backend_prepare_start,
 };
 
 bool wlr_backend_is_drm(struct wlr_backend *b) {
@@ -88,13 +103,19 @@ static void session_signal(struct wl_listener *listener, void *data) {
 
 	if (session->active) {
 		wlr_log(WLR_INFO, "DRM fd resumed");
-		scan_drm_connectors(drm);
+		// Another DRM master may have changed any property
+		drm->committed_props.len = 0;
+		scan_drm_connectors(drm, 0);
 
 		struct wlr_drm_connector *conn;
 		wl_list_for_each(conn, &drm->outputs, link){
 			if (conn->output.enabled) {
 				drm_connector_set_mode(&conn->output,
 						conn->output.current_mode);
+				if (conn->output.dpms_off && conn->crtc != NULL) {
+					// The modeset turned the display back on
+					drm->iface->conn_set_dpms(drm, conn, false);
+				}
 			} else {
 				enable_drm_connector(&conn->output, false);
 			}
@@ -105,7 +126,8 @@ static void session_signal(struct wl_listener *listener, void *data) {
 
 			struct wlr_drm_plane *plane = conn->crtc->cursor;
 			drm->iface->crtc_set_cursor(drm, conn->crtc,
-				(plane && plane->cursor_enabled) ? plane->surf.back : NULL);
+				(plane && plane->cursor_current) ?
+					plane->cursor_current->bo : NULL);
 			drm->iface->crtc_move_cursor(drm, conn->crtc, conn->cursor_x,
 				conn->cursor_y);
 
@@ -127,12 +149,26 @@ static void session_signal(struct wl_listener *listener, void *data) {
 static void drm_invalidated(struct wl_listener *listener, void *data) {
 	struct wlr_drm_backend *drm =
 		wl_container_of(listener, drm, drm_invalidated);
+	struct wlr_device_hotplug_event *event = data;
 
 	char *name = drmGetDeviceNameFromFd2(drm->fd);
 	wlr_log(WLR_DEBUG, "%s invalidated", name);
 	free(name);
 
-	scan_drm_connectors(drm);
+	if (event->lease) {
+		scan_drm_leases(drm);
+		return;
+	}
+
+	if (event->connector_id != 0) {
+		// Only the changed connector needs to be probed, which is quick
+		// enough to do right away
+		scan_drm_connectors(drm, event->connector_id);
+	} else {
+		// Probing all connectors can block for a long while, e.g. behind
+		// an MST hub
+		probe_drm_connectors_async(drm);
+	}
 }
 
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
@@ -165,7 +201,14 @@ struct wlr_backend *wlr_drm_backend_create(struct wl_display *display,
 
 	drm->fd = gpu_fd;
 	if (parent != NULL) {
-		drm->parent = get_drm_backend_from_backend(parent);
+		const char *mgpu_render = getenv("WLR_DRM_MGPU_RENDER");
+		if (mgpu_render != NULL && strcmp(mgpu_render, "local") == 0) {
+			// Outputs are rendered with this device's renderer, like on a
+			// primary GPU, and import client buffers from the parent
+			wlr_log(WLR_INFO, "Rendering on secondary GPU");
+		} else {
+			drm->parent = get_drm_backend_from_backend(parent);
+		}
 	}
 
 	drm->drm_invalidated.notify = drm_invalidated;
@@ -5,6 +5,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <gbm.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
@@ -12,13 +13,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <time.h>
+#include <unistd.h>
 #include <wayland-server.h>
 #include <wayland-util.h>
 #include <wlr/backend/interface.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/gles2.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
@@ -26,7 +30,9 @@
 #include "backend/drm/drm.h"
 #include "backend/drm/iface.h"
 #include "backend/drm/util.h"
+#include "render/gbm_allocator.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 bool check_drm_features(struct wlr_drm_backend *drm) {
 	uint64_t cap;
@@ -68,6 +74,41 @@ bool check_drm_features(struct wlr_drm_backend *drm) {
 	int ret = drmGetCap(drm->fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap);
 	drm->clock = (ret == 0 && cap == 1) ? CLOCK_MONOTONIC : CLOCK_REALTIME;
 
+	ret = drmGetCap(drm->fd, DRM_CAP_ADDFB2_MODIFIERS, &cap);
+	drm->addfb2_modifiers = ret == 0 && cap == 1;
+	wlr_log(WLR_DEBUG, "ADDFB2 modifiers %s",
+		drm->addfb2_modifiers ? "supported" : "unsupported");
+
+	if (drm->iface == &atomic_iface) {
+#ifdef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+		ret = drmGetCap(drm->fd, DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP, &cap);
+#else
+		// Older kernel headers predate async atomic commits
+		ret = -1;
+#endif
+	} else {
+		ret = drmGetCap(drm->fd, DRM_CAP_ASYNC_PAGE_FLIP, &cap);
+	}
+	drm->async_page_flip = ret == 0 && cap == 1;
+	wlr_log(WLR_DEBUG, "Async page-flips %s",
+		drm->async_page_flip ? "supported" : "unsupported");
+
+	drm->swapchain_depth = 2;
+	const char *depth = getenv("WLR_DRM_SWAPCHAIN_DEPTH");
+	if (depth && strcmp(depth, "3") == 0) {
+		if (drm->parent) {
+			// Multi-GPU copies go through a second surface per plane
+			wlr_log(WLR_INFO, "Triple buffering is unsupported on "
+				"secondary GPUs, using double buffering");
+		} else {
+			wlr_log(WLR_DEBUG, "Using triple buffering");
+			drm->swapchain_depth = 3;
+		}
+	} else if (depth && strcmp(depth, "2") != 0) {
+		wlr_log(WLR_ERROR, "Invalid WLR_DRM_SWAPCHAIN_DEPTH '%s', "
+			"using double buffering", depth);
+	}
+
 	return true;
 }
 
@@ -78,6 +119,86 @@ static int cmp_plane(const void *arg1, const void *arg2) {
 	return (int)a->type - (int)b->type;
 }
 
+// Collects the format and modifier pairs the plane supports
+static void init_plane_formats(struct wlr_drm_backend *drm,
+		struct wlr_drm_plane *p) {
+	if (p->props.in_formats == 0) {
+		return;
+	}
+
+	size_t len = 0;
+	struct drm_format_modifier_blob *data = get_drm_prop_blob(drm->fd,
+		p->id, p->props.in_formats, &len);
+	if (data == NULL) {
+		return;
+	}
+
+	const uint32_t *formats =
+		(const uint32_t *)((const char *)data + data->formats_offset);
+	const struct drm_format_modifier *mods =
+		(const struct drm_format_modifier *)((const char *)data +
+		data->modifiers_offset);
+
+	// Each modifier has a bitmask of the 64 formats following its offset
+	size_t max_formats = 0;
+	for (uint32_t i = 0; i < data->count_modifiers; ++i) {
+		max_formats += __builtin_popcountll(mods[i].formats);
+	}
+	p->formats = calloc(max_formats, sizeof(*p->formats));
+	p->modifiers = calloc(max_formats, sizeof(*p->modifiers));
+	if (p->formats == NULL || p->modifiers == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(p->formats);
+		free(p->modifiers);
+		p->formats = NULL;
+		p->modifiers = NULL;
+		goto out;
+	}
+
+	for (uint32_t i = 0; i < data->count_modifiers; ++i) {
+		const struct drm_format_modifier *mod = &mods[i];
+		for (uint32_t j = 0; j < 64; ++j) {
+			uint32_t fmt_idx = mod->offset + j;
+			if (fmt_idx >= data->count_formats ||
+					!(mod->formats & ((uint64_t)1 << j))) {
+				continue;
+			}
+
+			p->formats[p->num_formats++] = (struct wlr_dmabuf_format){
+				.format = formats[fmt_idx],
+				.modifier = mod->modifier,
+			};
+		}
+	}
+
+out:
+	free(data);
+}
+
+static bool plane_supports_format(struct wlr_drm_plane *p, uint32_t format) {
+	for (size_t i = 0; i < p->num_drm_formats; ++i) {
+		if (p->drm_formats[i] == format) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Makes format the plane's RGB format and collects the modifiers the plane
+// supports with it
+static void set_plane_format(struct wlr_drm_plane *p, uint32_t format) {
+	p->drm_format = format;
+	p->num_modifiers = 0;
+	if (p->modifiers == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < p->num_formats; ++i) {
+		if (p->formats[i].format == format) {
+			p->modifiers[p->num_modifiers++] = p->formats[i].modifier;
+		}
+	}
+}
+
 static bool init_planes(struct wlr_drm_backend *drm) {
 	drmModePlaneRes *plane_res = drmModeGetPlaneResources(drm->fd);
 	if (!plane_res) {
@@ -141,7 +262,19 @@ static bool init_planes(struct wlr_drm_backend *drm) {
 			drmModeFreePlane(plane);
 			goto error_planes;
 		}
-		p->drm_format = rgb_format;
+		p->drm_formats = calloc(plane->count_formats, sizeof(uint32_t));
+		if (p->drm_formats == NULL && plane->count_formats > 0) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			drmModeFreePlane(plane);
+			goto error_planes;
+		}
+		memcpy(p->drm_formats, plane->formats,
+			plane->count_formats * sizeof(uint32_t));
+		p->num_drm_formats = plane->count_formats;
+
+		init_plane_formats(drm, p);
+		p->default_format = rgb_format;
+		set_plane_format(p, rgb_format);
 
 		drmModeFreePlane(plane);
 	}
@@ -163,6 +296,11 @@ static bool init_planes(struct wlr_drm_backend *drm) {
 	return true;
 
 error_planes:
+	for (size_t i = 0; i < drm->num_planes; ++i) {
+		free(drm->planes[i].formats);
+		free(drm->planes[i].modifiers);
+		free(drm->planes[i].drm_formats);
+	}
 	free(drm->planes);
 error_res:
 	drmModeFreePlaneResources(plane_res);
@@ -219,7 +357,7 @@ void finish_drm_resources(struct wlr_drm_backend *drm) {
 
 	for (size_t i = 0; i < drm->num_crtcs; ++i) {
 		struct wlr_drm_crtc *crtc = &drm->crtcs[i];
-		drmModeAtomicFree(crtc->atomic);
+		free(crtc->atomic.items);
 		drmModeFreeCrtc(crtc->legacy_crtc);
 		if (crtc->mode_id) {
 			drmModeDestroyPropertyBlob(drm->fd, crtc->mode_id);
@@ -227,11 +365,21 @@ void finish_drm_resources(struct wlr_drm_backend *drm) {
 		if (crtc->gamma_lut) {
 			drmModeDestroyPropertyBlob(drm->fd, crtc->gamma_lut);
 		}
+		free(crtc->gamma_data);
+		free(crtc->pending_gamma);
 		free(crtc->gamma_table);
 	}
 
+	for (size_t i = 0; i < drm->num_planes; ++i) {
+		free(drm->planes[i].formats);
+		free(drm->planes[i].modifiers);
+		free(drm->planes[i].drm_formats);
+	}
+
 	free(drm->crtcs);
 	free(drm->planes);
+	free(drm->committed_props.items);
+	drm->committed_props = (struct wlr_drm_prop_list){0};
 }
 
 static struct wlr_drm_connector *get_drm_connector_from_output(
@@ -240,10 +388,495 @@ static struct wlr_drm_connector *get_drm_connector_from_output(
 	return (struct wlr_drm_connector *)wlr_output;
 }
 
+static void drm_fb_clear(struct wlr_drm_fb *fb) {
+	if (fb->bo != NULL) {
+		// Also removes the DRM framebuffer, see get_fb_for_client_bo
+		gbm_bo_destroy(fb->bo);
+	}
+	wlr_buffer_unref(fb->wlr_buf);
+	fb->bo = NULL;
+	fb->wlr_buf = NULL;
+}
+
+static void drm_fb_move(struct wlr_drm_fb *new, struct wlr_drm_fb *old) {
+	drm_fb_clear(new);
+	*new = *old;
+	old->bo = NULL;
+	old->wlr_buf = NULL;
+}
+
+static void drm_cursor_reset_key(struct wlr_drm_cursor *cursor) {
+	if (cursor->texture == NULL) {
+		return;
+	}
+	wl_list_remove(&cursor->texture_destroy.link);
+	wl_list_remove(&cursor->texture_update.link);
+	cursor->texture = NULL;
+}
+
+static void drm_plane_clear_fbs(struct wlr_drm_plane *plane) {
+	drm_fb_clear(&plane->pending_fb);
+	drm_fb_clear(&plane->queued_fb);
+	drm_fb_clear(&plane->current_fb);
+
+	for (size_t i = 0; i < WLR_DRM_CURSOR_CACHE_LEN; ++i) {
+		struct wlr_drm_cursor *cursor = &plane->cursor_cache[i];
+		drm_cursor_reset_key(cursor);
+		finish_drm_surface(&cursor->surf);
+		finish_drm_surface(&cursor->mgpu_surf);
+		cursor->bo = NULL;
+	}
+	for (size_t i = 0; i < 3; ++i) {
+		struct wlr_drm_cursor *cursor = &plane->cursor_pixels[i];
+		if (cursor->bo != NULL) {
+			gbm_bo_destroy(cursor->bo);
+			cursor->bo = NULL;
+		}
+	}
+	plane->cursor_current = NULL;
+	plane->cursor_shown = NULL;
+	plane->cursor_retired = NULL;
+}
+
+static void drm_connector_clear_fbs(struct wlr_drm_connector *conn) {
+	drm_fb_clear(&conn->pending_fb);
+	drm_fb_clear(&conn->queued_fb);
+	drm_fb_clear(&conn->current_fb);
+	if (conn->crtc != NULL && conn->crtc->overlay != NULL) {
+		drm_plane_clear_fbs(conn->crtc->overlay);
+	}
+	if (conn->crtc != NULL && conn->crtc->cursor != NULL) {
+		drm_plane_clear_fbs(conn->crtc->cursor);
+	}
+	if (conn->in_fence_fd >= 0) {
+		close(conn->in_fence_fd);
+		conn->in_fence_fd = -1;
+	}
+}
+
+// Drops the render fence once the page-flip has been submitted and hands the
+// fence signaled by the kernel to the renderer
+static void drm_connector_finish_fences(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+
+	if (conn->in_fence_fd >= 0) {
+		close(conn->in_fence_fd);
+		conn->in_fence_fd = -1;
+	}
+
+	if (conn->out_fence_fd >= 0) {
+		if (conn->crtc != NULL) {
+			struct wlr_drm_plane *plane = conn->crtc->primary;
+			set_drm_surface_release_fence(
+				drm->parent ? &plane->mgpu_surf : &plane->surf,
+				conn->out_fence_fd);
+		} else {
+			close(conn->out_fence_fd);
+		}
+		conn->out_fence_fd = -1;
+	}
+}
+
+static void drm_connector_queue_overlay(struct wlr_drm_connector *conn);
+static void drm_connector_keep_overlay(struct wlr_drm_connector *conn);
+static bool drm_connector_recover_flip(struct wlr_drm_connector *conn,
+	int error, bool modeset);
+
+static void drm_group_flush(void *data) {
+	struct wlr_drm_backend *drm = data;
+	drm->group_flush = NULL;
+
+	size_t len = 0;
+	struct wlr_drm_connector *conns[wl_list_length(&drm->outputs) + 1];
+	uint32_t fb_ids[wl_list_length(&drm->outputs) + 1];
+
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (!conn->group_flip_queued) {
+			continue;
+		}
+		conn->group_flip_queued = false;
+
+		if (conn->state != WLR_DRM_CONN_CONNECTED || conn->crtc == NULL ||
+				!drm->session->active) {
+			conn->pageflip_pending = false;
+			drm_connector_finish_fences(conn);
+			continue;
+		}
+
+		conns[len] = conn;
+		fb_ids[len] = conn->group_fb_id;
+		++len;
+	}
+
+	if (len == 0) {
+		return;
+	}
+
+	if (drm->iface->group_pageflip == NULL ||
+			!drm->iface->group_pageflip(drm, len, conns, fb_ids)) {
+		// Fallback to per-output pageflips
+		for (size_t i = 0; i < len; ++i) {
+			struct wlr_drm_connector *conn = conns[i];
+			if (!drm->iface->crtc_pageflip(drm, conn, conn->crtc, fb_ids[i],
+					NULL)) {
+				int error = errno;
+				conn->pageflip_pending = false;
+				drm_fb_clear(&conn->queued_fb);
+				if (!drm_connector_recover_flip(conn, error, false)) {
+					wlr_output_send_frame(&conn->output);
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		drm_connector_finish_fences(conns[i]);
+	}
+}
+
+// Pageflips the connector's CRTC, or defers it to the group flush if the
+// connector is grouped
+static bool drm_connector_pageflip(struct wlr_drm_connector *conn,
+		uint32_t fb_id) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	if (!conn->grouped) {
+		bool ok = drm->iface->crtc_pageflip(drm, conn, conn->crtc, fb_id, NULL);
+		int error = errno;
+		drm_connector_finish_fences(conn);
+		errno = error;
+		return ok;
+	}
+
+	conn->group_fb_id = fb_id;
+	conn->group_flip_queued = true;
+	if (drm->group_flush == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(drm->display);
+		drm->group_flush = wl_event_loop_add_idle(ev, drm_group_flush, drm);
+	}
+	return true;
+}
+
+bool wlr_drm_connector_set_grouped(struct wlr_output *output, bool grouped) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	uint64_t cap;
+	if (grouped && (drm->iface->group_pageflip == NULL ||
+			drmGetCap(drm->fd, DRM_CAP_CRTC_IN_VBLANK_EVENT, &cap) ||
+			cap == 0)) {
+		wlr_log(WLR_ERROR, "Grouped pageflips unsupported on output '%s'",
+			output->name);
+		return false;
+	}
+
+	conn->grouped = grouped;
+	return true;
+}
+
+bool wlr_drm_connector_set_depth(struct wlr_output *output, int depth) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	if (depth != 30 && depth != 24 && depth != 16) {
+		wlr_log(WLR_ERROR, "Unsupported depth %d for output '%s'", depth,
+			output->name);
+		return false;
+	}
+
+	conn->depth = depth;
+	return true;
+}
+
+bool wlr_drm_connector_move_cursor_async(struct wlr_output *output,
+		int x, int y) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	pthread_mutex_lock(&conn->async_cursor.lock);
+	uint32_t crtc_id = conn->async_cursor.crtc_id;
+	struct wlr_box box = { .x = x, .y = y };
+	wlr_box_transform(&box, &box, conn->async_cursor.transform,
+		conn->async_cursor.width, conn->async_cursor.height);
+	box.x -= conn->async_cursor.hotspot_x;
+	box.y -= conn->async_cursor.hotspot_y;
+	pthread_mutex_unlock(&conn->async_cursor.lock);
+
+	if (crtc_id == 0) {
+		return false;
+	}
+
+	// The legacy cursor ioctl is an asynchronous update on atomic drivers
+	// too, so it doesn't conflict with page-flips committed by the main
+	// thread
+	return drmModeMoveCursor(drm->fd, crtc_id, box.x, box.y) == 0;
+}
+
+const struct wlr_dmabuf_format *wlr_drm_connector_get_scanout_formats(
+		struct wlr_output *output, size_t *len) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	if (conn->crtc == NULL || conn->crtc->primary == NULL) {
+		*len = 0;
+		return NULL;
+	}
+
+	struct wlr_drm_plane *plane = conn->crtc->primary;
+	*len = plane->num_formats;
+	return plane->formats;
+}
+
 static bool drm_connector_make_current(struct wlr_output *output,
 		int *buffer_age) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
-	return make_drm_surface_current(&conn->crtc->primary->surf, buffer_age);
+	// A new frame is going to be rendered, drop any attached buffer
+	drm_fb_clear(&conn->pending_fb);
+	if (!make_drm_surface_current(&conn->crtc->primary->surf, buffer_age)) {
+		return false;
+	}
+	if (buffer_age != NULL && (conn->queued_fb.bo != NULL ||
+			conn->current_fb.bo != NULL)) {
+		// The EGL buffer age doesn't account for directly scanned out client
+		// buffers
+		*buffer_age = -1;
+	}
+	return true;
+}
+
+static bool drm_connector_set_damage_region(struct wlr_output *output,
+		pixman_region32_t *damage) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_surface *surf = &conn->crtc->primary->surf;
+	return wlr_egl_set_damage_region(&surf->renderer->egl, surf->egl, damage);
+}
+
+static void drm_connector_start_renderer(struct wlr_drm_connector *conn,
+	bool reuse_mode);
+static bool drm_connector_schedule_frame(struct wlr_output *output);
+
+static bool drm_connector_link_bad(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	if (conn->props.link_status == 0) {
+		return false;
+	}
+	uint64_t link_status;
+	return get_drm_prop(drm->fd, conn->id, conn->props.link_status,
+		&link_status) && link_status == DRM_MODE_LINK_STATUS_BAD;
+}
+
+// Requests a vblank event for the connector's CRTC, handled by vblank_handler
+static bool drm_connector_wait_vblank(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	uint32_t pipe = conn->crtc - drm->crtcs;
+	drmVBlank vbl = {
+		.request = {
+			.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT,
+			.sequence = 1,
+			.signal = (unsigned long)drm,
+		},
+	};
+	if (pipe == 1) {
+		vbl.request.type |= DRM_VBLANK_SECONDARY;
+	} else if (pipe > 1) {
+		vbl.request.type |= (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT) &
+			DRM_VBLANK_HIGH_CRTC_MASK;
+	}
+	if (drmWaitVBlank(drm->fd, &vbl) != 0) {
+		wlr_log_errno(WLR_DEBUG, "%s: Failed to wait for vblank",
+			conn->output.name);
+		return false;
+	}
+	return true;
+}
+
+// Requests a CRTC sequence event at the next vblank of the connector, handled
+// by sequence_handler
+static bool drm_connector_queue_frame_vblank(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	if (drmCrtcQueueSequence(drm->fd, conn->crtc->id,
+			DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL, (uintptr_t)conn) != 0) {
+		wlr_log_errno(WLR_DEBUG, "%s: Failed to queue CRTC sequence",
+			conn->output.name);
+		return false;
+	}
+	conn->frame_vblank_pending = true;
+	return true;
+}
+
+// Reads the time of the last vblank of the connector's CRTC
+static bool drm_connector_get_vblank_time(struct wlr_drm_connector *conn,
+		struct timespec *when) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	uint64_t seq, ns;
+	// CRTC sequence timestamps are always CLOCK_MONOTONIC
+	if (drm->clock != CLOCK_MONOTONIC ||
+			drmCrtcGetSequence(drm->fd, conn->crtc->id, &seq, &ns) != 0 ||
+			ns == 0) {
+		return false;
+	}
+	when->tv_sec = ns / 1000000000;
+	when->tv_nsec = ns % 1000000000;
+	return true;
+}
+
+// Hands the cursor image to the CRTC, or hides the cursor if NULL
+static bool drm_connector_commit_cursor(struct wlr_drm_connector *conn,
+		struct wlr_drm_cursor *cursor) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!drm->iface->crtc_set_cursor(drm, crtc,
+			cursor != NULL ? cursor->bo : NULL)) {
+		return false;
+	}
+	struct wlr_drm_plane *plane = crtc->cursor;
+	if (plane != NULL && plane->cursor_shown != cursor) {
+		plane->cursor_retired = plane->cursor_shown;
+		plane->cursor_shown = cursor;
+	}
+	return true;
+}
+
+// Applies the cursor updates deferred while a page-flip was pending. Returns
+// false if the cursor image couldn't be updated, in which case the previous
+// one is kept.
+static bool drm_connector_flush_cursor(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	bool ok = true;
+	if (conn->cursor_set_pending) {
+		struct wlr_drm_plane *plane = crtc->cursor;
+		if (!drm_connector_commit_cursor(conn,
+				plane != NULL ? plane->cursor_current : NULL)) {
+			wlr_log_errno(WLR_ERROR, "%s: Failed to set hardware cursor",
+				conn->output.name);
+			if (plane != NULL) {
+				plane->cursor_current = plane->cursor_shown;
+			}
+			ok = false;
+		}
+	}
+	if (conn->cursor_move_pending &&
+			!drm->iface->crtc_move_cursor(drm, crtc, conn->cursor_x,
+				conn->cursor_y)) {
+		wlr_log_errno(WLR_DEBUG, "%s: Failed to move hardware cursor",
+			conn->output.name);
+	}
+	conn->cursor_set_pending = false;
+	conn->cursor_move_pending = false;
+	return ok;
+}
+
+// Presents the last rendered frame without the client buffer and overlay
+// that may have been rejected, if a test-only commit accepts it
+static bool drm_connector_flip_fallback(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	struct wlr_drm_plane *plane = crtc->primary;
+
+	conn->flip_async = false;
+	drm_fb_clear(&conn->queued_fb);
+	if (crtc->overlay != NULL && drm->iface->crtc_set_overlay) {
+		drm_fb_clear(&crtc->overlay->queued_fb);
+		drm->iface->crtc_set_overlay(drm, crtc, 0, 0, 0, NULL);
+	}
+
+	struct gbm_bo *bo = drm->parent ? plane->mgpu_surf.back : plane->surf.back;
+	if (bo == NULL) {
+		return false;
+	}
+	uint32_t fb_id = get_fb_for_bo(bo, plane->drm_format);
+	if (!drm->iface->crtc_test(drm, conn, crtc, fb_id, NULL) ||
+			!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
+		return false;
+	}
+
+	conn->pageflip_pending = true;
+	// The last rendered frame may not be the one that failed
+	wlr_output_damage_whole(&conn->output);
+	return true;
+}
+
+// Recovers from a page-flip of the connector which failed with error, an
+// errno value, and reports it with the output's flip_error event. Returns
+// false if the frame is lost.
+static bool drm_connector_recover_flip(struct wlr_drm_connector *conn,
+		int error, bool modeset) {
+	struct wlr_output_event_flip_error event = {
+		.output = &conn->output,
+		.error = error,
+		.recovery = WLR_OUTPUT_FLIP_RECOVERY_NONE,
+	};
+
+	if (conn->crtc == NULL) {
+		// Nothing to recover
+	} else if (modeset) {
+		if (error == EBUSY && drm_connector_wait_vblank(conn)) {
+			event.recovery = WLR_OUTPUT_FLIP_RECOVERY_RETRY;
+			conn->flip_retry = true;
+			conn->flip_retry_modeset = true;
+		} else {
+			event.recovery = WLR_OUTPUT_FLIP_RECOVERY_DELAYED;
+			wl_event_source_timer_update(conn->retry_pageflip,
+				1000000.0f / conn->output.current_mode->refresh);
+			conn->retry_pageflip_armed = true;
+		}
+	} else if (drm_connector_link_bad(conn)) {
+		wlr_log(WLR_INFO, "Bad link for '%s', retraining", conn->output.name);
+		event.recovery = WLR_OUTPUT_FLIP_RECOVERY_RETRAIN;
+		wl_event_source_timer_update(conn->retry_pageflip, 1);
+		conn->retry_pageflip_armed = true;
+	} else if (error == EBUSY && drm_connector_wait_vblank(conn)) {
+		event.recovery = WLR_OUTPUT_FLIP_RECOVERY_RETRY;
+		conn->flip_retry = true;
+		conn->flip_retry_modeset = false;
+	} else if (error == EINVAL && drm_connector_flip_fallback(conn)) {
+		wlr_log(WLR_INFO, "Page-flip rejected on '%s', presented the "
+			"fallback configuration", conn->output.name);
+		event.recovery = WLR_OUTPUT_FLIP_RECOVERY_FALLBACK;
+	}
+
+	wlr_signal_emit_safe(&conn->output.events.flip_error, &event);
+	return event.recovery != WLR_OUTPUT_FLIP_RECOVERY_NONE;
+}
+
+static void vblank_handler(int fd, unsigned seq,
+		unsigned tv_sec, unsigned tv_usec, void *data) {
+	struct wlr_drm_backend *drm = data;
+
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (!conn->flip_retry) {
+			continue;
+		}
+		conn->flip_retry = false;
+		if (conn->state != WLR_DRM_CONN_CONNECTED || conn->crtc == NULL ||
+				!drm->session->active || conn->pageflip_pending) {
+			continue;
+		}
+
+		wlr_log(WLR_DEBUG, "%s: Retrying pageflip", conn->output.name);
+		if (conn->flip_retry_modeset) {
+			drm_connector_start_renderer(conn, false);
+		} else {
+			// The frame may have been a dropped client buffer
+			wlr_output_damage_whole(&conn->output);
+			if (!drm_connector_schedule_frame(&conn->output)) {
+				wlr_output_send_frame(&conn->output);
+			}
+		}
+	}
+}
+
+static void handle_early_frame(void *data) {
+	struct wlr_drm_connector *conn = data;
+	conn->early_frame = NULL;
+	wlr_output_send_frame(&conn->output);
 }
 
 static bool drm_connector_swap_buffers(struct wlr_output *output,
@@ -260,9 +893,49 @@ static bool drm_connector_swap_buffers(struct wlr_output *output,
 	}
 	struct wlr_drm_plane *plane = crtc->primary;
 
+	if (conn->pending_fb.bo != NULL) {
+		if (conn->pageflip_pending) {
+			wlr_log(WLR_ERROR, "Skipping pageflip on output '%s'",
+				conn->output.name);
+			drm_fb_clear(&conn->pending_fb);
+			return false;
+		}
+
+		drm_connector_queue_overlay(conn);
+		uint32_t fb_id = get_fb_for_client_bo(conn->pending_fb.bo);
+		// Drivers can only flip the primary plane asynchronously
+		conn->flip_async = output->tearing && drm->async_page_flip &&
+			!conn->grouped && (crtc->overlay == NULL ||
+				crtc->overlay->queued_fb.bo == NULL);
+		bool ok = drm_connector_pageflip(conn, fb_id);
+		if (!ok && conn->flip_async) {
+			wlr_log_errno(WLR_DEBUG, "%s: Async page-flip failed, "
+				"retrying synchronized", output->name);
+			conn->flip_async = false;
+			ok = drm_connector_pageflip(conn, fb_id);
+		}
+		if (!ok) {
+			int error = errno;
+			drm_fb_clear(&conn->pending_fb);
+			return drm_connector_recover_flip(conn, error, false);
+		}
+
+		drm_fb_move(&conn->queued_fb, &conn->pending_fb);
+		conn->pageflip_pending = true;
+		wlr_output_update_enabled(output, true);
+		return true;
+	}
+
+	if (conn->pageflip_pending && drm->swapchain_depth > 2) {
+		// Submitted by the page-flip handler once the previous frame is on
+		// screen
+		queue_drm_surface_buffers(&plane->surf, damage);
+		return true;
+	}
+
 	struct gbm_bo *bo = swap_drm_surface_buffers(&plane->surf, damage);
 	if (drm->parent) {
-		bo = copy_drm_surface_mgpu(&plane->mgpu_surf, bo);
+		bo = copy_drm_surface_mgpu(&plane->mgpu_surf, bo, damage);
 	}
 	uint32_t fb_id = get_fb_for_bo(bo, plane->drm_format);
 
@@ -271,12 +944,24 @@ static bool drm_connector_swap_buffers(struct wlr_output *output,
 		return false;
 	}
 
-	if (!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
-		return false;
+	// Let the kernel wait for rendering to complete instead of relying on
+	// implicit synchronization
+	conn->in_fence_fd = take_drm_surface_fence(
+		drm->parent ? &plane->mgpu_surf : &plane->surf);
+
+	drm_connector_queue_overlay(conn);
+	if (!drm_connector_pageflip(conn, fb_id)) {
+		return drm_connector_recover_flip(conn, errno, false);
 	}
 
 	conn->pageflip_pending = true;
 	wlr_output_update_enabled(output, true);
+	if (drm->swapchain_depth > 2 && conn->early_frame == NULL) {
+		// Start rendering the next frame without waiting for the page-flip
+		struct wl_event_loop *ev = wl_display_get_event_loop(drm->display);
+		conn->early_frame = wl_event_loop_add_idle(ev,
+			handle_early_frame, conn);
+	}
 	return true;
 }
 
@@ -286,87 +971,347 @@ static void fill_empty_gamma_table(size_t size,
 		uint16_t val = (uint32_t)0xffff * i / (size - 1);
 		r[i] = g[i] = b[i] = val;
 	}
-}
+}
+
+static size_t drm_connector_get_gamma_size(struct wlr_output *output) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	if (conn->crtc) {
+		return drm->iface->crtc_get_gamma_size(drm, conn->crtc);
+	}
+
+	return 0;
+}
+
+bool set_drm_connector_gamma(struct wlr_output *output, size_t size,
+		const uint16_t *r, const uint16_t *g, const uint16_t *b) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	if (!conn->crtc) {
+		return false;
+	}
+
+	bool reset = false;
+	if (size == 0) {
+		reset = true;
+		size = drm_connector_get_gamma_size(output);
+		if (size == 0) {
+			return false;
+		}
+	}
+
+	uint16_t *gamma_table = malloc(3 * size * sizeof(uint16_t));
+	if (gamma_table == NULL) {
+		wlr_log(WLR_ERROR, "Failed to allocate gamma table");
+		return false;
+	}
+	uint16_t *_r = gamma_table;
+	uint16_t *_g = gamma_table + size;
+	uint16_t *_b = gamma_table + 2 * size;
+
+	if (reset) {
+		fill_empty_gamma_table(size, _r, _g, _b);
+	} else {
+		memcpy(_r, r, size * sizeof(uint16_t));
+		memcpy(_g, g, size * sizeof(uint16_t));
+		memcpy(_b, b, size * sizeof(uint16_t));
+	}
+
+	bool ok = drm->iface->crtc_set_gamma(drm, conn->crtc, size, _r, _g, _b);
+	if (ok) {
+		wlr_output_update_needs_swap(output);
+
+		free(conn->crtc->gamma_table);
+		conn->crtc->gamma_table = gamma_table;
+		conn->crtc->gamma_table_size = size;
+	} else {
+		free(gamma_table);
+	}
+	return ok;
+}
+
+static bool drm_connector_export_dmabuf(struct wlr_output *output,
+		struct wlr_dmabuf_attributes *attribs) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	if (!drm->session->active) {
+		return false;
+	}
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc) {
+		return false;
+	}
+	struct wlr_drm_plane *plane = crtc->primary;
+	struct wlr_drm_surface *surf = &plane->surf;
+
+	// Client buffers being scanned out directly never hit the GL surface
+	if (conn->queued_fb.bo != NULL) {
+		return export_gbm_bo(conn->queued_fb.bo, attribs);
+	} else if (!conn->pageflip_pending && conn->current_fb.bo != NULL) {
+		return export_gbm_bo(conn->current_fb.bo, attribs);
+	}
+
+	return export_gbm_bo(surf->back, attribs);
+}
+
+// Imports a linux-dmabuf client buffer for scan-out
+static struct gbm_bo *import_client_buffer(struct wlr_drm_backend *drm,
+		struct wlr_buffer *buffer) {
+	struct wlr_dmabuf_attributes attribs;
+	if (!wlr_buffer_get_dmabuf(buffer, &attribs)) {
+		return NULL;
+	}
+	if (attribs.flags != 0) {
+		return NULL;
+	}
+
+	struct gbm_bo *bo;
+	if (attribs.modifier != DRM_FORMAT_MOD_INVALID || attribs.n_planes > 1) {
+		struct gbm_import_fd_modifier_data data = {
+			.width = attribs.width,
+			.height = attribs.height,
+			.format = attribs.format,
+			.num_fds = attribs.n_planes,
+			.modifier = attribs.modifier,
+		};
+		for (int i = 0; i < attribs.n_planes; ++i) {
+			data.fds[i] = attribs.fd[i];
+			data.strides[i] = attribs.stride[i];
+			data.offsets[i] = attribs.offset[i];
+		}
+		bo = gbm_bo_import(drm->renderer.gbm, GBM_BO_IMPORT_FD_MODIFIER,
+			&data, GBM_BO_USE_SCANOUT);
+	} else {
+		struct gbm_import_fd_data data = {
+			.fd = attribs.fd[0],
+			.width = attribs.width,
+			.height = attribs.height,
+			.stride = attribs.stride[0],
+			.format = attribs.format,
+		};
+		bo = gbm_bo_import(drm->renderer.gbm, GBM_BO_IMPORT_FD,
+			&data, GBM_BO_USE_SCANOUT);
+	}
+	if (bo == NULL) {
+		wlr_log(WLR_DEBUG, "Failed to import client buffer for scan-out");
+		return NULL;
+	}
+
+	if (get_fb_for_client_bo(bo) == 0) {
+		gbm_bo_destroy(bo);
+		return NULL;
+	}
+
+	return bo;
+}
+
+// The overlay on screen stays there across a page-flip without new content
+static void drm_connector_keep_overlay(struct wlr_drm_connector *conn) {
+	struct wlr_drm_plane *plane = conn->crtc->overlay;
+	if (plane != NULL) {
+		drm_fb_move(&plane->queued_fb, &plane->current_fb);
+	}
+}
+
+static bool drm_connector_attach_buffer(struct wlr_output *output,
+		struct wlr_buffer *buffer) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	if (!drm->session->active || conn->state != WLR_DRM_CONN_CONNECTED) {
+		return false;
+	}
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc) {
+		return false;
+	}
+
+	// Multi-GPU setups would need a copy anyway, and the cursor and primary
+	// plane matrices assume an untransformed buffer
+	if (drm->parent || output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
+
+	struct gbm_bo *bo = import_client_buffer(drm, buffer);
+	if (bo == NULL) {
+		return false;
+	}
+	if ((int32_t)gbm_bo_get_width(bo) != output->width ||
+			(int32_t)gbm_bo_get_height(bo) != output->height) {
+		gbm_bo_destroy(bo);
+		return false;
+	}
+
+	uint32_t fb_id = get_fb_for_client_bo(bo);
+	if (!drm->iface->crtc_test(drm, conn, crtc, fb_id, NULL)) {
+		gbm_bo_destroy(bo);
+		return false;
+	}
+
+	drm_fb_clear(&conn->pending_fb);
+	conn->pending_fb.bo = bo;
+	conn->pending_fb.wlr_buf = wlr_buffer_ref(buffer);
+	return true;
+}
+
+static size_t drm_connector_assign_overlays(struct wlr_output *output,
+		struct wlr_output_overlay *overlays, size_t len) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	if (!drm->session->active || conn->state != WLR_DRM_CONN_CONNECTED) {
+		return 0;
+	}
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc || !crtc->overlay || !drm->iface->crtc_set_overlay) {
+		return 0;
+	}
+	if (drm->parent || output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return 0;
+	}
+
+	struct wlr_drm_plane *plane = crtc->overlay;
+	drm_fb_clear(&plane->pending_fb);
+
+	// Each CRTC gets at most one overlay plane, see realloc_planes
+	for (size_t i = 0; i < len; ++i) {
+		struct wlr_output_overlay *overlay = &overlays[i];
+		struct wlr_box *box = &overlay->box;
+		if (box->width <= 0 || box->height <= 0 || box->x < 0 || box->y < 0 ||
+				box->x + box->width > output->width ||
+				box->y + box->height > output->height) {
+			continue;
+		}
+
+		struct gbm_bo *bo = import_client_buffer(drm, overlay->buffer);
+		if (bo == NULL) {
+			continue;
+		}
+
+		uint32_t fb_id = get_fb_for_client_bo(bo);
+		if (!drm->iface->crtc_set_overlay(drm, crtc, fb_id,
+				gbm_bo_get_width(bo), gbm_bo_get_height(bo), box)) {
+			gbm_bo_destroy(bo);
+			continue;
+		}
+
+		plane->pending_fb.bo = bo;
+		plane->pending_fb.wlr_buf = wlr_buffer_ref(overlay->buffer);
+		overlay->accepted = true;
+		return 1;
+	}
 
-static size_t drm_connector_get_gamma_size(struct wlr_output *output) {
-	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
-	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	return 0;
+}
 
-	if (conn->crtc) {
-		return drm->iface->crtc_get_gamma_size(drm, conn->crtc);
+// Submits the overlay assigned for this frame along with the next page-flip,
+// or removes the overlay currently on screen if none has been assigned
+static void drm_connector_queue_overlay(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_plane *plane = conn->crtc->overlay;
+	if (plane == NULL || !drm->iface->crtc_set_overlay) {
+		return;
 	}
 
-	return 0;
+	if (plane->pending_fb.bo == NULL && (plane->queued_fb.bo != NULL ||
+			plane->current_fb.bo != NULL)) {
+		drm->iface->crtc_set_overlay(drm, conn->crtc, 0, 0, 0, NULL);
+	}
+	drm_fb_move(&plane->queued_fb, &plane->pending_fb);
 }
 
-bool set_drm_connector_gamma(struct wlr_output *output, size_t size,
-		const uint16_t *r, const uint16_t *g, const uint16_t *b) {
+static bool drm_connector_set_adaptive_sync(struct wlr_output *output,
+		bool enabled) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
 	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
-
-	if (!conn->crtc) {
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc) {
 		return false;
 	}
 
-	bool reset = false;
-	if (size == 0) {
-		reset = true;
-		size = drm_connector_get_gamma_size(output);
-		if (size == 0) {
-			return false;
-		}
+	if (enabled && !conn->vrr_capable) {
+		wlr_log(WLR_DEBUG, "Output '%s' doesn't support adaptive sync",
+			output->name);
+		return false;
 	}
 
-	uint16_t *gamma_table = malloc(3 * size * sizeof(uint16_t));
-	if (gamma_table == NULL) {
-		wlr_log(WLR_ERROR, "Failed to allocate gamma table");
+	bool was_enabled =
+		output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+	if (!drm->iface->crtc_set_vrr(drm, crtc, enabled)) {
 		return false;
 	}
-	uint16_t *_r = gamma_table;
-	uint16_t *_g = gamma_table + size;
-	uint16_t *_b = gamma_table + 2 * size;
-
-	if (reset) {
-		fill_empty_gamma_table(size, _r, _g, _b);
-	} else {
-		memcpy(_r, r, size * sizeof(uint16_t));
-		memcpy(_g, g, size * sizeof(uint16_t));
-		memcpy(_b, b, size * sizeof(uint16_t));
+	// An idle output may not page-flip for a long time, so don't wait for the
+	// next page-flip to apply the change
+	if (output->enabled && drm->iface->crtc_commit_vrr != NULL &&
+			!drm->iface->crtc_commit_vrr(drm, crtc, enabled)) {
+		drm->iface->crtc_set_vrr(drm, crtc, was_enabled);
+		return false;
 	}
 
-	bool ok = drm->iface->crtc_set_gamma(drm, conn->crtc, size, _r, _g, _b);
-	if (ok) {
-		wlr_output_update_needs_swap(output);
-
-		free(conn->crtc->gamma_table);
-		conn->crtc->gamma_table = gamma_table;
-		conn->crtc->gamma_table_size = size;
-	} else {
-		free(gamma_table);
-	}
-	return ok;
+	output->adaptive_sync_status = enabled ?
+		WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED : WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED;
+	wlr_log(WLR_DEBUG, "Adaptive sync %s on output '%s'",
+		enabled ? "enabled" : "disabled", output->name);
+	return true;
 }
 
-static bool drm_connector_export_dmabuf(struct wlr_output *output,
-		struct wlr_dmabuf_attributes *attribs) {
-	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
-	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+static bool drm_mode_timings_equal(const drmModeModeInfo *a,
+		const drmModeModeInfo *b) {
+	return a->clock == b->clock &&
+		a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start &&
+		a->hsync_end == b->hsync_end && a->htotal == b->htotal &&
+		a->hskew == b->hskew &&
+		a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start &&
+		a->vsync_end == b->vsync_end && a->vtotal == b->vtotal &&
+		a->vscan == b->vscan && a->flags == b->flags;
+}
 
-	if (!drm->session->active) {
+// Checks whether the connector is already lit up by crtc in mode, which is
+// the case when taking over from the boot splash or coming back to our VT.
+// The kernel state is read rather than old_crtc, which goes stale once
+// another DRM master had the device.
+static bool crtc_shows_mode(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		const drmModeModeInfo *mode) {
+	drmModeConnector *drm_conn = drmModeGetConnectorCurrent(drm->fd, conn->id);
+	if (!drm_conn) {
 		return false;
 	}
-
-	struct wlr_drm_crtc *crtc = conn->crtc;
-	if (!crtc) {
+	drmModeEncoder *enc = drmModeGetEncoder(drm->fd, drm_conn->encoder_id);
+	drmModeFreeConnector(drm_conn);
+	if (!enc) {
+		return false;
+	}
+	uint32_t crtc_id = enc->crtc_id;
+	drmModeFreeEncoder(enc);
+	if (crtc_id != crtc->id) {
 		return false;
 	}
-	struct wlr_drm_plane *plane = crtc->primary;
-	struct wlr_drm_surface *surf = &plane->surf;
 
-	return export_drm_bo(surf->back, attribs);
+	drmModeCrtc *current = drmModeGetCrtc(drm->fd, crtc->id);
+	if (!current) {
+		return false;
+	}
+	bool same = current->mode_valid &&
+		drm_mode_timings_equal(&current->mode, mode);
+	drmModeFreeCrtc(current);
+	return same;
 }
 
-static void drm_connector_start_renderer(struct wlr_drm_connector *conn) {
+/**
+ * Commits the connector's mode with the last rendered frame. If reuse_mode is
+ * set and the CRTC already shows the mode, e.g. the one left by the boot
+ * splash or by the compositor before a VT switch, the modeset is skipped.
+ * Recovery paths must not set it: the kernel needs the modeset to retrain the
+ * link or to clear the failure.
+ */
+static void drm_connector_start_renderer(struct wlr_drm_connector *conn,
+		bool reuse_mode) {
 	if (conn->state != WLR_DRM_CONN_CONNECTED) {
 		return;
 	}
@@ -381,21 +1326,157 @@ static void drm_connector_start_renderer(struct wlr_drm_connector *conn) {
 	}
 	struct wlr_drm_plane *plane = crtc->primary;
 
-	struct gbm_bo *bo = get_drm_surface_front(
-		drm->parent ? &plane->mgpu_surf : &plane->surf);
+	// Show the last rendered frame again rather than a black one, e.g. when
+	// retraining the link
+	struct wlr_drm_surface *surf =
+		drm->parent ? &plane->mgpu_surf : &plane->surf;
+	struct gbm_bo *bo = surf->back != NULL ? surf->back :
+		get_drm_surface_front(surf);
 	uint32_t fb_id = get_fb_for_bo(bo, plane->drm_format);
 
+	// The CRTC may have changed since adaptive sync was enabled
+	if (conn->output.adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED &&
+			!drm->iface->crtc_set_vrr(drm, crtc, true)) {
+		conn->output.adaptive_sync_status = WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED;
+	}
+
 	struct wlr_drm_mode *mode = (struct wlr_drm_mode *)conn->output.current_mode;
-	if (drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, &mode->drm_mode)) {
+	drmModeModeInfo *modeset = &mode->drm_mode;
+	bool retry_pending = conn->flip_retry || conn->retry_pageflip_armed;
+	if (reuse_mode && !retry_pending && !drm_connector_link_bad(conn) &&
+			crtc_shows_mode(drm, conn, crtc, &mode->drm_mode) &&
+			drm->iface->crtc_adopt_mode(drm, crtc, &mode->drm_mode) &&
+			drm->iface->crtc_test(drm, conn, crtc, fb_id, NULL)) {
+		wlr_log(WLR_DEBUG, "Output '%s' is already in this mode, "
+			"skipping modeset", conn->output.name);
+		modeset = NULL;
+	}
+
+	if (drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, modeset)) {
 		conn->pageflip_pending = true;
 		wlr_output_update_enabled(&conn->output, true);
 	} else {
-		wl_event_source_timer_update(conn->retry_pageflip,
-			1000000.0f / conn->output.current_mode->refresh);
+		drm_connector_recover_flip(conn, errno, true);
+	}
+}
+
+// Returns a framebuffer of the connector's primary plane surfaces, to test
+// modesets with
+static uint32_t drm_connector_get_test_fb(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_plane *plane = conn->crtc->primary;
+	struct gbm_bo *bo = get_drm_surface_front(
+		drm->parent ? &plane->mgpu_surf : &plane->surf);
+	return get_fb_for_bo(bo, plane->drm_format);
+}
+
+// Checks whether the hardware accepts a modeset of the connector on its
+// current CRTC, without committing anything
+static bool drm_connector_test_mode(struct wlr_drm_connector *conn,
+		struct wlr_drm_mode *mode) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc) {
+		return false;
+	}
+	uint32_t fb_id = drm_connector_get_test_fb(conn);
+
+	if (!drm->iface->crtc_test(drm, conn, crtc, fb_id, &mode->drm_mode)) {
+		wlr_log(WLR_ERROR, "Modeset test failed for output '%s' on CRTC %zu",
+			conn->output.name, crtc - drm->crtcs);
+		return false;
+	}
+	return true;
+}
+
+// Formats of the primary plane's render surfaces, from the highest depth down
+static const struct {
+	int depth;
+	uint32_t format; // Allocated and rendered to
+	uint32_t opaque_format; // Scanned out if the plane lacks format
+} render_formats[] = {
+	{ 30, DRM_FORMAT_ARGB2101010, DRM_FORMAT_XRGB2101010 },
+	{ 24, DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888 },
+	{ 16, DRM_FORMAT_RGB565, DRM_FORMAT_RGB565 },
+};
+
+// Allocates the primary plane surfaces for a modeset and checks that the
+// hardware accepts them. Explicit modifiers are tried first, since they allow
+// tiled and compressed layouts, then the driver's implicit choice.
+static bool drm_connector_init_surfaces_with_format(
+		struct wlr_drm_connector *conn, struct wlr_output_mode *mode,
+		uint32_t format) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_plane *plane = conn->crtc->primary;
+
+	if (!init_drm_plane_surfaces(plane, drm, mode->width, mode->height,
+			format, true)) {
+		wlr_log(WLR_ERROR, "Failed to initialize renderer for plane");
+		return false;
+	}
+	if (drm_connector_test_mode(conn, (struct wlr_drm_mode *)mode)) {
+		return true;
+	}
+
+	if (plane->num_modifiers == 0 || !drm->addfb2_modifiers) {
+		return false;
+	}
+
+	wlr_log(WLR_INFO, "Retrying modeset of '%s' without explicit modifiers",
+		conn->output.name);
+	finish_drm_surface(&plane->surf);
+	finish_drm_surface(&plane->mgpu_surf);
+	if (!init_drm_plane_surfaces(plane, drm, mode->width, mode->height,
+			format, false)) {
+		wlr_log(WLR_ERROR, "Failed to initialize renderer for plane");
+		return false;
+	}
+	return drm_connector_test_mode(conn, (struct wlr_drm_mode *)mode);
+}
+
+// Tries the formats the plane supports up to the connector's depth, falling
+// back to lower depths if the hardware rejects the mode, e.g. because the
+// link lacks bandwidth
+static bool drm_connector_init_surfaces(struct wlr_drm_connector *conn,
+		struct wlr_output_mode *mode) {
+	struct wlr_drm_plane *plane = conn->crtc->primary;
+
+	for (size_t i = 0; i < sizeof(render_formats) / sizeof(render_formats[0]);
+			++i) {
+		if (render_formats[i].depth > conn->depth) {
+			continue;
+		}
+
+		uint32_t format = render_formats[i].format;
+		uint32_t scanout_format = format;
+		if (!plane_supports_format(plane, scanout_format)) {
+			scanout_format = render_formats[i].opaque_format;
+			if (!plane_supports_format(plane, scanout_format)) {
+				continue;
+			}
+		}
+
+		set_plane_format(plane, scanout_format);
+		if (drm_connector_init_surfaces_with_format(conn, mode, format)) {
+			wlr_log(WLR_DEBUG, "Using depth %d on output '%s'",
+				render_formats[i].depth, conn->output.name);
+			return true;
+		}
+		wlr_log(WLR_INFO, "Modeset of '%s' failed with depth %d, "
+			"trying a lower depth", conn->output.name,
+			render_formats[i].depth);
 	}
+
+	// Don't leave the plane in the format of the last fallback
+	set_plane_format(plane, plane->default_format);
+	return false;
 }
 
 static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs);
+static void dealloc_crtc(struct wlr_drm_connector *conn);
 
 static void attempt_enable_needs_modeset(struct wlr_drm_backend *drm) {
 	// Try to modeset any output that has a desired mode and a CRTC (ie. was
@@ -419,6 +1500,9 @@ bool enable_drm_connector(struct wlr_output *output, bool enable) {
 			&& conn->state != WLR_DRM_CONN_NEEDS_MODESET) {
 		return false;
 	}
+	if (conn->lease != NULL) {
+		return !enable;
+	}
 
 	conn->desired_enabled = enable;
 
@@ -433,7 +1517,7 @@ bool enable_drm_connector(struct wlr_output *output, bool enable) {
 	}
 
 	if (enable) {
-		drm_connector_start_renderer(conn);
+		drm_connector_start_renderer(conn, true);
 	} else {
 		realloc_crtcs(drm, NULL);
 
@@ -444,6 +1528,22 @@ bool enable_drm_connector(struct wlr_output *output, bool enable) {
 	return true;
 }
 
+static bool drm_connector_set_dpms(struct wlr_output *output, bool on) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	if (conn->state != WLR_DRM_CONN_CONNECTED || conn->crtc == NULL ||
+			!drm->session->active) {
+		return false;
+	}
+
+	if (!drm->iface->conn_set_dpms(drm, conn, on)) {
+		wlr_log(WLR_ERROR, "Failed to turn %s output '%s'",
+			on ? "on" : "off", output->name);
+		return false;
+	}
+	return true;
+}
+
 static ssize_t connector_index_from_crtc(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc) {
 	size_t i = 0;
@@ -476,7 +1576,14 @@ static void realloc_planes(struct wlr_drm_backend *drm, const uint32_t *crtc_in,
 		}
 
 		for (size_t i = 0; i < drm->num_crtcs; ++i) {
-			if (crtc_in[i] == UNMATCHED) {
+			if (crtc_in[i] == SKIP) {
+				// Leased CRTCs keep their planes
+				struct wlr_drm_plane *plane = drm->crtcs[i].planes[type];
+				if (plane != NULL) {
+					possible[plane - drm->type_planes[type]] = 0;
+				}
+				crtc[i] = SKIP;
+			} else if (crtc_in[i] == UNMATCHED) {
 				crtc[i] = SKIP;
 			} else if (drm->crtcs[i].planes[type]) {
 				crtc[i] = drm->crtcs[i].planes[type]
@@ -512,6 +1619,7 @@ static void realloc_planes(struct wlr_drm_backend *drm, const uint32_t *crtc_in,
 				}
 				if (*old) {
 					finish_drm_surface(&(*old)->surf);
+					drm_plane_clear_fbs(*old);
 				}
 				finish_drm_surface(&new->surf);
 				*old = new;
@@ -526,7 +1634,13 @@ bool drm_connector_set_mode(struct wlr_output *output,
 		struct wlr_output_mode *mode) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
 	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
-	if (conn->crtc == NULL) {
+	if (conn->lease != NULL) {
+		wlr_log(WLR_ERROR, "Cannot modeset '%s': connector is leased",
+			conn->output.name);
+		return false;
+	}
+	bool had_crtc = conn->crtc != NULL;
+	if (!had_crtc) {
 		// Maybe we can steal a CRTC from a disabled output
 		realloc_crtcs(drm, NULL);
 	}
@@ -541,9 +1655,18 @@ bool drm_connector_set_mode(struct wlr_output *output,
 	wlr_log(WLR_INFO, "Modesetting '%s' with '%ux%u@%u mHz'",
 		conn->output.name, mode->width, mode->height, mode->refresh);
 
-	if (!init_drm_plane_surfaces(conn->crtc->primary, drm,
-			mode->width, mode->height, drm->renderer.gbm_format)) {
-		wlr_log(WLR_ERROR, "Failed to initialize renderer for plane");
+	if (!drm_connector_init_surfaces(conn, mode)) {
+		if (!had_crtc) {
+			// Give back the CRTC we just took, another output may use it
+			dealloc_crtc(conn);
+			conn->desired_mode = mode;
+			return false;
+		}
+		// Put the surfaces back in shape for the mode still on screen
+		struct wlr_output_mode *current = conn->output.current_mode;
+		if (current != NULL) {
+			drm_connector_init_surfaces(conn, current);
+		}
 		return false;
 	}
 
@@ -553,7 +1676,7 @@ bool drm_connector_set_mode(struct wlr_output *output,
 	wlr_output_update_enabled(&conn->output, true);
 	conn->desired_enabled = true;
 
-	drm_connector_start_renderer(conn);
+	drm_connector_start_renderer(conn, true);
 
 	// When switching VTs, the mode is not updated but the buffers become
 	// invalid, so we need to manually damage the output here
@@ -601,16 +1724,157 @@ static void drm_connector_transform(struct wlr_output *output,
 	output->transform = transform;
 }
 
-static bool drm_connector_set_cursor(struct wlr_output *output,
-		struct wlr_texture *texture, int32_t scale,
-		enum wl_output_transform transform,
-		int32_t hotspot_x, int32_t hotspot_y, bool update_texture) {
-	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
-	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+static bool init_cursor_surfaces(struct wlr_drm_backend *drm,
+		struct wlr_drm_surface *surf, struct wlr_drm_surface *mgpu_surf,
+		uint32_t width, uint32_t height) {
+	if (!drm->parent) {
+		return init_drm_surface(surf, &drm->renderer, width, height,
+			drm->renderer.gbm_format, NULL, 0,
+			GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT);
+	}
+
+	if (!init_drm_surface(surf, &drm->parent->renderer, width, height,
+			drm->parent->renderer.gbm_format, NULL, 0, GBM_BO_USE_LINEAR)) {
+		return false;
+	}
+	return init_drm_surface(mgpu_surf, &drm->renderer, width, height,
+		drm->renderer.gbm_format, NULL, 0,
+		GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT);
+}
+
+static void drm_cursor_handle_texture_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_cursor *cursor =
+		wl_container_of(listener, cursor, texture_destroy);
+	// The buffer may still be on screen, only forget the key
+	drm_cursor_reset_key(cursor);
+}
+
+static void drm_cursor_handle_texture_update(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_cursor *cursor =
+		wl_container_of(listener, cursor, texture_update);
+	drm_cursor_reset_key(cursor);
+}
+
+static bool drm_cursor_matches(struct wlr_drm_cursor *cursor,
+		struct wlr_output *output, struct wlr_texture *texture,
+		int32_t scale, enum wl_output_transform transform) {
+	return cursor->texture == texture && cursor->scale == scale &&
+		cursor->transform == transform &&
+		cursor->output_transform == output->transform &&
+		cursor->output_scale == output->scale;
+}
+
+// Returns a cache entry holding the rendered cursor image, rendering it into
+// the least recently used entry if needed
+static struct wlr_drm_cursor *drm_plane_get_cursor(
+		struct wlr_drm_backend *drm, struct wlr_drm_plane *plane,
+		struct wlr_output *output, struct wlr_texture *texture,
+		int32_t scale, enum wl_output_transform transform,
+		int width, int height) {
+	struct wlr_drm_cursor *cursor = NULL;
+	for (size_t i = 0; i < WLR_DRM_CURSOR_CACHE_LEN; ++i) {
+		struct wlr_drm_cursor *c = &plane->cursor_cache[i];
+		if (drm_cursor_matches(c, output, texture, scale, transform)) {
+			c->last_used = ++plane->cursor_seq;
+			return c;
+		}
+
+		// These buffers are or may soon be on screen, they can't be
+		// re-rendered
+		if (c == plane->cursor_current || c == plane->cursor_shown ||
+				c == plane->cursor_retired) {
+			continue;
+		}
+		if (cursor == NULL || (cursor->texture != NULL &&
+				(c->texture == NULL || c->last_used < cursor->last_used))) {
+			cursor = c;
+		}
+	}
+	assert(cursor != NULL);
+
+	drm_cursor_reset_key(cursor);
+	cursor->bo = NULL;
+	if (!init_cursor_surfaces(drm, &cursor->surf, &cursor->mgpu_surf,
+			plane->surf.width, plane->surf.height)) {
+		wlr_log(WLR_ERROR, "Cannot allocate cursor resources");
+		return NULL;
+	}
+
+	make_drm_surface_current(&cursor->surf, NULL);
+
+	struct wlr_renderer *rend = cursor->surf.renderer->wlr_rend;
 
+	struct wlr_box cursor_box = { .width = width, .height = height };
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &cursor_box, transform, 0, plane->matrix);
+
+	wlr_renderer_begin(rend, cursor->surf.width, cursor->surf.height);
+	wlr_renderer_clear(rend, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+	wlr_render_texture_with_matrix(rend, texture, matrix, 1.0);
+	wlr_renderer_end(rend);
+
+	// Only the latest rendering of an entry is ever scanned out
+	struct gbm_bo *bo = swap_drm_surface_buffers(&cursor->surf, NULL);
+	post_drm_surface(&cursor->surf);
+	if (drm->parent) {
+		bo = copy_drm_surface_mgpu(&cursor->mgpu_surf, bo, NULL);
+		post_drm_surface(&cursor->mgpu_surf);
+	}
+
+	// workaround for nouveau
+	// Buffers created with GBM_BO_USER_LINEAR are placed in NOUVEAU_GEM_DOMAIN_GART.
+	// When the bo is attached to the cursor plane it is moved to NOUVEAU_GEM_DOMAIN_VRAM.
+	// However, this does not wait for the render operations to complete, leaving an empty surface.
+	// see https://bugs.freedesktop.org/show_bug.cgi?id=109631
+	// The render operations can be waited for using:
+	glFinish();
+
+	cursor->bo = bo;
+	cursor->texture = texture;
+	cursor->scale = scale;
+	cursor->transform = transform;
+	cursor->output_transform = output->transform;
+	cursor->output_scale = output->scale;
+	cursor->last_used = ++plane->cursor_seq;
+
+	cursor->texture_destroy.notify = drm_cursor_handle_texture_destroy;
+	wl_signal_add(&texture->events.destroy, &cursor->texture_destroy);
+	cursor->texture_update.notify = drm_cursor_handle_texture_update;
+	wl_signal_add(&texture->events.update, &cursor->texture_update);
+
+	return cursor;
+}
+
+static void drm_connector_publish_cursor(struct wlr_drm_connector *conn) {
+	struct wlr_output *output = &conn->output;
+	struct wlr_drm_plane *plane = conn->crtc != NULL ? conn->crtc->cursor : NULL;
+
+	pthread_mutex_lock(&conn->async_cursor.lock);
+	if (plane != NULL) {
+		conn->async_cursor.crtc_id = conn->crtc->id;
+		conn->async_cursor.transform =
+			wlr_output_transform_invert(output->transform);
+		wlr_output_transformed_resolution(output, &conn->async_cursor.width,
+			&conn->async_cursor.height);
+		conn->async_cursor.hotspot_x = plane->cursor_hotspot_x;
+		conn->async_cursor.hotspot_y = plane->cursor_hotspot_y;
+	} else {
+		conn->async_cursor.crtc_id = 0;
+	}
+	pthread_mutex_unlock(&conn->async_cursor.lock);
+}
+
+// Returns the connector's cursor plane, with its render surfaces allocated
+static struct wlr_drm_plane *drm_connector_get_cursor_plane(
+		struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
 	struct wlr_drm_crtc *crtc = conn->crtc;
 	if (!crtc) {
-		return false;
+		return NULL;
 	}
 
 	struct wlr_drm_plane *plane = crtc->cursor;
@@ -619,7 +1883,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		plane = calloc(1, sizeof(*plane));
 		if (!plane) {
 			wlr_log_errno(WLR_ERROR, "Allocation failed");
-			return false;
+			return NULL;
 		}
 		crtc->cursor = plane;
 	}
@@ -632,30 +1896,20 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		ret = drmGetCap(drm->fd, DRM_CAP_CURSOR_HEIGHT, &h);
 		h = ret ? 64 : h;
 
-
-		if (!drm->parent) {
-			if (!init_drm_surface(&plane->surf, &drm->renderer, w, h,
-					drm->renderer.gbm_format, GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT)) {
-				wlr_log(WLR_ERROR, "Cannot allocate cursor resources");
-				return false;
-			}
-		} else {
-			if (!init_drm_surface(&plane->surf, &drm->parent->renderer, w, h,
-					drm->parent->renderer.gbm_format, GBM_BO_USE_LINEAR)) {
-				wlr_log(WLR_ERROR, "Cannot allocate cursor resources");
-				return false;
-			}
-
-			if (!init_drm_surface(&plane->mgpu_surf, &drm->renderer, w, h,
-					drm->renderer.gbm_format, GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT)) {
-				wlr_log(WLR_ERROR, "Cannot allocate cursor resources");
-				return false;
-			}
+		if (!init_cursor_surfaces(drm, &plane->surf, &plane->mgpu_surf,
+				w, h)) {
+			wlr_log(WLR_ERROR, "Cannot allocate cursor resources");
+			return NULL;
 		}
 	}
 
-	wlr_matrix_projection(plane->matrix, plane->surf.width,
-		plane->surf.height, output->transform);
+	return plane;
+}
+
+static bool drm_connector_set_cursor_hotspot(struct wlr_drm_connector *conn,
+		struct wlr_drm_plane *plane, int32_t hotspot_x, int32_t hotspot_y) {
+	struct wlr_output *output = &conn->output;
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
 
 	struct wlr_box hotspot = { .x = hotspot_x, .y = hotspot_y };
 	wlr_box_transform(&hotspot, &hotspot,
@@ -669,21 +1923,79 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		conn->cursor_y -= hotspot.y - plane->cursor_hotspot_y;
 		plane->cursor_hotspot_x = hotspot.x;
 		plane->cursor_hotspot_y = hotspot.y;
+		drm_connector_publish_cursor(conn);
 
-		if (!drm->iface->crtc_move_cursor(drm, conn->crtc, conn->cursor_x,
-				conn->cursor_y)) {
+		if (conn->pageflip_pending) {
+			conn->cursor_move_pending = true;
+		} else if (!drm->iface->crtc_move_cursor(drm, conn->crtc,
+				conn->cursor_x, conn->cursor_y)) {
 			return false;
+		} else {
+			conn->cursor_move_pending = false;
 		}
 
 		wlr_output_update_needs_swap(output);
 	}
+	return true;
+}
+
+// Puts the cursor image on screen, or hides the cursor if NULL
+static bool drm_connector_show_cursor(struct wlr_drm_connector *conn,
+		struct wlr_drm_cursor *cursor) {
+	struct wlr_output *output = &conn->output;
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	struct wlr_drm_plane *plane = conn->crtc->cursor;
+
+	struct wlr_drm_cursor *prev_cursor = plane->cursor_current;
+	plane->cursor_current = cursor;
+
+	if (!drm->session->active) {
+		return true; // will be committed when session is resumed
+	}
+
+	if (conn->pageflip_pending && prev_cursor != NULL) {
+		// The CRTC already accepted a cursor buffer, so this can't fail for
+		// lack of cursor support and is deferred like moves
+		conn->cursor_set_pending = true;
+		wlr_output_update_needs_swap(output);
+		return true;
+	}
+
+	bool ok = drm_connector_commit_cursor(conn, cursor);
+	if (ok) {
+		conn->cursor_set_pending = false;
+		wlr_output_update_needs_swap(output);
+	} else {
+		plane->cursor_current = prev_cursor;
+	}
+	return ok;
+}
+
+static bool drm_connector_set_cursor(struct wlr_output *output,
+		struct wlr_texture *texture, int32_t scale,
+		enum wl_output_transform transform,
+		int32_t hotspot_x, int32_t hotspot_y, bool update_texture) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+
+	struct wlr_drm_plane *plane = drm_connector_get_cursor_plane(conn);
+	if (plane == NULL) {
+		return false;
+	}
+
+	wlr_matrix_projection(plane->matrix, plane->surf.width,
+		plane->surf.height, output->transform);
+
+	if (!drm_connector_set_cursor_hotspot(conn, plane, hotspot_x, hotspot_y)) {
+		return false;
+	}
 
 	if (!update_texture) {
 		// Don't update cursor image
 		return true;
 	}
 
-	plane->cursor_enabled = false;
+	struct wlr_drm_cursor *cursor = NULL;
 	if (texture != NULL) {
 		int width, height;
 		wlr_texture_get_size(texture, &width, &height);
@@ -696,48 +2008,78 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 			return false;
 		}
 
-		make_drm_surface_current(&plane->surf, NULL);
-
-		struct wlr_renderer *rend = plane->surf.renderer->wlr_rend;
-
-		struct wlr_box cursor_box = { .width = width, .height = height };
-
-		float matrix[9];
-		wlr_matrix_project_box(matrix, &cursor_box, transform, 0, plane->matrix);
-
-		wlr_renderer_begin(rend, plane->surf.width, plane->surf.height);
-		wlr_renderer_clear(rend, (float[]){ 0.0, 0.0, 0.0, 0.0 });
-		wlr_render_texture_with_matrix(rend, texture, matrix, 1.0);
-		wlr_renderer_end(rend);
+		cursor = drm_plane_get_cursor(drm, plane, output, texture, scale,
+			transform, width, height);
+		if (cursor == NULL) {
+			return false;
+		}
+	}
 
-		swap_drm_surface_buffers(&plane->surf, NULL);
+	return drm_connector_show_cursor(conn, cursor);
+}
 
-		plane->cursor_enabled = true;
+static bool drm_connector_set_cursor_pixels(struct wlr_output *output,
+		const void *data, int32_t stride, uint32_t width, uint32_t height,
+		int32_t hotspot_x, int32_t hotspot_y) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
+	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		// The image would need to be rotated, let the renderer do it
+		return false;
 	}
 
-	if (!drm->session->active) {
-		return true; // will be committed when session is resumed
+	struct wlr_drm_plane *plane = drm_connector_get_cursor_plane(conn);
+	if (plane == NULL || width > plane->surf.width ||
+			height > plane->surf.height) {
+		return false;
 	}
 
-	struct gbm_bo *bo = plane->cursor_enabled ? plane->surf.back : NULL;
-	if (bo && drm->parent) {
-		bo = copy_drm_surface_mgpu(&plane->mgpu_surf, bo);
+	// The buffers are written while previous images may be on screen, or
+	// waiting for a page-flip. Use one which is neither.
+	struct wlr_drm_cursor *cursor = NULL;
+	for (size_t i = 0; i < 3; ++i) {
+		struct wlr_drm_cursor *c = &plane->cursor_pixels[i];
+		if (c != plane->cursor_current && c != plane->cursor_shown &&
+				c != plane->cursor_retired) {
+			cursor = c;
+			break;
+		}
+	}
+	assert(cursor != NULL);
+	if (cursor->bo == NULL) {
+		// Allocated on the scan-out device, even with multiple GPUs
+		cursor->bo = gbm_bo_create(drm->renderer.gbm, plane->surf.width,
+			plane->surf.height, GBM_FORMAT_ARGB8888,
+			GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
+		if (cursor->bo == NULL) {
+			wlr_log(WLR_DEBUG, "Failed to allocate writable cursor buffer");
+			return false;
+		}
 	}
 
-	if (bo) {
-		// workaround for nouveau
-		// Buffers created with GBM_BO_USER_LINEAR are placed in NOUVEAU_GEM_DOMAIN_GART.
-		// When the bo is attached to the cursor plane it is moved to NOUVEAU_GEM_DOMAIN_VRAM.
-		// However, this does not wait for the render operations to complete, leaving an empty surface.
-		// see https://bugs.freedesktop.org/show_bug.cgi?id=109631
-		// The render operations can be waited for using:
-		glFinish();
+	// gbm_bo_write doesn't take a stride, the whole buffer is written
+	uint32_t bo_stride = gbm_bo_get_stride(cursor->bo);
+	size_t size = (size_t)bo_stride * plane->surf.height;
+	uint8_t *pixels = calloc(1, size);
+	if (pixels == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
 	}
-	bool ok = drm->iface->crtc_set_cursor(drm, crtc, bo);
-	if (ok) {
-		wlr_output_update_needs_swap(output);
+	for (uint32_t y = 0; y < height; ++y) {
+		memcpy(pixels + y * bo_stride, (const uint8_t *)data + y * stride,
+			width * 4);
 	}
-	return ok;
+	int ret = gbm_bo_write(cursor->bo, pixels, size);
+	free(pixels);
+	if (ret != 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to write cursor buffer");
+		return false;
+	}
+
+	if (!drm_connector_set_cursor_hotspot(conn, plane, hotspot_x, hotspot_y)) {
+		return false;
+	}
+	return drm_connector_show_cursor(conn, cursor);
 }
 
 static bool drm_connector_move_cursor(struct wlr_output *output,
@@ -765,13 +2107,23 @@ static bool drm_connector_move_cursor(struct wlr_output *output,
 
 	conn->cursor_x = box.x;
 	conn->cursor_y = box.y;
+	drm_connector_publish_cursor(conn);
 
 	if (!drm->session->active) {
 		return true; // will be committed when session is resumed
 	}
 
+	if (conn->pageflip_pending) {
+		// Applied once the page-flip completes, so that fast pointer motion
+		// costs one cursor update per frame
+		conn->cursor_move_pending = true;
+		wlr_output_update_needs_swap(output);
+		return true;
+	}
+
 	bool ok = drm->iface->crtc_move_cursor(drm, conn->crtc, box.x, box.y);
 	if (ok) {
+		conn->cursor_move_pending = false;
 		wlr_output_update_needs_swap(output);
 	}
 	return ok;
@@ -784,14 +2136,42 @@ static bool drm_connector_schedule_frame(struct wlr_output *output) {
 		return false;
 	}
 
-	// We need to figure out where we are in the vblank cycle
-	// TODO: try using drmWaitVBlank and fallback to pageflipping
-
 	struct wlr_drm_crtc *crtc = conn->crtc;
 	if (!crtc) {
 		return false;
 	}
 	struct wlr_drm_plane *plane = crtc->primary;
+
+	// We need to figure out where we are in the vblank cycle. Legacy
+	// page-flips don't carry any other state, so waiting for the next vblank
+	// is enough and doesn't flip the same buffer again.
+	if (drm->iface == &legacy_iface && !conn->pageflip_pending &&
+			(conn->frame_vblank_pending ||
+			drm_connector_queue_frame_vblank(conn))) {
+		wlr_output_update_enabled(output, true);
+		return true;
+	}
+
+	if (conn->current_fb.bo != NULL) {
+		// A client buffer is being scanned out, flip it again
+		if (conn->pageflip_pending) {
+			wlr_log(WLR_ERROR, "Skipping pageflip on output '%s'",
+				conn->output.name);
+			return true;
+		}
+
+		uint32_t fb_id = get_fb_for_client_bo(conn->current_fb.bo);
+		if (!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
+			return drm_connector_recover_flip(conn, errno, false);
+		}
+
+		drm_fb_move(&conn->queued_fb, &conn->current_fb);
+		drm_connector_keep_overlay(conn);
+		conn->pageflip_pending = true;
+		wlr_output_update_enabled(output, true);
+		return true;
+	}
+
 	struct gbm_bo *bo = plane->surf.back;
 	if (!bo) {
 		// We haven't swapped buffers yet -- can't do a pageflip
@@ -799,7 +2179,11 @@ static bool drm_connector_schedule_frame(struct wlr_output *output) {
 		return true;
 	}
 	if (drm->parent) {
-		bo = copy_drm_surface_mgpu(&plane->mgpu_surf, bo);
+		// The source buffer hasn't changed since the last copy
+		pixman_region32_t damage;
+		pixman_region32_init(&damage);
+		bo = copy_drm_surface_mgpu(&plane->mgpu_surf, bo, &damage);
+		pixman_region32_fini(&damage);
 	}
 
 	if (conn->pageflip_pending) {
@@ -810,9 +2194,10 @@ static bool drm_connector_schedule_frame(struct wlr_output *output) {
 
 	uint32_t fb_id = get_fb_for_bo(bo, plane->drm_format);
 	if (!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
-		return false;
+		return drm_connector_recover_flip(conn, errno, false);
 	}
 
+	drm_connector_keep_overlay(conn);
 	conn->pageflip_pending = true;
 	wlr_output_update_enabled(output, true);
 	return true;
@@ -821,25 +2206,36 @@ static bool drm_connector_schedule_frame(struct wlr_output *output) {
 static void drm_connector_destroy(struct wlr_output *output) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
 	drm_connector_cleanup(conn);
+	drm_connector_clear_fbs(conn);
 	drmModeFreeCrtc(conn->old_crtc);
 	wl_event_source_remove(conn->retry_pageflip);
+	if (conn->early_frame != NULL) {
+		wl_event_source_remove(conn->early_frame);
+	}
+	pthread_mutex_destroy(&conn->async_cursor.lock);
 	wl_list_remove(&conn->link);
 	free(conn);
 }
 
 static const struct wlr_output_impl output_impl = {
 	.enable = enable_drm_connector,
+	.set_dpms = drm_connector_set_dpms,
 	.set_mode = drm_connector_set_mode,
 	.transform = drm_connector_transform,
 	.set_cursor = drm_connector_set_cursor,
+	.set_cursor_pixels = drm_connector_set_cursor_pixels,
 	.move_cursor = drm_connector_move_cursor,
 	.destroy = drm_connector_destroy,
 	.make_current = drm_connector_make_current,
 	.swap_buffers = drm_connector_swap_buffers,
+	.set_damage_region = drm_connector_set_damage_region,
 	.set_gamma = set_drm_connector_gamma,
 	.get_gamma_size = drm_connector_get_gamma_size,
 	.export_dmabuf = drm_connector_export_dmabuf,
 	.schedule_frame = drm_connector_schedule_frame,
+	.attach_buffer = drm_connector_attach_buffer,
+	.assign_overlays = drm_connector_assign_overlays,
+	.set_adaptive_sync = drm_connector_set_adaptive_sync,
 };
 
 bool wlr_output_is_drm(struct wlr_output *output) {
@@ -849,7 +2245,8 @@ bool wlr_output_is_drm(struct wlr_output *output) {
 static int retry_pageflip(void *data) {
 	struct wlr_drm_connector *conn = data;
 	wlr_log(WLR_INFO, "%s: Retrying pageflip", conn->output.name);
-	drm_connector_start_renderer(conn);
+	conn->retry_pageflip_armed = false;
+	drm_connector_start_renderer(conn, false);
 	return 0;
 }
 
@@ -874,6 +2271,8 @@ static void dealloc_crtc(struct wlr_drm_connector *conn) {
 
 	set_drm_connector_gamma(&conn->output, 0, NULL, NULL, NULL);
 
+	drm_connector_clear_fbs(conn);
+
 	for (size_t type = 0; type < 3; ++type) {
 		struct wlr_drm_plane *plane = conn->crtc->planes[type];
 		if (plane == NULL) {
@@ -881,12 +2280,24 @@ static void dealloc_crtc(struct wlr_drm_connector *conn) {
 		}
 
 		finish_drm_surface(&plane->surf);
+		// The next CRTC using the plane negotiates its own format
+		set_plane_format(plane, plane->default_format);
 		conn->crtc->planes[type] = NULL;
 	}
 
 	drm->iface->conn_enable(drm, conn, false);
 
 	conn->crtc = NULL;
+	drm_connector_publish_cursor(conn);
+}
+
+// Gives up the connector's CRTC, if any, until its next modeset
+static void drm_connector_park(struct wlr_drm_connector *conn) {
+	dealloc_crtc(conn);
+	conn->state = WLR_DRM_CONN_NEEDS_MODESET;
+	wlr_output_update_enabled(&conn->output, false);
+	conn->desired_mode = conn->output.current_mode;
+	wlr_output_update_mode(&conn->output, NULL);
 }
 
 static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
@@ -909,6 +2320,7 @@ static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
 	}
 
 	struct wlr_drm_connector *connectors[num_outputs + 1];
+	bool had_crtc[num_outputs + 1];
 
 	uint32_t possible_crtc[num_outputs + 1];
 	memset(possible_crtc, 0, sizeof(possible_crtc));
@@ -919,13 +2331,18 @@ static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
 	wl_list_for_each(conn, &drm->outputs, link) {
 		i++;
 		connectors[i] = conn;
+		had_crtc[i] = conn->crtc != NULL;
 
 		wlr_log(WLR_DEBUG, "  '%s' crtc=%d state=%d desired_enabled=%d",
 			conn->output.name,
 			conn->crtc ? (int)(conn->crtc - drm->crtcs) : -1,
 			conn->state, conn->desired_enabled);
 
-		if (conn->crtc) {
+		if (conn->crtc && conn->lease != NULL) {
+			// The lessee owns this CRTC
+			crtc[conn->crtc - drm->crtcs] = SKIP;
+			continue;
+		} else if (conn->crtc) {
 			crtc[conn->crtc - drm->crtcs] = i;
 		}
 
@@ -945,14 +2362,14 @@ static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
 	bool matched[num_outputs + 1];
 	memset(matched, false, sizeof(matched));
 	for (size_t i = 0; i < drm->num_crtcs; ++i) {
-		if (crtc_res[i] != UNMATCHED) {
+		if (crtc_res[i] != UNMATCHED && crtc_res[i] != SKIP) {
 			matched[crtc_res[i]] = true;
 		}
 	}
 
 	for (size_t i = 0; i < drm->num_crtcs; ++i) {
 		// We don't want any of the current monitors to be deactivated
-		if (crtc[i] != UNMATCHED && !matched[crtc[i]] &&
+		if (crtc[i] != UNMATCHED && crtc[i] != SKIP && !matched[crtc[i]] &&
 				connectors[crtc[i]]->desired_enabled) {
 			wlr_log(WLR_DEBUG, "Could not match a CRTC for connected output %d",
 				crtc[i]);
@@ -995,6 +2412,11 @@ static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
 	realloc_planes(drm, crtc_res, changed_outputs);
 
 	// We need to reinitialize any plane that has changed
+	struct wlr_drm_connector *to_start[num_outputs + 1];
+	uint32_t fb_ids[num_outputs + 1];
+	drmModeModeInfo *modes[num_outputs + 1];
+	bool gained_crtc[num_outputs + 1];
+	size_t n_start = 0;
 	i = -1;
 	wl_list_for_each(conn, &drm->outputs, link) {
 		i++;
@@ -1007,23 +2429,46 @@ static void realloc_crtcs(struct wlr_drm_backend *drm, bool *changed_outputs) {
 		if (conn->crtc == NULL) {
 			wlr_log(WLR_DEBUG, "Output has %s lost its CRTC",
 				conn->output.name);
-			conn->state = WLR_DRM_CONN_NEEDS_MODESET;
-			wlr_output_update_enabled(&conn->output, false);
-			conn->desired_mode = conn->output.current_mode;
-			wlr_output_update_mode(&conn->output, NULL);
+			drm_connector_park(conn);
 			continue;
 		}
 
-		if (!init_drm_plane_surfaces(conn->crtc->primary, drm,
-				mode->width, mode->height, drm->renderer.gbm_format)) {
-			wlr_log(WLR_ERROR, "Failed to initialize renderer for plane");
-			drm_connector_cleanup(conn);
-			break;
+		if (!drm_connector_init_surfaces(conn, mode)) {
+			// Don't commit a configuration the hardware will refuse, wait for
+			// the next modeset instead
+			drm_connector_park(conn);
+			continue;
 		}
 
-		drm_connector_start_renderer(conn);
+		to_start[n_start] = conn;
+		fb_ids[n_start] = drm_connector_get_test_fb(conn);
+		modes[n_start] = &((struct wlr_drm_mode *)mode)->drm_mode;
+		gained_crtc[n_start] = !had_crtc[i];
+		n_start++;
+	}
+
+	// Each output has been tested on its own, but the outputs may still not
+	// fit together, e.g. because of the total bandwidth. Undo the assignment
+	// of the outputs which didn't have a CRTC before rather than commit a
+	// configuration the hardware will refuse.
+	if (n_start > 1 && drm->iface->group_test != NULL &&
+			!drm->iface->group_test(drm, n_start, to_start, fb_ids, modes)) {
+		wlr_log(WLR_INFO, "The new CRTC assignment was rejected, "
+			"leaving newly enabled outputs off");
+		for (size_t j = 0; j < n_start; ++j) {
+			if (gained_crtc[j]) {
+				drm_connector_park(to_start[j]);
+				to_start[j] = NULL;
+			}
+		}
+	}
 
-		wlr_output_damage_whole(&conn->output);
+	for (size_t j = 0; j < n_start; ++j) {
+		if (to_start[j] == NULL) {
+			continue;
+		}
+		drm_connector_start_renderer(to_start[j], false);
+		wlr_output_damage_whole(&to_start[j]->output);
 	}
 
 free_changed_outputs:
@@ -1071,7 +2516,160 @@ static uint32_t get_possible_crtcs(int fd, drmModeRes *res,
 	return ret;
 }
 
-void scan_drm_connectors(struct wlr_drm_backend *drm) {
+// Only uses the DRM fd, so that it can run on the probe thread
+static void probe_connectors(int fd, drmModeConnector ***connectors,
+		int *connectors_len) {
+	*connectors = NULL;
+	*connectors_len = 0;
+
+	drmModeRes *res = drmModeGetResources(fd);
+	if (!res) {
+		wlr_log_errno(WLR_ERROR, "Failed to get DRM resources");
+		return;
+	}
+
+	*connectors = calloc(res->count_connectors, sizeof(drmModeConnector *));
+	if (*connectors == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		drmModeFreeResources(res);
+		return;
+	}
+	*connectors_len = res->count_connectors;
+
+	// Getting a connector makes the kernel probe it, which may take a while
+	// if it reads the EDID
+	for (int i = 0; i < res->count_connectors; ++i) {
+		(*connectors)[i] = drmModeGetConnector(fd, res->connectors[i]);
+	}
+
+	drmModeFreeResources(res);
+}
+
+void probe_drm_connectors(struct wlr_drm_backend *drm) {
+	finish_probed_drm_connectors(drm);
+	probe_connectors(drm->fd, &drm->probed_connectors,
+		&drm->probed_connectors_len);
+}
+
+static void *probe_thread(void *data) {
+	struct wlr_drm_backend *drm = data;
+	probe_connectors(drm->fd, &drm->probe.connectors,
+		&drm->probe.connectors_len);
+	eventfd_write(drm->probe.event_fd, 1);
+	return NULL;
+}
+
+static void join_probe_thread(struct wlr_drm_backend *drm) {
+	pthread_join(drm->probe.thread, NULL);
+	drm->probe.running = false;
+
+	finish_probed_drm_connectors(drm);
+	drm->probed_connectors = drm->probe.connectors;
+	drm->probed_connectors_len = drm->probe.connectors_len;
+	drm->probe.connectors = NULL;
+	drm->probe.connectors_len = 0;
+}
+
+static int handle_probe_done(int fd, uint32_t mask, void *data) {
+	struct wlr_drm_backend *drm = data;
+
+	eventfd_t count;
+	eventfd_read(fd, &count);
+	if (!drm->probe.running) {
+		return 0;
+	}
+
+	join_probe_thread(drm);
+	scan_drm_connectors(drm, 0);
+
+	if (drm->probe.pending) {
+		drm->probe.pending = false;
+		probe_drm_connectors_async(drm);
+	}
+	return 0;
+}
+
+void probe_drm_connectors_async(struct wlr_drm_backend *drm) {
+	if (drm->probe.running) {
+		// The connectors may have changed after the thread probed them
+		drm->probe.pending = true;
+		return;
+	}
+
+	if (drm->probe.event == NULL) {
+		drm->probe.event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (drm->probe.event_fd < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to create eventfd");
+			goto error;
+		}
+
+		struct wl_event_loop *ev = wl_display_get_event_loop(drm->display);
+		drm->probe.event = wl_event_loop_add_fd(ev, drm->probe.event_fd,
+			WL_EVENT_READABLE, handle_probe_done, drm);
+		if (drm->probe.event == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create event source");
+			close(drm->probe.event_fd);
+			goto error;
+		}
+	}
+
+	if (pthread_create(&drm->probe.thread, NULL, probe_thread, drm) != 0) {
+		wlr_log(WLR_ERROR, "Failed to create connector probe thread");
+		goto error;
+	}
+	drm->probe.running = true;
+	return;
+
+error:
+	scan_drm_connectors(drm, 0);
+}
+
+void finish_drm_probe_thread(struct wlr_drm_backend *drm) {
+	if (drm->probe.running) {
+		join_probe_thread(drm);
+	}
+	if (drm->probe.event != NULL) {
+		wl_event_source_remove(drm->probe.event);
+		close(drm->probe.event_fd);
+		drm->probe.event = NULL;
+	}
+}
+
+void finish_probed_drm_connectors(struct wlr_drm_backend *drm) {
+	for (int i = 0; i < drm->probed_connectors_len; ++i) {
+		drmModeFreeConnector(drm->probed_connectors[i]);
+	}
+	free(drm->probed_connectors);
+	drm->probed_connectors = NULL;
+	drm->probed_connectors_len = 0;
+}
+
+static drmModeConnector *get_drm_connector(struct wlr_drm_backend *drm,
+		uint32_t id, bool probe) {
+	for (int i = 0; i < drm->probed_connectors_len; ++i) {
+		drmModeConnector *drm_conn = drm->probed_connectors[i];
+		if (drm_conn != NULL && drm_conn->connector_id == id) {
+			drm->probed_connectors[i] = NULL;
+			return drm_conn;
+		}
+	}
+	// Without probing, the kernel returns the state it already knows
+	return probe ? drmModeGetConnector(drm->fd, id) :
+		drmModeGetConnectorCurrent(drm->fd, id);
+}
+
+static bool crtc_is_taken(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (conn->crtc == crtc) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void scan_drm_connectors(struct wlr_drm_backend *drm, uint32_t changed_id) {
 	wlr_log(WLR_INFO, "Scanning DRM connectors");
 
 	drmModeRes *res = drmModeGetResources(drm->fd);
@@ -1089,8 +2687,18 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 	struct wlr_drm_connector *new_outputs[res->count_connectors + 1];
 
 	for (int i = 0; i < res->count_connectors; ++i) {
-		drmModeConnector *drm_conn = drmModeGetConnector(drm->fd,
-			res->connectors[i]);
+		uint32_t conn_id = res->connectors[i];
+		bool known = false;
+		struct wlr_drm_connector *c;
+		wl_list_for_each(c, &drm->outputs, link) {
+			if (c->id == conn_id) {
+				known = true;
+				break;
+			}
+		}
+
+		bool probe = changed_id == 0 || changed_id == conn_id || !known;
+		drmModeConnector *drm_conn = get_drm_connector(drm, conn_id, probe);
 		if (!drm_conn) {
 			wlr_log_errno(WLR_ERROR, "Failed to get DRM connector");
 			continue;
@@ -1099,7 +2707,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 			drm_conn->encoder_id);
 
 		ssize_t index = -1;
-		struct wlr_drm_connector *c, *wlr_conn = NULL;
+		struct wlr_drm_connector *wlr_conn = NULL;
 		wl_list_for_each(c, &drm->outputs, link) {
 			index++;
 			if (c->id == drm_conn->connector_id) {
@@ -1125,6 +2733,10 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 
 			wlr_conn->state = WLR_DRM_CONN_DISCONNECTED;
 			wlr_conn->id = drm_conn->connector_id;
+			wlr_conn->depth = 24;
+			wlr_conn->in_fence_fd = -1;
+			wlr_conn->out_fence_fd = -1;
+			pthread_mutex_init(&wlr_conn->async_cursor.lock, NULL);
 
 			snprintf(wlr_conn->output.name, sizeof(wlr_conn->output.name),
 				"%s-%"PRIu32, conn_get_name(drm_conn->connector_type),
@@ -1140,9 +2752,15 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 			seen[index] = true;
 		}
 
-		if (curr_enc) {
+		if (known && wlr_conn->crtc != NULL) {
+			// Keep driving the connector with the CRTC we picked, even if
+			// another DRM master moved it while we were switched away, so
+			// that resuming doesn't need a new assignment
+		} else if (curr_enc) {
+			wlr_conn->crtc = NULL;
 			for (size_t i = 0; i < drm->num_crtcs; ++i) {
-				if (drm->crtcs[i].id == curr_enc->crtc_id) {
+				if (drm->crtcs[i].id == curr_enc->crtc_id &&
+						!crtc_is_taken(drm, &drm->crtcs[i])) {
 					wlr_conn->crtc = &drm->crtcs[i];
 					break;
 				}
@@ -1183,6 +2801,15 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 
 			get_drm_connector_props(drm->fd, wlr_conn->id, &wlr_conn->props);
 
+			uint64_t vrr_capable = 0;
+			if (wlr_conn->props.vrr_capable != 0) {
+				get_drm_prop(drm->fd, wlr_conn->id,
+					wlr_conn->props.vrr_capable, &vrr_capable);
+			}
+			wlr_conn->vrr_capable = vrr_capable;
+			wlr_log(WLR_INFO, "Adaptive sync: %s",
+				vrr_capable ? "supported" : "unsupported");
+
 			size_t edid_len = 0;
 			uint8_t *edid = get_drm_prop_blob(drm->fd,
 				wlr_conn->id, wlr_conn->props.edid, &edid_len);
@@ -1240,6 +2867,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 	}
 
 	drmModeFreeResources(res);
+	finish_probed_drm_connectors(drm);
 
 	// Iterate in reverse order because we'll remove items from the list and
 	// still want indices to remain correct.
@@ -1254,7 +2882,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 		wlr_log(WLR_INFO, "'%s' disappeared", conn->output.name);
 		drm_connector_cleanup(conn);
 
-		if (conn->pageflip_pending) {
+		if (conn->pageflip_pending || conn->frame_vblank_pending) {
 			conn->state = WLR_DRM_CONN_DISAPPEARED;
 		} else {
 			wlr_output_destroy(&conn->output);
@@ -1297,16 +2925,63 @@ static int mhz_to_nsec(int mhz) {
 	return 1000000000000LL / mhz;
 }
 
+// Submits the frame rendered while the previous page-flip was pending, if any
+static void drm_connector_flip_queued(struct wlr_drm_connector *conn) {
+	struct wlr_drm_plane *plane = conn->crtc->primary;
+	struct gbm_bo *bo = promote_drm_surface_queued(&plane->surf);
+	if (bo == NULL) {
+		return;
+	}
+
+	conn->in_fence_fd = take_drm_surface_fence(&plane->surf);
+	drm_connector_queue_overlay(conn);
+	uint32_t fb_id = get_fb_for_bo(bo, plane->drm_format);
+	if (!drm_connector_pageflip(conn, fb_id)) {
+		drm_connector_recover_flip(conn, errno, false);
+		return;
+	}
+	conn->pageflip_pending = true;
+}
+
 static void page_flip_handler(int fd, unsigned seq,
-		unsigned tv_sec, unsigned tv_usec, void *data) {
+		unsigned tv_sec, unsigned tv_usec, unsigned crtc_id, void *data) {
 	struct wlr_drm_connector *conn = data;
 	struct wlr_drm_backend *drm =
 		get_drm_backend_from_backend(conn->output.backend);
 
+	if (crtc_id != 0 && conn->crtc != NULL && conn->crtc->id != crtc_id) {
+		// Grouped pageflips send all events with the same user data
+		struct wlr_drm_connector *c, *found = NULL;
+		wl_list_for_each(c, &drm->outputs, link) {
+			if (c->crtc != NULL && c->crtc->id == crtc_id) {
+				found = c;
+				break;
+			}
+		}
+		if (found == NULL) {
+			return;
+		}
+		conn = found;
+	}
+
+	wlr_trace(drm_page_flip, &conn->output, seq, tv_sec, tv_usec);
+
 	conn->pageflip_pending = false;
+	bool async = conn->flip_async;
+	conn->flip_async = false;
+
+	// The queued client buffer, if any, is now on screen
+	bool zero_copy = conn->queued_fb.bo != NULL;
+	drm_fb_move(&conn->current_fb, &conn->queued_fb);
+	if (conn->crtc != NULL && conn->crtc->overlay != NULL) {
+		struct wlr_drm_plane *overlay = conn->crtc->overlay;
+		drm_fb_move(&overlay->current_fb, &overlay->queued_fb);
+	}
 
 	if (conn->state == WLR_DRM_CONN_DISAPPEARED) {
-		wlr_output_destroy(&conn->output);
+		if (!conn->frame_vblank_pending) {
+			wlr_output_destroy(&conn->output);
+		}
 		return;
 	}
 
@@ -1323,24 +2998,79 @@ static void page_flip_handler(int fd, unsigned seq,
 		.tv_sec = tv_sec,
 		.tv_nsec = tv_usec * 1000,
 	};
+	uint32_t present_flags = WLR_OUTPUT_PRESENT_VSYNC |
+		WLR_OUTPUT_PRESENT_HW_CLOCK | WLR_OUTPUT_PRESENT_HW_COMPLETION;
+	if (tv_sec == 0 && tv_usec == 0 &&
+			!drm_connector_get_vblank_time(conn, &present_time)) {
+		// Some legacy drivers don't timestamp page-flip events
+		clock_gettime(drm->clock, &present_time);
+		present_flags &= ~WLR_OUTPUT_PRESENT_HW_CLOCK;
+	}
 	struct wlr_output_event_present present_event = {
 		.when = &present_time,
 		.seq = seq,
 		.refresh = mhz_to_nsec(conn->output.refresh),
-		.flags = WLR_OUTPUT_PRESENT_VSYNC | WLR_OUTPUT_PRESENT_HW_CLOCK |
-			WLR_OUTPUT_PRESENT_HW_COMPLETION,
+		.flags = present_flags,
 	};
+	if (conn->output.adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) {
+		present_event.adaptive_sync = true;
+		present_event.refresh = 0;
+	}
+	if (zero_copy) {
+		present_event.flags |= WLR_OUTPUT_PRESENT_ZERO_COPY;
+	}
+	if (async) {
+		present_event.flags &= ~WLR_OUTPUT_PRESENT_VSYNC;
+	}
 	wlr_output_send_present(&conn->output, &present_event);
 
+	if (conn->crtc->cursor != NULL) {
+		// The images replaced before this page-flip are off screen
+		conn->crtc->cursor->cursor_retired = NULL;
+	}
+
 	if (drm->session->active) {
+		if (!drm_connector_flush_cursor(conn) && !conn->cursor_failed) {
+			wlr_log(WLR_ERROR, "%s: Falling back to software cursors",
+				conn->output.name);
+			conn->cursor_failed = true;
+			wlr_output_lock_software_cursors(&conn->output, true);
+		}
+		drm_connector_flip_queued(conn);
 		wlr_output_send_frame(&conn->output);
 	}
 }
 
+static void sequence_handler(int fd, uint64_t seq, uint64_t ns,
+		uint64_t user_data) {
+	struct wlr_drm_connector *conn = (void *)(uintptr_t)user_data;
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+
+	conn->frame_vblank_pending = false;
+
+	if (conn->state == WLR_DRM_CONN_DISAPPEARED) {
+		if (!conn->pageflip_pending) {
+			wlr_output_destroy(&conn->output);
+		}
+		return;
+	}
+
+	// A page-flip submitted in the meantime sends the frame event itself
+	if (conn->state != WLR_DRM_CONN_CONNECTED || conn->crtc == NULL ||
+			!drm->session->active || conn->pageflip_pending) {
+		return;
+	}
+
+	wlr_output_send_frame(&conn->output);
+}
+
 int handle_drm_event(int fd, uint32_t mask, void *data) {
 	drmEventContext event = {
-		.version = 2,
-		.page_flip_handler = page_flip_handler,
+		.version = 4,
+		.vblank_handler = vblank_handler,
+		.page_flip_handler2 = page_flip_handler,
+		.sequence_handler = sequence_handler,
 	};
 
 	drmHandleEvent(fd, &event);
@@ -1387,11 +3117,17 @@ void restore_drm_outputs(struct wlr_drm_backend *drm) {
 	}
 }
 
+static void drm_lease_destroy(struct wlr_drm_lease *lease);
+
 static void drm_connector_cleanup(struct wlr_drm_connector *conn) {
 	if (!conn) {
 		return;
 	}
 
+	if (conn->lease != NULL) {
+		drm_lease_destroy(conn->lease);
+	}
+
 	switch (conn->state) {
 	case WLR_DRM_CONN_CONNECTED:
 	case WLR_DRM_CONN_CLEANUP:;
@@ -1421,6 +3157,8 @@ static void drm_connector_cleanup(struct wlr_drm_connector *conn) {
 
 		conn->output.enabled = false;
 		conn->output.width = conn->output.height = conn->output.refresh = 0;
+		conn->output.adaptive_sync_status = WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED;
+		conn->vrr_capable = false;
 
 		memset(&conn->output.make, 0, sizeof(conn->output.make));
 		memset(&conn->output.model, 0, sizeof(conn->output.model));
@@ -1430,9 +3168,16 @@ static void drm_connector_cleanup(struct wlr_drm_connector *conn) {
 			wl_event_source_remove(conn->output.idle_frame);
 			conn->output.idle_frame = NULL;
 		}
+		if (conn->early_frame != NULL) {
+			wl_event_source_remove(conn->early_frame);
+			conn->early_frame = NULL;
+		}
+		conn->flip_retry = false;
 		conn->output.needs_swap = false;
 		conn->output.frame_pending = false;
 
+		drm_connector_clear_fbs(conn);
+
 		/* Fallthrough */
 	case WLR_DRM_CONN_NEEDS_MODESET:
 		wlr_log(WLR_INFO, "Emitting destruction signal for '%s'",
@@ -1450,3 +3195,211 @@ static void drm_connector_cleanup(struct wlr_drm_connector *conn) {
 
 	conn->state = WLR_DRM_CONN_DISCONNECTED;
 }
+
+uint32_t wlr_drm_connector_get_id(struct wlr_output *output) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	return conn->id;
+}
+
+int wlr_drm_backend_get_non_master_fd(struct wlr_backend *backend) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
+
+	char *path = drmGetDeviceNameFromFd2(drm->fd);
+	if (path == NULL) {
+		wlr_log(WLR_ERROR, "Failed to get DRM device name");
+		return -1;
+	}
+
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to open '%s'", path);
+		free(path);
+		return -1;
+	}
+	free(path);
+
+	// The kernel makes the first opener master if nobody else is
+	if (drmDropMaster(fd) < 0 && errno != EINVAL) {
+		wlr_log_errno(WLR_ERROR, "Failed to drop DRM master");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool lease_alloc_crtc(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn) {
+	for (size_t i = 0; i < drm->num_crtcs; ++i) {
+		struct wlr_drm_crtc *crtc = &drm->crtcs[i];
+		if (!(conn->possible_crtc & (1 << i)) ||
+				connector_index_from_crtc(drm, crtc) >= 0) {
+			continue;
+		}
+
+		// The lessee needs a primary plane to display anything
+		if (crtc->primary == NULL) {
+			for (size_t j = 0; j < drm->num_primary_planes; ++j) {
+				struct wlr_drm_plane *plane = &drm->primary_planes[j];
+				bool taken = false;
+				for (size_t k = 0; k < drm->num_crtcs; ++k) {
+					taken = taken || drm->crtcs[k].primary == plane;
+				}
+				if (!taken && (plane->possible_crtcs & (1 << i))) {
+					crtc->primary = plane;
+					break;
+				}
+			}
+		}
+		if (crtc->primary == NULL) {
+			continue;
+		}
+
+		conn->crtc = crtc;
+		return true;
+	}
+	return false;
+}
+
+struct wlr_drm_lease *wlr_drm_create_lease(struct wlr_output **outputs,
+		size_t n_outputs, int *lease_fd) {
+	assert(n_outputs > 0);
+	if (!wlr_output_is_drm(outputs[0])) {
+		wlr_log(WLR_ERROR, "Cannot lease '%s': not a DRM output",
+			outputs[0]->name);
+		return NULL;
+	}
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(outputs[0]->backend);
+
+	struct wlr_drm_lease *lease = calloc(1, sizeof(struct wlr_drm_lease));
+	if (lease == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	lease->backend = &drm->backend;
+	wl_signal_init(&lease->events.destroy);
+
+	// One connector, CRTC and primary plane per output
+	uint32_t objects[3 * n_outputs];
+	size_t n_objects = 0;
+	// Connectors which got a CRTC for the lease, released on failure
+	struct wlr_drm_connector *allocated[n_outputs];
+	size_t n_allocated = 0;
+	for (size_t i = 0; i < n_outputs; ++i) {
+		struct wlr_output *output = outputs[i];
+		if (!wlr_output_is_drm(output) || output->backend != &drm->backend) {
+			wlr_log(WLR_ERROR, "Cannot lease '%s': not on the same DRM device",
+				output->name);
+			goto error;
+		}
+		struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+		if (conn->lease != NULL || output->enabled ||
+				(conn->state != WLR_DRM_CONN_CONNECTED &&
+				conn->state != WLR_DRM_CONN_NEEDS_MODESET)) {
+			wlr_log(WLR_ERROR, "Cannot lease '%s': output is in use or "
+				"disconnected", output->name);
+			goto error;
+		}
+		if (conn->crtc == NULL) {
+			if (!lease_alloc_crtc(drm, conn)) {
+				wlr_log(WLR_ERROR, "Cannot lease '%s': no free CRTC",
+					output->name);
+				goto error;
+			}
+			allocated[n_allocated++] = conn;
+		}
+		conn->lease = lease;
+
+		objects[n_objects++] = conn->id;
+		objects[n_objects++] = conn->crtc->id;
+		if (conn->crtc->primary->id != 0) {
+			objects[n_objects++] = conn->crtc->primary->id;
+		}
+	}
+
+	*lease_fd = drmModeCreateLease(drm->fd, objects, n_objects, O_CLOEXEC,
+		&lease->lessee_id);
+	if (*lease_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to create DRM lease");
+		goto error;
+	}
+
+	wlr_log(WLR_INFO, "Created DRM lease %"PRIu32" with %zu outputs",
+		lease->lessee_id, n_outputs);
+	return lease;
+
+error:
+	for (size_t i = 0; i < n_allocated; ++i) {
+		// Nothing was committed on the CRTC yet
+		allocated[i]->crtc = NULL;
+	}
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (conn->lease == lease) {
+			conn->lease = NULL;
+		}
+	}
+	free(lease);
+	return NULL;
+}
+
+static void drm_lease_destroy(struct wlr_drm_lease *lease) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(lease->backend);
+
+	if (drmModeRevokeLease(drm->fd, lease->lessee_id) < 0 && errno != ENOENT) {
+		wlr_log_errno(WLR_ERROR, "Failed to revoke DRM lease %"PRIu32,
+			lease->lessee_id);
+	}
+
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (conn->lease == lease) {
+			conn->lease = NULL;
+		}
+	}
+	// The lessee may have changed the properties of the leased objects
+	drm->committed_props.len = 0;
+
+	wlr_log(WLR_INFO, "DRM lease %"PRIu32" ended", lease->lessee_id);
+	wlr_signal_emit_safe(&lease->events.destroy, lease);
+	free(lease);
+}
+
+void wlr_drm_lease_terminate(struct wlr_drm_lease *lease) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(lease->backend);
+	drm_lease_destroy(lease);
+	// Turn off the CRTCs the lessee may have left on and hand them out again
+	realloc_crtcs(drm, NULL);
+	attempt_enable_needs_modeset(drm);
+}
+
+void scan_drm_leases(struct wlr_drm_backend *drm) {
+	drmModeLesseeListRes *list = drmModeListLessees(drm->fd);
+	if (list == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to list DRM lessees");
+		return;
+	}
+
+	struct wlr_drm_connector *conn;
+	bool changed;
+	do {
+		// Terminating a lease may reallocate CRTCs, start over each time
+		changed = false;
+		wl_list_for_each(conn, &drm->outputs, link) {
+			if (conn->lease == NULL) {
+				continue;
+			}
+			bool found = false;
+			for (size_t i = 0; i < list->count; ++i) {
+				found = found || list->lessees[i] == conn->lease->lessee_id;
+			}
+			if (!found) {
+				wlr_drm_lease_terminate(conn->lease);
+				changed = true;
+				break;
+			}
+		}
+	} while (changed);
+
+	drmFree(list);
+}
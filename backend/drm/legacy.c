@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <gbm.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
@@ -9,22 +10,67 @@
 static bool legacy_crtc_pageflip(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
 		uint32_t fb_id, drmModeModeInfo *mode) {
+	// Callers classify failures from errno, which logging may clobber
 	if (mode) {
 		if (drmModeSetCrtc(drm->fd, crtc->id, fb_id, 0, 0,
 				&conn->id, 1, mode)) {
+			int error = errno;
 			wlr_log_errno(WLR_ERROR, "%s: Failed to set CRTC", conn->output.name);
+			errno = error;
 			return false;
 		}
 	}
 
-	if (drmModePageFlip(drm->fd, crtc->id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, conn)) {
+	uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT;
+	if (conn->flip_async) {
+		flags |= DRM_MODE_PAGE_FLIP_ASYNC;
+	}
+	if (drmModePageFlip(drm->fd, crtc->id, fb_id, flags, conn)) {
+		int error = errno;
 		wlr_log_errno(WLR_ERROR, "%s: Failed to page flip", conn->output.name);
+		errno = error;
 		return false;
 	}
 
 	return true;
 }
 
+static bool legacy_crtc_adopt_mode(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, drmModeModeInfo *mode) {
+	// Legacy page-flips keep whatever mode the CRTC has
+	return true;
+}
+
+static bool legacy_crtc_test(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id, drmModeModeInfo *mode) {
+	if (mode) {
+		// The legacy interface has no way to test a modeset
+		return true;
+	}
+
+	// A legacy page-flip can't change the framebuffer layout, so the new
+	// buffer needs to match the one currently being scanned out
+	drmModeCrtc *current = drmModeGetCrtc(drm->fd, crtc->id);
+	if (!current) {
+		wlr_log_errno(WLR_ERROR, "%s: Failed to get CRTC", conn->output.name);
+		return false;
+	}
+	drmModeFB *cur_fb = drmModeGetFB(drm->fd, current->buffer_id);
+	drmModeFreeCrtc(current);
+	drmModeFB *new_fb = drmModeGetFB(drm->fd, fb_id);
+
+	bool ok = cur_fb && new_fb &&
+		cur_fb->width == new_fb->width &&
+		cur_fb->height == new_fb->height &&
+		cur_fb->bpp == new_fb->bpp &&
+		cur_fb->depth == new_fb->depth;
+
+	drmModeFreeFB(cur_fb);
+	drmModeFreeFB(new_fb);
+	return ok;
+}
+
 static bool legacy_conn_enable(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, bool enable) {
 	int ret = drmModeConnectorSetProperty(drm->fd, conn->id, conn->props.dpms,
@@ -62,6 +108,20 @@ bool legacy_crtc_move_cursor(struct wlr_drm_backend *drm,
 	return !drmModeMoveCursor(drm->fd, crtc->id, x, y);
 }
 
+static bool legacy_crtc_set_vrr(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool enabled) {
+	if (crtc->props.vrr_enabled == 0) {
+		return false;
+	}
+
+	if (drmModeObjectSetProperty(drm->fd, crtc->id, DRM_MODE_OBJECT_CRTC,
+			crtc->props.vrr_enabled, enabled) != 0) {
+		wlr_log_errno(WLR_ERROR, "drmModeObjectSetProperty(VRR_ENABLED) failed");
+		return false;
+	}
+	return true;
+}
+
 bool legacy_crtc_set_gamma(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, size_t size,
 		uint16_t *r, uint16_t *g, uint16_t *b) {
@@ -75,9 +135,13 @@ size_t legacy_crtc_get_gamma_size(struct wlr_drm_backend *drm,
 
 const struct wlr_drm_interface legacy_iface = {
 	.conn_enable = legacy_conn_enable,
+	.conn_set_dpms = legacy_conn_enable,
 	.crtc_pageflip = legacy_crtc_pageflip,
+	.crtc_adopt_mode = legacy_crtc_adopt_mode,
+	.crtc_test = legacy_crtc_test,
 	.crtc_set_cursor = legacy_crtc_set_cursor,
 	.crtc_move_cursor = legacy_crtc_move_cursor,
+	.crtc_set_vrr = legacy_crtc_set_vrr,
 	.crtc_set_gamma = legacy_crtc_set_gamma,
 	.crtc_get_gamma_size = legacy_crtc_get_gamma_size,
 };
@@ -24,6 +24,7 @@ static const struct prop_info connector_info[] = {
 	{ "EDID",        INDEX(edid) },
 	{ "PATH",        INDEX(path) },
 	{ "link-status", INDEX(link_status) },
+	{ "vrr_capable", INDEX(vrr_capable) },
 #undef INDEX
 };
 
@@ -33,6 +34,8 @@ static const struct prop_info crtc_info[] = {
 	{ "GAMMA_LUT",      INDEX(gamma_lut) },
 	{ "GAMMA_LUT_SIZE", INDEX(gamma_lut_size) },
 	{ "MODE_ID",        INDEX(mode_id) },
+	{ "OUT_FENCE_PTR",  INDEX(out_fence_ptr) },
+	{ "VRR_ENABLED",    INDEX(vrr_enabled) },
 	{ "rotation",       INDEX(rotation) },
 	{ "scaling mode",   INDEX(scaling_mode) },
 #undef INDEX
@@ -46,6 +49,8 @@ static const struct prop_info plane_info[] = {
 	{ "CRTC_X",  INDEX(crtc_x) },
 	{ "CRTC_Y",  INDEX(crtc_y) },
 	{ "FB_ID",   INDEX(fb_id) },
+	{ "IN_FENCE_FD", INDEX(in_fence_fd) },
+	{ "IN_FORMATS", INDEX(in_formats) },
 	{ "SRC_H",   INDEX(src_h) },
 	{ "SRC_W",   INDEX(src_w) },
 	{ "SRC_X",   INDEX(src_x) },
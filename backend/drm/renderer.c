@@ -13,6 +13,7 @@
 #include <wlr/util/log.h>
 #include "backend/drm/drm.h"
 #include "glapi.h"
+#include "render/gbm_allocator.h"
 
 bool init_drm_renderer(struct wlr_drm_backend *drm,
 		struct wlr_drm_renderer *renderer, wlr_renderer_create_func_t create_renderer_func) {
@@ -63,14 +64,17 @@ void finish_drm_renderer(struct wlr_drm_renderer *renderer) {
 
 bool init_drm_surface(struct wlr_drm_surface *surf,
 		struct wlr_drm_renderer *renderer, uint32_t width, uint32_t height,
-		uint32_t format, uint32_t flags) {
-	if (surf->width == width && surf->height == height) {
+		uint32_t format, const uint64_t *modifiers, size_t num_modifiers,
+		uint32_t flags) {
+	if (surf->width == width && surf->height == height &&
+			surf->format == format) {
 		return true;
 	}
 
 	surf->renderer = renderer;
 	surf->width = width;
 	surf->height = height;
+	surf->format = format;
 
 	if (surf->gbm) {
 		if (surf->front) {
@@ -81,23 +85,70 @@ bool init_drm_surface(struct wlr_drm_surface *surf,
 			gbm_surface_release_buffer(surf->gbm, surf->back);
 			surf->back = NULL;
 		}
+		if (surf->queued) {
+			gbm_surface_release_buffer(surf->gbm, surf->queued);
+			surf->queued = NULL;
+		}
 		gbm_surface_destroy(surf->gbm);
+		for (size_t i = 0; i < WLR_DRM_SURFACE_DAMAGE_LEN; ++i) {
+			pixman_region32_fini(&surf->previous_damage[i]);
+		}
+		if (surf->fence_fd >= 0) {
+			close(surf->fence_fd);
+		}
+		if (surf->release_fence_fd >= 0) {
+			close(surf->release_fence_fd);
+		}
 	}
 	wlr_egl_destroy_surface(&surf->renderer->egl, surf->egl);
 
-	surf->gbm = gbm_surface_create(renderer->gbm, width, height,
-		format, GBM_BO_USE_RENDERING | flags);
+	surf->gbm = NULL;
+	if (num_modifiers > 0) {
+		surf->gbm = gbm_surface_create_with_modifiers(renderer->gbm,
+			width, height, format, modifiers, num_modifiers);
+		if (!surf->gbm) {
+			wlr_log_errno(WLR_DEBUG, "Failed to create GBM surface with "
+				"modifiers, falling back to implicit modifiers");
+		}
+	}
+	if (!surf->gbm) {
+		surf->gbm = gbm_surface_create(renderer->gbm, width, height,
+			format, GBM_BO_USE_RENDERING | flags);
+	}
 	if (!surf->gbm) {
 		wlr_log_errno(WLR_ERROR, "Failed to create GBM surface");
 		goto error_zero;
 	}
 
-	surf->egl = wlr_egl_create_surface(&renderer->egl, surf->gbm);
+	if (format == renderer->gbm_format) {
+		surf->egl = wlr_egl_create_surface(&renderer->egl, surf->gbm);
+	} else {
+		surf->egl = wlr_egl_create_surface_with_visual(&renderer->egl,
+			surf->gbm, format);
+	}
 	if (surf->egl == EGL_NO_SURFACE) {
 		wlr_log(WLR_ERROR, "Failed to create EGL surface");
 		goto error_gbm;
 	}
 
+	// The driver then copies the last frame into the new back buffer, which
+	// is cheaper than repainting the whole output every frame
+	surf->preserved = !renderer->egl.exts.buffer_age_ext &&
+		eglSurfaceAttrib(renderer->egl.display, surf->egl,
+			EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED);
+	surf->preserved_valid = false;
+	if (surf->preserved) {
+		wlr_log(WLR_DEBUG, "EGL_EXT_buffer_age unsupported, "
+			"using preserved swaps for damage tracking");
+	}
+
+	for (size_t i = 0; i < WLR_DRM_SURFACE_DAMAGE_LEN; ++i) {
+		pixman_region32_init(&surf->previous_damage[i]);
+	}
+	surf->previous_idx = 0;
+	surf->fence_fd = -1;
+	surf->release_fence_fd = -1;
+
 	return true;
 
 error_gbm:
@@ -118,10 +169,22 @@ void finish_drm_surface(struct wlr_drm_surface *surf) {
 	if (surf->back) {
 		gbm_surface_release_buffer(surf->gbm, surf->back);
 	}
+	if (surf->queued) {
+		gbm_surface_release_buffer(surf->gbm, surf->queued);
+	}
 
 	wlr_egl_destroy_surface(&surf->renderer->egl, surf->egl);
 	if (surf->gbm) {
 		gbm_surface_destroy(surf->gbm);
+		for (size_t i = 0; i < WLR_DRM_SURFACE_DAMAGE_LEN; ++i) {
+			pixman_region32_fini(&surf->previous_damage[i]);
+		}
+		if (surf->fence_fd >= 0) {
+			close(surf->fence_fd);
+		}
+		if (surf->release_fence_fd >= 0) {
+			close(surf->release_fence_fd);
+		}
 	}
 
 	memset(surf, 0, sizeof(*surf));
@@ -129,7 +192,51 @@ void finish_drm_surface(struct wlr_drm_surface *surf) {
 
 bool make_drm_surface_current(struct wlr_drm_surface *surf,
 		int *buffer_damage) {
-	return wlr_egl_make_current(&surf->renderer->egl, surf->egl, buffer_damage);
+	struct wlr_egl *egl = &surf->renderer->egl;
+	if (!wlr_egl_make_current(egl, surf->egl, buffer_damage)) {
+		return false;
+	}
+	if (surf->preserved && buffer_damage != NULL) {
+		*buffer_damage = surf->preserved_valid ? 1 : 0;
+	}
+
+	if (surf->release_fence_fd >= 0) {
+		// Let the GPU wait instead of stalling the CPU
+		EGLSyncKHR sync =
+			wlr_egl_create_native_fence(egl, surf->release_fence_fd);
+		if (sync != EGL_NO_SYNC_KHR) {
+			wlr_egl_wait_sync(egl, sync);
+			wlr_egl_destroy_sync(egl, sync);
+		} else {
+			close(surf->release_fence_fd);
+		}
+		surf->release_fence_fd = -1;
+	}
+	return true;
+}
+
+// Swaps the EGL surface and returns its new front buffer, locked
+static struct gbm_bo *lock_drm_surface_buffer(struct wlr_drm_surface *surf,
+		pixman_region32_t *damage) {
+	struct wlr_egl *egl = &surf->renderer->egl;
+
+	// The fence can only be exported once it has been flushed, which
+	// swapping buffers does
+	EGLSyncKHR sync =
+		wlr_egl_create_native_fence(egl, EGL_NO_NATIVE_FENCE_FD_ANDROID);
+	wlr_egl_swap_buffers(egl, surf->egl, damage);
+
+	if (surf->fence_fd >= 0) {
+		close(surf->fence_fd);
+		surf->fence_fd = -1;
+	}
+	if (sync != EGL_NO_SYNC_KHR) {
+		surf->fence_fd = wlr_egl_dup_native_fence_fd(egl, sync);
+		wlr_egl_destroy_sync(egl, sync);
+	}
+
+	surf->preserved_valid = true;
+	return gbm_surface_lock_front_buffer(surf->gbm);
 }
 
 struct gbm_bo *swap_drm_surface_buffers(struct wlr_drm_surface *surf,
@@ -138,10 +245,32 @@ struct gbm_bo *swap_drm_surface_buffers(struct wlr_drm_surface *surf,
 		gbm_surface_release_buffer(surf->gbm, surf->front);
 	}
 
-	wlr_egl_swap_buffers(&surf->renderer->egl, surf->egl, damage);
+	surf->front = surf->back;
+	surf->back = lock_drm_surface_buffer(surf, damage);
+	return surf->back;
+}
+
+struct gbm_bo *queue_drm_surface_buffers(struct wlr_drm_surface *surf,
+		pixman_region32_t *damage) {
+	if (surf->queued) {
+		gbm_surface_release_buffer(surf->gbm, surf->queued);
+	}
+
+	surf->queued = lock_drm_surface_buffer(surf, damage);
+	return surf->queued;
+}
 
+struct gbm_bo *promote_drm_surface_queued(struct wlr_drm_surface *surf) {
+	if (!surf->queued) {
+		return NULL;
+	}
+
+	if (surf->front) {
+		gbm_surface_release_buffer(surf->gbm, surf->front);
+	}
 	surf->front = surf->back;
-	surf->back = gbm_surface_lock_front_buffer(surf->gbm);
+	surf->back = surf->queued;
+	surf->queued = NULL;
 	return surf->back;
 }
 
@@ -155,7 +284,10 @@ struct gbm_bo *get_drm_surface_front(struct wlr_drm_surface *surf) {
 	wlr_renderer_begin(renderer, surf->width, surf->height);
 	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 1.0 });
 	wlr_renderer_end(renderer);
-	return swap_drm_surface_buffers(surf, NULL);
+	struct gbm_bo *bo = swap_drm_surface_buffers(surf, NULL);
+	// The black frame isn't one the output damage knows about
+	surf->preserved_valid = false;
+	return bo;
 }
 
 void post_drm_surface(struct wlr_drm_surface *surf) {
@@ -165,32 +297,18 @@ void post_drm_surface(struct wlr_drm_surface *surf) {
 	}
 }
 
-bool export_drm_bo(struct gbm_bo *bo, struct wlr_dmabuf_attributes *attribs) {
-	memset(attribs, 0, sizeof(struct wlr_dmabuf_attributes));
-
-	attribs->n_planes = gbm_bo_get_plane_count(bo);
-	if (attribs->n_planes > WLR_DMABUF_MAX_PLANES) {
-		return false;
-	}
+int take_drm_surface_fence(struct wlr_drm_surface *surf) {
+	int fence_fd = surf->fence_fd;
+	surf->fence_fd = -1;
+	return fence_fd;
+}
 
-	attribs->width = gbm_bo_get_width(bo);
-	attribs->height = gbm_bo_get_height(bo);
-	attribs->format = gbm_bo_get_format(bo);
-	attribs->modifier = gbm_bo_get_modifier(bo);
-
-	for (int i = 0; i < attribs->n_planes; ++i) {
-		attribs->offset[i] = gbm_bo_get_offset(bo, i);
-		attribs->stride[i] = gbm_bo_get_stride_for_plane(bo, i);
-		attribs->fd[i] = gbm_bo_get_fd(bo);
-		if (attribs->fd[i] < 0) {
-			for (int j = 0; j < i; ++j) {
-				close(attribs->fd[j]);
-			}
-			return false;
-		}
+void set_drm_surface_release_fence(struct wlr_drm_surface *surf,
+		int fence_fd) {
+	if (surf->release_fence_fd >= 0) {
+		close(surf->release_fence_fd);
 	}
-
-	return true;
+	surf->release_fence_fd = fence_fd;
 }
 
 static void free_tex(struct gbm_bo *bo, void *data) {
@@ -206,7 +324,7 @@ static struct wlr_texture *get_tex_for_bo(struct wlr_drm_renderer *renderer,
 	}
 
 	struct wlr_dmabuf_attributes attribs;
-	if (!export_drm_bo(bo, &attribs)) {
+	if (!export_gbm_bo(bo, &attribs)) {
 		return NULL;
 	}
 
@@ -219,39 +337,93 @@ static struct wlr_texture *get_tex_for_bo(struct wlr_drm_renderer *renderer,
 }
 
 struct gbm_bo *copy_drm_surface_mgpu(struct wlr_drm_surface *dest,
-		struct gbm_bo *src) {
-	make_drm_surface_current(dest, NULL);
+		struct gbm_bo *src, pixman_region32_t *damage) {
+	int buffer_age = -1;
+	make_drm_surface_current(dest, &buffer_age);
 
 	struct wlr_texture *tex = get_tex_for_bo(dest->renderer, src);
 	assert(tex);
 
+	// The destination buffer misses the damage of the copies made since it
+	// was last used
+	pixman_region32_t copy_damage;
+	pixman_region32_init(&copy_damage);
+	if (damage == NULL || buffer_age <= 0 ||
+			buffer_age - 1 > WLR_DRM_SURFACE_DAMAGE_LEN) {
+		pixman_region32_union_rect(&copy_damage, &copy_damage, 0, 0,
+			dest->width, dest->height);
+	} else {
+		pixman_region32_copy(&copy_damage, damage);
+		for (int i = 0; i < buffer_age - 1; ++i) {
+			size_t j = (dest->previous_idx + i) % WLR_DRM_SURFACE_DAMAGE_LEN;
+			pixman_region32_union(&copy_damage, &copy_damage,
+				&dest->previous_damage[j]);
+		}
+	}
+
 	float mat[9];
 	wlr_matrix_projection(mat, 1, 1, WL_OUTPUT_TRANSFORM_NORMAL);
 
 	struct wlr_renderer *renderer = dest->renderer->wlr_rend;
 	wlr_renderer_begin(renderer, dest->width, dest->height);
-	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
-	wlr_render_texture_with_matrix(renderer, tex, mat, 1.0f);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&copy_damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		struct wlr_box box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		wlr_renderer_scissor(renderer, &box);
+		wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+		wlr_render_texture_with_matrix(renderer, tex, mat, 1.0f);
+	}
+
+	wlr_renderer_scissor(renderer, NULL);
 	wlr_renderer_end(renderer);
 
-	return swap_drm_surface_buffers(dest, NULL);
+	// Remember what changed in this copy for the buffers used next
+	dest->previous_idx += WLR_DRM_SURFACE_DAMAGE_LEN - 1;
+	dest->previous_idx %= WLR_DRM_SURFACE_DAMAGE_LEN;
+	if (damage != NULL) {
+		pixman_region32_copy(&dest->previous_damage[dest->previous_idx],
+			damage);
+	} else {
+		pixman_region32_union_rect(&dest->previous_damage[dest->previous_idx],
+			&dest->previous_damage[dest->previous_idx], 0, 0,
+			dest->width, dest->height);
+	}
+
+	struct gbm_bo *bo = swap_drm_surface_buffers(dest, &copy_damage);
+	pixman_region32_fini(&copy_damage);
+	return bo;
 }
 
 bool init_drm_plane_surfaces(struct wlr_drm_plane *plane,
 		struct wlr_drm_backend *drm, int32_t width, uint32_t height,
-		uint32_t format) {
+		uint32_t format, bool with_modifiers) {
+	const uint64_t *modifiers = NULL;
+	size_t num_modifiers = 0;
+	if (with_modifiers && drm->addfb2_modifiers) {
+		modifiers = plane->modifiers;
+		num_modifiers = plane->num_modifiers;
+	}
+
 	if (!drm->parent) {
 		return init_drm_surface(&plane->surf, &drm->renderer, width, height,
-			format, GBM_BO_USE_SCANOUT);
+			format, modifiers, num_modifiers, GBM_BO_USE_SCANOUT);
 	}
 
 	if (!init_drm_surface(&plane->surf, &drm->parent->renderer,
-			width, height, format, GBM_BO_USE_LINEAR)) {
+			width, height, format, NULL, 0, GBM_BO_USE_LINEAR)) {
 		return false;
 	}
 
 	if (!init_drm_surface(&plane->mgpu_surf, &drm->renderer,
-			width, height, format, GBM_BO_USE_SCANOUT)) {
+			width, height, format, modifiers, num_modifiers,
+			GBM_BO_USE_SCANOUT)) {
 		finish_drm_surface(&plane->surf);
 		return false;
 	}
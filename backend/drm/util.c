@@ -184,22 +184,86 @@ uint32_t get_fb_for_bo(struct gbm_bo *bo, uint32_t drm_format) {
 		return id;
 	}
 
-	assert(gbm_bo_get_format(bo) == GBM_FORMAT_ARGB8888);
-	assert(drm_format == DRM_FORMAT_ARGB8888 ||
-		drm_format == DRM_FORMAT_XRGB8888);
+	assert(drm_format != DRM_FORMAT_INVALID);
 
 	struct gbm_device *gbm = gbm_bo_get_device(bo);
 
 	int fd = gbm_device_get_fd(gbm);
 	uint32_t width = gbm_bo_get_width(bo);
 	uint32_t height = gbm_bo_get_height(bo);
-	uint32_t handles[4] = {gbm_bo_get_handle(bo).u32};
-	uint32_t pitches[4] = {gbm_bo_get_stride(bo)};
-	uint32_t offsets[4] = {gbm_bo_get_offset(bo, 0)};
+	uint64_t modifier = gbm_bo_get_modifier(bo);
+
+	uint32_t handles[4] = {0};
+	uint32_t pitches[4] = {0};
+	uint32_t offsets[4] = {0};
+	uint64_t modifiers[4] = {0};
+	int n_planes = gbm_bo_get_plane_count(bo);
+	for (int i = 0; i < n_planes && i < 4; ++i) {
+		handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+		pitches[i] = gbm_bo_get_stride_for_plane(bo, i);
+		offsets[i] = gbm_bo_get_offset(bo, i);
+		modifiers[i] = modifier;
+	}
 
-	if (drmModeAddFB2(fd, width, height, drm_format,
-			handles, pitches, offsets, &id, 0)) {
+	// Buffers allocated with explicit modifiers need them passed along, but
+	// older kernels may refuse them
+	int ret = -1;
+	if (modifier != DRM_FORMAT_MOD_INVALID) {
+		ret = drmModeAddFB2WithModifiers(fd, width, height, drm_format,
+			handles, pitches, offsets, modifiers, &id, DRM_MODE_FB_MODIFIERS);
+	}
+	if (ret != 0 && n_planes == 1) {
+		ret = drmModeAddFB2(fd, width, height, drm_format,
+			handles, pitches, offsets, &id, 0);
+	}
+	if (ret != 0) {
 		wlr_log_errno(WLR_ERROR, "Unable to add DRM framebuffer");
+		id = 0;
+	}
+
+	gbm_bo_set_user_data(bo, (void *)(uintptr_t)id, free_fb);
+
+	return id;
+}
+
+uint32_t get_fb_for_client_bo(struct gbm_bo *bo) {
+	uint32_t id = (uintptr_t)gbm_bo_get_user_data(bo);
+	if (id) {
+		return id;
+	}
+
+	struct gbm_device *gbm = gbm_bo_get_device(bo);
+
+	int fd = gbm_device_get_fd(gbm);
+	uint32_t width = gbm_bo_get_width(bo);
+	uint32_t height = gbm_bo_get_height(bo);
+	uint32_t format = gbm_bo_get_format(bo);
+	uint64_t modifier = gbm_bo_get_modifier(bo);
+
+	uint32_t handles[4] = {0};
+	uint32_t pitches[4] = {0};
+	uint32_t offsets[4] = {0};
+	uint64_t modifiers[4] = {0};
+	int n_planes = gbm_bo_get_plane_count(bo);
+	for (int i = 0; i < n_planes && i < 4; ++i) {
+		handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+		pitches[i] = gbm_bo_get_stride_for_plane(bo, i);
+		offsets[i] = gbm_bo_get_offset(bo, i);
+		modifiers[i] = modifier;
+	}
+
+	int ret;
+	if (modifier != DRM_FORMAT_MOD_INVALID) {
+		ret = drmModeAddFB2WithModifiers(fd, width, height, format, handles,
+			pitches, offsets, modifiers, &id, DRM_MODE_FB_MODIFIERS);
+	} else {
+		ret = drmModeAddFB2(fd, width, height, format, handles, pitches,
+			offsets, &id, 0);
+	}
+	if (ret) {
+		wlr_log_errno(WLR_DEBUG, "Unable to add DRM framebuffer for client "
+			"buffer");
+		id = 0;
 	}
 
 	gbm_bo_set_user_data(bo, (void *)(uintptr_t)id, free_fb);
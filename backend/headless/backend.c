@@ -1,5 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wlr/render/pixman.h>
+#include <xf86drm.h>
 #include <wlr/interfaces/wlr_input_device.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/egl.h>
@@ -22,7 +28,7 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 
 	struct wlr_headless_output *output;
 	wl_list_for_each(output, &backend->outputs, link) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		headless_output_start_frames(output);
 		wlr_output_update_enabled(&output->wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output,
 			&output->wlr_output);
@@ -61,6 +67,7 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 
 	wlr_signal_emit_safe(&wlr_backend->events.destroy, backend);
 
+	wlr_allocator_destroy(backend->allocator);
 	wlr_renderer_destroy(backend->renderer);
 	wlr_egl_finish(&backend->egl);
 	free(backend);
@@ -79,6 +86,82 @@ static const struct wlr_backend_impl backend_impl = {
 	.get_renderer = backend_get_renderer,
 };
 
+/**
+ * Opens the render node of the DRM device with the given device number,
+ * falling back to its primary node.
+ */
+static int open_drm_device(dev_t dev) {
+	int devices_len = drmGetDevices2(0, NULL, 0);
+	if (devices_len <= 0) {
+		return -1;
+	}
+	drmDevice **devices = calloc(devices_len, sizeof(drmDevice *));
+	if (devices == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return -1;
+	}
+	devices_len = drmGetDevices2(0, devices, devices_len);
+
+	int fd = -1;
+	for (int i = 0; i < devices_len && fd < 0; ++i) {
+		drmDevice *device = devices[i];
+		bool match = false;
+		for (int node = 0; node < DRM_NODE_MAX; ++node) {
+			struct stat st;
+			if ((device->available_nodes & (1 << node)) &&
+					stat(device->nodes[node], &st) == 0 &&
+					st.st_rdev == dev) {
+				match = true;
+				break;
+			}
+		}
+		if (!match) {
+			continue;
+		}
+
+		int node = (device->available_nodes & (1 << DRM_NODE_RENDER)) ?
+			DRM_NODE_RENDER : DRM_NODE_PRIMARY;
+		fd = open(device->nodes[node], O_RDWR | O_CLOEXEC);
+		if (fd < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to open %s",
+				device->nodes[node]);
+		}
+	}
+
+	drmFreeDevices(devices, devices_len);
+	free(devices);
+	return fd;
+}
+
+/**
+ * Creates an allocator on the renderer's DRM device, so that outputs can be
+ * backed by DMA-BUFs that can be exported.
+ */
+static void init_allocator(struct wlr_headless_backend *backend) {
+	if (wlr_renderer_is_pixman(backend->renderer)) {
+		return;
+	}
+
+	dev_t dev;
+	if (!wlr_renderer_get_drm_device(backend->renderer, &dev)) {
+		wlr_log(WLR_INFO, "Renderer DRM device unknown, "
+			"headless outputs won't support DMA-BUF export");
+		return;
+	}
+
+	int fd = open_drm_device(dev);
+	if (fd < 0) {
+		wlr_log(WLR_INFO, "Failed to open renderer DRM device, "
+			"headless outputs won't support DMA-BUF export");
+		return;
+	}
+
+	backend->allocator = wlr_gbm_allocator_create(fd);
+	if (backend->allocator == NULL) {
+		close(fd);
+	}
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_headless_backend *backend =
 		wl_container_of(listener, backend, display_destroy);
@@ -121,6 +204,8 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display,
 		return NULL;
 	}
 
+	init_allocator(backend);
+
 	backend->display_destroy.notify = handle_display_destroy;
 	wl_display_add_destroy_listener(display, &backend->display_destroy);
 
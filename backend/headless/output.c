@@ -1,8 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
@@ -26,21 +31,59 @@ static EGLSurface egl_create_surface(struct wlr_egl *egl, unsigned int width,
 	return surf;
 }
 
+static void output_destroy_swapchain(struct wlr_headless_output *output) {
+	if (output->buffer_bound) {
+		wlr_renderer_unbind_offscreen(output->backend->renderer);
+		output->buffer_bound = false;
+	}
+	wlr_swapchain_destroy(output->swapchain);
+	output->swapchain = NULL;
+}
+
+static bool output_create_buffer(struct wlr_headless_output *output,
+		unsigned int width, unsigned int height) {
+	struct wlr_headless_backend *backend = output->backend;
+
+	if (backend->allocator != NULL) {
+		output_destroy_swapchain(output);
+		output->swapchain = wlr_swapchain_create(backend->allocator,
+			width, height, DRM_FORMAT_XRGB8888, NULL, 0,
+			HEADLESS_BUFFERS_LEN);
+		return output->swapchain != NULL;
+	}
+
+	if (wlr_renderer_is_pixman(backend->renderer)) {
+		if (output->image != NULL) {
+			wlr_pixman_renderer_bind_image(backend->renderer, NULL);
+			pixman_image_unref(output->image);
+		}
+		output->image = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+			width, height, NULL, 0);
+		output->image_rendered = false;
+		if (output->image == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create pixman image");
+			return false;
+		}
+		return true;
+	}
+
+	wlr_egl_destroy_surface(&backend->egl, output->egl_surface);
+	output->egl_surface = egl_create_surface(&backend->egl, width, height);
+	output->image_rendered = false;
+	return output->egl_surface != EGL_NO_SURFACE;
+}
+
 static bool output_set_custom_mode(struct wlr_output *wlr_output, int32_t width,
 		int32_t height, int32_t refresh) {
 	struct wlr_headless_output *output =
 		headless_output_from_output(wlr_output);
-	struct wlr_headless_backend *backend = output->backend;
 
 	if (refresh <= 0) {
 		refresh = HEADLESS_DEFAULT_REFRESH;
 	}
 
-	wlr_egl_destroy_surface(&backend->egl, output->egl_surface);
-
-	output->egl_surface = egl_create_surface(&backend->egl, width, height);
-	if (output->egl_surface == EGL_NO_SURFACE) {
-		wlr_log(WLR_ERROR, "Failed to recreate EGL surface");
+	if (!output_create_buffer(output, width, height)) {
+		wlr_log(WLR_ERROR, "Failed to recreate output buffer");
 		wlr_output_destroy(wlr_output);
 		return false;
 	}
@@ -61,14 +104,129 @@ static void output_transform(struct wlr_output *wlr_output,
 static bool output_make_current(struct wlr_output *wlr_output, int *buffer_age) {
 	struct wlr_headless_output *output =
 		headless_output_from_output(wlr_output);
-	return wlr_egl_make_current(&output->backend->egl, output->egl_surface,
-		buffer_age);
+	if (output->image != NULL) {
+		wlr_pixman_renderer_bind_image(output->backend->renderer,
+			output->image);
+		// The image keeps its contents across frames
+		if (buffer_age != NULL) {
+			*buffer_age = output->image_rendered ? 1 : 0;
+		}
+		return true;
+	}
+	if (output->swapchain != NULL) {
+		int age;
+		struct wlr_allocator_buffer *back =
+			wlr_swapchain_acquire(output->swapchain, &age);
+		if (back == NULL || !wlr_renderer_bind_offscreen(
+				output->backend->renderer, &back->dmabuf,
+				back->dmabuf.width, back->dmabuf.height)) {
+			return false;
+		}
+		output->buffer_bound = true;
+		if (buffer_age != NULL) {
+			*buffer_age = age;
+		}
+		return true;
+	}
+	// Pbuffers have a single buffer, which EGL doesn't report the age of
+	if (!wlr_egl_make_current(&output->backend->egl, output->egl_surface,
+			NULL)) {
+		return false;
+	}
+	if (buffer_age != NULL) {
+		*buffer_age = output->image_rendered ? 1 : 0;
+	}
+	return true;
+}
+
+static void handle_idle_frame(void *data) {
+	struct wlr_headless_output *output = data;
+	output->idle_frame = NULL;
+	wlr_output_send_frame(&output->wlr_output);
+}
+
+static void output_schedule_idle_frame(struct wlr_headless_output *output) {
+	if (output->idle_frame != NULL) {
+		return;
+	}
+	struct wl_event_loop *ev =
+		wl_display_get_event_loop(output->backend->display);
+	output->idle_frame = wl_event_loop_add_idle(ev, handle_idle_frame, output);
+}
+
+static void output_send_virtual_present(struct wlr_headless_output *output) {
+	int refresh = output->wlr_output.refresh;
+	if (refresh <= 0) {
+		refresh = HEADLESS_DEFAULT_REFRESH;
+	}
+	int64_t period = 1000000000000ll / refresh;
+
+	output->virtual_time.tv_nsec += period;
+	while (output->virtual_time.tv_nsec >= 1000000000) {
+		output->virtual_time.tv_nsec -= 1000000000;
+		output->virtual_time.tv_sec++;
+	}
+
+	// No refresh is predicted, so that the render deadline doesn't wait for
+	// the virtual clock
+	struct wlr_output_event_present event = {
+		.when = &output->virtual_time,
+		.seq = ++output->virtual_seq,
+	};
+	wlr_output_send_present(&output->wlr_output, &event);
 }
 
 static bool output_swap_buffers(struct wlr_output *wlr_output,
 		pixman_region32_t *damage) {
-	// Nothing needs to be done for pbuffers
-	wlr_output_send_present(wlr_output, NULL);
+	struct wlr_headless_output *output =
+		headless_output_from_output(wlr_output);
+	// Nothing needs to be done for pbuffers and images
+	output->image_rendered = true;
+
+	if (output->buffer_bound) {
+		wlr_renderer_unbind_offscreen(output->backend->renderer);
+		output->buffer_bound = false;
+		wlr_swapchain_submit(output->swapchain);
+	}
+
+	switch (output->mode) {
+	case WLR_HEADLESS_OUTPUT_THROTTLED:
+		wlr_output_send_present(wlr_output, NULL);
+		break;
+	case WLR_HEADLESS_OUTPUT_UNTHROTTLED:
+		wlr_output_send_present(wlr_output, NULL);
+		output_schedule_idle_frame(output);
+		break;
+	case WLR_HEADLESS_OUTPUT_UNTHROTTLED_VIRTUAL_TIME:
+		output_send_virtual_present(output);
+		output_schedule_idle_frame(output);
+		break;
+	}
+	return true;
+}
+
+static bool output_schedule_frame(struct wlr_output *wlr_output) {
+	struct wlr_headless_output *output =
+		headless_output_from_output(wlr_output);
+	// Throttled outputs get their next frame from the timer
+	if (output->mode != WLR_HEADLESS_OUTPUT_THROTTLED) {
+		output_schedule_idle_frame(output);
+	}
+	return true;
+}
+
+static bool output_export_dmabuf(struct wlr_output *wlr_output,
+		struct wlr_dmabuf_attributes *attribs) {
+	struct wlr_headless_output *output =
+		headless_output_from_output(wlr_output);
+	struct wlr_allocator_buffer *front = output->swapchain != NULL ?
+		wlr_swapchain_get_front(output->swapchain) : NULL;
+	if (front == NULL ||
+			!wlr_dmabuf_attributes_copy(attribs, &front->dmabuf)) {
+		return false;
+	}
+	// Offscreen rendering leaves the contents y-inverted
+	attribs->flags |= WLR_DMABUF_ATTRIBUTES_FLAGS_Y_INVERT;
 	return true;
 }
 
@@ -79,8 +237,18 @@ static void output_destroy(struct wlr_output *wlr_output) {
 	wl_list_remove(&output->link);
 
 	wl_event_source_remove(output->frame_timer);
+	if (output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+	}
 
-	wlr_egl_destroy_surface(&output->backend->egl, output->egl_surface);
+	if (output->image != NULL) {
+		wlr_pixman_renderer_bind_image(output->backend->renderer, NULL);
+		pixman_image_unref(output->image);
+	} else if (output->backend->allocator != NULL) {
+		output_destroy_swapchain(output);
+	} else {
+		wlr_egl_destroy_surface(&output->backend->egl, output->egl_surface);
+	}
 	free(output);
 }
 
@@ -90,6 +258,8 @@ static const struct wlr_output_impl output_impl = {
 	.destroy = output_destroy,
 	.make_current = output_make_current,
 	.swap_buffers = output_swap_buffers,
+	.schedule_frame = output_schedule_frame,
+	.export_dmabuf = output_export_dmabuf,
 };
 
 bool wlr_output_is_headless(struct wlr_output *wlr_output) {
@@ -99,10 +269,59 @@ bool wlr_output_is_headless(struct wlr_output *wlr_output) {
 static int signal_frame(void *data) {
 	struct wlr_headless_output *output = data;
 	wlr_output_send_frame(&output->wlr_output);
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	if (output->mode == WLR_HEADLESS_OUTPUT_THROTTLED) {
+		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	}
 	return 0;
 }
 
+void headless_output_start_frames(struct wlr_headless_output *output) {
+	if (output->mode == WLR_HEADLESS_OUTPUT_THROTTLED) {
+		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	} else {
+		output_schedule_idle_frame(output);
+	}
+}
+
+void wlr_headless_output_set_mode(struct wlr_output *wlr_output,
+		enum wlr_headless_output_mode mode) {
+	struct wlr_headless_output *output =
+		headless_output_from_output(wlr_output);
+	if (output->mode == mode) {
+		return;
+	}
+
+	if (mode == WLR_HEADLESS_OUTPUT_UNTHROTTLED_VIRTUAL_TIME) {
+		clock_gettime(CLOCK_MONOTONIC, &output->virtual_time);
+	}
+
+	bool was_throttled = output->mode == WLR_HEADLESS_OUTPUT_THROTTLED;
+	output->mode = mode;
+	if (!output->backend->started) {
+		return;
+	}
+
+	if (mode == WLR_HEADLESS_OUTPUT_THROTTLED) {
+		if (output->idle_frame != NULL) {
+			wl_event_source_remove(output->idle_frame);
+			output->idle_frame = NULL;
+		}
+	} else if (was_throttled) {
+		wl_event_source_timer_update(output->frame_timer, 0);
+	}
+	headless_output_start_frames(output);
+}
+
+static enum wlr_headless_output_mode get_mode_from_env(void) {
+	const char *env = getenv("WLR_HEADLESS_UNTHROTTLED");
+	if (env == NULL || strcmp(env, "0") == 0) {
+		return WLR_HEADLESS_OUTPUT_THROTTLED;
+	} else if (strcmp(env, "virtual") == 0) {
+		return WLR_HEADLESS_OUTPUT_UNTHROTTLED_VIRTUAL_TIME;
+	}
+	return WLR_HEADLESS_OUTPUT_UNTHROTTLED;
+}
+
 struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 		unsigned int width, unsigned int height) {
 	struct wlr_headless_backend *backend =
@@ -115,13 +334,13 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 		return NULL;
 	}
 	output->backend = backend;
+	output->mode = get_mode_from_env();
 	wlr_output_init(&output->wlr_output, &backend->backend, &output_impl,
 		backend->display);
 	struct wlr_output *wlr_output = &output->wlr_output;
 
-	output->egl_surface = egl_create_surface(&backend->egl, width, height);
-	if (output->egl_surface == EGL_NO_SURFACE) {
-		wlr_log(WLR_ERROR, "Failed to create EGL surface");
+	if (!output_create_buffer(output, width, height)) {
+		wlr_log(WLR_ERROR, "Failed to create output buffer");
 		goto error;
 	}
 
@@ -131,8 +350,7 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 	snprintf(wlr_output->name, sizeof(wlr_output->name), "HEADLESS-%ld",
 		++backend->last_output_num);
 
-	if (!wlr_egl_make_current(&output->backend->egl, output->egl_surface,
-			NULL)) {
+	if (!output_make_current(wlr_output, NULL)) {
 		goto error;
 	}
 
@@ -145,8 +363,12 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 
 	wl_list_insert(&backend->outputs, &output->link);
 
+	if (output->mode == WLR_HEADLESS_OUTPUT_UNTHROTTLED_VIRTUAL_TIME) {
+		clock_gettime(CLOCK_MONOTONIC, &output->virtual_time);
+	}
+
 	if (backend->started) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		headless_output_start_frames(output);
 		wlr_output_update_enabled(wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output, wlr_output);
 	}
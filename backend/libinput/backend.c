@@ -1,6 +1,10 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <errno.h>
 #include <libinput.h>
+#include <libudev.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/backend/interface.h>
 #include <wlr/backend/session.h>
 #include <wlr/util/log.h>
@@ -16,12 +20,22 @@ static struct wlr_libinput_backend *get_libinput_backend_from_backend(
 static int libinput_open_restricted(const char *path,
 		int flags, void *_backend) {
 	struct wlr_libinput_backend *backend = _backend;
-	return wlr_session_open_file(backend->session, path);
+
+	struct wlr_libinput_prefetch *prefetch;
+	wl_list_for_each(prefetch, &backend->prefetches, link) {
+		if (prefetch->fd >= 0 && strcmp(prefetch->path, path) == 0) {
+			int fd = prefetch->fd;
+			prefetch->fd = -1;
+			return fd;
+		}
+	}
+
+	return libinput_thread_open_file(backend, path);
 }
 
 static void libinput_close_restricted(int fd, void *_backend) {
 	struct wlr_libinput_backend *backend = _backend;
-	wlr_session_close_file(backend->session, fd);
+	libinput_thread_close_file(backend, fd);
 }
 
 static const struct libinput_interface libinput_impl = {
@@ -49,9 +63,16 @@ static void log_libinput(struct libinput *libinput_context,
 	_wlr_vlog(WLR_ERROR, fmt, args);
 }
 
-static bool backend_start(struct wlr_backend *wlr_backend) {
-	struct wlr_libinput_backend *backend =
-		get_libinput_backend_from_backend(wlr_backend);
+static bool async_open_enabled(void) {
+	const char *env = getenv("WLR_LIBINPUT_ASYNC_OPEN");
+	return env != NULL && strcmp(env, "1") == 0;
+}
+
+// Enumerates and opens the input devices, their events are queued until start
+static bool init_libinput_context(struct wlr_libinput_backend *backend) {
+	if (backend->libinput_context) {
+		return true;
+	}
 	wlr_log(WLR_DEBUG, "Initializing libinput");
 
 	backend->libinput_context = libinput_udev_create_context(&libinput_impl,
@@ -61,16 +82,22 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 		return false;
 	}
 
+	// TODO: More sophisticated logging
+	libinput_log_set_handler(backend->libinput_context, log_libinput);
+	libinput_log_set_priority(backend->libinput_context, LIBINPUT_LOG_PRIORITY_ERROR);
+
 	if (libinput_udev_assign_seat(backend->libinput_context,
 			backend->session->seat) != 0) {
 		wlr_log(WLR_ERROR, "Failed to assign libinput seat");
+		libinput_unref(backend->libinput_context);
+		backend->libinput_context = NULL;
 		return false;
 	}
+	return true;
+}
 
-	// TODO: More sophisticated logging
-	libinput_log_set_handler(backend->libinput_context, log_libinput);
-	libinput_log_set_priority(backend->libinput_context, LIBINPUT_LOG_PRIORITY_ERROR);
-
+static bool start_libinput_events(struct wlr_libinput_backend *backend,
+		bool require_devices) {
 	int libinput_fd = libinput_get_fd(backend->libinput_context);
 	char *no_devs = getenv("WLR_LIBINPUT_NO_DEVICES");
 	if (no_devs) {
@@ -78,7 +105,10 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 			no_devs = NULL;
 		}
 	}
-	if (!no_devs && backend->wlr_device_lists.length == 0) {
+	if (!require_devices) {
+		// Add the devices right away
+		handle_libinput_readable(libinput_fd, WL_EVENT_READABLE, backend);
+	} else if (!no_devs && backend->wlr_device_lists.length == 0) {
 		handle_libinput_readable(libinput_fd, WL_EVENT_READABLE, backend);
 		if (backend->wlr_device_lists.length == 0) {
 			wlr_log(WLR_ERROR, "libinput initialization failed, no input devices");
@@ -98,10 +128,154 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 		wlr_log(WLR_ERROR, "Failed to create input event on event loop");
 		return false;
 	}
+
+	const char *threaded = getenv("WLR_LIBINPUT_THREAD");
+	if (threaded != NULL && strcmp(threaded, "1") == 0) {
+		if (libinput_thread_start(backend)) {
+			// The reader thread now watches the libinput fd
+			wl_event_source_remove(backend->input_event);
+			backend->input_event = NULL;
+		} else {
+			wlr_log(WLR_ERROR, "Falling back to reading libinput events "
+				"from the event loop");
+		}
+	}
 	wlr_log(WLR_DEBUG, "libinput successfully initialized");
 	return true;
 }
 
+static void prefetch_destroy(struct wlr_libinput_prefetch *prefetch) {
+	if (prefetch->request != NULL) {
+		wlr_session_open_request_cancel(prefetch->request);
+	}
+	if (prefetch->fd >= 0) {
+		wlr_session_close_file(prefetch->backend->session, prefetch->fd);
+	}
+	wl_list_remove(&prefetch->link);
+	free(prefetch->path);
+	free(prefetch);
+}
+
+static void finish_prefetch(struct wlr_libinput_backend *backend) {
+	if (init_libinput_context(backend)) {
+		start_libinput_events(backend, false);
+	}
+
+	// Drop the devices libinput didn't want
+	struct wlr_libinput_prefetch *prefetch, *tmp;
+	wl_list_for_each_safe(prefetch, tmp, &backend->prefetches, link) {
+		prefetch_destroy(prefetch);
+	}
+}
+
+static void prefetch_handle_open(struct wlr_session *session, int fd,
+		void *data) {
+	struct wlr_libinput_prefetch *prefetch = data;
+	struct wlr_libinput_backend *backend = prefetch->backend;
+	prefetch->request = NULL;
+	prefetch->fd = fd;
+
+	struct wlr_libinput_prefetch *iter;
+	wl_list_for_each(iter, &backend->prefetches, link) {
+		if (iter->request != NULL) {
+			return;
+		}
+	}
+	finish_prefetch(backend);
+}
+
+static void prefetch_device(struct wlr_libinput_backend *backend,
+		const char *path) {
+	struct wlr_libinput_prefetch *prefetch =
+		calloc(1, sizeof(struct wlr_libinput_prefetch));
+	if (prefetch == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed: %s", strerror(errno));
+		return;
+	}
+	prefetch->backend = backend;
+	prefetch->fd = -1;
+	prefetch->path = strdup(path);
+	if (prefetch->path == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed: %s", strerror(errno));
+		free(prefetch);
+		return;
+	}
+
+	prefetch->request = wlr_session_open_file_async(backend->session, path,
+		prefetch_handle_open, prefetch);
+	if (prefetch->request == NULL) {
+		free(prefetch->path);
+		free(prefetch);
+		return;
+	}
+	wl_list_insert(&backend->prefetches, &prefetch->link);
+}
+
+/**
+ * Opens the seat's input devices concurrently, libinput is initialized with
+ * them once they're all open. The devices are added after start returns.
+ */
+static void start_prefetch(struct wlr_libinput_backend *backend) {
+	struct udev_enumerate *enumerate =
+		udev_enumerate_new(backend->session->udev);
+	if (enumerate == NULL) {
+		finish_prefetch(backend);
+		return;
+	}
+	udev_enumerate_add_match_subsystem(enumerate, "input");
+	udev_enumerate_add_match_sysname(enumerate, "event*");
+	udev_enumerate_scan_devices(enumerate);
+
+	struct udev_list_entry *entry;
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+		const char *syspath = udev_list_entry_get_name(entry);
+		struct udev_device *dev = udev_device_new_from_syspath(
+			backend->session->udev, syspath);
+		if (dev == NULL) {
+			continue;
+		}
+
+		const char *seat = udev_device_get_property_value(dev, "ID_SEAT");
+		if (seat == NULL) {
+			seat = "seat0";
+		}
+		const char *path = udev_device_get_devnode(dev);
+		if (path != NULL && strcmp(seat, backend->session->seat) == 0) {
+			prefetch_device(backend, path);
+		}
+		udev_device_unref(dev);
+	}
+	udev_enumerate_unref(enumerate);
+
+	if (wl_list_empty(&backend->prefetches)) {
+		finish_prefetch(backend);
+	}
+}
+
+static bool backend_prepare_start(struct wlr_backend *wlr_backend) {
+	struct wlr_libinput_backend *backend =
+		get_libinput_backend_from_backend(wlr_backend);
+	if (async_open_enabled()) {
+		// The devices are opened from the event loop in start
+		return true;
+	}
+	return init_libinput_context(backend);
+}
+
+static bool backend_start(struct wlr_backend *wlr_backend) {
+	struct wlr_libinput_backend *backend =
+		get_libinput_backend_from_backend(wlr_backend);
+	if (async_open_enabled()) {
+		start_prefetch(backend);
+		return true;
+	}
+
+	if (!init_libinput_context(backend)) {
+		return false;
+	}
+	return start_libinput_events(backend, true);
+}
+
 static void backend_destroy(struct wlr_backend *wlr_backend) {
 	if (!wlr_backend) {
 		return;
@@ -109,6 +283,13 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 	struct wlr_libinput_backend *backend =
 		get_libinput_backend_from_backend(wlr_backend);
 
+	libinput_thread_stop(backend);
+
+	struct wlr_libinput_prefetch *prefetch, *prefetch_tmp;
+	wl_list_for_each_safe(prefetch, prefetch_tmp, &backend->prefetches, link) {
+		prefetch_destroy(prefetch);
+	}
+
 	for (size_t i = 0; i < backend->wlr_device_lists.length; i++) {
 		struct wl_list *wlr_devices = backend->wlr_device_lists.items[i];
 		struct wlr_input_device *wlr_dev, *next;
@@ -134,6 +315,7 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 static const struct wlr_backend_impl backend_impl = {
 	.start = backend_start,
 	.destroy = backend_destroy,
+	.prepare_start = backend_prepare_start,
 };
 
 bool wlr_backend_is_libinput(struct wlr_backend *b) {
@@ -149,11 +331,13 @@ static void session_signal(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	libinput_backend_lock(backend);
 	if (session->active) {
 		libinput_resume(backend->libinput_context);
 	} else {
 		libinput_suspend(backend->libinput_context);
 	}
+	libinput_backend_unlock(backend);
 }
 
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
@@ -179,6 +363,7 @@ struct wlr_backend *wlr_libinput_backend_create(struct wl_display *display,
 
 	backend->session = session;
 	backend->display = display;
+	wl_list_init(&backend->prefetches);
 
 	backend->session_signal.notify = session_signal;
 	wl_signal_add(&session->session_signal, &backend->session_signal);
@@ -199,6 +384,66 @@ struct libinput_device *wlr_libinput_get_device_handle(
 	return dev->handle;
 }
 
+// Whether all wlr_input_devices created for a libinput device are disabled
+static bool all_devices_disabled(struct wl_list *wlr_devices) {
+	struct wlr_input_device *wlr_dev;
+	wl_list_for_each(wlr_dev, wlr_devices, link) {
+		struct wlr_libinput_input_device *dev =
+			(struct wlr_libinput_input_device *)wlr_dev;
+		if (!dev->disabled) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void wlr_libinput_set_device_enabled(struct wlr_input_device *wlr_dev,
+		bool enabled) {
+	assert(wlr_input_device_is_libinput(wlr_dev));
+	struct wlr_libinput_input_device *dev =
+		(struct wlr_libinput_input_device *)wlr_dev;
+	if (dev->disabled == !enabled) {
+		return;
+	}
+
+	struct wl_list *wlr_devices = libinput_device_get_user_data(dev->handle);
+	bool was_suspended = all_devices_disabled(wlr_devices);
+	dev->disabled = !enabled;
+	bool suspended = all_devices_disabled(wlr_devices);
+	if (was_suspended == suspended) {
+		return;
+	}
+
+	struct wlr_libinput_backend *backend = libinput_get_user_data(
+		libinput_device_get_context(dev->handle));
+	libinput_backend_lock(backend);
+	if (suspended) {
+		uint32_t mode =
+			libinput_device_config_send_events_get_mode(dev->handle);
+		struct wlr_input_device *other;
+		wl_list_for_each(other, wlr_devices, link) {
+			((struct wlr_libinput_input_device *)other)->send_events_mode =
+				mode;
+		}
+		libinput_device_config_send_events_set_mode(dev->handle,
+			LIBINPUT_CONFIG_SEND_EVENTS_DISABLED);
+	} else {
+		libinput_device_config_send_events_set_mode(dev->handle,
+			dev->send_events_mode);
+	}
+	libinput_backend_unlock(backend);
+}
+
+void wlr_libinput_backend_set_motion_handler(struct wlr_backend *wlr_backend,
+		wlr_libinput_motion_handler_t handler, void *data) {
+	struct wlr_libinput_backend *backend =
+		get_libinput_backend_from_backend(wlr_backend);
+	libinput_backend_lock(backend);
+	backend->motion_handler = handler;
+	backend->motion_handler_data = data;
+	libinput_backend_unlock(backend);
+}
+
 uint32_t usec_to_msec(uint64_t usec) {
 	return (uint32_t)(usec / 1000);
 }
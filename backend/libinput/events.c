@@ -8,6 +8,7 @@
 #include <wlr/util/log.h>
 #include "backend/libinput.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 struct wlr_libinput_input_device *get_libinput_device_from_device(
 		struct wlr_input_device *wlr_dev) {
@@ -222,10 +223,69 @@ static void handle_device_removed(struct wlr_libinput_backend *backend,
 	free(wlr_devices);
 }
 
+// Gets the type of the device an input event is emitted on, returns false for
+// other events
+static bool get_event_device_type(enum libinput_event_type event_type,
+		enum wlr_input_device_type *type) {
+	switch (event_type) {
+	case LIBINPUT_EVENT_KEYBOARD_KEY:
+		*type = WLR_INPUT_DEVICE_KEYBOARD;
+		return true;
+	case LIBINPUT_EVENT_POINTER_MOTION:
+	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+	case LIBINPUT_EVENT_POINTER_BUTTON:
+	case LIBINPUT_EVENT_POINTER_AXIS:
+	case LIBINPUT_EVENT_GESTURE_SWIPE_BEGIN:
+	case LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE:
+	case LIBINPUT_EVENT_GESTURE_SWIPE_END:
+	case LIBINPUT_EVENT_GESTURE_PINCH_BEGIN:
+	case LIBINPUT_EVENT_GESTURE_PINCH_UPDATE:
+	case LIBINPUT_EVENT_GESTURE_PINCH_END:
+		*type = WLR_INPUT_DEVICE_POINTER;
+		return true;
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+	case LIBINPUT_EVENT_TOUCH_UP:
+	case LIBINPUT_EVENT_TOUCH_MOTION:
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+	case LIBINPUT_EVENT_TOUCH_FRAME:
+		*type = WLR_INPUT_DEVICE_TOUCH;
+		return true;
+	case LIBINPUT_EVENT_TABLET_TOOL_AXIS:
+	case LIBINPUT_EVENT_TABLET_TOOL_PROXIMITY:
+	case LIBINPUT_EVENT_TABLET_TOOL_TIP:
+	case LIBINPUT_EVENT_TABLET_TOOL_BUTTON:
+		*type = WLR_INPUT_DEVICE_TABLET_TOOL;
+		return true;
+	case LIBINPUT_EVENT_TABLET_PAD_BUTTON:
+	case LIBINPUT_EVENT_TABLET_PAD_RING:
+	case LIBINPUT_EVENT_TABLET_PAD_STRIP:
+		*type = WLR_INPUT_DEVICE_TABLET_PAD;
+		return true;
+	case LIBINPUT_EVENT_SWITCH_TOGGLE:
+		*type = WLR_INPUT_DEVICE_SWITCH;
+		return true;
+	default:
+		return false;
+	}
+}
+
 void handle_libinput_event(struct wlr_libinput_backend *backend,
 		struct libinput_event *event) {
 	struct libinput_device *libinput_dev = libinput_event_get_device(event);
 	enum libinput_event_type event_type = libinput_event_get_type(event);
+	wlr_trace(input_event, libinput_dev, event_type);
+
+	// Don't bother converting events nobody wants
+	enum wlr_input_device_type type;
+	if (get_event_device_type(event_type, &type)) {
+		struct wlr_input_device *wlr_dev =
+			get_appropriate_device(type, libinput_dev);
+		if (wlr_dev != NULL &&
+				get_libinput_device_from_device(wlr_dev)->disabled) {
+			return;
+		}
+	}
+
 	switch (event_type) {
 	case LIBINPUT_EVENT_DEVICE_ADDED:
 		handle_device_added(backend, libinput_dev);
@@ -261,7 +321,7 @@ void handle_libinput_event(struct wlr_libinput_backend *backend,
 		handle_touch_cancel(event, libinput_dev);
 		break;
 	case LIBINPUT_EVENT_TOUCH_FRAME:
-		// no-op (at least for now)
+		handle_touch_frame(event, libinput_dev);
 		break;
 	case LIBINPUT_EVENT_TABLET_TOOL_AXIS:
 		handle_tablet_tool_axis(event, libinput_dev);
@@ -23,7 +23,11 @@ static struct wlr_libinput_keyboard *get_libinput_keyboard_from_keyboard(
 static void keyboard_set_leds(struct wlr_keyboard *wlr_kb, uint32_t leds) {
 	struct wlr_libinput_keyboard *kb =
 		get_libinput_keyboard_from_keyboard(wlr_kb);
+	struct wlr_libinput_backend *backend = libinput_get_user_data(
+		libinput_device_get_context(kb->libinput_dev));
+	libinput_backend_lock(backend);
 	libinput_device_led_update(kb->libinput_dev, leds);
+	libinput_backend_unlock(backend);
 }
 
 static void keyboard_destroy(struct wlr_keyboard *wlr_kb) {
@@ -65,8 +69,8 @@ void handle_keyboard_key(struct libinput_event *event,
 	struct libinput_event_keyboard *kbevent =
 		libinput_event_get_keyboard_event(event);
 	struct wlr_event_keyboard_key wlr_event = { 0 };
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_keyboard_get_time_usec(kbevent));
+	wlr_event.time_usec = libinput_event_keyboard_get_time_usec(kbevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.keycode = libinput_event_keyboard_get_key(kbevent);
 	enum libinput_key_state state =
 		libinput_event_keyboard_get_key_state(kbevent);
@@ -49,7 +49,7 @@ void handle_switch_toggle(struct libinput_event *event,
 		wlr_event.switch_state = WLR_SWITCH_STATE_ON;
 		break;
 	}
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_switch_get_time_usec(sevent));
+	wlr_event.time_usec = libinput_event_switch_get_time_usec(sevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_signal_emit_safe(&wlr_dev->lid_switch->events.toggle, &wlr_event);
 }
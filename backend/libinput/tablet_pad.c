@@ -109,8 +109,8 @@ void handle_tablet_pad_button(struct libinput_event *event,
 	struct libinput_event_tablet_pad *pevent =
 		libinput_event_get_tablet_pad_event(event);
 	struct wlr_event_tablet_pad_button wlr_event = { 0 };
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_pad_get_time_usec(pevent));
+	wlr_event.time_usec = libinput_event_tablet_pad_get_time_usec(pevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.button = libinput_event_tablet_pad_get_button_number(pevent);
 	wlr_event.mode = libinput_event_tablet_pad_get_mode(pevent);
 	wlr_event.group = libinput_tablet_pad_mode_group_get_index(
@@ -138,8 +138,8 @@ void handle_tablet_pad_ring(struct libinput_event *event,
 	struct libinput_event_tablet_pad *pevent =
 		libinput_event_get_tablet_pad_event(event);
 	struct wlr_event_tablet_pad_ring wlr_event = { 0 };
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_pad_get_time_usec(pevent));
+	wlr_event.time_usec = libinput_event_tablet_pad_get_time_usec(pevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.ring = libinput_event_tablet_pad_get_ring_number(pevent);
 	wlr_event.position = libinput_event_tablet_pad_get_ring_position(pevent);
 	wlr_event.mode = libinput_event_tablet_pad_get_mode(pevent);
@@ -166,8 +166,8 @@ void handle_tablet_pad_strip(struct libinput_event *event,
 	struct libinput_event_tablet_pad *pevent =
 		libinput_event_get_tablet_pad_event(event);
 	struct wlr_event_tablet_pad_strip wlr_event = { 0 };
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_pad_get_time_usec(pevent));
+	wlr_event.time_usec = libinput_event_tablet_pad_get_time_usec(pevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.strip = libinput_event_tablet_pad_get_strip_number(pevent);
 	wlr_event.position = libinput_event_tablet_pad_get_strip_position(pevent);
 	wlr_event.mode = libinput_event_tablet_pad_get_mode(pevent);
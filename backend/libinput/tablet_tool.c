@@ -202,8 +202,8 @@ void handle_tablet_tool_axis(struct libinput_event *event,
 
 	wlr_event.device = wlr_dev;
 	wlr_event.tool = &tool->wlr_tool;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_tool_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_tablet_tool_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	if (libinput_event_tablet_tool_x_has_changed(tevent)) {
 		wlr_event.updated_axes |= WLR_TABLET_TOOL_AXIS_X;
 		wlr_event.x = libinput_event_tablet_tool_get_x_transformed(tevent, 1);
@@ -263,8 +263,8 @@ void handle_tablet_tool_proximity(struct libinput_event *event,
 
 	wlr_event.tool = &tool->wlr_tool;
 	wlr_event.device = wlr_dev;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_tool_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_tablet_tool_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	switch (libinput_event_tablet_tool_get_proximity_state(tevent)) {
 	case LIBINPUT_TABLET_TOOL_PROXIMITY_STATE_OUT:
 		wlr_event.state = WLR_TABLET_TOOL_PROXIMITY_OUT;
@@ -324,8 +324,8 @@ void handle_tablet_tool_tip(struct libinput_event *event,
 
 	wlr_event.device = wlr_dev;
 	wlr_event.tool = &tool->wlr_tool;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_tool_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_tablet_tool_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	switch (libinput_event_tablet_tool_get_tip_state(tevent)) {
 	case LIBINPUT_TABLET_TOOL_TIP_UP:
 		wlr_event.state = WLR_TABLET_TOOL_TIP_UP;
@@ -356,8 +356,8 @@ void handle_tablet_tool_button(struct libinput_event *event,
 
 	wlr_event.device = wlr_dev;
 	wlr_event.tool = &tool->wlr_tool;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_tablet_tool_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_tablet_tool_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.button = libinput_event_tablet_tool_get_button(tevent);
 	switch (libinput_event_tablet_tool_get_button_state(tevent)) {
 	case LIBINPUT_BUTTON_STATE_RELEASED:
@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <libinput.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wlr/backend/session.h>
+#include <wlr/util/log.h>
+#include "backend/libinput.h"
+
+/*
+ * The reader thread only ever reads events from libinput and hands them to the
+ * optional motion handler, everything else happens on the main thread. Both
+ * threads take backend->thread.lock before touching the libinput context.
+ *
+ * libinput opens devices from libinput_dispatch when they're hotplugged, but
+ * the session must only be used from the main thread. The reader thread thus
+ * forwards open/close requests to the main thread and waits for them. To avoid
+ * a deadlock, the main thread keeps servicing requests while it waits for the
+ * libinput lock.
+ */
+
+static_assert((WLR_LIBINPUT_QUEUE_LEN & (WLR_LIBINPUT_QUEUE_LEN - 1)) == 0,
+	"WLR_LIBINPUT_QUEUE_LEN must be a power of two");
+
+static bool queue_push(struct wlr_libinput_thread *thread,
+		struct libinput_event *event) {
+	size_t tail = atomic_load_explicit(&thread->queue_tail,
+		memory_order_relaxed);
+	size_t head = atomic_load_explicit(&thread->queue_head,
+		memory_order_acquire);
+	if (tail - head == WLR_LIBINPUT_QUEUE_LEN) {
+		return false;
+	}
+	thread->queue[tail & (WLR_LIBINPUT_QUEUE_LEN - 1)] = event;
+	atomic_store_explicit(&thread->queue_tail, tail + 1, memory_order_release);
+	return true;
+}
+
+static bool queue_full(struct wlr_libinput_thread *thread) {
+	size_t tail = atomic_load_explicit(&thread->queue_tail,
+		memory_order_relaxed);
+	size_t head = atomic_load_explicit(&thread->queue_head,
+		memory_order_acquire);
+	return tail - head == WLR_LIBINPUT_QUEUE_LEN;
+}
+
+static struct libinput_event *queue_pop(struct wlr_libinput_thread *thread) {
+	size_t head = atomic_load_explicit(&thread->queue_head,
+		memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&thread->queue_tail,
+		memory_order_acquire);
+	if (head == tail) {
+		return NULL;
+	}
+	struct libinput_event *event =
+		thread->queue[head & (WLR_LIBINPUT_QUEUE_LEN - 1)];
+	atomic_store_explicit(&thread->queue_head, head + 1, memory_order_release);
+	return event;
+}
+
+static bool on_reader_thread(struct wlr_libinput_backend *backend) {
+	return backend->thread.running &&
+		pthread_equal(pthread_self(), backend->thread.thread);
+}
+
+// Must be called with request_mutex held
+static void service_request(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	if (thread->request.path != NULL) {
+		thread->request.fd =
+			wlr_session_open_file(backend->session, thread->request.path);
+	} else {
+		wlr_session_close_file(backend->session, thread->request.fd);
+	}
+	thread->request.pending = false;
+	pthread_cond_broadcast(&thread->request_cond);
+}
+
+int libinput_thread_open_file(struct wlr_libinput_backend *backend,
+		const char *path) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	if (!on_reader_thread(backend)) {
+		return wlr_session_open_file(backend->session, path);
+	}
+
+	pthread_mutex_lock(&thread->request_mutex);
+	if (thread->stopping) {
+		// The main thread is blocked joining us
+		pthread_mutex_unlock(&thread->request_mutex);
+		return wlr_session_open_file(backend->session, path);
+	}
+	thread->request.path = path;
+	thread->request.pending = true;
+	pthread_cond_broadcast(&thread->request_cond);
+	eventfd_write(thread->event_fd, 1);
+	while (thread->request.pending) {
+		pthread_cond_wait(&thread->request_cond, &thread->request_mutex);
+	}
+	int fd = thread->request.fd;
+	pthread_mutex_unlock(&thread->request_mutex);
+	return fd;
+}
+
+void libinput_thread_close_file(struct wlr_libinput_backend *backend,
+		int fd) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	if (!on_reader_thread(backend)) {
+		wlr_session_close_file(backend->session, fd);
+		return;
+	}
+
+	pthread_mutex_lock(&thread->request_mutex);
+	if (thread->stopping) {
+		pthread_mutex_unlock(&thread->request_mutex);
+		wlr_session_close_file(backend->session, fd);
+		return;
+	}
+	thread->request.path = NULL;
+	thread->request.fd = fd;
+	thread->request.pending = true;
+	pthread_cond_broadcast(&thread->request_cond);
+	eventfd_write(thread->event_fd, 1);
+	while (thread->request.pending) {
+		pthread_cond_wait(&thread->request_cond, &thread->request_mutex);
+	}
+	pthread_mutex_unlock(&thread->request_mutex);
+}
+
+void libinput_backend_lock(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	if (!thread->running) {
+		return;
+	}
+	assert(!on_reader_thread(backend));
+
+	pthread_mutex_lock(&thread->request_mutex);
+	while (pthread_mutex_trylock(&thread->lock) != 0) {
+		if (thread->request.pending) {
+			service_request(backend);
+		} else {
+			pthread_cond_wait(&thread->request_cond, &thread->request_mutex);
+		}
+	}
+	pthread_mutex_unlock(&thread->request_mutex);
+}
+
+void libinput_backend_unlock(struct wlr_libinput_backend *backend) {
+	if (!backend->thread.running) {
+		return;
+	}
+	pthread_mutex_unlock(&backend->thread.lock);
+}
+
+static void reader_unlock(struct wlr_libinput_thread *thread) {
+	pthread_mutex_unlock(&thread->lock);
+	// Wake up the main thread if it's waiting for the lock
+	pthread_mutex_lock(&thread->request_mutex);
+	pthread_cond_broadcast(&thread->request_cond);
+	pthread_mutex_unlock(&thread->request_mutex);
+}
+
+// Called with the lock held
+static void reader_handle_event(struct wlr_libinput_backend *backend,
+		struct libinput_event *event) {
+	if (backend->motion_handler == NULL ||
+			libinput_event_get_type(event) != LIBINPUT_EVENT_POINTER_MOTION) {
+		return;
+	}
+
+	struct libinput_event_pointer *pointer_event =
+		libinput_event_get_pointer_event(event);
+	struct wlr_libinput_motion_event motion = {
+		.device = libinput_event_get_device(event),
+		.time_usec = libinput_event_pointer_get_time_usec(pointer_event),
+		.delta_x = libinput_event_pointer_get_dx(pointer_event),
+		.delta_y = libinput_event_pointer_get_dy(pointer_event),
+	};
+	backend->motion_handler(&motion, backend->motion_handler_data);
+}
+
+static void *reader_run(void *data) {
+	struct wlr_libinput_backend *backend = data;
+	struct wlr_libinput_thread *thread = &backend->thread;
+
+	struct pollfd fds[] = {
+		{ .fd = libinput_get_fd(backend->libinput_context), .events = POLLIN },
+		{ .fd = thread->wake_fd, .events = POLLIN },
+	};
+	while (!atomic_load(&thread->stop)) {
+		if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			wlr_log_errno(WLR_ERROR, "poll failed");
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			eventfd_t count;
+			eventfd_read(thread->wake_fd, &count);
+		}
+
+		pthread_mutex_lock(&thread->lock);
+		// Keep reading from the kernel even when the queue is full, libinput
+		// buffers the events and they are queued once there's room again
+		if ((fds[0].revents & POLLIN) &&
+				libinput_dispatch(backend->libinput_context) != 0) {
+			wlr_log(WLR_ERROR, "Failed to dispatch libinput");
+		}
+		bool queued = false;
+		while (!queue_full(thread) &&
+				libinput_next_event_type(backend->libinput_context) !=
+				LIBINPUT_EVENT_NONE) {
+			struct libinput_event *event =
+				libinput_get_event(backend->libinput_context);
+			reader_handle_event(backend, event);
+			queue_push(thread, event);
+			queued = true;
+		}
+		reader_unlock(thread);
+
+		if (queued) {
+			eventfd_write(thread->event_fd, 1);
+		}
+	}
+
+	return NULL;
+}
+
+static int handle_queue_readable(int fd, uint32_t mask, void *data) {
+	struct wlr_libinput_backend *backend = data;
+	struct wlr_libinput_thread *thread = &backend->thread;
+
+	eventfd_t count;
+	eventfd_read(thread->event_fd, &count);
+
+	pthread_mutex_lock(&thread->request_mutex);
+	if (thread->request.pending) {
+		service_request(backend);
+	}
+	pthread_mutex_unlock(&thread->request_mutex);
+
+	bool was_full = queue_full(thread);
+	struct libinput_event *event;
+	while ((event = queue_pop(thread)) != NULL) {
+		libinput_backend_lock(backend);
+		handle_libinput_event(backend, event);
+		libinput_event_destroy(event);
+		libinput_backend_unlock(backend);
+	}
+
+	if (was_full) {
+		// Let the reader thread queue the events libinput has buffered
+		eventfd_write(thread->wake_fd, 1);
+	}
+	return 0;
+}
+
+bool libinput_thread_start(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	assert(!thread->running);
+
+	thread->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->event_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "eventfd failed");
+		return false;
+	}
+	thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->wake_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "eventfd failed");
+		goto error_event_fd;
+	}
+
+	struct wl_event_loop *event_loop =
+		wl_display_get_event_loop(backend->display);
+	thread->queue_event = wl_event_loop_add_fd(event_loop, thread->event_fd,
+		WL_EVENT_READABLE, handle_queue_readable, backend);
+	if (thread->queue_event == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create queue event on event loop");
+		goto error_wake_fd;
+	}
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	// Event handlers may call back into the backend, e.g. to update LEDs
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&thread->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_init(&thread->request_mutex, NULL);
+	pthread_cond_init(&thread->request_cond, NULL);
+	atomic_init(&thread->queue_head, 0);
+	atomic_init(&thread->queue_tail, 0);
+	atomic_init(&thread->stop, false);
+	thread->stopping = false;
+	thread->request.pending = false;
+
+	// Set before the thread runs so that on_reader_thread works from the start
+	thread->running = true;
+	int ret = pthread_create(&thread->thread, NULL, reader_run, backend);
+	if (ret != 0) {
+		wlr_log(WLR_ERROR, "Failed to create libinput thread: %s",
+			strerror(ret));
+		thread->running = false;
+		goto error_sync;
+	}
+
+	wlr_log(WLR_DEBUG, "Reading libinput events from a dedicated thread");
+	return true;
+
+error_sync:
+	pthread_cond_destroy(&thread->request_cond);
+	pthread_mutex_destroy(&thread->request_mutex);
+	pthread_mutex_destroy(&thread->lock);
+	wl_event_source_remove(thread->queue_event);
+error_wake_fd:
+	close(thread->wake_fd);
+error_event_fd:
+	close(thread->event_fd);
+	return false;
+}
+
+void libinput_thread_stop(struct wlr_libinput_backend *backend) {
+	struct wlr_libinput_thread *thread = &backend->thread;
+	if (!thread->running) {
+		return;
+	}
+
+	atomic_store(&thread->stop, true);
+	pthread_mutex_lock(&thread->request_mutex);
+	// From now on the reader thread uses the session directly, since we don't
+	// touch it until the thread has exited
+	thread->stopping = true;
+	if (thread->request.pending) {
+		service_request(backend);
+	}
+	pthread_mutex_unlock(&thread->request_mutex);
+	eventfd_write(thread->wake_fd, 1);
+	pthread_join(thread->thread, NULL);
+	thread->running = false;
+
+	struct libinput_event *event;
+	while ((event = queue_pop(thread)) != NULL) {
+		libinput_event_destroy(event);
+	}
+
+	pthread_cond_destroy(&thread->request_cond);
+	pthread_mutex_destroy(&thread->request_mutex);
+	pthread_mutex_destroy(&thread->lock);
+	wl_event_source_remove(thread->queue_event);
+	close(thread->wake_fd);
+	close(thread->event_fd);
+}
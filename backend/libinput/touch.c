@@ -32,8 +32,8 @@ void handle_touch_down(struct libinput_event *event,
 		libinput_event_get_touch_event(event);
 	struct wlr_event_touch_down wlr_event = { 0 };
 	wlr_event.device = wlr_dev;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_touch_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_touch_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.touch_id = libinput_event_touch_get_slot(tevent);
 	wlr_event.x = libinput_event_touch_get_x_transformed(tevent, 1);
 	wlr_event.y = libinput_event_touch_get_y_transformed(tevent, 1);
@@ -52,8 +52,8 @@ void handle_touch_up(struct libinput_event *event,
 		libinput_event_get_touch_event(event);
 	struct wlr_event_touch_up wlr_event = { 0 };
 	wlr_event.device = wlr_dev;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_touch_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_touch_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.touch_id = libinput_event_touch_get_slot(tevent);
 	wlr_signal_emit_safe(&wlr_dev->touch->events.up, &wlr_event);
 }
@@ -70,8 +70,8 @@ void handle_touch_motion(struct libinput_event *event,
 		libinput_event_get_touch_event(event);
 	struct wlr_event_touch_motion wlr_event = { 0 };
 	wlr_event.device = wlr_dev;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_touch_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_touch_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.touch_id = libinput_event_touch_get_slot(tevent);
 	wlr_event.x = libinput_event_touch_get_x_transformed(tevent, 1);
 	wlr_event.y = libinput_event_touch_get_y_transformed(tevent, 1);
@@ -90,8 +90,19 @@ void handle_touch_cancel(struct libinput_event *event,
 		libinput_event_get_touch_event(event);
 	struct wlr_event_touch_cancel wlr_event = { 0 };
 	wlr_event.device = wlr_dev;
-	wlr_event.time_msec =
-		usec_to_msec(libinput_event_touch_get_time_usec(tevent));
+	wlr_event.time_usec = libinput_event_touch_get_time_usec(tevent);
+	wlr_event.time_msec = usec_to_msec(wlr_event.time_usec);
 	wlr_event.touch_id = libinput_event_touch_get_slot(tevent);
 	wlr_signal_emit_safe(&wlr_dev->touch->events.cancel, &wlr_event);
 }
+
+void handle_touch_frame(struct libinput_event *event,
+		struct libinput_device *libinput_dev) {
+	struct wlr_input_device *wlr_dev =
+		get_appropriate_device(WLR_INPUT_DEVICE_TOUCH, libinput_dev);
+	if (!wlr_dev) {
+		wlr_log(WLR_DEBUG, "Got a touch event for a device with no touch?");
+		return;
+	}
+	wlr_signal_emit_safe(&wlr_dev->touch->events.frame, wlr_dev->touch);
+}
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
@@ -24,8 +25,86 @@ static struct wlr_multi_backend *multi_backend_from_backend(
 	return (struct wlr_multi_backend *)wlr_backend;
 }
 
+struct prepare_start_job {
+	struct wlr_backend *backend;
+	pthread_t thread;
+	bool started; // whether the thread has been created
+	bool ok;
+};
+
+static void *prepare_start_thread(void *data) {
+	struct prepare_start_job *job = data;
+	job->ok = job->backend->impl->prepare_start(job->backend);
+	return NULL;
+}
+
+/**
+ * Runs the sub-backends' prepare_start concurrently, so that the time spent
+ * probing devices is bounded by the slowest sub-backend. The sub-backends are
+ * all prepared before any of them is started, so no event is emitted from
+ * another thread.
+ */
+static bool prepare_start_subbackends(struct wlr_multi_backend *backend) {
+	size_t jobs_len = 0;
+	struct subbackend_state *sub;
+	wl_list_for_each(sub, &backend->backends, link) {
+		if (sub->backend->impl->prepare_start) {
+			jobs_len++;
+		}
+	}
+	if (jobs_len < 2) {
+		// Nothing to parallelize, start will do the work
+		return true;
+	}
+
+	struct prepare_start_job *jobs =
+		calloc(jobs_len, sizeof(struct prepare_start_job));
+	if (jobs == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return true;
+	}
+
+	size_t i = 0;
+	wl_list_for_each(sub, &backend->backends, link) {
+		if (sub->backend->impl->prepare_start) {
+			jobs[i++].backend = sub->backend;
+		}
+	}
+
+	// The first job runs on this thread
+	for (i = 1; i < jobs_len; ++i) {
+		int ret = pthread_create(&jobs[i].thread, NULL,
+			prepare_start_thread, &jobs[i]);
+		jobs[i].started = ret == 0;
+		if (!jobs[i].started) {
+			wlr_log(WLR_ERROR, "Failed to create backend start thread");
+		}
+	}
+	prepare_start_thread(&jobs[0]);
+
+	bool ok = true;
+	for (i = 0; i < jobs_len; ++i) {
+		if (i > 0 && !jobs[i].started) {
+			// start will do the work instead
+			continue;
+		}
+		if (jobs[i].started) {
+			pthread_join(jobs[i].thread, NULL);
+		}
+		ok = ok && jobs[i].ok;
+	}
+
+	free(jobs);
+	return ok;
+}
+
 static bool multi_backend_start(struct wlr_backend *wlr_backend) {
 	struct wlr_multi_backend *backend = multi_backend_from_backend(wlr_backend);
+	if (!prepare_start_subbackends(backend)) {
+		wlr_log(WLR_ERROR, "Failed to initialize backend.");
+		return false;
+	}
+
 	struct subbackend_state *sub;
 	wl_list_for_each(sub, &backend->backends, link) {
 		if (!wlr_backend_start(sub->backend)) {
@@ -40,6 +40,16 @@ struct logind_session {
 	// if so, the session will be (de)activated with the drm fd,
 	// otherwise with the dbus PropertiesChanged on "active" signal
 	bool has_drm;
+
+	struct wl_list pending_takes; // logind_take::link
+};
+
+// An asynchronous TakeDevice call
+struct logind_take {
+	struct logind_session *session;
+	struct wlr_session_open_request *request; // NULL if cancelled
+	sd_bus_slot *slot;
+	struct wl_list link; // logind_session::pending_takes
 };
 
 static struct logind_session *logind_session_from_session(
@@ -48,39 +58,30 @@ static struct logind_session *logind_session_from_session(
 	return (struct logind_session *)base;
 }
 
-static int logind_take_device(struct wlr_session *base, const char *path) {
-	struct logind_session *session = logind_session_from_session(base);
-
-	int fd = -1;
-	int ret;
-	sd_bus_message *msg = NULL;
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-
+static bool stat_device(struct logind_session *session, const char *path,
+		dev_t *dev) {
 	struct stat st;
 	if (stat(path, &st) < 0) {
 		wlr_log(WLR_ERROR, "Failed to stat '%s'", path);
-		return -1;
+		return false;
 	}
 
 	if (major(st.st_rdev) == DRM_MAJOR) {
 		session->has_drm = true;
 	}
+	*dev = st.st_rdev;
+	return true;
+}
 
-	ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
-		session->path, "org.freedesktop.login1.Session", "TakeDevice",
-		&error, &msg, "uu", major(st.st_rdev), minor(st.st_rdev));
-	if (ret < 0) {
-		wlr_log(WLR_ERROR, "Failed to take device '%s': %s", path,
-			error.message);
-		goto out;
-	}
-
+// Returns a file descriptor owned by the caller, or -1 on error
+static int read_take_device_reply(sd_bus_message *msg, const char *path) {
+	int fd = -1;
 	int paused = 0;
-	ret = sd_bus_message_read(msg, "hb", &fd, &paused);
+	int ret = sd_bus_message_read(msg, "hb", &fd, &paused);
 	if (ret < 0) {
 		wlr_log(WLR_ERROR, "Failed to parse D-Bus response for '%s': %s",
 			path, strerror(-ret));
-		goto out;
+		return -1;
 	}
 
 	// The original fd seems to be closed when the message is freed
@@ -89,15 +90,123 @@ static int logind_take_device(struct wlr_session *base, const char *path) {
 	if (fd < 0) {
 		wlr_log(WLR_ERROR, "Failed to clone file descriptor for '%s': %s",
 			path, strerror(errno));
+		return -1;
+	}
+	return fd;
+}
+
+static int logind_take_device(struct wlr_session *base, const char *path) {
+	struct logind_session *session = logind_session_from_session(base);
+
+	int fd = -1;
+	int ret;
+	sd_bus_message *msg = NULL;
+	sd_bus_error error = SD_BUS_ERROR_NULL;
+
+	dev_t dev;
+	if (!stat_device(session, path, &dev)) {
+		return -1;
+	}
+
+	ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
+		session->path, "org.freedesktop.login1.Session", "TakeDevice",
+		&error, &msg, "uu", major(dev), minor(dev));
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "Failed to take device '%s': %s", path,
+			error.message);
 		goto out;
 	}
 
+	fd = read_take_device_reply(msg, path);
+
 out:
 	sd_bus_error_free(&error);
 	sd_bus_message_unref(msg);
 	return fd;
 }
 
+static void logind_release_device(struct wlr_session *base, int fd);
+
+static void logind_take_destroy(struct logind_take *take) {
+	wl_list_remove(&take->link);
+	sd_bus_slot_unref(take->slot);
+	free(take);
+}
+
+static int take_device_handler(sd_bus_message *msg, void *data,
+		sd_bus_error *ret_error) {
+	struct logind_take *take = data;
+	struct wlr_session_open_request *request = take->request;
+	struct logind_session *session = take->session;
+	const char *path = request != NULL ? request->path : "(cancelled)";
+
+	int fd = -EIO;
+	if (sd_bus_message_is_method_error(msg, NULL)) {
+		const sd_bus_error *error = sd_bus_message_get_error(msg);
+		wlr_log(WLR_ERROR, "Failed to take device '%s': %s", path,
+			error->message);
+		int err = sd_bus_message_get_errno(msg);
+		fd = err > 0 ? -err : -EIO;
+	} else {
+		int reply_fd = read_take_device_reply(msg, path);
+		if (reply_fd >= 0) {
+			fd = reply_fd;
+		}
+	}
+
+	logind_take_destroy(take);
+
+	if (request == NULL) {
+		// Nobody wants the device anymore
+		if (fd >= 0) {
+			logind_release_device(&session->base, fd);
+		}
+		return 0;
+	}
+	wlr_session_open_request_complete(request, fd);
+	return 0;
+}
+
+static bool logind_take_device_async(struct wlr_session *base,
+		struct wlr_session_open_request *request) {
+	struct logind_session *session = logind_session_from_session(base);
+
+	dev_t dev;
+	if (!stat_device(session, request->path, &dev)) {
+		return false;
+	}
+
+	struct logind_take *take = calloc(1, sizeof(struct logind_take));
+	if (take == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed: %s", strerror(errno));
+		return false;
+	}
+	take->session = session;
+	take->request = request;
+
+	int ret = sd_bus_call_method_async(session->bus, &take->slot,
+		"org.freedesktop.login1", session->path,
+		"org.freedesktop.login1.Session", "TakeDevice",
+		take_device_handler, take, "uu", major(dev), minor(dev));
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "Failed to take device '%s': %s", request->path,
+			strerror(-ret));
+		free(take);
+		return false;
+	}
+
+	request->impl_data = take;
+	wl_list_insert(&session->pending_takes, &take->link);
+	return true;
+}
+
+static void logind_cancel_take_device(struct wlr_session *base,
+		struct wlr_session_open_request *request) {
+	// Keep waiting for the reply, so that the device can be released
+	struct logind_take *take = request->impl_data;
+	take->request = NULL;
+}
+
 static void logind_release_device(struct wlr_session *base, int fd) {
 	struct logind_session *session = logind_session_from_session(base);
 
@@ -230,6 +339,11 @@ static void release_control(struct logind_session *session) {
 static void logind_session_destroy(struct wlr_session *base) {
 	struct logind_session *session = logind_session_from_session(base);
 
+	struct logind_take *take, *take_tmp;
+	wl_list_for_each_safe(take, take_tmp, &session->pending_takes, link) {
+		logind_take_destroy(take);
+	}
+
 	release_control(session);
 
 	wl_event_source_remove(session->event);
@@ -611,6 +725,7 @@ static struct wlr_session *logind_session_create(struct wl_display *disp) {
 		wlr_log(WLR_ERROR, "Allocation failed: %s", strerror(errno));
 		return NULL;
 	}
+	wl_list_init(&session->pending_takes);
 
 	if (!get_display_session(&session->id)) {
 		goto error;
@@ -680,4 +795,6 @@ const struct session_impl session_logind = {
 	.open = logind_take_device,
 	.close = logind_release_device,
 	.change_vt = logind_change_vt,
+	.open_async = logind_take_device_async,
+	.cancel_open = logind_cancel_take_device,
 };
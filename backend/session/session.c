@@ -44,12 +44,21 @@ static int udev_event(int fd, uint32_t mask, void *data) {
 		goto out;
 	}
 
+	struct wlr_device_hotplug_event event = { .session = session };
+	const char *connector =
+		udev_device_get_property_value(udev_dev, "CONNECTOR");
+	if (connector != NULL) {
+		event.connector_id = strtoul(connector, NULL, 10);
+	}
+	const char *lease = udev_device_get_property_value(udev_dev, "LEASE");
+	event.lease = lease != NULL && strcmp(lease, "1") == 0;
+
 	dev_t devnum = udev_device_get_devnum(udev_dev);
 	struct wlr_device *dev;
 
 	wl_list_for_each(dev, &session->devices, link) {
 		if (dev->dev == devnum) {
-			wlr_signal_emit_safe(&dev->signal, session);
+			wlr_signal_emit_safe(&dev->signal, &event);
 			break;
 		}
 	}
@@ -101,6 +110,8 @@ struct wlr_session *wlr_session_create(struct wl_display *disp) {
 	wl_signal_init(&session->session_signal);
 	wl_signal_init(&session->events.destroy);
 	wl_list_init(&session->devices);
+	wl_list_init(&session->open_requests);
+	session->display = disp;
 
 	session->udev = udev_new();
 	if (!session->udev) {
@@ -149,6 +160,12 @@ void wlr_session_destroy(struct wlr_session *session) {
 	wlr_signal_emit_safe(&session->events.destroy, session);
 	wl_list_remove(&session->display_destroy.link);
 
+	struct wlr_session_open_request *request, *request_tmp;
+	wl_list_for_each_safe(request, request_tmp, &session->open_requests,
+			link) {
+		wlr_session_open_request_cancel(request);
+	}
+
 	wl_event_source_remove(session->udev_event);
 	udev_monitor_unref(session->mon);
 	udev_unref(session->udev);
@@ -156,36 +173,113 @@ void wlr_session_destroy(struct wlr_session *session) {
 	session->impl->destroy(session);
 }
 
-int wlr_session_open_file(struct wlr_session *session, const char *path) {
-	int fd = session->impl->open(session, path);
-	if (fd < 0) {
-		return fd;
-	}
-
+static void session_add_device(struct wlr_session *session, int fd) {
 	struct wlr_device *dev = malloc(sizeof(*dev));
 	if (!dev) {
 		wlr_log_errno(WLR_ERROR, "Allocation failed");
-		goto error;
+		return;
 	}
 
 	struct stat st;
 	if (fstat(fd, &st) < 0) {
 		wlr_log_errno(WLR_ERROR, "Stat failed");
-		goto error;
+		free(dev);
+		return;
 	}
 
 	dev->fd = fd;
 	dev->dev = st.st_rdev;
 	wl_signal_init(&dev->signal);
 	wl_list_insert(&session->devices, &dev->link);
+}
 
-	return fd;
+int wlr_session_open_file(struct wlr_session *session, const char *path) {
+	int fd = session->impl->open(session, path);
+	if (fd < 0) {
+		return fd;
+	}
 
-error:
-	free(dev);
+	session_add_device(session, fd);
 	return fd;
 }
 
+static void open_request_destroy(struct wlr_session_open_request *request) {
+	wl_list_remove(&request->link);
+	free(request->path);
+	free(request);
+}
+
+void wlr_session_open_request_complete(
+		struct wlr_session_open_request *request, int fd) {
+	struct wlr_session *session = request->session;
+	if (fd >= 0) {
+		session_add_device(session, fd);
+	}
+
+	wlr_session_open_func_t callback = request->callback;
+	void *data = request->data;
+	open_request_destroy(request);
+	callback(session, fd, data);
+}
+
+static void open_request_handle_idle(void *data) {
+	struct wlr_session_open_request *request = data;
+	request->impl_data = NULL;
+	int fd = request->session->impl->open(request->session, request->path);
+	wlr_session_open_request_complete(request, fd);
+}
+
+struct wlr_session_open_request *wlr_session_open_file_async(
+		struct wlr_session *session, const char *path,
+		wlr_session_open_func_t callback, void *data) {
+	struct wlr_session_open_request *request =
+		calloc(1, sizeof(struct wlr_session_open_request));
+	if (request == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	request->session = session;
+	request->callback = callback;
+	request->data = data;
+	request->path = strdup(path);
+	if (request->path == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(request);
+		return NULL;
+	}
+	wl_list_insert(&session->open_requests, &request->link);
+
+	if (session->impl->open_async) {
+		if (!session->impl->open_async(session, request)) {
+			open_request_destroy(request);
+			return NULL;
+		}
+		return request;
+	}
+
+	// Fall back to a synchronous open, but don't call back before returning
+	struct wl_event_loop *loop = wl_display_get_event_loop(session->display);
+	request->impl_data =
+		wl_event_loop_add_idle(loop, open_request_handle_idle, request);
+	if (request->impl_data == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add idle event source");
+		open_request_destroy(request);
+		return NULL;
+	}
+	return request;
+}
+
+void wlr_session_open_request_cancel(
+		struct wlr_session_open_request *request) {
+	struct wlr_session *session = request->session;
+	if (session->impl->open_async) {
+		session->impl->cancel_open(session, request);
+	} else if (request->impl_data != NULL) {
+		wl_event_source_remove(request->impl_data);
+	}
+	open_request_destroy(request);
+}
+
 static struct wlr_device *find_device(struct wlr_session *session, int fd) {
 	struct wlr_device *dev;
 
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h>
@@ -17,6 +18,7 @@
 #include <wlr/util/log.h>
 
 #include "backend/wayland.h"
+#include "presentation-time-client-protocol.h"
 #include "util/signal.h"
 #include "xdg-shell-client-protocol.h"
 
@@ -58,6 +60,16 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
 	xdg_wm_base_handle_ping,
 };
 
+static void presentation_handle_clock_id(void *data,
+		struct wp_presentation *presentation, uint32_t clock) {
+	struct wlr_wl_backend *wl = data;
+	wl->presentation_clock = clock;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+	.clock_id = presentation_handle_clock_id,
+};
+
 static void registry_global(void *data, struct wl_registry *registry,
 		uint32_t name, const char *iface, uint32_t version) {
 	struct wlr_wl_backend *wl = data;
@@ -78,6 +90,11 @@ static void registry_global(void *data, struct wl_registry *registry,
 		wl->xdg_wm_base = wl_registry_bind(registry, name,
 			&xdg_wm_base_interface, 1);
 		xdg_wm_base_add_listener(wl->xdg_wm_base, &xdg_wm_base_listener, NULL);
+	} else if (strcmp(iface, wp_presentation_interface.name) == 0) {
+		wl->presentation = wl_registry_bind(registry, name,
+			&wp_presentation_interface, 1);
+		wp_presentation_add_listener(wl->presentation,
+			&presentation_listener, wl);
 	}
 }
 
@@ -150,6 +167,9 @@ static void backend_destroy(struct wlr_backend *backend) {
 	if (wl->shm) {
 		wl_shm_destroy(wl->shm);
 	}
+	if (wl->presentation) {
+		wp_presentation_destroy(wl->presentation);
+	}
 	xdg_wm_base_destroy(wl->xdg_wm_base);
 	wl_compositor_destroy(wl->compositor);
 	wl_registry_destroy(wl->registry);
@@ -162,10 +182,16 @@ static struct wlr_renderer *backend_get_renderer(struct wlr_backend *backend) {
 	return wl->renderer;
 }
 
+static clockid_t backend_get_presentation_clock(struct wlr_backend *backend) {
+	struct wlr_wl_backend *wl = get_wl_backend_from_backend(backend);
+	return wl->presentation_clock;
+}
+
 static struct wlr_backend_impl backend_impl = {
 	.start = backend_start,
 	.destroy = backend_destroy,
 	.get_renderer = backend_get_renderer,
+	.get_presentation_clock = backend_get_presentation_clock,
 };
 
 bool wlr_backend_is_wl(struct wlr_backend *b) {
@@ -193,6 +219,7 @@ struct wlr_backend *wlr_wl_backend_create(struct wl_display *display,
 	wl->local_display = display;
 	wl_list_init(&wl->devices);
 	wl_list_init(&wl->outputs);
+	wl->presentation_clock = CLOCK_MONOTONIC;
 
 	wl->remote_display = wl_display_connect(remote);
 	if (!wl->remote_display) {
@@ -267,6 +294,9 @@ error_registry:
 	if (wl->xdg_wm_base) {
 		xdg_wm_base_destroy(wl->xdg_wm_base);
 	}
+	if (wl->presentation) {
+		wp_presentation_destroy(wl->presentation);
+	}
 	wl_registry_destroy(wl->registry);
 error_display:
 	wl_display_disconnect(wl->remote_display);
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -15,6 +16,7 @@
 #include <wlr/util/log.h>
 
 #include "backend/wayland.h"
+#include "presentation-time-client-protocol.h"
 #include "util/signal.h"
 #include "xdg-shell-client-protocol.h"
 
@@ -40,6 +42,95 @@ static struct wl_callback_listener frame_listener = {
 	.done = surface_frame_callback
 };
 
+static void presentation_feedback_destroy(
+		struct wlr_wl_presentation_feedback *feedback) {
+	wl_list_remove(&feedback->link);
+	wp_presentation_feedback_destroy(feedback->feedback);
+	free(feedback);
+}
+
+static void presentation_feedback_handle_sync_output(void *data,
+		struct wp_presentation_feedback *feedback, struct wl_output *output) {
+	// This is a no-op
+}
+
+static void presentation_feedback_handle_presented(void *data,
+		struct wp_presentation_feedback *wp_feedback, uint32_t tv_sec_hi,
+		uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh_ns,
+		uint32_t seq_hi, uint32_t seq_lo, uint32_t flags) {
+	struct wlr_wl_presentation_feedback *feedback = data;
+
+	struct timespec t = {
+		.tv_sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo,
+		.tv_nsec = tv_nsec,
+	};
+	uint32_t present_flags = 0;
+	if (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) {
+		present_flags |= WLR_OUTPUT_PRESENT_VSYNC;
+	}
+	if (flags & WP_PRESENTATION_FEEDBACK_KIND_HW_CLOCK) {
+		present_flags |= WLR_OUTPUT_PRESENT_HW_CLOCK;
+	}
+	if (flags & WP_PRESENTATION_FEEDBACK_KIND_HW_COMPLETION) {
+		present_flags |= WLR_OUTPUT_PRESENT_HW_COMPLETION;
+	}
+	if (flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY) {
+		present_flags |= WLR_OUTPUT_PRESENT_ZERO_COPY;
+	}
+	struct wlr_output_event_present event = {
+		.output = &feedback->output->wlr_output,
+		.when = &t,
+		.seq = ((uint64_t)seq_hi << 32) | seq_lo,
+		.commit_seq = feedback->commit_seq,
+		.refresh = refresh_ns,
+		.flags = present_flags,
+	};
+	wlr_output_send_present(&feedback->output->wlr_output, &event);
+
+	presentation_feedback_destroy(feedback);
+}
+
+static void presentation_feedback_handle_discarded(void *data,
+		struct wp_presentation_feedback *wp_feedback) {
+	struct wlr_wl_presentation_feedback *feedback = data;
+	// The frame has been replaced before being displayed
+	presentation_feedback_destroy(feedback);
+}
+
+static const struct wp_presentation_feedback_listener
+		presentation_feedback_listener = {
+	.sync_output = presentation_feedback_handle_sync_output,
+	.presented = presentation_feedback_handle_presented,
+	.discarded = presentation_feedback_handle_discarded,
+};
+
+/**
+ * Asks the parent compositor when the next commit of the surface is displayed.
+ * Returns false if it doesn't support the presentation-time protocol.
+ */
+static bool output_request_presentation_feedback(
+		struct wlr_wl_output *output) {
+	struct wlr_wl_backend *backend = output->backend;
+	if (backend->presentation == NULL) {
+		return false;
+	}
+
+	struct wlr_wl_presentation_feedback *feedback =
+		calloc(1, sizeof(struct wlr_wl_presentation_feedback));
+	if (feedback == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	feedback->output = output;
+	feedback->commit_seq = output->wlr_output.commit_seq;
+	feedback->feedback =
+		wp_presentation_feedback(backend->presentation, output->surface);
+	wp_presentation_feedback_add_listener(feedback->feedback,
+		&presentation_feedback_listener, feedback);
+	wl_list_insert(&output->presentation_feedbacks, &feedback->link);
+	return true;
+}
+
 static bool output_set_custom_mode(struct wlr_output *wlr_output,
 		int32_t width, int32_t height, int32_t refresh) {
 	struct wlr_wl_output *output = get_wl_output_from_output(wlr_output);
@@ -58,6 +149,14 @@ static bool output_make_current(struct wlr_output *wlr_output,
 		buffer_age);
 }
 
+static bool output_set_damage_region(struct wlr_output *wlr_output,
+		pixman_region32_t *damage) {
+	struct wlr_wl_output *output =
+		get_wl_output_from_output(wlr_output);
+	return wlr_egl_set_damage_region(&output->backend->egl,
+		output->egl_surface, damage);
+}
+
 static bool output_swap_buffers(struct wlr_output *wlr_output,
 		pixman_region32_t *damage) {
 	struct wlr_wl_output *output =
@@ -71,13 +170,17 @@ static bool output_swap_buffers(struct wlr_output *wlr_output,
 	output->frame_callback = wl_surface_frame(output->surface);
 	wl_callback_add_listener(output->frame_callback, &frame_listener, output);
 
+	// The feedback applies to the commit done by eglSwapBuffers
+	bool has_feedback = output_request_presentation_feedback(output);
+
 	if (!wlr_egl_swap_buffers(&output->backend->egl,
 			output->egl_surface, damage)) {
 		return false;
 	}
 
-	// TODO: if available, use the presentation-time protocol
-	wlr_output_send_present(wlr_output, NULL);
+	if (!has_feedback) {
+		wlr_output_send_present(wlr_output, NULL);
+	}
 	return true;
 }
 
@@ -87,12 +190,146 @@ static void output_transform(struct wlr_output *wlr_output,
 	output->wlr_output.transform = transform;
 }
 
+static void cursor_surface_reset(struct wlr_wl_cursor_surface *cursor) {
+	if (cursor->texture == NULL) {
+		return;
+	}
+	cursor->texture = NULL;
+	wl_list_remove(&cursor->texture_update.link);
+	wl_list_remove(&cursor->texture_destroy.link);
+}
+
+static void cursor_surface_handle_texture_update(struct wl_listener *listener,
+		void *data) {
+	struct wlr_wl_cursor_surface *cursor =
+		wl_container_of(listener, cursor, texture_update);
+	cursor_surface_reset(cursor);
+}
+
+static void cursor_surface_handle_texture_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_wl_cursor_surface *cursor =
+		wl_container_of(listener, cursor, texture_destroy);
+	cursor_surface_reset(cursor);
+}
+
+static void cursor_surface_finish(struct wlr_wl_cursor_surface *cursor) {
+	cursor_surface_reset(cursor);
+	if (cursor->egl_surface != EGL_NO_SURFACE) {
+		wlr_egl_destroy_surface(&cursor->output->backend->egl,
+			cursor->egl_surface);
+	}
+	if (cursor->egl_window != NULL) {
+		wl_egl_window_destroy(cursor->egl_window);
+	}
+	if (cursor->surface != NULL) {
+		wl_surface_destroy(cursor->surface);
+	}
+}
+
+// Returns the slot already displaying the texture with these parameters, or
+// the least recently used one, which needs to be rendered
+static struct wlr_wl_cursor_surface *output_get_cursor_surface(
+		struct wlr_wl_output *output, struct wlr_texture *texture,
+		int32_t scale, enum wl_output_transform transform, int32_t width,
+		int32_t height, bool *cached) {
+	struct wlr_wl_cursor_surface *lru = NULL;
+	for (size_t i = 0; i < WLR_WL_CURSOR_CACHE_LEN; ++i) {
+		struct wlr_wl_cursor_surface *cursor = &output->cursor.cache[i];
+		if (cursor->texture == texture && cursor->scale == scale &&
+				cursor->transform == transform &&
+				cursor->output_transform == output->wlr_output.transform &&
+				cursor->width == width && cursor->height == height) {
+			*cached = true;
+			return cursor;
+		}
+		// Don't redraw the surface being displayed, the host compositor may
+		// not have released its buffer yet
+		if (cursor->surface != NULL &&
+				cursor->surface == output->cursor.surface) {
+			continue;
+		}
+		if (lru == NULL || cursor->last_used < lru->last_used) {
+			lru = cursor;
+		}
+	}
+	*cached = false;
+	return lru;
+}
+
+static bool cursor_surface_render(struct wlr_wl_cursor_surface *cursor,
+		struct wlr_texture *texture, int32_t scale,
+		enum wl_output_transform transform, int32_t width, int32_t height) {
+	struct wlr_wl_output *output = cursor->output;
+	struct wlr_wl_backend *backend = output->backend;
+	struct wlr_output *wlr_output = &output->wlr_output;
+
+	cursor_surface_reset(cursor);
+
+	if (cursor->surface == NULL) {
+		cursor->surface = wl_compositor_create_surface(backend->compositor);
+		if (cursor->surface == NULL) {
+			return false;
+		}
+	}
+	if (cursor->egl_window == NULL) {
+		cursor->egl_window =
+			wl_egl_window_create(cursor->surface, width, height);
+		if (cursor->egl_window == NULL) {
+			return false;
+		}
+	}
+	wl_egl_window_resize(cursor->egl_window, width, height, 0, 0);
+	if (cursor->egl_surface == EGL_NO_SURFACE) {
+		cursor->egl_surface =
+			wlr_egl_create_surface(&backend->egl, cursor->egl_window);
+		if (cursor->egl_surface == EGL_NO_SURFACE) {
+			return false;
+		}
+	}
+
+	if (!wlr_egl_make_current(&backend->egl, cursor->egl_surface, NULL)) {
+		return false;
+	}
+
+	struct wlr_box cursor_box = {
+		.width = width,
+		.height = height,
+	};
+
+	float projection[9];
+	wlr_matrix_projection(projection, width, height, wlr_output->transform);
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &cursor_box, transform, 0, projection);
+
+	wlr_renderer_begin(backend->renderer, width, height);
+	wlr_renderer_clear(backend->renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+	wlr_render_texture_with_matrix(backend->renderer, texture, matrix, 1.0);
+	wlr_renderer_end(backend->renderer);
+
+	if (!wlr_egl_swap_buffers(&backend->egl, cursor->egl_surface, NULL)) {
+		return false;
+	}
+
+	cursor->texture = texture;
+	cursor->scale = scale;
+	cursor->transform = transform;
+	cursor->output_transform = wlr_output->transform;
+	cursor->width = width;
+	cursor->height = height;
+	cursor->texture_update.notify = cursor_surface_handle_texture_update;
+	wl_signal_add(&texture->events.update, &cursor->texture_update);
+	cursor->texture_destroy.notify = cursor_surface_handle_texture_destroy;
+	wl_signal_add(&texture->events.destroy, &cursor->texture_destroy);
+	return true;
+}
+
 static bool output_set_cursor(struct wlr_output *wlr_output,
 		struct wlr_texture *texture, int32_t scale,
 		enum wl_output_transform transform,
 		int32_t hotspot_x, int32_t hotspot_y, bool update_texture) {
 	struct wlr_wl_output *output = get_wl_output_from_output(wlr_output);
-	struct wlr_wl_backend *backend = output->backend;
 
 	struct wlr_box hotspot = { .x = hotspot_x, .y = hotspot_y };
 	wlr_box_transform(&hotspot, &hotspot,
@@ -109,55 +346,33 @@ static bool output_set_cursor(struct wlr_output *wlr_output,
 		return true;
 	}
 
-	if (output->cursor.surface == NULL) {
-		output->cursor.surface =
-			wl_compositor_create_surface(backend->compositor);
+	if (texture == NULL) {
+		output->cursor.surface = NULL;
+		update_wl_output_cursor(output);
+		return true;
 	}
-	struct wl_surface *surface = output->cursor.surface;
-
-	if (texture != NULL) {
-		int width, height;
-		wlr_texture_get_size(texture, &width, &height);
-		width = width * wlr_output->scale / scale;
-		height = height * wlr_output->scale / scale;
-
-		output->cursor.width = width;
-		output->cursor.height = height;
-
-		if (output->cursor.egl_window == NULL) {
-			output->cursor.egl_window =
-				wl_egl_window_create(surface, width, height);
-		}
-		wl_egl_window_resize(output->cursor.egl_window, width, height, 0, 0);
 
-		EGLSurface egl_surface =
-			wlr_egl_create_surface(&backend->egl, output->cursor.egl_window);
-
-		wlr_egl_make_current(&backend->egl, egl_surface, NULL);
-
-		struct wlr_box cursor_box = {
-			.width = width,
-			.height = height,
-		};
-
-		float projection[9];
-		wlr_matrix_projection(projection, width, height, wlr_output->transform);
-
-		float matrix[9];
-		wlr_matrix_project_box(matrix, &cursor_box, transform, 0, projection);
-
-		wlr_renderer_begin(backend->renderer, width, height);
-		wlr_renderer_clear(backend->renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
-		wlr_render_texture_with_matrix(backend->renderer, texture, matrix, 1.0);
-		wlr_renderer_end(backend->renderer);
-
-		wlr_egl_swap_buffers(&backend->egl, egl_surface, NULL);
-		wlr_egl_destroy_surface(&backend->egl, egl_surface);
-	} else {
-		wl_surface_attach(surface, NULL, 0, 0);
-		wl_surface_commit(surface);
+	int width, height;
+	wlr_texture_get_size(texture, &width, &height);
+	width = width * wlr_output->scale / scale;
+	height = height * wlr_output->scale / scale;
+
+	output->cursor.width = width;
+	output->cursor.height = height;
+
+	// Images set again, e.g. when the pointer goes back and forth between
+	// two cursor shapes, are still rendered on their surface
+	bool cached;
+	struct wlr_wl_cursor_surface *cursor = output_get_cursor_surface(output,
+		texture, scale, transform, width, height, &cached);
+	if (!cached && !cursor_surface_render(cursor, texture, scale, transform,
+			width, height)) {
+		wlr_log(WLR_ERROR, "Failed to render cursor");
+		return false;
 	}
+	cursor->last_used = ++output->cursor.use_counter;
 
+	output->cursor.surface = cursor->surface;
 	update_wl_output_cursor(output);
 	return true;
 }
@@ -170,17 +385,20 @@ static void output_destroy(struct wlr_output *wlr_output) {
 
 	wl_list_remove(&output->link);
 
-	if (output->cursor.egl_window != NULL) {
-		wl_egl_window_destroy(output->cursor.egl_window);
-	}
-	if (output->cursor.surface) {
-		wl_surface_destroy(output->cursor.surface);
+	for (size_t i = 0; i < WLR_WL_CURSOR_CACHE_LEN; ++i) {
+		cursor_surface_finish(&output->cursor.cache[i]);
 	}
 
 	if (output->frame_callback) {
 		wl_callback_destroy(output->frame_callback);
 	}
 
+	struct wlr_wl_presentation_feedback *feedback, *feedback_tmp;
+	wl_list_for_each_safe(feedback, feedback_tmp,
+			&output->presentation_feedbacks, link) {
+		presentation_feedback_destroy(feedback);
+	}
+
 	wlr_egl_destroy_surface(&output->backend->egl, output->egl_surface);
 	wl_egl_window_destroy(output->egl_window);
 	xdg_toplevel_destroy(output->xdg_toplevel);
@@ -222,6 +440,7 @@ static const struct wlr_output_impl output_impl = {
 	.destroy = output_destroy,
 	.make_current = output_make_current,
 	.swap_buffers = output_swap_buffers,
+	.set_damage_region = output_set_damage_region,
 	.set_cursor = output_set_cursor,
 	.move_cursor = output_move_cursor,
 	.schedule_frame = output_schedule_frame,
@@ -294,6 +513,10 @@ struct wlr_output *wlr_wl_output_create(struct wlr_backend *wlr_backend) {
 		++backend->last_output_num);
 
 	output->backend = backend;
+	wl_list_init(&output->presentation_feedbacks);
+	for (size_t i = 0; i < WLR_WL_CURSOR_CACHE_LEN; ++i) {
+		output->cursor.cache[i].output = output;
+	}
 
 	output->surface = wl_compositor_create_surface(backend->compositor);
 	if (!output->surface) {
@@ -81,6 +81,7 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 	struct wlr_event_pointer_motion_absolute event = {
 		.device = &pointer->input_device->wlr_input_device,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.x = wl_fixed_to_double(sx) / wlr_output->width,
 		.y = wl_fixed_to_double(sy) / wlr_output->height,
 	};
@@ -100,6 +101,7 @@ static void pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
 		.button = button,
 		.state = state,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 	};
 	wlr_signal_emit_safe(&pointer->wlr_pointer.events.button, &event);
 }
@@ -118,6 +120,7 @@ static void pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
 		.delta_discrete = pointer->axis_discrete,
 		.orientation = axis,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.source = pointer->axis_source,
 	};
 	wlr_signal_emit_safe(&pointer->wlr_pointer.events.axis, &event);
@@ -161,6 +164,7 @@ static void pointer_handle_axis_stop(void *data, struct wl_pointer *wl_pointer,
 		.delta_discrete = 0,
 		.orientation = axis,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.source = pointer->axis_source,
 	};
 	wlr_signal_emit_safe(&pointer->wlr_pointer.events.axis, &event);
@@ -194,24 +198,25 @@ static void keyboard_handle_keymap(void *data, struct wl_keyboard *wl_keyboard,
 	// TODO: set keymap
 }
 
-static uint32_t get_current_time_msec(void) {
+static uint64_t get_current_time_usec(void) {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	return now.tv_nsec / 1000;
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
 }
 
 static void keyboard_handle_enter(void *data, struct wl_keyboard *wl_keyboard,
 		uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
 	struct wlr_input_device *dev = data;
 
-	uint32_t time = get_current_time_msec();
+	uint64_t time_usec = get_current_time_usec();
 
 	uint32_t *keycode_ptr;
 	wl_array_for_each(keycode_ptr, keys) {
 		struct wlr_event_keyboard_key event = {
 			.keycode = *keycode_ptr,
 			.state = WLR_KEY_PRESSED,
-			.time_msec = time,
+			.time_msec = time_usec / 1000,
+			.time_usec = time_usec,
 			.update_state = false,
 		};
 		wlr_keyboard_notify_key(dev->keyboard, &event);
@@ -222,7 +227,7 @@ static void keyboard_handle_leave(void *data, struct wl_keyboard *wl_keyboard,
 		uint32_t serial, struct wl_surface *surface) {
 	struct wlr_input_device *dev = data;
 
-	uint32_t time = get_current_time_msec();
+	uint64_t time_usec = get_current_time_usec();
 
 	uint32_t pressed[dev->keyboard->num_keycodes + 1];
 	memcpy(pressed, dev->keyboard->keycodes,
@@ -234,7 +239,8 @@ static void keyboard_handle_leave(void *data, struct wl_keyboard *wl_keyboard,
 		struct wlr_event_keyboard_key event = {
 			.keycode = keycode,
 			.state = WLR_KEY_RELEASED,
-			.time_msec = time,
+			.time_msec = time_usec / 1000,
+			.time_usec = time_usec,
 			.update_state = false,
 		};
 		wlr_keyboard_notify_key(dev->keyboard, &event);
@@ -250,6 +256,7 @@ static void keyboard_handle_key(void *data, struct wl_keyboard *wl_keyboard,
 		.keycode = key,
 		.state = state,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.update_state = false,
 	};
 	wlr_keyboard_notify_key(dev->keyboard, &wlr_event);
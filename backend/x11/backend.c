@@ -1,17 +1,24 @@
 #define _POSIX_C_SOURCE 200112L
 
 #include <assert.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <wlr/config.h>
 
 #include <X11/Xlib-xcb.h>
+#include <gbm.h>
 #include <wayland-server.h>
 #include <xcb/xcb.h>
+#include <xcb/dri3.h>
+#include <xcb/present.h>
+#include <xcb/render.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinput.h>
 
@@ -75,6 +82,9 @@ static void handle_x11_event(struct wlr_x11_backend *x11,
 		xcb_ge_generic_event_t *ev = (xcb_ge_generic_event_t *)event;
 		if (ev->extension == x11->xinput_opcode) {
 			handle_x11_xinput_event(x11, ev);
+		} else if (x11->present_opcode != 0 &&
+				ev->extension == x11->present_opcode) {
+			handle_x11_present_event(x11, ev);
 		}
 	}
 	}
@@ -116,6 +126,78 @@ static bool backend_start(struct wlr_backend *backend) {
 	return true;
 }
 
+/**
+ * Opens the DRM device the X server renders with and creates a GBM device on
+ * it, so that output buffers can be shared with the X server with DRI3 instead
+ * of being copied by EGL.
+ */
+static bool init_dri3(struct wlr_x11_backend *x11) {
+	if (x11->present_opcode == 0) {
+		return false;
+	}
+	// Pixmaps must have the same depth as the windows they're presented to
+	if (x11->screen->root_depth != 24) {
+		wlr_log(WLR_INFO, "DRI3 requires a screen with a depth of 24");
+		return false;
+	}
+
+	const xcb_query_extension_reply_t *ext =
+		xcb_get_extension_data(x11->xcb, &xcb_dri3_id);
+	if (!ext || !ext->present) {
+		wlr_log(WLR_INFO, "X11 does not support DRI3 extension");
+		return false;
+	}
+
+	xcb_dri3_query_version_cookie_t dri3_cookie =
+		xcb_dri3_query_version(x11->xcb, 1, 0);
+	xcb_dri3_query_version_reply_t *dri3_reply =
+		xcb_dri3_query_version_reply(x11->xcb, dri3_cookie, NULL);
+	if (!dri3_reply) {
+		wlr_log(WLR_INFO, "X11 does not support required DRI3 version");
+		return false;
+	}
+	free(dri3_reply);
+
+	xcb_dri3_open_cookie_t open_cookie =
+		xcb_dri3_open(x11->xcb, x11->screen->root, 0);
+	xcb_dri3_open_reply_t *open_reply =
+		xcb_dri3_open_reply(x11->xcb, open_cookie, NULL);
+	if (!open_reply) {
+		wlr_log(WLR_ERROR, "Failed to open DRM device with DRI3");
+		return false;
+	}
+	int fd = -1;
+	if (open_reply->nfd == 1) {
+		fd = xcb_dri3_open_reply_fds(x11->xcb, open_reply)[0];
+	}
+	free(open_reply);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "DRI3 didn't return a DRM device FD");
+		return false;
+	}
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+		wlr_log_errno(WLR_ERROR, "fcntl(F_SETFD) failed");
+		close(fd);
+		return false;
+	}
+
+	x11->gbm = gbm_create_device(fd);
+	if (!x11->gbm) {
+		wlr_log(WLR_ERROR, "Failed to create GBM device");
+		close(fd);
+		return false;
+	}
+	x11->drm_fd = fd;
+	return true;
+}
+
+static void finish_dri3(struct wlr_x11_backend *x11) {
+	gbm_device_destroy(x11->gbm);
+	close(x11->drm_fd);
+	x11->gbm = NULL;
+	x11->drm_fd = -1;
+}
+
 static void backend_destroy(struct wlr_backend *backend) {
 	if (!backend) {
 		return;
@@ -140,6 +222,10 @@ static void backend_destroy(struct wlr_backend *backend) {
 	wlr_renderer_destroy(x11->renderer);
 	wlr_egl_finish(&x11->egl);
 
+	if (x11->gbm) {
+		finish_dri3(x11);
+	}
+
 	if (x11->xlib_conn) {
 		XCloseDisplay(x11->xlib_conn);
 	}
@@ -168,6 +254,54 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	backend_destroy(&x11->backend);
 }
 
+/**
+ * Returns the 32-bit picture format with alpha cursor images are uploaded
+ * with, or XCB_NONE if the X server can't create cursors from pictures.
+ */
+static xcb_render_pictformat_t get_argb32_format(xcb_connection_t *xcb) {
+	// Pixels are uploaded as native 32-bit words
+	uint32_t one = 1;
+	uint8_t native_order = *(uint8_t *)&one == 1 ?
+		XCB_IMAGE_ORDER_LSB_FIRST : XCB_IMAGE_ORDER_MSB_FIRST;
+	if (xcb_get_setup(xcb)->image_byte_order != native_order) {
+		return XCB_NONE;
+	}
+
+	xcb_render_query_version_cookie_t version_cookie =
+		xcb_render_query_version(xcb, 0, 5);
+	xcb_render_query_pict_formats_cookie_t formats_cookie =
+		xcb_render_query_pict_formats(xcb);
+	xcb_render_query_version_reply_t *version_reply =
+		xcb_render_query_version_reply(xcb, version_cookie, NULL);
+	xcb_render_query_pict_formats_reply_t *formats_reply =
+		xcb_render_query_pict_formats_reply(xcb, formats_cookie, NULL);
+
+	xcb_render_pictformat_t format = XCB_NONE;
+	// CreateCursor was added in version 0.5
+	if (version_reply != NULL && formats_reply != NULL &&
+			(version_reply->major_version > 0 ||
+			version_reply->minor_version >= 5)) {
+		xcb_render_pictforminfo_iterator_t iter =
+			xcb_render_query_pict_formats_formats_iterator(formats_reply);
+		for (; iter.rem > 0; xcb_render_pictforminfo_next(&iter)) {
+			const xcb_render_pictforminfo_t *info = iter.data;
+			const xcb_render_directformat_t *direct = &info->direct;
+			if (info->type == XCB_RENDER_PICT_TYPE_DIRECT &&
+					info->depth == 32 &&
+					direct->alpha_shift == 24 && direct->alpha_mask == 0xff &&
+					direct->red_shift == 16 && direct->red_mask == 0xff &&
+					direct->green_shift == 8 && direct->green_mask == 0xff &&
+					direct->blue_shift == 0 && direct->blue_mask == 0xff) {
+				format = info->id;
+				break;
+			}
+		}
+	}
+	free(version_reply);
+	free(formats_reply);
+	return format;
+}
+
 struct wlr_backend *wlr_x11_backend_create(struct wl_display *display,
 		const char *x11_display,
 		wlr_renderer_create_func_t create_renderer_func) {
@@ -261,6 +395,31 @@ struct wlr_backend *wlr_x11_backend_create(struct wl_display *display,
 	}
 	free(xi_reply);
 
+	ext = xcb_get_extension_data(x11->xcb, &xcb_present_id);
+	if (ext && ext->present) {
+		xcb_present_query_version_cookie_t present_cookie =
+			xcb_present_query_version(x11->xcb, 1, 0);
+		xcb_present_query_version_reply_t *present_reply =
+			xcb_present_query_version_reply(x11->xcb, present_cookie, NULL);
+		if (present_reply != NULL) {
+			x11->present_opcode = ext->major_opcode;
+		}
+		free(present_reply);
+	}
+	if (x11->present_opcode == 0) {
+		wlr_log(WLR_INFO, "X11 does not support Present extension, "
+			"frames won't be synchronized with the display");
+	}
+
+	ext = xcb_get_extension_data(x11->xcb, &xcb_render_id);
+	if (ext && ext->present) {
+		x11->argb32 = get_argb32_format(x11->xcb);
+	}
+	if (x11->argb32 == XCB_NONE) {
+		wlr_log(WLR_INFO, "X11 can't create ARGB cursors, "
+			"falling back to software cursors");
+	}
+
 	int fd = xcb_get_file_descriptor(x11->xcb);
 	struct wl_event_loop *ev = wl_display_get_event_loop(display);
 	uint32_t events = WL_EVENT_READABLE | WL_EVENT_ERROR | WL_EVENT_HANGUP;
@@ -286,8 +445,25 @@ struct wlr_backend *wlr_x11_backend_create(struct wl_display *display,
 		EGL_NONE,
 	};
 
-	x11->renderer = create_renderer_func(&x11->egl, EGL_PLATFORM_X11_KHR,
-		x11->xlib_conn, config_attribs, x11->screen->root_visual);
+	x11->drm_fd = -1;
+	const char *dri3 = getenv("WLR_X11_DRI3");
+	if (dri3 && strcmp(dri3, "1") == 0 && init_dri3(x11)) {
+		x11->renderer = create_renderer_func(&x11->egl,
+			EGL_PLATFORM_GBM_MESA, x11->gbm, config_attribs,
+			GBM_FORMAT_XRGB8888);
+		if (x11->renderer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create GBM renderer, "
+				"falling back to EGL on X11");
+			finish_dri3(x11);
+		} else {
+			wlr_log(WLR_INFO, "Presenting buffers with DRI3");
+		}
+	}
+
+	if (x11->renderer == NULL) {
+		x11->renderer = create_renderer_func(&x11->egl, EGL_PLATFORM_X11_KHR,
+			x11->xlib_conn, config_attribs, x11->screen->root_visual);
+	}
 
 	if (x11->renderer == NULL) {
 		wlr_log(WLR_ERROR, "Failed to create renderer");
@@ -20,6 +20,7 @@ static void send_key_event(struct wlr_x11_backend *x11, uint32_t key,
 		enum wlr_key_state st, xcb_timestamp_t time) {
 	struct wlr_event_keyboard_key ev = {
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.keycode = key,
 		.state = st,
 		.update_state = true,
@@ -32,6 +33,7 @@ static void send_button_event(struct wlr_x11_output *output, uint32_t key,
 	struct wlr_event_pointer_button ev = {
 		.device = &output->pointer_dev,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.button = key,
 		.state = st,
 	};
@@ -43,6 +45,7 @@ static void send_axis_event(struct wlr_x11_output *output, int32_t delta,
 	struct wlr_event_pointer_axis ev = {
 		.device = &output->pointer_dev,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.source = WLR_AXIS_SOURCE_WHEEL,
 		.orientation = WLR_AXIS_ORIENTATION_VERTICAL,
 		// 15 is a typical value libinput sends for one scroll
@@ -58,6 +61,7 @@ static void send_pointer_position_event(struct wlr_x11_output *output,
 	struct wlr_event_pointer_motion_absolute ev = {
 		.device = &output->pointer_dev,
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.x = (double)x / output->wlr_output.width,
 		.y = (double)y / output->wlr_output.height,
 	};
@@ -171,7 +175,8 @@ void handle_x11_xinput_event(struct wlr_x11_backend *x11,
 			return;
 		}
 
-		if (!output->cursor_hidden) {
+		// Software cursors are drawn instead of the host cursor
+		if (!output->cursor_hidden && output->cursor.xid == XCB_NONE) {
 			xcb_xfixes_hide_cursor(x11->xcb, output->win);
 			xcb_flush(x11->xcb);
 			output->cursor_hidden = true;
@@ -3,12 +3,21 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <gbm.h>
+#include <xcb/dri3.h>
+#include <xcb/present.h>
+#include <xcb/render.h>
 #include <xcb/xcb.h>
+#include <xcb/xfixes.h>
 #include <xcb/xinput.h>
 
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 
 #include "backend/x11.h"
@@ -21,6 +30,113 @@ static int signal_frame(void *data) {
 	return 0;
 }
 
+/**
+ * Asks the X server for a CompleteNotify event at the next vertical blank of
+ * the window's CRTC.
+ */
+static void output_request_msc_notify(struct wlr_x11_output *output) {
+	if (output->msc_notify_pending) {
+		return;
+	}
+	struct wlr_x11_backend *x11 = output->x11;
+	xcb_present_notify_msc(x11->xcb, output->win, 0, 0, 1, 0);
+	xcb_flush(x11->xcb);
+	output->msc_notify_pending = true;
+}
+
+static void buffer_handle_bo_destroy(struct gbm_bo *bo, void *data) {
+	struct wlr_x11_buffer *buffer = data;
+	xcb_free_pixmap(buffer->output->x11->xcb, buffer->pixmap);
+	wl_list_remove(&buffer->link);
+	free(buffer);
+}
+
+/**
+ * Returns the DRI3 pixmap sharing the GBM buffer with the X server, importing
+ * the buffer the first time it is presented.
+ */
+static struct wlr_x11_buffer *get_or_create_buffer(
+		struct wlr_x11_output *output, struct gbm_bo *bo) {
+	struct wlr_x11_buffer *buffer = gbm_bo_get_user_data(bo);
+	if (buffer != NULL) {
+		return buffer;
+	}
+
+	struct wlr_x11_backend *x11 = output->x11;
+	int fd = gbm_bo_get_fd(bo);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "Failed to export GBM buffer");
+		return NULL;
+	}
+
+	buffer = calloc(1, sizeof(struct wlr_x11_buffer));
+	if (buffer == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		close(fd);
+		return NULL;
+	}
+	buffer->output = output;
+	buffer->bo = bo;
+	buffer->pixmap = xcb_generate_id(x11->xcb);
+
+	// xcb closes the file descriptor once it has been sent
+	uint32_t stride = gbm_bo_get_stride(bo);
+	uint32_t height = gbm_bo_get_height(bo);
+	xcb_dri3_pixmap_from_buffer(x11->xcb, buffer->pixmap, output->win,
+		height * stride, gbm_bo_get_width(bo), height, stride,
+		x11->screen->root_depth, 32, fd);
+
+	wl_list_insert(&output->buffers, &buffer->link);
+	gbm_bo_set_user_data(bo, buffer, buffer_handle_bo_destroy);
+	return buffer;
+}
+
+static bool output_init_gbm_surface(struct wlr_x11_output *output) {
+	struct wlr_x11_backend *x11 = output->x11;
+	int width = output->wlr_output.width;
+	int height = output->wlr_output.height;
+
+	output->gbm_surface = gbm_surface_create(x11->gbm, width, height,
+		GBM_FORMAT_XRGB8888, GBM_BO_USE_RENDERING | GBM_BO_USE_SCANOUT);
+	if (output->gbm_surface == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to create GBM surface");
+		return false;
+	}
+
+	output->surf = wlr_egl_create_surface(&x11->egl, output->gbm_surface);
+	if (output->surf == EGL_NO_SURFACE) {
+		wlr_log(WLR_ERROR, "Failed to create EGL surface");
+		gbm_surface_destroy(output->gbm_surface);
+		output->gbm_surface = NULL;
+		return false;
+	}
+
+	output->gbm_width = width;
+	output->gbm_height = height;
+	return true;
+}
+
+static void output_finish_gbm_surface(struct wlr_x11_output *output) {
+	if (output->gbm_surface == NULL) {
+		return;
+	}
+	struct wlr_x11_backend *x11 = output->x11;
+
+	wlr_egl_destroy_surface(&x11->egl, output->surf);
+	output->surf = EGL_NO_SURFACE;
+
+	// The X server keeps the pixmaps it still displays alive on its own
+	struct wlr_x11_buffer *buffer;
+	wl_list_for_each(buffer, &output->buffers, link) {
+		if (buffer->busy) {
+			gbm_surface_release_buffer(output->gbm_surface, buffer->bo);
+			buffer->busy = false;
+		}
+	}
+	gbm_surface_destroy(output->gbm_surface);
+	output->gbm_surface = NULL;
+}
+
 static void parse_xcb_setup(struct wlr_output *output,
 		xcb_connection_t *xcb) {
 	const xcb_setup_t *xcb_setup = xcb_get_setup(xcb);
@@ -88,8 +204,18 @@ static void output_destroy(struct wlr_output *wlr_output) {
 	wlr_input_device_destroy(&output->pointer_dev);
 
 	wl_list_remove(&output->link);
-	wl_event_source_remove(output->frame_timer);
-	wlr_egl_destroy_surface(&x11->egl, output->surf);
+	if (output->frame_timer != NULL) {
+		wl_event_source_remove(output->frame_timer);
+	}
+	if (x11->gbm != NULL) {
+		output_finish_gbm_surface(output);
+	} else {
+		wlr_egl_destroy_surface(&x11->egl, output->surf);
+	}
+	if (output->cursor.xid != XCB_NONE) {
+		xcb_free_cursor(x11->xcb, output->cursor.xid);
+	}
+	free(output->cursor.pixels);
 	xcb_destroy_window(x11->xcb, output->win);
 	xcb_flush(x11->xcb);
 	free(output);
@@ -100,9 +226,88 @@ static bool output_make_current(struct wlr_output *wlr_output,
 	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
 	struct wlr_x11_backend *x11 = output->x11;
 
+	if (x11->gbm != NULL) {
+		if (output->gbm_surface == NULL ||
+				output->gbm_width != wlr_output->width ||
+				output->gbm_height != wlr_output->height) {
+			output_finish_gbm_surface(output);
+			if (!output_init_gbm_surface(output)) {
+				return false;
+			}
+		}
+		if (!gbm_surface_has_free_buffers(output->gbm_surface)) {
+			// A frame is sent once the X server releases a buffer
+			output->buffers_exhausted = true;
+			return false;
+		}
+	}
+
 	return wlr_egl_make_current(&x11->egl, output->surf, buffer_age);
 }
 
+static bool output_set_damage_region(struct wlr_output *wlr_output,
+		pixman_region32_t *damage) {
+	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
+	struct wlr_x11_backend *x11 = output->x11;
+
+	return wlr_egl_set_damage_region(&x11->egl, output->surf, damage);
+}
+
+/**
+ * Presents the buffer EGL just rendered to the window, without a copy if the
+ * X server is able to flip to it.
+ */
+static bool output_present_pixmap(struct wlr_x11_output *output,
+		pixman_region32_t *damage) {
+	struct wlr_x11_backend *x11 = output->x11;
+
+	struct gbm_bo *bo = gbm_surface_lock_front_buffer(output->gbm_surface);
+	if (bo == NULL) {
+		wlr_log(WLR_ERROR, "Failed to lock GBM front buffer");
+		return false;
+	}
+	struct wlr_x11_buffer *buffer = get_or_create_buffer(output, bo);
+	if (buffer == NULL) {
+		gbm_surface_release_buffer(output->gbm_surface, bo);
+		return false;
+	}
+	buffer->busy = true;
+
+	xcb_xfixes_region_t region = XCB_NONE;
+	if (damage != NULL) {
+		int nrects;
+		pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+		xcb_rectangle_t *xrects = calloc(nrects, sizeof(xcb_rectangle_t));
+		if (xrects != NULL) {
+			for (int i = 0; i < nrects; ++i) {
+				xrects[i] = (xcb_rectangle_t){
+					.x = rects[i].x1,
+					.y = rects[i].y1,
+					.width = rects[i].x2 - rects[i].x1,
+					.height = rects[i].y2 - rects[i].y1,
+				};
+			}
+			region = xcb_generate_id(x11->xcb);
+			xcb_xfixes_create_region(x11->xcb, region, nrects, xrects);
+			free(xrects);
+		}
+	}
+
+	xcb_present_pixmap(x11->xcb, output->win, buffer->pixmap,
+		++output->present_serial, XCB_NONE, region, 0, 0, XCB_NONE,
+		XCB_NONE, XCB_NONE, XCB_PRESENT_OPTION_NONE, 0, 0, 0, 0, NULL);
+
+	// The X server copies the update region when handling the request
+	if (region != XCB_NONE) {
+		xcb_xfixes_destroy_region(x11->xcb, region);
+	}
+	xcb_flush(x11->xcb);
+
+	// The present and frame events are sent when the pixmap is displayed
+	output->present_pending = true;
+	return true;
+}
+
 static bool output_swap_buffers(struct wlr_output *wlr_output,
 		pixman_region32_t *damage) {
 	struct wlr_x11_output *output = (struct wlr_x11_output *)wlr_output;
@@ -112,16 +317,227 @@ static bool output_swap_buffers(struct wlr_output *wlr_output,
 		return false;
 	}
 
-	wlr_output_send_present(wlr_output, NULL);
+	if (x11->gbm != NULL) {
+		return output_present_pixmap(output, damage);
+	}
+
+	if (x11->present_opcode == 0) {
+		wlr_output_send_present(wlr_output, NULL);
+		return true;
+	}
+
+	// The present and frame events are sent at the next vertical blank
+	output->present_pending = true;
+	output_request_msc_notify(output);
+	return true;
+}
+
+/**
+ * Renders the cursor texture with the output transform applied and reads it
+ * back, X cursors are uploaded from client memory. `width` and `height` are
+ * the size of the cursor before the output transform, the image is rotated
+ * with it.
+ */
+static uint32_t *output_read_cursor_pixels(struct wlr_x11_output *output,
+		struct wlr_texture *texture, enum wl_output_transform transform,
+		int width, int height) {
+	struct wlr_x11_backend *x11 = output->x11;
+	struct wlr_renderer *renderer = x11->renderer;
+
+	struct wlr_box cursor_box = {
+		.width = width,
+		.height = height,
+	};
+	if (output->wlr_output.transform & WL_OUTPUT_TRANSFORM_90) {
+		width = cursor_box.height;
+		height = cursor_box.width;
+	}
+
+	uint32_t *pixels = calloc((size_t)width * height, sizeof(uint32_t));
+	if (pixels == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	if (!wlr_egl_make_current(&x11->egl, output->surf, NULL) ||
+			!wlr_renderer_bind_offscreen(renderer, NULL, width, height)) {
+		free(pixels);
+		return NULL;
+	}
+
+	float projection[9];
+	wlr_matrix_projection(projection, width, height,
+		output->wlr_output.transform);
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &cursor_box, transform, 0, projection);
+
+	wlr_renderer_begin(renderer, width, height);
+	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+	wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0);
+	// Without flags, rows are returned top-down
+	bool ok = wlr_renderer_read_pixels(renderer, WL_SHM_FORMAT_ARGB8888, NULL,
+		width * sizeof(uint32_t), width, height, 0, 0, 0, 0, pixels);
+	wlr_renderer_end(renderer);
+	wlr_renderer_unbind_offscreen(renderer);
+
+	if (!ok) {
+		free(pixels);
+		return NULL;
+	}
+	return pixels;
+}
+
+/**
+ * Creates an X cursor from the last cursor image and sets it on the window.
+ * A hidden cursor is a transparent pixel.
+ */
+static bool output_upload_cursor(struct wlr_x11_output *output,
+		int hotspot_x, int hotspot_y) {
+	struct wlr_x11_backend *x11 = output->x11;
+
+	uint32_t transparent = 0;
+	const uint32_t *pixels = &transparent;
+	int width = 1, height = 1;
+	if (output->cursor.pixels != NULL) {
+		pixels = output->cursor.pixels;
+		width = output->cursor.width;
+		height = output->cursor.height;
+	}
+
+	// The hotspot must be inside the image
+	hotspot_x = hotspot_x < 0 ? 0 : hotspot_x >= width ? width - 1 : hotspot_x;
+	hotspot_y = hotspot_y < 0 ? 0 : hotspot_y >= height ? height - 1 : hotspot_y;
+
+	xcb_pixmap_t pixmap = xcb_generate_id(x11->xcb);
+	xcb_create_pixmap(x11->xcb, 32, pixmap, output->win, width, height);
+
+	xcb_gcontext_t gc = xcb_generate_id(x11->xcb);
+	xcb_create_gc(x11->xcb, gc, pixmap, 0, NULL);
+	xcb_put_image(x11->xcb, XCB_IMAGE_FORMAT_Z_PIXMAP, pixmap, gc,
+		width, height, 0, 0, 0, 32, width * height * sizeof(uint32_t),
+		(const uint8_t *)pixels);
+	xcb_free_gc(x11->xcb, gc);
+
+	xcb_render_picture_t picture = xcb_generate_id(x11->xcb);
+	xcb_render_create_picture(x11->xcb, picture, pixmap, x11->argb32,
+		0, NULL);
+
+	xcb_cursor_t cursor = xcb_generate_id(x11->xcb);
+	xcb_render_create_cursor(x11->xcb, cursor, picture,
+		hotspot_x, hotspot_y);
+
+	xcb_render_free_picture(x11->xcb, picture);
+	xcb_free_pixmap(x11->xcb, pixmap);
+
+	xcb_change_window_attributes(x11->xcb, output->win, XCB_CW_CURSOR,
+		&cursor);
+	if (output->cursor.xid != XCB_NONE) {
+		xcb_free_cursor(x11->xcb, output->cursor.xid);
+	}
+	output->cursor.xid = cursor;
+
+	// The host cursor was hidden for software cursors to be drawn instead
+	if (output->cursor_hidden) {
+		xcb_xfixes_show_cursor(x11->xcb, output->win);
+		output->cursor_hidden = false;
+	}
+
+	xcb_flush(x11->xcb);
+	return true;
+}
+
+// Gives the window the host's default cursor back, for software cursors
+static void output_clear_cursor(struct wlr_x11_output *output) {
+	struct wlr_x11_backend *x11 = output->x11;
+	if (output->cursor.xid == XCB_NONE) {
+		return;
+	}
+	uint32_t cursor = XCB_CURSOR_NONE;
+	xcb_change_window_attributes(x11->xcb, output->win, XCB_CW_CURSOR,
+		&cursor);
+	xcb_free_cursor(x11->xcb, output->cursor.xid);
+	output->cursor.xid = XCB_NONE;
+	xcb_flush(x11->xcb);
+}
+
+static bool output_set_cursor(struct wlr_output *wlr_output,
+		struct wlr_texture *texture, int32_t scale,
+		enum wl_output_transform transform,
+		int32_t hotspot_x, int32_t hotspot_y, bool update_texture) {
+	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
+	struct wlr_x11_backend *x11 = output->x11;
+
+	if (x11->argb32 == XCB_NONE) {
+		return false;
+	}
+
+	if (update_texture) {
+		uint32_t *pixels = NULL;
+		int width = 0, height = 0;
+		if (texture != NULL) {
+			wlr_texture_get_size(texture, &width, &height);
+			width = width * wlr_output->scale / scale;
+			height = height * wlr_output->scale / scale;
+
+			// The image is sent in a single request
+			size_t max_size = xcb_get_maximum_request_length(x11->xcb) * 4;
+			if (width <= 0 || height <= 0 ||
+					(size_t)width * height * sizeof(uint32_t) +
+					sizeof(xcb_put_image_request_t) > max_size) {
+				output_clear_cursor(output);
+				return false;
+			}
+
+			pixels = output_read_cursor_pixels(output, texture, transform,
+				width, height);
+			if (pixels == NULL) {
+				wlr_log(WLR_ERROR, "Failed to render cursor");
+				output_clear_cursor(output);
+				return false;
+			}
+			if (wlr_output->transform & WL_OUTPUT_TRANSFORM_90) {
+				int tmp = width;
+				width = height;
+				height = tmp;
+			}
+		}
+
+		free(output->cursor.pixels);
+		output->cursor.pixels = pixels;
+		output->cursor.width = width;
+		output->cursor.height = height;
+	}
+
+	// The hotspot is given before the output transform
+	int width = output->cursor.width, height = output->cursor.height;
+	if (wlr_output->transform & WL_OUTPUT_TRANSFORM_90) {
+		width = output->cursor.height;
+		height = output->cursor.width;
+	}
+	struct wlr_box hotspot = { .x = hotspot_x, .y = hotspot_y };
+	wlr_box_transform(&hotspot, &hotspot,
+		wlr_output_transform_invert(wlr_output->transform), width, height);
+
+	// X cursors are immutable, a new one is created even if only the hotspot
+	// changes
+	return output_upload_cursor(output, hotspot.x, hotspot.y);
+}
+
+static bool output_move_cursor(struct wlr_output *wlr_output, int x, int y) {
+	// The X server moves the cursor along with the host pointer
 	return true;
 }
 
 static const struct wlr_output_impl output_impl = {
 	.set_custom_mode = output_set_custom_mode,
 	.transform = output_transform,
+	.set_cursor = output_set_cursor,
+	.move_cursor = output_move_cursor,
 	.destroy = output_destroy,
 	.make_current = output_make_current,
 	.swap_buffers = output_swap_buffers,
+	.set_damage_region = output_set_damage_region,
 };
 
 struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
@@ -137,6 +553,7 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 		return NULL;
 	}
 	output->x11 = x11;
+	wl_list_init(&output->buffers);
 
 	struct wlr_output *wlr_output = &output->wlr_output;
 	wlr_output_init(wlr_output, &x11->backend, &output_impl, x11->wl_display);
@@ -174,11 +591,18 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 	};
 	xcb_input_xi_select_events(x11->xcb, output->win, 1, &xinput_mask.head);
 
-	output->surf = wlr_egl_create_surface(&x11->egl, &output->win);
-	if (!output->surf) {
-		wlr_log(WLR_ERROR, "Failed to create EGL surface");
-		free(output);
-		return NULL;
+	if (x11->gbm != NULL) {
+		if (!output_init_gbm_surface(output)) {
+			free(output);
+			return NULL;
+		}
+	} else {
+		output->surf = wlr_egl_create_surface(&x11->egl, &output->win);
+		if (!output->surf) {
+			wlr_log(WLR_ERROR, "Failed to create EGL surface");
+			free(output);
+			return NULL;
+		}
 	}
 
 	xcb_change_property(x11->xcb, XCB_PROP_MODE_REPLACE, output->win,
@@ -190,12 +614,22 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 	xcb_map_window(x11->xcb, output->win);
 	xcb_flush(x11->xcb);
 
-	struct wl_event_loop *ev = wl_display_get_event_loop(x11->wl_display);
-	output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
-
 	wl_list_insert(&x11->outputs, &output->link);
 
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	if (x11->present_opcode != 0) {
+		uint32_t present_mask = XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY;
+		if (x11->gbm != NULL) {
+			present_mask |= XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY;
+		}
+		output->present_event_id = xcb_generate_id(x11->xcb);
+		xcb_present_select_input(x11->xcb, output->present_event_id,
+			output->win, present_mask);
+		output_request_msc_notify(output);
+	} else {
+		struct wl_event_loop *ev = wl_display_get_event_loop(x11->wl_display);
+		output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
+		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	}
 	wlr_output_update_enabled(wlr_output, true);
 
 	wlr_input_device_init(&output->pointer_dev, WLR_INPUT_DEVICE_POINTER,
@@ -226,6 +660,86 @@ void handle_x11_configure_notify(struct wlr_x11_output *output,
 	}
 }
 
+static void handle_x11_idle_notify(struct wlr_x11_backend *x11,
+		xcb_present_idle_notify_event_t *ev) {
+	struct wlr_x11_output *output =
+		get_x11_output_from_window_id(x11, ev->window);
+	if (output == NULL || output->gbm_surface == NULL) {
+		return;
+	}
+
+	struct wlr_x11_buffer *buffer;
+	wl_list_for_each(buffer, &output->buffers, link) {
+		if (buffer->pixmap == ev->pixmap && buffer->busy) {
+			gbm_surface_release_buffer(output->gbm_surface, buffer->bo);
+			buffer->busy = false;
+			break;
+		}
+	}
+
+	if (output->buffers_exhausted) {
+		output->buffers_exhausted = false;
+		wlr_output_send_frame(&output->wlr_output);
+	}
+}
+
+static void handle_x11_complete_notify(struct wlr_x11_backend *x11,
+		xcb_present_complete_notify_event_t *ev) {
+	struct wlr_x11_output *output =
+		get_x11_output_from_window_id(x11, ev->window);
+	if (output == NULL) {
+		return;
+	}
+	if (ev->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC) {
+		output->msc_notify_pending = false;
+	} else if (output->gbm_surface == NULL) {
+		// Completions of the buffer swaps done by EGL are handled by EGL
+		return;
+	}
+
+	// UST is in microseconds, on the monotonic clock
+	int refresh = 0;
+	if (output->last_msc != 0 && ev->msc > output->last_msc &&
+			ev->ust > output->last_ust) {
+		refresh = (ev->ust - output->last_ust) * 1000 /
+			(ev->msc - output->last_msc);
+	}
+	output->last_msc = ev->msc;
+	output->last_ust = ev->ust;
+
+	if (output->present_pending) {
+		output->present_pending = false;
+		struct timespec when = {
+			.tv_sec = ev->ust / 1000000,
+			.tv_nsec = (ev->ust % 1000000) * 1000,
+		};
+		struct wlr_output_event_present present_event = {
+			.output = &output->wlr_output,
+			.when = &when,
+			.seq = ev->msc,
+			.refresh = refresh,
+			.flags = WLR_OUTPUT_PRESENT_VSYNC | WLR_OUTPUT_PRESENT_HW_CLOCK,
+		};
+		wlr_output_send_present(&output->wlr_output, &present_event);
+	}
+
+	wlr_output_send_frame(&output->wlr_output);
+}
+
+void handle_x11_present_event(struct wlr_x11_backend *x11,
+		xcb_ge_generic_event_t *event) {
+	switch (event->event_type) {
+	case XCB_PRESENT_EVENT_COMPLETE_NOTIFY:
+		handle_x11_complete_notify(x11,
+			(xcb_present_complete_notify_event_t *)event);
+		break;
+	case XCB_PRESENT_EVENT_IDLE_NOTIFY:
+		handle_x11_idle_notify(x11,
+			(xcb_present_idle_notify_event_t *)event);
+		break;
+	}
+}
+
 bool wlr_output_is_x11(struct wlr_output *wlr_output) {
 	return wlr_output->impl == &output_impl;
 }
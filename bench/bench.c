@@ -0,0 +1,372 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_list.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+
+// Each benchmark runs for at least this long
+#define MIN_DURATION_NSEC 200000000
+
+struct bench {
+	const char *name;
+	// Runs `iterations` iterations, returns false if the benchmark can't run
+	bool (*run)(struct bench *bench, uint64_t iterations);
+	int param;
+};
+
+// Keeps the compiler from optimizing benchmarked code away
+static volatile uint64_t sink;
+
+static uint64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Builds a region of `n` boxes scattered on a 1920x1080 output
+static void make_region(pixman_region32_t *region, int n) {
+	pixman_region32_init(region);
+	uint32_t seed = 1;
+	for (int i = 0; i < n; ++i) {
+		seed = seed * 1103515245 + 12345;
+		int x = (seed >> 8) % 1800;
+		seed = seed * 1103515245 + 12345;
+		int y = (seed >> 8) % 1000;
+		pixman_region32_union_rect(region, region, x, y,
+			16 + (seed >> 4) % 100, 16 + (seed >> 12) % 60);
+	}
+}
+
+static bool bench_region_scale(struct bench *bench, uint64_t iterations) {
+	pixman_region32_t src, dst;
+	make_region(&src, bench->param);
+	pixman_region32_init(&dst);
+	for (uint64_t i = 0; i < iterations; ++i) {
+		wlr_region_scale(&dst, &src, 1.5);
+		sink += pixman_region32_n_rects(&dst);
+	}
+	pixman_region32_fini(&dst);
+	pixman_region32_fini(&src);
+	return true;
+}
+
+static bool bench_region_transform(struct bench *bench, uint64_t iterations) {
+	pixman_region32_t src, dst;
+	make_region(&src, bench->param);
+	pixman_region32_init(&dst);
+	for (uint64_t i = 0; i < iterations; ++i) {
+		wlr_region_transform(&dst, &src, WL_OUTPUT_TRANSFORM_90, 1920, 1080);
+		sink += pixman_region32_n_rects(&dst);
+	}
+	pixman_region32_fini(&dst);
+	pixman_region32_fini(&src);
+	return true;
+}
+
+static bool bench_region_confine(struct bench *bench, uint64_t iterations) {
+	pixman_region32_t region;
+	make_region(&region, bench->param);
+	pixman_box32_t *extents = pixman_region32_extents(&region);
+	for (uint64_t i = 0; i < iterations; ++i) {
+		double x, y;
+		// Moves from inside the first box across the whole region
+		pixman_box32_t *box = pixman_region32_rectangles(&region, NULL);
+		wlr_region_confine(&region, box->x1 + 1, box->y1 + 1,
+			extents->x2 + 100, extents->y2 + 100, &x, &y);
+		sink += (uint64_t)x + (uint64_t)y;
+	}
+	pixman_region32_fini(&region);
+	return true;
+}
+
+static bool bench_region_index_confine(struct bench *bench,
+		uint64_t iterations) {
+	pixman_region32_t region;
+	make_region(&region, bench->param);
+	pixman_box32_t *extents = pixman_region32_extents(&region);
+	struct wlr_region_index index = {0};
+	wlr_region_index_update(&index, &region);
+	for (uint64_t i = 0; i < iterations; ++i) {
+		double x, y;
+		pixman_box32_t *box = pixman_region32_rectangles(&region, NULL);
+		wlr_region_index_confine(&index, box->x1 + 1, box->y1 + 1,
+			extents->x2 + 100, extents->y2 + 100, &x, &y);
+		sink += (uint64_t)x + (uint64_t)y;
+	}
+	wlr_region_index_finish(&index);
+	pixman_region32_fini(&region);
+	return true;
+}
+
+static bool bench_matrix_project_box(struct bench *bench,
+		uint64_t iterations) {
+	float projection[9], mat[9];
+	wlr_matrix_projection(projection, 1920, 1080, WL_OUTPUT_TRANSFORM_NORMAL);
+	struct wlr_box box = { .x = 100, .y = 200, .width = 640, .height = 480 };
+	float rotation = bench->param ? 0.5f : 0;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		box.x = i & 1023;
+		wlr_matrix_project_box(mat, &box, WL_OUTPUT_TRANSFORM_FLIPPED_90,
+			rotation, projection);
+		sink += (uint64_t)mat[2];
+	}
+	return true;
+}
+
+static bool bench_box_intersection(struct bench *bench, uint64_t iterations) {
+	struct wlr_box a = { .x = 0, .y = 0, .width = 800, .height = 600 };
+	struct wlr_box b = { .x = 0, .y = 300, .width = 800, .height = 600 };
+	struct wlr_box dest;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		b.x = (i & 2047) - 1024;
+		sink += wlr_box_intersection(&dest, &a, &b);
+	}
+	return true;
+}
+
+static bool bench_box_transform(struct bench *bench, uint64_t iterations) {
+	struct wlr_box box = { .x = 10, .y = 20, .width = 300, .height = 200 };
+	struct wlr_box dest;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		box.x = i & 1023;
+		wlr_box_transform(&dest, &box, i & 7, 1920, 1080);
+		sink += dest.x;
+	}
+	return true;
+}
+
+static bool bench_box_rotated_bounds(struct bench *bench,
+		uint64_t iterations) {
+	struct wlr_box box = { .x = 10, .y = 20, .width = 300, .height = 200 };
+	struct wlr_box dest;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		wlr_box_rotated_bounds(&dest, &box, (i & 63) * 0.1f);
+		sink += dest.width;
+	}
+	return true;
+}
+
+static bool bench_list_push_pop(struct bench *bench, uint64_t iterations) {
+	struct wlr_list list;
+	if (!wlr_list_init(&list)) {
+		return false;
+	}
+	for (uint64_t i = 0; i < iterations; ++i) {
+		for (int j = 0; j < bench->param; ++j) {
+			wlr_list_push(&list, &list);
+		}
+		while (list.length > 0) {
+			sink += (uintptr_t)wlr_list_pop(&list);
+		}
+	}
+	wlr_list_finish(&list);
+	return true;
+}
+
+static struct {
+	bool initialized;
+	struct wl_display *display;
+	struct wlr_backend *backend;
+	struct wlr_output *output;
+} headless;
+
+static struct wlr_output *get_headless_output(void) {
+	if (headless.initialized) {
+		return headless.output;
+	}
+	headless.initialized = true;
+
+	headless.display = wl_display_create();
+	if (headless.display == NULL) {
+		return NULL;
+	}
+	headless.backend = wlr_headless_backend_create(headless.display, NULL);
+	if (headless.backend == NULL) {
+		return NULL;
+	}
+	headless.output = wlr_headless_add_output(headless.backend, 1920, 1080);
+	return headless.output;
+}
+
+static void finish_headless(void) {
+	if (headless.backend != NULL) {
+		wlr_backend_destroy(headless.backend);
+	}
+	if (headless.display != NULL) {
+		wl_display_destroy(headless.display);
+	}
+}
+
+static void handle_signal(struct wl_listener *listener, void *data) {
+	sink++;
+}
+
+// wlr_signal_emit_safe isn't exported, it is reached through an output event
+static bool bench_signal_emit(struct bench *bench, uint64_t iterations) {
+	struct wlr_output *output = get_headless_output();
+	if (output == NULL) {
+		return false;
+	}
+	struct wl_listener *listeners =
+		calloc(bench->param, sizeof(struct wl_listener));
+	if (listeners == NULL) {
+		return false;
+	}
+	for (int i = 0; i < bench->param; ++i) {
+		listeners[i].notify = handle_signal;
+		wl_signal_add(&output->events.needs_swap, &listeners[i]);
+	}
+	for (uint64_t i = 0; i < iterations; ++i) {
+		wlr_output_update_needs_swap(output);
+	}
+	for (int i = 0; i < bench->param; ++i) {
+		wl_list_remove(&listeners[i].link);
+	}
+	free(listeners);
+	return true;
+}
+
+// The param is the number of damaged boxes per frame, a negative one uses
+// tiled damage accumulation
+static bool bench_output_damage_make_current(struct bench *bench,
+		uint64_t iterations) {
+	struct wlr_output *output = get_headless_output();
+	if (output == NULL) {
+		return false;
+	}
+	struct wlr_output_damage *output_damage = wlr_output_damage_create(output);
+	if (output_damage == NULL) {
+		return false;
+	}
+	int n = abs(bench->param);
+	if (bench->param < 0) {
+		wlr_output_damage_set_tile_size(output_damage, 64);
+	}
+
+	pixman_region32_t frame_damage, damage;
+	make_region(&frame_damage, n);
+	pixman_region32_init(&damage);
+	bool ok = true;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		pixman_region32_translate(&frame_damage, (i & 1) ? 7 : -7, 0);
+		wlr_output_damage_add(output_damage, &frame_damage);
+
+		bool needs_swap;
+		pixman_region32_clear(&damage);
+		if (!wlr_output_damage_make_current(output_damage, &needs_swap,
+				&damage)) {
+			ok = false;
+			break;
+		}
+		sink += pixman_region32_n_rects(&damage);
+		if (needs_swap && !wlr_output_damage_swap_buffers(output_damage,
+				NULL, &damage)) {
+			ok = false;
+			break;
+		}
+	}
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&frame_damage);
+	wlr_output_damage_destroy(output_damage);
+	return ok;
+}
+
+static struct bench benches[] = {
+	{ "region_scale/16", bench_region_scale, 16 },
+	{ "region_scale/256", bench_region_scale, 256 },
+	{ "region_transform/16", bench_region_transform, 16 },
+	{ "region_transform/256", bench_region_transform, 256 },
+	{ "region_confine/16", bench_region_confine, 16 },
+	{ "region_confine/256", bench_region_confine, 256 },
+	{ "region_index_confine/16", bench_region_index_confine, 16 },
+	{ "region_index_confine/256", bench_region_index_confine, 256 },
+	{ "matrix_project_box", bench_matrix_project_box, 0 },
+	{ "matrix_project_box/rotated", bench_matrix_project_box, 1 },
+	{ "box_intersection", bench_box_intersection, 0 },
+	{ "box_transform", bench_box_transform, 0 },
+	{ "box_rotated_bounds", bench_box_rotated_bounds, 0 },
+	{ "list_push_pop/64", bench_list_push_pop, 64 },
+	{ "signal_emit/1", bench_signal_emit, 1 },
+	{ "signal_emit/16", bench_signal_emit, 16 },
+	{ "output_damage_make_current/1", bench_output_damage_make_current, 1 },
+	{ "output_damage_make_current/64", bench_output_damage_make_current, 64 },
+	{ "output_damage_make_current/64/tiled",
+		bench_output_damage_make_current, -64 },
+};
+
+// Per-object memory footprints, allocated for each client surface
+static const struct {
+	const char *name;
+	size_t size;
+} footprints[] = {
+	{ "sizeof/wlr_surface", sizeof(struct wlr_surface) },
+	{ "sizeof/wlr_surface_state", sizeof(struct wlr_surface_state) },
+	{ "sizeof/wlr_subsurface", sizeof(struct wlr_subsurface) },
+	{ "sizeof/wlr_xdg_surface", sizeof(struct wlr_xdg_surface) },
+	{ "sizeof/wlr_xdg_toplevel", sizeof(struct wlr_xdg_toplevel) },
+};
+
+/**
+ * Runs the benchmarks whose name starts with the first argument, or all of
+ * them, then prints the matching footprints. Results are printed as one JSON
+ * object per line.
+ */
+int main(int argc, char *argv[]) {
+	wlr_log_init(WLR_ERROR, NULL);
+	const char *filter = argc > 1 ? argv[1] : "";
+
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+		struct bench *bench = &benches[i];
+		if (strncmp(bench->name, filter, strlen(filter)) != 0) {
+			continue;
+		}
+
+		uint64_t iterations = 1, elapsed = 0;
+		bool ok = true;
+		while (ok) {
+			uint64_t start = get_time_nsec();
+			ok = bench->run(bench, iterations);
+			elapsed = get_time_nsec() - start;
+			if (elapsed >= MIN_DURATION_NSEC) {
+				break;
+			}
+			iterations *= 2;
+		}
+
+		if (!ok) {
+			printf("{\"name\": \"%s\", \"skipped\": true}\n", bench->name);
+			continue;
+		}
+		printf("{\"name\": \"%s\", \"iterations\": %" PRIu64 ", "
+			"\"ns_per_iter\": %.2f}\n", bench->name, iterations,
+			(double)elapsed / iterations);
+		fflush(stdout);
+	}
+
+	for (size_t i = 0; i < sizeof(footprints) / sizeof(footprints[0]); ++i) {
+		if (strncmp(footprints[i].name, filter, strlen(filter)) != 0) {
+			continue;
+		}
+		printf("{\"name\": \"%s\", \"bytes\": %zu}\n",
+			footprints[i].name, footprints[i].size);
+	}
+
+	finish_headless();
+	return EXIT_SUCCESS;
+}
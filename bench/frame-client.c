@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "frame.h"
+
+static int allocate_shm_file(size_t size) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	char name[64];
+	snprintf(name, sizeof(name), "/wlroots-bench-%d-%ld", getpid(),
+		ts.tv_nsec);
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		return -1;
+	}
+	shm_unlink(name);
+
+	int ret;
+	do {
+		ret = ftruncate(fd, size);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+#define PARTIAL_DAMAGE_SIZE 32
+
+struct client_buffer {
+	struct wl_buffer *buffer;
+	uint32_t *data;
+	bool busy;
+};
+
+struct client_surface {
+	struct wl_surface *surface;
+	struct wl_subsurface *subsurface; // NULL for the root surface
+	struct client_buffer buffers[2];
+};
+
+struct client {
+	const struct frame_client_options *options;
+	struct wl_display *display;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+
+	void *pool_data;
+	size_t pool_size;
+	struct client_surface *surfaces; // root first, then each nested child
+	int n_surfaces;
+	struct wl_callback *frame_callback;
+	uint32_t frame;
+};
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct client *client = data;
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor =
+			wl_registry_bind(registry, name, &wl_compositor_interface, 1);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client->subcompositor =
+			wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	}
+}
+
+static void registry_handle_global_remove(void *data,
+		struct wl_registry *registry, uint32_t name) {
+	// Don't care
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_handle_global,
+	.global_remove = registry_handle_global_remove,
+};
+
+static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer) {
+	struct client_buffer *buffer = data;
+	buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_handle_release,
+};
+
+static bool create_buffers(struct client *client) {
+	int width = client->options->width, height = client->options->height;
+	int stride = width * 4;
+	size_t buffer_size = (size_t)stride * height;
+	client->pool_size = buffer_size * 2 * client->n_surfaces;
+
+	int fd = allocate_shm_file(client->pool_size);
+	if (fd < 0) {
+		return false;
+	}
+	client->pool_data = mmap(NULL, client->pool_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if (client->pool_data == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	struct wl_shm_pool *pool =
+		wl_shm_create_pool(client->shm, fd, client->pool_size);
+	close(fd);
+
+	size_t offset = 0;
+	for (int i = 0; i < client->n_surfaces; ++i) {
+		for (int j = 0; j < 2; ++j) {
+			struct client_buffer *buffer = &client->surfaces[i].buffers[j];
+			buffer->buffer = wl_shm_pool_create_buffer(pool, offset,
+				width, height, stride, WL_SHM_FORMAT_ARGB8888);
+			buffer->data = (uint32_t *)((char *)client->pool_data + offset);
+			wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+			offset += buffer_size;
+		}
+	}
+	wl_shm_pool_destroy(pool);
+	return true;
+}
+
+static void fill(struct client_buffer *buffer, int stride, int x, int y,
+		int width, int height, uint32_t color) {
+	for (int j = y; j < y + height; ++j) {
+		uint32_t *row = buffer->data + j * stride;
+		for (int i = x; i < x + width; ++i) {
+			row[i] = color;
+		}
+	}
+}
+
+static void draw_surface(struct client *client,
+		struct client_surface *surface, int index) {
+	const struct frame_client_options *options = client->options;
+	struct client_buffer *buffer = NULL;
+	for (int i = 0; i < 2; ++i) {
+		if (!surface->buffers[i].busy) {
+			buffer = &surface->buffers[i];
+			break;
+		}
+	}
+	if (buffer == NULL) {
+		// The compositor still holds both buffers, skip this frame
+		return;
+	}
+
+	uint32_t color = 0xFF000000 | ((client->frame * 8 + index * 64) & 0xFF);
+	switch (options->damage) {
+	case FRAME_DAMAGE_FULL:
+		fill(buffer, options->width, 0, 0, options->width, options->height,
+			color);
+		wl_surface_damage(surface->surface, 0, 0,
+			options->width, options->height);
+		break;
+	case FRAME_DAMAGE_PARTIAL:;
+		int size = PARTIAL_DAMAGE_SIZE;
+		if (size > options->width || size > options->height) {
+			size = options->width < options->height ?
+				options->width : options->height;
+		}
+		int x = (client->frame * 4) % (options->width - size + 1);
+		int y = (client->frame * 2) % (options->height - size + 1);
+		fill(buffer, options->width, x, y, size, size, color);
+		wl_surface_damage(surface->surface, x, y, size, size);
+		break;
+	case FRAME_DAMAGE_NONE:
+		break;
+	}
+
+	wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
+	buffer->busy = true;
+}
+
+static void draw(struct client *client);
+
+static void frame_handle_done(void *data, struct wl_callback *callback,
+		uint32_t time) {
+	struct client *client = data;
+	wl_callback_destroy(callback);
+	client->frame_callback = NULL;
+	client->frame++;
+	draw(client);
+}
+
+static const struct wl_callback_listener frame_listener = {
+	.done = frame_handle_done,
+};
+
+static void draw(struct client *client) {
+	// Subsurfaces are synchronized: commit from the innermost child to the
+	// root, which applies the whole tree atomically
+	for (int i = client->n_surfaces - 1; i >= 0; --i) {
+		struct client_surface *surface = &client->surfaces[i];
+		draw_surface(client, surface, i);
+		if (i == 0) {
+			client->frame_callback = wl_surface_frame(surface->surface);
+			wl_callback_add_listener(client->frame_callback,
+				&frame_listener, client);
+		}
+		wl_surface_commit(surface->surface);
+	}
+}
+
+static bool create_surfaces(struct client *client) {
+	client->n_surfaces = client->options->depth + 1;
+	client->surfaces =
+		calloc(client->n_surfaces, sizeof(struct client_surface));
+	if (client->surfaces == NULL) {
+		return false;
+	}
+	for (int i = 0; i < client->n_surfaces; ++i) {
+		struct client_surface *surface = &client->surfaces[i];
+		surface->surface = wl_compositor_create_surface(client->compositor);
+		if (i > 0) {
+			surface->subsurface = wl_subcompositor_get_subsurface(
+				client->subcompositor, surface->surface,
+				client->surfaces[i - 1].surface);
+			wl_subsurface_set_position(surface->subsurface, 16, 16);
+		}
+	}
+	return create_buffers(client);
+}
+
+int frame_client_run(int fd, const struct frame_client_options *options) {
+	struct client client = { .options = options };
+	int status = EXIT_FAILURE;
+
+	client.display = wl_display_connect_to_fd(fd);
+	if (client.display == NULL) {
+		fprintf(stderr, "Failed to connect to the compositor\n");
+		return EXIT_FAILURE;
+	}
+
+	struct wl_registry *registry = wl_display_get_registry(client.display);
+	wl_registry_add_listener(registry, &registry_listener, &client);
+	wl_display_roundtrip(client.display);
+	if (client.compositor == NULL || client.shm == NULL ||
+			(options->depth > 0 && client.subcompositor == NULL)) {
+		fprintf(stderr, "Compositor is missing required globals\n");
+		goto out;
+	}
+
+	if (!create_surfaces(&client)) {
+		fprintf(stderr, "Failed to create surfaces\n");
+		goto out;
+	}
+
+	draw(&client);
+	while (wl_display_dispatch(client.display) != -1) {
+		// This space is intentionally left blank
+	}
+	// The compositor closing the connection is the normal way to exit
+	status = EXIT_SUCCESS;
+
+out:
+	// The process exits right after, the compositor cleans up our objects
+	if (client.pool_data != NULL && client.pool_data != MAP_FAILED) {
+		munmap(client.pool_data, client.pool_size);
+	}
+	free(client.surfaces);
+	wl_display_disconnect(client.display);
+	return status;
+}
@@ -0,0 +1,437 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+#include "frame.h"
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+// Frames rendered before measurements start, while clients connect
+#define WARMUP_FRAMES 30
+
+struct server {
+	struct wl_display *display;
+	struct wlr_backend *backend;
+	struct wlr_compositor *compositor;
+	struct wlr_scene *scene;
+	struct wlr_scene_output *scene_output;
+	struct wlr_output *output;
+
+	struct frame_client_options client_options;
+	int target_frames;
+	struct wl_list surfaces; // bench_surface::link
+	int n_roots;
+
+	int frames;
+	uint64_t cpu_start, cpu_max;
+	uint64_t latency_sum, latency_max, latency_count;
+	long rss_start;
+
+	struct wl_listener new_surface;
+	struct wl_listener output_frame;
+	struct wl_listener output_present;
+};
+
+struct bench_surface {
+	struct server *server;
+	struct wlr_surface *surface;
+	struct wl_list link; // server::surfaces
+	bool placed;
+
+	// Time of the first commit not rendered yet, and of the first commit
+	// rendered but not presented yet, 0 if none
+	uint64_t commit_nsec, rendered_nsec;
+
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+static uint64_t timespec_to_nsec(const struct timespec *ts) {
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static uint64_t get_clock_nsec(clockid_t clock) {
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return timespec_to_nsec(&now);
+}
+
+static long get_rss_kib(void) {
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL) {
+		return -1;
+	}
+	long size, resident;
+	int n = fscanf(f, "%ld %ld", &size, &resident);
+	fclose(f);
+	if (n != 2) {
+		return -1;
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void place_root_surface(struct bench_surface *bench_surface) {
+	struct server *server = bench_surface->server;
+	const struct frame_client_options *options = &server->client_options;
+	struct wlr_scene_node *node = wlr_scene_subsurface_tree_create(
+		&server->scene->node, bench_surface->surface);
+	if (node == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add surface to the scene");
+		return;
+	}
+
+	// Lay clients out in a grid, wrapping around when the output is full
+	int cols = OUTPUT_WIDTH / options->width;
+	int rows = OUTPUT_HEIGHT / options->height;
+	if (cols < 1) {
+		cols = 1;
+	}
+	if (rows < 1) {
+		rows = 1;
+	}
+	int slot = server->n_roots++;
+	wlr_scene_node_set_position(node, (slot % cols) * options->width,
+		(slot / cols % rows) * options->height);
+}
+
+static void surface_handle_commit(struct wl_listener *listener, void *data) {
+	struct bench_surface *bench_surface =
+		wl_container_of(listener, bench_surface, commit);
+	if (bench_surface->commit_nsec == 0) {
+		bench_surface->commit_nsec = get_clock_nsec(CLOCK_MONOTONIC);
+	}
+
+	// Subsurfaces get their role before their first commit
+	if (!bench_surface->placed) {
+		bench_surface->placed = true;
+		if (bench_surface->surface->role == NULL) {
+			place_root_surface(bench_surface);
+		}
+	}
+}
+
+static void surface_handle_destroy(struct wl_listener *listener, void *data) {
+	struct bench_surface *bench_surface =
+		wl_container_of(listener, bench_surface, destroy);
+	wl_list_remove(&bench_surface->commit.link);
+	wl_list_remove(&bench_surface->destroy.link);
+	wl_list_remove(&bench_surface->link);
+	free(bench_surface);
+}
+
+static void handle_new_surface(struct wl_listener *listener, void *data) {
+	struct server *server = wl_container_of(listener, server, new_surface);
+	struct wlr_surface *surface = data;
+
+	struct bench_surface *bench_surface =
+		calloc(1, sizeof(struct bench_surface));
+	if (bench_surface == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	bench_surface->server = server;
+	bench_surface->surface = surface;
+	wl_list_insert(&server->surfaces, &bench_surface->link);
+
+	bench_surface->commit.notify = surface_handle_commit;
+	wl_signal_add(&surface->events.commit, &bench_surface->commit);
+	bench_surface->destroy.notify = surface_handle_destroy;
+	wl_signal_add(&surface->events.destroy, &bench_surface->destroy);
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+	struct server *server = wl_container_of(listener, server, output_frame);
+	uint64_t cpu_start = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+
+	struct bench_surface *bench_surface;
+	wl_list_for_each(bench_surface, &server->surfaces, link) {
+		if (bench_surface->rendered_nsec == 0) {
+			bench_surface->rendered_nsec = bench_surface->commit_nsec;
+			bench_surface->commit_nsec = 0;
+		}
+	}
+
+	if (!wlr_scene_output_commit(server->scene_output)) {
+		wlr_log(WLR_ERROR, "Failed to render frame");
+		wl_display_terminate(server->display);
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wlr_scene_output_send_frame_done(server->scene_output, &now);
+	// Keep unthrottled outputs going even if nothing was damaged
+	wlr_output_schedule_frame(server->output);
+
+	server->frames++;
+	if (server->frames <= WARMUP_FRAMES) {
+		if (server->frames == WARMUP_FRAMES) {
+			server->cpu_start = get_clock_nsec(CLOCK_PROCESS_CPUTIME_ID);
+			server->rss_start = get_rss_kib();
+		}
+		return;
+	}
+
+	uint64_t cpu = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+	if (cpu > server->cpu_max) {
+		server->cpu_max = cpu;
+	}
+	if (server->frames - WARMUP_FRAMES >= server->target_frames) {
+		wl_display_terminate(server->display);
+	}
+}
+
+static void output_handle_present(struct wl_listener *listener, void *data) {
+	struct server *server = wl_container_of(listener, server, output_present);
+	struct wlr_output_event_present *event = data;
+	if (server->frames < WARMUP_FRAMES) {
+		return;
+	}
+
+	uint64_t when = timespec_to_nsec(event->when);
+	struct bench_surface *bench_surface;
+	wl_list_for_each(bench_surface, &server->surfaces, link) {
+		if (bench_surface->rendered_nsec == 0) {
+			continue;
+		}
+		uint64_t latency = when > bench_surface->rendered_nsec ?
+			when - bench_surface->rendered_nsec : 0;
+		bench_surface->rendered_nsec = 0;
+		server->latency_sum += latency;
+		server->latency_count++;
+		if (latency > server->latency_max) {
+			server->latency_max = latency;
+		}
+	}
+}
+
+static const char *damage_names[] = {
+	[FRAME_DAMAGE_FULL] = "full",
+	[FRAME_DAMAGE_PARTIAL] = "partial",
+	[FRAME_DAMAGE_NONE] = "none",
+};
+
+static const char usage[] =
+	"usage: wlroots-bench-frame [options]\n"
+	"  -c <clients>  number of clients (default: 4)\n"
+	"  -s <WxH>      surface size (default: 256x256)\n"
+	"  -d <depth>    nested subsurfaces per client (default: 0)\n"
+	"  -p <damage>   damage pattern: full, partial or none (default: full)\n"
+	"  -f <frames>   frames to measure (default: 600)\n"
+	"  -u            don't throttle frames to the refresh rate\n";
+
+static bool parse_damage(const char *name, enum frame_damage *damage) {
+	for (size_t i = 0; i < sizeof(damage_names) / sizeof(damage_names[0]);
+			++i) {
+		if (strcmp(name, damage_names[i]) == 0) {
+			*damage = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Starts a headless compositor with synthetic clients committing shm buffers,
+ * and measures the compositor's CPU time per frame, the latency between a
+ * commit and its presentation, and memory growth. The result is printed as a
+ * JSON object.
+ */
+int main(int argc, char *argv[]) {
+	struct server server = {
+		.client_options = {
+			.width = 256,
+			.height = 256,
+			.damage = FRAME_DAMAGE_FULL,
+		},
+		.target_frames = 600,
+	};
+	struct frame_client_options *client_options = &server.client_options;
+	int n_clients = 4;
+	bool unthrottled = false;
+
+	int c;
+	while ((c = getopt(argc, argv, "c:s:d:p:f:uh")) != -1) {
+		switch (c) {
+		case 'c':
+			n_clients = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &client_options->width,
+					&client_options->height) != 2) {
+				fprintf(stderr, "%s", usage);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			client_options->depth = atoi(optarg);
+			break;
+		case 'p':
+			if (!parse_damage(optarg, &client_options->damage)) {
+				fprintf(stderr, "%s", usage);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f':
+			server.target_frames = atoi(optarg);
+			break;
+		case 'u':
+			unthrottled = true;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n_clients < 0 || client_options->width <= 0 ||
+			client_options->height <= 0 || client_options->depth < 0 ||
+			server.target_frames <= 0) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+	int status = EXIT_FAILURE;
+
+	// Clients are forked before the compositor sets up its renderer
+	pid_t *pids = calloc(n_clients, sizeof(pid_t));
+	int *fds = calloc(n_clients, sizeof(int));
+	if ((n_clients > 0 && pids == NULL) || (n_clients > 0 && fds == NULL)) {
+		fprintf(stderr, "Allocation failed\n");
+		goto out_clients;
+	}
+	for (int i = 0; i < n_clients; ++i) {
+		fds[i] = -1;
+	}
+	for (int i = 0; i < n_clients; ++i) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+			perror("socketpair");
+			goto out_clients;
+		}
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			close(sv[0]);
+			close(sv[1]);
+			goto out_clients;
+		} else if (pids[i] == 0) {
+			close(sv[0]);
+			_exit(frame_client_run(sv[1], client_options));
+		}
+		close(sv[1]);
+		fds[i] = sv[0];
+	}
+
+	server.display = wl_display_create();
+	if (server.display == NULL) {
+		goto out_clients;
+	}
+	server.backend = wlr_headless_backend_create(server.display, NULL);
+	if (server.backend == NULL) {
+		goto out_display;
+	}
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(server.backend);
+	wlr_renderer_init_wl_display(renderer, server.display);
+	server.compositor = wlr_compositor_create(server.display, renderer);
+	server.scene = wlr_scene_create();
+	if (server.compositor == NULL || server.scene == NULL) {
+		goto out_backend;
+	}
+
+	wl_list_init(&server.surfaces);
+	server.new_surface.notify = handle_new_surface;
+	wl_signal_add(&server.compositor->events.new_surface, &server.new_surface);
+
+	server.output = wlr_headless_add_output(server.backend,
+		OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	if (server.output == NULL) {
+		goto out_backend;
+	}
+	if (unthrottled) {
+		wlr_headless_output_set_mode(server.output,
+			WLR_HEADLESS_OUTPUT_UNTHROTTLED);
+	}
+	server.scene_output = wlr_scene_output_create(server.scene, server.output);
+	if (server.scene_output == NULL) {
+		goto out_backend;
+	}
+	server.output_frame.notify = output_handle_frame;
+	wl_signal_add(&server.output->events.frame, &server.output_frame);
+	server.output_present.notify = output_handle_present;
+	wl_signal_add(&server.output->events.present, &server.output_present);
+
+	for (int i = 0; i < n_clients; ++i) {
+		if (wl_client_create(server.display, fds[i]) == NULL) {
+			fprintf(stderr, "Failed to create client\n");
+			goto out_listeners;
+		}
+		fds[i] = -1;
+	}
+
+	if (!wlr_backend_start(server.backend)) {
+		goto out_listeners;
+	}
+	wl_display_run(server.display);
+
+	int frames = server.frames - WARMUP_FRAMES;
+	uint64_t cpu = get_clock_nsec(CLOCK_PROCESS_CPUTIME_ID) - server.cpu_start;
+	uint64_t latency_avg = server.latency_count > 0 ?
+		server.latency_sum / server.latency_count : 0;
+	printf("{\"clients\": %d, \"width\": %d, \"height\": %d, \"depth\": %d, "
+		"\"damage\": \"%s\", \"unthrottled\": %s, \"frames\": %d, "
+		"\"cpu_ns_per_frame\": %.0f, \"frame_cpu_ns_max\": %" PRIu64 ", "
+		"\"latency_us_avg\": %.1f, \"latency_us_max\": %.1f, "
+		"\"rss_kib_start\": %ld, \"rss_kib_growth\": %ld}\n",
+		n_clients, client_options->width, client_options->height,
+		client_options->depth, damage_names[client_options->damage],
+		unthrottled ? "true" : "false", frames, (double)cpu / frames,
+		server.cpu_max, latency_avg / 1000.0, server.latency_max / 1000.0,
+		server.rss_start, get_rss_kib() - server.rss_start);
+	status = EXIT_SUCCESS;
+
+out_listeners:
+	wl_list_remove(&server.output_frame.link);
+	wl_list_remove(&server.output_present.link);
+	wl_list_remove(&server.new_surface.link);
+out_backend:
+	wl_display_destroy_clients(server.display);
+	if (server.scene != NULL) {
+		wlr_scene_node_destroy(&server.scene->node);
+	}
+	wlr_backend_destroy(server.backend);
+out_display:
+	wl_display_destroy(server.display);
+out_clients:
+	for (int i = 0; pids != NULL && i < n_clients; ++i) {
+		if (fds[i] >= 0) {
+			close(fds[i]);
+		}
+		if (pids[i] > 0) {
+			kill(pids[i], SIGTERM);
+			waitpid(pids[i], NULL, 0);
+		}
+	}
+	free(fds);
+	free(pids);
+	return status;
+}
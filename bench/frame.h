@@ -0,0 +1,26 @@
+#ifndef BENCH_FRAME_H
+#define BENCH_FRAME_H
+
+enum frame_damage {
+	FRAME_DAMAGE_FULL,
+	// A small square moving across the surface
+	FRAME_DAMAGE_PARTIAL,
+	// Buffers are committed without any damage
+	FRAME_DAMAGE_NONE,
+};
+
+struct frame_client_options {
+	int width, height;
+	// Number of nested subsurfaces below the root surface
+	int depth;
+	enum frame_damage damage;
+};
+
+/**
+ * Runs a synthetic client on the connection `fd` until the compositor goes
+ * away. It redraws and commits its surfaces on each frame callback. Returns
+ * the process exit status.
+ */
+int frame_client_run(int fd, const struct frame_client_options *options);
+
+#endif
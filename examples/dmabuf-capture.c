@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 199309L
+#include <inttypes.h>
 #include <libavformat/avformat.h>
 #include <libavutil/display.h>
 #include <libavutil/hwcontext_drm.h>
@@ -8,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -68,6 +70,13 @@ struct capture_context {
 
 	int64_t start_pts;
 
+	/* Statistics, counters are only written by the thread named after them */
+	uint64_t captured_frames; /* Capture */
+	uint64_t dropped_frames; /* Capture, the encoder queue was full */
+	uint64_t cancelled_frames; /* Capture */
+	uint64_t encoded_frames; /* Encoding */
+	int64_t latency_min, latency_max, latency_total; /* Encoding, nsec */
+
 	/* Config */
 	enum AVPixelFormat software_format;
 	enum AVHWDeviceType hw_device_type;
@@ -79,6 +88,12 @@ struct capture_context {
 	float out_bitrate;
 };
 
+static int64_t get_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static int init_fifo(struct fifo_buffer *buf, int max_queued_frames) {
 	pthread_mutex_init(&buf->lock, NULL);
 	pthread_cond_init(&buf->cond, NULL);
@@ -414,14 +429,22 @@ static void frame_ready(void *data, struct zwlr_export_dmabuf_frame_v1 *frame,
 		goto end;
 	}
 
-	err = av_hwframe_map(mapped_frame, f, 0);
+	/* Import the dmabuf as a surface of the encoding device. The mapping
+	 * must not copy, so that the measurements reflect the zero-copy path. */
+	err = av_hwframe_map(mapped_frame, f,
+			AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_DIRECT);
 	if (err) {
-		av_log(ctx, AV_LOG_ERROR, "Error mapping: %s!\n", av_err2str(err));
+		av_log(ctx, AV_LOG_ERROR, "Error mapping the dmabuf without copying: "
+				"%s!\n", av_err2str(err));
+		av_frame_free(&mapped_frame);
 		goto end;
 	}
 
+	ctx->captured_frames++;
 	if (push_to_fifo(&ctx->vid_frames, mapped_frame)) {
-		av_log(ctx, AV_LOG_WARNING, "Dropped frame!\n");
+		ctx->dropped_frames++;
+		av_log(ctx, AV_LOG_WARNING, "Dropped frame (%" PRIu64 " so far)!\n",
+				ctx->dropped_frames);
 	}
 
 	if (!ctx->quit && !ctx->err) {
@@ -436,6 +459,7 @@ end:
 static void frame_cancel(void *data, struct zwlr_export_dmabuf_frame_v1 *frame,
 		uint32_t reason) {
 	struct capture_context *ctx = data;
+	ctx->cancelled_frames++;
 	av_log(ctx, AV_LOG_WARNING, "Frame cancelled!\n");
 	av_frame_free(&ctx->current_frame);
 	if (reason == ZWLR_EXPORT_DMABUF_FRAME_V1_CANCEL_REASON_PERMANENT) {
@@ -505,6 +529,21 @@ void *vid_encode_thread(void *arg) {
 				goto end;
 			}
 
+			/* The pts is the presentation time of the captured frame,
+			 * relative to the first one. wlroots reports it with
+			 * CLOCK_MONOTONIC, like get_time_ns. */
+			int64_t present = ctx->start_pts + av_rescale_q(pkt.pts,
+					ctx->avctx->time_base, (AVRational){ 1, 1000000000 });
+			int64_t latency = get_time_ns() - present;
+			if (ctx->encoded_frames == 0 || latency < ctx->latency_min) {
+				ctx->latency_min = latency;
+			}
+			if (ctx->encoded_frames == 0 || latency > ctx->latency_max) {
+				ctx->latency_max = latency;
+			}
+			ctx->latency_total += latency;
+			ctx->encoded_frames++;
+
 			pkt.stream_index = 0;
 			err = av_interleaved_write_frame(ctx->avf, &pkt);
 
@@ -515,10 +554,12 @@ void *vid_encode_thread(void *arg) {
 						av_err2str(err));
 				goto end;
 			}
-		};
 
-		av_log(ctx, AV_LOG_INFO, "Encoded frame %i (%i in queue)\n",
-				ctx->avctx->frame_number, get_fifo_size(&ctx->vid_frames));
+			av_log(ctx, AV_LOG_INFO, "Encoded frame %i (%i in queue), "
+					"capture-to-encode latency %.2f ms\n",
+					ctx->avctx->frame_number, get_fifo_size(&ctx->vid_frames),
+					latency / 1000000.0);
+		};
 
 	} while (!ctx->err);
 
@@ -624,6 +665,10 @@ static int init_encoding(struct capture_context *ctx) {
 	}
 	ctx->avf->oformat->video_codec = out_codec->id;
 	ctx->is_software_encoder = !(out_codec->capabilities & AV_CODEC_CAP_HARDWARE);
+	if (ctx->is_software_encoder) {
+		av_log(ctx, AV_LOG_WARNING, "Software encoder, frames will be "
+				"downloaded to system memory before encoding!\n");
+	}
 
 	ctx->avctx = avcodec_alloc_context3(out_codec);
 	if (!ctx->avctx)
@@ -737,6 +782,17 @@ static int main_loop(struct capture_context *ctx) {
 
 	av_log(ctx, AV_LOG_INFO, "Wrote trailer!\n");
 
+	av_log(ctx, AV_LOG_INFO, "Captured %" PRIu64 " frames: %" PRIu64
+			" encoded, %" PRIu64 " dropped, %" PRIu64 " cancelled\n",
+			ctx->captured_frames, ctx->encoded_frames, ctx->dropped_frames,
+			ctx->cancelled_frames);
+	if (ctx->encoded_frames > 0) {
+		av_log(ctx, AV_LOG_INFO, "Capture-to-encode latency: min %.2f ms, "
+				"avg %.2f ms, max %.2f ms\n", ctx->latency_min / 1000000.0,
+				ctx->latency_total / 1000000.0 / ctx->encoded_frames,
+				ctx->latency_max / 1000000.0);
+	}
+
 	return ctx->err;
 }
 
@@ -0,0 +1,691 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "idle-inhibit-unstable-v1-client-protocol.h"
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+#include "text-input-unstable-v3-client-protocol.h"
+#include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "xdg-decoration-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+#include "xdg-shell-unstable-v6-client-protocol.h"
+
+/**
+ * Usage: protocol-replay [-f] [-s speed] <file>
+ * Replays the clients recorded with wlr_protocol_recorder (rootston -T)
+ * against the running compositor, e.g. rootston on the headless backend. Each
+ * recorded client gets its own connection, and its requests are sent at their
+ * recorded times divided by the speed, or as fast as possible with -f. Prints
+ * how long the replay took, so that recordings can be used as benchmarks.
+ *
+ * Events aren't replayed. Serials received in configure and ping events are
+ * acknowledged instead of the recorded ones. Shm buffers are filled with noise
+ * whenever their recorded hash changes. Requests on objects created by the
+ * compositor, e.g. data offers, and on globals this tool doesn't know about
+ * are skipped.
+ */
+
+// WL_CLOSURE_MAX_ARGS in libwayland
+#define MAX_ARGS 20
+
+struct replay_global {
+	uint32_t name;
+	char *interface;
+	uint32_t version;
+	struct wl_list link; // replay_client::globals
+};
+
+struct replay_object {
+	struct replay_client *client;
+	struct wl_proxy *proxy;
+	const struct wl_interface *interface;
+	uint32_t id; // in the recording
+
+	// Latest serials to acknowledge, 0 if none received yet
+	uint32_t configure_serial, ping_serial;
+
+	int fd; // shm pools and buffers, -1 otherwise
+	off_t offset; // shm buffers, in the pool
+	size_t size;
+	uint64_t hash;
+};
+
+struct replay_client {
+	int id; // in the recording
+	struct wl_display *display;
+	struct replay_object **objects; // indexed by recorded object ID
+	size_t objects_len;
+	struct wl_list globals; // replay_global::link
+	struct wl_list link;
+};
+
+static const struct wl_interface *global_interfaces[] = {
+	&wl_compositor_interface,
+	&wl_data_device_manager_interface,
+	&wl_output_interface,
+	&wl_seat_interface,
+	&wl_shell_interface,
+	&wl_shm_interface,
+	&wl_subcompositor_interface,
+	&wp_presentation_interface,
+	&xdg_wm_base_interface,
+	&zwlr_layer_shell_v1_interface,
+	&zwp_idle_inhibit_manager_v1_interface,
+	&zwp_pointer_constraints_v1_interface,
+	&zwp_relative_pointer_manager_v1_interface,
+	&zwp_text_input_manager_v3_interface,
+	&zxdg_decoration_manager_v1_interface,
+	&zxdg_shell_v6_interface,
+};
+
+static struct wl_list clients;
+static double speed = 1.0;
+static bool fast = false;
+static uint64_t start_usec = 0;
+static unsigned long replayed = 0, skipped = 0;
+
+static uint64_t get_time_usec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int create_file(off_t size) {
+	static int counter = 0;
+	char name[64];
+	snprintf(name, sizeof(name), "/wlroots-replay-%d-%d", getpid(),
+		counter++);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "shm_open failed: %m\n");
+		return -1;
+	}
+	shm_unlink(name);
+	if (ftruncate(fd, size) < 0) {
+		fprintf(stderr, "ftruncate failed: %m\n");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static const struct wl_interface *find_global_interface(const char *name) {
+	size_t len = sizeof(global_interfaces) / sizeof(global_interfaces[0]);
+	for (size_t i = 0; i < len; ++i) {
+		if (strcmp(global_interfaces[i]->name, name) == 0) {
+			return global_interfaces[i];
+		}
+	}
+	return NULL;
+}
+
+static int find_request(const struct wl_interface *interface,
+		const char *name) {
+	for (int i = 0; i < interface->method_count; ++i) {
+		if (strcmp(interface->methods[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static struct replay_global *find_global(struct replay_client *client,
+		const char *interface) {
+	struct replay_global *global;
+	wl_list_for_each(global, &client->globals, link) {
+		if (strcmp(global->interface, interface) == 0) {
+			return global;
+		}
+	}
+	return NULL;
+}
+
+static int dispatch_event(const void *impl, void *target, uint32_t opcode,
+		const struct wl_message *message, union wl_argument *args);
+
+static struct replay_object *object_create(struct replay_client *client,
+		uint32_t id, struct wl_proxy *proxy,
+		const struct wl_interface *interface);
+
+static void object_destroy(struct replay_object *object) {
+	struct replay_client *client = object->client;
+	client->objects[object->id] = NULL;
+	if (object->proxy != (struct wl_proxy *)client->display) {
+		wl_proxy_destroy(object->proxy);
+	}
+	if (object->fd >= 0) {
+		close(object->fd);
+	}
+	free(object);
+}
+
+static struct replay_object *object_create(struct replay_client *client,
+		uint32_t id, struct wl_proxy *proxy,
+		const struct wl_interface *interface) {
+	if (id >= client->objects_len) {
+		size_t len = client->objects_len > 0 ? client->objects_len : 64;
+		while (len <= id) {
+			len *= 2;
+		}
+		struct replay_object **objects =
+			realloc(client->objects, len * sizeof(*objects));
+		if (objects == NULL) {
+			return NULL;
+		}
+		memset(&objects[client->objects_len], 0,
+			(len - client->objects_len) * sizeof(*objects));
+		client->objects = objects;
+		client->objects_len = len;
+	}
+
+	struct replay_object *object = calloc(1, sizeof(struct replay_object));
+	if (object == NULL) {
+		return NULL;
+	}
+	object->client = client;
+	object->proxy = proxy;
+	object->interface = interface;
+	object->id = id;
+	object->fd = -1;
+
+	// IDs are reused once the previous object is gone
+	if (client->objects[id] != NULL) {
+		object_destroy(client->objects[id]);
+	}
+	client->objects[id] = object;
+	if (proxy != (struct wl_proxy *)client->display) {
+		wl_proxy_add_dispatcher(proxy, dispatch_event, NULL, object);
+	}
+	return object;
+}
+
+static struct replay_object *get_object(struct replay_client *client,
+		uint32_t id) {
+	return id < client->objects_len ? client->objects[id] : NULL;
+}
+
+static int dispatch_event(const void *impl, void *target, uint32_t opcode,
+		const struct wl_message *message, union wl_argument *args) {
+	struct replay_object *object = wl_proxy_get_user_data(target);
+	struct replay_client *client = object->client;
+
+	if (object->interface == &wl_registry_interface) {
+		if (strcmp(message->name, "global") == 0) {
+			struct replay_global *global =
+				calloc(1, sizeof(struct replay_global));
+			if (global == NULL) {
+				return 0;
+			}
+			global->name = args[0].u;
+			global->interface = strdup(args[1].s);
+			global->version = args[2].u;
+			wl_list_insert(client->globals.prev, &global->link);
+		} else if (strcmp(message->name, "global_remove") == 0) {
+			struct replay_global *global, *tmp;
+			wl_list_for_each_safe(global, tmp, &client->globals, link) {
+				if (global->name == args[0].u) {
+					wl_list_remove(&global->link);
+					free(global->interface);
+					free(global);
+				}
+			}
+		}
+	} else if (object->interface == &wl_callback_interface) {
+		// The compositor destroys callbacks once done
+		object_destroy(object);
+	} else if (strcmp(message->name, "configure") == 0 &&
+			find_request(object->interface, "ack_configure") >= 0) {
+		object->configure_serial = args[0].u;
+	} else if (strcmp(message->name, "ping") == 0) {
+		object->ping_serial = args[0].u;
+	}
+	return 0;
+}
+
+static void client_destroy(struct replay_client *client) {
+	for (size_t i = 0; i < client->objects_len; ++i) {
+		if (client->objects[i] != NULL) {
+			object_destroy(client->objects[i]);
+		}
+	}
+	free(client->objects);
+	struct replay_global *global, *tmp;
+	wl_list_for_each_safe(global, tmp, &client->globals, link) {
+		free(global->interface);
+		free(global);
+	}
+	wl_display_disconnect(client->display);
+	wl_list_remove(&client->link);
+	free(client);
+}
+
+static struct replay_client *get_client(int id, bool create) {
+	struct replay_client *client;
+	wl_list_for_each(client, &clients, link) {
+		if (client->id == id) {
+			return client;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	client = calloc(1, sizeof(struct replay_client));
+	if (client == NULL) {
+		return NULL;
+	}
+	client->id = id;
+	wl_list_init(&client->globals);
+	client->display = wl_display_connect(NULL);
+	if (client->display == NULL) {
+		fprintf(stderr, "Failed to connect to the compositor\n");
+		free(client);
+		return NULL;
+	}
+	wl_list_insert(&clients, &client->link);
+	if (object_create(client, 1, (struct wl_proxy *)client->display,
+			&wl_display_interface) == NULL) {
+		client_destroy(client);
+		return NULL;
+	}
+	return client;
+}
+
+// Sends pending requests and dispatches the events received within timeout
+// milliseconds, for all clients
+static void dispatch_clients(int timeout) {
+	size_t len = wl_list_length(&clients);
+	if (len == 0) {
+		if (timeout > 0) {
+			usleep(timeout * 1000);
+		}
+		return;
+	}
+	struct pollfd *fds = calloc(len, sizeof(struct pollfd));
+	if (fds == NULL) {
+		return;
+	}
+
+	size_t i = 0;
+	struct replay_client *client;
+	wl_list_for_each(client, &clients, link) {
+		while (wl_display_prepare_read(client->display) != 0) {
+			wl_display_dispatch_pending(client->display);
+		}
+		fds[i].fd = wl_display_get_fd(client->display);
+		fds[i].events = POLLIN;
+		if (wl_display_flush(client->display) < 0 && errno == EAGAIN) {
+			fds[i].events |= POLLOUT;
+		}
+		++i;
+	}
+
+	if (poll(fds, len, timeout) < 0 && errno != EINTR) {
+		fprintf(stderr, "poll failed: %m\n");
+	}
+
+	i = 0;
+	wl_list_for_each(client, &clients, link) {
+		if (fds[i].revents & POLLIN) {
+			wl_display_read_events(client->display);
+		} else {
+			wl_display_cancel_read(client->display);
+		}
+		wl_display_dispatch_pending(client->display);
+		++i;
+	}
+	free(fds);
+}
+
+static void wait_until(uint64_t usec) {
+	if (fast) {
+		dispatch_clients(0);
+		return;
+	}
+	uint64_t due = start_usec + (uint64_t)(usec / speed);
+	while (true) {
+		uint64_t now = get_time_usec();
+		if (now >= due) {
+			dispatch_clients(0);
+			return;
+		}
+		int timeout = (due - now + 999) / 1000;
+		dispatch_clients(timeout);
+	}
+}
+
+// Splits the next space-separated token off the line, quoted strings are
+// unescaped in place
+static char *next_token(char **cursor) {
+	char *token = *cursor;
+	while (*token == ' ') {
+		++token;
+	}
+	if (*token == '\0' || *token == '\n') {
+		return NULL;
+	}
+
+	if (*token != '"') {
+		char *end = token + strcspn(token, " \n");
+		if (*end != '\0') {
+			*end++ = '\0';
+		}
+		*cursor = end;
+		return token;
+	}
+
+	char *src = token + 1, *dst = token;
+	while (*src != '\0' && *src != '"') {
+		if (*src != '\\') {
+			*dst++ = *src++;
+			continue;
+		}
+		++src;
+		if (*src == 'x') {
+			unsigned int c = 0;
+			sscanf(src + 1, "%2x", &c);
+			*dst++ = c;
+			src += 3;
+		} else if (*src != '\0') {
+			*dst++ = *src++;
+		}
+	}
+	*dst = '\0';
+	*cursor = *src == '"' ? src + 1 : src;
+	return token;
+}
+
+static void fill_buffer(struct replay_object *buffer, uint64_t hash) {
+	if (buffer->fd < 0 || hash == buffer->hash) {
+		return;
+	}
+	buffer->hash = hash;
+
+	// xorshift64, seeded with the hash
+	uint64_t state = hash != 0 ? hash : 1;
+	uint64_t chunk[8192];
+	size_t written = 0;
+	while (written < buffer->size) {
+		for (size_t i = 0; i < sizeof(chunk) / sizeof(chunk[0]); ++i) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			chunk[i] = state;
+		}
+		size_t len = buffer->size - written;
+		if (len > sizeof(chunk)) {
+			len = sizeof(chunk);
+		}
+		ssize_t n = pwrite(buffer->fd, chunk, len, buffer->offset + written);
+		if (n <= 0) {
+			return;
+		}
+		written += n;
+	}
+}
+
+static bool parse_array(const char *token, struct wl_array *array) {
+	size_t len = strlen(token);
+	if (len < 2 || token[0] != '[' || token[len - 1] != ']') {
+		return false;
+	}
+	for (size_t i = 1; i + 2 < len; i += 2) {
+		unsigned int byte;
+		unsigned char *p = wl_array_add(array, 1);
+		if (p == NULL || sscanf(&token[i], "%2x", &byte) != 1) {
+			return false;
+		}
+		*p = byte;
+	}
+	return true;
+}
+
+static bool replay_request(struct replay_client *client, char *target,
+		char *cursor) {
+	char *at = strchr(target, '@');
+	char *dot = at != NULL ? strchr(at, '.') : NULL;
+	if (dot == NULL) {
+		return false;
+	}
+	*at = *dot = '\0';
+	uint32_t id = strtoul(at + 1, NULL, 10);
+	struct replay_object *object = get_object(client, id);
+	if (object == NULL || strcmp(object->interface->name, target) != 0) {
+		return false;
+	}
+	int opcode = find_request(object->interface, dot + 1);
+	if (opcode < 0) {
+		return false;
+	}
+	const struct wl_message *message = &object->interface->methods[opcode];
+
+	union wl_argument args[MAX_ARGS] = {0};
+	struct wl_array arrays[MAX_ARGS];
+	int n_arrays = 0, fd = -1, n = 0;
+	uint32_t new_id = 0;
+	const struct wl_interface *new_interface = NULL;
+	uint32_t version = wl_proxy_get_version(object->proxy);
+	bool ok = true;
+
+	for (const char *c = message->signature; *c != '\0' && ok; ++c) {
+		if ((*c >= '0' && *c <= '9') || *c == '?') {
+			continue;
+		}
+		char *token = next_token(&cursor);
+		if (token == NULL || n == MAX_ARGS) {
+			ok = false;
+			break;
+		}
+		switch (*c) {
+		case 'i':
+		case 'f':
+			args[n].i = strtol(token, NULL, 10);
+			break;
+		case 'u':
+			args[n].u = strtoul(token, NULL, 10);
+			break;
+		case 's':
+			args[n].s = strcmp(token, "-") == 0 ? NULL : token;
+			break;
+		case 'o': {
+			uint32_t obj_id = strtoul(token, NULL, 10);
+			if (obj_id != 0) {
+				struct replay_object *obj = get_object(client, obj_id);
+				ok = obj != NULL;
+				args[n].o = ok ? (struct wl_object *)obj->proxy : NULL;
+			}
+			break;
+		}
+		case 'n':
+			new_id = strtoul(token, NULL, 10);
+			new_interface = message->types[n];
+			if (new_interface == NULL) {
+				if (n < 2) {
+					ok = false;
+					break;
+				}
+				// wl_registry.bind: bind the same global of this compositor
+				new_interface = find_global_interface(args[n - 2].s);
+				struct replay_global *global = NULL;
+				if (new_interface != NULL) {
+					global = find_global(client, new_interface->name);
+					if (global == NULL) {
+						wl_display_roundtrip(client->display);
+						global = find_global(client, new_interface->name);
+					}
+				}
+				ok = global != NULL;
+				if (ok) {
+					args[0].u = global->name;
+					version = args[n - 1].u < global->version ?
+						args[n - 1].u : global->version;
+					args[n - 1].u = version;
+				}
+			}
+			break;
+		case 'a':
+			wl_array_init(&arrays[n_arrays]);
+			ok = parse_array(token, &arrays[n_arrays]);
+			args[n].a = &arrays[n_arrays++];
+			break;
+		case 'h': {
+			off_t size = strtoll(token, NULL, 10);
+			fd = size >= 0 ? create_file(size) : open("/dev/null", O_RDWR);
+			ok = fd >= 0;
+			args[n].h = fd;
+			break;
+		}
+		}
+		++n;
+	}
+
+	if (ok) {
+		if (strcmp(message->name, "ack_configure") == 0) {
+			if (object->configure_serial == 0) {
+				wl_display_roundtrip(client->display);
+			}
+			args[0].u = object->configure_serial;
+		} else if (strcmp(message->name, "pong") == 0) {
+			args[0].u = object->ping_serial;
+		}
+
+		struct wl_proxy *proxy = wl_proxy_marshal_array_constructor_versioned(
+			object->proxy, opcode, args, new_interface, version);
+		struct replay_object *new_object = NULL;
+		if (proxy != NULL) {
+			new_object = object_create(client, new_id, proxy, new_interface);
+		}
+
+		if (new_object != NULL && new_interface == &wl_shm_pool_interface) {
+			new_object->fd = fd;
+			fd = -1;
+		} else if (new_object != NULL &&
+				new_interface == &wl_buffer_interface && object->fd >= 0) {
+			// wl_shm_pool.create_buffer
+			new_object->fd = dup(object->fd);
+			new_object->offset = args[1].i;
+			new_object->size = (size_t)args[4].i * args[3].i;
+		} else if (object->interface == &wl_shm_pool_interface &&
+				strcmp(message->name, "resize") == 0 && object->fd >= 0) {
+			if (ftruncate(object->fd, args[0].i) < 0) {
+				fprintf(stderr, "ftruncate failed: %m\n");
+			}
+		}
+
+		// Destructor requests are named so in all known protocols
+		if (strcmp(message->name, "destroy") == 0 ||
+				strcmp(message->name, "release") == 0) {
+			object_destroy(object);
+		}
+	}
+
+	if (fd >= 0) {
+		close(fd);
+	}
+	for (int i = 0; i < n_arrays; ++i) {
+		wl_array_release(&arrays[i]);
+	}
+	return ok;
+}
+
+static void replay_line(char *line) {
+	char *cursor = line;
+	char *usec = next_token(&cursor);
+	char *client_id = next_token(&cursor);
+	char *what = next_token(&cursor);
+	if (usec == NULL || usec[0] == '#' || client_id == NULL || what == NULL) {
+		return;
+	}
+	wait_until(strtoull(usec, NULL, 10));
+
+	bool disconnect = strcmp(what, "disconnect") == 0;
+	struct replay_client *client = get_client(atoi(client_id), !disconnect);
+	if (client == NULL) {
+		return;
+	}
+
+	if (disconnect) {
+		wl_display_roundtrip(client->display);
+		client_destroy(client);
+		return;
+	} else if (strcmp(what, "buffer") == 0) {
+		char *id = next_token(&cursor);
+		char *hash = next_token(&cursor);
+		struct replay_object *buffer =
+			id != NULL ? get_object(client, strtoul(id, NULL, 10)) : NULL;
+		if (buffer != NULL && hash != NULL) {
+			fill_buffer(buffer, strtoull(hash, NULL, 16));
+		}
+		return;
+	}
+
+	if (replay_request(client, what, cursor)) {
+		replayed++;
+	} else {
+		skipped++;
+	}
+}
+
+int main(int argc, char **argv) {
+	int c;
+	while ((c = getopt(argc, argv, "fs:")) != -1) {
+		switch (c) {
+		case 'f':
+			fast = true;
+			break;
+		case 's':
+			speed = strtod(optarg, NULL);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f] [-s speed] <file>\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1 || speed <= 0) {
+		fprintf(stderr, "usage: %s [-f] [-s speed] <file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE *file = fopen(argv[optind], "r");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open %s: %m\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	wl_list_init(&clients);
+	start_usec = get_time_usec();
+	char *line = NULL;
+	size_t line_size = 0;
+	while (getline(&line, &line_size, file) > 0) {
+		replay_line(line);
+	}
+	free(line);
+	fclose(file);
+
+	// Wait for the compositor to handle everything
+	struct replay_client *client, *tmp;
+	wl_list_for_each(client, &clients, link) {
+		wl_display_roundtrip(client->display);
+	}
+	uint64_t elapsed = get_time_usec() - start_usec;
+	wl_list_for_each_safe(client, tmp, &clients, link) {
+		client_destroy(client);
+	}
+
+	printf("Replayed %lu requests in %.3f s, skipped %lu\n", replayed,
+		elapsed / 1000000.0, skipped);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,570 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+
+/**
+ * Usage: stress [-n toplevels] [-d depth] [-r rate] [-t seconds] [-s seed]
+ * Stresses the compositor with worst-case client behavior. Opens many
+ * toplevels, each with a chain of nested subsurfaces, and at every tick
+ * (without waiting for frame callbacks):
+ * - resizes every surface and commits a new buffer with random damage
+ * - moves subsurfaces around
+ * - opens or closes popups
+ * - replaces the selection with a new data source
+ * Useful to profile the compositor's CPU and memory usage.
+ */
+
+#define MAX_SIZE 512
+#define MIN_SIZE 32
+#define MAX_DAMAGE_RECTS 4
+// Each toplevel toggles its popup every this many ticks
+#define POPUP_PERIOD 16
+
+struct stress_popup {
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_popup *xdg_popup;
+	bool configured;
+};
+
+struct stress_toplevel {
+	int index;
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *xdg_toplevel;
+	bool configured;
+
+	struct wl_surface **subsurfaces; // nested, each a child of the previous
+	struct wl_subsurface **wl_subsurfaces;
+
+	struct stress_popup *popup; // NULL if closed
+};
+
+static struct wl_display *display = NULL;
+static struct wl_compositor *compositor = NULL;
+static struct wl_subcompositor *subcompositor = NULL;
+static struct wl_shm *shm = NULL;
+static struct xdg_wm_base *wm_base = NULL;
+static struct wl_seat *seat = NULL;
+static struct wl_data_device_manager *data_device_manager = NULL;
+
+static struct wl_shm_pool *pool = NULL;
+static uint32_t *pool_data = NULL;
+static struct wl_data_device *data_device = NULL;
+static struct wl_data_offer *selection_offer = NULL;
+
+static int n_toplevels = 100, depth = 4, rate = 240;
+static struct stress_toplevel *toplevels = NULL;
+static uint32_t tick = 0;
+// Latest serial received, used to set the selection
+static uint32_t last_serial = 0;
+static bool running = true;
+
+static uint64_t get_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool create_pool(void) {
+	size_t size = MAX_SIZE * MAX_SIZE * 4;
+
+	const char shm_name[] = "/wlroots-stress";
+	int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "shm_open failed\n");
+		return false;
+	}
+	shm_unlink(shm_name);
+
+	int ret;
+	while ((ret = ftruncate(fd, size)) == EINTR) {
+		// No-op
+	}
+	if (ret < 0) {
+		close(fd);
+		fprintf(stderr, "ftruncate failed\n");
+		return false;
+	}
+
+	pool_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pool_data == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %m\n");
+		close(fd);
+		return false;
+	}
+
+	pool = wl_shm_create_pool(shm, fd, size);
+	close(fd);
+	return true;
+}
+
+static void buffer_handle_release(void *data, struct wl_buffer *buffer) {
+	wl_buffer_destroy(buffer);
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_handle_release,
+};
+
+/**
+ * Commits a new buffer of the given size, all buffers share the same pool
+ * memory. Damages a few random rectangles.
+ */
+static void commit_buffer(struct wl_surface *surface, int width, int height) {
+	uint32_t color = 0xFF000000 | (rand() & 0xFFFFFF);
+	int row = rand() % height;
+	for (int x = 0; x < width; ++x) {
+		pool_data[row * MAX_SIZE + x] = color;
+	}
+
+	struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,
+		width, height, MAX_SIZE * 4, WL_SHM_FORMAT_ARGB8888);
+	wl_buffer_add_listener(buffer, &buffer_listener, NULL);
+	wl_surface_attach(surface, buffer, 0, 0);
+
+	int n_rects = 1 + rand() % MAX_DAMAGE_RECTS;
+	for (int i = 0; i < n_rects; ++i) {
+		int x = rand() % width, y = rand() % height;
+		wl_surface_damage(surface, x, y,
+			1 + rand() % (width - x), 1 + rand() % (height - y));
+	}
+	wl_surface_commit(surface);
+}
+
+static int toplevel_size(struct stress_toplevel *toplevel, int axis) {
+	int range = MAX_SIZE - MIN_SIZE;
+	int phase = (tick * (axis + 2) + toplevel->index * 37) % (2 * range);
+	// Grow and shrink back
+	return MIN_SIZE + (phase < range ? phase : 2 * range - phase);
+}
+
+static void popup_destroy(struct stress_popup *popup) {
+	if (popup == NULL) {
+		return;
+	}
+	xdg_popup_destroy(popup->xdg_popup);
+	xdg_surface_destroy(popup->xdg_surface);
+	wl_surface_destroy(popup->surface);
+	free(popup);
+}
+
+static void popup_surface_handle_configure(void *data,
+		struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct stress_popup *popup = data;
+	last_serial = serial;
+	xdg_surface_ack_configure(xdg_surface, serial);
+	popup->configured = true;
+	commit_buffer(popup->surface, 64, 64);
+}
+
+static const struct xdg_surface_listener popup_surface_listener = {
+	.configure = popup_surface_handle_configure,
+};
+
+static void popup_handle_configure(void *data, struct xdg_popup *xdg_popup,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	// Wait for xdg_surface::configure
+}
+
+static void popup_handle_done(void *data, struct xdg_popup *xdg_popup) {
+	struct stress_toplevel *toplevel = data;
+	popup_destroy(toplevel->popup);
+	toplevel->popup = NULL;
+}
+
+static const struct xdg_popup_listener popup_listener = {
+	.configure = popup_handle_configure,
+	.popup_done = popup_handle_done,
+};
+
+static void toplevel_open_popup(struct stress_toplevel *toplevel) {
+	struct stress_popup *popup = calloc(1, sizeof(struct stress_popup));
+	if (popup == NULL) {
+		return;
+	}
+	popup->surface = wl_compositor_create_surface(compositor);
+	popup->xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, popup->surface);
+	xdg_surface_add_listener(popup->xdg_surface, &popup_surface_listener,
+		popup);
+
+	struct xdg_positioner *positioner = xdg_wm_base_create_positioner(wm_base);
+	xdg_positioner_set_size(positioner, 64, 64);
+	xdg_positioner_set_anchor_rect(positioner, rand() % MIN_SIZE,
+		rand() % MIN_SIZE, 1, 1);
+	popup->xdg_popup = xdg_surface_get_popup(popup->xdg_surface,
+		toplevel->xdg_surface, positioner);
+	xdg_positioner_destroy(positioner);
+	xdg_popup_add_listener(popup->xdg_popup, &popup_listener, toplevel);
+
+	wl_surface_commit(popup->surface);
+	toplevel->popup = popup;
+}
+
+static void toplevel_update(struct stress_toplevel *toplevel) {
+	if (!toplevel->configured) {
+		return;
+	}
+
+	int width = toplevel_size(toplevel, 0);
+	int height = toplevel_size(toplevel, 1);
+
+	// Subsurfaces are desynchronized, each commit is applied immediately
+	for (int i = depth - 1; i >= 0; --i) {
+		wl_subsurface_set_position(toplevel->wl_subsurfaces[i],
+			rand() % width, rand() % height);
+		commit_buffer(toplevel->subsurfaces[i],
+			MIN_SIZE + rand() % (width / 2 + 1),
+			MIN_SIZE + rand() % (height / 2 + 1));
+	}
+
+	xdg_surface_set_window_geometry(toplevel->xdg_surface, 0, 0,
+		width, height);
+	commit_buffer(toplevel->surface, width, height);
+
+	if ((tick + toplevel->index) % POPUP_PERIOD == 0) {
+		if (toplevel->popup != NULL) {
+			popup_destroy(toplevel->popup);
+			toplevel->popup = NULL;
+		} else {
+			toplevel_open_popup(toplevel);
+		}
+	}
+}
+
+static void data_source_handle_target(void *data,
+		struct wl_data_source *source, const char *mime_type) {
+	// This space intentionally left blank
+}
+
+static void data_source_handle_send(void *data, struct wl_data_source *source,
+		const char *mime_type, int32_t fd) {
+	const char text[] = "wlroots stress";
+	if (write(fd, text, sizeof(text) - 1) < 0) {
+		fprintf(stderr, "Failed to send selection\n");
+	}
+	close(fd);
+}
+
+static void data_source_handle_cancelled(void *data,
+		struct wl_data_source *source) {
+	wl_data_source_destroy(source);
+}
+
+static const struct wl_data_source_listener data_source_listener = {
+	.target = data_source_handle_target,
+	.send = data_source_handle_send,
+	.cancelled = data_source_handle_cancelled,
+};
+
+static void churn_selection(void) {
+	if (data_device == NULL) {
+		return;
+	}
+	struct wl_data_source *source =
+		wl_data_device_manager_create_data_source(data_device_manager);
+	wl_data_source_add_listener(source, &data_source_listener, NULL);
+	wl_data_source_offer(source, "text/plain");
+	wl_data_source_offer(source, "text/plain;charset=utf-8");
+	// The previous source gets cancelled and destroyed
+	wl_data_device_set_selection(data_device, source, last_serial);
+}
+
+static void data_device_handle_data_offer(void *data,
+		struct wl_data_device *data_device, struct wl_data_offer *offer) {
+	// Offers are only used for the selection, see below
+}
+
+static void data_device_handle_enter(void *data,
+		struct wl_data_device *data_device, uint32_t serial,
+		struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y,
+		struct wl_data_offer *offer) {
+	last_serial = serial;
+	if (offer != NULL) {
+		wl_data_offer_destroy(offer);
+	}
+}
+
+static void data_device_handle_leave(void *data,
+		struct wl_data_device *data_device) {
+	// This space intentionally left blank
+}
+
+static void data_device_handle_motion(void *data,
+		struct wl_data_device *data_device, uint32_t time,
+		wl_fixed_t x, wl_fixed_t y) {
+	// This space intentionally left blank
+}
+
+static void data_device_handle_drop(void *data,
+		struct wl_data_device *data_device) {
+	// This space intentionally left blank
+}
+
+static void data_device_handle_selection(void *data,
+		struct wl_data_device *data_device, struct wl_data_offer *offer) {
+	if (selection_offer != NULL) {
+		wl_data_offer_destroy(selection_offer);
+	}
+	selection_offer = offer;
+}
+
+static const struct wl_data_device_listener data_device_listener = {
+	.data_offer = data_device_handle_data_offer,
+	.enter = data_device_handle_enter,
+	.leave = data_device_handle_leave,
+	.motion = data_device_handle_motion,
+	.drop = data_device_handle_drop,
+	.selection = data_device_handle_selection,
+};
+
+static void xdg_surface_handle_configure(void *data,
+		struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct stress_toplevel *toplevel = data;
+	last_serial = serial;
+	xdg_surface_ack_configure(xdg_surface, serial);
+	if (!toplevel->configured) {
+		toplevel->configured = true;
+		toplevel_update(toplevel);
+	}
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_handle_configure,
+};
+
+static void xdg_toplevel_handle_configure(void *data,
+		struct xdg_toplevel *xdg_toplevel, int32_t w, int32_t h,
+		struct wl_array *states) {
+	// The requested size is ignored, toplevels keep resizing themselves
+}
+
+static void xdg_toplevel_handle_close(void *data,
+		struct xdg_toplevel *xdg_toplevel) {
+	running = false;
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	.configure = xdg_toplevel_handle_configure,
+	.close = xdg_toplevel_handle_close,
+};
+
+static void wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base,
+		uint32_t serial) {
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = wm_base_handle_ping,
+};
+
+static bool toplevel_init(struct stress_toplevel *toplevel, int index) {
+	toplevel->index = index;
+	toplevel->surface = wl_compositor_create_surface(compositor);
+	toplevel->xdg_surface =
+		xdg_wm_base_get_xdg_surface(wm_base, toplevel->surface);
+	xdg_surface_add_listener(toplevel->xdg_surface, &xdg_surface_listener,
+		toplevel);
+	toplevel->xdg_toplevel = xdg_surface_get_toplevel(toplevel->xdg_surface);
+	xdg_toplevel_add_listener(toplevel->xdg_toplevel, &xdg_toplevel_listener,
+		toplevel);
+	xdg_toplevel_set_title(toplevel->xdg_toplevel, "stress");
+
+	toplevel->subsurfaces = calloc(depth, sizeof(struct wl_surface *));
+	toplevel->wl_subsurfaces = calloc(depth, sizeof(struct wl_subsurface *));
+	if (depth > 0 && (toplevel->subsurfaces == NULL ||
+			toplevel->wl_subsurfaces == NULL)) {
+		return false;
+	}
+	struct wl_surface *parent = toplevel->surface;
+	for (int i = 0; i < depth; ++i) {
+		toplevel->subsurfaces[i] = wl_compositor_create_surface(compositor);
+		toplevel->wl_subsurfaces[i] = wl_subcompositor_get_subsurface(
+			subcompositor, toplevel->subsurfaces[i], parent);
+		wl_subsurface_set_desync(toplevel->wl_subsurfaces[i]);
+		parent = toplevel->subsurfaces[i];
+	}
+
+	wl_surface_commit(toplevel->surface);
+	return true;
+}
+
+static void handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		compositor = wl_registry_bind(registry, name,
+			&wl_compositor_interface, 1);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		subcompositor = wl_registry_bind(registry, name,
+			&wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+	} else if (strcmp(interface, wl_seat_interface.name) == 0 && seat == NULL) {
+		seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+	} else if (strcmp(interface, wl_data_device_manager_interface.name) == 0) {
+		data_device_manager = wl_registry_bind(registry, name,
+			&wl_data_device_manager_interface, 1);
+	}
+}
+
+static void handle_global_remove(void *data, struct wl_registry *registry,
+		uint32_t name) {
+	// who cares
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_global,
+	.global_remove = handle_global_remove,
+};
+
+int main(int argc, char **argv) {
+	int seconds = 0;
+	unsigned int seed = 1;
+	int c;
+	while ((c = getopt(argc, argv, "n:d:r:t:s:h")) != -1) {
+		switch (c) {
+		case 'n':
+			n_toplevels = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n toplevels] [-d depth] [-r rate] "
+				"[-t seconds] [-s seed]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n_toplevels <= 0 || depth < 0 || rate <= 0) {
+		fprintf(stderr, "Invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+	srand(seed);
+
+	display = wl_display_connect(NULL);
+	if (display == NULL) {
+		fprintf(stderr, "Failed to create display\n");
+		return EXIT_FAILURE;
+	}
+
+	struct wl_registry *registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry, &registry_listener, NULL);
+	wl_display_roundtrip(display);
+
+	if (compositor == NULL || subcompositor == NULL || shm == NULL) {
+		fprintf(stderr, "wl_compositor, wl_subcompositor or wl_shm "
+			"not available\n");
+		return EXIT_FAILURE;
+	}
+	if (wm_base == NULL) {
+		fprintf(stderr, "xdg-shell not available\n");
+		return EXIT_FAILURE;
+	}
+	xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
+	if (seat != NULL && data_device_manager != NULL) {
+		data_device =
+			wl_data_device_manager_get_data_device(data_device_manager, seat);
+		wl_data_device_add_listener(data_device, &data_device_listener, NULL);
+	} else {
+		fprintf(stderr, "No data device, selections won't be churned\n");
+	}
+
+	if (!create_pool()) {
+		return EXIT_FAILURE;
+	}
+
+	toplevels = calloc(n_toplevels, sizeof(struct stress_toplevel));
+	if (toplevels == NULL) {
+		fprintf(stderr, "Allocation failed\n");
+		return EXIT_FAILURE;
+	}
+	for (int i = 0; i < n_toplevels; ++i) {
+		if (!toplevel_init(&toplevels[i], i)) {
+			fprintf(stderr, "Allocation failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	uint64_t start = get_time_msec();
+	uint64_t next_tick = start;
+	struct pollfd pfd = { .fd = wl_display_get_fd(display) };
+	while (running) {
+		while (wl_display_prepare_read(display) != 0) {
+			wl_display_dispatch_pending(display);
+		}
+
+		// Stop generating requests while the compositor can't keep up
+		pfd.events = POLLIN;
+		if (wl_display_flush(display) < 0) {
+			if (errno != EAGAIN) {
+				wl_display_cancel_read(display);
+				break;
+			}
+			pfd.events |= POLLOUT;
+		}
+
+		uint64_t now = get_time_msec();
+		int timeout = next_tick > now ? (int)(next_tick - now) : 0;
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+			wl_display_cancel_read(display);
+			break;
+		}
+		if (pfd.revents & POLLIN) {
+			if (wl_display_read_events(display) < 0) {
+				break;
+			}
+		} else {
+			wl_display_cancel_read(display);
+		}
+		if (wl_display_dispatch_pending(display) < 0) {
+			break;
+		}
+
+		now = get_time_msec();
+		if (now < next_tick || (pfd.events & POLLOUT)) {
+			continue;
+		}
+		next_tick += 1000 / rate;
+		if (next_tick < now) {
+			// Don't try to catch up after a stall
+			next_tick = now;
+		}
+
+		tick++;
+		for (int i = 0; i < n_toplevels; ++i) {
+			toplevel_update(&toplevels[i]);
+		}
+		churn_selection();
+
+		if (seconds > 0 && now - start >= (uint64_t)seconds * 1000) {
+			running = false;
+		}
+	}
+
+	int err = wl_display_get_error(display);
+	wl_display_disconnect(display);
+	return err == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,6 +3,7 @@
 
 #include <EGL/egl.h>
 #include <gbm.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -17,6 +18,46 @@
 #include "properties.h"
 #include "renderer.h"
 
+// A client buffer imported for direct scan-out
+struct wlr_drm_fb {
+	struct wlr_buffer *wlr_buf;
+	struct gbm_bo *bo;
+};
+
+// A property value of a DRM object, atomic only
+struct wlr_drm_prop_value {
+	uint32_t obj_id, prop_id;
+	uint64_t value;
+	// Committed even if the kernel already has this value
+	bool force;
+};
+
+struct wlr_drm_prop_list {
+	struct wlr_drm_prop_value *items;
+	size_t len, cap;
+};
+
+#define WLR_DRM_CURSOR_CACHE_LEN 4
+
+// A cursor image rendered for the cursor plane, so that switching back to it
+// only requires swapping the plane's buffer
+struct wlr_drm_cursor {
+	// Texture is NULL if the entry doesn't hold a valid image
+	struct wlr_texture *texture;
+	int32_t scale;
+	enum wl_output_transform transform;
+	enum wl_output_transform output_transform;
+	float output_scale;
+
+	struct wlr_drm_surface surf;
+	struct wlr_drm_surface mgpu_surf;
+	struct gbm_bo *bo; // The buffer to scan out, from mgpu_surf if multi-GPU
+	uint32_t last_used;
+
+	struct wl_listener texture_destroy;
+	struct wl_listener texture_update;
+};
+
 struct wlr_drm_plane {
 	uint32_t type;
 	uint32_t id;
@@ -26,12 +67,39 @@ struct wlr_drm_plane {
 	struct wlr_drm_surface surf;
 	struct wlr_drm_surface mgpu_surf;
 
-	uint32_t drm_format; // ARGB8888 or XRGB8888
+	// Format of the plane's render surfaces, negotiated on modeset.
+	// default_format until then.
+	uint32_t drm_format;
+	// 8-bit ARGB8888 or XRGB8888, chosen when the plane is initialized
+	uint32_t default_format;
+	// Modifiers supported with drm_format, from IN_FORMATS
+	uint64_t *modifiers;
+	size_t num_modifiers;
+	// Formats the plane supports, without modifiers
+	uint32_t *drm_formats;
+	size_t num_drm_formats;
+	// All format and modifier pairs, from IN_FORMATS
+	struct wlr_dmabuf_format *formats;
+	size_t num_formats;
 
 	// Only used by cursor
 	float matrix[9];
-	bool cursor_enabled;
 	int32_t cursor_hotspot_x, cursor_hotspot_y;
+	struct wlr_drm_cursor cursor_cache[WLR_DRM_CURSOR_CACHE_LEN];
+	// Images written by the CPU, only their bo is used. See
+	// drm_connector_set_cursor_pixels.
+	struct wlr_drm_cursor cursor_pixels[3];
+	// The image to show, NULL if the cursor is hidden. It may wait for the
+	// pending page-flip before being handed to the CRTC.
+	struct wlr_drm_cursor *cursor_current;
+	// The last image handed to the CRTC, and the one it replaced, which may
+	// stay on screen until the next page-flip completes. Their buffers must
+	// not be rewritten.
+	struct wlr_drm_cursor *cursor_shown, *cursor_retired;
+	uint32_t cursor_seq;
+
+	// Only used by overlay, see wlr_drm_connector for the fb lifecycle
+	struct wlr_drm_fb pending_fb, queued_fb, current_fb;
 
 	union wlr_drm_plane_props props;
 };
@@ -42,7 +110,13 @@ struct wlr_drm_crtc {
 	// Atomic modesetting only
 	uint32_t mode_id;
 	uint32_t gamma_lut;
-	drmModeAtomicReq *atomic;
+	// Property changes waiting for the next commit
+	struct wlr_drm_prop_list atomic;
+	// Contents of gamma_lut, and the LUT waiting for the next page-flip. An
+	// empty pending LUT resets gamma.
+	struct drm_color_lut *gamma_data, *pending_gamma;
+	size_t gamma_data_len, pending_gamma_len;
+	bool gamma_pending;
 
 	// Legacy only
 	drmModeCrtc *legacy_crtc;
@@ -67,9 +141,21 @@ struct wlr_drm_crtc {
 struct wlr_drm_backend {
 	struct wlr_backend backend;
 
+	// Renders this backend's outputs, which are copied through mgpu_surf.
+	// NULL for the primary GPU and for secondary GPUs rendering locally.
 	struct wlr_drm_backend *parent;
 	const struct wlr_drm_interface *iface;
 	clockid_t clock;
+	bool addfb2_modifiers;
+	// Property values of the last atomic commits. Commits only include the
+	// properties which changed since, except for modesets. Cleared when
+	// another DRM master may have changed them.
+	struct wlr_drm_prop_list committed_props;
+	// Whether page-flips may skip waiting for vblank
+	bool async_page_flip;
+	// Number of buffers of the outputs' render surfaces, 2 or 3. With 3, the
+	// next frame is rendered while the previous one waits for its page-flip.
+	int swapchain_depth;
 
 	int fd;
 
@@ -107,6 +193,26 @@ struct wlr_drm_backend {
 
 	struct wlr_drm_renderer renderer;
 	struct wlr_session *session;
+
+	// Submits the pageflips of grouped outputs, see
+	// wlr_drm_connector_set_grouped
+	struct wl_event_source *group_flush;
+
+	// Connectors probed by probe_drm_connectors, consumed by the next scan
+	drmModeConnector **probed_connectors;
+	int probed_connectors_len;
+
+	// Probes the connectors off the main loop after a hotplug event which
+	// doesn't name a connector, see probe_drm_connectors_async
+	struct {
+		pthread_t thread;
+		bool running;
+		bool pending; // Another hotplug event arrived while running
+		int event_fd;
+		struct wl_event_source *event;
+		drmModeConnector **connectors;
+		int connectors_len;
+	} probe;
 };
 
 enum wlr_drm_connector_state {
@@ -135,16 +241,66 @@ struct wlr_drm_connector {
 
 	struct wlr_drm_crtc *crtc;
 	uint32_t possible_crtc;
+	// Set while the connector and its CRTC are leased to another process
+	struct wlr_drm_lease *lease;
 
 	union wlr_drm_connector_props props;
 
 	uint32_t width, height;
 	int32_t cursor_x, cursor_y;
 
+	// Snapshot of the cursor state used by wlr_drm_connector_move_cursor_async,
+	// published by the main thread on each cursor update
+	struct {
+		pthread_mutex_t lock;
+		uint32_t crtc_id; // 0 if the cursor can't be moved
+		enum wl_output_transform transform;
+		int width, height;
+		int hotspot_x, hotspot_y;
+	} async_cursor;
+
+	bool vrr_capable;
+	// Highest depth of the render surfaces, see wlr_drm_connector_set_depth
+	int depth;
+
 	drmModeCrtc *old_crtc;
 
+	// Client buffers, only used for direct scan-out: pending is attached but
+	// not yet submitted, queued waits for a page-flip and current is on screen
+	struct wlr_drm_fb pending_fb, queued_fb, current_fb;
+
 	bool pageflip_pending;
+	// The next or pending page-flip doesn't wait for vblank, see
+	// wlr_output_set_tearing
+	bool flip_async;
 	struct wl_event_source *retry_pageflip;
+	bool retry_pageflip_armed;
+	// Waiting for a vblank to retry a page-flip which failed with EBUSY
+	bool flip_retry;
+	bool flip_retry_modeset;
+	// Sends the frame event right after a page-flip has been submitted, with
+	// a swapchain depth of 3
+	struct wl_event_source *early_frame;
+	// Waiting for the CRTC sequence event which sends the next frame event,
+	// legacy only
+	bool frame_vblank_pending;
+	// Cursor updates deferred until the pending page-flip completes
+	bool cursor_set_pending, cursor_move_pending;
+	// The cursor plane failed, software cursors are used instead
+	bool cursor_failed;
+
+	// Part of the backend's page-flip group
+	bool grouped;
+	// Waiting for the group flush to be page-flipped to group_fb_id
+	bool group_flip_queued;
+	uint32_t group_fb_id;
+
+	// Explicit fencing, atomic only: the render fence of the buffer about to
+	// be page-flipped and the fence the kernel signals once it is displayed.
+	// -1 if none.
+	int in_fence_fd;
+	int32_t out_fence_fd;
+
 	struct wl_list link;
 };
 
@@ -154,7 +310,28 @@ bool check_drm_features(struct wlr_drm_backend *drm);
 bool init_drm_resources(struct wlr_drm_backend *drm);
 void finish_drm_resources(struct wlr_drm_backend *drm);
 void restore_drm_outputs(struct wlr_drm_backend *drm);
-void scan_drm_connectors(struct wlr_drm_backend *state);
+/**
+ * Updates the outputs from the DRM connectors. If changed_id is non-zero, only
+ * that connector and unknown ones are probed, the others keep their last
+ * probed state.
+ */
+void scan_drm_connectors(struct wlr_drm_backend *state, uint32_t changed_id);
+/**
+ * Probes the connectors ahead of the next scan_drm_connectors, which then
+ * doesn't block on output detection. Doesn't touch the Wayland display.
+ */
+void probe_drm_connectors(struct wlr_drm_backend *drm);
+/**
+ * Probes the connectors on a separate thread, then scans them from the main
+ * loop.
+ */
+void probe_drm_connectors_async(struct wlr_drm_backend *drm);
+void finish_drm_probe_thread(struct wlr_drm_backend *drm);
+/**
+ * Terminates the leases whose lessee has gone away.
+ */
+void scan_drm_leases(struct wlr_drm_backend *drm);
+void finish_probed_drm_connectors(struct wlr_drm_backend *drm);
 int handle_drm_event(int fd, uint32_t mask, void *data);
 bool enable_drm_connector(struct wlr_output *output, bool enable);
 bool set_drm_connector_gamma(struct wlr_output *output, size_t size,
@@ -3,10 +3,12 @@
 
 #include <gbm.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+struct wlr_box;
 struct wlr_drm_backend;
 struct wlr_drm_connector;
 struct wlr_drm_crtc;
@@ -16,16 +18,50 @@ struct wlr_drm_interface {
 	// Enable or disable DPMS for connector
 	bool (*conn_enable)(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, bool enable);
+	// Turn the connector's display on or off, keeping its CRTC and mode
+	bool (*conn_set_dpms)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, bool on);
 	// Pageflip on crtc. If mode is non-NULL perform a full modeset using it.
 	bool (*crtc_pageflip)(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
 		uint32_t fb_id, drmModeModeInfo *mode);
+	// Make crtc use mode for the next page-flips, without a modeset. Only
+	// valid if the hardware is already scanning out in mode.
+	bool (*crtc_adopt_mode)(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, drmModeModeInfo *mode);
+	// Pageflip the CRTCs of several connectors in a single commit. Optional.
+	bool (*group_pageflip)(struct wlr_drm_backend *drm, size_t len,
+		struct wlr_drm_connector *conns[static len],
+		const uint32_t fb_ids[static len]);
+	// Check whether crtc_pageflip would succeed with these arguments, without
+	// changing any state
+	bool (*crtc_test)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id, drmModeModeInfo *mode);
+	// Check whether modesets of several connectors, each on its current CRTC,
+	// would succeed together in a single commit. Optional.
+	bool (*group_test)(struct wlr_drm_backend *drm, size_t len,
+		struct wlr_drm_connector *conns[static len],
+		const uint32_t fb_ids[static len],
+		drmModeModeInfo *modes[static len]);
+	// Show fb_id, a src_w x src_h buffer, in box on the overlay plane of crtc
+	// with the next page-flip. Set fb_id to 0 to disable. Optional.
+	bool (*crtc_set_overlay)(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, uint32_t fb_id,
+		uint32_t src_w, uint32_t src_h, const struct wlr_box *box);
 	// Enable the cursor buffer on crtc. Set bo to NULL to disable
 	bool (*crtc_set_cursor)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, struct gbm_bo *bo);
 	// Move the cursor on crtc
 	bool (*crtc_move_cursor)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, int x, int y);
+	// Enable or disable variable refresh rate on crtc
+	bool (*crtc_set_vrr)(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool enabled);
+	// Apply a change made with crtc_set_vrr right away rather than with the
+	// next page-flip. Optional, for interfaces which defer it.
+	bool (*crtc_commit_vrr)(struct wlr_drm_backend *drm,
+		struct wlr_drm_crtc *crtc, bool enabled);
 	// Set the gamma lut on crtc
 	bool (*crtc_set_gamma)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, size_t size,
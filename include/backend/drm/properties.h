@@ -16,12 +16,13 @@ union wlr_drm_connector_props {
 		uint32_t dpms;
 		uint32_t link_status; // not guaranteed to exist
 		uint32_t path;
+		uint32_t vrr_capable; // not guaranteed to exist
 
 		// atomic-modesetting only
 
 		uint32_t crtc_id;
 	};
-	uint32_t props[4];
+	uint32_t props[6];
 };
 
 union wlr_drm_crtc_props {
@@ -29,6 +30,7 @@ union wlr_drm_crtc_props {
 		// Neither of these are guaranteed to exist
 		uint32_t rotation;
 		uint32_t scaling_mode;
+		uint32_t vrr_enabled; // not guaranteed to exist
 
 		// atomic-modesetting only
 
@@ -36,14 +38,16 @@ union wlr_drm_crtc_props {
 		uint32_t mode_id;
 		uint32_t gamma_lut;
 		uint32_t gamma_lut_size;
+		uint32_t out_fence_ptr; // Not guaranteed to exist
 	};
-	uint32_t props[6];
+	uint32_t props[8];
 };
 
 union wlr_drm_plane_props {
 	struct {
 		uint32_t type;
 		uint32_t rotation; // Not guaranteed to exist
+		uint32_t in_formats; // Not guaranteed to exist
 
 		// atomic-modesetting only
 
@@ -57,8 +61,9 @@ union wlr_drm_plane_props {
 		uint32_t crtc_h;
 		uint32_t fb_id;
 		uint32_t crtc_id;
+		uint32_t in_fence_fd; // Not guaranteed to exist
 	};
-	uint32_t props[12];
+	uint32_t props[14];
 };
 
 bool get_drm_connector_props(int fd, uint32_t id,
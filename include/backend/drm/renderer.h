@@ -3,6 +3,7 @@
 
 #include <EGL/egl.h>
 #include <gbm.h>
+#include <pixman.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <wlr/backend.h>
@@ -21,17 +22,41 @@ struct wlr_drm_renderer {
 	struct wlr_renderer *wlr_rend;
 };
 
+#define WLR_DRM_SURFACE_DAMAGE_LEN 2
+
 struct wlr_drm_surface {
 	struct wlr_drm_renderer *renderer;
 
 	uint32_t width;
 	uint32_t height;
+	uint32_t format;
 
 	struct gbm_surface *gbm;
 	EGLSurface egl;
 
 	struct gbm_bo *front;
 	struct gbm_bo *back;
+	// Rendered while back was still waiting for its page-flip, submitted once
+	// back is on screen. Only used with a swapchain depth of 3.
+	struct gbm_bo *queued;
+
+	// Signaled once rendering to back has completed, -1 if none
+	int fence_fd;
+	// Signaled once the display has stopped reading the previous buffer,
+	// waited for on the GPU before rendering again. -1 if none.
+	int release_fence_fd;
+
+	// Without EGL_EXT_buffer_age, the EGL surface may be asked to preserve
+	// its contents across swaps, so that the back buffer always holds the
+	// last frame
+	bool preserved;
+	// Whether the back buffer holds the last frame of the output, only used
+	// if preserved
+	bool preserved_valid;
+
+	// Damage of the previous multi-GPU copies, most recent first
+	pixman_region32_t previous_damage[WLR_DRM_SURFACE_DAMAGE_LEN];
+	size_t previous_idx;
 };
 
 bool init_drm_renderer(struct wlr_drm_backend *drm,
@@ -40,20 +65,36 @@ void finish_drm_renderer(struct wlr_drm_renderer *renderer);
 
 bool init_drm_surface(struct wlr_drm_surface *surf,
 	struct wlr_drm_renderer *renderer, uint32_t width, uint32_t height,
-	uint32_t format, uint32_t flags);
+	uint32_t format, const uint64_t *modifiers, size_t num_modifiers,
+	uint32_t flags);
 
+// Set with_modifiers to allocate with the modifiers advertised by the plane
 bool init_drm_plane_surfaces(struct wlr_drm_plane *plane,
 	struct wlr_drm_backend *drm, int32_t width, uint32_t height,
-	uint32_t format);
+	uint32_t format, bool with_modifiers);
 
 void finish_drm_surface(struct wlr_drm_surface *surf);
 bool make_drm_surface_current(struct wlr_drm_surface *surf, int *buffer_age);
 struct gbm_bo *swap_drm_surface_buffers(struct wlr_drm_surface *surf,
 	pixman_region32_t *damage);
+// Like swap_drm_surface_buffers, but keeps the buffer in queued instead of
+// making it the back buffer. A previously queued buffer is dropped.
+struct gbm_bo *queue_drm_surface_buffers(struct wlr_drm_surface *surf,
+	pixman_region32_t *damage);
+// Makes the queued buffer the back buffer, to be called once the previous back
+// buffer has been page-flipped. Returns NULL if no buffer is queued.
+struct gbm_bo *promote_drm_surface_queued(struct wlr_drm_surface *surf);
 struct gbm_bo *get_drm_surface_front(struct wlr_drm_surface *surf);
 void post_drm_surface(struct wlr_drm_surface *surf);
+// Returns the render fence of the last swapped buffer and transfers its
+// ownership to the caller. Returns -1 if explicit fencing is unsupported.
+int take_drm_surface_fence(struct wlr_drm_surface *surf);
+// Takes ownership of fence_fd, see wlr_drm_surface.release_fence_fd
+void set_drm_surface_release_fence(struct wlr_drm_surface *surf, int fence_fd);
+// Copies src into dest. If damage is non-NULL, only the regions changed since
+// the previous copy and those for which dest's buffer is out-of-date are
+// copied.
 struct gbm_bo *copy_drm_surface_mgpu(struct wlr_drm_surface *dest,
-	struct gbm_bo *src);
-bool export_drm_bo(struct gbm_bo *bo, struct wlr_dmabuf_attributes *attribs);
+	struct gbm_bo *src, pixman_region32_t *damage);
 
 #endif
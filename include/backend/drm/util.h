@@ -15,6 +15,9 @@ void parse_edid(struct wlr_output *restrict output, size_t len,
 const char *conn_get_name(uint32_t type_id);
 // Returns the DRM framebuffer id for a gbm_bo
 uint32_t get_fb_for_bo(struct gbm_bo *bo, uint32_t drm_format);
+// Returns the DRM framebuffer id for an imported client gbm_bo, using the bo's
+// own format and modifier. Returns 0 if the buffer can't be scanned out.
+uint32_t get_fb_for_client_bo(struct gbm_bo *bo);
 
 // Part of match_obj
 enum {
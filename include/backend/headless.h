@@ -1,11 +1,18 @@
 #ifndef BACKEND_HEADLESS_H
 #define BACKEND_HEADLESS_H
 
+#include <pixman.h>
+#include <time.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/swapchain.h>
 #include <wlr/backend/headless.h>
 #include <wlr/backend/interface.h>
 
 #define HEADLESS_DEFAULT_REFRESH (60 * 1000) // 60 Hz
 
+// Enough for a consumer to read the last frame while the next one is rendered
+#define HEADLESS_BUFFERS_LEN 3
+
 struct wlr_headless_backend {
 	struct wlr_backend backend;
 	struct wlr_egl egl;
@@ -16,6 +23,10 @@ struct wlr_headless_backend {
 	struct wl_list input_devices;
 	struct wl_listener display_destroy;
 	bool started;
+
+	// Used to allocate output buffers with the GLES2 renderer, NULL if the
+	// renderer's DRM device can't be opened
+	struct wlr_allocator *allocator;
 };
 
 struct wlr_headless_output {
@@ -25,8 +36,22 @@ struct wlr_headless_output {
 	struct wl_list link;
 
 	void *egl_surface;
+	// Used instead of the EGL surface with the pixman renderer
+	pixman_image_t *image;
+	// Whether the image or the pbuffer has been rendered to. Both keep their
+	// contents across frames.
+	bool image_rendered;
+	// Used instead of the EGL surface if the backend has an allocator
+	struct wlr_swapchain *swapchain;
+	bool buffer_bound; // a swapchain buffer is bound for rendering
 	struct wl_event_source *frame_timer;
 	int frame_delay; // ms
+
+	// Only used in unthrottled mode
+	enum wlr_headless_output_mode mode;
+	struct wl_event_source *idle_frame;
+	struct timespec virtual_time;
+	unsigned virtual_seq;
 };
 
 struct wlr_headless_input_device {
@@ -37,5 +62,6 @@ struct wlr_headless_input_device {
 
 struct wlr_headless_backend *headless_backend_from_backend(
 	struct wlr_backend *wlr_backend);
+void headless_output_start_frames(struct wlr_headless_output *output);
 
 #endif
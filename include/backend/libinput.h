@@ -2,13 +2,54 @@
 #define BACKEND_LIBINPUT_H
 
 #include <libinput.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <wayland-server-core.h>
 #include <wlr/backend/interface.h>
 #include <wlr/backend/libinput.h>
+#include <wlr/backend/session.h>
 #include <wlr/interfaces/wlr_input_device.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_list.h>
 
+#define WLR_LIBINPUT_QUEUE_LEN 1024
+
+struct wlr_libinput_thread {
+	bool running;
+	pthread_t thread;
+	pthread_mutex_t lock; // recursive, guards the libinput context
+
+	// Events read by the thread, waiting to be handled by the main loop
+	struct libinput_event *queue[WLR_LIBINPUT_QUEUE_LEN];
+	atomic_size_t queue_head, queue_tail;
+
+	int event_fd; // thread to main loop: events queued or request pending
+	int wake_fd; // main loop to thread: queue drained or stop requested
+	struct wl_event_source *queue_event;
+	atomic_bool stop;
+
+	// Session requests made by libinput on the thread
+	pthread_mutex_t request_mutex;
+	pthread_cond_t request_cond;
+	bool stopping;
+	struct {
+		bool pending;
+		const char *path; // NULL to close fd
+		int fd;
+	} request;
+};
+
+// An input device opened with wlr_session_open_file_async before libinput
+// asks for it
+struct wlr_libinput_prefetch {
+	struct wlr_libinput_backend *backend;
+	char *path;
+	struct wlr_session_open_request *request; // NULL once done
+	int fd; // -1 if not open or taken by libinput
+	struct wl_list link; // wlr_libinput_backend::prefetches
+};
+
 struct wlr_libinput_backend {
 	struct wlr_backend backend;
 
@@ -22,16 +63,38 @@ struct wlr_libinput_backend {
 	struct wl_listener session_signal;
 
 	struct wlr_list wlr_device_lists; // list of struct wl_list
+
+	struct wlr_libinput_thread thread;
+	struct wl_list prefetches; // wlr_libinput_prefetch::link
+
+	wlr_libinput_motion_handler_t motion_handler;
+	void *motion_handler_data;
 };
 
 struct wlr_libinput_input_device {
 	struct wlr_input_device wlr_input_device;
 
 	struct libinput_device *handle;
+	// Events are dropped, see wlr_libinput_set_device_enabled
+	bool disabled;
+	// Restored once the libinput device isn't suspended anymore
+	uint32_t send_events_mode;
 };
 
 uint32_t usec_to_msec(uint64_t usec);
 
+bool libinput_thread_start(struct wlr_libinput_backend *backend);
+void libinput_thread_stop(struct wlr_libinput_backend *backend);
+int libinput_thread_open_file(struct wlr_libinput_backend *backend,
+	const char *path);
+void libinput_thread_close_file(struct wlr_libinput_backend *backend, int fd);
+/**
+ * Must be held by the main thread while it uses the libinput context when the
+ * reader thread is running. Does nothing otherwise.
+ */
+void libinput_backend_lock(struct wlr_libinput_backend *backend);
+void libinput_backend_unlock(struct wlr_libinput_backend *backend);
+
 void handle_libinput_event(struct wlr_libinput_backend *state,
 		struct libinput_event *event);
 
@@ -82,6 +145,8 @@ void handle_touch_motion(struct libinput_event *event,
 		struct libinput_device *device);
 void handle_touch_cancel(struct libinput_event *event,
 		struct libinput_device *device);
+void handle_touch_frame(struct libinput_event *event,
+		struct libinput_device *device);
 
 struct wlr_tablet *create_libinput_tablet(
 		struct libinput_device *device);
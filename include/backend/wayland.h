@@ -2,6 +2,7 @@
 #define BACKEND_WAYLAND_H
 
 #include <stdbool.h>
+#include <time.h>
 
 #include <wayland-client.h>
 #include <wayland-egl.h>
@@ -33,6 +34,8 @@ struct wlr_wl_backend {
 	struct wl_compositor *compositor;
 	struct xdg_wm_base *xdg_wm_base;
 	struct wl_shm *shm;
+	struct wp_presentation *presentation;
+	clockid_t presentation_clock;
 	struct wl_seat *seat;
 	struct wl_pointer *pointer;
 	struct wl_keyboard *keyboard;
@@ -40,6 +43,30 @@ struct wlr_wl_backend {
 	char *seat_name;
 };
 
+// Number of cursor images kept rendered on their own surface per output
+#define WLR_WL_CURSOR_CACHE_LEN 4
+
+// A cursor image rendered to a surface of the host compositor, which can be
+// set as the pointer's cursor again without redrawing it
+struct wlr_wl_cursor_surface {
+	struct wlr_wl_output *output;
+
+	struct wl_surface *surface;
+	struct wl_egl_window *egl_window;
+	EGLSurface egl_surface;
+
+	// What has been rendered, texture is NULL if the slot is unused. The
+	// slot is reset if the texture is updated or destroyed.
+	struct wlr_texture *texture;
+	int32_t scale;
+	enum wl_output_transform transform, output_transform;
+	int32_t width, height;
+	uint64_t last_used;
+
+	struct wl_listener texture_update;
+	struct wl_listener texture_destroy;
+};
+
 struct wlr_wl_output {
 	struct wlr_output wlr_output;
 
@@ -52,17 +79,27 @@ struct wlr_wl_output {
 	struct xdg_toplevel *xdg_toplevel;
 	struct wl_egl_window *egl_window;
 	EGLSurface egl_surface;
+	struct wl_list presentation_feedbacks; // wlr_wl_presentation_feedback::link
 
 	uint32_t enter_serial;
 
 	struct {
-		struct wl_surface *surface;
-		struct wl_egl_window *egl_window;
+		struct wl_surface *surface; // NULL if hidden
 		int32_t hotspot_x, hotspot_y;
 		int32_t width, height;
+
+		struct wlr_wl_cursor_surface cache[WLR_WL_CURSOR_CACHE_LEN];
+		uint64_t use_counter;
 	} cursor;
 };
 
+struct wlr_wl_presentation_feedback {
+	struct wlr_wl_output *output;
+	struct wl_list link; // wlr_wl_output::presentation_feedbacks
+	struct wp_presentation_feedback *feedback;
+	uint32_t commit_seq; // of the swap the feedback was requested for
+};
+
 struct wlr_wl_input_device {
 	struct wlr_input_device wlr_input_device;
 
@@ -4,7 +4,10 @@
 #include <stdbool.h>
 
 #include <X11/Xlib-xcb.h>
+#include <gbm.h>
 #include <wayland-server.h>
+#include <xcb/present.h>
+#include <xcb/render.h>
 #include <xcb/xcb.h>
 
 #include <wlr/backend/x11.h>
@@ -19,6 +22,16 @@
 #define X11_DEFAULT_REFRESH (60 * 1000) // 60 Hz
 
 struct wlr_x11_backend;
+struct wlr_x11_output;
+
+// A GBM buffer shared with the X server as a DRI3 pixmap
+struct wlr_x11_buffer {
+	struct wlr_x11_output *output;
+	struct gbm_bo *bo;
+	xcb_pixmap_t pixmap;
+	bool busy; // locked until the X server sends an IdleNotify
+	struct wl_list link; // wlr_x11_output::buffers
+};
 
 struct wlr_x11_output {
 	struct wlr_output wlr_output;
@@ -31,10 +44,31 @@ struct wlr_x11_output {
 	struct wlr_pointer pointer;
 	struct wlr_input_device pointer_dev;
 
+	// Only used if the Present extension is unavailable
 	struct wl_event_source *frame_timer;
 	int frame_delay;
 
+	xcb_present_event_t present_event_id;
+	bool msc_notify_pending; // waiting for the next vertical blank
+	bool present_pending; // a buffer has been swapped since the last one
+	uint64_t last_msc, last_ust;
+
+	// Only used if buffers are presented with DRI3
+	struct gbm_surface *gbm_surface;
+	int gbm_width, gbm_height;
+	struct wl_list buffers; // wlr_x11_buffer::link
+	uint32_t present_serial;
+	bool buffers_exhausted; // a frame was skipped for lack of free buffers
+
 	bool cursor_hidden;
+
+	// Hardware cursor, set as the cursor of the window. The X server moves it
+	// along with the host pointer.
+	struct {
+		xcb_cursor_t xid; // XCB_NONE if not set, cursors are drawn in software
+		uint32_t *pixels; // ARGB8888, NULL if the cursor is hidden
+		int width, height;
+	} cursor;
 };
 
 struct wlr_x11_backend {
@@ -68,6 +102,13 @@ struct wlr_x11_backend {
 	xcb_timestamp_t time;
 
 	uint8_t xinput_opcode;
+	uint8_t present_opcode; // zero if the Present extension is unavailable
+	// Format of cursor pictures, XCB_NONE if cursors are drawn in software
+	xcb_render_pictformat_t argb32;
+
+	// Only set if buffers are allocated with GBM and presented with DRI3
+	struct gbm_device *gbm;
+	int drm_fd;
 
 	struct wl_listener display_destroy;
 };
@@ -88,5 +129,7 @@ void update_x11_pointer_position(struct wlr_x11_output *output,
 
 void handle_x11_configure_notify(struct wlr_x11_output *output,
 	xcb_configure_notify_event_t *event);
+void handle_x11_present_event(struct wlr_x11_backend *x11,
+	xcb_ge_generic_event_t *event);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef RENDER_GBM_ALLOCATOR_H
+#define RENDER_GBM_ALLOCATOR_H
+
+#include <gbm.h>
+#include <stdbool.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/dmabuf.h>
+
+struct wlr_gbm_allocator {
+	struct wlr_allocator base;
+
+	int fd;
+	struct gbm_device *gbm;
+};
+
+struct wlr_gbm_buffer {
+	struct wlr_allocator_buffer base;
+
+	struct gbm_bo *bo;
+};
+
+/**
+ * Exports a GBM buffer as DMA-BUF. The attributes own new file descriptors,
+ * which must be closed with wlr_dmabuf_attributes_finish.
+ */
+bool export_gbm_bo(struct gbm_bo *bo, struct wlr_dmabuf_attributes *attribs);
+
+#endif
@@ -21,6 +21,10 @@ struct wlr_gles2_pixel_format {
 	GLint gl_format, gl_type;
 	int depth, bpp;
 	bool has_alpha;
+	// Set if the wl_shm memory layout differs from gl_format and gl_type:
+	// converts a row of pixels before uploads and after read-backs. Both
+	// layouts have the same size, dst and src may be the same.
+	void (*convert)(void *dst, const void *src, uint32_t width);
 };
 
 struct wlr_gles2_tex_shader {
@@ -29,6 +33,55 @@ struct wlr_gles2_tex_shader {
 	GLint invert_y;
 	GLint tex;
 	GLint alpha;
+	// Only used by the YUV shaders, which sample the chroma planes from
+	// further texture units
+	GLint tex_chroma[2];
+	GLint yuv_matrix, yuv_offset;
+};
+
+struct wlr_gles2_texture;
+
+// Small textures are sub-allocated from shared pages of this size, see
+// texture.c
+#define WLR_GLES2_ATLAS_PAGE_SIZE 1024
+#define WLR_GLES2_ATLAS_MAX_TEXTURE_SIZE 128
+
+// A row of textures with the same height in an atlas page
+struct wlr_gles2_atlas_shelf {
+	struct wl_list link; // wlr_gles2_atlas_page::shelves
+	int y, height;
+	int next_x;
+	size_t entries;
+};
+
+struct wlr_gles2_atlas_page {
+	struct wlr_gles2_renderer *renderer; // NULL once the renderer is destroyed
+	struct wl_list link; // wlr_gles2_renderer::atlas_pages
+
+	const struct wlr_gles2_pixel_format *fmt;
+	GLuint gl_tex;
+
+	struct wl_list shelves; // wlr_gles2_atlas_shelf::link
+	int next_y;
+	size_t entries;
+};
+
+// Number of pixel unpack buffers used in turn for texture uploads, and the
+// minimum upload size in bytes for which they are used
+#define WLR_GLES2_UPLOAD_RING_LEN 4
+#define WLR_GLES2_UPLOAD_MIN_SIZE (64 * 1024)
+
+// Maximum number of textured quads drawn at once, see gles2_flush_batch
+#define WLR_GLES2_BATCH_LEN 64
+
+struct wlr_gles2_offscreen {
+	GLuint fbo, tex;
+	EGLImageKHR image; // NULL if tex is allocated by the renderer
+	// Set if tex belongs to this texture, see gles2_bind_texture
+	struct wlr_gles2_texture *texture;
+	// Viewport in use when the framebuffer was bound, restored on unbind
+	uint32_t saved_viewport_width, saved_viewport_height;
+	uint32_t saved_framebuffer_width, saved_framebuffer_height;
 };
 
 struct wlr_gles2_renderer {
@@ -41,8 +94,30 @@ struct wlr_gles2_renderer {
 		bool read_format_bgra_ext;
 		bool debug_khr;
 		bool egl_image_external_oes;
+		bool get_program_binary_oes;
+		bool pixel_buffer_object;
+		bool disjoint_timer_query_ext;
+		bool pack_subimage;
 	} exts;
 
+	// Where linked programs are cached, NULL if disabled
+	char *program_cache_dir;
+	// Program binaries are written from there, NULL before init_wl_display
+	struct wlr_work_queue *work_queue;
+	struct wl_listener work_queue_destroy;
+	// Binaries of the programs linked before init_wl_display
+	struct wl_list program_writes; // program_write::link
+
+	struct wl_list atlas_pages; // wlr_gles2_atlas_page::link
+
+	// Pixel unpack buffers for shm uploads, only if the pixel_buffer_object
+	// extension is available
+	struct {
+		GLuint pbos[WLR_GLES2_UPLOAD_RING_LEN];
+		size_t sizes[WLR_GLES2_UPLOAD_RING_LEN];
+		size_t idx;
+	} upload_ring;
+
 	struct {
 		struct {
 			GLuint program;
@@ -57,9 +132,51 @@ struct wlr_gles2_renderer {
 		struct wlr_gles2_tex_shader tex_rgba;
 		struct wlr_gles2_tex_shader tex_rgbx;
 		struct wlr_gles2_tex_shader tex_ext;
+		// Variants for opaque textures drawn with an alpha of 1, which don't
+		// need blending
+		struct wlr_gles2_tex_shader tex_opaque;
+		struct wlr_gles2_tex_shader tex_ext_opaque;
+		// Convert multi-planar YUV textures to RGB
+		struct wlr_gles2_tex_shader tex_nv12;
+		struct wlr_gles2_tex_shader tex_yuv420;
 	} shaders;
 
 	uint32_t viewport_width, viewport_height;
+	// Size of the bound framebuffer, smaller than the viewport when a texture
+	// is rendered at a reduced resolution
+	uint32_t framebuffer_width, framebuffer_height;
+	// Whether the debug group spanning gles2_begin to gles2_end is open
+	bool frame_marker;
+	struct wlr_gles2_render_timer *running_timer;
+
+	struct {
+		bool enabled;
+		struct wlr_box box;
+	} scissor;
+
+	// Framebuffer bound by gles2_bind_offscreen or gles2_bind_texture, fbo is
+	// 0 if none
+	struct wlr_gles2_offscreen offscreen;
+	// Framebuffer a texture has been bound on top of, bound again when the
+	// texture is unbound
+	struct wlr_gles2_offscreen offscreen_below;
+
+	// Consecutive textured quads sharing the same GL texture, shader, alpha
+	// and filtering, two triangles each. Vertices are already transformed to
+	// clip space. Textures from the same atlas page share a batch.
+	struct {
+		struct wlr_gles2_texture *texture; // first texture, NULL if empty
+		GLuint tex_id;
+		struct wlr_gles2_tex_shader *shader;
+		GLenum target;
+		float alpha;
+		// Quads are drawn pixel for pixel, sample without filtering
+		bool nearest;
+		size_t len;
+		GLfloat verts[WLR_GLES2_BATCH_LEN * 6 * 2];
+		GLfloat texcoords[WLR_GLES2_BATCH_LEN * 6 * 2];
+		struct wl_listener texture_destroy;
+	} batch;
 };
 
 enum wlr_gles2_texture_type {
@@ -67,36 +184,112 @@ enum wlr_gles2_texture_type {
 	WLR_GLES2_TEXTURE_WL_DRM_GL,
 	WLR_GLES2_TEXTURE_WL_DRM_EXT,
 	WLR_GLES2_TEXTURE_DMABUF,
+	WLR_GLES2_TEXTURE_DMABUF_YUV,
 };
 
+// Maximum number of planes of a YUV DMA-BUF imported plane by plane
+#define WLR_GLES2_YUV_MAX_PLANES 3
+
 struct wlr_gles2_texture {
 	struct wlr_texture wlr_texture;
 
 	struct wlr_egl *egl;
+	// Set if created by the renderer, only used for uploads
+	struct wlr_gles2_renderer *renderer;
 	enum wlr_gles2_texture_type type;
 	int width, height;
 	bool has_alpha;
 	enum wl_shm_format wl_format; // used to interpret upload data
 	bool inverted_y;
 
-	// Not set if WLR_GLES2_TEXTURE_GLTEX
+	// Not set if WLR_GLES2_TEXTURE_GLTEX or WLR_GLES2_TEXTURE_DMABUF_YUV
 	EGLImageKHR image;
 	GLuint image_tex;
 
+	// Set if WLR_GLES2_TEXTURE_DMABUF_YUV: each plane is imported as a
+	// single-channel or two-channel image, sampled at the same texture
+	// coordinates and converted to RGB by the shader
+	struct {
+		size_t n_planes; // 2 if the chroma samples are interleaved
+		EGLImageKHR images[WLR_GLES2_YUV_MAX_PLANES];
+		GLuint texs[WLR_GLES2_YUV_MAX_PLANES];
+		enum wlr_gles2_yuv_encoding encoding;
+		bool full_range;
+	} yuv;
+
+	// Set if the texture is sub-allocated from an atlas page, in which case
+	// gl_tex is the page's texture. The position excludes the one pixel
+	// border replicating the texture's edges.
+	struct wlr_gles2_atlas_page *atlas_page;
+	struct wlr_gles2_atlas_shelf *atlas_shelf;
+	int atlas_x, atlas_y;
+
 	union {
 		GLuint gl_tex;
 		struct wl_resource *wl_drm;
 	};
 };
 
+struct wlr_gles2_readback {
+	struct wlr_renderer_readback wlr_readback;
+
+	struct wlr_gles2_renderer *renderer;
+	const struct wlr_gles2_pixel_format *fmt;
+
+	// Pixels are packed tightly and bottom-up, either in a pixel buffer
+	// object or in client memory if PBOs aren't supported
+	GLuint pbo;
+	void *data;
+};
+
+struct wlr_gles2_render_timer {
+	struct wlr_render_timer wlr_timer;
+
+	struct wlr_gles2_renderer *renderer;
+	GLuint query;
+	bool running, ended;
+	bool interrupted; // stopped by another timer
+};
+
 const struct wlr_gles2_pixel_format *get_gles2_format_from_wl(
 	enum wl_shm_format fmt);
 const struct wlr_gles2_pixel_format *get_gles2_format_from_gl(
 	GLint gl_format, GLint gl_type, bool alpha);
 const enum wl_shm_format *get_gles2_wl_formats(size_t *len);
+// Returns a format reading pixels as RGBA and converting them to fmt, for
+// when BGRA can't be read directly
+const struct wlr_gles2_pixel_format *get_gles2_swizzled_read_format(
+	enum wl_shm_format fmt);
+// Converts a rectangle of pixels into a newly allocated, tightly packed
+// buffer. fmt->convert must be set.
+void *gles2_convert_pixels(const struct wlr_gles2_pixel_format *fmt,
+	uint32_t stride, uint32_t width, uint32_t height, uint32_t src_x,
+	uint32_t src_y, const void *data);
 
 struct wlr_gles2_texture *gles2_get_texture(
 	struct wlr_texture *wlr_texture);
+// Returns NULL if the texture isn't suitable for the atlas
+struct wlr_texture *gles2_atlas_texture_from_pixels(
+	struct wlr_gles2_renderer *renderer, enum wl_shm_format wl_fmt,
+	uint32_t stride, uint32_t width, uint32_t height, const void *data);
+void gles2_atlas_finish(struct wlr_gles2_renderer *renderer);
+
+// Draws the pending textured quads
+void gles2_flush_batch(struct wlr_gles2_renderer *renderer);
+
+// Returns the directory to cache program binaries in, creating it if needed
+char *gles2_get_program_cache_dir(void);
+// Writes program binaries from the work queue of the display, including those
+// of the programs linked so far
+void gles2_init_program_cache(struct wlr_gles2_renderer *renderer,
+	struct wl_display *display);
+// Writes the binaries which haven't been queued yet
+void gles2_finish_program_cache(struct wlr_gles2_renderer *renderer);
+// Returns 0 if the program isn't cached
+GLuint gles2_load_program_binary(struct wlr_gles2_renderer *renderer,
+	const GLchar *vert_src, const GLchar *frag_src);
+void gles2_save_program_binary(struct wlr_gles2_renderer *renderer,
+	GLuint prog, const GLchar *vert_src, const GLchar *frag_src);
 
 void push_gles2_marker(const char *file, const char *func);
 void pop_gles2_marker(void);
@@ -0,0 +1,43 @@
+#ifndef RENDER_PIXMAN_H
+#define RENDER_PIXMAN_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+
+struct wlr_pixman_pixel_format {
+	enum wl_shm_format wl_format;
+	pixman_format_code_t pixman_format;
+	int bpp;
+	bool has_alpha;
+};
+
+struct wlr_pixman_renderer {
+	struct wlr_renderer wlr_renderer;
+
+	pixman_image_t *image; // bound render target, NULL if none
+	uint32_t width, height;
+};
+
+struct wlr_pixman_texture {
+	struct wlr_texture wlr_texture;
+
+	const struct wlr_pixman_pixel_format *fmt;
+	pixman_image_t *image;
+};
+
+const struct wlr_pixman_pixel_format *get_pixman_format_from_wl(
+	enum wl_shm_format fmt);
+const struct wlr_pixman_pixel_format *get_pixman_format_from_pixman(
+	pixman_format_code_t fmt);
+const enum wl_shm_format *get_pixman_wl_formats(size_t *len);
+
+struct wlr_pixman_texture *pixman_get_texture(struct wlr_texture *wlr_texture);
+struct wlr_texture *pixman_texture_from_pixels(enum wl_shm_format wl_fmt,
+	uint32_t stride, uint32_t width, uint32_t height, const void *data);
+
+#endif
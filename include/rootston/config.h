@@ -19,6 +19,18 @@ struct roots_output_config {
 	enum wl_output_transform transform;
 	int x, y;
 	float scale;
+	bool adaptive_sync;
+	int depth; // 0 for the backend's default
+	int damage_tile_size;
+	// Lower the refresh rate after this many msec without damage, 0 disables
+	int idle_refresh_timeout;
+	char *mirror; // name of the output to mirror
+	// Offer the output to DRM lease clients instead of using it
+	bool lease;
+	// Render at a lower resolution when frames take too long
+	bool dynamic_resolution;
+	// Let fullscreen views which opted in tear, see wlr_output_set_tearing
+	bool tearing;
 	struct wl_list link;
 	struct {
 		int width, height;
@@ -38,9 +50,10 @@ struct roots_device_config {
 
 struct roots_binding_config {
 	uint32_t modifiers;
-	xkb_keysym_t *keysyms;
+	xkb_keysym_t *keysyms; // sorted once the config is loaded
 	size_t keysyms_len;
 	char *command;
+	uint32_t hash;
 	struct wl_list link;
 };
 
@@ -77,10 +90,36 @@ struct roots_switch_config {
 struct roots_config {
 	bool xwayland;
 	bool xwayland_lazy;
+	// Start lazy Xwayland once the first frame has been presented
+	bool xwayland_prewarm;
+	// Frame rate of surfaces hidden behind opaque content, 0 if unthrottled
+	int hidden_frame_rate;
+	// Frame rate of views which aren't focused, 0 if unthrottled
+	int unfocused_frame_rate;
+	// Send pointer motion at most once per output refresh
+	bool coalesce_pointer_motion;
+	// Log input-to-present latencies when outputs are destroyed
+	bool track_input_latency;
+	// Move the default seat's hardware cursor from the libinput thread
+	bool cursor_fast_path;
+	// Copy the pixels of a moved opaque view instead of repainting it
+	bool blit_moved_views;
+	// Evict textures of surfaces not rendered for this many seconds, 0 to
+	// keep them
+	int texture_eviction_timeout;
+	// Render time budget in milliseconds, over which rendering is made
+	// cheaper, 0 if disabled
+	int render_budget;
+	// Match the refresh rate of outputs to their fullscreen content
+	bool auto_refresh_rate;
 
 	struct wl_list outputs;
 	struct wl_list devices;
 	struct wl_list bindings;
+	// Open-addressing hash table of the bindings, keyed by modifiers and
+	// keysym set, see roots_config_get_binding
+	struct roots_binding_config **binding_table;
+	size_t binding_table_len; // power of two
 	struct wl_list keyboards;
 	struct wl_list cursors;
 	struct wl_list switches;
@@ -88,6 +127,12 @@ struct roots_config {
 	char *config_path;
 	char *startup_cmd;
 	bool debug_damage_tracking;
+	bool debug_damage_heatmap;
+	char *input_record_path;
+	char *input_replay_path;
+	double input_replay_speed;
+	char *protocol_record_path;
+	bool protocol_record_buffers;
 };
 
 /**
@@ -130,4 +175,13 @@ struct roots_keyboard_config *roots_config_get_keyboard(
 struct roots_cursor_config *roots_config_get_cursor(struct roots_config *config,
 	const char *seat_name);
 
+/**
+ * Get the binding triggered by the pressed keysyms, an array of
+ * ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP keysyms where unused slots are
+ * XKB_KEY_NoSymbol. Returns NULL if there's none.
+ */
+struct roots_binding_config *roots_config_get_binding(
+	struct roots_config *config, uint32_t modifiers,
+	const xkb_keysym_t *pressed_keysyms);
+
 #endif
@@ -1,7 +1,10 @@
 #ifndef ROOTSTON_CURSOR_H
 #define ROOTSTON_CURSOR_H
 
+#include <pthread.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/util/region.h>
 #include "rootston/seat.h"
 
 enum roots_cursor_mode {
@@ -17,6 +20,8 @@ struct roots_cursor {
 
 	struct wlr_pointer_constraint_v1 *active_constraint;
 	pixman_region32_t confine; // invalid if active_constraint == NULL
+	// Index of the confine region, queried on each motion event
+	struct wlr_region_index confine_index;
 
 	const char *default_xcursor;
 
@@ -30,10 +35,26 @@ struct roots_cursor {
 	int view_x, view_y, view_width, view_height;
 	float view_rotation;
 	uint32_t resize_edges;
+	// Pointer motion to apply to the grabbed view on the next output frame
+	bool grab_pending;
 
 	struct roots_seat_view *pointer_view;
 	struct wlr_surface *wlr_surface;
 
+	// Moves the hardware cursor from the libinput thread, see
+	// roots_cursor_init_fast_path
+	bool fast_path_enabled;
+	struct {
+		pthread_mutex_t lock;
+		struct wlr_output *output; // NULL if disabled
+		struct wlr_box box;
+		float scale;
+		double x, y;
+		// Motion of mapped devices is left to the main loop
+		bool cursor_mapped;
+		struct wl_array mapped_devices; // struct libinput_device *
+	} fast_path;
+
 	struct wl_listener motion;
 	struct wl_listener motion_absolute;
 	struct wl_listener button;
@@ -49,6 +70,7 @@ struct roots_cursor {
 	struct wl_listener touch_down;
 	struct wl_listener touch_up;
 	struct wl_listener touch_motion;
+	struct wl_listener touch_frame;
 
 	struct wl_listener tool_axis;
 	struct wl_listener tool_tip;
@@ -60,12 +82,27 @@ struct roots_cursor {
 	struct wl_listener focus_change;
 
 	struct wl_listener constraint_commit;
+
+	struct wl_listener layout_change;
 };
 
 struct roots_cursor *roots_cursor_create(struct roots_seat *seat);
 
 void roots_cursor_destroy(struct roots_cursor *cursor);
 
+/**
+ * Lets the libinput thread move the hardware cursor directly on relative
+ * pointer motion, so that it stays responsive while the main loop is busy. The
+ * cursor position is corrected by the main loop once it handles the events.
+ */
+void roots_cursor_init_fast_path(struct roots_cursor *cursor);
+
+/**
+ * Updates the devices whose motion the fast path skips, must be called when
+ * pointers or their mappings change.
+ */
+void roots_cursor_update_fast_path_devices(struct roots_cursor *cursor);
+
 void roots_cursor_handle_motion(struct roots_cursor *cursor,
 	struct wlr_event_pointer_motion *event);
 
@@ -89,6 +126,8 @@ void roots_cursor_handle_touch_up(struct roots_cursor *cursor,
 void roots_cursor_handle_touch_motion(struct roots_cursor *cursor,
 	struct wlr_event_touch_motion *event);
 
+void roots_cursor_handle_touch_frame(struct roots_cursor *cursor);
+
 void roots_cursor_handle_tool_axis(struct roots_cursor *cursor,
 	struct wlr_event_tablet_tool_axis *event);
 
@@ -105,6 +144,11 @@ void roots_cursor_handle_constraint_commit(struct roots_cursor *cursor);
 
 void roots_cursor_update_position(struct roots_cursor *cursor,
 	uint32_t time);
+/**
+ * Moves, resizes or rotates the grabbed view according to the pointer motion
+ * since it was last applied. Called once per output frame.
+ */
+void roots_cursor_apply_grab(struct roots_cursor *cursor);
 
 void roots_cursor_update_focus(struct roots_cursor *cursor);
 
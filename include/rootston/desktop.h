@@ -4,14 +4,17 @@
 #include <wayland-server.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_drm_lease_v1.h>
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_gamma_control.h>
 #include <wlr/types/wlr_idle_inhibit_v1.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_input_inhibitor.h>
+#include <wlr/types/wlr_input_latency.h>
 #include <wlr/types/wlr_input_method_v2.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_list.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output.h>
@@ -21,19 +24,24 @@
 #include <wlr/types/wlr_relative_pointer_v1.h>
 #include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_screenshooter.h>
+#include <wlr/types/wlr_spatial_index.h>
 #include <wlr/types/wlr_text_input_v3.h>
+#include <wlr/types/wlr_viewporter.h>
 #include <wlr/types/wlr_virtual_keyboard_v1.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/work_queue.h>
 #include "rootston/config.h"
 #include "rootston/output.h"
 #include "rootston/view.h"
 
 struct roots_desktop {
 	struct wl_list views; // roots_view::link
+	// Input bounds of mapped views, may be NULL
+	struct wlr_spatial_index *view_index; // roots_view::index_entry
 
 	struct wl_list outputs; // roots_output::link
 	struct timespec last_frame;
@@ -50,6 +58,7 @@ struct roots_desktop {
 	struct wlr_xdg_shell *xdg_shell;
 	struct wlr_gamma_control_manager *gamma_control_manager;
 	struct wlr_gamma_control_manager_v1 *gamma_control_manager_v1;
+	struct wlr_drm_lease_v1_manager *drm_lease_manager; // may be NULL
 	struct wlr_screenshooter *screenshooter;
 	struct wlr_export_dmabuf_manager_v1 *export_dmabuf_manager_v1;
 	struct wlr_server_decoration_manager *server_decoration_manager;
@@ -69,6 +78,10 @@ struct roots_desktop {
 	struct wlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager_v1;
 	struct wlr_relative_pointer_manager_v1 *relative_pointer_manager;
 	struct wlr_pointer_gestures_v1 *pointer_gestures;
+	struct wlr_viewporter *viewporter;
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf; // created by the renderer
+	struct wlr_input_latency_tracker *input_latency; // may be NULL
+	struct wlr_work_queue *work_queue; // may be NULL
 
 	struct wl_listener new_output;
 	struct wl_listener layout_change;
@@ -81,10 +94,14 @@ struct roots_desktop {
 	struct wl_listener input_inhibit_deactivate;
 	struct wl_listener virtual_keyboard_new;
 	struct wl_listener pointer_constraint;
+	struct wl_listener drm_lease_request;
 
 #if WLR_HAS_XWAYLAND
 	struct wlr_xwayland *xwayland;
 	struct wl_listener xwayland_surface;
+	struct wl_listener xwayland_ready;
+	const char *xwayland_cursor;
+	bool xwayland_prewarm; // start xwayland after the next presented frame
 #endif
 };
 
@@ -4,6 +4,7 @@
 #include <wayland-server.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_input_recorder.h>
 #include <wlr/types/wlr_seat.h>
 #include "rootston/config.h"
 #include "rootston/cursor.h"
@@ -17,6 +18,13 @@ struct roots_input {
 	struct wl_listener new_input;
 
 	struct wl_list seats; // roots_seat::link
+
+	FILE *record_file;
+	struct wlr_input_recorder *recorder; // NULL if input isn't recorded
+
+	// Flushes the pointer motion of all seats once per event loop iteration
+	struct wl_event_source *motion_idle;
+	unsigned int motion_round; // rotates the seat flushed first
 };
 
 struct roots_input *input_create(struct roots_server *server,
@@ -34,4 +42,6 @@ struct roots_seat *input_last_active_seat(struct roots_input *input);
 
 void input_update_cursor_focus(struct roots_input *input);
 
+void input_schedule_motion_flush(struct roots_input *input);
+
 #endif
@@ -3,30 +3,74 @@
 #include <pixman.h>
 #include <time.h>
 #include <wayland-server.h>
+#include <wlr/render/pass.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_output_content_rate.h>
 #include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output_mirror.h>
 
 struct roots_desktop;
 
+/**
+ * A view moved since the last frame. If the last frame is still in the back
+ * buffer, its pixels are copied to the new position instead of repainting
+ * them, see the blit-moved-views option.
+ */
+struct roots_output_move {
+	struct roots_view *view; // NULL if no view moved
+	struct wlr_box src; // opaque box of the view in the last frame
+	bool moving; // set while the move damages the output
+	bool invalid; // the last frame can't be reused
+	pixman_region32_t damage; // added while moving
+	pixman_region32_t other_damage; // added by anything else
+};
+
 struct roots_output {
 	struct roots_desktop *desktop;
 	struct wlr_output *wlr_output;
 	struct wl_list link; // roots_desktop:outputs
 
 	struct roots_view *fullscreen_view;
+	// Views intersecting the output, in the same order as
+	// roots_desktop::views
+	struct wl_list views; // roots_view_output::output_link
 	struct wl_list layers[4]; // layer_surface::link
+	struct roots_output_move move;
 
 	struct timespec last_frame;
 	struct wlr_output_damage *damage;
+	// Records the draws of each frame, see output_render
+	struct wlr_render_pass *pass;
+	// Wakes up hidden surfaces whose frame done events have been throttled
+	struct wl_event_source *hidden_frame_timer;
 
 	struct wlr_box usable_area;
 
+	// Set while this output displays the content of another one
+	struct wlr_output_mirror *mirror;
+	// Matches the refresh rate to the fullscreen view, NULL if disabled
+	struct wlr_output_content_rate *content_rate;
+
+	// See the tearing option
+	bool allow_tearing;
+
+	// See the dynamic-resolution option
+	struct {
+		bool enabled;
+		float scale; // of the rendering resolution, 1 for the output's
+		// Holds the last frame at the reduced resolution, NULL if unused
+		struct wlr_texture *texture;
+		int slow_frames, fast_frames; // in a row
+	} dynamic_res;
+
 	struct wl_listener destroy;
 	struct wl_listener mode;
 	struct wl_listener transform;
 	struct wl_listener present;
+	struct wl_listener frame_stats;
 	struct wl_listener damage_frame;
 	struct wl_listener damage_destroy;
+	struct wl_listener mirror_destroy;
 };
 
 typedef void (*roots_surface_iterator_func_t)(struct roots_output *output,
@@ -65,9 +109,22 @@ struct roots_view;
 struct roots_drag_icon;
 
 void output_damage_whole(struct roots_output *output);
+/**
+ * Damages the surfaces of the view, but not its decoration.
+ */
 void output_damage_whole_view(struct roots_output *output,
 	struct roots_view *view);
-void output_damage_from_view(struct roots_output *output,
+/**
+ * Damages the decoration of the view on all outputs, only if it moved or its
+ * appearance changed since it was last damaged. `visible` is false if the
+ * view is being unmapped.
+ */
+void desktop_damage_view_decoration(struct roots_desktop *desktop,
+	struct roots_view *view, bool visible);
+/**
+ * Damages all outputs with the damage of the view's last commits.
+ */
+void desktop_damage_from_view(struct roots_desktop *desktop,
 	struct roots_view *view);
 void output_damage_whole_drag_icon(struct roots_output *output,
 	struct roots_drag_icon *icon);
@@ -76,7 +133,20 @@ void output_damage_from_local_surface(struct roots_output *output,
 void output_damage_whole_local_surface(struct roots_output *output,
 	struct wlr_surface *surface, double ox, double oy);
 
+void output_begin_view_move(struct roots_output *output,
+	struct roots_view *view);
+void output_end_view_move(struct roots_output *output);
+void output_cancel_view_move(struct roots_output *output,
+	struct roots_view *view);
+void output_reset_view_move(struct roots_output *output, bool invalid);
+bool output_get_view_opaque_box(struct roots_output *output,
+	struct roots_view *view, struct wlr_box *box);
+
 void output_render(struct roots_output *output);
+/**
+ * Must be called when the output's fullscreen view changes or is mapped.
+ */
+void output_update_content_rate(struct roots_output *output);
 
 void scale_box(struct wlr_box *box, float scale);
 void get_decoration_box(struct roots_view *view,
@@ -2,12 +2,19 @@
 #define ROOTSTON_SEAT_H
 
 #include <wayland-server.h>
+#include <wlr/types/wlr_pointer.h>
 #include "rootston/input.h"
 #include "rootston/keyboard.h"
 #include "rootston/layers.h"
 #include "rootston/switch.h"
 #include "rootston/text_input.h"
 
+enum roots_seat_motion_type {
+	ROOTS_SEAT_MOTION_NONE,
+	ROOTS_SEAT_MOTION_RELATIVE,
+	ROOTS_SEAT_MOTION_ABSOLUTE,
+};
+
 struct roots_seat {
 	struct roots_input *input;
 	struct wlr_seat *seat;
@@ -31,6 +38,15 @@ struct roots_seat {
 
 	struct roots_drag_icon *drag_icon; // can be NULL
 
+	// Pointer motion coalesced until the seats are flushed, see
+	// input_schedule_motion_flush
+	struct {
+		enum roots_seat_motion_type type;
+		struct wlr_event_pointer_motion relative; // deltas are accumulated
+		struct wlr_event_pointer_motion_absolute absolute; // last event
+		bool frame; // a frame event follows the motion
+	} pending_motion;
+
 	struct wl_list keyboards;
 	struct wl_list pointers;
 	struct wl_list switches;
@@ -140,6 +156,12 @@ struct roots_seat *roots_seat_create(struct roots_input *input, char *name);
 
 void roots_seat_destroy(struct roots_seat *seat);
 
+/**
+ * Processes the pointer motion coalesced since the last flush. Events which
+ * depend on the pointer position call it first.
+ */
+void roots_seat_flush_motion(struct roots_seat *seat);
+
 void roots_seat_add_device(struct roots_seat *seat,
 		struct wlr_input_device *device);
 
@@ -50,6 +50,8 @@ struct roots_view {
 
 	bool maximized;
 	struct roots_output *fullscreen_output;
+	// Opted in to tearing while fullscreen, see the toggle_tearing binding
+	bool allow_tearing;
 	struct {
 		double x, y;
 		uint32_t width, height;
@@ -64,6 +66,14 @@ struct roots_view {
 
 	struct wlr_surface *wlr_surface;
 	struct wl_list children; // roots_view_child::link
+	// Entry in roots_desktop::view_index, NULL if unmapped
+	struct wlr_spatial_index_entry *index_entry;
+	// Outputs intersecting the view's bounds
+	struct wl_list outputs; // roots_view_output::view_link
+	// Sends the surface enter and leave events, NULL until set up
+	struct wlr_output_layout_surface *layout_surface;
+	struct wl_listener layout_surface_output_enter;
+	struct wl_listener layout_surface_output_leave;
 
 	struct wlr_foreign_toplevel_handle_v1 *toplevel_handle;
 	struct wl_listener toplevel_handle_request_maximize;
@@ -72,6 +82,24 @@ struct roots_view {
 
 	struct wl_listener new_subsurface;
 
+	// Composition of the view's surfaces, drawn as a single quad once none of
+	// them has committed for a while, see render.c
+	struct {
+		struct wlr_texture *texture; // NULL if not cached
+		struct wlr_box box; // view-local
+		float scale; // of the output it was rendered for
+		int idle_frames; // frames rendered since the surfaces last changed
+	} cache;
+
+	// Decoration as it was last damaged, see desktop_damage_view_decoration
+	struct {
+		bool visible;
+		bool stale; // the view was raised since
+		double x, y; // layout coordinates
+		int width, height;
+		float rotation, alpha;
+	} deco_damage;
+
 	struct {
 		struct wl_signal unmap;
 		struct wl_signal destroy;
@@ -213,6 +241,14 @@ struct roots_xdg_popup {
 	struct wl_listener new_popup;
 };
 
+// Links a view to an output its bounds intersect
+struct roots_view_output {
+	struct roots_view *view;
+	struct roots_output *output;
+	struct wl_list view_link; // roots_view::outputs
+	struct wl_list output_link; // roots_output::views
+};
+
 struct roots_xdg_toplevel_decoration {
 	struct wlr_xdg_toplevel_decoration_v1 *wlr_decoration;
 	struct roots_xdg_surface *surface;
@@ -229,6 +265,10 @@ void view_damage_whole(struct roots_view *view);
 void view_update_position(struct roots_view *view, int x, int y);
 void view_update_size(struct roots_view *view, int width, int height);
 void view_update_decorated(struct roots_view *view, bool decorated);
+void view_update_bounds(struct roots_view *view);
+void view_invalidate_cache(struct roots_view *view);
+void view_raise(struct roots_view *view);
+void view_output_destroy(struct roots_view_output *view_output);
 void view_initial_focus(struct roots_view *view);
 void view_map(struct roots_view *view, struct wlr_surface *surface);
 void view_unmap(struct roots_view *view);
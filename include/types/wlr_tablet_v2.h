@@ -2,6 +2,7 @@
 #define TYPES_WLR_TABLET_V2_H
 
 #include "tablet-unstable-v2-protocol.h"
+#include <time.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_tablet_v2.h>
 
@@ -61,6 +62,24 @@ struct wlr_tablet_pad_client_v2 {
 	struct wl_resource **strips;
 };
 
+enum wlr_tablet_tool_v2_axis {
+	WLR_TABLET_TOOL_V2_AXIS_MOTION = 1 << 0,
+	WLR_TABLET_TOOL_V2_AXIS_PRESSURE = 1 << 1,
+	WLR_TABLET_TOOL_V2_AXIS_DISTANCE = 1 << 2,
+	WLR_TABLET_TOOL_V2_AXIS_TILT = 1 << 3,
+	WLR_TABLET_TOOL_V2_AXIS_ROTATION = 1 << 4,
+	WLR_TABLET_TOOL_V2_AXIS_SLIDER = 1 << 5,
+};
+
+// Axis values in protocol units
+struct wlr_tablet_tool_v2_axes {
+	wl_fixed_t x, y;
+	uint32_t pressure, distance;
+	wl_fixed_t tilt_x, tilt_y;
+	wl_fixed_t rotation;
+	int32_t slider;
+};
+
 struct wlr_tablet_tool_client_v2 {
 	struct wl_list seat_link;
 	struct wl_list tool_link;
@@ -70,6 +89,18 @@ struct wlr_tablet_tool_client_v2 {
 	struct wlr_tablet_seat_client_v2 *seat;
 
 	struct wl_event_source *frame_source;
+
+	// Axis changes are accumulated until the next frame, unless the client
+	// gets them at full rate
+	bool full_rate;
+	uint32_t pending_axes; // enum wlr_tablet_tool_v2_axis
+	struct wlr_tablet_tool_v2_axes pending;
+	uint32_t sent_axes; // enum wlr_tablet_tool_v2_axis, since proximity in
+	struct wlr_tablet_tool_v2_axes sent;
+
+	struct wl_event_source *frame_timer;
+	bool frame_timer_armed;
+	struct timespec last_frame;
 };
 
 struct wlr_tablet_client_v2 *tablet_client_from_resource(struct wl_resource *resource);
@@ -1,7 +1,15 @@
 #ifndef UTIL_SHM_H
 #define UTIL_SHM_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 int create_shm_file(void);
 int allocate_shm_file(size_t size);
+/**
+ * Allocates a shared memory file and opens it twice: once read-write for the
+ * compositor, and once read-only to be shared with clients.
+ */
+bool allocate_shm_file_pair(size_t size, int *rw_fd, int *ro_fd);
 
 #endif
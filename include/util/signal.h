@@ -1,8 +1,35 @@
 #ifndef UTIL_SIGNAL_H
 #define UTIL_SIGNAL_H
 
+#include <stdint.h>
 #include <wayland-server.h>
 
-void wlr_signal_emit_safe(struct wl_signal *signal, void *data);
+// Emission statistics of a wlr_signal_emit_safe call site
+struct wlr_signal_site {
+	const char *file;
+	int line;
+	const char *signal;
+	uint64_t count;
+	struct wlr_signal_site *next; // sites which have emitted at least once
+};
+
+void _wlr_signal_emit_safe(struct wlr_signal_site *site,
+	struct wl_signal *signal, void *data);
+
+/**
+ * Emits a signal. Listeners may remove any listener of the signal, including
+ * themselves, and listeners added during the emission aren't called.
+ *
+ * Each call site counts its emissions. If WLR_SIGNAL_STATS=1, the call sites
+ * which emitted the most are logged on exit.
+ */
+#define wlr_signal_emit_safe(sig, data) do { \
+		static struct wlr_signal_site _wlr_signal_site = { \
+			.file = __FILE__, \
+			.line = __LINE__, \
+			.signal = #sig, \
+		}; \
+		_wlr_signal_emit_safe(&_wlr_signal_site, sig, data); \
+	} while (0)
 
 #endif
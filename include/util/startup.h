@@ -0,0 +1,16 @@
+#ifndef UTIL_STARTUP_H
+#define UTIL_STARTUP_H
+
+/**
+ * Logs at debug level how long after the first mark the given startup stage
+ * completed, and how long it took since the previous mark. Marks are ignored
+ * once the first frame has been presented.
+ */
+void startup_mark(const char *stage);
+
+/**
+ * Marks the first presented frame, which ends the startup timeline.
+ */
+void startup_mark_presented(void);
+
+#endif
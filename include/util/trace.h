@@ -0,0 +1,22 @@
+#ifndef UTIL_TRACE_H
+#define UTIL_TRACE_H
+
+#include "config.h"
+
+/**
+ * Fires a USDT tracepoint of the "wlroots" provider, e.g.
+ * `sdt_wlroots:surface_commit` with perf. Arguments must be integers or
+ * pointers. Objects are identified by their address, so that events relating
+ * to the same surface, output or seat can be matched across subsystems.
+ *
+ * Tracepoints are only built with `-Dtracing=enabled`. Otherwise the
+ * arguments aren't evaluated.
+ */
+#if HAVE_TRACING
+#include <sys/sdt.h>
+#define wlr_trace(...) STAP_PROBEV(wlroots, __VA_ARGS__)
+#else
+#define wlr_trace(...) ((void)0)
+#endif
+
+#endif
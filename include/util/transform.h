@@ -0,0 +1,61 @@
+#ifndef UTIL_TRANSFORM_H
+#define UTIL_TRANSFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+/**
+ * Each output transform swaps the axes or not, then flips each of the
+ * resulting axes or not. The extent of a flipped axis is the size of the
+ * transformed space along it, i.e. the height for x if the axes are swapped.
+ */
+struct transform_axes {
+	bool swap;
+	bool flip_x, flip_y;
+};
+
+static const struct transform_axes transform_axes[] = {
+	[WL_OUTPUT_TRANSFORM_NORMAL] = { false, false, false },
+	[WL_OUTPUT_TRANSFORM_90] = { true, false, true },
+	[WL_OUTPUT_TRANSFORM_180] = { false, true, true },
+	[WL_OUTPUT_TRANSFORM_270] = { true, true, false },
+	[WL_OUTPUT_TRANSFORM_FLIPPED] = { false, true, false },
+	[WL_OUTPUT_TRANSFORM_FLIPPED_90] = { true, true, true },
+	[WL_OUTPUT_TRANSFORM_FLIPPED_180] = { false, false, true },
+	[WL_OUTPUT_TRANSFORM_FLIPPED_270] = { true, false, false },
+};
+
+/**
+ * Transforms a box of a width x height space, a point being a box of size 0.
+ * Flipping maps x to extent - x - size, computed without branches as
+ * flip * (extent - size) + (1 - 2 * flip) * x.
+ */
+static inline void transform_box_coords(int32_t coords[static 4],
+		enum wl_output_transform transform, int32_t width, int32_t height) {
+	const struct transform_axes *t = &transform_axes[transform];
+	int32_t s = t->swap, fx = t->flip_x, fy = t->flip_y;
+	int32_t x = coords[s], y = coords[1 - s];
+	int32_t w = coords[2 + s], h = coords[3 - s];
+	int32_t ext_x = s ? height : width, ext_y = s ? width : height;
+	coords[0] = fx * (ext_x - w) + (1 - 2 * fx) * x;
+	coords[1] = fy * (ext_y - h) + (1 - 2 * fy) * y;
+	coords[2] = w;
+	coords[3] = h;
+}
+
+static inline void transform_fbox_coords(double coords[static 4],
+		enum wl_output_transform transform, double width, double height) {
+	const struct transform_axes *t = &transform_axes[transform];
+	int s = t->swap;
+	double fx = t->flip_x, fy = t->flip_y;
+	double x = coords[s], y = coords[1 - s];
+	double w = coords[2 + s], h = coords[3 - s];
+	double ext_x = s ? height : width, ext_y = s ? width : height;
+	coords[0] = fx * (ext_x - w) + (1 - 2 * fx) * x;
+	coords[1] = fy * (ext_y - h) + (1 - 2 * fy) * y;
+	coords[2] = w;
+	coords[3] = h;
+}
+
+#endif
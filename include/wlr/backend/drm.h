@@ -12,6 +12,7 @@
 #include <wayland-server.h>
 #include <wlr/backend.h>
 #include <wlr/backend/session.h>
+#include <wlr/render/dmabuf.h>
 #include <wlr/types/wlr_output.h>
 
 /**
@@ -34,4 +35,84 @@ bool wlr_output_is_drm(struct wlr_output *output);
 typedef struct _drmModeModeInfo drmModeModeInfo;
 bool wlr_drm_connector_add_mode(struct wlr_output *output, const drmModeModeInfo *mode);
 
+/**
+ * Adds or removes the output from its backend's page-flip group. Buffer swaps
+ * of grouped outputs happening during the same event loop iteration are
+ * submitted in a single atomic commit, so that they are presented together.
+ *
+ * Returns false if grouping isn't supported by the DRM device.
+ */
+bool wlr_drm_connector_set_grouped(struct wlr_output *output, bool grouped);
+
+/**
+ * Sets the highest colour depth of the output's scan-out buffers: 30 for
+ * 10 bits per channel, 24 for 8 bits (the default) or 16 for RGB565. Each
+ * modeset uses the highest depth up to this one that the primary plane
+ * supports and falls back to lower depths if the hardware rejects the mode,
+ * e.g. because the link lacks bandwidth. Takes effect on the next modeset.
+ */
+bool wlr_drm_connector_set_depth(struct wlr_output *output, int depth);
+
+/**
+ * Moves the output's hardware cursor to the given position, in output-local
+ * buffer pixels (the coordinates given to wlr_output_cursor_move multiplied by
+ * the output scale). Unlike wlr_output_cursor_move, this may be called from any
+ * thread and doesn't update the wlr_output_cursor state: the next cursor move
+ * from the main thread overrides it.
+ *
+ * This allows a compositor to move the cursor at the input rate from an input
+ * thread while the main thread is busy. The caller must ensure the output isn't
+ * destroyed concurrently. Returns false if the output has no hardware cursor.
+ */
+bool wlr_drm_connector_move_cursor_async(struct wlr_output *output,
+	int x, int y);
+
+/**
+ * Get the format and modifier pairs the primary plane used by the output can
+ * scan out, as advertised by the plane's IN_FORMATS property. Returns NULL if
+ * the output isn't enabled or if the property isn't supported.
+ */
+const struct wlr_dmabuf_format *wlr_drm_connector_get_scanout_formats(
+	struct wlr_output *output, size_t *len);
+
+/**
+ * Returns the DRM connector ID of the output.
+ */
+uint32_t wlr_drm_connector_get_id(struct wlr_output *output);
+
+/**
+ * A set of DRM resources (connectors, CRTCs and primary planes) handed to
+ * another process. The compositor can't use the leased outputs until the lease
+ * ends.
+ */
+struct wlr_drm_lease {
+	struct wlr_backend *backend;
+	uint32_t lessee_id;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+/**
+ * Leases the given outputs, which must be disabled and belong to the same DRM
+ * backend. Each output gets a free CRTC and primary plane. On success,
+ * `lease_fd` is set to a DRM file descriptor for the lessee, which the caller
+ * owns. Returns NULL on error.
+ */
+struct wlr_drm_lease *wlr_drm_create_lease(struct wlr_output **outputs,
+	size_t n_outputs, int *lease_fd);
+/**
+ * Revokes the lease and gives its outputs back to the compositor. The lease
+ * is destroyed.
+ */
+void wlr_drm_lease_terminate(struct wlr_drm_lease *lease);
+/**
+ * Opens a new file descriptor for the DRM device without DRM master, which can
+ * be given to clients. Returns -1 on error.
+ */
+int wlr_drm_backend_get_non_master_fd(struct wlr_backend *backend);
+
 #endif
@@ -23,9 +23,32 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display,
  * Create a new headless output backed by an in-memory EGL framebuffer. You can
  * read pixels from this framebuffer via wlr_renderer_read_pixels but it is
  * otherwise not displayed.
+ *
+ * If the GLES2 renderer's DRM device can be opened, the framebuffer is a
+ * swapchain of GBM buffers and the last rendered frame can be exported with
+ * wlr_output_export_dmabuf.
  */
 struct wlr_output *wlr_headless_add_output(struct wlr_backend *backend,
 	unsigned int width, unsigned int height);
+enum wlr_headless_output_mode {
+	// Frame events are sent at the output's refresh rate
+	WLR_HEADLESS_OUTPUT_THROTTLED,
+	// The next frame event is sent as soon as the previous buffer swap is done
+	WLR_HEADLESS_OUTPUT_UNTHROTTLED,
+	// Same as unthrottled, but present events report a virtual clock that
+	// advances by one refresh period per frame
+	WLR_HEADLESS_OUTPUT_UNTHROTTLED_VIRTUAL_TIME,
+};
+
+/**
+ * Sets how frame events are paced on a headless output. The unthrottled modes
+ * are meant for benchmarks and tests which render as many frames as possible.
+ *
+ * New outputs are throttled, unless the WLR_HEADLESS_UNTHROTTLED environment
+ * variable is set.
+ */
+void wlr_headless_output_set_mode(struct wlr_output *output,
+	enum wlr_headless_output_mode mode);
 /**
  * Creates a new input device. The caller is responsible for manually raising
  * any event signals on the new input device if it wants to simulate input
@@ -20,6 +20,13 @@ struct wlr_backend_impl {
 	struct wlr_renderer *(*get_renderer)(struct wlr_backend *backend);
 	struct wlr_session *(*get_session)(struct wlr_backend *backend);
 	clockid_t (*get_presentation_clock)(struct wlr_backend *backend);
+	/**
+	 * Optional. Performs the blocking work of start which doesn't touch the
+	 * Wayland display, such as probing devices. It may be called from another
+	 * thread, concurrently with other backends' prepare_start, before start
+	 * is called from the display's thread.
+	 */
+	bool (*prepare_start)(struct wlr_backend *backend);
 };
 
 /**
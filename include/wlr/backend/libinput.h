@@ -17,9 +17,48 @@
 
 struct wlr_backend *wlr_libinput_backend_create(struct wl_display *display,
 		struct wlr_session *session);
-/** Gets the underlying libinput_device handle for the given wlr_input_device */
+/**
+ * Gets the underlying libinput_device handle for the given wlr_input_device.
+ *
+ * If WLR_LIBINPUT_THREAD is set, libinput is dispatched from another thread.
+ * The handle is then only safe to use from input device signal handlers, such
+ * as the backend's new_input signal.
+ */
 struct libinput_device *wlr_libinput_get_device_handle(
 		struct wlr_input_device *dev);
+/**
+ * Enables or disables an input device, e.g. one the compositor doesn't use or
+ * which belongs to another seat. Events of disabled devices are dropped by the
+ * backend without being converted. Once all the devices created for a libinput
+ * device are disabled, libinput is asked to stop sending its events
+ * altogether, and its previous send events mode is restored when one of them
+ * is enabled again.
+ *
+ * Keys and buttons pressed when the device is disabled aren't released.
+ */
+void wlr_libinput_set_device_enabled(struct wlr_input_device *dev,
+		bool enabled);
+
+struct wlr_libinput_motion_event {
+	struct libinput_device *device;
+	uint64_t time_usec;
+	double delta_x, delta_y;
+};
+
+typedef void (*wlr_libinput_motion_handler_t)(
+	const struct wlr_libinput_motion_event *event, void *data);
+
+/**
+ * Sets a function called from the libinput thread for each relative pointer
+ * motion event as soon as it's read, before it's handed to the main loop. The
+ * handler must be thread-safe and must not call into wlroots, except for
+ * functions documented as thread-safe such as
+ * wlr_drm_connector_move_cursor_async. Pass NULL to remove the handler.
+ *
+ * The handler is only called if WLR_LIBINPUT_THREAD is set.
+ */
+void wlr_libinput_backend_set_motion_handler(struct wlr_backend *backend,
+	wlr_libinput_motion_handler_t handler, void *data);
 
 bool wlr_backend_is_libinput(struct wlr_backend *backend);
 bool wlr_input_device_is_libinput(struct wlr_input_device *device);
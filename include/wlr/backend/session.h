@@ -7,11 +7,37 @@
 #include <wayland-server.h>
 
 struct session_impl;
+struct wlr_session;
+
+/**
+ * Called when a file opened with wlr_session_open_file_async is ready. `fd` is
+ * a negative errno value on error.
+ */
+typedef void (*wlr_session_open_func_t)(struct wlr_session *session,
+	int fd, void *data);
+
+struct wlr_session_open_request {
+	struct wlr_session *session;
+	char *path;
+	wlr_session_open_func_t callback;
+	void *data;
+	struct wl_list link; // wlr_session::open_requests
+
+	void *impl_data; // used by the session implementation
+};
+
+struct wlr_device_hotplug_event {
+	struct wlr_session *session;
+	// The connector which changed, 0 if the kernel didn't specify it
+	uint32_t connector_id;
+	// A DRM lease has ended
+	bool lease;
+};
 
 struct wlr_device {
 	int fd;
 	dev_t dev;
-	struct wl_signal signal;
+	struct wl_signal signal; // struct wlr_device_hotplug_event *
 
 	struct wl_list link;
 };
@@ -37,7 +63,9 @@ struct wlr_session {
 	struct wl_event_source *udev_event;
 
 	struct wl_list devices;
+	struct wl_list open_requests; // wlr_session_open_request::link
 
+	struct wl_display *display;
 	struct wl_listener display_destroy;
 
 	struct {
@@ -76,6 +104,25 @@ void wlr_session_destroy(struct wlr_session *session);
  */
 int wlr_session_open_file(struct wlr_session *session, const char *path);
 
+/*
+ * Starts opening the file at path without blocking, the callback is invoked
+ * from the event loop once the file is open. Sessions which can't open files
+ * asynchronously open them from an idle callback. Several requests made in a
+ * row are processed concurrently by the logind session.
+ *
+ * The file must be closed with wlr_session_close_file. Returns NULL on error.
+ */
+struct wlr_session_open_request *wlr_session_open_file_async(
+	struct wlr_session *session, const char *path,
+	wlr_session_open_func_t callback, void *data);
+
+/*
+ * Cancels a pending request made with wlr_session_open_file_async, its
+ * callback won't be invoked. A device which is acquired after the request was
+ * cancelled is released right away.
+ */
+void wlr_session_open_request_cancel(struct wlr_session_open_request *request);
+
 /*
  * Closes a file previously opened with wlr_session_open_file.
  */
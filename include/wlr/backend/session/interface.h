@@ -17,6 +17,19 @@ struct session_impl {
 	int (*open)(struct wlr_session *session, const char *path);
 	void (*close)(struct wlr_session *session, int fd);
 	bool (*change_vt)(struct wlr_session *session, unsigned vt);
+	// Optional, the request must be completed with
+	// wlr_session_open_request_complete unless it's cancelled
+	bool (*open_async)(struct wlr_session *session,
+		struct wlr_session_open_request *request);
+	void (*cancel_open)(struct wlr_session *session,
+		struct wlr_session_open_request *request);
 };
 
+/**
+ * Completes a request started by session_impl::open_async. Takes ownership of
+ * the file descriptor, which is a negative errno value on error.
+ */
+void wlr_session_open_request_complete(
+	struct wlr_session_open_request *request, int fd);
+
 #endif
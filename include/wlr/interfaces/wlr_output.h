@@ -16,6 +16,7 @@
 
 struct wlr_output_impl {
 	bool (*enable)(struct wlr_output *output, bool enable);
+	bool (*set_dpms)(struct wlr_output *output, bool on);
 	bool (*set_mode)(struct wlr_output *output, struct wlr_output_mode *mode);
 	bool (*set_custom_mode)(struct wlr_output *output, int32_t width,
 		int32_t height, int32_t refresh);
@@ -25,15 +26,28 @@ struct wlr_output_impl {
 		int32_t scale, enum wl_output_transform transform,
 		int32_t hotspot_x, int32_t hotspot_y, bool update_texture);
 	bool (*move_cursor)(struct wlr_output *output, int x, int y);
+	/**
+	 * Optional, sets the hardware cursor image from ARGB8888 pixels already
+	 * scaled for the output. Returns false to fall back to set_cursor.
+	 */
+	bool (*set_cursor_pixels)(struct wlr_output *output, const void *data,
+		int32_t stride, uint32_t width, uint32_t height,
+		int32_t hotspot_x, int32_t hotspot_y);
 	void (*destroy)(struct wlr_output *output);
 	bool (*make_current)(struct wlr_output *output, int *buffer_age);
 	bool (*swap_buffers)(struct wlr_output *output, pixman_region32_t *damage);
+	bool (*set_damage_region)(struct wlr_output *output,
+		pixman_region32_t *damage);
 	bool (*set_gamma)(struct wlr_output *output, size_t size,
 		const uint16_t *r, const uint16_t *g, const uint16_t *b);
 	size_t (*get_gamma_size)(struct wlr_output *output);
 	bool (*export_dmabuf)(struct wlr_output *output,
 		struct wlr_dmabuf_attributes *attribs);
 	bool (*schedule_frame)(struct wlr_output *output);
+	bool (*set_adaptive_sync)(struct wlr_output *output, bool enabled);
+	bool (*attach_buffer)(struct wlr_output *output, struct wlr_buffer *buffer);
+	size_t (*assign_overlays)(struct wlr_output *output,
+		struct wlr_output_overlay *overlays, size_t len);
 };
 
 void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
@@ -0,0 +1,54 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_ALLOCATOR_H
+#define WLR_RENDER_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wlr/render/dmabuf.h>
+
+struct wlr_allocator_impl;
+
+/**
+ * Allocates buffers which can be rendered into with
+ * wlr_renderer_bind_offscreen, and scanned out or shared through their
+ * DMA-BUF.
+ */
+struct wlr_allocator {
+	const struct wlr_allocator_impl *impl;
+};
+
+/**
+ * A buffer allocated by a wlr_allocator. The DMA-BUF file descriptors are
+ * owned by the buffer.
+ */
+struct wlr_allocator_buffer {
+	struct wlr_allocator *allocator;
+	struct wlr_dmabuf_attributes dmabuf;
+};
+
+/**
+ * Creates an allocator backed by GBM on the DRM device. On success, the
+ * allocator takes ownership of the file descriptor.
+ */
+struct wlr_allocator *wlr_gbm_allocator_create(int drm_fd);
+void wlr_allocator_destroy(struct wlr_allocator *alloc);
+
+/**
+ * Allocates a buffer with a DRM format. If `modifiers` isn't empty, the
+ * buffer's layout is one of them, it is implementation-defined otherwise.
+ * The format sets the depth, e.g. DRM_FORMAT_XRGB2101010 for 30 bits.
+ * Returns NULL on error.
+ */
+struct wlr_allocator_buffer *wlr_allocator_create_buffer(
+	struct wlr_allocator *alloc, int width, int height, uint32_t format,
+	const uint64_t *modifiers, size_t modifiers_len);
+void wlr_allocator_buffer_destroy(struct wlr_allocator_buffer *buffer);
+
+#endif
@@ -9,6 +9,7 @@
 #ifndef WLR_RENDER_DMABUF_H
 #define WLR_RENDER_DMABUF_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define WLR_DMABUF_MAX_PLANES 4
@@ -31,9 +32,23 @@ struct wlr_dmabuf_attributes {
 	int fd[WLR_DMABUF_MAX_PLANES];
 };
 
+/**
+ * A DRM format and modifier pair.
+ */
+struct wlr_dmabuf_format {
+	uint32_t format;
+	uint64_t modifier;
+};
+
 /**
  * Closes all file descriptors in the DMA-BUF attributes.
  */
 void wlr_dmabuf_attributes_finish(struct wlr_dmabuf_attributes *attribs);
+/**
+ * Copies the DMA-BUF attributes, with duplicated file descriptors. Returns
+ * false on error, dst is left empty then.
+ */
+bool wlr_dmabuf_attributes_copy(struct wlr_dmabuf_attributes *dst,
+	const struct wlr_dmabuf_attributes *src);
 
 #endif
@@ -18,10 +18,28 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <pixman.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <wayland-server.h>
 #include <wlr/render/dmabuf.h>
 
+struct wlr_egl;
+
+/**
+ * A context sharing textures, buffers and images with wlr_egl::context, for
+ * GPU work on other threads, such as uploads or readbacks. It is bound
+ * without a surface, rendering goes to framebuffer objects.
+ */
+struct wlr_egl_context {
+	struct wlr_egl *egl;
+	EGLContext context;
+	bool in_use;
+
+	struct wl_list link; // wlr_egl::context_pool.contexts
+};
+
 struct wlr_egl {
 	EGLenum platform;
 	EGLDisplay display;
@@ -33,15 +51,26 @@ struct wlr_egl {
 	struct {
 		bool bind_wayland_display_wl;
 		bool buffer_age_ext;
+		bool fence_sync_khr;
 		bool image_base_khr;
 		bool image_dma_buf_export_mesa;
 		bool image_dmabuf_import_ext;
 		bool image_dmabuf_import_modifiers_ext;
+		bool native_fence_sync_android;
+		bool partial_update_khr;
+		bool surfaceless_context_khr;
 		bool swap_buffers_with_damage_ext;
 		bool swap_buffers_with_damage_khr;
+		bool wait_sync_khr;
 	} exts;
 
 	struct wl_display *wl_display;
+
+	// Shared contexts, kept around once released
+	struct {
+		pthread_mutex_t lock;
+		struct wl_list contexts; // wlr_egl_context::link
+	} context_pool;
 };
 
 // TODO: Allocate and return a wlr_egl
@@ -54,7 +83,7 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 
 /**
  * Frees all related EGL resources, makes the context not-current and
- * unbinds a bound wayland display.
+ * unbinds a bound wayland display. Shared contexts must have been released.
  */
 void wlr_egl_finish(struct wlr_egl *egl);
 
@@ -71,6 +100,15 @@ bool wlr_egl_bind_display(struct wlr_egl *egl, struct wl_display *local_display)
  */
 EGLSurface wlr_egl_create_surface(struct wlr_egl *egl, void *window);
 
+/**
+ * Like wlr_egl_create_surface, but uses an EGL config whose native visual is
+ * visual_id instead of the one the wlr_egl was created with, e.g. to render
+ * with a different bit depth. Returns EGL_NO_SURFACE if there is no such
+ * config.
+ */
+EGLSurface wlr_egl_create_surface_with_visual(struct wlr_egl *egl,
+	void *window, EGLint visual_id);
+
 /**
  * Creates an EGL image from the given wl_drm buffer resource.
  */
@@ -96,6 +134,12 @@ int wlr_egl_get_dmabuf_formats(struct wlr_egl *egl, int **formats);
 int wlr_egl_get_dmabuf_modifiers(struct wlr_egl *egl, int format,
 	uint64_t **modifiers);
 
+/**
+ * Get the DRM device the EGL display renders with. Returns false if it can't
+ * be determined, e.g. when EGL_EXT_device_drm isn't supported.
+ */
+bool wlr_egl_get_drm_device(struct wlr_egl *egl, dev_t *dev);
+
 bool wlr_egl_export_image_to_dmabuf(struct wlr_egl *egl, EGLImageKHR image,
 	int32_t width, int32_t height, uint32_t flags,
 	struct wlr_dmabuf_attributes *attribs);
@@ -110,9 +154,77 @@ bool wlr_egl_make_current(struct wlr_egl *egl, EGLSurface surface,
 
 bool wlr_egl_is_current(struct wlr_egl *egl);
 
+/**
+ * Takes an idle context sharing objects with the main context from the pool,
+ * creating one if needed. It can then be made current on any one thread, e.g.
+ * for the duration of a frame. This function is thread-safe. Returns NULL if
+ * EGL_KHR_surfaceless_context isn't supported or on error.
+ */
+struct wlr_egl_context *wlr_egl_acquire_context(struct wlr_egl *egl);
+
+/**
+ * Makes the shared context current on the calling thread, without a surface.
+ */
+bool wlr_egl_context_make_current(struct wlr_egl_context *ctx);
+
+/**
+ * Unbinds the shared context if it's current on the calling thread and gives
+ * it back to the pool. It must not be current on another thread, the next
+ * thread acquiring it couldn't make it current. This function is thread-safe.
+ */
+void wlr_egl_release_context(struct wlr_egl_context *ctx);
+
 bool wlr_egl_swap_buffers(struct wlr_egl *egl, EGLSurface surface,
 	pixman_region32_t *damage);
 
+/**
+ * Tells the driver which region of the surface's back buffer is going to be
+ * redrawn, so that it doesn't need to preserve the rest. This must be called
+ * after making the surface current and querying its buffer age, before
+ * rendering. Content outside the region is undefined afterwards. Returns false
+ * if EGL_KHR_partial_update isn't supported.
+ */
+bool wlr_egl_set_damage_region(struct wlr_egl *egl, EGLSurface surface,
+	pixman_region32_t *damage);
+
 bool wlr_egl_destroy_surface(struct wlr_egl *egl, EGLSurface surface);
 
+/**
+ * Creates a native fence sync object. If fence_fd is -1, the fence is signaled
+ * once the GL commands issued so far have completed. Otherwise the fence
+ * imports fence_fd and takes ownership of it. Returns EGL_NO_SYNC_KHR if
+ * EGL_ANDROID_native_fence_sync isn't supported.
+ */
+EGLSyncKHR wlr_egl_create_native_fence(struct wlr_egl *egl, int fence_fd);
+
+/**
+ * Exports a native fence sync object as a sync file. The GL commands preceding
+ * the fence must have been flushed, e.g. by swapping buffers. Returns -1 on
+ * error.
+ */
+int wlr_egl_dup_native_fence_fd(struct wlr_egl *egl, EGLSyncKHR sync);
+
+/**
+ * Creates a fence sync object, signaled once the GL commands issued so far in
+ * the current context have completed. It can be waited on from another
+ * context sharing objects with this one, after the commands have been flushed
+ * with glFlush. Returns EGL_NO_SYNC_KHR if EGL_KHR_fence_sync isn't supported.
+ */
+EGLSyncKHR wlr_egl_create_fence(struct wlr_egl *egl);
+
+/**
+ * Makes the GPU wait for the sync object before executing further GL commands,
+ * without blocking the CPU.
+ */
+bool wlr_egl_wait_sync(struct wlr_egl *egl, EGLSyncKHR sync);
+
+/**
+ * Blocks the calling thread until the sync object is signaled or timeout
+ * nanoseconds have passed. Returns false on timeout or error.
+ */
+bool wlr_egl_client_wait_sync(struct wlr_egl *egl, EGLSyncKHR sync,
+	uint64_t timeout);
+
+void wlr_egl_destroy_sync(struct wlr_egl *egl, EGLSyncKHR sync);
+
 #endif
@@ -14,6 +14,11 @@
 
 struct wlr_egl;
 
+enum wlr_gles2_yuv_encoding {
+	WLR_GLES2_YUV_ENCODING_BT601,
+	WLR_GLES2_YUV_ENCODING_BT709,
+};
+
 struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl);
 
 struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
@@ -24,4 +29,13 @@ struct wlr_texture *wlr_gles2_texture_from_wl_drm(struct wlr_egl *egl,
 struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 	struct wlr_dmabuf_attributes *attribs);
 
+/**
+ * Sets how a texture created from a multi-planar YUV DMA-BUF is converted to
+ * RGB. By default, BT.709 is used from 720p up and BT.601 below, both with
+ * limited range. Returns false if the texture isn't a GLES2 texture sampled
+ * plane by plane.
+ */
+bool wlr_gles2_texture_set_yuv_encoding(struct wlr_texture *texture,
+	enum wlr_gles2_yuv_encoding encoding, bool full_range);
+
 #endif
@@ -19,6 +19,7 @@
 #include <EGL/eglext.h>
 #include <stdbool.h>
 #include <wayland-server-protocol.h>
+#include <wlr/render/allocator.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_box.h>
@@ -31,9 +32,16 @@ struct wlr_renderer_impl {
 	void (*end)(struct wlr_renderer *renderer);
 	void (*clear)(struct wlr_renderer *renderer, const float color[static 4]);
 	void (*scissor)(struct wlr_renderer *renderer, struct wlr_box *box);
-	bool (*render_texture_with_matrix)(struct wlr_renderer *renderer,
-		struct wlr_texture *texture, const float matrix[static 9],
-		float alpha);
+	bool (*render_subtexture_with_matrix)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha);
+	// Optional, the scissor box is used for each rectangle otherwise
+	bool (*render_subtexture_with_matrix_region)(
+		struct wlr_renderer *renderer, struct wlr_texture *texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha, pixman_region32_t *region);
+	void (*clear_region)(struct wlr_renderer *renderer,
+		const float color[static 4], pixman_region32_t *region);
 	void (*render_quad_with_matrix)(struct wlr_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]);
 	void (*render_ellipse_with_matrix)(struct wlr_renderer *renderer,
@@ -49,11 +57,31 @@ struct wlr_renderer_impl {
 	int (*get_dmabuf_formats)(struct wlr_renderer *renderer, int **formats);
 	int (*get_dmabuf_modifiers)(struct wlr_renderer *renderer, int format,
 		uint64_t **modifiers);
+	bool (*get_drm_device)(struct wlr_renderer *renderer, dev_t *dev);
 	enum wl_shm_format (*preferred_read_format)(struct wlr_renderer *renderer);
 	bool (*read_pixels)(struct wlr_renderer *renderer, enum wl_shm_format fmt,
 		uint32_t *flags, uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
 		void *data);
+	struct wlr_renderer_readback *(*read_pixels_async)(
+		struct wlr_renderer *renderer, enum wl_shm_format fmt,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y);
+	bool (*blit_dmabuf)(struct wlr_renderer *renderer,
+		struct wlr_dmabuf_attributes *dst, uint32_t *flags, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+		uint32_t dst_y);
+	bool (*copy_region)(struct wlr_renderer *renderer,
+		const struct wlr_box *src, int dst_x, int dst_y);
+	bool (*bind_offscreen)(struct wlr_renderer *renderer,
+		struct wlr_dmabuf_attributes *dmabuf, uint32_t width, uint32_t height);
+	void (*unbind_offscreen)(struct wlr_renderer *renderer);
+	bool (*bind_offscreen_scaled)(struct wlr_renderer *renderer,
+		const struct wlr_box *src, struct wlr_dmabuf_attributes *dmabuf,
+		uint32_t width, uint32_t height);
+	bool (*bind_texture)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture);
+	struct wlr_render_timer *(*render_timer_create)(
+		struct wlr_renderer *renderer);
 	struct wlr_texture *(*texture_from_pixels)(struct wlr_renderer *renderer,
 		enum wl_shm_format fmt, uint32_t stride, uint32_t width,
 		uint32_t height, const void *data);
@@ -69,6 +97,26 @@ struct wlr_renderer_impl {
 void wlr_renderer_init(struct wlr_renderer *renderer,
 	const struct wlr_renderer_impl *impl);
 
+struct wlr_renderer_readback_impl {
+	bool (*finish)(struct wlr_renderer_readback *readback, uint32_t *flags,
+		uint32_t stride, uint32_t dst_x, uint32_t dst_y, void *data);
+	void (*destroy)(struct wlr_renderer_readback *readback);
+};
+
+void wlr_renderer_readback_init(struct wlr_renderer_readback *readback,
+	const struct wlr_renderer_readback_impl *impl, uint32_t width,
+	uint32_t height);
+
+struct wlr_render_timer_impl {
+	void (*begin)(struct wlr_render_timer *timer);
+	void (*end)(struct wlr_render_timer *timer);
+	bool (*get_duration)(struct wlr_render_timer *timer, int64_t *duration);
+	void (*destroy)(struct wlr_render_timer *timer);
+};
+
+void wlr_render_timer_init(struct wlr_render_timer *timer,
+	const struct wlr_render_timer_impl *impl);
+
 struct wlr_texture_impl {
 	void (*get_size)(struct wlr_texture *texture, int *width, int *height);
 	bool (*is_opaque)(struct wlr_texture *texture);
@@ -84,4 +132,15 @@ struct wlr_texture_impl {
 void wlr_texture_init(struct wlr_texture *texture,
 	const struct wlr_texture_impl *impl);
 
+struct wlr_allocator_impl {
+	struct wlr_allocator_buffer *(*create_buffer)(struct wlr_allocator *alloc,
+		int width, int height, uint32_t format, const uint64_t *modifiers,
+		size_t modifiers_len);
+	void (*destroy_buffer)(struct wlr_allocator_buffer *buffer);
+	void (*destroy)(struct wlr_allocator *alloc);
+};
+
+void wlr_allocator_init(struct wlr_allocator *alloc,
+	const struct wlr_allocator_impl *impl);
+
 #endif
@@ -0,0 +1,102 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_PASS_H
+#define WLR_RENDER_PASS_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_box.h>
+
+// Number of preceding operations searched for one to batch a draw with
+#define WLR_RENDER_PASS_REORDER_WINDOW 32
+
+enum wlr_render_op_type {
+	WLR_RENDER_OP_CLEAR,
+	WLR_RENDER_OP_TEXTURE,
+	WLR_RENDER_OP_QUAD,
+};
+
+struct wlr_render_op {
+	enum wlr_render_op_type type;
+	struct wlr_texture *texture; // WLR_RENDER_OP_TEXTURE only
+	struct wlr_fbox box; // in texture pixels
+	float matrix[9];
+	float color[4]; // WLR_RENDER_OP_CLEAR and WLR_RENDER_OP_QUAD
+	float alpha;
+	pixman_region32_t clip; // in buffer coordinates
+	// Part of the clip region covered by opaque pixels
+	pixman_region32_t opaque;
+};
+
+/**
+ * A recorded list of draw operations, each limited to a clip region, which
+ * is executed in one go by `wlr_render_pass_submit`. All regions are in
+ * buffer coordinates, like the scissor box.
+ *
+ * Before drawing, the parts of each operation covered by the opaque regions
+ * of the operations recorded after it are discarded, and operations which
+ * don't overlap are reordered so that draws from the same texture end up
+ * next to each other, which lets the renderer batch them. The recorded
+ * operations aren't modified: the same pass can be submitted again, e.g. to
+ * an offscreen buffer of the same size for a capture.
+ *
+ * Textures must stay alive until the pass is reset or destroyed.
+ */
+struct wlr_render_pass {
+	int width, height;
+
+	struct wlr_render_op *ops;
+	size_t ops_len, ops_cap;
+};
+
+struct wlr_render_pass *wlr_render_pass_create(int width, int height);
+void wlr_render_pass_destroy(struct wlr_render_pass *pass);
+/**
+ * Discards all recorded operations and sets the size of the buffer the pass
+ * is drawn into.
+ */
+void wlr_render_pass_reset(struct wlr_render_pass *pass, int width,
+	int height);
+/**
+ * Records a clear of the `clip` region, or of the whole buffer if `clip` is
+ * NULL. Returns false on allocation failure.
+ */
+bool wlr_render_pass_add_clear(struct wlr_render_pass *pass,
+	const float color[static 4], pixman_region32_t *clip);
+/**
+ * Records a draw of the `box` part of the texture (in texture pixels, the
+ * whole texture if NULL), like `wlr_render_subtexture_with_matrix_region`.
+ * `opaque` is the part of the buffer the draw covers with opaque pixels, or
+ * NULL if unknown. It is ignored if `alpha` is below 1. Returns false on
+ * allocation failure.
+ */
+bool wlr_render_pass_add_texture(struct wlr_render_pass *pass,
+	struct wlr_texture *texture, const struct wlr_fbox *box,
+	const float matrix[static 9], float alpha, pixman_region32_t *clip,
+	pixman_region32_t *opaque);
+/**
+ * Records a solid quadrangle, like `wlr_render_quad_with_matrix`. `opaque`
+ * has the same meaning as in `wlr_render_pass_add_texture`, it is ignored if
+ * the color isn't opaque. Returns false on allocation failure.
+ */
+bool wlr_render_pass_add_quad(struct wlr_render_pass *pass,
+	const float color[static 4], const float matrix[static 9],
+	pixman_region32_t *clip, pixman_region32_t *opaque);
+/**
+ * Draws the recorded operations. Must be called between `wlr_renderer_begin`
+ * and `wlr_renderer_end`. The scissor box is disabled. Returns false if a
+ * draw failed.
+ */
+bool wlr_render_pass_submit(struct wlr_render_pass *pass,
+	struct wlr_renderer *renderer);
+
+#endif
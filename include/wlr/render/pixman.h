@@ -0,0 +1,28 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_PIXMAN_H
+#define WLR_RENDER_PIXMAN_H
+
+#include <pixman.h>
+#include <wlr/render/wlr_renderer.h>
+
+/**
+ * Creates a software renderer drawing with pixman. It doesn't need a GPU but
+ * only supports shm buffers.
+ */
+struct wlr_renderer *wlr_pixman_renderer_create(void);
+bool wlr_renderer_is_pixman(struct wlr_renderer *renderer);
+/**
+ * Sets the image the renderer draws to and reads pixels from. The image must
+ * not be destroyed while it's bound. Passing NULL unbinds the current image.
+ */
+void wlr_pixman_renderer_bind_image(struct wlr_renderer *renderer,
+	pixman_image_t *image);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_SWAPCHAIN_H
+#define WLR_RENDER_SWAPCHAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wlr/render/allocator.h>
+
+#define WLR_SWAPCHAIN_CAP 4
+
+struct wlr_swapchain_slot {
+	struct wlr_allocator_buffer *buffer; // NULL until first acquired
+	int age; // number of frames since this buffer was submitted, 0 if never
+};
+
+/**
+ * A fixed set of buffers of the same size and format, rendered into in turn.
+ * Buffers are allocated on first use. The last submitted buffer is never
+ * acquired again before the next one is submitted, so that it can be
+ * displayed or read while the next frame is rendered.
+ */
+struct wlr_swapchain {
+	struct wlr_allocator *allocator;
+	int width, height;
+	uint32_t format;
+	uint64_t *modifiers;
+	size_t modifiers_len;
+
+	struct wlr_swapchain_slot slots[WLR_SWAPCHAIN_CAP];
+	size_t len; // number of slots used, at least 2
+	struct wlr_swapchain_slot *front; // last submitted, NULL if none
+	struct wlr_swapchain_slot *back; // acquired, NULL if none
+};
+
+/**
+ * Creates a swapchain of `len` buffers, from 2 to WLR_SWAPCHAIN_CAP. The
+ * modifiers are passed to wlr_allocator_create_buffer.
+ */
+struct wlr_swapchain *wlr_swapchain_create(struct wlr_allocator *alloc,
+	int width, int height, uint32_t format, const uint64_t *modifiers,
+	size_t modifiers_len, size_t len);
+void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
+/**
+ * Returns the buffer to render the next frame into, the one which has been
+ * submitted the longest ago. If `age` isn't NULL, it is set to the number of
+ * frames since its contents were submitted, or 0 if they are undefined.
+ * Acquiring again before submitting returns the same buffer. Returns NULL if
+ * the allocation fails.
+ */
+struct wlr_allocator_buffer *wlr_swapchain_acquire(
+	struct wlr_swapchain *swapchain, int *age);
+/**
+ * Submits the acquired buffer, which becomes the front buffer.
+ */
+void wlr_swapchain_submit(struct wlr_swapchain *swapchain);
+/**
+ * Returns the last submitted buffer, or NULL if none.
+ */
+struct wlr_allocator_buffer *wlr_swapchain_get_front(
+	struct wlr_swapchain *swapchain);
+
+#endif
@@ -9,7 +9,9 @@
 #ifndef WLR_RENDER_WLR_RENDERER_H
 #define WLR_RENDER_WLR_RENDERER_H
 
+#include <pixman.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <wayland-server-protocol.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/wlr_texture.h>
@@ -20,6 +22,8 @@ enum wlr_renderer_read_pixels_flags {
 };
 
 struct wlr_renderer_impl;
+struct wlr_renderer_readback_impl;
+struct wlr_render_timer_impl;
 
 struct wlr_renderer {
 	const struct wlr_renderer_impl *impl;
@@ -29,12 +33,35 @@ struct wlr_renderer {
 	} events;
 };
 
+/**
+ * A pending read-out of pixels, see wlr_renderer_read_pixels_async.
+ */
+struct wlr_renderer_readback {
+	const struct wlr_renderer_readback_impl *impl;
+
+	uint32_t width, height;
+};
+
+/**
+ * Measures the time the GPU spends executing rendering commands, see
+ * wlr_render_timer_create.
+ */
+struct wlr_render_timer {
+	const struct wlr_render_timer_impl *impl;
+};
+
 struct wlr_renderer *wlr_renderer_autocreate(struct wlr_egl *egl, EGLenum platform,
 	void *remote_display, EGLint *config_attribs, EGLint visual_id);
 
 void wlr_renderer_begin(struct wlr_renderer *r, int width, int height);
 void wlr_renderer_end(struct wlr_renderer *r);
 void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]);
+/**
+ * Clears the pixels of `region`, in buffer coordinates like the scissor box.
+ * The scissor box is disabled.
+ */
+void wlr_renderer_clear_region(struct wlr_renderer *r,
+	const float color[static 4], pixman_region32_t *region);
 /**
  * Defines a scissor box. Only pixels that lie within the scissor box can be
  * modified by drawing functions. Providing a NULL `box` disables the scissor
@@ -51,6 +78,29 @@ bool wlr_render_texture(struct wlr_renderer *r, struct wlr_texture *texture,
  */
 bool wlr_render_texture_with_matrix(struct wlr_renderer *r,
 	struct wlr_texture *texture, const float matrix[static 9], float alpha);
+/**
+ * Renders the `box` part of the texture (in texture pixels) using the provided
+ * matrix, scaled to fill the unit square.
+ */
+bool wlr_render_subtexture_with_matrix(struct wlr_renderer *r,
+	struct wlr_texture *texture, const struct wlr_fbox *box,
+	const float matrix[static 9], float alpha);
+/**
+ * Renders the requested texture using the provided matrix, only modifying the
+ * pixels of `region`. The region is in buffer coordinates like the scissor
+ * box, which is disabled. Cheaper than scissoring each rectangle of the
+ * region in turn.
+ */
+bool wlr_render_texture_with_matrix_region(struct wlr_renderer *r,
+	struct wlr_texture *texture, const float matrix[static 9], float alpha,
+	pixman_region32_t *region);
+/**
+ * Like wlr_render_subtexture_with_matrix, but only modifies the pixels of
+ * `region`, see wlr_render_texture_with_matrix_region.
+ */
+bool wlr_render_subtexture_with_matrix_region(struct wlr_renderer *r,
+	struct wlr_texture *texture, const struct wlr_fbox *box,
+	const float matrix[static 9], float alpha, pixman_region32_t *region);
 /**
  * Renders a solid rectangle in the specified color.
  */
@@ -96,6 +146,11 @@ int wlr_renderer_get_dmabuf_formats(struct wlr_renderer *renderer,
  */
 int wlr_renderer_get_dmabuf_modifiers(struct wlr_renderer *renderer, int format,
 	uint64_t **modifiers);
+/**
+ * Get the DRM device the renderer uses. Returns false if the renderer doesn't
+ * use a DRM device or if it can't be determined.
+ */
+bool wlr_renderer_get_drm_device(struct wlr_renderer *renderer, dev_t *dev);
 /**
  * Reads out of pixels of the currently bound surface into data. `stride` is in
  * bytes.
@@ -106,6 +161,119 @@ int wlr_renderer_get_dmabuf_modifiers(struct wlr_renderer *renderer, int format,
 bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 	uint32_t *flags, uint32_t stride, uint32_t width, uint32_t height,
 	uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y, void *data);
+/**
+ * Starts reading out pixels of the currently bound surface without waiting
+ * for the GPU. The pixels can be retrieved with wlr_renderer_readback_finish
+ * once the frame has been presented, e.g. on the next output frame event.
+ *
+ * Returns NULL if the renderer doesn't support asynchronous read-outs or on
+ * error, in which case the caller can fall back to wlr_renderer_read_pixels.
+ * The read-out must be destroyed before the renderer.
+ */
+struct wlr_renderer_readback *wlr_renderer_read_pixels_async(
+	struct wlr_renderer *r, enum wl_shm_format fmt, uint32_t width,
+	uint32_t height, uint32_t src_x, uint32_t src_y);
+/**
+ * Copies the pixels of a pending read-out into data. `stride` is in bytes.
+ * This blocks if the GPU hasn't finished the transfer yet.
+ *
+ * `flags` has the same meaning as in wlr_renderer_read_pixels.
+ */
+bool wlr_renderer_readback_finish(struct wlr_renderer_readback *readback,
+	uint32_t *flags, uint32_t stride, uint32_t dst_x, uint32_t dst_y,
+	void *data);
+void wlr_renderer_readback_destroy(struct wlr_renderer_readback *readback);
+/**
+ * Copies pixels of the currently bound surface into a DMA-BUF on the GPU,
+ * without going through system memory. `dst_x` and `dst_y` are the position
+ * of the copied region in the DMA-BUF once `flags` are applied, so that
+ * partial copies into the same buffer are consistent.
+ *
+ * `flags` has the same meaning as in wlr_renderer_read_pixels. Returns false
+ * if the renderer doesn't support it or on error.
+ */
+bool wlr_renderer_blit_dmabuf(struct wlr_renderer *r,
+	struct wlr_dmabuf_attributes *dst, uint32_t *flags, uint32_t width,
+	uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+	uint32_t dst_y);
+/**
+ * Copies a box of the currently bound surface to another position in it, e.g.
+ * to move content without repainting it. Coordinates are in buffer pixels and
+ * the boxes may overlap. The scissor box applies to the destination, which is
+ * made opaque.
+ *
+ * Returns false if the renderer doesn't support it or on error.
+ */
+bool wlr_renderer_copy_region(struct wlr_renderer *r,
+	const struct wlr_box *src, int dst_x, int dst_y);
+/**
+ * Redirects rendering to an offscreen buffer of the given size, instead of
+ * the current output. If `dmabuf` isn't NULL, it is rendered into directly,
+ * otherwise the renderer allocates the buffer and its pixels can be read with
+ * wlr_renderer_read_pixels. Rendering must still be enclosed in
+ * wlr_renderer_begin and wlr_renderer_end.
+ *
+ * The DMA-BUF contents are y-inverted, like pixels read from an output.
+ * Returns false if the renderer doesn't support it or on error.
+ */
+bool wlr_renderer_bind_offscreen(struct wlr_renderer *r,
+	struct wlr_dmabuf_attributes *dmabuf, uint32_t width, uint32_t height);
+/**
+ * Scales a box of the currently bound surface to the given size into an
+ * offscreen buffer, then binds that buffer like wlr_renderer_bind_offscreen.
+ * Its pixels can then be read with wlr_renderer_read_pixels, e.g. to read back
+ * a thumbnail of an output without transferring the full-size pixels.
+ * Coordinates are in buffer pixels and the copy is opaque.
+ *
+ * Returns false if the renderer doesn't support it or on error, nothing is
+ * bound then.
+ */
+bool wlr_renderer_bind_offscreen_scaled(struct wlr_renderer *r,
+	const struct wlr_box *src, struct wlr_dmabuf_attributes *dmabuf,
+	uint32_t width, uint32_t height);
+/**
+ * Redirects rendering into a texture, e.g. to cache the composition of
+ * several surfaces and draw it later as a single quad. The texture can be
+ * created with wlr_texture_from_pixels and NULL data, and must not be drawn
+ * while it is bound. Rendering must still be enclosed in wlr_renderer_begin
+ * and wlr_renderer_end. If they are given a larger size than the texture's,
+ * everything is scaled down to fit the texture, e.g. to render an output at a
+ * reduced resolution; wlr_renderer_copy_region fails then.
+ *
+ * Returns false if the renderer doesn't support it or can't render into this
+ * texture, e.g. because it shares its storage with other small textures.
+ */
+bool wlr_renderer_bind_texture(struct wlr_renderer *r,
+	struct wlr_texture *texture);
+/**
+ * Submits the rendering commands and releases the buffer bound by
+ * wlr_renderer_bind_offscreen or wlr_renderer_bind_texture. Unbinding a
+ * texture goes back to the framebuffer it was bound on top of, e.g. the one
+ * of the current output. Otherwise, output rendering can resume once the
+ * output is made current again. The viewport set before binding is restored.
+ */
+void wlr_renderer_unbind_offscreen(struct wlr_renderer *r);
+/**
+ * Creates a GPU timer. Returns NULL if the renderer doesn't support timers.
+ * The timer must be destroyed before the renderer.
+ */
+struct wlr_render_timer *wlr_render_timer_create(struct wlr_renderer *r);
+/**
+ * Starts measuring the rendering commands issued from now on. Only one timer
+ * can be running at a time: starting a timer stops the running one, which then
+ * reports no duration.
+ */
+void wlr_render_timer_begin(struct wlr_render_timer *timer);
+void wlr_render_timer_end(struct wlr_render_timer *timer);
+/**
+ * Gets the GPU time elapsed between wlr_render_timer_begin and
+ * wlr_render_timer_end without blocking. Returns false if the GPU hasn't
+ * finished executing the commands yet. Otherwise `duration` is set in
+ * nanoseconds, or to -1 if the measurement is invalid.
+ */
+bool wlr_render_timer_get_duration(struct wlr_render_timer *timer,
+	int64_t *duration);
+void wlr_render_timer_destroy(struct wlr_render_timer *timer);
 /**
  * Checks if a format is supported.
  */
@@ -13,6 +13,7 @@
 #include <EGL/eglext.h>
 #include <stdint.h>
 #include <wayland-server-protocol.h>
+#include <wayland-server.h>
 #include <wlr/render/dmabuf.h>
 
 struct wlr_renderer;
@@ -20,11 +21,17 @@ struct wlr_texture_impl;
 
 struct wlr_texture {
 	const struct wlr_texture_impl *impl;
+
+	struct {
+		struct wl_signal destroy;
+		struct wl_signal update; // the contents have changed
+	} events;
 };
 
 /**
  * Create a new texture from raw pixel data. `stride` is in bytes. The returned
- * texture is mutable.
+ * texture is mutable. If `data` is NULL, the contents are undefined until they
+ * are written with `wlr_texture_write_pixels`.
  */
 struct wlr_texture *wlr_texture_from_pixels(struct wlr_renderer *renderer,
 	enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width, uint32_t height,
@@ -18,6 +18,11 @@ struct wlr_box {
 	int width, height;
 };
 
+struct wlr_fbox {
+	double x, y;
+	double width, height;
+};
+
 void wlr_box_closest_point(const struct wlr_box *box, double x, double y,
 	double *dest_x, double *dest_y);
 
@@ -34,6 +39,12 @@ bool wlr_box_empty(const struct wlr_box *box);
 void wlr_box_transform(struct wlr_box *dest, const struct wlr_box *box,
 	enum wl_output_transform transform, int width, int height);
 
+/**
+ * Transforms a floating-point box inside a `width` x `height` box.
+ */
+void wlr_fbox_transform(struct wlr_fbox *dest, const struct wlr_fbox *box,
+	enum wl_output_transform transform, double width, double height);
+
 /**
  * Creates the smallest box that contains the box rotated about its center.
  */
@@ -11,6 +11,9 @@
 
 #include <pixman.h>
 #include <wayland-server.h>
+#include <wlr/render/dmabuf.h>
+
+struct wlr_buffer_client_usage;
 
 /**
  * A client buffer.
@@ -25,12 +28,61 @@ struct wlr_buffer {
 	 * client destroys the buffer before it has been released.
 	 */
 	struct wlr_texture *texture;
+	struct wlr_renderer *renderer;
 	bool released;
+	/**
+	 * Retained wl_shm buffers aren't released after their upload, the client
+	 * gets them back once they're replaced. This allows evicting the texture
+	 * and uploading it again later, see wlr_buffer_evict_texture.
+	 */
+	bool retained;
+	/**
+	 * The texture has been evicted and will be imported again by
+	 * wlr_buffer_finish_upload.
+	 */
+	bool evicted;
+	/**
+	 * Buffers imported from linux-dmabuf are kept with no reference until
+	 * the client destroys the resource, so that re-attaching them doesn't
+	 * import the DMA-BUF again.
+	 */
 	size_t n_refs;
 
+	// Pending upload of a large wl_shm buffer, see wlr_buffer_finish_upload
+	struct {
+		struct wl_event_source *timer; // NULL if done
+		int32_t next_row;
+	} upload;
+
+	// Estimated memory used by the texture, in bytes
+	size_t size;
+	// Usage of the client which created the buffer, NULL once the client is
+	// destroyed
+	struct wlr_buffer_client_usage *usage;
+	struct wl_list usage_link; // wlr_buffer_client_usage::buffers
+
+	// Textures imported into other renderers, see wlr_buffer_get_texture
+	struct wl_list foreign_textures;
+
 	struct wl_listener resource_destroy;
 };
 
+/**
+ * Memory held by the compositor on behalf of a client. Buffers are accounted
+ * until they are destroyed, which includes buffers still referenced by
+ * surface states and cached linux-dmabuf imports. Sizes are estimated from
+ * the texture dimensions, at four bytes per pixel.
+ */
+struct wlr_buffer_client_usage {
+	struct wl_client *client;
+	struct wl_list buffers; // wlr_buffer::usage_link
+	size_t n_buffers;
+	size_t bytes;
+	size_t peak_bytes; // highest value of `bytes`
+
+	struct wl_listener client_destroy;
+};
+
 struct wlr_renderer;
 
 /**
@@ -44,10 +96,36 @@ bool wlr_buffer_get_resource_size(struct wl_resource *resource,
 	struct wlr_renderer *renderer, int *width, int *height);
 
 /**
- * Upload a buffer to the GPU and reference it.
+ * Upload a buffer to the GPU and reference it. If the resource is a
+ * linux-dmabuf buffer that has already been imported, the existing buffer is
+ * referenced instead.
  */
 struct wlr_buffer *wlr_buffer_create(struct wlr_renderer *renderer,
 	struct wl_resource *resource);
+/**
+ * Same as wlr_buffer_create, but wl_shm buffers aren't released once
+ * uploaded. They're released when the buffer is replaced or destroyed.
+ */
+struct wlr_buffer *wlr_buffer_create_retained(struct wlr_renderer *renderer,
+	struct wl_resource *resource);
+/**
+ * Finishes uploading the buffer's pixels to its texture. Large wl_shm buffers
+ * are uploaded in chunks from the event loop, so this must be called before
+ * reading the texture. The wl_buffer is released once the upload is done.
+ *
+ * If the texture has been evicted, it is imported again from the wl_buffer.
+ */
+void wlr_buffer_finish_upload(struct wlr_buffer *buffer);
+/**
+ * Destroy the buffer's texture to free GPU memory, keeping what's needed to
+ * import it again on the next wlr_buffer_finish_upload call. Only retained
+ * wl_shm buffers and DMA-BUF buffers can be evicted, and only while nothing
+ * else references the buffer. Returns true if the texture has been evicted.
+ *
+ * If the client destroys the wl_buffer while the texture is evicted, the
+ * contents are lost and the buffer won't have a texture anymore.
+ */
+bool wlr_buffer_evict_texture(struct wlr_buffer *buffer);
 /**
  * Reference the buffer.
  */
@@ -67,5 +145,30 @@ void wlr_buffer_unref(struct wlr_buffer *buffer);
  */
 struct wlr_buffer *wlr_buffer_apply_damage(struct wlr_buffer *buffer,
 	struct wl_resource *resource, pixman_region32_t *damage);
+/**
+ * Get the memory held by the buffers of a client, or NULL if the client never
+ * created one. Compositors can use it to enforce per-client budgets.
+ */
+const struct wlr_buffer_client_usage *wlr_buffer_get_client_usage(
+	struct wl_client *client);
+/**
+ * Get the buffer's texture for the given renderer. If it isn't the renderer
+ * the buffer was created with, e.g. the renderer of a secondary GPU, the
+ * buffer is imported into it and the texture is cached until the buffer
+ * changes. DMA-BUFs are imported directly, other buffers through their
+ * texture exported as a DMA-BUF. wl_shm buffers which haven't been released
+ * are uploaded again if the device can't import it.
+ *
+ * Returns NULL if the buffer can't be imported into the renderer.
+ */
+struct wlr_texture *wlr_buffer_get_texture(struct wlr_buffer *buffer,
+	struct wlr_renderer *renderer);
+/**
+ * Reads the DMA-BUF attributes of the buffer. Returns false if the buffer
+ * isn't a linux-dmabuf buffer or if the client has destroyed it. The file
+ * descriptors remain owned by the buffer resource.
+ */
+bool wlr_buffer_get_dmabuf(struct wlr_buffer *buffer,
+	struct wlr_dmabuf_attributes *attribs);
 
 #endif
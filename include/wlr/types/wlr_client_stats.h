@@ -0,0 +1,42 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_CLIENT_STATS_H
+#define WLR_TYPES_WLR_CLIENT_STATS_H
+
+#include <stdint.h>
+#include <wayland-server.h>
+
+/**
+ * Counts the requests of a client which cost the compositor the most, to find
+ * out which client floods it. Counters only ever increase: sample them
+ * periodically to compute rates. All clients of a display can be iterated
+ * with wl_client_for_each over wl_display_get_client_list.
+ */
+struct wlr_client_stats {
+	struct wl_client *client;
+
+	uint64_t commits; // wl_surface.commit
+	uint64_t damage_rects; // wl_surface.damage and damage_buffer
+	uint64_t buffer_attaches; // wl_surface.attach
+	uint64_t frame_callbacks; // wl_surface.frame
+	// receive requests of data, data control and primary selection offers
+	uint64_t data_transfers;
+
+	// private state
+
+	struct wl_listener client_destroy;
+};
+
+/**
+ * Returns the counters of the client, allocated on first use and freed along
+ * with the client. Returns NULL on allocation failure.
+ */
+struct wlr_client_stats *wlr_client_stats_get(struct wl_client *client);
+
+#endif
@@ -29,6 +29,12 @@ struct wlr_compositor {
 
 	struct wlr_subcompositor subcompositor;
 
+	struct {
+		int timeout; // msec, 0 if disabled
+		struct wl_event_source *timer;
+	} texture_eviction;
+
+	struct wl_display *display;
 	struct wl_listener display_destroy;
 
 	struct {
@@ -40,6 +46,17 @@ struct wlr_compositor {
 void wlr_compositor_destroy(struct wlr_compositor *wlr_compositor);
 struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 	struct wlr_renderer *renderer);
+/**
+ * Destroy the textures of surfaces which haven't been rendered for `timeout`
+ * milliseconds, to free GPU memory held for hidden windows. The textures are
+ * imported again from the client buffers the next time they're rendered.
+ *
+ * When enabled, wl_shm buffers are only released once the surface commits
+ * another buffer, since they're needed to upload the texture again. Pass 0
+ * to disable eviction, which is the default.
+ */
+void wlr_compositor_set_texture_eviction(struct wlr_compositor *compositor,
+	int timeout);
 
 bool wlr_surface_is_subsurface(struct wlr_surface *surface);
 
@@ -16,12 +16,21 @@ struct wlr_data_control_manager_v1 {
 	struct wl_global *global;
 	struct wl_list resources; // wl_resource_get_link
 	struct wl_list devices; // wlr_data_control_device_v1::link
+	// Maximum size in bytes of the cached selection data per selection, 0 if
+	// caching is disabled
+	size_t selection_cache_size;
 
 	struct {
 		struct wl_signal destroy;
 		struct wl_signal new_device; // wlr_data_control_device_v1
 	} events;
 
+	// private state
+
+	struct wl_event_loop *event_loop;
+	struct wl_list selection_caches;
+	struct wl_list selection_transfers;
+
 	struct wl_listener display_destroy;
 };
 
@@ -43,6 +52,16 @@ struct wlr_data_control_manager_v1 *wlr_data_control_manager_v1_create(
 	struct wl_display *display);
 void wlr_data_control_manager_v1_destroy(
 	struct wlr_data_control_manager_v1 *manager);
+/**
+ * Enables caching the selection data for data-control clients. When the
+ * selection changes on a seat with data-control devices, it is read once from
+ * the source for every offered mime type, and following receive requests are
+ * served from the cache instead of waking up the source client. At most
+ * `max_size` bytes are cached per selection, mime types which don't fit are
+ * read from the source as usual. 0 disables caching.
+ */
+void wlr_data_control_manager_v1_set_selection_cache(
+	struct wlr_data_control_manager_v1 *manager, size_t max_size);
 
 void wlr_data_control_device_v1_destroy(
 	struct wlr_data_control_device_v1 *device);
@@ -74,7 +74,7 @@ struct wlr_data_source {
 	const struct wlr_data_source_impl *impl;
 
 	// source metadata
-	struct wl_array mime_types;
+	struct wl_array mime_types; // const char *, see wlr/util/mime_type.h
 	int32_t actions;
 
 	// source status
@@ -130,8 +130,17 @@ struct wlr_drag {
 	bool started, dropped, cancelling;
 	int32_t grab_touch_id, touch_id; // if WLR_DRAG_GRAB_TOUCH
 
+	// Motion waiting to be sent, see events.motion
+	struct {
+		struct wl_event_source *idle; // NULL if none
+		uint32_t time;
+		double sx, sy;
+	} motion;
+
 	struct {
 		struct wl_signal focus;
+		// Coalesced: emitted once the event loop is idle, with the latest
+		// position
 		struct wl_signal motion; // wlr_drag_motion_event
 		struct wl_signal drop; // wlr_drag_drop_event
 		struct wl_signal destroy;
@@ -0,0 +1,133 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_DRM_LEASE_V1_H
+#define WLR_TYPES_WLR_DRM_LEASE_V1_H
+
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_output.h>
+
+struct wlr_drm_lease;
+
+/**
+ * Implements wp_drm_lease_device_v1, which lets clients such as VR runtimes
+ * drive outputs directly. The compositor picks which outputs are offered, and
+ * decides whether to grant each lease request.
+ */
+struct wlr_drm_lease_v1_manager {
+	struct wl_list devices; // wlr_drm_lease_device_v1::link
+
+	struct wl_display *display;
+	struct wl_listener display_destroy;
+
+	struct {
+		/**
+		 * Emitted when a client submits a lease request. The compositor must
+		 * call wlr_drm_lease_request_v1_grant or
+		 * wlr_drm_lease_request_v1_reject from the handler, the request is
+		 * rejected otherwise.
+		 */
+		struct wl_signal request; // struct wlr_drm_lease_request_v1 *
+	} events;
+
+	void *data;
+};
+
+// One per DRM backend
+struct wlr_drm_lease_device_v1 {
+	struct wl_list resources;
+	struct wl_global *global;
+
+	struct wlr_drm_lease_v1_manager *manager;
+	struct wlr_backend *backend;
+
+	struct wl_list connectors; // wlr_drm_lease_connector_v1::link
+	struct wl_list leases; // wlr_drm_lease_v1::link
+	struct wl_list requests; // wlr_drm_lease_request_v1::link
+	struct wl_list link; // wlr_drm_lease_v1_manager::devices
+
+	struct wl_listener backend_destroy;
+
+	void *data;
+};
+
+// An output offered for leasing
+struct wlr_drm_lease_connector_v1 {
+	struct wl_list resources;
+
+	struct wlr_output *output;
+	struct wlr_drm_lease_device_v1 *device;
+	struct wlr_drm_lease_v1 *active_lease; // NULL if not leased
+
+	struct wl_listener output_destroy;
+	struct wl_list link; // wlr_drm_lease_device_v1::connectors
+};
+
+struct wlr_drm_lease_request_v1 {
+	struct wl_resource *resource;
+	struct wlr_drm_lease_device_v1 *device;
+
+	struct wlr_drm_lease_connector_v1 **connectors;
+	size_t n_connectors;
+	// A requested connector has been withdrawn, the lease can't be granted
+	bool invalid;
+
+	// The wp_drm_lease_v1 being submitted, NULL before the submit request
+	struct wl_resource *lease_resource;
+	bool handled;
+
+	struct wl_list link; // wlr_drm_lease_device_v1::requests
+};
+
+struct wlr_drm_lease_v1 {
+	struct wl_resource *resource;
+	struct wlr_drm_lease *drm_lease;
+	struct wlr_drm_lease_device_v1 *device;
+
+	struct wlr_drm_lease_connector_v1 **connectors;
+	size_t n_connectors;
+
+	struct wl_listener destroy;
+	struct wl_list link; // wlr_drm_lease_device_v1::leases
+
+	void *data;
+};
+
+/**
+ * Creates a lease device for each DRM backend in `backend`, which may be a
+ * multi-backend. Returns NULL if there is no DRM backend.
+ */
+struct wlr_drm_lease_v1_manager *wlr_drm_lease_v1_manager_create(
+	struct wl_display *display, struct wlr_backend *backend);
+/**
+ * Offers a disabled DRM output to clients. Returns false if the output doesn't
+ * belong to one of the manager's devices.
+ */
+bool wlr_drm_lease_v1_manager_offer_output(
+	struct wlr_drm_lease_v1_manager *manager, struct wlr_output *output);
+/**
+ * Stops offering the output, revoking its lease if it's leased.
+ */
+void wlr_drm_lease_v1_manager_withdraw_output(
+	struct wlr_drm_lease_v1_manager *manager, struct wlr_output *output);
+
+/**
+ * Creates the lease and sends it to the client. Returns NULL and rejects the
+ * request on error.
+ */
+struct wlr_drm_lease_v1 *wlr_drm_lease_request_v1_grant(
+	struct wlr_drm_lease_request_v1 *request);
+void wlr_drm_lease_request_v1_reject(struct wlr_drm_lease_request_v1 *request);
+
+/**
+ * Revokes the lease, its outputs are offered to clients again.
+ */
+void wlr_drm_lease_v1_revoke(struct wlr_drm_lease_v1 *lease);
+
+#endif
@@ -10,6 +10,7 @@
 #define WLR_TYPES_WLR_EXPORT_DMABUF_V1_H
 
 #include <stdbool.h>
+#include <sys/types.h>
 #include <wayland-server.h>
 #include <wlr/render/dmabuf.h>
 
@@ -17,6 +18,8 @@ struct wlr_export_dmabuf_manager_v1 {
 	struct wl_global *global;
 	struct wl_list resources; // wl_resource_get_link
 	struct wl_list frames; // wlr_export_dmabuf_frame_v1::link
+	// Exported output buffers, kept alive across frames
+	struct wl_list outputs; // wlr_export_dmabuf_output_v1::link
 
 	struct wl_listener display_destroy;
 
@@ -30,12 +33,34 @@ struct wlr_export_dmabuf_frame_v1 {
 	struct wlr_export_dmabuf_manager_v1 *manager;
 	struct wl_list link; // wlr_export_dmabuf_manager_v1::frames
 
-	struct wlr_dmabuf_attributes attribs;
 	struct wlr_output *output;
 
 	bool cursor_locked;
+	bool swapped; // a buffer swap happened since the frame was requested
 
 	struct wl_listener output_swap_buffers;
+	struct wl_listener output_present;
+};
+
+#define WLR_EXPORT_DMABUF_V1_CACHE_LEN 4
+
+/**
+ * A cache of the buffers exported for an output. An output only cycles
+ * through a few buffers, so the same DMA-BUFs can be sent again instead of
+ * being exported for each frame.
+ */
+struct wlr_export_dmabuf_output_v1 {
+	struct wlr_output *output;
+	struct wl_list link; // wlr_export_dmabuf_manager_v1::outputs
+
+	struct {
+		struct wlr_dmabuf_attributes attribs;
+		dev_t dev;
+		ino_t ino;
+	} buffers[WLR_EXPORT_DMABUF_V1_CACHE_LEN];
+	size_t buffers_len, next_buffer;
+
+	struct wl_listener output_destroy;
 };
 
 struct wlr_export_dmabuf_manager_v1 *wlr_export_dmabuf_manager_v1_create(
@@ -18,6 +18,10 @@ struct wlr_foreign_toplevel_manager_v1 {
 	struct wl_list resources;
 	struct wl_list toplevels; // wlr_foreign_toplevel_handle_v1::link
 
+	// Maximum number of updates sent per toplevel and per second, 0 for no
+	// limit. See wlr_foreign_toplevel_manager_v1_set_update_rate.
+	int max_update_rate;
+
 	struct wl_listener display_destroy;
 
 	struct {
@@ -33,6 +37,12 @@ enum wlr_foreign_toplevel_handle_v1_state {
 	WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED = 4,
 };
 
+enum wlr_foreign_toplevel_handle_v1_pending_field {
+	WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_TITLE = 1 << 0,
+	WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_APP_ID = 1 << 1,
+	WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_STATE = 1 << 2,
+};
+
 struct wlr_foreign_toplevel_handle_v1_output {
 	struct wl_list link; // wlr_foreign_toplevel_handle_v1::outputs
 	struct wl_listener output_destroy;
@@ -47,11 +57,21 @@ struct wlr_foreign_toplevel_handle_v1 {
 	struct wl_list link;
 	struct wl_event_source *idle_source;
 
+	// Changes not sent to clients yet, only the latest values are sent
+	uint32_t pending; // enum wlr_foreign_toplevel_handle_v1_pending_field
+	struct wl_event_source *update_timer;
+	bool update_timer_armed;
+	int64_t last_update; // msec, CLOCK_MONOTONIC
+
 	char *title;
 	char *app_id;
 	struct wl_list outputs; // wlr_foreign_toplevel_v1_output
 	uint32_t state; // wlr_foreign_toplevel_v1_state
 
+	// The toplevel's main surface, may be NULL
+	struct wlr_surface *surface;
+	struct wl_listener surface_destroy;
+
 	struct {
 		// wlr_foreign_toplevel_handle_v1_maximized_event
 		struct wl_signal request_maximize;
@@ -94,12 +114,34 @@ struct wlr_foreign_toplevel_manager_v1 *wlr_foreign_toplevel_manager_v1_create(
 	struct wl_display *display);
 void wlr_foreign_toplevel_manager_v1_destroy(
 	struct wlr_foreign_toplevel_manager_v1 *manager);
+/**
+ * Limit the number of updates sent to clients for each toplevel to `rate` per
+ * second, 0 to disable the limit. Changes made in between are coalesced: only
+ * the latest title, app ID and state are sent. Without a limit, changes are
+ * still coalesced within an event loop iteration.
+ */
+void wlr_foreign_toplevel_manager_v1_set_update_rate(
+	struct wlr_foreign_toplevel_manager_v1 *manager, int rate);
 
 struct wlr_foreign_toplevel_handle_v1 *wlr_foreign_toplevel_handle_v1_create(
 	struct wlr_foreign_toplevel_manager_v1 *manager);
 void wlr_foreign_toplevel_handle_v1_destroy(
 	struct wlr_foreign_toplevel_handle_v1 *toplevel);
 
+/**
+ * Returns the toplevel behind a zwlr_foreign_toplevel_handle_v1 resource, or
+ * NULL if the toplevel has been destroyed.
+ */
+struct wlr_foreign_toplevel_handle_v1 *wlr_foreign_toplevel_handle_v1_from_resource(
+	struct wl_resource *resource);
+
+/**
+ * Sets the main surface of the toplevel. Other protocols referring to the
+ * toplevel, such as screencopy, use it to access the toplevel's contents.
+ */
+void wlr_foreign_toplevel_handle_v1_set_surface(
+	struct wlr_foreign_toplevel_handle_v1 *toplevel,
+	struct wlr_surface *surface);
 void wlr_foreign_toplevel_handle_v1_set_title(
 	struct wlr_foreign_toplevel_handle_v1 *toplevel, const char *title);
 void wlr_foreign_toplevel_handle_v1_set_app_id(
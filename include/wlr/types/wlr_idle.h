@@ -46,6 +46,11 @@ struct wlr_idle_timeout {
 	bool enabled;
 	uint32_t timeout; // milliseconds
 
+	// Activity only updates this timestamp, the timer re-arms itself with
+	// the remaining time when it fires too early
+	int64_t last_activity; // milliseconds, CLOCK_MONOTONIC
+	bool armed;
+
 	struct wl_listener input_listener;
 	struct wl_listener seat_destroy;
 
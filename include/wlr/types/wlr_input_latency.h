@@ -0,0 +1,119 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_INPUT_LATENCY_H
+#define WLR_TYPES_WLR_INPUT_LATENCY_H
+
+#include <stdint.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * Measures the time between input events and the moment their effect is
+ * displayed.
+ *
+ * The compositor tags each input event delivered to a client with
+ * wlr_input_latency_tracker_notify_input. The tracker then waits for the
+ * client to commit its surface, for the output to render a frame after the
+ * commit, and for that frame to be presented. The time between the input
+ * event and the presentation is added to the output's histogram.
+ *
+ * Input timestamps and presentation timestamps must use the same clock, which
+ * is CLOCK_MONOTONIC for the libinput and DRM backends.
+ */
+struct wlr_input_latency_tracker {
+	struct wl_list outputs; // wlr_input_latency_output::link
+	struct wl_list samples; // wlr_input_latency_sample::link
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+// Bucket i counts latencies in [2^i, 2^(i+1)) microseconds, the last bucket
+// also counts all larger latencies
+#define WLR_INPUT_LATENCY_BUCKETS 24
+
+struct wlr_input_latency_histogram {
+	uint64_t buckets[WLR_INPUT_LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t sum, min, max; // usec
+};
+
+struct wlr_input_latency_output {
+	struct wlr_input_latency_tracker *tracker;
+	struct wlr_output *output;
+	struct wl_list link; // wlr_input_latency_tracker::outputs
+
+	struct wlr_input_latency_histogram histogram;
+
+	struct wl_listener output_swap_buffers;
+	struct wl_listener output_present;
+	struct wl_listener output_destroy;
+
+	void *data;
+};
+
+enum wlr_input_latency_sample_state {
+	// The input event has been delivered, waiting for a surface commit
+	WLR_INPUT_LATENCY_SAMPLE_DELIVERED,
+	// The surface has been committed, waiting for the output to render
+	WLR_INPUT_LATENCY_SAMPLE_COMMITTED,
+	// The output rendered the commit, waiting for it to be presented
+	WLR_INPUT_LATENCY_SAMPLE_RENDERED,
+};
+
+struct wlr_input_latency_sample {
+	struct wlr_input_latency_output *output;
+	struct wlr_surface *surface; // NULL once committed
+	struct wl_list link; // wlr_input_latency_tracker::samples
+
+	enum wlr_input_latency_sample_state state;
+	uint64_t input_usec, commit_usec;
+
+	struct wl_listener surface_commit;
+	struct wl_listener surface_destroy;
+};
+
+struct wlr_input_latency_tracker *wlr_input_latency_tracker_create(void);
+void wlr_input_latency_tracker_destroy(
+	struct wlr_input_latency_tracker *tracker);
+/**
+ * Starts collecting latencies for the output. Returns the existing state if
+ * the output is already tracked.
+ */
+struct wlr_input_latency_output *wlr_input_latency_tracker_add_output(
+	struct wlr_input_latency_tracker *tracker, struct wlr_output *output);
+/**
+ * Returns the latencies collected for the output, or NULL if it isn't tracked.
+ */
+struct wlr_input_latency_output *wlr_input_latency_tracker_get_output(
+	struct wlr_input_latency_tracker *tracker, struct wlr_output *output);
+/**
+ * Records that an input event with the given timestamp has been delivered to
+ * a surface displayed on the output. While a surface hasn't committed, only
+ * its oldest pending input event is tracked. Does nothing if the output isn't
+ * tracked.
+ */
+void wlr_input_latency_tracker_notify_input(
+	struct wlr_input_latency_tracker *tracker, struct wlr_surface *surface,
+	struct wlr_output *output, uint64_t time_usec);
+
+void wlr_input_latency_histogram_reset(
+	struct wlr_input_latency_histogram *histogram);
+/**
+ * Returns an upper bound of the given percentile (between 0 and 1) of the
+ * latencies, in microseconds. Returns 0 if the histogram is empty.
+ */
+uint64_t wlr_input_latency_histogram_percentile(
+	const struct wlr_input_latency_histogram *histogram, double percentile);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_INPUT_RECORDER_H
+#define WLR_TYPES_WLR_INPUT_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_tablet_tool.h>
+
+/**
+ * Records the events of input devices to a file, so that they can be replayed
+ * later with wlr_input_replay. Pointer, keyboard, touch and tablet tool events
+ * are recorded along with the time they were received, from CLOCK_MONOTONIC.
+ *
+ * The recording is a text file with one event per line:
+ *
+ *     <usec> <device id> <event> <arguments...>
+ *
+ * where usec is the time elapsed since the recording started.
+ */
+struct wlr_input_recorder {
+	FILE *file;
+	uint64_t start_usec;
+	struct wl_list devices; // wlr_input_recorder_device::link
+	int next_device_id;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+struct wlr_input_recorder_device {
+	struct wlr_input_recorder *recorder;
+	struct wlr_input_device *device;
+	int id;
+	struct wl_list link; // wlr_input_recorder::devices
+
+	// private state
+
+	struct wl_listener motion;
+	struct wl_listener motion_absolute;
+	struct wl_listener button;
+	struct wl_listener axis;
+	struct wl_listener frame;
+	struct wl_listener key;
+	struct wl_listener touch_down;
+	struct wl_listener touch_up;
+	struct wl_listener touch_motion;
+	struct wl_listener touch_cancel;
+	struct wl_listener touch_frame;
+	struct wl_listener tool_axis;
+	struct wl_listener tool_proximity;
+	struct wl_listener tool_tip;
+	struct wl_listener tool_button;
+	struct wl_listener destroy;
+};
+
+/**
+ * Replays a recording made by wlr_input_recorder on the headless backend. A
+ * headless input device is added for each recorded device, and events are
+ * emitted on it at their recorded times divided by `speed`. Replayed events
+ * are timestamped with the current time.
+ */
+struct wlr_input_replay {
+	struct wlr_backend *backend;
+	FILE *file;
+	double speed;
+	uint64_t start_usec;
+	struct wl_list devices; // wlr_input_replay_device::link
+
+	struct {
+		// Emitted once all events have been replayed
+		struct wl_signal done;
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+
+	// private state
+
+	struct wl_event_source *timer;
+	char *line; // next event, NULL at the end of the file
+	size_t line_size;
+	uint64_t line_usec;
+	unsigned long line_number;
+
+	struct wl_listener backend_destroy;
+};
+
+struct wlr_input_replay_device {
+	struct wlr_input_replay *replay;
+	int id; // in the recording
+	struct wlr_input_device *device;
+	struct wl_list tools; // wlr_input_replay_tool::link
+	struct wl_list link; // wlr_input_replay::devices
+
+	// private state
+
+	struct wl_listener destroy;
+};
+
+struct wlr_input_replay_tool {
+	struct wlr_tablet_tool tool;
+	struct wl_list link; // wlr_input_replay_device::tools
+};
+
+/**
+ * Starts recording to the file. The file isn't closed when the recorder is
+ * destroyed.
+ */
+struct wlr_input_recorder *wlr_input_recorder_create(FILE *file);
+void wlr_input_recorder_destroy(struct wlr_input_recorder *recorder);
+/**
+ * Records the events of the device until it's destroyed. Switches and tablet
+ * pads are ignored.
+ */
+bool wlr_input_recorder_add_device(struct wlr_input_recorder *recorder,
+	struct wlr_input_device *device);
+
+/**
+ * Replays the recording read from the file on a headless backend. The replay
+ * is destroyed along with the backend. The file isn't closed when the replay
+ * is destroyed.
+ */
+struct wlr_input_replay *wlr_input_replay_create(struct wlr_backend *backend,
+	struct wl_event_loop *loop, FILE *file, double speed);
+/**
+ * Stops the replay and removes the input devices it added.
+ */
+void wlr_input_replay_destroy(struct wlr_input_replay *replay);
+
+#endif
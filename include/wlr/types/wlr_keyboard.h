@@ -50,8 +50,11 @@ struct wlr_keyboard_modifiers {
 struct wlr_keyboard {
 	const struct wlr_keyboard_impl *impl;
 
+	// Shared by all keyboards using the same keymap, must not be modified
 	char *keymap_string;
 	size_t keymap_size;
+	// Read-only file containing keymap_string, shared with all clients
+	int keymap_fd;
 	struct xkb_keymap *keymap;
 	struct xkb_state *xkb_state;
 	xkb_led_index_t led_indexes[WLR_LED_COUNT];
@@ -96,6 +99,7 @@ enum wlr_key_state {
 
 struct wlr_event_keyboard_key {
 	uint32_t time_msec;
+	uint64_t time_usec;
 	uint32_t keycode;
 	bool update_state; // if backend doesn't update modifiers on its own
 	enum wlr_key_state state;
@@ -103,6 +107,13 @@ struct wlr_event_keyboard_key {
 
 void wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 	struct xkb_keymap *keymap);
+/**
+ * Compiles a keymap from RMLVO names and sets it. Keymaps are cached while
+ * a keyboard uses them, so keyboards configured with the same names share
+ * the compiled keymap and its serialized form. Returns false on failure.
+ */
+bool wlr_keyboard_set_keymap_from_names(struct wlr_keyboard *kb,
+	const struct xkb_rule_names *names);
 /**
  * Sets the keyboard repeat info. `rate` is in key repeats/second and delay is
  * in milliseconds.
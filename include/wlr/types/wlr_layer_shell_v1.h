@@ -45,6 +45,21 @@ struct wlr_layer_shell_v1 {
 	void *data;
 };
 
+enum wlr_layer_surface_v1_state_field {
+	WLR_LAYER_SURFACE_V1_STATE_ANCHOR = 1 << 0,
+	WLR_LAYER_SURFACE_V1_STATE_EXCLUSIVE_ZONE = 1 << 1,
+	WLR_LAYER_SURFACE_V1_STATE_MARGIN = 1 << 2,
+	WLR_LAYER_SURFACE_V1_STATE_KEYBOARD_INTERACTIVE = 1 << 3,
+	WLR_LAYER_SURFACE_V1_STATE_DESIRED_SIZE = 1 << 4,
+};
+
+// Fields affecting the arrangement of surfaces on the output
+#define WLR_LAYER_SURFACE_V1_STATE_LAYOUT \
+	(WLR_LAYER_SURFACE_V1_STATE_ANCHOR | \
+	WLR_LAYER_SURFACE_V1_STATE_EXCLUSIVE_ZONE | \
+	WLR_LAYER_SURFACE_V1_STATE_MARGIN | \
+	WLR_LAYER_SURFACE_V1_STATE_DESIRED_SIZE)
+
 struct wlr_layer_surface_v1_state {
 	uint32_t anchor;
 	int32_t exclusive_zone;
@@ -84,6 +99,12 @@ struct wlr_layer_surface_v1 {
 	struct wlr_layer_surface_v1_state client_pending;
 	struct wlr_layer_surface_v1_state server_pending;
 	struct wlr_layer_surface_v1_state current;
+	/**
+	 * Fields of `current` changed by the last commit, a bitfield of
+	 * `enum wlr_layer_surface_v1_state_field`. Surfaces committing new
+	 * buffers only don't need to be arranged again.
+	 */
+	uint32_t current_changed;
 
 	struct wl_listener surface_destroy;
 
@@ -10,15 +10,21 @@
 #define WLR_TYPES_WLR_LINUX_DMABUF_H
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <wayland-server-protocol.h>
 #include <wlr/render/dmabuf.h>
 
+struct wlr_surface;
+
 struct wlr_dmabuf_v1_buffer {
 	struct wlr_renderer *renderer;
 	struct wl_resource *buffer_resource;
 	struct wl_resource *params_resource;
 	struct wlr_dmabuf_attributes attributes;
 	bool has_modifier;
+	// Imported when the buffer is created to check it's usable, NULL once
+	// taken by wlr_buffer_create
+	struct wlr_texture *texture;
 };
 
 /**
@@ -41,12 +47,51 @@ struct wlr_dmabuf_v1_buffer *wlr_dmabuf_v1_buffer_from_buffer_resource(
 struct wlr_dmabuf_v1_buffer *wlr_dmabuf_v1_buffer_from_params_resource(
 	struct wl_resource *params_resource);
 
+/**
+ * Takes the texture imported when the buffer was created, if it was imported
+ * into `renderer`. The caller becomes responsible for destroying it. Returns
+ * NULL if it's already been taken.
+ */
+struct wlr_texture *wlr_dmabuf_v1_buffer_take_texture(
+	struct wlr_dmabuf_v1_buffer *buffer, struct wlr_renderer *renderer);
+
+enum wlr_linux_dmabuf_feedback_v1_tranche_flags {
+	// The buffers can be scanned out directly, e.g. on a DRM plane
+	WLR_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_SCANOUT = 1 << 0,
+};
+
+struct wlr_linux_dmabuf_feedback_v1_tranche {
+	dev_t target_device;
+	uint32_t flags; // enum wlr_linux_dmabuf_feedback_v1_tranche_flags
+	// Format and modifier pairs, or NULL for all pairs supported by the
+	// renderer
+	const struct wlr_dmabuf_format *formats;
+	size_t formats_len;
+};
+
+/**
+ * Buffer format and modifier preferences, as a list of tranches in decreasing
+ * order of preference. Pairs which the renderer can't import are ignored.
+ */
+struct wlr_linux_dmabuf_feedback_v1 {
+	dev_t main_device;
+	const struct wlr_linux_dmabuf_feedback_v1_tranche *tranches;
+	size_t tranches_len;
+};
+
+struct wlr_linux_dmabuf_v1_feedback_compiled;
+
 /* the protocol interface */
 struct wlr_linux_dmabuf_v1 {
 	struct wl_global *global;
 	struct wlr_renderer *renderer;
 	struct wl_list resources;
 
+	// Built from the renderer formats. NULL if the renderer's DRM device is
+	// unknown, in which case feedback isn't supported.
+	struct wlr_linux_dmabuf_v1_feedback_compiled *default_feedback;
+	struct wl_list surfaces; // wlr_linux_dmabuf_v1_surface::link
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -72,4 +117,21 @@ void wlr_linux_dmabuf_v1_destroy(struct wlr_linux_dmabuf_v1 *linux_dmabuf);
 struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_from_resource(
 	struct wl_resource *resource);
 
+/**
+ * Returns the linux-dmabuf interface created for the display, e.g. by
+ * wlr_renderer_init_wl_display, or NULL.
+ */
+struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_from_display(
+	struct wl_display *display);
+
+/**
+ * Sets the buffer format and modifier preferences sent to clients for this
+ * surface, for instance to advertise the formats which can be scanned out
+ * while the surface is fullscreen. Passing NULL restores the default feedback.
+ * Returns false if feedback isn't supported or on error.
+ */
+bool wlr_linux_dmabuf_v1_set_surface_feedback(
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf, struct wlr_surface *surface,
+	const struct wlr_linux_dmabuf_feedback_v1 *feedback);
+
 #endif
@@ -15,6 +15,7 @@
 #include <wayland-server.h>
 #include <wayland-util.h>
 #include <wlr/render/dmabuf.h>
+#include <wlr/types/wlr_box.h>
 
 struct wlr_output_mode {
 	uint32_t flags; // enum wl_output_mode
@@ -23,6 +24,15 @@ struct wlr_output_mode {
 	struct wl_list link;
 };
 
+#define WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN 4
+
+// An image set with wlr_output_cursor_set_image
+struct wlr_output_cursor_image {
+	struct wlr_texture *texture;
+	uint8_t *pixels; // tightly packed copy, used to recognize the image
+	uint32_t width, height;
+};
+
 struct wlr_output_cursor {
 	struct wlr_output *output;
 	double x, y;
@@ -34,6 +44,9 @@ struct wlr_output_cursor {
 
 	// only when using a software cursor without a surface
 	struct wlr_texture *texture;
+	// Recently set images, most recent first. Setting one of them again
+	// reuses its texture, which lets backends cache their own copy.
+	struct wlr_output_cursor_image images[WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN];
 
 	// only when using a cursor surface
 	struct wlr_surface *surface;
@@ -45,6 +58,53 @@ struct wlr_output_cursor {
 	} events;
 };
 
+/**
+ * Timestamps of a rendered frame, in nanoseconds on the backend's presentation
+ * clock. See wlr_output_enable_frame_timings.
+ */
+struct wlr_output_frame_timing {
+	uint32_t commit_seq; // see wlr_output::commit_seq
+	int64_t frame; // `frame` event emission
+	int64_t make_current; // first `wlr_output_make_current` call, 0 if none
+	int64_t swap_buffers;
+	int64_t present; // 0 if not presented yet
+	unsigned missed; // vblanks missed before the frame was presented
+};
+
+enum wlr_output_adaptive_sync_status {
+	WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED,
+	WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED,
+};
+
+enum wlr_output_state_field {
+	WLR_OUTPUT_STATE_ENABLED = 1 << 0,
+	WLR_OUTPUT_STATE_MODE = 1 << 1,
+	WLR_OUTPUT_STATE_TRANSFORM = 1 << 2,
+	WLR_OUTPUT_STATE_SCALE = 1 << 3,
+	WLR_OUTPUT_STATE_GAMMA = 1 << 4,
+	WLR_OUTPUT_STATE_ADAPTIVE_SYNC = 1 << 5,
+};
+
+/**
+ * Output configuration changes staged by the `wlr_output_pending_*` functions
+ * and applied by `wlr_output_commit`.
+ */
+struct wlr_output_state {
+	uint32_t committed; // enum wlr_output_state_field
+	bool enabled;
+	struct wlr_output_mode *mode; // NULL for a custom mode
+	int32_t custom_width, custom_height, custom_refresh;
+	enum wl_output_transform transform;
+	float scale;
+	bool adaptive_sync_enabled;
+	size_t gamma_size;
+	uint16_t *gamma_lut; // red, green and blue ramps of gamma_size each
+};
+
+#define WLR_OUTPUT_RENDER_TIME_SAMPLES 8
+#define WLR_OUTPUT_FRAME_TIMERS 3
+#define WLR_OUTPUT_FRAME_TIMINGS_LEN 128
+
 struct wlr_output_impl;
 
 /**
@@ -77,16 +137,26 @@ struct wlr_output {
 	int32_t refresh; // mHz, may be zero
 
 	bool enabled;
+	// Whether the display is turned off, see wlr_output_set_dpms
+	bool dpms_off;
 	float scale;
 	enum wl_output_subpixel subpixel;
 	enum wl_output_transform transform;
+	enum wlr_output_adaptive_sync_status adaptive_sync_status;
+	// Whether attached buffers may be presented without waiting for vblank,
+	// see wlr_output_set_tearing
+	bool tearing;
 
 	bool needs_swap;
+	// Incremented on each buffer swap, before the backend swaps buffers
+	uint32_t commit_seq;
 	// damage for cursors and fullscreen surface, in output-local coordinates
 	pixman_region32_t damage;
 	bool frame_pending;
 	float transform_matrix[9];
 
+	struct wlr_output_state pending;
+
 	struct {
 		// Request to render a frame
 		struct wl_signal frame;
@@ -97,7 +167,14 @@ struct wlr_output {
 		struct wl_signal swap_buffers; // wlr_output_event_swap_buffers
 		// Emitted right after the buffer has been presented to the user
 		struct wl_signal present; // wlr_output_event_present
+		struct wl_signal frame_stats; // wlr_output_event_frame_stats
+		// Emitted when the backend failed to present a frame
+		struct wl_signal flip_error; // wlr_output_event_flip_error
+		// Emitted when the hardware cursor moves, changes or is hidden. These
+		// changes don't damage the output.
+		struct wl_signal hardware_cursor;
 		struct wl_signal enable;
+		struct wl_signal dpms;
 		struct wl_signal mode;
 		struct wl_signal scale;
 		struct wl_signal transform;
@@ -105,10 +182,47 @@ struct wlr_output {
 	} events;
 
 	struct wl_event_source *idle_frame;
+	// Properties changed since the last done event was sent to clients,
+	// flushed once per event loop iteration
+	struct wl_event_source *idle_done;
+	uint32_t pending_done;
+
+	// See wlr_output_enable_render_deadline
+	struct {
+		bool enabled;
+		bool frame_delayed;
+		struct wl_event_source *timer;
+		int64_t frame_start; // nsec, 0 if no frame is being rendered
+		int64_t last_present; // nsec
+		int refresh; // nsec
+		int64_t samples[WLR_OUTPUT_RENDER_TIME_SAMPLES]; // nsec
+		size_t samples_len, samples_idx;
+	} render_deadline;
+
+	// See wlr_output_enable_frame_stats
+	struct {
+		bool enabled;
+		int64_t frame_start; // nsec, 0 if no frame is being rendered
+		// GPU results lag a few frames behind, one slot per frame in flight
+		struct wlr_render_timer *timers[WLR_OUTPUT_FRAME_TIMERS];
+		int64_t cpu_times[WLR_OUTPUT_FRAME_TIMERS]; // nsec, -1 if unused
+		size_t idx;
+	} frame_stats;
+
+	// See wlr_output_enable_frame_timings
+	struct {
+		bool enabled;
+		// Ring buffer of the last WLR_OUTPUT_FRAME_TIMINGS_LEN swapped frames
+		struct wlr_output_frame_timing *frames;
+		size_t len, idx;
+		struct wlr_output_frame_timing current; // frame being rendered
+		uint64_t missed; // vblanks missed since enabled
+	} frame_timings;
 
 	struct wl_list cursors; // wlr_output_cursor::link
 	struct wlr_output_cursor *hardware_cursor;
 	int software_cursor_locks; // number of locks forcing software cursors
+	int attach_render_locks; // number of locks forcing rendering
 
 	// the output position in layout space reported to clients
 	int32_t lx, ly;
@@ -144,19 +258,133 @@ struct wlr_output_event_present {
 	struct timespec *when;
 	// Vertical retrace counter. Zero if unavailable.
 	unsigned seq;
+	// wlr_output::commit_seq of the buffer swap being presented. Zero if the
+	// latest one.
+	uint32_t commit_seq;
 	// Prediction of how many nanoseconds after `when` the very next output
 	// refresh may occur. Zero if unknown.
 	int refresh; // nsec
 	uint32_t flags; // enum wlr_output_present_flag
+	// Whether the refresh rate varied to follow the content. If so, `refresh`
+	// is zero since the next refresh can't be predicted.
+	bool adaptive_sync;
+};
+
+enum wlr_output_flip_recovery {
+	// The failure couldn't be recovered from, the frame is lost
+	WLR_OUTPUT_FLIP_RECOVERY_NONE,
+	// The hardware was busy, the frame is submitted again on the next vblank
+	WLR_OUTPUT_FLIP_RECOVERY_RETRY,
+	// The configuration was rejected, the frame is presented without the
+	// parts that failed (e.g. direct scan-out or overlays)
+	WLR_OUTPUT_FLIP_RECOVERY_FALLBACK,
+	// The link to the display failed, a modeset retrains it
+	WLR_OUTPUT_FLIP_RECOVERY_RETRAIN,
+	// Retried after a refresh period
+	WLR_OUTPUT_FLIP_RECOVERY_DELAYED,
+};
+
+struct wlr_output_event_flip_error {
+	struct wlr_output *output;
+	int error; // errno value of the failure
+	enum wlr_output_flip_recovery recovery;
+};
+
+struct wlr_output_event_frame_stats {
+	struct wlr_output *output;
+	// Time spent between `wlr_output_make_current` and the buffer swap
+	int64_t cpu_time; // nsec
+	// Time the GPU spent executing the frame's commands, -1 if unavailable
+	int64_t gpu_time; // nsec
+};
+
+struct wlr_output_timing_percentiles {
+	int64_t p50, p90, p99, max; // nsec
+};
+
+struct wlr_output_frame_timings_summary {
+	// Number of presented frames the percentiles are computed from
+	size_t frames;
+	// Time between the presentation of consecutive frames
+	struct wlr_output_timing_percentiles frame_time;
+	// Time between `wlr_output_make_current` and the buffer swap
+	struct wlr_output_timing_percentiles render_time;
+	// Time between `wlr_output_make_current` and the presentation
+	struct wlr_output_timing_percentiles render_to_present;
+	// Vblanks missed since frame timings were enabled
+	uint64_t missed;
 };
 
 struct wlr_surface;
+struct wlr_buffer;
 
+/**
+ * A client buffer that the compositor would like to display on a hardware
+ * overlay plane instead of compositing it.
+ */
+struct wlr_output_overlay {
+	struct wlr_buffer *buffer;
+	// Destination rectangle, in output-buffer-local coordinates
+	struct wlr_box box;
+	// Set by the backend if the buffer will be displayed on a plane
+	bool accepted;
+};
+
+/**
+ * Stages enabling or disabling the output for the next `wlr_output_commit`.
+ * Disabling the output discards the other pending changes except the
+ * transform and scale.
+ */
+void wlr_output_pending_enable(struct wlr_output *output, bool enable);
+/**
+ * Stages a mode for the next `wlr_output_commit`. The output is enabled by
+ * the commit if it's currently disabled.
+ */
+void wlr_output_pending_set_mode(struct wlr_output *output,
+	struct wlr_output_mode *mode);
+void wlr_output_pending_set_custom_mode(struct wlr_output *output,
+	int32_t width, int32_t height, int32_t refresh);
+void wlr_output_pending_set_transform(struct wlr_output *output,
+	enum wl_output_transform transform);
+void wlr_output_pending_set_scale(struct wlr_output *output, float scale);
+void wlr_output_pending_enable_adaptive_sync(struct wlr_output *output,
+	bool enabled);
+/**
+ * Stages a gamma table for the next `wlr_output_commit`, see
+ * `wlr_output_set_gamma`. The ramps are copied. Returns false on allocation
+ * failure.
+ */
+bool wlr_output_pending_set_gamma(struct wlr_output *output, size_t size,
+	const uint16_t *r, const uint16_t *g, const uint16_t *b);
+/**
+ * Applies all pending changes at once and clears them. Changes the backend
+ * handles in hardware are grouped: with atomic DRM, the gamma table and
+ * adaptive sync are submitted along with the modeset in a single commit, and
+ * enabling an output with a new mode costs a single modeset. Buffer swaps
+ * stay separate, see `wlr_output_swap_buffers`.
+ *
+ * Returns false if a change couldn't be applied. The changes which have
+ * succeeded are kept.
+ */
+bool wlr_output_commit(struct wlr_output *output);
+/**
+ * Discards all pending changes.
+ */
+void wlr_output_rollback(struct wlr_output *output);
 /**
  * Enables or disables the output. A disabled output is turned off and doesn't
  * emit `frame` events.
  */
 bool wlr_output_enable(struct wlr_output *output, bool enable);
+/**
+ * Turns the display of an enabled output off or back on. Unlike
+ * `wlr_output_enable`, the mode and the resources allocated by the backend are
+ * kept, so that turning the display back on is quick. While the display is
+ * off, no `frame` events are emitted: compositors stop rendering the output
+ * and sending frame callbacks to its surfaces. Turning it back on damages the
+ * whole output and schedules a frame.
+ */
+bool wlr_output_set_dpms(struct wlr_output *output, bool on);
 void wlr_output_create_global(struct wlr_output *output);
 void wlr_output_destroy_global(struct wlr_output *output);
 /**
@@ -172,6 +400,24 @@ bool wlr_output_set_custom_mode(struct wlr_output *output, int32_t width,
 	int32_t height, int32_t refresh);
 void wlr_output_set_transform(struct wlr_output *output,
 	enum wl_output_transform transform);
+/**
+ * Enables or disables adaptive sync (ie. variable refresh rate) on this
+ * output. With adaptive sync the display refreshes as soon as a new frame is
+ * submitted, within the limits of the monitor. Returns false if the output or
+ * its backend don't support it.
+ */
+bool wlr_output_enable_adaptive_sync(struct wlr_output *output, bool enabled);
+/**
+ * Allows the buffers attached with `wlr_output_attach_buffer` to be presented
+ * as soon as possible instead of at the next vblank, at the cost of tearing.
+ * Rendered frames are always synchronized. Backends which can't flip
+ * asynchronously present as usual. The present event of a torn frame doesn't
+ * have the `WLR_OUTPUT_PRESENT_VSYNC` flag.
+ *
+ * This is meant for latency-sensitive fullscreen clients, the compositor
+ * should only allow it while such a client is scanned out.
+ */
+void wlr_output_set_tearing(struct wlr_output *output, bool tearing);
 void wlr_output_set_position(struct wlr_output *output, int32_t lx, int32_t ly);
 void wlr_output_set_scale(struct wlr_output *output, float scale);
 void wlr_output_set_subpixel(struct wlr_output *output, enum wl_output_subpixel subpixel);
@@ -211,11 +457,94 @@ bool wlr_output_preferred_read_format(struct wlr_output *output,
  */
 bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 	pixman_region32_t *damage);
+/**
+ * Hints the backend that only `damage` (in output-buffer-local coordinates) is
+ * going to be redrawn in the current frame. This lets tile-based GPUs skip
+ * restoring the rest of the buffer from memory. It must be called right after
+ * `wlr_output_make_current`, before rendering anything, and only the damaged
+ * region must be rendered afterwards. Returns false if unsupported.
+ */
+bool wlr_output_set_damage_region(struct wlr_output *output,
+	pixman_region32_t *damage);
+/**
+ * Attaches a client buffer to the output, to be displayed as-is on the next
+ * call to `wlr_output_swap_buffers` instead of the rendered content. This
+ * avoids a composition pass, for instance when a fullscreen surface covers the
+ * whole output.
+ *
+ * The buffer must have the same size as the output and the output must not be
+ * transformed. Returns false if the backend can't display the buffer, in which
+ * case the compositor should render as usual. The attachment is discarded by
+ * the next call to `wlr_output_make_current`.
+ */
+bool wlr_output_attach_buffer(struct wlr_output *output,
+	struct wlr_buffer *buffer);
+/**
+ * Tries to display client buffers on hardware overlay planes for the next
+ * frame. Overlays are stacked above the rendered content, so only buffers that
+ * nothing else covers should be proposed, in order of preference.
+ *
+ * The backend sets `accepted` on each overlay it is able to display. The
+ * compositor must skip rendering those and render all others as usual. This
+ * needs to be called before `wlr_output_make_current` for each frame:
+ * overlays not assigned again are removed on the next buffer swap. Returns the
+ * number of accepted overlays.
+ */
+size_t wlr_output_assign_overlays(struct wlr_output *output,
+	struct wlr_output_overlay *overlays, size_t len);
+/**
+ * Enables or disables render-deadline scheduling. When enabled, the `frame`
+ * event following a presentation is delayed until just before the next
+ * vblank, minus the time recent frames took to render (measured from the
+ * `frame` event to the buffer swap). This trades idle time at the start of the
+ * refresh cycle for lower input-to-photon latency.
+ */
+void wlr_output_enable_render_deadline(struct wlr_output *output,
+	bool enabled);
+/**
+ * Enables or disables frame statistics. When enabled, a `frame_stats` event is
+ * emitted for each rendered frame with the CPU time spent submitting it and,
+ * if the renderer supports timer queries, the GPU time spent executing it. GPU
+ * results are collected asynchronously, so events are emitted a few frames
+ * late.
+ */
+void wlr_output_enable_frame_stats(struct wlr_output *output, bool enabled);
+/**
+ * Enables or disables frame timings. When enabled, the times at which the
+ * `frame` event is emitted, the output is made current, buffers are swapped
+ * and the frame is presented are recorded for the last
+ * WLR_OUTPUT_FRAME_TIMINGS_LEN frames. A frame is counted as missed when it is
+ * presented after the first vblank following its buffer swap. Disabling frame
+ * timings discards the recorded frames. Returns false on allocation failure.
+ */
+bool wlr_output_enable_frame_timings(struct wlr_output *output, bool enabled);
+/**
+ * Copies up to `len` of the most recently swapped frames to `frames`, oldest
+ * first. Frames still waiting to be presented have a zero `present` timestamp.
+ * Returns the number of frames copied.
+ */
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+	struct wlr_output_frame_timing *frames, size_t len);
+/**
+ * Computes frame time and latency percentiles over the recorded frames which
+ * have been presented. Durations which can't be computed are zero. Returns
+ * false if frame timings are disabled.
+ */
+bool wlr_output_get_frame_timings_summary(struct wlr_output *output,
+	struct wlr_output_frame_timings_summary *summary);
 /**
  * Manually schedules a `frame` event. If a `frame` event is already pending,
  * it is a no-op.
  */
 void wlr_output_schedule_frame(struct wlr_output *output);
+/**
+ * Predict when the next frame will be presented, based on the timestamp and
+ * refresh period of the last presentation. `when` uses the backend's
+ * presentation clock. Returns false if the output hasn't presented anything
+ * yet or if its refresh rate is unknown, e.g. with adaptive sync.
+ */
+bool wlr_output_predict_next_present(struct wlr_output *output,
+	struct timespec *when);
 /**
  * Returns the maximum length of each gamma ramp, or 0 if unsupported.
  */
@@ -240,12 +569,33 @@ struct wlr_output *wlr_output_from_resource(struct wl_resource *resource);
  * a lock.
  */
 void wlr_output_lock_software_cursors(struct wlr_output *output, bool lock);
+/**
+ * Locks the output to always composite its content instead of displaying
+ * buffers attached with `wlr_output_attach_buffer`. This is required when the
+ * rendered content is read back (e.g. during screen capture). Locks and unlocks
+ * must be balanced like `wlr_output_lock_software_cursors`.
+ */
+void wlr_output_lock_attach_render(struct wlr_output *output, bool lock);
 /**
  * Renders software cursors. This is a utility function that can be called when
  * compositors render.
  */
 void wlr_output_render_software_cursors(struct wlr_output *output,
 	pixman_region32_t *damage);
+/**
+ * Gets the box of the hardware cursor in output-buffer-local coordinates.
+ * Returns false if there is no visible hardware cursor.
+ */
+bool wlr_output_get_hardware_cursor_box(struct wlr_output *output,
+	struct wlr_box *box);
+/**
+ * Renders the hardware cursor into the current render target, which holds the
+ * part `box` of the output buffer, oriented like pixels read from the output.
+ * Screen capture uses this to show the cursor in a copy of the output without
+ * disabling the hardware cursor.
+ */
+void wlr_output_render_hardware_cursor(struct wlr_output *output,
+	const struct wlr_box *box);
 
 
 struct wlr_output_cursor *wlr_output_cursor_create(struct wlr_output *output);
@@ -0,0 +1,69 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_OUTPUT_CONTENT_RATE_H
+#define WLR_TYPES_WLR_OUTPUT_CONTENT_RATE_H
+
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+
+#define WLR_OUTPUT_CONTENT_RATE_SAMPLES 24
+
+/**
+ * Matches the refresh rate of an output to the frame rate of its fullscreen
+ * content, e.g. 24 fps video.
+ *
+ * The frame rate is measured from the intervals between the surface's buffer
+ * commits. Once it's steady, the output switches to a mode with the same
+ * resolution whose refresh rate is a multiple of the content's. The previous
+ * mode is restored when the surface stops being fullscreen, when its frame
+ * rate changes or when the helper is destroyed. Nothing is switched if the
+ * current mode already fits, or if the compositor changes the mode itself.
+ */
+struct wlr_output_content_rate {
+	struct wlr_output *output;
+	struct wlr_surface *surface; // NULL if there is no fullscreen surface
+
+	// Times of the last buffer commits, a ring buffer
+	struct timespec commits[WLR_OUTPUT_CONTENT_RATE_SAMPLES];
+	size_t commits_len, commits_idx;
+	int32_t content_rate; // mHz, 0 if unknown or irregular
+
+	// The mode to restore, NULL if the mode hasn't been switched
+	struct wlr_output_mode *restore_mode;
+	bool switching;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	struct wl_listener surface_commit;
+	struct wl_listener surface_destroy;
+	struct wl_listener output_mode;
+	struct wl_listener output_destroy;
+
+	void *data;
+};
+
+struct wlr_output_content_rate *wlr_output_content_rate_create(
+	struct wlr_output *output);
+/**
+ * Destroys the helper, restoring the output's mode if it has been switched.
+ */
+void wlr_output_content_rate_destroy(
+	struct wlr_output_content_rate *content_rate);
+/**
+ * Sets the surface covering the whole output, or NULL if there is none. It's
+ * cheap to call this on each frame.
+ */
+void wlr_output_content_rate_set_surface(
+	struct wlr_output_content_rate *content_rate, struct wlr_surface *surface);
+
+#endif
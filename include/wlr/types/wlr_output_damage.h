@@ -17,10 +17,21 @@
 /**
  * Damage tracking requires to keep track of previous frames' damage. To allow
  * damage tracking to work with triple buffering, a history of two frames is
- * required.
+ * required. This is the default history length, see
+ * `wlr_output_damage_set_previous_len`.
  */
 #define WLR_OUTPUT_DAMAGE_PREVIOUS_LEN 2
 
+// Number of frames whose damage is shown by the debug overlay, and number of
+// frames in its damaged area graph
+#define WLR_OUTPUT_DAMAGE_DEBUG_FRAMES 30
+#define WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN 120
+
+// Number of frames whose render time is averaged to check the render budget
+#define WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES 8
+
+struct wlr_renderer;
+
 /**
  * Tracks damage for an output.
  *
@@ -31,16 +42,65 @@
  */
 struct wlr_output_damage {
 	struct wlr_output *output;
-	int max_rects; // max number of damaged rectangles
+	// Max number of damaged rectangles, the damage is simplified into at most
+	// this many clusters beyond that
+	int max_rects;
 
 	pixman_region32_t current; // in output-local coordinates
 
 	// circular queue for previous damage
-	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_LEN];
+	pixman_region32_t *previous;
+	size_t previous_len;
 	size_t previous_idx;
+	// Age of the buffer made current by `wlr_output_damage_make_current`, 0
+	// if unknown. With an age of 1, the buffer holds the last frame.
+	int buffer_age;
+
+	// Optional tile bitmap accumulating damage for the current frame, one bit
+	// per tile, merged into `current` before it is read. See
+	// `wlr_output_damage_set_tile_size`.
+	int tile_size; // 0 if disabled
+	uint64_t *tiles;
+	int tiles_width, tiles_height;
+	size_t tiles_stride; // number of 64-bit words per row
+	bool tiles_dirty;
+
+	// See wlr_output_damage_enable_debug
+	struct {
+		bool enabled;
+		// circular queue of the damage of recent frames, most recent first
+		pixman_region32_t frames[WLR_OUTPUT_DAMAGE_DEBUG_FRAMES];
+		size_t frames_idx;
+		// circular queue of the damaged fraction of the output per frame
+		float area[WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN];
+		size_t area_len, area_idx;
+	} debug;
+
+	// See wlr_output_damage_set_render_budget
+	struct {
+		int64_t budget; // nsec, 0 if disabled
+		int64_t samples[WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES]; // nsec
+		size_t samples_len, samples_idx;
+	} render_time;
+	// Whether rendering is over budget and should be made cheaper
+	bool degraded;
+
+	// See wlr_output_damage_set_idle_refresh
+	struct {
+		int timeout; // msec, 0 if disabled
+		struct wl_event_source *timer;
+		bool idle; // the output refreshes at a lower rate
+		bool wake; // leave idle at the next frame
+		bool switching; // ignore damage caused by our own changes
+		bool adaptive_sync; // enabled when going idle
+		// Mode set when going idle, and the one to restore
+		struct wlr_output_mode *idle_mode, *restore_mode;
+	} idle_refresh;
 
 	struct {
 		struct wl_signal frame;
+		// Emitted when `degraded` changes
+		struct wl_signal degraded;
 		struct wl_signal destroy;
 	} events;
 
@@ -50,10 +110,77 @@ struct wlr_output_damage {
 	struct wl_listener output_scale;
 	struct wl_listener output_needs_swap;
 	struct wl_listener output_frame;
+	struct wl_listener output_hardware_cursor;
+	struct wl_listener output_frame_stats;
 };
 
 struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output);
 void wlr_output_damage_destroy(struct wlr_output_damage *output_damage);
+/**
+ * Sets the number of previous frames whose damage is kept. Drivers queueing
+ * more buffers, e.g. with quad buffering, need a longer history for damage
+ * tracking to be used, instead of repainting the whole output. Changing the
+ * length damages the whole output for the frames which weren't tracked.
+ */
+bool wlr_output_damage_set_previous_len(struct wlr_output_damage *output_damage,
+	size_t len);
+/**
+ * Accumulates damage in a bitmap of `tile_size`x`tile_size` tiles instead of a
+ * region. Adding damage is then constant-time per damaged row of tiles, which
+ * is cheaper than region unions when many small surfaces are damaged, at the
+ * cost of rounding the damage up to the tile grid. Set `tile_size` to 0 to
+ * go back to region accumulation.
+ */
+bool wlr_output_damage_set_tile_size(struct wlr_output_damage *output_damage,
+	int tile_size);
+/**
+ * Enables or disables the damage debug overlay. When enabled, the damage of
+ * each frame is recorded and the whole output is repainted, so that
+ * `wlr_output_damage_render_debug` can draw over it.
+ */
+void wlr_output_damage_enable_debug(struct wlr_output_damage *output_damage,
+	bool enabled);
+/**
+ * Renders the damage debug overlay on top of the current frame: the damage of
+ * recent frames is shown in red, fading as frames get older, so that regions
+ * damaged over and over again stand out. A graph in the bottom-left corner
+ * shows the damaged fraction of the output for each frame, full-output damage
+ * is drawn in red. This should be called right before `wlr_renderer_end`.
+ */
+void wlr_output_damage_render_debug(struct wlr_output_damage *output_damage,
+	struct wlr_renderer *renderer);
+/**
+ * Sets the render time budget, in nanoseconds. The render time of a frame is
+ * the largest of its CPU and GPU times reported by the output's frame
+ * statistics, which are enabled for this, see wlr_output_enable_frame_stats.
+ * It is averaged over the last WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES frames. When
+ * the average exceeds the budget, the output damage becomes `degraded` until
+ * it drops below three quarters of the budget.
+ *
+ * While degraded, damage is simplified into a quarter of `max_rects` to save
+ * draw calls. Compositors should listen to the `degraded` event to make
+ * rendering cheaper too, e.g. by throttling hidden surfaces or skipping
+ * effects. Set `budget` to 0 to disable.
+ */
+void wlr_output_damage_set_render_budget(
+	struct wlr_output_damage *output_damage, int64_t budget);
+/**
+ * Lowers the refresh rate of the output when nothing has been damaged for
+ * `timeout` milliseconds, to save power on static screens. Adaptive sync is
+ * enabled if the output supports it, so that the display drops to its minimum
+ * rate while no frames are submitted. Otherwise, the mode with the same
+ * resolution and the lowest refresh rate is set. This costs a modeset, and
+ * like any mode change it is announced to clients with wl_output mode events.
+ *
+ * The previous state is restored at the next frame after damage is added or
+ * the hardware cursor moves, before the `frame` event is emitted. With a
+ * lowered mode, that frame comes at the idle rate, so the first frame after
+ * waking up can be late by up to one idle refresh period. Displays with Panel
+ * Self Refresh enter it on their own while no frames are submitted. Set
+ * `timeout` to 0 to disable.
+ */
+bool wlr_output_damage_set_idle_refresh(
+	struct wlr_output_damage *output_damage, int timeout);
 /**
  * Makes the output rendering context current. `needs_swap` is set to true if
  * `wlr_output_damage_swap_buffers` needs to be called. The region of the output
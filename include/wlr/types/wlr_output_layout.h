@@ -10,11 +10,13 @@
 #define WLR_TYPES_WLR_OUTPUT_LAYOUT_H
 
 #include <stdbool.h>
-#include <wayland-util.h>
+#include <stdint.h>
+#include <wayland-server.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output.h>
 
 struct wlr_output_layout_state;
+struct wlr_surface;
 
 struct wlr_output_layout {
 	struct wl_list outputs;
@@ -42,6 +44,31 @@ struct wlr_output_layout_output {
 	} events;
 };
 
+/**
+ * Tracks the outputs of a layout a surface intersects, and sends the surface
+ * enter and leave events as it moves or the layout changes. Outputs are
+ * tracked in a bitmask, so moving a surface only sends events for the outputs
+ * whose intersection with it actually changed. At most 32 outputs are tracked
+ * per layout.
+ */
+struct wlr_output_layout_surface {
+	struct wlr_output_layout *layout; // NULL if the layout was destroyed
+	struct wlr_surface *surface; // NULL if the surface was destroyed
+	struct wlr_box box; // in layout coordinates
+
+	struct {
+		// Emitted after the surface is sent an enter or leave event
+		struct wl_signal output_enter; // struct wlr_output *
+		struct wl_signal output_leave; // struct wlr_output *
+	} events;
+
+	// private state
+
+	struct wl_list link; // wlr_output_layout_state::surfaces
+	uint32_t outputs; // bitmask of the intersected outputs
+	struct wl_listener surface_destroy;
+};
+
 /**
  * Creates a wlr_output_layout, which can be used to describing outputs in
  * physical space relative to one another, and perform various useful operations
@@ -112,6 +139,31 @@ void wlr_output_layout_add_auto(struct wlr_output_layout *layout,
 struct wlr_output *wlr_output_layout_get_center_output(
 		struct wlr_output_layout *layout);
 
+/**
+ * Starts tracking the outputs the surface intersects. The surface doesn't
+ * intersect any output until its box is set.
+ */
+struct wlr_output_layout_surface *wlr_output_layout_surface_create(
+		struct wlr_output_layout *layout, struct wlr_surface *surface);
+/**
+ * Stops tracking the surface. No leave events are sent.
+ */
+void wlr_output_layout_surface_destroy(
+		struct wlr_output_layout_surface *layout_surface);
+/**
+ * Sets the box of the surface in layout coordinates, sending enter and leave
+ * events for the outputs it started or stopped intersecting.
+ */
+void wlr_output_layout_surface_set_box(
+		struct wlr_output_layout_surface *layout_surface,
+		const struct wlr_box *box);
+/**
+ * Whether the surface currently intersects the output.
+ */
+bool wlr_output_layout_surface_intersects(
+		struct wlr_output_layout_surface *layout_surface,
+		struct wlr_output *output);
+
 enum wlr_direction {
 	WLR_DIRECTION_UP = 1,
 	WLR_DIRECTION_DOWN = 2,
@@ -0,0 +1,63 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_OUTPUT_MIRROR_H
+#define WLR_TYPES_WLR_OUTPUT_MIRROR_H
+
+#include <pixman.h>
+#include <wayland-server.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output.h>
+
+/**
+ * Displays the content of a source output on a destination output, without
+ * rendering the scene a second time.
+ *
+ * Each frame presented on the source output is exported as a DMA-BUF and
+ * imported as a texture, which is then drawn on the destination output. Only
+ * the damage reported by the source output is repainted, and the content is
+ * only scaled if the resolutions differ. Both outputs must be driven by the
+ * same GPU.
+ *
+ * The mirror renders the destination output from its `frame` event: the
+ * compositor must not render on it while it is mirroring.
+ */
+struct wlr_output_mirror {
+	struct wlr_output *src;
+	struct wlr_output_damage *dst_damage;
+
+	struct wlr_texture *texture; // last frame presented on the source
+	pixman_region32_t pending_damage; // source buffer-local coordinates
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	struct wl_listener src_swap_buffers;
+	struct wl_listener src_present;
+	struct wl_listener src_destroy;
+	struct wl_listener dst_frame;
+	struct wl_listener dst_destroy;
+
+	void *data;
+};
+
+/**
+ * Starts mirroring `src` on the output tracked by `dst_damage`. Returns NULL
+ * if the source output can't export its buffers.
+ */
+struct wlr_output_mirror *wlr_output_mirror_create(struct wlr_output *src,
+	struct wlr_output_damage *dst_damage);
+/**
+ * Stops mirroring. The compositor is responsible for rendering the destination
+ * output again.
+ */
+void wlr_output_mirror_destroy(struct wlr_output_mirror *mirror);
+
+#endif
@@ -34,8 +34,14 @@ struct wlr_presentation_feedback {
 	bool committed;
 	struct wl_list link; // wlr_presentation::feedbacks
 
+	// Output the committed content has been sampled for, NULL if it hasn't
+	// been displayed yet
+	struct wlr_output *output;
+
 	struct wl_listener surface_commit;
 	struct wl_listener surface_destroy;
+	struct wl_listener output_present;
+	struct wl_listener output_destroy;
 };
 
 struct wlr_presentation_event {
@@ -55,5 +61,18 @@ void wlr_presentation_destroy(struct wlr_presentation *presentation);
 void wlr_presentation_send_surface_presented(
 	struct wlr_presentation *presentation, struct wlr_surface *surface,
 	struct wlr_presentation_event *event);
+/**
+ * Mark the surface's current content as sampled for the frame being displayed
+ * on `output`, e.g. because it has been rendered or scanned out. Feedback for
+ * this content is sent automatically when the output emits its next `present`
+ * event. Content superseded by a new commit before being sampled is reported
+ * as discarded.
+ *
+ * Compositors using this function shouldn't call
+ * wlr_presentation_send_surface_presented.
+ */
+void wlr_presentation_surface_sampled_on_output(
+	struct wlr_presentation *presentation, struct wlr_surface *surface,
+	struct wlr_output *output);
 
 #endif
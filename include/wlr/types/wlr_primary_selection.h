@@ -30,7 +30,7 @@ struct wlr_primary_selection_source {
 	const struct wlr_primary_selection_source_impl *impl;
 
 	// source metadata
-	struct wl_array mime_types;
+	struct wl_array mime_types; // const char *, see wlr/util/mime_type.h
 
 	struct {
 		struct wl_signal destroy;
@@ -0,0 +1,84 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_PROTOCOL_RECORDER_H
+#define WLR_TYPES_WLR_PROTOCOL_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server.h>
+
+/**
+ * Records the requests sent by all clients of a display to a file, so that
+ * the clients can be recreated later, e.g. by the protocol-replay example.
+ * Events are not recorded.
+ *
+ * The recording is a text file with one request per line:
+ *
+ *     <usec> <client id> <interface>@<object id>.<request> <arguments...>
+ *
+ * where usec is the time elapsed since the recording started. Arguments are
+ * written in the order of the request signature:
+ *
+ * - integers, object and new IDs in decimal, 0 for a NULL object
+ * - fixed-point numbers as their raw 24.8 value
+ * - strings quoted, with C escapes, or `-` if NULL
+ * - arrays as hexadecimal bytes in brackets
+ * - file descriptors as the size of the file they refer to, -1 if it isn't a
+ *   regular file
+ *
+ * Two more kinds of lines are recorded:
+ *
+ *     <usec> <client id> buffer <buffer id> <hash>
+ *     <usec> <client id> disconnect
+ *
+ * The first one is only written if `hash_buffers` is set, right before a shm
+ * buffer is attached to a surface, with a 64-bit FNV-1a hash of its content.
+ */
+struct wlr_protocol_recorder {
+	FILE *file;
+	uint64_t start_usec;
+	// Set to record a hash of shm buffers attached to surfaces. This reads
+	// all of their pixels for each commit.
+	bool hash_buffers;
+	struct wl_list clients; // wlr_protocol_recorder_client::link
+	int next_client_id;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+
+	// private state
+
+	struct wl_protocol_logger *logger;
+	struct wl_listener display_destroy;
+};
+
+struct wlr_protocol_recorder_client {
+	struct wlr_protocol_recorder *recorder;
+	struct wl_client *client;
+	int id;
+	struct wl_list link; // wlr_protocol_recorder::clients
+
+	// private state
+
+	struct wl_listener destroy;
+};
+
+/**
+ * Starts recording the requests of the display's clients to the file. The
+ * file isn't closed when the recorder is destroyed.
+ */
+struct wlr_protocol_recorder *wlr_protocol_recorder_create(
+	struct wl_display *display, FILE *file);
+void wlr_protocol_recorder_destroy(struct wlr_protocol_recorder *recorder);
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_SCENE_H
+#define WLR_TYPES_WLR_SCENE_H
+
+/**
+ * The scene-graph API provides a declarative way to display surfaces. The
+ * compositor creates a scene, adds surfaces, then displays the scene on an
+ * output. The scene-graph API only supports basic 2D composition operations
+ * (like the KMS API or the Wayland protocol does). For anything more
+ * complicated, compositors need to implement custom rendering logic.
+ *
+ * Nodes are kept in a tree: each node has a position relative to its parent
+ * and its children are rendered above it, the last child at the top. Changing
+ * the tree damages the affected parts of each output, and each output only
+ * repaints what has been damaged and isn't occluded by opaque content above.
+ */
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_surface.h>
+
+struct wlr_buffer;
+
+enum wlr_scene_node_type {
+	WLR_SCENE_NODE_ROOT,
+	WLR_SCENE_NODE_TREE,
+	WLR_SCENE_NODE_SURFACE,
+	WLR_SCENE_NODE_RECT,
+	WLR_SCENE_NODE_BUFFER,
+};
+
+struct wlr_scene_node_state {
+	struct wl_list link; // wlr_scene_node_state::children
+
+	struct wl_list children; // wlr_scene_node_state::link
+
+	bool enabled;
+	int x, y; // relative to parent
+};
+
+/** A node is an object in the scene. */
+struct wlr_scene_node {
+	enum wlr_scene_node_type type;
+	struct wlr_scene_node *parent;
+	struct wlr_scene_node_state state;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+/** The root scene-graph node. */
+struct wlr_scene {
+	struct wlr_scene_node node;
+
+	struct wl_list outputs; // wlr_scene_output::link
+};
+
+/** A sub-tree in the scene-graph, used to group and move nodes together. */
+struct wlr_scene_tree {
+	struct wlr_scene_node node;
+};
+
+/** A scene-graph node displaying a single surface. */
+struct wlr_scene_surface {
+	struct wlr_scene_node node;
+	struct wlr_surface *surface;
+
+	// private state
+
+	struct wl_listener surface_destroy;
+	struct wl_listener surface_commit;
+};
+
+/** A scene-graph node displaying a solid-colored rectangle. */
+struct wlr_scene_rect {
+	struct wlr_scene_node node;
+	int width, height;
+	float color[4];
+};
+
+/** A scene-graph node displaying a buffer, e.g. a compositor-drawn image. */
+struct wlr_scene_buffer {
+	struct wlr_scene_node node;
+	struct wlr_buffer *buffer; // may be NULL
+};
+
+/** A viewport for an output in the scene-graph. */
+struct wlr_scene_output {
+	struct wlr_output *output;
+	struct wl_list link; // wlr_scene::outputs
+	struct wlr_scene *scene;
+	struct wlr_output_damage *damage;
+
+	int x, y; // position of the output in the scene
+
+	// Surfaces fully occluded on this output get frame done events at most
+	// once every this many milliseconds, 0 to send them on every frame
+	int hidden_frame_interval;
+
+	// private state
+
+	struct wl_event_source *hidden_frame_timer;
+
+	struct wl_listener damage_destroy;
+};
+
+/**
+ * Immediately destroy the scene-graph node and all of its children.
+ */
+void wlr_scene_node_destroy(struct wlr_scene_node *node);
+/**
+ * Enable or disable this node. If a node is disabled, all of its children are
+ * implicitly disabled as well.
+ */
+void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled);
+/**
+ * Set the position of the node relative to its parent.
+ */
+void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y);
+/**
+ * Move the node right above the specified sibling.
+ */
+void wlr_scene_node_place_above(struct wlr_scene_node *node,
+	struct wlr_scene_node *sibling);
+/**
+ * Move the node right below the specified sibling.
+ */
+void wlr_scene_node_place_below(struct wlr_scene_node *node,
+	struct wlr_scene_node *sibling);
+/**
+ * Move the node above all of its sibling nodes.
+ */
+void wlr_scene_node_raise_to_top(struct wlr_scene_node *node);
+/**
+ * Move the node below all of its sibling nodes.
+ */
+void wlr_scene_node_lower_to_bottom(struct wlr_scene_node *node);
+/**
+ * Move the node to another location in the tree, at the top of its new
+ * siblings.
+ */
+void wlr_scene_node_reparent(struct wlr_scene_node *node,
+	struct wlr_scene_node *new_parent);
+/**
+ * Get the node's position in the scene. Returns false if the node or one of
+ * its ancestors is disabled.
+ */
+bool wlr_scene_node_coords(struct wlr_scene_node *node, int *lx, int *ly);
+/**
+ * Call `iterator` on each surface in the scene-graph, with the surface's
+ * position in scene coordinates. The function is called from bottom to top.
+ * Disabled nodes are skipped.
+ */
+void wlr_scene_node_for_each_surface(struct wlr_scene_node *node,
+	wlr_surface_iterator_func_t iterator, void *user_data);
+/**
+ * Find the topmost node in this scene-graph that contains the point at the
+ * given position in node-local coordinates. Surface nodes only match where
+ * their surface accepts input. Returns the node and the coordinates relative
+ * to it, or NULL if no node is found at that location.
+ */
+struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
+	double lx, double ly, double *nx, double *ny);
+
+/**
+ * Create a new scene-graph.
+ */
+struct wlr_scene *wlr_scene_create(void);
+
+/**
+ * Add a node displaying nothing but its children.
+ */
+struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_node *parent);
+
+/**
+ * Add a node displaying a single surface to the scene-graph. The node is
+ * destroyed along with the surface. Subsurfaces aren't displayed, see
+ * `wlr_scene_subsurface_tree_create`.
+ */
+struct wlr_scene_surface *wlr_scene_surface_create(
+	struct wlr_scene_node *parent, struct wlr_surface *surface);
+
+struct wlr_scene_surface *wlr_scene_surface_from_node(
+	struct wlr_scene_node *node);
+
+/**
+ * Add a node displaying a surface and all of its subsurfaces to the
+ * scene-graph. The tree follows subsurfaces as they are created, moved,
+ * restacked, mapped and destroyed, and is destroyed along with the surface.
+ */
+struct wlr_scene_node *wlr_scene_subsurface_tree_create(
+	struct wlr_scene_node *parent, struct wlr_surface *surface);
+
+/**
+ * Add a node displaying a solid-colored rectangle to the scene-graph.
+ */
+struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_node *parent,
+	int width, int height, const float color[static 4]);
+/**
+ * Change the width and height of an existing rectangle node.
+ */
+void wlr_scene_rect_set_size(struct wlr_scene_rect *rect,
+	int width, int height);
+/**
+ * Change the color of an existing rectangle node.
+ */
+void wlr_scene_rect_set_color(struct wlr_scene_rect *rect,
+	const float color[static 4]);
+
+/**
+ * Add a node displaying a buffer to the scene-graph. The node holds a
+ * reference to the buffer. `buffer` may be NULL.
+ */
+struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_node *parent,
+	struct wlr_buffer *buffer);
+/**
+ * Change the buffer displayed by an existing buffer node. The whole node is
+ * damaged.
+ */
+void wlr_scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
+	struct wlr_buffer *buffer);
+
+/**
+ * Create a new scene output. An output can only be added once to the scene.
+ * The scene output tracks damage with a `wlr_output_damage`: the compositor
+ * should call `wlr_scene_output_commit` from its `frame` event handler.
+ */
+struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
+	struct wlr_output *output);
+/**
+ * Destroy a scene output.
+ */
+void wlr_scene_output_destroy(struct wlr_scene_output *scene_output);
+/**
+ * Set the output's position in the scene-graph.
+ */
+void wlr_scene_output_set_position(struct wlr_scene_output *scene_output,
+	int lx, int ly);
+/**
+ * Render and swap the output's buffers, if it is damaged. Parts that are
+ * occluded by opaque nodes aren't rendered. If a single opaque surface covers
+ * the whole output, its buffer is scanned out directly instead.
+ */
+bool wlr_scene_output_commit(struct wlr_scene_output *scene_output);
+/**
+ * Send frame done events to all surfaces displayed on the output. Surfaces
+ * fully occluded by opaque content are throttled according to
+ * `hidden_frame_interval`, the output schedules a frame when they are due.
+ * Frame rate caps set with `wlr_surface_set_max_frame_rate` are honoured the
+ * same way.
+ */
+void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
+	struct timespec *now);
+/**
+ * Get a scene output from a wlr_output, NULL if the output isn't in the scene.
+ */
+struct wlr_scene_output *wlr_scene_get_scene_output(struct wlr_scene *scene,
+	struct wlr_output *output);
+
+#endif
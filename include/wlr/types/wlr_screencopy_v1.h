@@ -10,14 +10,25 @@
 #define WLR_TYPES_WLR_SCREENCOPY_V1_H
 
 #include <stdbool.h>
+#include <time.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_box.h>
 
+struct wlr_dmabuf_v1_buffer;
+struct wlr_screencopy_v1_client;
+
 struct wlr_screencopy_manager_v1 {
 	struct wl_global *global;
 	struct wl_list resources; // wl_resource
 	struct wl_list frames; // wlr_screencopy_frame_v1::link
 
+	// wlroots-private protocols capturing toplevels and scaled output
+	// regions into screencopy frames
+	struct wl_global *toplevel_global;
+	struct wl_list toplevel_resources; // wl_resource
+	struct wl_global *scaled_global;
+	struct wl_list scaled_resources; // wl_resource
+
 	struct wl_listener display_destroy;
 
 	struct {
@@ -30,19 +41,41 @@ struct wlr_screencopy_manager_v1 {
 struct wlr_screencopy_frame_v1 {
 	struct wl_resource *resource;
 	struct wlr_screencopy_manager_v1 *manager;
+	struct wlr_screencopy_v1_client *client;
 	struct wl_list link;
 
 	enum wl_shm_format format;
-	struct wlr_box box;
+	uint32_t fourcc; // linux-dmabuf buffer format, 0 if unsupported
+	struct wlr_box box; // captured region, in buffer coordinates
+	int width, height; // frame size, smaller than the box if scaled down
 	int stride;
 
-	bool overlay_cursor, cursor_locked;
+	bool overlay_cursor, cursor_locked, render_locked;
+	// Only copy the region damaged since the client's previous copy
+	bool with_damage;
+	struct wlr_box damage; // frame-local, part copied into the client buffer
 
+	// Either a wl_shm or a linux-dmabuf buffer
 	struct wl_shm_buffer *buffer;
+	struct wlr_dmabuf_v1_buffer *dma_buffer;
 	struct wl_listener buffer_destroy;
 
+	// Either an output or a toplevel's surface tree is captured
 	struct wlr_output *output;
 	struct wl_listener output_swap_buffers;
+	// Only for DMA-BUF copies overlaying the cursor, which composite the
+	// hardware cursor into the copy instead of locking software cursors
+	struct wl_listener output_hardware_cursor;
+
+	struct wlr_surface *surface;
+	int32_t scale; // box is in surface-local coordinates multiplied by scale
+	struct wl_listener surface_commit;
+	struct wl_listener surface_destroy;
+
+	// Pending pixel read-out, finished on the next output frame
+	struct wlr_renderer_readback *readback;
+	struct timespec readback_when;
+	struct wl_listener output_frame;
 
 	void *data;
 };
@@ -24,6 +24,7 @@ struct wlr_seat_client {
 	struct wl_client *client;
 	struct wlr_seat *seat;
 	struct wl_list link;
+	struct wl_list bucket_link; // wlr_seat::client_buckets
 
 	// lists of wl_resource
 	struct wl_list resources;
@@ -32,6 +33,9 @@ struct wlr_seat_client {
 	struct wl_list touches;
 	struct wl_list data_devices;
 
+	// Touch events were sent since the last wl_touch.frame
+	bool needs_touch_frame;
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -96,6 +100,7 @@ struct wlr_touch_grab_interface {
 			struct wlr_touch_point *point);
 	void (*enter)(struct wlr_seat_touch_grab *grab, uint32_t time_msec,
 			struct wlr_touch_point *point);
+	void (*frame)(struct wlr_seat_touch_grab *grab);
 	// XXX this will conflict with the actual touch cancel which is different so
 	// we need to rename this
 	void (*cancel)(struct wlr_seat_touch_grab *grab);
@@ -147,6 +152,15 @@ struct wlr_seat_pointer_state {
 
 	struct wl_listener surface_destroy;
 
+	// Motion coalescing, see wlr_seat_pointer_set_coalesce_motion
+	bool coalesce_motion;
+	struct {
+		bool pending, frame;
+		uint32_t time_msec;
+		double sx, sy;
+	} pending_motion;
+	struct wl_event_source *motion_timer;
+
 	struct {
 		struct wl_signal focus_change; // wlr_seat_pointer_focus_change_event
 	} events;
@@ -183,6 +197,9 @@ struct wlr_seat_touch_state {
 
 	struct wlr_seat_touch_grab *grab;
 	struct wlr_seat_touch_grab *default_grab;
+
+	// Sends the frame if the compositor doesn't notify the seat of one
+	struct wl_event_source *frame_source;
 };
 
 struct wlr_primary_selection_source;
@@ -192,6 +209,10 @@ struct wlr_seat {
 	struct wl_display *display;
 	struct wl_list clients;
 
+	// Hash table of clients by wl_client, its length is a power of two
+	struct wl_list *client_buckets; // wlr_seat_client::bucket_link
+	size_t client_buckets_len, clients_len;
+
 	char *name;
 	uint32_t capabilities;
 	struct timespec last_event;
@@ -338,6 +359,27 @@ void wlr_seat_pointer_clear_focus(struct wlr_seat *wlr_seat);
 void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time_msec,
 		double sx, double sy);
 
+/**
+ * Enables or disables pointer motion coalescing. When enabled, motion events
+ * which are only followed by a frame event are held back, and only the latest
+ * position is sent when wlr_seat_pointer_flush_motion is called, before any
+ * other pointer event, or at the latest after
+ * WLR_SEAT_POINTER_COALESCE_MOTION_MS milliseconds.
+ *
+ * Compositors should flush motion when outputs are refreshed, so that clients
+ * don't receive more motion events than they can render. Relative motion sent
+ * through wlr_relative_pointer_v1 isn't affected.
+ */
+void wlr_seat_pointer_set_coalesce_motion(struct wlr_seat *wlr_seat,
+		bool coalesce);
+
+#define WLR_SEAT_POINTER_COALESCE_MOTION_MS 16
+
+/**
+ * Sends the motion held back by motion coalescing, if any.
+ */
+void wlr_seat_pointer_flush_motion(struct wlr_seat *wlr_seat);
+
 /**
  * Send a button event to the surface with pointer focus. Coordinates for the
  * button event are surface-local. Returns the serial. Compositors should use
@@ -587,6 +629,21 @@ void wlr_seat_touch_send_up(struct wlr_seat *seat, uint32_t time_msec,
 void wlr_seat_touch_send_motion(struct wlr_seat *seat, uint32_t time_msec,
 		int32_t touch_id, double sx, double sy);
 
+/**
+ * Send a frame event to the clients which were sent touch events since the
+ * last frame. Compositors should use `wlr_seat_touch_notify_frame()` to respect
+ * any grabs of the touch device.
+ */
+void wlr_seat_touch_send_frame(struct wlr_seat *seat);
+
+/**
+ * Notify the seat of a touch frame event, ending a group of touch point
+ * updates which logically belong together. All updates sent within the frame
+ * are followed by a single frame event. If the compositor doesn't notify the
+ * seat of frames, the frame is sent once the event loop is idle.
+ */
+void wlr_seat_touch_notify_frame(struct wlr_seat *seat);
+
 /**
  * How many touch points are currently down for the seat.
  */
@@ -0,0 +1,105 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_SPATIAL_INDEX_H
+#define WLR_TYPES_WLR_SPATIAL_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_box.h>
+
+#define WLR_SPATIAL_INDEX_BUCKETS 1024
+
+/**
+ * A spatial index of stacked boxes, typically the input bounding boxes of
+ * views in layout coordinates. It speeds up finding the topmost object under
+ * a point: the plane is split into a uniform grid of square cells, and only
+ * the boxes overlapping the cell containing the point are tested.
+ *
+ * Boxes covering too many cells are kept in a separate list which is always
+ * tested.
+ */
+struct wlr_spatial_index {
+	int cell_size;
+
+	struct wl_list entries; // wlr_spatial_index_entry::link
+	// Grid cells are hashed into buckets of struct wlr_spatial_index_cell_ref
+	struct wl_array buckets[WLR_SPATIAL_INDEX_BUCKETS];
+	struct wl_list large_entries; // wlr_spatial_index_entry::large_link
+
+	int64_t top_z, bottom_z;
+	struct wl_array candidates; // struct wlr_spatial_index_entry *
+};
+
+struct wlr_spatial_index_entry {
+	struct wlr_spatial_index *index;
+	struct wl_list link; // wlr_spatial_index::entries
+
+	struct wlr_box box;
+	int64_t z; // stacking order, higher is on top
+
+	// Range of cells the box is stored in, if not in the large list
+	bool large;
+	int cell_x1, cell_y1, cell_x2, cell_y2;
+	struct wl_list large_link; // wlr_spatial_index::large_entries
+
+	void *data;
+};
+
+struct wlr_spatial_index_cell_ref {
+	int x, y;
+	struct wlr_spatial_index_entry *entry;
+};
+
+/**
+ * Called on each entry whose box contains the queried point, from top to
+ * bottom, until it returns true. `x` and `y` are the queried coordinates.
+ */
+typedef bool (*wlr_spatial_index_accept_func_t)(
+	struct wlr_spatial_index_entry *entry, double x, double y, void *data);
+
+/**
+ * Creates a spatial index. `cell_size` is the size of the grid cells, 0 picks
+ * a default suitable for windows in layout coordinates.
+ */
+struct wlr_spatial_index *wlr_spatial_index_create(int cell_size);
+/**
+ * Destroys the index along with all of its entries.
+ */
+void wlr_spatial_index_destroy(struct wlr_spatial_index *index);
+/**
+ * Adds a box at the top of the stack.
+ */
+struct wlr_spatial_index_entry *wlr_spatial_index_add(
+	struct wlr_spatial_index *index, const struct wlr_box *box, void *data);
+void wlr_spatial_index_entry_destroy(struct wlr_spatial_index_entry *entry);
+/**
+ * Updates the box of an entry, e.g. after the object moved or was resized.
+ */
+void wlr_spatial_index_entry_set_box(struct wlr_spatial_index_entry *entry,
+	const struct wlr_box *box);
+/**
+ * Moves the entry above all other entries.
+ */
+void wlr_spatial_index_entry_raise(struct wlr_spatial_index_entry *entry);
+/**
+ * Moves the entry below all other entries.
+ */
+void wlr_spatial_index_entry_lower(struct wlr_spatial_index_entry *entry);
+/**
+ * Finds the topmost entry containing the point for which `accept` returns
+ * true. If `accept` is NULL, the topmost entry containing the point is
+ * returned. Returns NULL if there's no such entry.
+ */
+struct wlr_spatial_index_entry *wlr_spatial_index_at(
+	struct wlr_spatial_index *index, double x, double y,
+	wlr_spatial_index_accept_func_t accept, void *data);
+
+#endif
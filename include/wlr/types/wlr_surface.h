@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <time.h>
 #include <wayland-server.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_client_stats.h>
 #include <wlr/types/wlr_output.h>
 
 enum wlr_surface_state_field {
@@ -25,6 +27,7 @@ enum wlr_surface_state_field {
 	WLR_SURFACE_STATE_TRANSFORM = 1 << 5,
 	WLR_SURFACE_STATE_SCALE = 1 << 6,
 	WLR_SURFACE_STATE_FRAME_CALLBACK_LIST = 1 << 7,
+	WLR_SURFACE_STATE_VIEWPORT = 1 << 8,
 };
 
 struct wlr_surface_state {
@@ -38,18 +41,42 @@ struct wlr_surface_state {
 	int32_t scale;
 	struct wl_list frame_callback_list; // wl_resource
 
+	// wp_viewport state, see wlr_viewporter.h
+	struct {
+		bool has_src, has_dst;
+		// In coordinates after scale and transform are applied, but before the
+		// destination rectangle is applied
+		struct wlr_fbox src;
+		int dst_width, dst_height; // in surface-local coordinates
+	} viewport;
+
 	int width, height; // in surface-local coordinates
 	int buffer_width, buffer_height;
 
 	struct wl_listener buffer_destroy;
 };
 
+/**
+ * The part of the state of the previous commit needed to compute damage.
+ */
+struct wlr_surface_previous_state {
+	int width, height; // in surface-local coordinates
+	int buffer_width, buffer_height;
+	enum wl_output_transform transform;
+	int32_t scale;
+};
+
 struct wlr_surface_role {
 	const char *name;
 	void (*commit)(struct wlr_surface *surface);
 	void (*precommit)(struct wlr_surface *surface);
 };
 
+struct wlr_surface_tree_node {
+	struct wlr_surface *surface;
+	int x, y; // relative to the surface owning the tree
+};
+
 struct wlr_surface {
 	struct wl_resource *resource;
 	struct wlr_renderer *renderer;
@@ -64,11 +91,22 @@ struct wlr_surface {
 	 * The buffer position, in surface-local units.
 	 */
 	int sx, sy;
+
+	const struct wlr_surface_role *role; // the lifetime-bound role or NULL
+	void *role_data; // role-specific data
+
+	/**
+	 * `current` contains the current, committed surface state. It is grouped
+	 * with the fields above, which are read when iterating over surfaces.
+	 */
+	struct wlr_surface_state current;
+
 	/**
 	 * The last commit's buffer damage, in buffer-local coordinates. This
 	 * contains both the damage accumulated by the client via
 	 * `wlr_surface_state.surface_damage` and `wlr_surface_state.buffer_damage`.
-	 * If the buffer has been resized, the whole buffer is damaged.
+	 * If the buffer has been resized or the viewport has changed, the whole
+	 * buffer is damaged.
 	 *
 	 * This region needs to be scaled and transformed into output coordinates,
 	 * just like the buffer's texture. In addition, if the buffer has shrunk the
@@ -88,15 +126,40 @@ struct wlr_surface {
 	 */
 	pixman_region32_t input_region;
 	/**
-	 * `current` contains the current, committed surface state. `pending`
-	 * accumulates state changes from the client between commits and shouldn't
-	 * be accessed by the compositor directly. `previous` contains the state of
-	 * the previous commit.
+	 * `pending` accumulates state changes from the client between commits and
+	 * shouldn't be accessed by the compositor directly. `previous` contains
+	 * the size and transform of the previous commit.
 	 */
-	struct wlr_surface_state current, pending, previous;
-
-	const struct wlr_surface_role *role; // the lifetime-bound role or NULL
-	void *role_data; // role-specific data
+	struct wlr_surface_state pending;
+	struct wlr_surface_previous_state previous;
+
+	// When frame done events were last sent, in msec
+	int64_t last_frame_done;
+	// See wlr_surface_set_max_frame_rate
+	int max_frame_rate;
+	// See wlr_surface_set_max_damage_rects
+	int max_damage_rects;
+	// Of the client owning the surface, NULL on allocation failure
+	struct wlr_client_stats *client_stats;
+
+	// Keep wl_shm buffers until they're replaced, so that the texture can be
+	// evicted, see wlr_compositor_set_texture_eviction
+	bool retain_buffers;
+	// When the texture was last used, in msec. Only updated if
+	// `retain_buffers` is set.
+	int64_t last_texture_use;
+
+	// See wlr_surface_transaction
+	struct {
+		struct wlr_surface_transaction *transaction; // NULL if none
+		struct wl_list link; // wlr_surface_transaction::surfaces
+		// Commits held back until the transaction is applied, allocated on
+		// demand. NULL if no commit is held back.
+		struct wlr_surface_state *state;
+		bool ready;
+		bool (*is_ready)(struct wlr_surface *surface, void *data);
+		void *is_ready_data;
+	} transaction;
 
 	struct {
 		struct wl_signal commit;
@@ -109,6 +172,19 @@ struct wlr_surface {
 	// wlr_subsurface::parent_pending_link
 	struct wl_list subsurface_pending_list;
 
+	// Subsurfaces with cached state in their tree, committed along with this
+	// surface if they're synchronized
+	struct wl_list cached_subsurfaces; // wlr_subsurface::cached_link
+
+	// Flattened subsurface tree in rendering order, rebuilt on demand when
+	// subsurfaces are added, removed, moved or restacked
+	struct {
+		struct wlr_surface_tree_node *nodes;
+		size_t len, cap;
+		bool valid;
+		int iterating; // nested wlr_surface_for_each_surface calls
+	} tree;
+
 	struct wl_listener renderer_destroy;
 
 	void *data;
@@ -125,7 +201,8 @@ struct wlr_subsurface {
 
 	struct wlr_subsurface_state current, pending;
 
-	struct wlr_surface_state cached;
+	// Commits cached while synchronized, allocated on the first one
+	struct wlr_surface_state *cached;
 	bool has_cache;
 
 	bool synchronized;
@@ -134,6 +211,8 @@ struct wlr_subsurface {
 
 	struct wl_list parent_link;
 	struct wl_list parent_pending_link;
+	// wlr_surface::cached_subsurfaces of the parent, or empty
+	struct wl_list cached_link;
 
 	struct wl_listener surface_destroy;
 	struct wl_listener parent_destroy;
@@ -150,6 +229,29 @@ struct wlr_subsurface {
 typedef void (*wlr_surface_iterator_func_t)(struct wlr_surface *surface,
 	int sx, int sy, void *data);
 
+/**
+ * A set of surfaces whose commits are applied together, so that e.g. windows
+ * resized by a new layout show up in a single frame. The commits of the
+ * surfaces are held back from the moment they're added, until all of them
+ * are ready or the timeout expires. Subsurfaces can't be added, but the
+ * synchronized subsurfaces of a held surface are held with it.
+ */
+struct wlr_surface_transaction {
+	struct wl_list surfaces; // wlr_surface::transaction.link
+	size_t n_waiting; // surfaces which aren't ready yet
+	struct wl_event_source *timer;
+
+	struct {
+		/**
+		 * Emitted after the held commits have been applied, right before the
+		 * transaction is destroyed.
+		 */
+		struct wl_signal apply;
+	} events;
+
+	void *data;
+};
+
 struct wlr_renderer;
 
 /**
@@ -179,10 +281,19 @@ bool wlr_surface_has_buffer(struct wlr_surface *surface);
 /**
  * Get the texture of the buffer currently attached to this surface. Returns
  * NULL if no buffer is currently attached or if something went wrong with
- * uploading the buffer.
+ * uploading the buffer. Finishes any pending upload of the buffer's pixels,
+ * and imports the texture again if it has been evicted.
  */
 struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface);
 
+/**
+ * Like wlr_surface_get_texture, but returns a texture usable with the given
+ * renderer, e.g. the one of an output on another GPU. See
+ * wlr_buffer_get_texture.
+ */
+struct wlr_texture *wlr_surface_get_texture_for_renderer(
+	struct wlr_surface *surface, struct wlr_renderer *renderer);
+
 /**
  * Create a new subsurface resource with the provided new ID. If `resource_list`
  * is non-NULL, adds the subsurface's resource to the list.
@@ -217,10 +328,51 @@ void wlr_surface_send_enter(struct wlr_surface *surface,
 void wlr_surface_send_leave(struct wlr_surface *surface,
 		struct wlr_output *output);
 
-void wlr_surface_send_frame_done(struct wlr_surface *surface,
+/**
+ * Sends frame done events, unless the surface's frame rate cap delays them.
+ * Returns the number of milliseconds until the delayed events are due, or 0.
+ * The compositor should make sure this function is called again by then, even
+ * if the output isn't damaged.
+ */
+int wlr_surface_send_frame_done(struct wlr_surface *surface,
 		const struct timespec *when);
 
+/**
+ * Sends frame done events like `wlr_surface_send_frame_done`, but at most once
+ * every `interval` milliseconds. This is meant for surfaces that aren't
+ * visible: their clients can make progress at a low rate instead of rendering
+ * at the full refresh rate for nothing.
+ */
+int wlr_surface_send_frame_done_throttled(struct wlr_surface *surface,
+		const struct timespec *when, int interval);
+
+/**
+ * Limits the number of rectangles of the damage accumulated between two
+ * commits. Beyond `max_rects`, the pending damage is simplified into a quarter
+ * as many covering rectangles, see wlr_region_simplify. Defaults to 64, set
+ * `max_rects` to 0 to keep the exact damage.
+ */
+void wlr_surface_set_max_damage_rects(struct wlr_surface *surface,
+	int max_rects);
+
+/**
+ * Caps the rate of frame done events sent to the surface and its subsurfaces,
+ * in frames per second, e.g. to keep clients in the background from rendering
+ * at the full refresh rate of the output. A subsurface's own cap takes
+ * precedence over its parent's. Set `rate` to 0 to remove the cap.
+ */
+void wlr_surface_set_max_frame_rate(struct wlr_surface *surface, int rate);
+
 struct wlr_box;
+
+/**
+ * Checks whether a surface displayed at `box` is hidden, i.e. it has no buffer
+ * or `occluded` covers all of it. `occluded` is typically the union of the
+ * opaque regions rendered above the surface, in the same coordinate space as
+ * `box`.
+ */
+bool wlr_surface_is_occluded(struct wlr_surface *surface,
+	const struct wlr_box *box, pixman_region32_t *occluded);
 /**
  * Get the bounding box that contains the surface and all subsurfaces in
  * surface coordinates.
@@ -238,6 +390,15 @@ struct wlr_surface *wlr_surface_from_resource(struct wl_resource *resource);
 void wlr_surface_for_each_surface(struct wlr_surface *surface,
 	wlr_surface_iterator_func_t iterator, void *user_data);
 
+/**
+ * Get the source rectangle describing the region of the buffer that needs to
+ * be sampled to render this surface's current state, in buffer pixels. This
+ * is the whole buffer unless the client has set a viewport source rectangle.
+ * The source rectangle is then scaled to the surface size.
+ */
+void wlr_surface_get_buffer_source_box(struct wlr_surface *surface,
+	struct wlr_fbox *box);
+
 /**
  * Get the effective damage to the surface in terms of surface local
  * coordinates. This includes damage induced by resizing and moving the
@@ -246,4 +407,24 @@ void wlr_surface_for_each_surface(struct wlr_surface *surface,
 void wlr_surface_get_effective_damage(struct wlr_surface *surface,
 	pixman_region32_t *damage);
 
+/**
+ * Creates a transaction which is applied after `timeout_ms` at the latest.
+ */
+struct wlr_surface_transaction *wlr_surface_transaction_create(
+	struct wl_display *display, int timeout_ms);
+/**
+ * Holds the commits of the surface until the transaction is applied. The
+ * surface is ready on the first commit for which `is_ready` returns true, or
+ * on its next commit if `is_ready` is NULL. Returns false if the surface is a
+ * subsurface or already part of a transaction.
+ */
+bool wlr_surface_transaction_add(struct wlr_surface_transaction *txn,
+	struct wlr_surface *surface,
+	bool (*is_ready)(struct wlr_surface *surface, void *data), void *data);
+/**
+ * Applies the commits held so far and destroys the transaction. This happens
+ * automatically once all surfaces are ready or on timeout.
+ */
+void wlr_surface_transaction_apply(struct wlr_surface_transaction *txn);
+
 #endif
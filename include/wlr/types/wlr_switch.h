@@ -40,6 +40,7 @@ enum wlr_switch_state {
 struct wlr_event_switch_toggle {
 	struct wlr_input_device *device;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	enum wlr_switch_type switch_type;
 	enum wlr_switch_state switch_state;
 };
@@ -59,6 +59,7 @@ struct wlr_tablet_pad_group {
 
 struct wlr_event_tablet_pad_button {
 	uint32_t time_msec;
+	uint64_t time_usec;
 	uint32_t button;
 	enum wlr_button_state state;
 	unsigned int mode;
@@ -72,6 +73,7 @@ enum wlr_tablet_pad_ring_source {
 
 struct wlr_event_tablet_pad_ring {
 	uint32_t time_msec;
+	uint64_t time_usec;
 	enum wlr_tablet_pad_ring_source source;
 	uint32_t ring;
 	double position;
@@ -85,6 +87,7 @@ enum wlr_tablet_pad_strip_source {
 
 struct wlr_event_tablet_pad_strip {
 	uint32_t time_msec;
+	uint64_t time_usec;
 	enum wlr_tablet_pad_strip_source source;
 	uint32_t strip;
 	double position;
@@ -84,6 +84,7 @@ struct wlr_event_tablet_tool_axis {
 	struct wlr_tablet_tool *tool;
 
 	uint32_t time_msec;
+	uint64_t time_usec;
 	uint32_t updated_axes;
 	// From 0..1
 	double x, y;
@@ -106,6 +107,7 @@ struct wlr_event_tablet_tool_proximity {
 	struct wlr_input_device *device;
 	struct wlr_tablet_tool *tool;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	// From 0..1
 	double x, y;
 	enum wlr_tablet_tool_proximity_state state;
@@ -120,6 +122,7 @@ struct wlr_event_tablet_tool_tip {
 	struct wlr_input_device *device;
 	struct wlr_tablet_tool *tool;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	// From 0..1
 	double x, y;
 	enum wlr_tablet_tool_tip_state state;
@@ -129,6 +132,7 @@ struct wlr_event_tablet_tool_button {
 	struct wlr_input_device *device;
 	struct wlr_tablet_tool *tool;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	uint32_t button;
 	enum wlr_button_state state;
 };
@@ -84,6 +84,11 @@ struct wlr_tablet_v2_tablet_tool {
 	uint32_t pressed_buttons[WLR_TABLET_V2_TOOL_BUTTONS_CAP];
 	uint32_t pressed_serials[WLR_TABLET_V2_TOOL_BUTTONS_CAP];
 
+	// Frames carrying only axis changes are sent at most once every this many
+	// milliseconds, e.g. the refresh period of the output showing the focused
+	// surface. 0 sends them as soon as the compositor is idle.
+	int axis_frame_interval;
+
 	struct {
 		struct wl_signal set_cursor; // struct wlr_tablet_v2_event_cursor
 	} events;
@@ -179,6 +184,17 @@ void wlr_send_tablet_v2_tablet_tool_button(
 	struct wlr_tablet_v2_tablet_tool *tool, uint32_t button,
 	enum zwp_tablet_pad_v2_button_state state);
 
+/**
+ * By default, axis changes are accumulated and only the axes whose value
+ * changed are sent once per frame. Clients which need every sample, e.g.
+ * drawing applications doing their own smoothing, can be sent each axis
+ * change as it happens instead. This applies to the tool objects the client
+ * has currently bound.
+ */
+void wlr_tablet_v2_tablet_tool_set_client_full_rate(
+	struct wlr_tablet_v2_tablet_tool *tool, struct wl_client *client,
+	bool full_rate);
+
 
 
 void wlr_tablet_v2_tablet_tool_notify_proximity_in(
@@ -13,6 +13,13 @@
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_surface.h>
 
+enum wlr_text_input_v3_state_field {
+	WLR_TEXT_INPUT_V3_STATE_SURROUNDING_TEXT = 1 << 0,
+	WLR_TEXT_INPUT_V3_STATE_TEXT_CHANGE_CAUSE = 1 << 1,
+	WLR_TEXT_INPUT_V3_STATE_CONTENT_TYPE = 1 << 2,
+	WLR_TEXT_INPUT_V3_STATE_CURSOR_RECTANGLE = 1 << 3,
+};
+
 struct wlr_text_input_v3_state {
 	struct {
 		char *text; // NULL is allowed and equivalent to empty string
@@ -41,6 +48,9 @@ struct wlr_text_input_v3 {
 	struct wlr_surface *focused_surface;
 	struct wlr_text_input_v3_state pending;
 	struct wlr_text_input_v3_state current;
+	// Fields which differ from the previous state in the last commit,
+	// enum wlr_text_input_v3_state_field
+	uint32_t current_changed;
 	uint32_t current_serial; // next in line to send
 	bool pending_enabled;
 	bool current_enabled;
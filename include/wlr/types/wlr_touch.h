@@ -22,6 +22,7 @@ struct wlr_touch {
 		struct wl_signal up;
 		struct wl_signal motion;
 		struct wl_signal cancel;
+		struct wl_signal frame;
 	} events;
 
 	void *data;
@@ -30,6 +31,7 @@ struct wlr_touch {
 struct wlr_event_touch_down {
 	struct wlr_input_device *device;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	int32_t touch_id;
 	// From 0..1
 	double x, y;
@@ -38,12 +40,14 @@ struct wlr_event_touch_down {
 struct wlr_event_touch_up {
 	struct wlr_input_device *device;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	int32_t touch_id;
 };
 
 struct wlr_event_touch_motion {
 	struct wlr_input_device *device;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	int32_t touch_id;
 	// From 0..1
 	double x, y;
@@ -52,6 +56,7 @@ struct wlr_event_touch_motion {
 struct wlr_event_touch_cancel {
 	struct wlr_input_device *device;
 	uint32_t time_msec;
+	uint64_t time_usec;
 	int32_t touch_id;
 };
 
@@ -0,0 +1,39 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_VIEWPORTER_H
+#define WLR_TYPES_WLR_VIEWPORTER_H
+
+#include <wayland-server.h>
+
+/**
+ * Implements wp_viewporter, which allows clients to crop and scale their
+ * surfaces independently of the buffer size.
+ *
+ * The viewport state is committed with the surface state, see
+ * `wlr_surface_state.viewport`. Compositors render surfaces with
+ * `wlr_surface_get_buffer_source_box` and the surface size, so that scaling is
+ * done by the renderer.
+ */
+struct wlr_viewporter {
+	struct wl_global *global;
+	struct wl_list resources; // wl_resource_get_link
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	struct wl_listener display_destroy;
+
+	void *data;
+};
+
+struct wlr_viewporter *wlr_viewporter_create(struct wl_display *display);
+void wlr_viewporter_destroy(struct wlr_viewporter *viewporter);
+
+#endif
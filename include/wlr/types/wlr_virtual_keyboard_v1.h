@@ -18,6 +18,12 @@ struct wlr_virtual_keyboard_manager_v1 {
 	struct wl_list resources; // struct wl_resource*
 	struct wl_list virtual_keyboards; // struct wlr_virtual_keyboard_v1*
 
+	// Shared by all virtual keyboards, clients tend to send the same keymap
+	// over and over
+	struct xkb_context *xkb_context;
+	struct wl_list keymaps; // wlr_virtual_keyboard_keymap_v1::link
+	size_t n_keymaps;
+
 	struct wl_listener display_destroy;
 
 	struct {
@@ -26,7 +32,17 @@ struct wlr_virtual_keyboard_manager_v1 {
 	} events;
 };
 
+// A keymap compiled for virtual keyboards, cached by content
+struct wlr_virtual_keyboard_keymap_v1 {
+	struct wl_list link; // wlr_virtual_keyboard_manager_v1::keymaps
+	uint64_t hash;
+	char *string;
+	size_t size;
+	struct xkb_keymap *keymap;
+};
+
 struct wlr_virtual_keyboard_v1 {
+	struct wlr_virtual_keyboard_manager_v1 *manager;
 	struct wl_resource *resource;
 	struct wlr_input_device input_device;
 	struct wlr_seat *seat;
@@ -14,11 +14,12 @@
 #include <wlr/xcursor.h>
 
 /**
- * An XCursor theme at a particular scale factor of the base size.
+ * An XCursor theme at a particular scale factor of the base size. Themes are
+ * shared with all managers loading the same theme at the same size.
  */
 struct wlr_xcursor_manager_theme {
 	float scale;
-	struct wlr_xcursor_theme *theme;
+	struct wlr_xcursor_theme *theme; // NULL until a cursor is first needed
 	struct wl_list link;
 };
 
@@ -44,7 +45,9 @@ struct wlr_xcursor_manager *wlr_xcursor_manager_create(const char *name,
 void wlr_xcursor_manager_destroy(struct wlr_xcursor_manager *manager);
 
 /**
- * Ensures an xcursor theme at the given scale factor is loaded in the manager.
+ * Ensures an xcursor theme at the given scale factor is available in the
+ * manager. The theme files are only read when a cursor is first requested at
+ * this scale, so this only fails on allocation errors. Returns 0 on success.
  */
 int wlr_xcursor_manager_load(struct wlr_xcursor_manager *manager,
 	float scale);
@@ -52,7 +55,7 @@ int wlr_xcursor_manager_load(struct wlr_xcursor_manager *manager,
 /**
  * Retrieves a wlr_xcursor reference for the given cursor name at the given
  * scale factor, or NULL if this wlr_xcursor_manager has not loaded a cursor
- * theme at the requested scale.
+ * theme at the requested scale or the theme failed to load.
  */
 struct wlr_xcursor *wlr_xcursor_manager_get_xcursor(
 	struct wlr_xcursor_manager *manager, const char *name, float scale);
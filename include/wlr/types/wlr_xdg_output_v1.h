@@ -21,11 +21,15 @@ struct wlr_xdg_output_v1 {
 	int32_t x, y;
 	int32_t width, height;
 
+	// Pending update, flushed once per event loop iteration
+	struct wl_event_source *idle_update;
+
 	struct wl_listener destroy;
 };
 
 struct wlr_xdg_output_manager_v1 {
 	struct wl_global *global;
+	struct wl_display *display;
 	struct wl_list resources;
 	struct wlr_output_layout *layout;
 
@@ -171,6 +171,15 @@ struct wlr_xdg_surface {
 	uint32_t configure_next_serial;
 	struct wl_list configure_list;
 
+	// See wlr_xdg_surface_set_configure_throttle
+	bool throttle_configures;
+	// A configure has been sent, but not acked and committed yet
+	bool configure_outstanding;
+	// A configure is waiting for the outstanding one
+	bool configure_deferred;
+	// See wlr_xdg_surface_transaction_add
+	uint32_t transaction_serial;
+
 	bool has_next_geometry;
 	struct wlr_box next_geometry;
 	struct wlr_box geometry;
@@ -380,6 +389,26 @@ void wlr_xdg_surface_for_each_surface(struct wlr_xdg_surface *surface,
  */
 uint32_t wlr_xdg_surface_schedule_configure(struct wlr_xdg_surface *surface);
 
+/**
+ * Enable or disable configure throttling. When enabled, at most one configure
+ * is outstanding: further configures are held back until the client has acked
+ * and committed the previous one, and then sent once with the latest state.
+ * Useful during interactive resizes, so that slow clients don't accumulate a
+ * backlog of configures. Serials returned while a configure is held back are
+ * the serials of the configure which will eventually be sent.
+ */
+void wlr_xdg_surface_set_configure_throttle(struct wlr_xdg_surface *surface,
+	bool throttle);
+
+/**
+ * Adds the surface to a transaction, see wlr_surface_transaction. Its commits
+ * are held until the transaction is applied, and it's ready once the client
+ * has acked the configure with the given serial and committed. Returns false
+ * if the surface is already part of a transaction.
+ */
+bool wlr_xdg_surface_transaction_add(struct wlr_xdg_surface *surface,
+	struct wlr_surface_transaction *txn, uint32_t serial);
+
 /**
  * Call `iterator` on each popup in the xdg-surface tree, with the popup's
  * position relative to the root xdg-surface. The function is called from root
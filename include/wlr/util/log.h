@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 
@@ -42,6 +43,19 @@ void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback);
 // Returns the log verbosity provided to wlr_log_init
 enum wlr_log_importance wlr_log_get_verbosity(void);
 
+// Makes the default logger hand messages over to a dedicated thread which
+// writes them to stderr, so that logging never blocks the caller. Messages are
+// stored in a ring buffer of `buffer_size` bytes, and are dropped (and later
+// counted in the log) when it is full. Has no effect on custom callbacks.
+// Returns false if the thread couldn't be started.
+bool wlr_log_start_async(size_t buffer_size);
+
+// Writes out all pending messages and stops the logging thread. No other
+// thread may be logging while this is called. At exit, pending messages are
+// written out automatically, but the ring buffer isn't freed since other
+// threads may still be logging.
+void wlr_log_stop_async(void);
+
 #ifdef __GNUC__
 #define _WLR_ATTRIB_PRINTF(start, end) __attribute__((format(printf, start, end)))
 #else
@@ -52,11 +66,25 @@ void _wlr_log(enum wlr_log_importance verbosity, const char *format, ...) _WLR_A
 void _wlr_vlog(enum wlr_log_importance verbosity, const char *format, va_list args) _WLR_ATTRIB_PRINTF(2, 0);
 const char *_wlr_strip_path(const char *filepath);
 
+// The verbosity set by wlr_log_init, checked before the arguments of the
+// logging macros are evaluated. Use wlr_log_get_verbosity instead.
+extern enum wlr_log_importance _wlr_log_verbosity;
+
 #define wlr_log(verb, fmt, ...) \
-	_wlr_log(verb, "[%s:%d] " fmt, _wlr_strip_path(__FILE__), __LINE__, ##__VA_ARGS__)
+	do { \
+		if ((verb) <= _wlr_log_verbosity) { \
+			_wlr_log(verb, "[%s:%d] " fmt, _wlr_strip_path(__FILE__), \
+				__LINE__, ##__VA_ARGS__); \
+		} \
+	} while (0)
 
 #define wlr_vlog(verb, fmt, args) \
-	_wlr_vlog(verb, "[%s:%d] " fmt, _wlr_strip_path(__FILE__), __LINE__, args)
+	do { \
+		if ((verb) <= _wlr_log_verbosity) { \
+			_wlr_vlog(verb, "[%s:%d] " fmt, _wlr_strip_path(__FILE__), \
+				__LINE__, args); \
+		} \
+	} while (0)
 
 #define wlr_log_errno(verb, fmt, ...) \
 	wlr_log(verb, fmt ": %s", ##__VA_ARGS__, strerror(errno))
@@ -0,0 +1,36 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_UTIL_MIME_TYPE_H
+#define WLR_UTIL_MIME_TYPE_H
+
+/**
+ * MIME types offered by data sources are interned: there is a single copy of
+ * each string in the process, shared by all sources, offers and Xwayland
+ * selections. Interned MIME types can be compared with ==.
+ *
+ * The `mime_types` arrays of wlr_data_source and
+ * wlr_primary_selection_source only contain interned MIME types, each
+ * holding a reference which is dropped when the source is destroyed.
+ */
+
+/**
+ * Returns the interned copy of the MIME type, with a new reference. Returns
+ * NULL on allocation failure.
+ */
+const char *wlr_mime_type_intern(const char *mime_type);
+/**
+ * Adds a reference to an interned MIME type.
+ */
+const char *wlr_mime_type_ref(const char *mime_type);
+/**
+ * Drops a reference to an interned MIME type. Does nothing if NULL.
+ */
+void wlr_mime_type_unref(const char *mime_type);
+
+#endif
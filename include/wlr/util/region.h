@@ -30,6 +30,29 @@
 void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 	float scale);
 
+/**
+ * Like `wlr_region_scale`, with different horizontal and vertical factors.
+ */
+void wlr_region_scale_xy(pixman_region32_t *dst, pixman_region32_t *src,
+	float scale_x, float scale_y);
+
+/**
+ * Like `wlr_region_scale_xy`, but the resulting coordinates are rounded so
+ * that the new region is contained in the exactly scaled one, e.g. to scale
+ * opaque regions.
+ */
+void wlr_region_scale_xy_inner(pixman_region32_t *dst, pixman_region32_t *src,
+	float scale_x, float scale_y);
+
+/**
+ * Approximates a region with at most `max_rects` boxes, such that the result
+ * contains the original region. Rectangles are merged into clusters so that
+ * the area added by merging stays small. Because clusters may overlap, the
+ * resulting region can contain a few more rectangles than `max_rects`.
+ */
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+	int max_rects);
+
 /**
  * Applies a transform to a region inside a box of size `width` x `height`.
  */
@@ -53,4 +76,38 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 bool wlr_region_confine(pixman_region32_t *region, double x1, double y1, double x2,
 	double y2, double *x2_out, double *y2_out);
 
+/**
+ * A copy of a region's rectangles bucketed in a uniform grid, to find the
+ * rectangle containing a point without searching the whole region. Meant for
+ * regions queried much more often than they change, such as pointer
+ * confinement regions. A zeroed index is a valid empty one.
+ */
+struct wlr_region_index {
+	pixman_box32_t extents;
+	pixman_box32_t *rects;
+	int nrects;
+	int cols, rows; // 0 if the rectangles aren't bucketed
+	int *cell_start; // cols * rows + 1 offsets in cell_rects
+	int *cell_rects;
+	int last_rect; // last rectangle found, checked first
+};
+
+/**
+ * Rebuilds the index from the region. On allocation failure, the index is
+ * empty.
+ */
+void wlr_region_index_update(struct wlr_region_index *index,
+	pixman_region32_t *region);
+void wlr_region_index_finish(struct wlr_region_index *index);
+/**
+ * Same as pixman_region32_contains_point, for an indexed region.
+ */
+bool wlr_region_index_contains_point(struct wlr_region_index *index,
+	int x, int y, pixman_box32_t *box);
+/**
+ * Same as wlr_region_confine, for an indexed region.
+ */
+bool wlr_region_index_confine(struct wlr_region_index *index, double x1,
+	double y1, double x2, double y2, double *x2_out, double *y2_out);
+
 #endif
@@ -0,0 +1,120 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_UTIL_WORK_QUEUE_H
+#define WLR_UTIL_WORK_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+struct wlr_output;
+
+// Default values of the wlr_work_queue fields, in nsec
+#define WLR_WORK_QUEUE_SLICE 4000000
+#define WLR_WORK_QUEUE_FRAME_MARGIN 4000000
+#define WLR_WORK_QUEUE_INPUT_DELAY 16000000
+
+enum wlr_work_priority {
+	WLR_WORK_PRIORITY_LOW,
+	WLR_WORK_PRIORITY_NORMAL,
+	WLR_WORK_PRIORITY_HIGH,
+};
+
+/**
+ * Performs a slice of deferred work. `deadline` is the CLOCK_MONOTONIC time,
+ * in nsec, by which work which can be split should return. Returns true if
+ * there is more work to do, in which case the function is called again later.
+ */
+typedef bool (*wlr_work_func_t)(void *data, int64_t deadline);
+
+struct wlr_work_item {
+	struct wlr_work_queue *queue;
+	enum wlr_work_priority priority;
+	int64_t budget; // expected duration of a call to func, nsec
+	wlr_work_func_t func;
+	// Called when the item is done or dropped, may be NULL
+	void (*destroy)(void *data);
+	void *data;
+
+	struct wl_list link; // wlr_work_queue::items
+};
+
+/**
+ * Runs expensive operations which don't need to happen right away, such as
+ * writing caches, from the event loop when the compositor has nothing more
+ * urgent to do.
+ *
+ * Work runs from a timer, so that pending events are dispatched first, in
+ * slices of at most `slice` nsec, highest priority first. An item only starts
+ * if its budget fits before the next frame of each output added with
+ * `wlr_work_queue_add_output`, minus `frame_margin` for rendering, and not
+ * within `input_delay` of the last `wlr_work_queue_notify_input` call.
+ * Otherwise, work resumes after the next frame has been presented.
+ */
+struct wlr_work_queue {
+	struct wl_event_loop *event_loop;
+
+	int64_t slice, frame_margin, input_delay; // nsec
+
+	struct wl_list items; // wlr_work_item::link, highest priority first
+	struct wl_list outputs; // wlr_work_queue_output::link
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	int64_t last_input; // nsec
+	struct wl_event_source *timer;
+	struct wl_listener display_destroy;
+};
+
+struct wlr_work_queue_output {
+	struct wlr_work_queue *queue;
+	struct wlr_output *output;
+	int64_t next_frame; // predicted presentation time, nsec, 0 if unknown
+
+	struct wl_list link; // wlr_work_queue::outputs
+
+	struct wl_listener present;
+	struct wl_listener destroy;
+};
+
+/**
+ * Returns the work queue of the display, creating it on first use. It is
+ * destroyed with the display, dropping the pending work. Returns NULL on
+ * allocation failure.
+ */
+struct wlr_work_queue *wlr_work_queue_get(struct wl_display *display);
+/**
+ * Queues work. Items of the same priority run in the order they were queued.
+ * Returns NULL on allocation failure, in which case `destroy` isn't called.
+ */
+struct wlr_work_item *wlr_work_queue_add(struct wlr_work_queue *queue,
+	enum wlr_work_priority priority, int64_t budget, wlr_work_func_t func,
+	void (*destroy)(void *data), void *data);
+/**
+ * Drops a queued item without running it further. Must not be called from
+ * the item's function, which should return false instead.
+ */
+void wlr_work_item_cancel(struct wlr_work_item *item);
+/**
+ * Makes work yield to the frames of the output. The output is removed when
+ * destroyed.
+ */
+bool wlr_work_queue_add_output(struct wlr_work_queue *queue,
+	struct wlr_output *output);
+/**
+ * Postpones work for `input_delay` nsec, so that the handling of input
+ * bursts isn't delayed. Should be called on each input event.
+ */
+void wlr_work_queue_notify_input(struct wlr_work_queue *queue);
+
+#endif
@@ -61,14 +61,24 @@ struct wlr_xcursor {
 	uint32_t total_delay; /* length of the animation in ms */
 };
 
+struct wlr_xcursor_theme_file;
+
 /**
  * Container for an Xcursor theme.
+ *
+ * Cursors are decoded on first use: cursors only contains the cursors that
+ * have been obtained with wlr_xcursor_theme_get_cursor so far.
  */
 struct wlr_xcursor_theme {
 	unsigned int cursor_count;
 	struct wlr_xcursor **cursors;
 	char *name;
 	int size;
+
+	// Cursor files found in the theme and its inherited themes, in order of
+	// precedence. A cursor can have several files.
+	unsigned int file_count;
+	struct wlr_xcursor_theme_file *files;
 };
 
 /**
@@ -77,6 +87,9 @@ struct wlr_xcursor_theme {
  * client-side cursors is not available or you wish to override client-side
  * cursors for a particular UI interaction (such as using a grab cursor when
  * moving a window around).
+ *
+ * Only the names of the cursors are read at this point, the images of each
+ * cursor are loaded by wlr_xcursor_theme_get_cursor.
  */
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size);
 
@@ -84,6 +97,7 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme);
 
 /**
  * Obtains a wlr_xcursor image for the specified cursor name (e.g. "left_ptr").
+ * The cursor file is read the first time the cursor is requested.
  */
 struct wlr_xcursor *wlr_xcursor_theme_get_cursor(
 	struct wlr_xcursor_theme *theme, const char *name);
@@ -37,6 +37,10 @@ struct wlr_xwayland {
 	int x_fd[2];
 	struct wl_event_source *x_fd_read_event[2];
 	bool lazy;
+	// Only send a window its next geometry once the X server has reported
+	// the previous one with a ConfigureNotify, see
+	// wlr_xwayland_surface_configure
+	bool throttle_configures;
 
 	struct wl_display *wl_display;
 	struct wlr_compositor *compositor;
@@ -107,6 +111,8 @@ struct wlr_xwayland_surface {
 
 	struct wl_list link;
 	struct wl_list unpaired_link;
+	struct wl_list bucket_link;
+	struct wl_list unpaired_bucket_link;
 
 	struct wlr_surface *surface;
 	int16_t x, y;
@@ -147,6 +153,29 @@ struct wlr_xwayland_surface {
 
 	bool has_alpha;
 
+	// Geometry set by wlr_xwayland_surface_configure, sent to the X server
+	// once per event loop iteration
+	struct {
+		bool pending;
+		bool in_flight; // waiting for the ConfigureNotify of `sent`
+		struct {
+			int16_t x, y;
+			uint16_t width, height;
+		} sent; // last geometry sent or reported by the X server
+		struct wl_list link; // wlr_xwm::configure_queue
+	} configure;
+
+	// Initial geometry and properties of override-redirect windows, handled
+	// once their replies arrive instead of waiting for them
+	struct {
+		bool geometry;
+		xcb_get_geometry_cookie_t geometry_cookie;
+		xcb_atom_t *atoms; // XCB_ATOM_NONE once handled
+		xcb_get_property_cookie_t *cookies;
+		size_t len;
+		struct wl_list link; // wlr_xwm::pending_reads
+	} pending_reads;
+
 	struct {
 		struct wl_signal destroy;
 		struct wl_signal request_configure;
@@ -194,7 +223,7 @@ struct wlr_xwayland_resize_event {
 /** Create an Xwayland server.
  *
  * The server supports a lazy mode in which Xwayland is only started when a
- * client tries to connect.
+ * client tries to connect, or when wlr_xwayland_start is called.
  *
  * Note: wlr_xwayland will setup a global SIGUSR1 handler on the compositor
  * process.
@@ -204,6 +233,14 @@ struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
 
 void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland);
 
+/**
+ * Starts a lazy Xwayland server without waiting for a client to connect. This
+ * can be used to start the server in the background once the compositor is
+ * up, so that the first X11 client doesn't have to wait for it. Does nothing
+ * if the server is already started.
+ */
+bool wlr_xwayland_start(struct wlr_xwayland *wlr_xwayland);
+
 void wlr_xwayland_set_cursor(struct wlr_xwayland *wlr_xwayland,
 	uint8_t *pixels, uint32_t stride, uint32_t width, uint32_t height,
 	int32_t hotspot_x, int32_t hotspot_y);
@@ -211,6 +248,12 @@ void wlr_xwayland_set_cursor(struct wlr_xwayland *wlr_xwayland,
 void wlr_xwayland_surface_activate(struct wlr_xwayland_surface *surface,
 	bool activated);
 
+/**
+ * Sets the geometry of the surface. The surface fields are updated right
+ * away, but the X server is only sent the latest geometry of each surface
+ * once per event loop iteration, in a single write. If `throttle_configures`
+ * is set, it isn't sent before the previous geometry has been applied.
+ */
 void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *surface,
 	int16_t x, int16_t y, uint16_t width, uint16_t height);
 
@@ -58,8 +58,11 @@ XcursorLibraryLoadImages (const char *file, const char *theme, int size);
 void
 XcursorImagesDestroy (XcursorImages *images);
 
+XcursorImages *
+xcursor_load_images(const char *path, const char *name, int size);
+
 void
-xcursor_load_theme(const char *theme, int size,
-		    void (*load_callback)(XcursorImages *, void *),
-		    void *user_data);
+xcursor_scan_theme(const char *theme,
+		   void (*scan_callback)(const char *, const char *, void *),
+		   void *user_data);
 #endif
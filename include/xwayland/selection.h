@@ -6,6 +6,8 @@
 #define INCR_CHUNK_SIZE (64 * 1024)
 
 #define XDND_VERSION 5
+// Milliseconds to wait for an XdndStatus before treating it as a refusal
+#define XDND_STATUS_TIMEOUT 500
 
 struct wlr_primary_selection_source;
 
@@ -26,7 +28,8 @@ struct wlr_xwm_selection_transfer {
 	struct wl_list outgoing_link;
 
 	// when receiving from x11
-	int property_start;
+	uint32_t property_offset; // bytes of the property already read
+	int property_start; // bytes of the current chunk already written
 	xcb_get_property_reply_t *property_reply;
 };
 
@@ -95,6 +95,7 @@ enum net_wm_state_action {
 struct wlr_xwm {
 	struct wlr_xwayland *xwayland;
 	struct wl_event_source *event_source;
+	struct wl_event_source *event_timer; // resumes budgeted event dispatch
 	struct wlr_seat *seat;
 	uint32_t ping_timeout;
 
@@ -106,6 +107,8 @@ struct wlr_xwm {
 	xcb_colormap_t colormap;
 	xcb_render_pictformat_t render_format_id;
 	xcb_cursor_t cursor;
+	struct wl_list cursors; // xwm_cursor::link, most recently used first
+	size_t cursors_len;
 
 	xcb_window_t selection_window;
 	struct wlr_xwm_selection clipboard_selection;
@@ -119,8 +122,38 @@ struct wlr_xwm {
 	struct wl_list surfaces; // wlr_xwayland_surface::link
 	struct wl_list unpaired_surfaces; // wlr_xwayland_surface::unpaired_link
 
+	// Hash tables of surfaces keyed by window_id, and of unpaired surfaces
+	// keyed by surface_id
+	struct wl_list *surface_buckets; // wlr_xwayland_surface::bucket_link
+	size_t surface_buckets_len, surfaces_len;
+	// wlr_xwayland_surface::unpaired_bucket_link
+	struct wl_list *unpaired_buckets;
+	size_t unpaired_buckets_len, unpaired_len;
+
+	// Windows of mapped surfaces, in mapping order, as sent in
+	// _NET_CLIENT_LIST once the pending maps and unmaps have been handled
+	struct wl_array client_list; // xcb_window_t
+	struct wl_event_source *client_list_idle;
+
+	// Surfaces with a geometry to send, see wlr_xwayland_surface_configure
+	struct wl_list configure_queue; // wlr_xwayland_surface::configure.link
+	struct wl_event_source *configure_idle;
+
+	// Override-redirect windows waiting for replies
+	struct wl_list pending_reads; // wlr_xwayland_surface::pending_reads.link
+
 	struct wlr_drag *drag;
 	struct wlr_xwayland_surface *drag_focus;
+	// XDND targets reply to each XdndPosition with an XdndStatus, positions
+	// are held back until then and only the latest one is sent
+	struct {
+		bool waiting_status;
+		bool pending;
+		uint32_t time;
+		int16_t x, y;
+		// Fires if the target doesn't reply, see XDND_STATUS_TIMEOUT
+		struct wl_event_source *status_timer;
+	} dnd_position;
 
 	const xcb_query_extension_reply_t *xfixes;
 #if WLR_HAS_XCB_ERRORS
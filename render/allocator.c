@@ -0,0 +1,36 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/interface.h>
+
+void wlr_allocator_init(struct wlr_allocator *alloc,
+		const struct wlr_allocator_impl *impl) {
+	assert(impl->create_buffer && impl->destroy_buffer && impl->destroy);
+	alloc->impl = impl;
+}
+
+void wlr_allocator_destroy(struct wlr_allocator *alloc) {
+	if (alloc == NULL) {
+		return;
+	}
+	alloc->impl->destroy(alloc);
+}
+
+struct wlr_allocator_buffer *wlr_allocator_create_buffer(
+		struct wlr_allocator *alloc, int width, int height, uint32_t format,
+		const uint64_t *modifiers, size_t modifiers_len) {
+	struct wlr_allocator_buffer *buffer = alloc->impl->create_buffer(alloc,
+		width, height, format, modifiers, modifiers_len);
+	if (buffer != NULL) {
+		buffer->allocator = alloc;
+	}
+	return buffer;
+}
+
+void wlr_allocator_buffer_destroy(struct wlr_allocator_buffer *buffer) {
+	if (buffer == NULL) {
+		return;
+	}
+	wlr_dmabuf_attributes_finish(&buffer->dmabuf);
+	buffer->allocator->impl->destroy_buffer(buffer);
+}
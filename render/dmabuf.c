@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
 #include <unistd.h>
 #include <wlr/render/dmabuf.h>
+#include <wlr/util/log.h>
 
 void wlr_dmabuf_attributes_finish( struct wlr_dmabuf_attributes *attribs) {
 	for (int i = 0; i < attribs->n_planes; ++i) {
@@ -8,3 +11,18 @@ void wlr_dmabuf_attributes_finish( struct wlr_dmabuf_attributes *attribs) {
 	}
 	attribs->n_planes = 0;
 }
+
+bool wlr_dmabuf_attributes_copy(struct wlr_dmabuf_attributes *dst,
+		const struct wlr_dmabuf_attributes *src) {
+	*dst = *src;
+	for (int i = 0; i < src->n_planes; ++i) {
+		dst->fd[i] = fcntl(src->fd[i], F_DUPFD_CLOEXEC, 0);
+		if (dst->fd[i] < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to duplicate DMA-BUF fd");
+			dst->n_planes = i;
+			wlr_dmabuf_attributes_finish(dst);
+			return false;
+		}
+	}
+	return true;
+}
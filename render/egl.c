@@ -1,13 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <wlr/render/egl.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "glapi.h"
+#include "util/startup.h"
 
 static bool egl_get_config(EGLDisplay disp, EGLint *attribs, EGLConfig *out,
 		EGLint visual_id) {
@@ -104,6 +107,10 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 		return false;
 	}
 
+	// Before anything can fail, wlr_egl_finish walks the pool
+	pthread_mutex_init(&egl->context_pool.lock, NULL);
+	wl_list_init(&egl->context_pool.contexts);
+
 	if (eglDebugMessageControlKHR) {
 		static const EGLAttrib debug_attribs[] = {
 			EGL_DEBUG_MSG_CRITICAL_KHR, EGL_TRUE,
@@ -163,6 +170,10 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 		(check_egl_ext(egl->exts_str, "EGL_KHR_swap_buffers_with_damage") &&
 			eglSwapBuffersWithDamageKHR);
 
+	egl->exts.partial_update_khr =
+		check_egl_ext(egl->exts_str, "EGL_KHR_partial_update") &&
+		eglSetDamageRegionKHR;
+
 	egl->exts.image_dmabuf_import_ext =
 		check_egl_ext(egl->exts_str, "EGL_EXT_image_dma_buf_import");
 	egl->exts.image_dmabuf_import_modifiers_ext =
@@ -173,6 +184,19 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 		check_egl_ext(egl->exts_str, "EGL_MESA_image_dma_buf_export") &&
 		eglExportDMABUFImageQueryMESA && eglExportDMABUFImageMESA;
 
+	egl->exts.wait_sync_khr =
+		check_egl_ext(egl->exts_str, "EGL_KHR_wait_sync") &&
+		eglCreateSyncKHR && eglDestroySyncKHR && eglWaitSyncKHR;
+	egl->exts.native_fence_sync_android =
+		check_egl_ext(egl->exts_str, "EGL_ANDROID_native_fence_sync") &&
+		egl->exts.wait_sync_khr && eglDupNativeFenceFDANDROID;
+	egl->exts.fence_sync_khr =
+		check_egl_ext(egl->exts_str, "EGL_KHR_fence_sync") &&
+		eglCreateSyncKHR && eglDestroySyncKHR && eglClientWaitSyncKHR;
+
+	egl->exts.surfaceless_context_khr =
+		check_egl_ext(egl->exts_str, "EGL_KHR_surfaceless_context");
+
 	print_dmabuf_formats(egl);
 
 	egl->exts.bind_wayland_display_wl =
@@ -226,6 +250,7 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 		goto error;
 	}
 
+	startup_mark("EGL initialized");
 	return true;
 
 error:
@@ -238,7 +263,7 @@ error:
 }
 
 void wlr_egl_finish(struct wlr_egl *egl) {
-	if (egl == NULL) {
+	if (egl == NULL || egl->display == EGL_NO_DISPLAY) {
 		return;
 	}
 
@@ -248,6 +273,15 @@ void wlr_egl_finish(struct wlr_egl *egl) {
 		eglUnbindWaylandDisplayWL(egl->display, egl->wl_display);
 	}
 
+	struct wlr_egl_context *ctx, *tmp;
+	wl_list_for_each_safe(ctx, tmp, &egl->context_pool.contexts, link) {
+		assert(!ctx->in_use);
+		eglDestroyContext(egl->display, ctx->context);
+		wl_list_remove(&ctx->link);
+		free(ctx);
+	}
+	pthread_mutex_destroy(&egl->context_pool.lock);
+
 	eglDestroyContext(egl->display, egl->context);
 	eglTerminate(egl->display);
 	eglReleaseThread();
@@ -287,6 +321,30 @@ EGLSurface wlr_egl_create_surface(struct wlr_egl *egl, void *window) {
 	return surf;
 }
 
+EGLSurface wlr_egl_create_surface_with_visual(struct wlr_egl *egl,
+		void *window, EGLint visual_id) {
+	assert(eglCreatePlatformWindowSurfaceEXT);
+	EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+		EGL_RED_SIZE, 1,
+		EGL_GREEN_SIZE, 1,
+		EGL_BLUE_SIZE, 1,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	if (!egl_get_config(egl->display, config_attribs, &config, visual_id)) {
+		return EGL_NO_SURFACE;
+	}
+
+	EGLSurface surf = eglCreatePlatformWindowSurfaceEXT(egl->display,
+		config, window, NULL);
+	if (surf == EGL_NO_SURFACE) {
+		wlr_log(WLR_ERROR, "Failed to create EGL surface");
+		return EGL_NO_SURFACE;
+	}
+	return surf;
+}
+
 static int egl_get_buffer_age(struct wlr_egl *egl, EGLSurface surface) {
 	if (!egl->exts.buffer_age_ext) {
 		return -1;
@@ -305,7 +363,13 @@ static int egl_get_buffer_age(struct wlr_egl *egl, EGLSurface surface) {
 
 bool wlr_egl_make_current(struct wlr_egl *egl, EGLSurface surface,
 		int *buffer_age) {
-	if (!eglMakeCurrent(egl->display, surface, surface, egl->context)) {
+	// Switching contexts is expensive with some drivers even if nothing
+	// changes, e.g. when several outputs are rendered in a row
+	bool is_current = eglGetCurrentContext() == egl->context &&
+		eglGetCurrentSurface(EGL_DRAW) == surface &&
+		eglGetCurrentSurface(EGL_READ) == surface;
+	if (!is_current &&
+			!eglMakeCurrent(egl->display, surface, surface, egl->context)) {
 		wlr_log(WLR_ERROR, "eglMakeCurrent failed");
 		return false;
 	}
@@ -320,6 +384,128 @@ bool wlr_egl_is_current(struct wlr_egl *egl) {
 	return eglGetCurrentContext() == egl->context;
 }
 
+struct wlr_egl_context *wlr_egl_acquire_context(struct wlr_egl *egl) {
+	if (!egl->exts.surfaceless_context_khr) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&egl->context_pool.lock);
+	struct wlr_egl_context *ctx;
+	wl_list_for_each(ctx, &egl->context_pool.contexts, link) {
+		if (!ctx->in_use) {
+			ctx->in_use = true;
+			pthread_mutex_unlock(&egl->context_pool.lock);
+			return ctx;
+		}
+	}
+	pthread_mutex_unlock(&egl->context_pool.lock);
+
+	ctx = calloc(1, sizeof(struct wlr_egl_context));
+	if (ctx == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	ctx->egl = egl;
+	ctx->in_use = true;
+
+	const EGLint attribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE,
+	};
+	ctx->context = eglCreateContext(egl->display, egl->config, egl->context,
+		attribs);
+	if (ctx->context == EGL_NO_CONTEXT) {
+		wlr_log(WLR_ERROR, "Failed to create shared EGL context");
+		free(ctx);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&egl->context_pool.lock);
+	wl_list_insert(&egl->context_pool.contexts, &ctx->link);
+	pthread_mutex_unlock(&egl->context_pool.lock);
+	return ctx;
+}
+
+bool wlr_egl_context_make_current(struct wlr_egl_context *ctx) {
+	assert(ctx->in_use);
+	if (eglGetCurrentContext() == ctx->context) {
+		return true;
+	}
+	if (!eglMakeCurrent(ctx->egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			ctx->context)) {
+		wlr_log(WLR_ERROR, "eglMakeCurrent failed");
+		return false;
+	}
+	return true;
+}
+
+void wlr_egl_release_context(struct wlr_egl_context *ctx) {
+	struct wlr_egl *egl = ctx->egl;
+	if (eglGetCurrentContext() == ctx->context) {
+		eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+	}
+
+	pthread_mutex_lock(&egl->context_pool.lock);
+	ctx->in_use = false;
+	pthread_mutex_unlock(&egl->context_pool.lock);
+}
+
+// Converts damage to EGL rectangles, which have a bottom-left origin. Returns
+// the number of rectangles, the array must be freed by the caller.
+static int egl_damage_rects(struct wlr_egl *egl, EGLSurface surface,
+		pixman_region32_t *damage, EGLint **egl_damage) {
+	EGLint width = 0, height = 0;
+	eglQuerySurface(egl->display, surface, EGL_WIDTH, &width);
+	eglQuerySurface(egl->display, surface, EGL_HEIGHT, &height);
+
+	pixman_region32_t flipped_damage;
+	pixman_region32_init(&flipped_damage);
+	wlr_region_transform(&flipped_damage, damage,
+		WL_OUTPUT_TRANSFORM_FLIPPED_180, width, height);
+
+	int nrects;
+	pixman_box32_t *rects =
+		pixman_region32_rectangles(&flipped_damage, &nrects);
+	*egl_damage = calloc(nrects > 0 ? 4 * nrects : 1, sizeof(EGLint));
+	if (*egl_damage == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		pixman_region32_fini(&flipped_damage);
+		return -1;
+	}
+	for (int i = 0; i < nrects; ++i) {
+		(*egl_damage)[4*i] = rects[i].x1;
+		(*egl_damage)[4*i + 1] = rects[i].y1;
+		(*egl_damage)[4*i + 2] = rects[i].x2 - rects[i].x1;
+		(*egl_damage)[4*i + 3] = rects[i].y2 - rects[i].y1;
+	}
+
+	pixman_region32_fini(&flipped_damage);
+	return nrects;
+}
+
+bool wlr_egl_set_damage_region(struct wlr_egl *egl, EGLSurface surface,
+		pixman_region32_t *damage) {
+	if (!egl->exts.partial_update_khr) {
+		return false;
+	}
+
+	EGLint *egl_damage;
+	int nrects = egl_damage_rects(egl, surface, damage, &egl_damage);
+	if (nrects < 0) {
+		return false;
+	}
+
+	EGLBoolean ret = eglSetDamageRegionKHR(egl->display, surface, egl_damage,
+		nrects);
+	free(egl_damage);
+	if (!ret) {
+		wlr_log(WLR_ERROR, "eglSetDamageRegionKHR failed");
+		return false;
+	}
+	return true;
+}
+
 bool wlr_egl_swap_buffers(struct wlr_egl *egl, EGLSurface surface,
 		pixman_region32_t *damage) {
 	// Never block when swapping buffers on Wayland
@@ -330,28 +516,12 @@ bool wlr_egl_swap_buffers(struct wlr_egl *egl, EGLSurface surface,
 	EGLBoolean ret;
 	if (damage != NULL && (egl->exts.swap_buffers_with_damage_ext ||
 				egl->exts.swap_buffers_with_damage_khr)) {
-		EGLint width = 0, height = 0;
-		eglQuerySurface(egl->display, surface, EGL_WIDTH, &width);
-		eglQuerySurface(egl->display, surface, EGL_HEIGHT, &height);
-
-		pixman_region32_t flipped_damage;
-		pixman_region32_init(&flipped_damage);
-		wlr_region_transform(&flipped_damage, damage,
-			WL_OUTPUT_TRANSFORM_FLIPPED_180, width, height);
-
-		int nrects;
-		pixman_box32_t *rects =
-			pixman_region32_rectangles(&flipped_damage, &nrects);
-		EGLint egl_damage[4 * nrects];
-		for (int i = 0; i < nrects; ++i) {
-			egl_damage[4*i] = rects[i].x1;
-			egl_damage[4*i + 1] = rects[i].y1;
-			egl_damage[4*i + 2] = rects[i].x2 - rects[i].x1;
-			egl_damage[4*i + 3] = rects[i].y2 - rects[i].y1;
+		EGLint *egl_damage;
+		int nrects = egl_damage_rects(egl, surface, damage, &egl_damage);
+		if (nrects < 0) {
+			return false;
 		}
 
-		pixman_region32_fini(&flipped_damage);
-
 		if (egl->exts.swap_buffers_with_damage_ext) {
 			ret = eglSwapBuffersWithDamageEXT(egl->display, surface, egl_damage,
 				nrects);
@@ -359,6 +529,7 @@ bool wlr_egl_swap_buffers(struct wlr_egl *egl, EGLSurface surface,
 			ret = eglSwapBuffersWithDamageKHR(egl->display, surface, egl_damage,
 				nrects);
 		}
+		free(egl_damage);
 	} else {
 		ret = eglSwapBuffers(egl->display, surface);
 	}
@@ -570,6 +741,47 @@ int wlr_egl_get_dmabuf_modifiers(struct wlr_egl *egl,
 	return num;
 }
 
+bool wlr_egl_get_drm_device(struct wlr_egl *egl, dev_t *dev) {
+	const char *client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (client_exts == NULL ||
+			!check_egl_ext(client_exts, "EGL_EXT_device_query") ||
+			!eglQueryDisplayAttribEXT || !eglQueryDeviceStringEXT) {
+		wlr_log(WLR_DEBUG, "EGL_EXT_device_query not supported");
+		return false;
+	}
+
+	EGLAttrib device_attrib;
+	if (!eglQueryDisplayAttribEXT(egl->display, EGL_DEVICE_EXT,
+			&device_attrib)) {
+		wlr_log(WLR_ERROR, "eglQueryDisplayAttribEXT(EGL_DEVICE_EXT) failed");
+		return false;
+	}
+	EGLDeviceEXT device = (EGLDeviceEXT)device_attrib;
+
+	const char *device_exts = eglQueryDeviceStringEXT(device, EGL_EXTENSIONS);
+	if (device_exts == NULL ||
+			!check_egl_ext(device_exts, "EGL_EXT_device_drm")) {
+		wlr_log(WLR_DEBUG, "EGL_EXT_device_drm not supported");
+		return false;
+	}
+
+	const char *path = eglQueryDeviceStringEXT(device,
+		EGL_DRM_DEVICE_FILE_EXT);
+	if (path == NULL) {
+		wlr_log(WLR_ERROR, "eglQueryDeviceStringEXT(EGL_DRM_DEVICE_FILE_EXT) "
+			"failed");
+		return false;
+	}
+
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to stat '%s'", path);
+		return false;
+	}
+	*dev = st.st_rdev;
+	return true;
+}
+
 bool wlr_egl_export_image_to_dmabuf(struct wlr_egl *egl, EGLImageKHR image,
 		int32_t width, int32_t height, uint32_t flags,
 		struct wlr_dmabuf_attributes *attribs) {
@@ -607,3 +819,81 @@ bool wlr_egl_destroy_surface(struct wlr_egl *egl, EGLSurface surface) {
 	}
 	return eglDestroySurface(egl->display, surface);
 }
+
+EGLSyncKHR wlr_egl_create_native_fence(struct wlr_egl *egl, int fence_fd) {
+	if (!egl->exts.native_fence_sync_android) {
+		return EGL_NO_SYNC_KHR;
+	}
+
+	EGLint attribs[] = {
+		EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence_fd,
+		EGL_NONE,
+	};
+	EGLSyncKHR sync = eglCreateSyncKHR(egl->display,
+		EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+	if (sync == EGL_NO_SYNC_KHR) {
+		wlr_log(WLR_ERROR, "eglCreateSyncKHR failed");
+	}
+	return sync;
+}
+
+int wlr_egl_dup_native_fence_fd(struct wlr_egl *egl, EGLSyncKHR sync) {
+	if (!egl->exts.native_fence_sync_android) {
+		return -1;
+	}
+
+	int fd = eglDupNativeFenceFDANDROID(egl->display, sync);
+	if (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+		wlr_log(WLR_ERROR, "eglDupNativeFenceFDANDROID failed");
+		return -1;
+	}
+	return fd;
+}
+
+EGLSyncKHR wlr_egl_create_fence(struct wlr_egl *egl) {
+	if (!egl->exts.fence_sync_khr) {
+		return EGL_NO_SYNC_KHR;
+	}
+
+	EGLSyncKHR sync = eglCreateSyncKHR(egl->display, EGL_SYNC_FENCE_KHR, NULL);
+	if (sync == EGL_NO_SYNC_KHR) {
+		wlr_log(WLR_ERROR, "eglCreateSyncKHR failed");
+	}
+	return sync;
+}
+
+bool wlr_egl_wait_sync(struct wlr_egl *egl, EGLSyncKHR sync) {
+	if (!egl->exts.wait_sync_khr) {
+		return false;
+	}
+
+	if (eglWaitSyncKHR(egl->display, sync, 0) != EGL_TRUE) {
+		wlr_log(WLR_ERROR, "eglWaitSyncKHR failed");
+		return false;
+	}
+	return true;
+}
+
+void wlr_egl_destroy_sync(struct wlr_egl *egl, EGLSyncKHR sync) {
+	if (sync == EGL_NO_SYNC_KHR) {
+		return;
+	}
+	if (eglDestroySyncKHR(egl->display, sync) != EGL_TRUE) {
+		wlr_log(WLR_ERROR, "eglDestroySyncKHR failed");
+	}
+}
+
+bool wlr_egl_client_wait_sync(struct wlr_egl *egl, EGLSyncKHR sync,
+		uint64_t timeout) {
+	if (!egl->exts.fence_sync_khr) {
+		return false;
+	}
+
+	EGLint ret = eglClientWaitSyncKHR(egl->display, sync,
+		EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, timeout);
+	if (ret == EGL_FALSE) {
+		wlr_log(WLR_ERROR, "eglClientWaitSyncKHR failed");
+		return false;
+	}
+	return ret == EGL_CONDITION_SATISFIED_KHR;
+}
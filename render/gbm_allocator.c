@@ -0,0 +1,122 @@
+#include <assert.h>
+#include <gbm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/render/interface.h>
+#include <wlr/util/log.h>
+#include "render/gbm_allocator.h"
+
+bool export_gbm_bo(struct gbm_bo *bo, struct wlr_dmabuf_attributes *attribs) {
+	memset(attribs, 0, sizeof(struct wlr_dmabuf_attributes));
+
+	attribs->n_planes = gbm_bo_get_plane_count(bo);
+	if (attribs->n_planes > WLR_DMABUF_MAX_PLANES) {
+		return false;
+	}
+
+	attribs->width = gbm_bo_get_width(bo);
+	attribs->height = gbm_bo_get_height(bo);
+	attribs->format = gbm_bo_get_format(bo);
+	attribs->modifier = gbm_bo_get_modifier(bo);
+
+	for (int i = 0; i < attribs->n_planes; ++i) {
+		attribs->offset[i] = gbm_bo_get_offset(bo, i);
+		attribs->stride[i] = gbm_bo_get_stride_for_plane(bo, i);
+		attribs->fd[i] = gbm_bo_get_fd(bo);
+		if (attribs->fd[i] < 0) {
+			for (int j = 0; j < i; ++j) {
+				close(attribs->fd[j]);
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static const struct wlr_allocator_impl allocator_impl;
+
+static struct wlr_gbm_allocator *gbm_allocator_from_allocator(
+		struct wlr_allocator *alloc) {
+	assert(alloc->impl == &allocator_impl);
+	return (struct wlr_gbm_allocator *)alloc;
+}
+
+static struct wlr_allocator_buffer *allocator_create_buffer(
+		struct wlr_allocator *wlr_alloc, int width, int height,
+		uint32_t format, const uint64_t *modifiers, size_t modifiers_len) {
+	struct wlr_gbm_allocator *alloc = gbm_allocator_from_allocator(wlr_alloc);
+
+	struct wlr_gbm_buffer *buffer = calloc(1, sizeof(struct wlr_gbm_buffer));
+	if (buffer == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	if (modifiers_len > 0) {
+		buffer->bo = gbm_bo_create_with_modifiers(alloc->gbm, width, height,
+			format, modifiers, modifiers_len);
+	} else {
+		buffer->bo = gbm_bo_create(alloc->gbm, width, height, format,
+			GBM_BO_USE_RENDERING | GBM_BO_USE_SCANOUT);
+		if (buffer->bo == NULL) {
+			// Some devices can render but can't scan out
+			buffer->bo = gbm_bo_create(alloc->gbm, width, height, format,
+				GBM_BO_USE_RENDERING);
+		}
+	}
+	if (buffer->bo == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to create GBM buffer");
+		free(buffer);
+		return NULL;
+	}
+
+	if (!export_gbm_bo(buffer->bo, &buffer->base.dmabuf)) {
+		wlr_log(WLR_ERROR, "Failed to export GBM buffer");
+		gbm_bo_destroy(buffer->bo);
+		free(buffer);
+		return NULL;
+	}
+
+	return &buffer->base;
+}
+
+static void allocator_destroy_buffer(struct wlr_allocator_buffer *wlr_buffer) {
+	struct wlr_gbm_buffer *buffer = (struct wlr_gbm_buffer *)wlr_buffer;
+	gbm_bo_destroy(buffer->bo);
+	free(buffer);
+}
+
+static void allocator_destroy(struct wlr_allocator *wlr_alloc) {
+	struct wlr_gbm_allocator *alloc = gbm_allocator_from_allocator(wlr_alloc);
+	gbm_device_destroy(alloc->gbm);
+	close(alloc->fd);
+	free(alloc);
+}
+
+static const struct wlr_allocator_impl allocator_impl = {
+	.create_buffer = allocator_create_buffer,
+	.destroy_buffer = allocator_destroy_buffer,
+	.destroy = allocator_destroy,
+};
+
+struct wlr_allocator *wlr_gbm_allocator_create(int drm_fd) {
+	struct wlr_gbm_allocator *alloc =
+		calloc(1, sizeof(struct wlr_gbm_allocator));
+	if (alloc == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	alloc->gbm = gbm_create_device(drm_fd);
+	if (alloc->gbm == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create GBM device");
+		free(alloc);
+		return NULL;
+	}
+	alloc->fd = drm_fd;
+
+	wlr_allocator_init(&alloc->base, &allocator_impl);
+	return &alloc->base;
+}
@@ -1,7 +1,39 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "render/gles2.h"
 
+/*
+ * Conversion kernels, used when the memory layout of a wl_shm format doesn't
+ * match any GL format. They only reorder channels, so they can work in place.
+ * The loops have no dependencies between iterations and compilers vectorize
+ * them.
+ */
+
+static void convert_swap_rb_32(void *dst, const void *src, uint32_t width) {
+	const unsigned char *s = src;
+	unsigned char *d = dst;
+	for (uint32_t i = 0; i < width; ++i) {
+		uint32_t p;
+		memcpy(&p, s + i * 4, sizeof(p));
+		p = (p & 0xFF00FF00) | ((p & 0xFF) << 16) | ((p >> 16) & 0xFF);
+		memcpy(d + i * 4, &p, sizeof(p));
+	}
+}
+
+static void convert_swap_rb_24(void *dst, const void *src, uint32_t width) {
+	const unsigned char *s = src;
+	unsigned char *d = dst;
+	for (uint32_t i = 0; i < width; ++i) {
+		unsigned char r = s[i * 3], g = s[i * 3 + 1], b = s[i * 3 + 2];
+		d[i * 3] = b;
+		d[i * 3 + 1] = g;
+		d[i * 3 + 2] = r;
+	}
+}
+
 /*
  * The wayland formats are little endian while the GL formats are big endian,
  * so WL_SHM_FORMAT_ARGB8888 is actually compatible with GL_BGRA_EXT.
@@ -39,6 +71,56 @@ static const struct wlr_gles2_pixel_format formats[] = {
 		.gl_type = GL_UNSIGNED_BYTE,
 		.has_alpha = true,
 	},
+	{
+		.wl_format = WL_SHM_FORMAT_RGB565,
+		.depth = 16,
+		.bpp = 16,
+		.gl_format = GL_RGB,
+		.gl_type = GL_UNSIGNED_SHORT_5_6_5,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_BGR888,
+		.depth = 24,
+		.bpp = 24,
+		.gl_format = GL_RGB,
+		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_RGB888,
+		.depth = 24,
+		.bpp = 24,
+		.gl_format = GL_RGB,
+		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = false,
+		.convert = convert_swap_rb_24,
+	},
+};
+
+/*
+ * Read-back of BGRA formats without GL_EXT_read_format_bgra: pixels are read
+ * as RGBA and converted afterwards.
+ */
+static const struct wlr_gles2_pixel_format swizzled_read_formats[] = {
+	{
+		.wl_format = WL_SHM_FORMAT_ARGB8888,
+		.depth = 32,
+		.bpp = 32,
+		.gl_format = GL_RGBA,
+		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = true,
+		.convert = convert_swap_rb_32,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_XRGB8888,
+		.depth = 24,
+		.bpp = 32,
+		.gl_format = GL_RGBA,
+		.gl_type = GL_UNSIGNED_BYTE,
+		.has_alpha = false,
+		.convert = convert_swap_rb_32,
+	},
 };
 
 static const enum wl_shm_format wl_formats[] = {
@@ -46,10 +128,11 @@ static const enum wl_shm_format wl_formats[] = {
 	WL_SHM_FORMAT_XRGB8888,
 	WL_SHM_FORMAT_ABGR8888,
 	WL_SHM_FORMAT_XBGR8888,
+	WL_SHM_FORMAT_RGB565,
+	WL_SHM_FORMAT_BGR888,
+	WL_SHM_FORMAT_RGB888,
 };
 
-// TODO: more pixel formats
-
 const struct wlr_gles2_pixel_format *get_gles2_format_from_wl(
 		enum wl_shm_format fmt) {
 	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
@@ -63,15 +146,44 @@ const struct wlr_gles2_pixel_format *get_gles2_format_from_wl(
 const struct wlr_gles2_pixel_format *get_gles2_format_from_gl(
 		GLint gl_format, GLint gl_type, bool alpha) {
 	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+		// Read-back users expect 4 bytes per pixel
 		if (formats[i].gl_format == gl_format &&
 				formats[i].gl_type == gl_type &&
-				formats[i].has_alpha == alpha) {
+				formats[i].has_alpha == alpha &&
+				formats[i].bpp == 32 && formats[i].convert == NULL) {
 			return &formats[i];
 		}
 	}
 	return NULL;
 }
 
+const struct wlr_gles2_pixel_format *get_gles2_swizzled_read_format(
+		enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(swizzled_read_formats) /
+			sizeof(*swizzled_read_formats); ++i) {
+		if (swizzled_read_formats[i].wl_format == fmt) {
+			return &swizzled_read_formats[i];
+		}
+	}
+	return NULL;
+}
+
+void *gles2_convert_pixels(const struct wlr_gles2_pixel_format *fmt,
+		uint32_t stride, uint32_t width, uint32_t height, uint32_t src_x,
+		uint32_t src_y, const void *data) {
+	size_t row_size = (size_t)width * fmt->bpp / 8;
+	unsigned char *converted = malloc(row_size * height);
+	if (converted == NULL) {
+		return NULL;
+	}
+	const unsigned char *src = (const unsigned char *)data +
+		src_y * stride + src_x * fmt->bpp / 8;
+	for (uint32_t i = 0; i < height; ++i) {
+		fmt->convert(converted + i * row_size, src + i * stride, width);
+	}
+	return converted;
+}
+
 const enum wl_shm_format *get_gles2_wl_formats(size_t *len) {
 	*len = sizeof(wl_formats) / sizeof(wl_formats[0]);
 	return wl_formats;
@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <wlr/util/log.h>
+#include <wlr/util/work_queue.h>
+#include "glapi.h"
+#include "render/gles2.h"
+
+/*
+ * Cached programs are stored in $XDG_CACHE_HOME/wlroots, one file per
+ * program. A file is named after a hash of the driver's identification strings
+ * and of the shader sources, so that updating either invalidates it. It
+ * contains the binary format followed by the binary itself.
+ *
+ * Binaries are retrieved right after linking, but written from the work queue
+ * of the display, so that file I/O delays neither the startup nor frames.
+ * Binaries of the programs linked before the renderer gets a display wait for
+ * it. Pending binaries are written right away when either the renderer or the
+ * work queue is destroyed.
+ */
+
+// Expected duration of a program binary write, nsec
+#define PROGRAM_WRITE_BUDGET 2000000
+
+struct program_write {
+	char *path;
+	uint32_t format;
+	void *binary;
+	size_t len;
+	struct wlr_work_item *item; // NULL if not queued yet
+	struct wl_list link; // wlr_gles2_renderer::program_writes
+};
+
+static uint64_t hash_str(uint64_t hash, const char *str) {
+	// FNV-1a
+	for (const unsigned char *c = (const unsigned char *)str; *c; ++c) {
+		hash ^= *c;
+		hash *= UINT64_C(0x100000001b3);
+	}
+	return hash;
+}
+
+static bool ensure_dir(const char *path) {
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create directory '%s'", path);
+		return false;
+	}
+	return true;
+}
+
+char *gles2_get_program_cache_dir(void) {
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	char *home_cache = NULL;
+	if (cache_home == NULL || cache_home[0] == '\0') {
+		const char *home = getenv("HOME");
+		if (home == NULL) {
+			return NULL;
+		}
+		size_t len = strlen(home) + strlen("/.cache") + 1;
+		home_cache = malloc(len);
+		if (home_cache == NULL) {
+			return NULL;
+		}
+		snprintf(home_cache, len, "%s/.cache", home);
+		cache_home = home_cache;
+	}
+
+	size_t len = strlen(cache_home) + strlen("/wlroots") + 1;
+	char *dir = malloc(len);
+	if (dir == NULL) {
+		free(home_cache);
+		return NULL;
+	}
+	snprintf(dir, len, "%s/wlroots", cache_home);
+
+	bool ok = ensure_dir(cache_home) && ensure_dir(dir);
+	free(home_cache);
+	if (!ok) {
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+static char *get_program_path(struct wlr_gles2_renderer *renderer,
+		const GLchar *vert_src, const GLchar *frag_src) {
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+	hash = hash_str(hash, (const char *)glGetString(GL_VENDOR));
+	hash = hash_str(hash, (const char *)glGetString(GL_RENDERER));
+	hash = hash_str(hash, (const char *)glGetString(GL_VERSION));
+	hash = hash_str(hash, vert_src);
+	hash = hash_str(hash, frag_src);
+
+	int len = snprintf(NULL, 0, "%s/gles2-%016"PRIx64".bin",
+		renderer->program_cache_dir, hash) + 1;
+	char *path = malloc(len);
+	if (path == NULL) {
+		return NULL;
+	}
+	snprintf(path, len, "%s/gles2-%016"PRIx64".bin",
+		renderer->program_cache_dir, hash);
+	return path;
+}
+
+GLuint gles2_load_program_binary(struct wlr_gles2_renderer *renderer,
+		const GLchar *vert_src, const GLchar *frag_src) {
+	if (renderer->program_cache_dir == NULL) {
+		return 0;
+	}
+
+	char *path = get_program_path(renderer, vert_src, frag_src);
+	if (path == NULL) {
+		return 0;
+	}
+
+	GLuint prog = 0;
+	void *binary = NULL;
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		goto out;
+	}
+
+	uint32_t format;
+	if (fread(&format, sizeof(format), 1, f) != 1 ||
+			fseek(f, 0, SEEK_END) != 0) {
+		goto out;
+	}
+	long size = ftell(f) - (long)sizeof(format);
+	if (size <= 0 || fseek(f, sizeof(format), SEEK_SET) != 0) {
+		goto out;
+	}
+
+	binary = malloc(size);
+	if (binary == NULL || fread(binary, size, 1, f) != 1) {
+		goto out;
+	}
+
+	PUSH_GLES2_DEBUG;
+	prog = glCreateProgram();
+	glProgramBinaryOES(prog, format, binary, size);
+
+	// Drivers reject binaries they can't use anymore, e.g. after an update
+	// which didn't change the version strings
+	GLint ok;
+	glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+	if (ok == GL_FALSE) {
+		wlr_log(WLR_DEBUG, "Ignoring stale program binary '%s'", path);
+		glDeleteProgram(prog);
+		prog = 0;
+	}
+	POP_GLES2_DEBUG;
+
+out:
+	if (f != NULL) {
+		fclose(f);
+	}
+	free(binary);
+	free(path);
+	return prog;
+}
+
+static void write_program_binary(const char *path, uint32_t format,
+		const void *binary, size_t len) {
+	// Write to a temporary file first, so that concurrent compositors never
+	// load a truncated binary
+	size_t tmp_len = strlen(path) + strlen(".tmp") + 1;
+	char *tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) {
+		return;
+	}
+	snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+	FILE *f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		wlr_log_errno(WLR_DEBUG, "Failed to open '%s'", tmp_path);
+		free(tmp_path);
+		return;
+	}
+	bool ok = fwrite(&format, sizeof(format), 1, f) == 1 &&
+		fwrite(binary, len, 1, f) == 1;
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(tmp_path, path) != 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to write program binary '%s'", path);
+		remove(tmp_path);
+	}
+	free(tmp_path);
+}
+
+static void program_write_destroy(void *data) {
+	struct program_write *write = data;
+	wl_list_remove(&write->link);
+	free(write->path);
+	free(write->binary);
+	free(write);
+}
+
+static bool program_write_run(void *data, int64_t deadline) {
+	struct program_write *write = data;
+	write_program_binary(write->path, write->format, write->binary,
+		write->len);
+	return false;
+}
+
+static void flush_program_writes(struct wlr_gles2_renderer *renderer) {
+	struct program_write *write, *tmp;
+	wl_list_for_each_safe(write, tmp, &renderer->program_writes, link) {
+		program_write_run(write, 0);
+		if (write->item != NULL) {
+			wlr_work_item_cancel(write->item);
+		} else {
+			program_write_destroy(write);
+		}
+	}
+}
+
+static void handle_work_queue_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_gles2_renderer *renderer =
+		wl_container_of(listener, renderer, work_queue_destroy);
+	// The queue would drop the writes it didn't run yet
+	flush_program_writes(renderer);
+	wl_list_remove(&renderer->work_queue_destroy.link);
+	renderer->work_queue = NULL;
+}
+
+static bool queue_program_write(struct wlr_gles2_renderer *renderer,
+		struct program_write *write) {
+	write->item = wlr_work_queue_add(renderer->work_queue,
+		WLR_WORK_PRIORITY_LOW, PROGRAM_WRITE_BUDGET, program_write_run,
+		program_write_destroy, write);
+	return write->item != NULL;
+}
+
+void gles2_init_program_cache(struct wlr_gles2_renderer *renderer,
+		struct wl_display *display) {
+	if (renderer->program_cache_dir == NULL ||
+			renderer->work_queue != NULL) {
+		return;
+	}
+	renderer->work_queue = wlr_work_queue_get(display);
+	if (renderer->work_queue == NULL) {
+		return;
+	}
+	renderer->work_queue_destroy.notify = handle_work_queue_destroy;
+	wl_signal_add(&renderer->work_queue->events.destroy,
+		&renderer->work_queue_destroy);
+
+	struct program_write *write, *tmp;
+	wl_list_for_each_safe(write, tmp, &renderer->program_writes, link) {
+		queue_program_write(renderer, write);
+	}
+}
+
+void gles2_finish_program_cache(struct wlr_gles2_renderer *renderer) {
+	if (renderer->work_queue != NULL) {
+		wl_list_remove(&renderer->work_queue_destroy.link);
+	}
+	flush_program_writes(renderer);
+}
+
+void gles2_save_program_binary(struct wlr_gles2_renderer *renderer,
+		GLuint prog, const GLchar *vert_src, const GLchar *frag_src) {
+	if (renderer->program_cache_dir == NULL) {
+		return;
+	}
+
+	PUSH_GLES2_DEBUG;
+
+	void *binary = NULL;
+	char *path = get_program_path(renderer, vert_src, frag_src);
+	if (path == NULL) {
+		goto out;
+	}
+
+	GLint size = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH_OES, &size);
+	if (size <= 0) {
+		goto out;
+	}
+
+	binary = malloc(size);
+	if (binary == NULL) {
+		goto out;
+	}
+	GLenum format;
+	GLsizei len = 0;
+	glGetProgramBinaryOES(prog, size, &len, &format, binary);
+	if (len <= 0) {
+		goto out;
+	}
+
+	struct program_write *write = calloc(1, sizeof(struct program_write));
+	if (write == NULL) {
+		write_program_binary(path, format, binary, len);
+		goto out;
+	}
+	write->path = path;
+	write->format = format;
+	write->binary = binary;
+	write->len = len;
+	wl_list_insert(renderer->program_writes.prev, &write->link);
+	path = NULL;
+	binary = NULL;
+
+	if (renderer->work_queue != NULL) {
+		queue_program_write(renderer, write);
+	}
+
+out:
+	POP_GLES2_DEBUG;
+	free(binary);
+	free(path);
+}
@@ -1,9 +1,11 @@
 #include <assert.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-server-protocol.h>
 #include <wayland-util.h>
 #include <wlr/render/egl.h>
@@ -13,6 +15,7 @@
 #include <wlr/util/log.h>
 #include "glapi.h"
 #include "render/gles2.h"
+#include "util/startup.h"
 
 static const struct wlr_renderer_impl renderer_impl;
 
@@ -29,16 +32,166 @@ static struct wlr_gles2_renderer *gles2_get_renderer_in_context(
 	return renderer;
 }
 
+// Gets the column-major matrix and the offset converting the YUV samples of
+// texture to RGB, as rgb = matrix * (yuv - offset)
+static void get_yuv_conversion(const struct wlr_gles2_texture *texture,
+		GLfloat matrix[static 9], GLfloat offset[static 3]) {
+	// Red from V, blue from U, green from both
+	float kr_v, kg_u, kg_v, kb_u;
+	switch (texture->yuv.encoding) {
+	case WLR_GLES2_YUV_ENCODING_BT601:
+		kr_v = 1.402f;
+		kg_u = 0.344136f;
+		kg_v = 0.714136f;
+		kb_u = 1.772f;
+		break;
+	case WLR_GLES2_YUV_ENCODING_BT709:
+	default:
+		kr_v = 1.5748f;
+		kg_u = 0.187324f;
+		kg_v = 0.468124f;
+		kb_u = 1.8556f;
+		break;
+	}
+
+	// Limited range maps luma to [16, 235] and chroma to [16, 240]
+	float y_scale = 1.0f, c_scale = 1.0f;
+	offset[0] = 0.0f;
+	if (!texture->yuv.full_range) {
+		y_scale = 255.0f / 219.0f;
+		c_scale = 255.0f / 224.0f;
+		offset[0] = 16.0f / 255.0f;
+	}
+	offset[1] = offset[2] = 128.0f / 255.0f;
+
+	const GLfloat m[9] = {
+		y_scale, y_scale, y_scale,
+		0.0f, -kg_u * c_scale, kb_u * c_scale,
+		kr_v * c_scale, -kg_v * c_scale, 0.0f,
+	};
+	memcpy(matrix, m, sizeof(m));
+}
+
+// Must be called before any GL state used by the batch changes
+void gles2_flush_batch(struct wlr_gles2_renderer *renderer) {
+	if (renderer->batch.texture == NULL) {
+		return;
+	}
+
+	struct wlr_gles2_tex_shader *shader = renderer->batch.shader;
+	GLenum target = renderer->batch.target;
+
+	// Vertices are already projected
+	static const GLfloat identity[9] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
+	};
+
+	PUSH_GLES2_DEBUG;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(target, renderer->batch.tex_id);
+
+	GLint filter = renderer->batch.nearest ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+
+	glUseProgram(shader->program);
+
+	glUniformMatrix3fv(shader->proj, 1, GL_FALSE, identity);
+	glUniform1i(shader->invert_y, 0);
+	glUniform1i(shader->tex, 0);
+	glUniform1f(shader->alpha, renderer->batch.alpha);
+
+	// The chroma planes go to the following texture units
+	struct wlr_gles2_texture *texture = renderer->batch.texture;
+	bool yuv = texture->type == WLR_GLES2_TEXTURE_DMABUF_YUV;
+	if (yuv) {
+		for (size_t i = 1; i < texture->yuv.n_planes; ++i) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(target, texture->yuv.texs[i]);
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+			glUniform1i(shader->tex_chroma[i - 1], i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+
+		GLfloat yuv_matrix[9], yuv_offset[3];
+		get_yuv_conversion(texture, yuv_matrix, yuv_offset);
+		glUniformMatrix3fv(shader->yuv_matrix, 1, GL_FALSE, yuv_matrix);
+		glUniform3fv(shader->yuv_offset, 1, yuv_offset);
+	}
+
+	// Blending is useless for opaque textures
+	bool opaque = shader == &renderer->shaders.tex_opaque ||
+		shader == &renderer->shaders.tex_ext_opaque ||
+		(yuv && renderer->batch.alpha == 1.0f);
+	if (opaque) {
+		glDisable(GL_BLEND);
+	}
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, renderer->batch.verts);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
+		renderer->batch.texcoords);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glDrawArrays(GL_TRIANGLES, 0, renderer->batch.len * 6);
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+
+	if (opaque) {
+		glEnable(GL_BLEND);
+	}
+
+	POP_GLES2_DEBUG;
+
+	wl_list_remove(&renderer->batch.texture_destroy.link);
+	renderer->batch.texture = NULL;
+	renderer->batch.len = 0;
+}
+
+static void gles2_batch_handle_texture_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_gles2_renderer *renderer =
+		wl_container_of(listener, renderer, batch.texture_destroy);
+	gles2_flush_batch(renderer);
+}
+
 static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		uint32_t height) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
+	gles2_flush_batch(renderer);
+
+	// Group the whole frame, each operation is nested in its own group
+	if (renderer->frame_marker) {
+		pop_gles2_marker();
+	}
+	push_gles2_marker(_wlr_strip_path(__FILE__), "frame");
+	renderer->frame_marker = true;
+
 	PUSH_GLES2_DEBUG;
 
-	glViewport(0, 0, width, height);
+	// Rendering into a texture is scaled to fit it
+	uint32_t fb_width = width, fb_height = height;
+	if (renderer->offscreen.texture != NULL) {
+		fb_width = renderer->offscreen.texture->width;
+		fb_height = renderer->offscreen.texture->height;
+	}
+	glViewport(0, 0, fb_width, fb_height);
 	renderer->viewport_width = width;
 	renderer->viewport_height = height;
+	renderer->framebuffer_width = fb_width;
+	renderer->framebuffer_height = fb_height;
+
+	// The scissor box depends on the viewport
+	glDisable(GL_SCISSOR_TEST);
+	renderer->scissor.enabled = false;
 
 	// enable transparency
 	glEnable(GL_BLEND);
@@ -51,13 +204,22 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 }
 
 static void gles2_end(struct wlr_renderer *wlr_renderer) {
-	gles2_get_renderer_in_context(wlr_renderer);
-	// no-op
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	gles2_flush_batch(renderer);
+
+	if (renderer->frame_marker) {
+		pop_gles2_marker();
+		renderer->frame_marker = false;
+	}
 }
 
 static void gles2_clear(struct wlr_renderer *wlr_renderer,
 		const float color[static 4]) {
-	gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	gles2_flush_batch(renderer);
 
 	PUSH_GLES2_DEBUG;
 	glClearColor(color[0], color[1], color[2], color[3]);
@@ -65,16 +227,55 @@ static void gles2_clear(struct wlr_renderer *wlr_renderer,
 	POP_GLES2_DEBUG;
 }
 
+static bool gles2_is_scaled(struct wlr_gles2_renderer *renderer) {
+	return renderer->framebuffer_width != renderer->viewport_width ||
+		renderer->framebuffer_height != renderer->viewport_height;
+}
+
+// Maps a box from viewport to framebuffer pixels, rounding outwards
+static void scale_scissor_box(struct wlr_gles2_renderer *renderer,
+		struct wlr_box *box) {
+	double sx = (double)renderer->framebuffer_width / renderer->viewport_width;
+	double sy =
+		(double)renderer->framebuffer_height / renderer->viewport_height;
+	int x1 = floor(box->x * sx);
+	int y1 = floor(box->y * sy);
+	int x2 = ceil((box->x + box->width) * sx);
+	int y2 = ceil((box->y + box->height) * sy);
+	box->x = x1;
+	box->y = y1;
+	box->width = x2 - x1;
+	box->height = y2 - y1;
+}
+
 static void gles2_scissor(struct wlr_renderer *wlr_renderer,
 		struct wlr_box *box) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
+	// Compositors usually scissor each damage rectangle, don't break the
+	// batch if it doesn't change
+	if (box != NULL ? (renderer->scissor.enabled &&
+			memcmp(box, &renderer->scissor.box, sizeof(*box)) == 0) :
+			!renderer->scissor.enabled) {
+		return;
+	}
+
+	gles2_flush_batch(renderer);
+
+	renderer->scissor.enabled = box != NULL;
+	if (box != NULL) {
+		renderer->scissor.box = *box;
+	}
+
 	PUSH_GLES2_DEBUG;
 	if (box != NULL) {
 		struct wlr_box gl_box;
 		wlr_box_transform(&gl_box, box, WL_OUTPUT_TRANSFORM_FLIPPED_180,
 			renderer->viewport_width, renderer->viewport_height);
+		if (gles2_is_scaled(renderer)) {
+			scale_scissor_box(renderer, &gl_box);
+		}
 
 		glScissor(gl_box.x, gl_box.y, gl_box.width, gl_box.height);
 		glEnable(GL_SCISSOR_TEST);
@@ -84,20 +285,929 @@ static void gles2_scissor(struct wlr_renderer *wlr_renderer,
 	POP_GLES2_DEBUG;
 }
 
-static void draw_quad(void) {
+static void draw_quad(void) {
+	GLfloat verts[] = {
+		1, 0, // top right
+		0, 0, // top left
+		1, 1, // bottom right
+		0, 1, // bottom left
+	};
+	GLfloat texcoord[] = {
+		1, 0, // top right
+		0, 0, // top left
+		1, 1, // bottom right
+		0, 1, // bottom left
+	};
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+}
+
+static bool is_integer(float f) {
+	return fabsf(f - roundf(f)) < 0.001f;
+}
+
+// Whether matrix draws box pixel for pixel at integer coordinates, in which
+// case the texture doesn't need filtering
+static bool matrix_is_pixel_aligned(struct wlr_gles2_renderer *renderer,
+		const struct wlr_fbox *box, const float matrix[static 9]) {
+	if (gles2_is_scaled(renderer)) {
+		return false;
+	}
+	float half_width = renderer->viewport_width / 2.0f;
+	float half_height = renderer->viewport_height / 2.0f;
+	// Where the edges of the unit square end up, in pixels
+	float ux = matrix[0] * half_width, uy = matrix[3] * half_height;
+	float vx = matrix[1] * half_width, vy = matrix[4] * half_height;
+	if (!((uy == 0 && vx == 0) || (ux == 0 && vy == 0))) {
+		return false;
+	}
+	float x = (matrix[2] + 1) * half_width;
+	float y = (matrix[5] + 1) * half_height;
+	return fabsf(fabsf(ux + uy) - box->width) < 0.001f &&
+		fabsf(fabsf(vx + vy) - box->height) < 0.001f &&
+		is_integer(x) && is_integer(y) &&
+		is_integer(box->x) && is_integer(box->y) &&
+		is_integer(box->width) && is_integer(box->height);
+}
+
+// Makes the batch draw texture with alpha, flushing it first if it draws
+// something else or is full
+static bool gles2_batch_prepare(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_texture *texture, float alpha, bool nearest) {
+	struct wlr_gles2_tex_shader *shader = NULL;
+	GLenum target = 0;
+	bool opaque = !texture->has_alpha && alpha == 1.0f;
+
+	switch (texture->type) {
+	case WLR_GLES2_TEXTURE_GLTEX:
+	case WLR_GLES2_TEXTURE_WL_DRM_GL:
+		if (opaque) {
+			shader = &renderer->shaders.tex_opaque;
+		} else if (texture->has_alpha) {
+			shader = &renderer->shaders.tex_rgba;
+		} else {
+			shader = &renderer->shaders.tex_rgbx;
+		}
+		target = GL_TEXTURE_2D;
+		break;
+	case WLR_GLES2_TEXTURE_WL_DRM_EXT:
+	case WLR_GLES2_TEXTURE_DMABUF:
+		shader = opaque ? &renderer->shaders.tex_ext_opaque :
+			&renderer->shaders.tex_ext;
+		target = GL_TEXTURE_EXTERNAL_OES;
+
+		if (!renderer->exts.egl_image_external_oes) {
+			wlr_log(WLR_ERROR, "Failed to render texture: "
+				"GL_TEXTURE_EXTERNAL_OES not supported");
+			return false;
+		}
+		break;
+	case WLR_GLES2_TEXTURE_DMABUF_YUV:
+		shader = texture->yuv.n_planes == 2 ?
+			&renderer->shaders.tex_nv12 : &renderer->shaders.tex_yuv420;
+		target = GL_TEXTURE_EXTERNAL_OES;
+
+		if (!renderer->exts.egl_image_external_oes) {
+			wlr_log(WLR_ERROR, "Failed to render texture: "
+				"GL_TEXTURE_EXTERNAL_OES not supported");
+			return false;
+		}
+		break;
+	}
+
+	GLuint tex_id;
+	switch (texture->type) {
+	case WLR_GLES2_TEXTURE_GLTEX:
+		tex_id = texture->gl_tex;
+		break;
+	case WLR_GLES2_TEXTURE_DMABUF_YUV:
+		tex_id = texture->yuv.texs[0];
+		break;
+	default:
+		tex_id = texture->image_tex;
+		break;
+	}
+	if (renderer->batch.texture != NULL &&
+			(renderer->batch.tex_id != tex_id ||
+			renderer->batch.shader != shader ||
+			renderer->batch.alpha != alpha ||
+			renderer->batch.nearest != nearest ||
+			renderer->batch.len == WLR_GLES2_BATCH_LEN)) {
+		gles2_flush_batch(renderer);
+	}
+
+	if (renderer->batch.texture == NULL) {
+		renderer->batch.texture = texture;
+		renderer->batch.tex_id = tex_id;
+		renderer->batch.shader = shader;
+		renderer->batch.target = target;
+		renderer->batch.alpha = alpha;
+		renderer->batch.nearest = nearest;
+		renderer->batch.texture_destroy.notify =
+			gles2_batch_handle_texture_destroy;
+		wl_signal_add(&texture->wlr_texture.events.destroy,
+			&renderer->batch.texture_destroy);
+	}
+
+	return true;
+}
+
+// Appends the part [u0, u1] x [v0, v1] of the unit square transformed by
+// matrix to the batch prepared by gles2_batch_prepare, textured with the
+// matching part of box
+static void gles2_batch_add(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], GLfloat u0, GLfloat v0,
+		GLfloat u1, GLfloat v1) {
+	// Two triangles: top left, top right, bottom left, then top right, bottom
+	// right, bottom left
+	static const GLfloat corners[] = {
+		0, 0, 1, 0, 0, 1,
+		1, 0, 1, 1, 0, 1,
+	};
+
+	// Atlas textures only cover a part of the GL texture, and inverted
+	// textures store the source box upside down
+	GLfloat tex_size_x = texture->width, tex_size_y = texture->height;
+	GLfloat box_x = box->x, box_y = box->y;
+	if (texture->atlas_page != NULL) {
+		tex_size_x = tex_size_y = WLR_GLES2_ATLAS_PAGE_SIZE;
+		box_x += texture->atlas_x;
+		box_y += texture->atlas_y;
+	} else if (texture->inverted_y) {
+		box_y = texture->height - box->y - box->height;
+	}
+	GLfloat tex_x = box_x / tex_size_x;
+	GLfloat tex_y = box_y / tex_size_y;
+	GLfloat tex_width = box->width / tex_size_x;
+	GLfloat tex_height = box->height / tex_size_y;
+
+	GLfloat *verts = &renderer->batch.verts[renderer->batch.len * 12];
+	GLfloat *texcoords = &renderer->batch.texcoords[renderer->batch.len * 12];
+	for (size_t i = 0; i < 6; ++i) {
+		GLfloat x = corners[2 * i] ? u1 : u0;
+		GLfloat y = corners[2 * i + 1] ? v1 : v0;
+		verts[2 * i] = matrix[0] * x + matrix[1] * y + matrix[2];
+		verts[2 * i + 1] = matrix[3] * x + matrix[4] * y + matrix[5];
+		if (texture->inverted_y) {
+			y = 1 - y;
+		}
+		texcoords[2 * i] = tex_x + x * tex_width;
+		texcoords[2 * i + 1] = tex_y + y * tex_height;
+	}
+	++renderer->batch.len;
+}
+
+static bool gles2_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_texture *texture =
+		gles2_get_texture(wlr_texture);
+
+	bool nearest = matrix_is_pixel_aligned(renderer, box, matrix);
+	if (!gles2_batch_prepare(renderer, texture, alpha, nearest)) {
+		return false;
+	}
+	gles2_batch_add(renderer, texture, box, matrix, 0, 0, 1, 1);
+	return true;
+}
+
+// Converts a box of the region passed to the *_region functions to clip
+// space, like gles2_scissor does for the scissor box
+static void region_box_to_clip(struct wlr_gles2_renderer *renderer,
+		const pixman_box32_t *rect, GLfloat *x1, GLfloat *y1,
+		GLfloat *x2, GLfloat *y2) {
+	GLfloat width = renderer->viewport_width;
+	GLfloat height = renderer->viewport_height;
+	*x1 = 2 * rect->x1 / width - 1;
+	*x2 = 2 * rect->x2 / width - 1;
+	*y1 = 1 - 2 * rect->y2 / height;
+	*y2 = 1 - 2 * rect->y1 / height;
+}
+
+static bool gles2_render_subtexture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha, pixman_region32_t *region) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_texture *texture =
+		gles2_get_texture(wlr_texture);
+
+	gles2_scissor(wlr_renderer, NULL);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+
+	// Clipped quads can only be computed if the unit square is transformed
+	// to an axis-aligned rectangle, scissor each box otherwise
+	bool axis_aligned = (matrix[1] == 0 && matrix[3] == 0) ||
+		(matrix[0] == 0 && matrix[4] == 0);
+	float det = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+	if (!axis_aligned || det == 0) {
+		bool ok = true;
+		for (int i = 0; i < nrects; ++i) {
+			struct wlr_box scissor = {
+				.x = rects[i].x1,
+				.y = rects[i].y1,
+				.width = rects[i].x2 - rects[i].x1,
+				.height = rects[i].y2 - rects[i].y1,
+			};
+			gles2_scissor(wlr_renderer, &scissor);
+			ok = gles2_render_subtexture_with_matrix(wlr_renderer,
+				wlr_texture, box, matrix, alpha) && ok;
+		}
+		gles2_scissor(wlr_renderer, NULL);
+		return ok;
+	}
+
+	bool nearest = matrix_is_pixel_aligned(renderer, box, matrix);
+
+	// Bounds of the transformed unit square
+	GLfloat qx1 = matrix[2], qx2 = matrix[0] + matrix[1] + matrix[2];
+	GLfloat qy1 = matrix[5], qy2 = matrix[3] + matrix[4] + matrix[5];
+	if (qx1 > qx2) {
+		GLfloat tmp = qx1;
+		qx1 = qx2;
+		qx2 = tmp;
+	}
+	if (qy1 > qy2) {
+		GLfloat tmp = qy1;
+		qy1 = qy2;
+		qy2 = tmp;
+	}
+
+	for (int i = 0; i < nrects; ++i) {
+		GLfloat x1, y1, x2, y2;
+		region_box_to_clip(renderer, &rects[i], &x1, &y1, &x2, &y2);
+		x1 = fmaxf(x1, qx1);
+		y1 = fmaxf(y1, qy1);
+		x2 = fminf(x2, qx2);
+		y2 = fminf(y2, qy2);
+		if (x1 >= x2 || y1 >= y2) {
+			continue;
+		}
+
+		// Map two opposite corners back to the unit square, the quad spans
+		// the rectangle between them
+		GLfloat corners[2][2] = { { x1, y1 }, { x2, y2 } };
+		GLfloat uv[2][2];
+		for (size_t j = 0; j < 2; ++j) {
+			GLfloat dx = corners[j][0] - matrix[2];
+			GLfloat dy = corners[j][1] - matrix[5];
+			uv[j][0] = (matrix[4] * dx - matrix[1] * dy) / det;
+			uv[j][1] = (matrix[0] * dy - matrix[3] * dx) / det;
+		}
+
+		if (!gles2_batch_prepare(renderer, texture, alpha, nearest)) {
+			return false;
+		}
+		gles2_batch_add(renderer, texture, box, matrix,
+			uv[0][0], uv[0][1], uv[1][0], uv[1][1]);
+	}
+
+	return true;
+}
+
+static void gles2_clear_region(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], pixman_region32_t *region) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	gles2_flush_batch(renderer);
+	gles2_scissor(wlr_renderer, NULL);
+
+	// Vertices are computed in clip space
+	static const GLfloat identity[9] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
+	};
+
+	PUSH_GLES2_DEBUG;
+	glUseProgram(renderer->shaders.quad.program);
+	glUniformMatrix3fv(renderer->shaders.quad.proj, 1, GL_FALSE, identity);
+	glUniform4f(renderer->shaders.quad.color,
+		color[0], color[1], color[2], color[3]);
+	// Like glClear, replace the contents instead of blending over them
+	glDisable(GL_BLEND);
+	glEnableVertexAttribArray(0);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	GLfloat verts[WLR_GLES2_BATCH_LEN * 12];
+	for (int i = 0; i < nrects; i += WLR_GLES2_BATCH_LEN) {
+		int len = nrects - i;
+		if (len > WLR_GLES2_BATCH_LEN) {
+			len = WLR_GLES2_BATCH_LEN;
+		}
+		for (int j = 0; j < len; ++j) {
+			GLfloat x1, y1, x2, y2;
+			region_box_to_clip(renderer, &rects[i + j], &x1, &y1, &x2, &y2);
+			GLfloat quad[] = {
+				x1, y1, x2, y1, x1, y2,
+				x2, y1, x2, y2, x1, y2,
+			};
+			memcpy(&verts[j * 12], quad, sizeof(quad));
+		}
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
+		glDrawArrays(GL_TRIANGLES, 0, len * 6);
+	}
+
+	glDisableVertexAttribArray(0);
+	glEnable(GL_BLEND);
+	POP_GLES2_DEBUG;
+}
+
+static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	gles2_flush_batch(renderer);
+
+	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
+	// to GL_FALSE
+	float transposition[9];
+	wlr_matrix_transpose(transposition, matrix);
+
+	PUSH_GLES2_DEBUG;
+	glUseProgram(renderer->shaders.quad.program);
+
+	glUniformMatrix3fv(renderer->shaders.quad.proj, 1, GL_FALSE, transposition);
+	glUniform4f(renderer->shaders.quad.color, color[0], color[1], color[2], color[3]);
+	draw_quad();
+	POP_GLES2_DEBUG;
+}
+
+static void gles2_render_ellipse_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	gles2_flush_batch(renderer);
+
+	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
+	// to GL_FALSE
+	float transposition[9];
+	wlr_matrix_transpose(transposition, matrix);
+
+	PUSH_GLES2_DEBUG;
+	glUseProgram(renderer->shaders.ellipse.program);
+
+	glUniformMatrix3fv(renderer->shaders.ellipse.proj, 1, GL_FALSE, transposition);
+	glUniform4f(renderer->shaders.ellipse.color, color[0], color[1], color[2], color[3]);
+	draw_quad();
+	POP_GLES2_DEBUG;
+}
+
+static const enum wl_shm_format *gles2_renderer_formats(
+		struct wlr_renderer *wlr_renderer, size_t *len) {
+	return get_gles2_wl_formats(len);
+}
+
+static bool gles2_format_supported(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt) {
+	return get_gles2_format_from_wl(wl_fmt) != NULL;
+}
+
+static bool gles2_resource_is_wl_drm_buffer(struct wlr_renderer *wlr_renderer,
+		struct wl_resource *resource) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+
+	if (!eglQueryWaylandBufferWL) {
+		return false;
+	}
+
+	EGLint fmt;
+	return eglQueryWaylandBufferWL(renderer->egl->display, resource,
+		EGL_TEXTURE_FORMAT, &fmt);
+}
+
+static void gles2_wl_drm_buffer_get_size(struct wlr_renderer *wlr_renderer,
+		struct wl_resource *buffer, int *width, int *height) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer(wlr_renderer);
+
+	if (!eglQueryWaylandBufferWL) {
+		return;
+	}
+
+	eglQueryWaylandBufferWL(renderer->egl->display, buffer, EGL_WIDTH, width);
+	eglQueryWaylandBufferWL(renderer->egl->display, buffer, EGL_HEIGHT, height);
+}
+
+static int gles2_get_dmabuf_formats(struct wlr_renderer *wlr_renderer,
+		int **formats) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	return wlr_egl_get_dmabuf_formats(renderer->egl, formats);
+}
+
+static int gles2_get_dmabuf_modifiers(struct wlr_renderer *wlr_renderer,
+		int format, uint64_t **modifiers) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	return wlr_egl_get_dmabuf_modifiers(renderer->egl, format, modifiers);
+}
+
+static bool gles2_get_drm_device(struct wlr_renderer *wlr_renderer,
+		dev_t *dev) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	return wlr_egl_get_drm_device(renderer->egl, dev);
+}
+
+static enum wl_shm_format gles2_preferred_read_format(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	GLint gl_format = -1, gl_type = -1;
+	PUSH_GLES2_DEBUG;
+	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &gl_format);
+	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &gl_type);
+	POP_GLES2_DEBUG;
+
+	EGLint alpha_size = -1;
+	eglGetConfigAttrib(renderer->egl->display, renderer->egl->config,
+		EGL_ALPHA_SIZE, &alpha_size);
+
+	const struct wlr_gles2_pixel_format *fmt =
+		get_gles2_format_from_gl(gl_format, gl_type, alpha_size > 0);
+	if (fmt != NULL) {
+		return fmt->wl_format;
+	}
+
+	if (renderer->exts.read_format_bgra_ext) {
+		return WL_SHM_FORMAT_XRGB8888;
+	}
+	return WL_SHM_FORMAT_XBGR8888;
+}
+
+static const struct wlr_gles2_pixel_format *get_read_format(
+		struct wlr_gles2_renderer *renderer, enum wl_shm_format wl_fmt) {
+	const struct wlr_gles2_pixel_format *fmt = get_gles2_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
+		return NULL;
+	}
+
+	if (fmt->gl_format == GL_BGRA_EXT && !renderer->exts.read_format_bgra_ext) {
+		fmt = get_gles2_swizzled_read_format(wl_fmt);
+		if (fmt == NULL) {
+			wlr_log(WLR_ERROR, "Cannot read pixels: missing "
+				"GL_EXT_read_format_bgra extension");
+			return NULL;
+		}
+	}
+
+	return fmt;
+}
+
+// Converts rows written by copy_read_rows in place, if needed
+static void convert_read_rows(const struct wlr_gles2_pixel_format *fmt,
+		unsigned char *dst, uint32_t stride, uint32_t width, uint32_t height) {
+	if (fmt->convert == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < height; ++i) {
+		fmt->convert(dst + i * stride, dst + i * stride, width);
+	}
+}
+
+// Copies height rows of pack_stride bytes, read bottom-up by glReadPixels,
+// to dst. If flip is set, the rows are put back in top-down order.
+static void copy_read_rows(unsigned char *dst, uint32_t stride,
+		const unsigned char *src, uint32_t pack_stride, uint32_t height,
+		bool flip) {
+	if (!flip && pack_stride == stride) {
+		memcpy(dst, src, (size_t)pack_stride * height);
+		return;
+	}
+	for (size_t i = 0; i < height; ++i) {
+		size_t row = flip ? height - i - 1 : i;
+		memcpy(dst + i * stride, src + row * pack_stride, pack_stride);
+	}
+}
+
+static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt, uint32_t *flags, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	const struct wlr_gles2_pixel_format *fmt = get_read_format(renderer, wl_fmt);
+	if (fmt == NULL) {
+		return false;
+	}
+
+	gles2_flush_batch(renderer);
+
+	PUSH_GLES2_DEBUG;
+
+	glGetError(); // Clear the error flag
+
+	// glReadPixels into client memory waits for pending drawing by itself
+	uint32_t bytes_per_pixel = fmt->bpp / 8;
+	unsigned char *p = (unsigned char *)data + dst_y * stride +
+		dst_x * bytes_per_pixel;
+	uint32_t pack_stride = width * bytes_per_pixel;
+	GLint y = renderer->viewport_height - height - src_y;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	bool ok = true;
+	if (flags != NULL && fmt->convert == NULL && (pack_stride == stride ||
+			(renderer->exts.pack_subimage &&
+			stride % bytes_per_pixel == 0))) {
+		// Rows are read bottom-up in a single call, the caller accepts
+		// y-inverted data
+		if (pack_stride != stride) {
+			glPixelStorei(GL_PACK_ROW_LENGTH_NV, stride / bytes_per_pixel);
+		}
+		glReadPixels(src_x, y, width, height, fmt->gl_format, fmt->gl_type, p);
+		if (pack_stride != stride) {
+			glPixelStorei(GL_PACK_ROW_LENGTH_NV, 0);
+		}
+		*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+	} else {
+		// Read into a tightly packed buffer and copy the rows over, instead
+		// of one glReadPixels call per row
+		unsigned char *staging = malloc(pack_stride * height);
+		if (staging == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			ok = false;
+		} else {
+			glReadPixels(src_x, y, width, height, fmt->gl_format,
+				fmt->gl_type, staging);
+			copy_read_rows(p, stride, staging, pack_stride, height,
+				flags == NULL);
+			convert_read_rows(fmt, p, stride, width, height);
+			free(staging);
+			if (flags != NULL) {
+				*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+			}
+		}
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	POP_GLES2_DEBUG;
+
+	return ok && glGetError() == GL_NO_ERROR;
+}
+
+static bool gles2_blit_dmabuf(struct wlr_renderer *wlr_renderer,
+		struct wlr_dmabuf_attributes *dst, uint32_t *flags, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+		uint32_t dst_y) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	if (!glEGLImageTargetTexture2DOES ||
+			!renderer->egl->exts.image_dmabuf_import_ext) {
+		return false;
+	}
+
+	EGLImageKHR image = wlr_egl_create_image_from_dmabuf(renderer->egl, dst);
+	if (image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to import DMA-BUF to blit into");
+		return false;
+	}
+
+	gles2_flush_batch(renderer);
+
+	PUSH_GLES2_DEBUG;
+
+	glGetError(); // Clear the error flag
+
+	// Copy straight from the framebuffer into the DMA-BUF through a texture
+	// bound to it. Rows are copied bottom-up, like a single glReadPixels call,
+	// so the destination is y-inverted too.
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst->height - height - dst_y,
+		src_x, renderer->viewport_height - height - src_y, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &tex);
+
+	// Implicit synchronization takes care of the consumer waiting for the
+	// copy, it only needs to be submitted
+	glFlush();
+
+	bool ok = glGetError() == GL_NO_ERROR;
+
+	POP_GLES2_DEBUG;
+
+	wlr_egl_destroy_image(renderer->egl, image);
+
+	if (ok && flags != NULL) {
+		*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+	}
+	return ok;
+}
+
+static bool gles2_copy_region(struct wlr_renderer *wlr_renderer,
+		const struct wlr_box *src, int dst_x, int dst_y) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	if (wlr_box_empty(src)) {
+		return true;
+	}
+	if (gles2_is_scaled(renderer)) {
+		return false;
+	}
+
+	gles2_flush_batch(renderer);
+
+	// GLES2 has no framebuffer blits: copy the source into a texture first,
+	// which also makes overlapping boxes work, then draw it at the
+	// destination. Everything below is in GL coordinates, y pointing up.
+	int vw = renderer->viewport_width, vh = renderer->viewport_height;
+	int src_y = vh - src->y - src->height;
+	int gl_dst_y = vh - dst_y - src->height;
+
+	GLfloat x1 = 2.0f * dst_x / vw - 1.0f;
+	GLfloat x2 = 2.0f * (dst_x + src->width) / vw - 1.0f;
+	GLfloat y1 = 2.0f * gl_dst_y / vh - 1.0f;
+	GLfloat y2 = 2.0f * (gl_dst_y + src->height) / vh - 1.0f;
+	GLfloat verts[] = {
+		x2, y1,
+		x1, y1,
+		x2, y2,
+		x1, y2,
+	};
+	GLfloat texcoord[] = {
+		1, 0,
+		0, 0,
+		1, 1,
+		0, 1,
+	};
+	static const GLfloat identity[9] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
+	};
+
+	struct wlr_gles2_tex_shader *shader = &renderer->shaders.tex_opaque;
+
+	PUSH_GLES2_DEBUG;
+
+	glGetError(); // Clear the error flag
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, src->x, src_y,
+		src->width, src->height, 0);
+
+	glUseProgram(shader->program);
+	glUniformMatrix3fv(shader->proj, 1, GL_FALSE, identity);
+	glUniform1i(shader->invert_y, 0);
+	glUniform1i(shader->tex, 0);
+
+	glDisable(GL_BLEND);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+
+	glEnable(GL_BLEND);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &tex);
+
+	bool ok = glGetError() == GL_NO_ERROR;
+
+	POP_GLES2_DEBUG;
+
+	return ok;
+}
+
+static void save_viewport(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_offscreen *offscreen) {
+	offscreen->saved_viewport_width = renderer->viewport_width;
+	offscreen->saved_viewport_height = renderer->viewport_height;
+	offscreen->saved_framebuffer_width = renderer->framebuffer_width;
+	offscreen->saved_framebuffer_height = renderer->framebuffer_height;
+}
+
+static void gles2_unbind_offscreen(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	if (renderer->offscreen.fbo == 0) {
+		return;
+	}
+
+	gles2_flush_batch(renderer);
+
+	// Textures are bound on top of another framebuffer, e.g. the output's
+	bool texture = renderer->offscreen.texture != NULL;
+	PUSH_GLES2_DEBUG;
+	glFlush();
+	glBindFramebuffer(GL_FRAMEBUFFER,
+		texture ? renderer->offscreen_below.fbo : 0);
+	glDeleteFramebuffers(1, &renderer->offscreen.fbo);
+	if (!texture) {
+		glDeleteTextures(1, &renderer->offscreen.tex);
+	}
+	// Rendering into the previous framebuffer, e.g. reading an output's
+	// pixels after a copy, must not need another gles2_begin
+	renderer->viewport_width = renderer->offscreen.saved_viewport_width;
+	renderer->viewport_height = renderer->offscreen.saved_viewport_height;
+	renderer->framebuffer_width = renderer->offscreen.saved_framebuffer_width;
+	renderer->framebuffer_height =
+		renderer->offscreen.saved_framebuffer_height;
+	glViewport(0, 0, renderer->framebuffer_width,
+		renderer->framebuffer_height);
+	POP_GLES2_DEBUG;
+
+	if (renderer->offscreen.image != NULL) {
+		wlr_egl_destroy_image(renderer->egl, renderer->offscreen.image);
+	}
+	if (texture) {
+		renderer->offscreen = renderer->offscreen_below;
+		memset(&renderer->offscreen_below, 0,
+			sizeof(renderer->offscreen_below));
+	} else {
+		memset(&renderer->offscreen, 0, sizeof(renderer->offscreen));
+	}
+}
+
+static void gles2_unbind_all_offscreen(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	while (renderer->offscreen.fbo != 0) {
+		gles2_unbind_offscreen(wlr_renderer);
+	}
+}
+
+static bool gles2_bind_offscreen(struct wlr_renderer *wlr_renderer,
+		struct wlr_dmabuf_attributes *dmabuf, uint32_t width,
+		uint32_t height) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+
+	// Offscreen rendering doesn't need any output to be current
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
+	gles2_unbind_all_offscreen(wlr_renderer);
+
+	EGLImageKHR image = NULL;
+	if (dmabuf != NULL) {
+		if (!glEGLImageTargetTexture2DOES ||
+				!renderer->egl->exts.image_dmabuf_import_ext) {
+			return false;
+		}
+		image = wlr_egl_create_image_from_dmabuf(renderer->egl, dmabuf);
+		if (image == NULL) {
+			wlr_log(WLR_ERROR, "Failed to import DMA-BUF to render into");
+			return false;
+		}
+	}
+
+	PUSH_GLES2_DEBUG;
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	if (image != NULL) {
+		glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image);
+	} else {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+			GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, tex, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	POP_GLES2_DEBUG;
+
+	renderer->offscreen.fbo = fbo;
+	renderer->offscreen.tex = tex;
+	renderer->offscreen.image = image;
+	save_viewport(renderer, &renderer->offscreen);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		wlr_log(WLR_ERROR, "Offscreen framebuffer incomplete (0x%x)", status);
+		gles2_unbind_offscreen(wlr_renderer);
+		return false;
+	}
+	return true;
+}
+
+static bool gles2_bind_offscreen_scaled(struct wlr_renderer *wlr_renderer,
+		const struct wlr_box *src, struct wlr_dmabuf_attributes *dmabuf,
+		uint32_t width, uint32_t height) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	if (wlr_box_empty(src) || width == 0 || height == 0) {
+		return false;
+	}
+	if (gles2_is_scaled(renderer)) {
+		return false;
+	}
+
+	gles2_flush_batch(renderer);
+
+	// Like copy_region, the source goes through a texture: GLES2 has no
+	// framebuffer blits. The texture is then sampled with linear filtering
+	// into the destination.
+	int src_y = renderer->viewport_height - src->y - src->height;
+
+	PUSH_GLES2_DEBUG;
+
+	glGetError(); // Clear the error flag
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, src->x, src_y,
+		src->width, src->height, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	bool ok = glGetError() == GL_NO_ERROR;
+
+	POP_GLES2_DEBUG;
+
+	if (!ok || !gles2_bind_offscreen(wlr_renderer, dmabuf, width, height)) {
+		PUSH_GLES2_DEBUG;
+		glDeleteTextures(1, &tex);
+		POP_GLES2_DEBUG;
+		return false;
+	}
+
+	// Rows keep their bottom-up order, like a direct read of the source
 	GLfloat verts[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
+		1, -1,
+		-1, -1,
+		1, 1,
+		-1, 1,
 	};
 	GLfloat texcoord[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
+		1, 0,
+		0, 0,
+		1, 1,
+		0, 1,
+	};
+	static const GLfloat identity[9] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
 	};
 
+	struct wlr_gles2_tex_shader *shader = &renderer->shaders.tex_opaque;
+
+	gles2_begin(wlr_renderer, width, height);
+
+	PUSH_GLES2_DEBUG;
+
+	glGetError(); // Clear the error flag
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	glUseProgram(shader->program);
+	glUniformMatrix3fv(shader->proj, 1, GL_FALSE, identity);
+	glUniform1i(shader->invert_y, 0);
+	glUniform1i(shader->tex, 0);
+
+	glDisable(GL_BLEND);
+
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
 
@@ -108,241 +1218,368 @@ static void draw_quad(void) {
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
-}
 
-static bool gles2_render_texture_with_matrix(struct wlr_renderer *wlr_renderer,
-		struct wlr_texture *wlr_texture, const float matrix[static 9],
-		float alpha) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
-	struct wlr_gles2_texture *texture =
-		gles2_get_texture(wlr_texture);
+	glEnable(GL_BLEND);
 
-	struct wlr_gles2_tex_shader *shader = NULL;
-	GLenum target = 0;
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &tex);
 
-	switch (texture->type) {
-	case WLR_GLES2_TEXTURE_GLTEX:
-	case WLR_GLES2_TEXTURE_WL_DRM_GL:
-		if (texture->has_alpha) {
-			shader = &renderer->shaders.tex_rgba;
-		} else {
-			shader = &renderer->shaders.tex_rgbx;
-		}
-		target = GL_TEXTURE_2D;
-		break;
-	case WLR_GLES2_TEXTURE_WL_DRM_EXT:
-	case WLR_GLES2_TEXTURE_DMABUF:
-		shader = &renderer->shaders.tex_ext;
-		target = GL_TEXTURE_EXTERNAL_OES;
+	ok = glGetError() == GL_NO_ERROR;
 
-		if (!renderer->exts.egl_image_external_oes) {
-			wlr_log(WLR_ERROR, "Failed to render texture: "
-				"GL_TEXTURE_EXTERNAL_OES not supported");
-			return false;
-		}
-		break;
+	POP_GLES2_DEBUG;
+
+	gles2_end(wlr_renderer);
+
+	if (!ok) {
+		gles2_unbind_offscreen(wlr_renderer);
+		return false;
 	}
+	return true;
+}
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
+static bool gles2_bind_texture(struct wlr_renderer *wlr_renderer,
+		struct wlr_texture *wlr_texture) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
+	// Atlas pages are shared with other textures
+	if (texture->type != WLR_GLES2_TEXTURE_GLTEX ||
+			texture->atlas_page != NULL) {
+		return false;
+	}
+
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
+	// Quads queued for the previous framebuffer must land there
+	gles2_flush_batch(renderer);
+	if (renderer->offscreen.texture != NULL) {
+		gles2_unbind_offscreen(wlr_renderer);
+	}
+	renderer->offscreen_below = renderer->offscreen;
+	memset(&renderer->offscreen, 0, sizeof(renderer->offscreen));
 
 	PUSH_GLES2_DEBUG;
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, texture->gl_tex, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	POP_GLES2_DEBUG;
 
-	GLuint tex_id = texture->type == WLR_GLES2_TEXTURE_GLTEX ?
-		texture->gl_tex : texture->image_tex;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(target, tex_id);
+	renderer->offscreen.fbo = fbo;
+	renderer->offscreen.tex = texture->gl_tex;
+	renderer->offscreen.texture = texture;
+	save_viewport(renderer, &renderer->offscreen);
 
-	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		wlr_log(WLR_ERROR, "Texture framebuffer incomplete (0x%x)", status);
+		gles2_unbind_offscreen(wlr_renderer);
+		return false;
+	}
 
-	glUseProgram(shader->program);
+	// Rows are rendered bottom-up
+	texture->inverted_y = true;
+	return true;
+}
 
-	glUniformMatrix3fv(shader->proj, 1, GL_FALSE, transposition);
-	glUniform1i(shader->invert_y, texture->inverted_y);
-	glUniform1i(shader->tex, 0);
-	glUniform1f(shader->alpha, alpha);
+static const struct wlr_renderer_readback_impl readback_impl;
 
-	draw_quad();
+static struct wlr_gles2_readback *gles2_get_readback(
+		struct wlr_renderer_readback *wlr_readback) {
+	assert(wlr_readback->impl == &readback_impl);
+	return (struct wlr_gles2_readback *)wlr_readback;
+}
 
-	POP_GLES2_DEBUG;
-	return true;
+static void gles2_readback_destroy(struct wlr_renderer_readback *wlr_readback) {
+	struct wlr_gles2_readback *readback = gles2_get_readback(wlr_readback);
+
+	if (readback->pbo != 0) {
+		if (!wlr_egl_is_current(readback->renderer->egl)) {
+			wlr_egl_make_current(readback->renderer->egl, EGL_NO_SURFACE, NULL);
+		}
+
+		PUSH_GLES2_DEBUG;
+		glDeleteBuffers(1, &readback->pbo);
+		POP_GLES2_DEBUG;
+	}
+
+	free(readback->data);
+	free(readback);
 }
 
+static bool gles2_readback_finish(struct wlr_renderer_readback *wlr_readback,
+		uint32_t *flags, uint32_t stride, uint32_t dst_x, uint32_t dst_y,
+		void *data) {
+	struct wlr_gles2_readback *readback = gles2_get_readback(wlr_readback);
+	struct wlr_gles2_renderer *renderer = readback->renderer;
+	uint32_t width = wlr_readback->width;
+	uint32_t height = wlr_readback->height;
+	uint32_t pack_stride = width * readback->fmt->bpp / 8;
+
+	const unsigned char *src = readback->data;
+	if (readback->pbo != 0) {
+		if (!wlr_egl_is_current(renderer->egl)) {
+			wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+		}
 
-static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
+		PUSH_GLES2_DEBUG;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, readback->pbo);
+		src = glMapBufferRangeEXT(GL_PIXEL_PACK_BUFFER_NV, 0,
+			pack_stride * height, GL_MAP_READ_BIT_EXT);
+		if (src == NULL) {
+			wlr_log(WLR_ERROR, "Failed to map pixel buffer object");
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, 0);
+			POP_GLES2_DEBUG;
+			return false;
+		}
+	}
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
+	unsigned char *p = (unsigned char *)data + dst_y * stride +
+		dst_x * readback->fmt->bpp / 8;
+	// Flip the rows unless the caller accepts y-inverted data
+	copy_read_rows(p, stride, src, pack_stride, height, flags == NULL);
+	convert_read_rows(readback->fmt, p, stride, width, height);
+	if (flags != NULL) {
+		*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+	}
 
-	PUSH_GLES2_DEBUG;
-	glUseProgram(renderer->shaders.quad.program);
+	if (readback->pbo != 0) {
+		glUnmapBufferOES(GL_PIXEL_PACK_BUFFER_NV);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, 0);
+		POP_GLES2_DEBUG;
+	}
 
-	glUniformMatrix3fv(renderer->shaders.quad.proj, 1, GL_FALSE, transposition);
-	glUniform4f(renderer->shaders.quad.color, color[0], color[1], color[2], color[3]);
-	draw_quad();
-	POP_GLES2_DEBUG;
+	return true;
 }
 
-static void gles2_render_ellipse_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
+static const struct wlr_renderer_readback_impl readback_impl = {
+	.finish = gles2_readback_finish,
+	.destroy = gles2_readback_destroy,
+};
+
+static struct wlr_renderer_readback *gles2_read_pixels_async(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
+	const struct wlr_gles2_pixel_format *fmt = get_read_format(renderer, wl_fmt);
+	if (fmt == NULL) {
+		return NULL;
+	}
+
+	struct wlr_gles2_readback *readback =
+		calloc(1, sizeof(struct wlr_gles2_readback));
+	if (readback == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_renderer_readback_init(&readback->wlr_readback, &readback_impl,
+		width, height);
+	readback->renderer = renderer;
+	readback->fmt = fmt;
+
+	size_t size = width * height * fmt->bpp / 8;
+	if (!renderer->exts.pixel_buffer_object) {
+		readback->data = malloc(size);
+		if (readback->data == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			free(readback);
+			return NULL;
+		}
+	}
+
+	gles2_flush_batch(renderer);
 
 	PUSH_GLES2_DEBUG;
-	glUseProgram(renderer->shaders.ellipse.program);
 
-	glUniformMatrix3fv(renderer->shaders.ellipse.proj, 1, GL_FALSE, transposition);
-	glUniform4f(renderer->shaders.ellipse.color, color[0], color[1], color[2], color[3]);
-	draw_quad();
+	glGetError(); // Clear the error flag
+
+	GLint y = renderer->viewport_height - height - src_y;
+	if (renderer->exts.pixel_buffer_object) {
+		// The transfer is queued, the buffer is only waited for when mapped.
+		// GLES2 has no GL_STREAM_READ, the usage is only a hint anyway.
+		glGenBuffers(1, &readback->pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, readback->pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER_NV, size, NULL, GL_STREAM_DRAW);
+		glReadPixels(src_x, y, width, height, fmt->gl_format, fmt->gl_type,
+			NULL);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, 0);
+	} else {
+		glFinish();
+		glReadPixels(src_x, y, width, height, fmt->gl_format, fmt->gl_type,
+			readback->data);
+	}
+
 	POP_GLES2_DEBUG;
+
+	if (glGetError() != GL_NO_ERROR) {
+		wlr_log(WLR_ERROR, "Failed to read pixels");
+		gles2_readback_destroy(&readback->wlr_readback);
+		return NULL;
+	}
+
+	return &readback->wlr_readback;
 }
 
-static const enum wl_shm_format *gles2_renderer_formats(
-		struct wlr_renderer *wlr_renderer, size_t *len) {
-	return get_gles2_wl_formats(len);
+static const struct wlr_render_timer_impl render_timer_impl;
+
+static struct wlr_gles2_render_timer *gles2_get_render_timer(
+		struct wlr_render_timer *wlr_timer) {
+	assert(wlr_timer->impl == &render_timer_impl);
+	return (struct wlr_gles2_render_timer *)wlr_timer;
 }
 
-static bool gles2_format_supported(struct wlr_renderer *wlr_renderer,
-		enum wl_shm_format wl_fmt) {
-	return get_gles2_format_from_wl(wl_fmt) != NULL;
+static void render_timer_stop(struct wlr_gles2_render_timer *timer) {
+	PUSH_GLES2_DEBUG;
+	glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+	POP_GLES2_DEBUG;
+
+	timer->running = false;
+	timer->ended = true;
+	timer->renderer->running_timer = NULL;
 }
 
-static bool gles2_resource_is_wl_drm_buffer(struct wlr_renderer *wlr_renderer,
-		struct wl_resource *resource) {
-	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+static void gles2_render_timer_begin(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer = gles2_get_render_timer(wlr_timer);
+	struct wlr_gles2_renderer *renderer = timer->renderer;
+	assert(wlr_egl_is_current(renderer->egl));
 
-	if (!eglQueryWaylandBufferWL) {
-		return false;
+	// Time elapsed queries can't be nested
+	struct wlr_gles2_render_timer *running = renderer->running_timer;
+	if (running != NULL) {
+		gles2_flush_batch(renderer);
+		render_timer_stop(running);
+		running->interrupted = running != timer;
 	}
 
-	EGLint fmt;
-	return eglQueryWaylandBufferWL(renderer->egl->display, resource,
-		EGL_TEXTURE_FORMAT, &fmt);
-}
+	PUSH_GLES2_DEBUG;
+	glBeginQueryEXT(GL_TIME_ELAPSED_EXT, timer->query);
+	POP_GLES2_DEBUG;
 
-static void gles2_wl_drm_buffer_get_size(struct wlr_renderer *wlr_renderer,
-		struct wl_resource *buffer, int *width, int *height) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer(wlr_renderer);
+	timer->running = true;
+	timer->ended = false;
+	timer->interrupted = false;
+	renderer->running_timer = timer;
+}
 
-	if (!eglQueryWaylandBufferWL) {
+static void gles2_render_timer_end(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer = gles2_get_render_timer(wlr_timer);
+	if (!timer->running) {
 		return;
 	}
+	assert(wlr_egl_is_current(timer->renderer->egl));
 
-	eglQueryWaylandBufferWL(renderer->egl->display, buffer, EGL_WIDTH, width);
-	eglQueryWaylandBufferWL(renderer->egl->display, buffer, EGL_HEIGHT, height);
+	// Pending quads belong to the measured commands
+	gles2_flush_batch(timer->renderer);
+	render_timer_stop(timer);
 }
 
-static int gles2_get_dmabuf_formats(struct wlr_renderer *wlr_renderer,
-		int **formats) {
-	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_egl_get_dmabuf_formats(renderer->egl, formats);
-}
+static bool gles2_render_timer_get_duration(struct wlr_render_timer *wlr_timer,
+		int64_t *duration) {
+	struct wlr_gles2_render_timer *timer = gles2_get_render_timer(wlr_timer);
+	struct wlr_gles2_renderer *renderer = timer->renderer;
 
-static int gles2_get_dmabuf_modifiers(struct wlr_renderer *wlr_renderer,
-		int format, uint64_t **modifiers) {
-	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_egl_get_dmabuf_modifiers(renderer->egl, format, modifiers);
-}
+	if (!timer->ended || timer->interrupted) {
+		*duration = -1;
+		return true;
+	}
 
-static enum wl_shm_format gles2_preferred_read_format(
-		struct wlr_renderer *wlr_renderer) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
 
-	GLint gl_format = -1, gl_type = -1;
 	PUSH_GLES2_DEBUG;
-	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &gl_format);
-	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &gl_type);
-	POP_GLES2_DEBUG;
-
-	EGLint alpha_size = -1;
-	eglGetConfigAttrib(renderer->egl->display, renderer->egl->config,
-		EGL_ALPHA_SIZE, &alpha_size);
 
-	const struct wlr_gles2_pixel_format *fmt =
-		get_gles2_format_from_gl(gl_format, gl_type, alpha_size > 0);
-	if (fmt != NULL) {
-		return fmt->wl_format;
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuivEXT(timer->query, GL_QUERY_RESULT_AVAILABLE_EXT,
+		&available);
+	if (!available) {
+		POP_GLES2_DEBUG;
+		return false;
 	}
 
-	if (renderer->exts.read_format_bgra_ext) {
-		return WL_SHM_FORMAT_XRGB8888;
-	}
-	return WL_SHM_FORMAT_XBGR8888;
+	// The result is meaningless if the GPU clock changed meanwhile
+	GLint disjoint = GL_FALSE;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64vEXT(timer->query, GL_QUERY_RESULT_EXT, &elapsed);
+
+	POP_GLES2_DEBUG;
+
+	*duration = disjoint ? -1 : (int64_t)elapsed;
+	return true;
 }
 
-static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
-		enum wl_shm_format wl_fmt, uint32_t *flags, uint32_t stride,
-		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
-		uint32_t dst_x, uint32_t dst_y, void *data) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
+static void gles2_render_timer_destroy(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer = gles2_get_render_timer(wlr_timer);
+	struct wlr_gles2_renderer *renderer = timer->renderer;
 
-	const struct wlr_gles2_pixel_format *fmt = get_gles2_format_from_wl(wl_fmt);
-	if (fmt == NULL) {
-		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
-		return false;
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
 	}
 
-	if (fmt->gl_format == GL_BGRA_EXT && !renderer->exts.read_format_bgra_ext) {
-		wlr_log(WLR_ERROR,
-			"Cannot read pixels: missing GL_EXT_read_format_bgra extension");
-		return false;
+	if (timer->running) {
+		render_timer_stop(timer);
 	}
 
 	PUSH_GLES2_DEBUG;
+	glDeleteQueriesEXT(1, &timer->query);
+	POP_GLES2_DEBUG;
 
-	// Make sure any pending drawing is finished before we try to read it
-	glFinish();
+	free(timer);
+}
 
-	glGetError(); // Clear the error flag
+static const struct wlr_render_timer_impl render_timer_impl = {
+	.begin = gles2_render_timer_begin,
+	.end = gles2_render_timer_end,
+	.get_duration = gles2_render_timer_get_duration,
+	.destroy = gles2_render_timer_destroy,
+};
 
-	unsigned char *p = (unsigned char *)data + dst_y * stride;
-	uint32_t pack_stride = width * fmt->bpp / 8;
-	if (pack_stride == stride && dst_x == 0 && flags != NULL) {
-		// Under these particular conditions, we can read the pixels with only
-		// one glReadPixels call
-		glReadPixels(src_x, renderer->viewport_height - height - src_y,
-			width, height, fmt->gl_format, fmt->gl_type, p);
-		*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
-	} else {
-		// Unfortunately GLES2 doesn't support GL_PACK_*, so we have to read
-		// the lines out row by row
-		for (size_t i = src_y; i < src_y + height; ++i) {
-			glReadPixels(src_x, src_y + height - i - 1, width, 1, fmt->gl_format,
-				fmt->gl_type, p + i * stride + dst_x * fmt->bpp / 8);
-		}
-		if (flags != NULL) {
-			*flags = 0;
-		}
+static struct wlr_render_timer *gles2_render_timer_create(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	if (!renderer->exts.disjoint_timer_query_ext) {
+		return NULL;
+	}
+
+	struct wlr_gles2_render_timer *timer =
+		calloc(1, sizeof(struct wlr_gles2_render_timer));
+	if (timer == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
 	}
+	wlr_render_timer_init(&timer->wlr_timer, &render_timer_impl);
+	timer->renderer = renderer;
 
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
+
+	PUSH_GLES2_DEBUG;
+	glGenQueriesEXT(1, &timer->query);
 	POP_GLES2_DEBUG;
 
-	return glGetError() == GL_NO_ERROR;
+	return &timer->wlr_timer;
 }
 
 static struct wlr_texture *gles2_texture_from_pixels(
 		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
 		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_gles2_texture_from_pixels(renderer->egl, wl_fmt, stride, width,
-		height, data);
+	struct wlr_texture *texture = gles2_atlas_texture_from_pixels(renderer,
+		wl_fmt, stride, width, height, data);
+	if (texture != NULL) {
+		return texture;
+	}
+	texture = wlr_gles2_texture_from_pixels(renderer->egl, wl_fmt, stride,
+		width, height, data);
+	if (texture != NULL) {
+		gles2_get_texture(texture)->renderer = renderer;
+	}
+	return texture;
 }
 
 static struct wlr_texture *gles2_texture_from_wl_drm(
@@ -365,19 +1602,33 @@ static void gles2_init_wl_display(struct wlr_renderer *wlr_renderer,
 	if (!wlr_egl_bind_display(renderer->egl, wl_display)) {
 		wlr_log(WLR_INFO, "failed to bind wl_display to EGL");
 	}
+	gles2_init_program_cache(renderer, wl_display);
 }
 
 static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
 
 	wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	gles2_unbind_all_offscreen(wlr_renderer);
+
+	// There is no render target anymore, drop the pending quads
+	if (renderer->batch.texture != NULL) {
+		wl_list_remove(&renderer->batch.texture_destroy.link);
+	}
+
+	gles2_atlas_finish(renderer);
 
 	PUSH_GLES2_DEBUG;
+	glDeleteBuffers(WLR_GLES2_UPLOAD_RING_LEN, renderer->upload_ring.pbos);
 	glDeleteProgram(renderer->shaders.quad.program);
 	glDeleteProgram(renderer->shaders.ellipse.program);
 	glDeleteProgram(renderer->shaders.tex_rgba.program);
 	glDeleteProgram(renderer->shaders.tex_rgbx.program);
 	glDeleteProgram(renderer->shaders.tex_ext.program);
+	glDeleteProgram(renderer->shaders.tex_opaque.program);
+	glDeleteProgram(renderer->shaders.tex_ext_opaque.program);
+	glDeleteProgram(renderer->shaders.tex_nv12.program);
+	glDeleteProgram(renderer->shaders.tex_yuv420.program);
 	POP_GLES2_DEBUG;
 
 	if (renderer->exts.debug_khr) {
@@ -385,6 +1636,8 @@ static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 		glDebugMessageCallbackKHR(NULL, NULL);
 	}
 
+	gles2_finish_program_cache(renderer);
+	free(renderer->program_cache_dir);
 	free(renderer);
 }
 
@@ -394,7 +1647,10 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.end = gles2_end,
 	.clear = gles2_clear,
 	.scissor = gles2_scissor,
-	.render_texture_with_matrix = gles2_render_texture_with_matrix,
+	.render_subtexture_with_matrix = gles2_render_subtexture_with_matrix,
+	.render_subtexture_with_matrix_region =
+		gles2_render_subtexture_with_matrix_region,
+	.clear_region = gles2_clear_region,
 	.render_quad_with_matrix = gles2_render_quad_with_matrix,
 	.render_ellipse_with_matrix = gles2_render_ellipse_with_matrix,
 	.formats = gles2_renderer_formats,
@@ -403,8 +1659,17 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.wl_drm_buffer_get_size = gles2_wl_drm_buffer_get_size,
 	.get_dmabuf_formats = gles2_get_dmabuf_formats,
 	.get_dmabuf_modifiers = gles2_get_dmabuf_modifiers,
+	.get_drm_device = gles2_get_drm_device,
 	.preferred_read_format = gles2_preferred_read_format,
 	.read_pixels = gles2_read_pixels,
+	.read_pixels_async = gles2_read_pixels_async,
+	.blit_dmabuf = gles2_blit_dmabuf,
+	.copy_region = gles2_copy_region,
+	.bind_offscreen = gles2_bind_offscreen,
+	.unbind_offscreen = gles2_unbind_offscreen,
+	.bind_offscreen_scaled = gles2_bind_offscreen_scaled,
+	.bind_texture = gles2_bind_texture,
+	.render_timer_create = gles2_render_timer_create,
 	.texture_from_pixels = gles2_texture_from_pixels,
 	.texture_from_wl_drm = gles2_texture_from_wl_drm,
 	.texture_from_dmabuf = gles2_texture_from_dmabuf,
@@ -466,7 +1731,13 @@ static GLuint compile_shader(GLuint type, const GLchar *src) {
 	return shader;
 }
 
-static GLuint link_program(const GLchar *vert_src, const GLchar *frag_src) {
+static GLuint link_program(struct wlr_gles2_renderer *renderer,
+		const GLchar *vert_src, const GLchar *frag_src) {
+	GLuint prog = gles2_load_program_binary(renderer, vert_src, frag_src);
+	if (prog != 0) {
+		return prog;
+	}
+
 	PUSH_GLES2_DEBUG;
 
 	GLuint vert = compile_shader(GL_VERTEX_SHADER, vert_src);
@@ -480,7 +1751,7 @@ static GLuint link_program(const GLchar *vert_src, const GLchar *frag_src) {
 		goto error;
 	}
 
-	GLuint prog = glCreateProgram();
+	prog = glCreateProgram();
 	glAttachShader(prog, vert);
 	glAttachShader(prog, frag);
 	glLinkProgram(prog);
@@ -497,6 +1768,8 @@ static GLuint link_program(const GLchar *vert_src, const GLchar *frag_src) {
 		goto error;
 	}
 
+	gles2_save_program_binary(renderer, prog, vert_src, frag_src);
+
 	POP_GLES2_DEBUG;
 	return prog;
 
@@ -530,6 +1803,28 @@ extern const GLchar tex_vertex_src[];
 extern const GLchar tex_fragment_src_rgba[];
 extern const GLchar tex_fragment_src_rgbx[];
 extern const GLchar tex_fragment_src_external[];
+extern const GLchar tex_fragment_src_opaque[];
+extern const GLchar tex_fragment_src_external_opaque[];
+extern const GLchar tex_fragment_src_nv12[];
+extern const GLchar tex_fragment_src_yuv420[];
+
+static bool link_yuv_shader(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_tex_shader *shader, const GLchar *frag_src) {
+	GLuint prog = shader->program =
+		link_program(renderer, tex_vertex_src, frag_src);
+	if (!prog) {
+		return false;
+	}
+	shader->proj = glGetUniformLocation(prog, "proj");
+	shader->invert_y = glGetUniformLocation(prog, "invert_y");
+	shader->tex = glGetUniformLocation(prog, "tex");
+	shader->alpha = glGetUniformLocation(prog, "alpha");
+	shader->tex_chroma[0] = glGetUniformLocation(prog, "tex_chroma0");
+	shader->tex_chroma[1] = glGetUniformLocation(prog, "tex_chroma1");
+	shader->yuv_matrix = glGetUniformLocation(prog, "yuv_matrix");
+	shader->yuv_offset = glGetUniformLocation(prog, "yuv_offset");
+	return true;
+}
 
 struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	if (!load_glapi()) {
@@ -542,6 +1837,8 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 		return NULL;
 	}
 	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
+	wl_list_init(&renderer->atlas_pages);
+	wl_list_init(&renderer->program_writes);
 
 	renderer->egl = egl;
 	if (!wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL)) {
@@ -569,6 +1866,35 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 		check_gl_ext(renderer->exts_str, "GL_OES_EGL_image_external") &&
 		glEGLImageTargetTexture2DOES;
 
+	GLint num_binary_formats = 0;
+	if (check_gl_ext(renderer->exts_str, "GL_OES_get_program_binary")) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_binary_formats);
+	}
+	renderer->exts.get_program_binary_oes = num_binary_formats > 0 &&
+		glGetProgramBinaryOES && glProgramBinaryOES;
+	if (renderer->exts.get_program_binary_oes) {
+		renderer->program_cache_dir = gles2_get_program_cache_dir();
+	}
+
+	// GLES 3.0 has PBOs in core, but we use the extension entry points to
+	// avoid depending on the GLES3 headers
+	const char *version_str = (const char *)glGetString(GL_VERSION);
+	bool has_pbo = strncmp(version_str, "OpenGL ES 3.", 12) == 0 ||
+		check_gl_ext(renderer->exts_str, "GL_NV_pixel_buffer_object");
+	renderer->exts.disjoint_timer_query_ext =
+		check_gl_ext(renderer->exts_str, "GL_EXT_disjoint_timer_query") &&
+		glGenQueriesEXT && glDeleteQueriesEXT && glBeginQueryEXT &&
+		glEndQueryEXT && glGetQueryObjectuivEXT && glGetQueryObjectui64vEXT;
+
+	// GL_PACK_ROW_LENGTH is core in GLES 3.0 and has the same value as the
+	// NV enum
+	renderer->exts.pack_subimage =
+		strncmp(version_str, "OpenGL ES 3.", 12) == 0 ||
+		check_gl_ext(renderer->exts_str, "GL_NV_pack_subimage");
+	renderer->exts.pixel_buffer_object = has_pbo &&
+		check_gl_ext(renderer->exts_str, "GL_EXT_map_buffer_range") &&
+		glMapBufferRangeEXT && glUnmapBufferOES;
+
 	if (renderer->exts.debug_khr) {
 		glEnable(GL_DEBUG_OUTPUT_KHR);
 		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
@@ -583,9 +1909,12 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 
 	PUSH_GLES2_DEBUG;
 
+	// Rows of 16 and 24 bpp formats aren't necessarily 4-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
 	GLuint prog;
 	renderer->shaders.quad.program = prog =
-		link_program(quad_vertex_src, quad_fragment_src);
+		link_program(renderer, quad_vertex_src, quad_fragment_src);
 	if (!renderer->shaders.quad.program) {
 		goto error;
 	}
@@ -593,7 +1922,7 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	renderer->shaders.quad.color = glGetUniformLocation(prog, "color");
 
 	renderer->shaders.ellipse.program = prog =
-		link_program(quad_vertex_src, ellipse_fragment_src);
+		link_program(renderer, quad_vertex_src, ellipse_fragment_src);
 	if (!renderer->shaders.ellipse.program) {
 		goto error;
 	}
@@ -601,7 +1930,7 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	renderer->shaders.ellipse.color = glGetUniformLocation(prog, "color");
 
 	renderer->shaders.tex_rgba.program = prog =
-		link_program(tex_vertex_src, tex_fragment_src_rgba);
+		link_program(renderer, tex_vertex_src, tex_fragment_src_rgba);
 	if (!renderer->shaders.tex_rgba.program) {
 		goto error;
 	}
@@ -611,7 +1940,7 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	renderer->shaders.tex_rgba.alpha = glGetUniformLocation(prog, "alpha");
 
 	renderer->shaders.tex_rgbx.program = prog =
-		link_program(tex_vertex_src, tex_fragment_src_rgbx);
+		link_program(renderer, tex_vertex_src, tex_fragment_src_rgbx);
 	if (!renderer->shaders.tex_rgbx.program) {
 		goto error;
 	}
@@ -620,9 +1949,19 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	renderer->shaders.tex_rgbx.tex = glGetUniformLocation(prog, "tex");
 	renderer->shaders.tex_rgbx.alpha = glGetUniformLocation(prog, "alpha");
 
+	renderer->shaders.tex_opaque.program = prog =
+		link_program(renderer, tex_vertex_src, tex_fragment_src_opaque);
+	if (!renderer->shaders.tex_opaque.program) {
+		goto error;
+	}
+	renderer->shaders.tex_opaque.proj = glGetUniformLocation(prog, "proj");
+	renderer->shaders.tex_opaque.invert_y = glGetUniformLocation(prog, "invert_y");
+	renderer->shaders.tex_opaque.tex = glGetUniformLocation(prog, "tex");
+	renderer->shaders.tex_opaque.alpha = -1;
+
 	if (renderer->exts.egl_image_external_oes) {
 		renderer->shaders.tex_ext.program = prog =
-			link_program(tex_vertex_src, tex_fragment_src_external);
+			link_program(renderer, tex_vertex_src, tex_fragment_src_external);
 		if (!renderer->shaders.tex_ext.program) {
 			goto error;
 		}
@@ -630,10 +1969,32 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 		renderer->shaders.tex_ext.invert_y = glGetUniformLocation(prog, "invert_y");
 		renderer->shaders.tex_ext.tex = glGetUniformLocation(prog, "tex");
 		renderer->shaders.tex_ext.alpha = glGetUniformLocation(prog, "alpha");
+
+		renderer->shaders.tex_ext_opaque.program = prog =
+			link_program(renderer, tex_vertex_src,
+				tex_fragment_src_external_opaque);
+		if (!renderer->shaders.tex_ext_opaque.program) {
+			goto error;
+		}
+		renderer->shaders.tex_ext_opaque.proj =
+			glGetUniformLocation(prog, "proj");
+		renderer->shaders.tex_ext_opaque.invert_y =
+			glGetUniformLocation(prog, "invert_y");
+		renderer->shaders.tex_ext_opaque.tex =
+			glGetUniformLocation(prog, "tex");
+		renderer->shaders.tex_ext_opaque.alpha = -1;
+
+		if (!link_yuv_shader(renderer, &renderer->shaders.tex_nv12,
+				tex_fragment_src_nv12) ||
+				!link_yuv_shader(renderer, &renderer->shaders.tex_yuv420,
+				tex_fragment_src_yuv420)) {
+			goto error;
+		}
 	}
 
 	POP_GLES2_DEBUG;
 
+	startup_mark("shaders compiled");
 	return &renderer->wlr_renderer;
 
 error:
@@ -642,6 +2003,10 @@ error:
 	glDeleteProgram(renderer->shaders.tex_rgba.program);
 	glDeleteProgram(renderer->shaders.tex_rgbx.program);
 	glDeleteProgram(renderer->shaders.tex_ext.program);
+	glDeleteProgram(renderer->shaders.tex_opaque.program);
+	glDeleteProgram(renderer->shaders.tex_ext_opaque.program);
+	glDeleteProgram(renderer->shaders.tex_nv12.program);
+	glDeleteProgram(renderer->shaders.tex_yuv420.program);
 
 	POP_GLES2_DEBUG;
 
@@ -650,6 +2015,8 @@ error:
 		glDebugMessageCallbackKHR(NULL, NULL);
 	}
 
+	gles2_finish_program_cache(renderer);
+	free(renderer->program_cache_dir);
 	free(renderer);
 	return NULL;
 }
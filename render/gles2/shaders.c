@@ -76,6 +76,16 @@ const GLchar tex_fragment_src_rgbx[] =
 "	gl_FragColor = vec4(texture2D(tex, v_texcoord).rgb, 1.0) * alpha;\n"
 "}\n";
 
+// Opaque textures drawn with an alpha of 1, blending is disabled
+const GLchar tex_fragment_src_opaque[] =
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform sampler2D tex;\n"
+"\n"
+"void main() {\n"
+"	gl_FragColor = vec4(texture2D(tex, v_texcoord).rgb, 1.0);\n"
+"}\n";
+
 const GLchar tex_fragment_src_external[] =
 "#extension GL_OES_EGL_image_external : require\n\n"
 "precision mediump float;\n"
@@ -86,3 +96,49 @@ const GLchar tex_fragment_src_external[] =
 "void main() {\n"
 "	gl_FragColor = texture2D(texture0, v_texcoord) * alpha;\n"
 "}\n";
+
+const GLchar tex_fragment_src_external_opaque[] =
+"#extension GL_OES_EGL_image_external : require\n\n"
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform samplerExternalOES texture0;\n"
+"\n"
+"void main() {\n"
+"	gl_FragColor = vec4(texture2D(texture0, v_texcoord).rgb, 1.0);\n"
+"}\n";
+
+// Semi-planar YUV: luma in the first texture, interleaved chroma in the second
+const GLchar tex_fragment_src_nv12[] =
+"#extension GL_OES_EGL_image_external : require\n\n"
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform samplerExternalOES tex;\n"
+"uniform samplerExternalOES tex_chroma0;\n"
+"uniform mat3 yuv_matrix;\n"
+"uniform vec3 yuv_offset;\n"
+"uniform float alpha;\n"
+"\n"
+"void main() {\n"
+"	vec3 yuv = vec3(texture2D(tex, v_texcoord).r,\n"
+"		texture2D(tex_chroma0, v_texcoord).rg);\n"
+"	gl_FragColor = vec4(yuv_matrix * (yuv - yuv_offset), 1.0) * alpha;\n"
+"}\n";
+
+// Planar YUV: one texture per plane, in Y, U, V order
+const GLchar tex_fragment_src_yuv420[] =
+"#extension GL_OES_EGL_image_external : require\n\n"
+"precision mediump float;\n"
+"varying vec2 v_texcoord;\n"
+"uniform samplerExternalOES tex;\n"
+"uniform samplerExternalOES tex_chroma0;\n"
+"uniform samplerExternalOES tex_chroma1;\n"
+"uniform mat3 yuv_matrix;\n"
+"uniform vec3 yuv_offset;\n"
+"uniform float alpha;\n"
+"\n"
+"void main() {\n"
+"	vec3 yuv = vec3(texture2D(tex, v_texcoord).r,\n"
+"		texture2D(tex_chroma0, v_texcoord).r,\n"
+"		texture2D(tex_chroma1, v_texcoord).r);\n"
+"	gl_FragColor = vec4(yuv_matrix * (yuv - yuv_offset), 1.0) * alpha;\n"
+"}\n";
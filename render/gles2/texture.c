@@ -32,6 +32,199 @@ struct wlr_gles2_texture *get_gles2_texture_in_context(
 	return texture;
 }
 
+static void upload_rect(const struct wlr_gles2_pixel_format *fmt,
+		uint32_t stride, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y, int dst_x, int dst_y,
+		const void *data) {
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (fmt->bpp / 8));
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, src_y);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
+		fmt->gl_format, fmt->gl_type, data);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+}
+
+// Copies the pixels into the next buffer of the upload ring, so that the
+// transfer to the bound texture happens asynchronously
+static bool upload_from_pbo(struct wlr_gles2_renderer *renderer,
+		const struct wlr_gles2_pixel_format *fmt, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, const void *data) {
+	size_t idx = renderer->upload_ring.idx;
+	renderer->upload_ring.idx = (idx + 1) % WLR_GLES2_UPLOAD_RING_LEN;
+
+	GLuint *pbo = &renderer->upload_ring.pbos[idx];
+	if (*pbo == 0) {
+		glGenBuffers(1, pbo);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, *pbo);
+
+	size_t row_size = width * fmt->bpp / 8;
+	size_t size = row_size * height;
+	if (renderer->upload_ring.sizes[idx] < size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER_NV, size, NULL, GL_STREAM_DRAW);
+		renderer->upload_ring.sizes[idx] = size;
+	}
+
+	// Invalidating lets the driver hand out fresh storage if the GPU is still
+	// reading from the previous contents
+	unsigned char *map = glMapBufferRangeEXT(GL_PIXEL_UNPACK_BUFFER_NV, 0,
+		size, GL_MAP_WRITE_BIT_EXT | GL_MAP_INVALIDATE_BUFFER_BIT_EXT);
+	if (map == NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+		return false;
+	}
+
+	const unsigned char *src = (const unsigned char *)data +
+		src_y * stride + src_x * fmt->bpp / 8;
+	for (size_t i = 0; i < height; ++i) {
+		memcpy(map + i * row_size, src + i * stride, row_size);
+	}
+
+	bool ok = glUnmapBufferOES(GL_PIXEL_UNPACK_BUFFER_NV);
+	if (ok) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
+			fmt->gl_format, fmt->gl_type, NULL);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+	return ok;
+}
+
+// Uploads pixels to an atlas texture. Edges are replicated into the border so
+// that linear filtering doesn't sample neighbouring textures. The page's GL
+// texture must be bound.
+static void atlas_write_pixels(struct wlr_gles2_texture *texture,
+		const struct wlr_gles2_pixel_format *fmt, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, const void *data) {
+	int x = texture->atlas_x + dst_x;
+	int y = texture->atlas_y + dst_y;
+
+	upload_rect(fmt, stride, width, height, src_x, src_y, x, y, data);
+	if (dst_x == 0) {
+		upload_rect(fmt, stride, 1, height, src_x, src_y, x - 1, y, data);
+	}
+	if (dst_x + width == (uint32_t)texture->width) {
+		upload_rect(fmt, stride, 1, height, src_x + width - 1, src_y,
+			x + width, y, data);
+	}
+	if (dst_y == 0) {
+		upload_rect(fmt, stride, width, 1, src_x, src_y, x, y - 1, data);
+	}
+	if (dst_y + height == (uint32_t)texture->height) {
+		upload_rect(fmt, stride, width, 1, src_x, src_y + height - 1,
+			x, y + height, data);
+	}
+}
+
+static struct wlr_gles2_atlas_page *atlas_page_create(
+		struct wlr_gles2_renderer *renderer,
+		const struct wlr_gles2_pixel_format *fmt) {
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (max_size < WLR_GLES2_ATLAS_PAGE_SIZE) {
+		return NULL;
+	}
+
+	struct wlr_gles2_atlas_page *page =
+		calloc(1, sizeof(struct wlr_gles2_atlas_page));
+	if (page == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	page->renderer = renderer;
+	page->fmt = fmt;
+	wl_list_init(&page->shelves);
+
+	PUSH_GLES2_DEBUG;
+	glGenTextures(1, &page->gl_tex);
+	glBindTexture(GL_TEXTURE_2D, page->gl_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, fmt->gl_format, WLR_GLES2_ATLAS_PAGE_SIZE,
+		WLR_GLES2_ATLAS_PAGE_SIZE, 0, fmt->gl_format, fmt->gl_type, NULL);
+	POP_GLES2_DEBUG;
+
+	wl_list_insert(&renderer->atlas_pages, &page->link);
+	return page;
+}
+
+static void atlas_page_destroy(struct wlr_gles2_atlas_page *page) {
+	struct wlr_gles2_atlas_shelf *shelf, *tmp;
+	wl_list_for_each_safe(shelf, tmp, &page->shelves, link) {
+		wl_list_remove(&shelf->link);
+		free(shelf);
+	}
+	wl_list_remove(&page->link);
+
+	PUSH_GLES2_DEBUG;
+	glDeleteTextures(1, &page->gl_tex);
+	POP_GLES2_DEBUG;
+
+	free(page);
+}
+
+// Finds room for a texture in a page using shelf packing. Returns the shelf
+// the texture has been placed on, or NULL if the page is full.
+static struct wlr_gles2_atlas_shelf *atlas_page_alloc(
+		struct wlr_gles2_atlas_page *page, int width, int height,
+		int *x, int *y) {
+	// Account for the border
+	width += 2;
+	height += 2;
+
+	struct wlr_gles2_atlas_shelf *shelf, *best = NULL;
+	wl_list_for_each(shelf, &page->shelves, link) {
+		if (shelf->height < height ||
+				shelf->next_x + width > WLR_GLES2_ATLAS_PAGE_SIZE) {
+			continue;
+		}
+		if (best == NULL || shelf->height < best->height) {
+			best = shelf;
+		}
+	}
+
+	// Start a new shelf if the best one would waste too much space
+	bool has_room = page->next_y + height <= WLR_GLES2_ATLAS_PAGE_SIZE;
+	if (has_room && (best == NULL || best->height > height * 3 / 2)) {
+		best = calloc(1, sizeof(struct wlr_gles2_atlas_shelf));
+		if (best == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return NULL;
+		}
+		best->y = page->next_y;
+		best->height = height;
+		page->next_y += height;
+		wl_list_insert(page->shelves.prev, &best->link);
+	}
+	if (best == NULL) {
+		return NULL;
+	}
+
+	*x = best->next_x + 1;
+	*y = best->y + 1;
+	best->next_x += width;
+	++best->entries;
+	++page->entries;
+	return best;
+}
+
+static void atlas_texture_release(struct wlr_gles2_texture *texture) {
+	struct wlr_gles2_atlas_page *page = texture->atlas_page;
+	struct wlr_gles2_atlas_shelf *shelf = texture->atlas_shelf;
+
+	// Shelves are only reused once they are completely free
+	if (--shelf->entries == 0) {
+		shelf->next_x = 0;
+	}
+	if (--page->entries == 0) {
+		atlas_page_destroy(page);
+	}
+}
+
 static void gles2_texture_get_size(struct wlr_texture *wlr_texture, int *width,
 		int *height) {
 	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
@@ -60,23 +253,46 @@ static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 		get_gles2_format_from_wl(texture->wl_format);
 	assert(fmt);
 
+	void *converted = NULL;
+	if (fmt->convert != NULL) {
+		converted = gles2_convert_pixels(fmt, stride, width, height,
+			src_x, src_y, data);
+		if (converted == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		data = converted;
+		stride = width * fmt->bpp / 8;
+		src_x = src_y = 0;
+	}
+
 	// TODO: what if the unpack subimage extension isn't supported?
 	PUSH_GLES2_DEBUG;
 
 	glBindTexture(GL_TEXTURE_2D, texture->gl_tex);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (fmt->bpp / 8));
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, src_y);
+	if (texture->atlas_page != NULL) {
+		atlas_write_pixels(texture, fmt, stride, width, height,
+			src_x, src_y, dst_x, dst_y, data);
+		POP_GLES2_DEBUG;
+		free(converted);
+		return true;
+	}
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
-		fmt->gl_format, fmt->gl_type, data);
+	struct wlr_gles2_renderer *renderer = texture->renderer;
+	if (renderer != NULL && renderer->exts.pixel_buffer_object &&
+			width * height * fmt->bpp / 8 >= WLR_GLES2_UPLOAD_MIN_SIZE &&
+			upload_from_pbo(renderer, fmt, stride, width, height,
+				src_x, src_y, dst_x, dst_y, data)) {
+		POP_GLES2_DEBUG;
+		free(converted);
+		return true;
+	}
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+	upload_rect(fmt, stride, width, height, src_x, src_y, dst_x, dst_y, data);
 
 	POP_GLES2_DEBUG;
+	free(converted);
 	return true;
 }
 
@@ -84,6 +300,16 @@ static bool gles2_texture_to_dmabuf(struct wlr_texture *wlr_texture,
 		struct wlr_dmabuf_attributes *attribs) {
 	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
 
+	// The atlas page is shared with other textures
+	if (texture->atlas_page != NULL) {
+		return false;
+	}
+
+	// There is no single image to export
+	if (texture->type == WLR_GLES2_TEXTURE_DMABUF_YUV) {
+		return false;
+	}
+
 	if (!texture->image) {
 		assert(texture->type == WLR_GLES2_TEXTURE_GLTEX);
 
@@ -115,6 +341,14 @@ static void gles2_texture_destroy(struct wlr_texture *wlr_texture) {
 
 	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
 
+	// Pending quads may still sample this texture's area of the atlas page.
+	// This must happen before the render surface is unbound.
+	struct wlr_gles2_atlas_page *page = texture->atlas_page;
+	if (page != NULL && page->renderer != NULL &&
+			page->renderer->batch.tex_id == page->gl_tex) {
+		gles2_flush_batch(page->renderer);
+	}
+
 	wlr_egl_make_current(texture->egl, EGL_NO_SURFACE, NULL);
 
 	PUSH_GLES2_DEBUG;
@@ -124,7 +358,16 @@ static void gles2_texture_destroy(struct wlr_texture *wlr_texture) {
 	}
 	wlr_egl_destroy_image(texture->egl, texture->image);
 
-	if (texture->type == WLR_GLES2_TEXTURE_GLTEX) {
+	if (texture->type == WLR_GLES2_TEXTURE_DMABUF_YUV) {
+		glDeleteTextures(texture->yuv.n_planes, texture->yuv.texs);
+		for (size_t i = 0; i < texture->yuv.n_planes; ++i) {
+			wlr_egl_destroy_image(texture->egl, texture->yuv.images[i]);
+		}
+	}
+
+	if (texture->atlas_page != NULL) {
+		atlas_texture_release(texture);
+	} else if (texture->type == WLR_GLES2_TEXTURE_GLTEX) {
 		glDeleteTextures(1, &texture->gl_tex);
 	}
 
@@ -154,10 +397,23 @@ struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 		return NULL;
 	}
 
+	void *converted = NULL;
+	if (fmt->convert != NULL) {
+		converted = gles2_convert_pixels(fmt, stride, width, height, 0, 0,
+			data);
+		if (converted == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return NULL;
+		}
+		data = converted;
+		stride = width * fmt->bpp / 8;
+	}
+
 	struct wlr_gles2_texture *texture =
 		calloc(1, sizeof(struct wlr_gles2_texture));
 	if (texture == NULL) {
 		wlr_log(WLR_ERROR, "Allocation failed");
+		free(converted);
 		return NULL;
 	}
 	wlr_texture_init(&texture->wlr_texture, &texture_impl);
@@ -179,9 +435,94 @@ struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 
 	POP_GLES2_DEBUG;
+	free(converted);
+	return &texture->wlr_texture;
+}
+
+struct wlr_texture *gles2_atlas_texture_from_pixels(
+		struct wlr_gles2_renderer *renderer, enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	if (width > WLR_GLES2_ATLAS_MAX_TEXTURE_SIZE ||
+			height > WLR_GLES2_ATLAS_MAX_TEXTURE_SIZE) {
+		return NULL;
+	}
+
+	// Pages are 32 bpp and can't take converted uploads
+	const struct wlr_gles2_pixel_format *fmt = get_gles2_format_from_wl(wl_fmt);
+	if (fmt == NULL || fmt->bpp != 32 || fmt->convert != NULL) {
+		return NULL;
+	}
+
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
+
+	struct wlr_gles2_texture *texture =
+		calloc(1, sizeof(struct wlr_gles2_texture));
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	struct wlr_gles2_atlas_page *page;
+	struct wlr_gles2_atlas_shelf *shelf = NULL;
+	wl_list_for_each(page, &renderer->atlas_pages, link) {
+		if (page->fmt != fmt) {
+			continue;
+		}
+		shelf = atlas_page_alloc(page, width, height,
+			&texture->atlas_x, &texture->atlas_y);
+		if (shelf != NULL) {
+			break;
+		}
+	}
+	if (shelf == NULL) {
+		page = atlas_page_create(renderer, fmt);
+		if (page == NULL) {
+			free(texture);
+			return NULL;
+		}
+		shelf = atlas_page_alloc(page, width, height,
+			&texture->atlas_x, &texture->atlas_y);
+		if (shelf == NULL) {
+			atlas_page_destroy(page);
+			free(texture);
+			return NULL;
+		}
+	}
+
+	wlr_texture_init(&texture->wlr_texture, &texture_impl);
+	texture->egl = renderer->egl;
+	texture->width = width;
+	texture->height = height;
+	texture->type = WLR_GLES2_TEXTURE_GLTEX;
+	texture->has_alpha = fmt->has_alpha;
+	texture->wl_format = fmt->wl_format;
+	texture->gl_tex = page->gl_tex;
+	texture->atlas_page = page;
+	texture->atlas_shelf = shelf;
+
+	PUSH_GLES2_DEBUG;
+	if (data != NULL) {
+		glBindTexture(GL_TEXTURE_2D, page->gl_tex);
+		atlas_write_pixels(texture, fmt, stride, width, height,
+			0, 0, 0, 0, data);
+	}
+	POP_GLES2_DEBUG;
+
 	return &texture->wlr_texture;
 }
 
+void gles2_atlas_finish(struct wlr_gles2_renderer *renderer) {
+	// Pages are destroyed along with their last texture
+	struct wlr_gles2_atlas_page *page, *tmp;
+	wl_list_for_each_safe(page, tmp, &renderer->atlas_pages, link) {
+		page->renderer = NULL;
+		wl_list_remove(&page->link);
+		wl_list_init(&page->link);
+	}
+}
+
 struct wlr_texture *wlr_gles2_texture_from_wl_drm(struct wlr_egl *egl,
 		struct wl_resource *data) {
 	if (!wlr_egl_is_current(egl)) {
@@ -240,6 +581,129 @@ struct wlr_texture *wlr_gles2_texture_from_wl_drm(struct wlr_egl *egl,
 	return &texture->wlr_texture;
 }
 
+// Formats without an alpha channel can be drawn without blending
+static bool dmabuf_format_has_alpha(uint32_t format) {
+	switch (format & ~DRM_FORMAT_BIG_ENDIAN) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_XBGR8888:
+	case DRM_FORMAT_RGBX8888:
+	case DRM_FORMAT_BGRX8888:
+	case DRM_FORMAT_XRGB2101010:
+	case DRM_FORMAT_XBGR2101010:
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_BGR565:
+	case DRM_FORMAT_RGB888:
+	case DRM_FORMAT_BGR888:
+		return false;
+	default:
+		return true;
+	}
+}
+
+// Imports each plane of 4:2:0 YUV formats as a separate texture, sampled
+// with a shader doing the YUV to RGB conversion instead of the EGL driver.
+// Returns NULL if the format isn't handled or the planes can't be imported.
+static struct wlr_texture *texture_from_yuv_dmabuf(struct wlr_egl *egl,
+		struct wlr_dmabuf_attributes *attribs) {
+	// Planes in Y, U, V order and their format
+	int plane_idx[WLR_GLES2_YUV_MAX_PLANES] = { 0, 1, 2 };
+	uint32_t chroma_format;
+	size_t n_planes;
+	switch (attribs->format) {
+	case DRM_FORMAT_NV12:
+		n_planes = 2;
+		chroma_format = DRM_FORMAT_GR88;
+		break;
+	case DRM_FORMAT_YUV420:
+		n_planes = 3;
+		chroma_format = DRM_FORMAT_R8;
+		break;
+	case DRM_FORMAT_YVU420:
+		n_planes = 3;
+		chroma_format = DRM_FORMAT_R8;
+		plane_idx[1] = 2;
+		plane_idx[2] = 1;
+		break;
+	default:
+		return NULL;
+	}
+	if (attribs->n_planes != (int)n_planes) {
+		return NULL;
+	}
+
+	struct wlr_gles2_texture *texture =
+		calloc(1, sizeof(struct wlr_gles2_texture));
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_texture_init(&texture->wlr_texture, &texture_impl);
+	texture->egl = egl;
+	texture->width = attribs->width;
+	texture->height = attribs->height;
+	texture->type = WLR_GLES2_TEXTURE_DMABUF_YUV;
+	texture->has_alpha = false;
+	texture->wl_format = 0xFFFFFFFF; // texture can't be written anyways
+	texture->inverted_y =
+		(attribs->flags & WLR_DMABUF_ATTRIBUTES_FLAGS_Y_INVERT) != 0;
+	texture->yuv.n_planes = n_planes;
+	texture->yuv.encoding = attribs->width >= 1280 ?
+		WLR_GLES2_YUV_ENCODING_BT709 : WLR_GLES2_YUV_ENCODING_BT601;
+	texture->yuv.full_range = false;
+
+	for (size_t i = 0; i < n_planes; ++i) {
+		int idx = plane_idx[i];
+		// Chroma is subsampled horizontally and vertically
+		struct wlr_dmabuf_attributes plane_attribs = {
+			.width = i == 0 ? attribs->width : (attribs->width + 1) / 2,
+			.height = i == 0 ? attribs->height : (attribs->height + 1) / 2,
+			.format = i == 0 ? DRM_FORMAT_R8 : chroma_format,
+			.modifier = attribs->modifier,
+			.n_planes = 1,
+			.offset = { attribs->offset[idx] },
+			.stride = { attribs->stride[idx] },
+			.fd = { attribs->fd[idx] },
+		};
+		texture->yuv.images[i] =
+			wlr_egl_create_image_from_dmabuf(egl, &plane_attribs);
+		if (texture->yuv.images[i] == NULL) {
+			wlr_log(WLR_DEBUG, "Failed to import plane %d of YUV DMA-BUF, "
+				"falling back to single image import", idx);
+			for (size_t j = 0; j < i; ++j) {
+				wlr_egl_destroy_image(egl, texture->yuv.images[j]);
+			}
+			free(texture);
+			return NULL;
+		}
+	}
+
+	PUSH_GLES2_DEBUG;
+
+	glGenTextures(n_planes, texture->yuv.texs);
+	for (size_t i = 0; i < n_planes; ++i) {
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture->yuv.texs[i]);
+		glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+			texture->yuv.images[i]);
+	}
+
+	POP_GLES2_DEBUG;
+	return &texture->wlr_texture;
+}
+
+bool wlr_gles2_texture_set_yuv_encoding(struct wlr_texture *wlr_texture,
+		enum wlr_gles2_yuv_encoding encoding, bool full_range) {
+	if (wlr_texture->impl != &texture_impl) {
+		return false;
+	}
+	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
+	if (texture->type != WLR_GLES2_TEXTURE_DMABUF_YUV) {
+		return false;
+	}
+	texture->yuv.encoding = encoding;
+	texture->yuv.full_range = full_range;
+	return true;
+}
+
 struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 		struct wlr_dmabuf_attributes *attribs) {
 	if (!wlr_egl_is_current(egl)) {
@@ -256,6 +720,11 @@ struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 		return NULL;
 	}
 
+	struct wlr_texture *yuv_texture = texture_from_yuv_dmabuf(egl, attribs);
+	if (yuv_texture != NULL) {
+		return yuv_texture;
+	}
+
 	switch (attribs->format & ~DRM_FORMAT_BIG_ENDIAN) {
 	case WL_SHM_FORMAT_YUYV:
 	case WL_SHM_FORMAT_YVYU:
@@ -279,7 +748,7 @@ struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 	texture->width = attribs->width;
 	texture->height = attribs->height;
 	texture->type = WLR_GLES2_TEXTURE_DMABUF;
-	texture->has_alpha = true;
+	texture->has_alpha = dmabuf_format_has_alpha(attribs->format);
 	texture->wl_format = 0xFFFFFFFF; // texture can't be written anyways
 	texture->inverted_y =
 		(attribs->flags & WLR_DMABUF_ATTRIBUTES_FLAGS_Y_INVERT) != 0;
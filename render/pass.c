@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/log.h>
+
+struct wlr_render_pass *wlr_render_pass_create(int width, int height) {
+	struct wlr_render_pass *pass = calloc(1, sizeof(struct wlr_render_pass));
+	if (pass == NULL) {
+		return NULL;
+	}
+	pass->width = width;
+	pass->height = height;
+	return pass;
+}
+
+void wlr_render_pass_reset(struct wlr_render_pass *pass, int width,
+		int height) {
+	for (size_t i = 0; i < pass->ops_len; ++i) {
+		pixman_region32_fini(&pass->ops[i].clip);
+		pixman_region32_fini(&pass->ops[i].opaque);
+	}
+	pass->ops_len = 0;
+	pass->width = width;
+	pass->height = height;
+}
+
+void wlr_render_pass_destroy(struct wlr_render_pass *pass) {
+	if (pass == NULL) {
+		return;
+	}
+	wlr_render_pass_reset(pass, 0, 0);
+	free(pass->ops);
+	free(pass);
+}
+
+static struct wlr_render_op *pass_add_op(struct wlr_render_pass *pass,
+		enum wlr_render_op_type type, pixman_region32_t *clip) {
+	if (pass->ops_len == pass->ops_cap) {
+		size_t cap = pass->ops_cap == 0 ? 32 : pass->ops_cap * 2;
+		struct wlr_render_op *ops =
+			realloc(pass->ops, cap * sizeof(struct wlr_render_op));
+		if (ops == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return NULL;
+		}
+		pass->ops = ops;
+		pass->ops_cap = cap;
+	}
+
+	struct wlr_render_op *op = &pass->ops[pass->ops_len++];
+	memset(op, 0, sizeof(*op));
+	op->type = type;
+	pixman_region32_init_rect(&op->clip, 0, 0, pass->width, pass->height);
+	if (clip != NULL) {
+		pixman_region32_intersect(&op->clip, &op->clip, clip);
+	}
+	pixman_region32_init(&op->opaque);
+	return op;
+}
+
+bool wlr_render_pass_add_clear(struct wlr_render_pass *pass,
+		const float color[static 4], pixman_region32_t *clip) {
+	struct wlr_render_op *op = pass_add_op(pass, WLR_RENDER_OP_CLEAR, clip);
+	if (op == NULL) {
+		return false;
+	}
+	memcpy(op->color, color, sizeof(op->color));
+	// Clearing replaces the pixels whatever the alpha
+	pixman_region32_copy(&op->opaque, &op->clip);
+	return true;
+}
+
+bool wlr_render_pass_add_texture(struct wlr_render_pass *pass,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha, pixman_region32_t *clip,
+		pixman_region32_t *opaque) {
+	struct wlr_render_op *op = pass_add_op(pass, WLR_RENDER_OP_TEXTURE, clip);
+	if (op == NULL) {
+		return false;
+	}
+	op->texture = texture;
+	if (box != NULL) {
+		op->box = *box;
+	} else {
+		int width, height;
+		wlr_texture_get_size(texture, &width, &height);
+		op->box = (struct wlr_fbox){ .width = width, .height = height };
+	}
+	memcpy(op->matrix, matrix, sizeof(op->matrix));
+	op->alpha = alpha;
+	if (opaque != NULL && alpha >= 1.0) {
+		pixman_region32_intersect(&op->opaque, opaque, &op->clip);
+	}
+	return true;
+}
+
+bool wlr_render_pass_add_quad(struct wlr_render_pass *pass,
+		const float color[static 4], const float matrix[static 9],
+		pixman_region32_t *clip, pixman_region32_t *opaque) {
+	struct wlr_render_op *op = pass_add_op(pass, WLR_RENDER_OP_QUAD, clip);
+	if (op == NULL) {
+		return false;
+	}
+	memcpy(op->color, color, sizeof(op->color));
+	memcpy(op->matrix, matrix, sizeof(op->matrix));
+	if (opaque != NULL && color[3] >= 1.0) {
+		pixman_region32_intersect(&op->opaque, opaque, &op->clip);
+	}
+	return true;
+}
+
+struct pass_draw {
+	const struct wlr_render_op *op;
+	pixman_region32_t visible;
+};
+
+static bool ops_can_batch(const struct wlr_render_op *a,
+		const struct wlr_render_op *b) {
+	if (a->type != b->type) {
+		return false;
+	}
+	switch (a->type) {
+	case WLR_RENDER_OP_TEXTURE:
+		return a->texture == b->texture;
+	case WLR_RENDER_OP_QUAD:
+		return true;
+	case WLR_RENDER_OP_CLEAR:
+		return false;
+	}
+	return false;
+}
+
+static bool regions_overlap(pixman_region32_t *a, pixman_region32_t *b) {
+	pixman_box32_t *ea = pixman_region32_extents(a);
+	pixman_box32_t *eb = pixman_region32_extents(b);
+	if (ea->x2 <= eb->x1 || eb->x2 <= ea->x1 ||
+			ea->y2 <= eb->y1 || eb->y2 <= ea->y1) {
+		return false;
+	}
+
+	pixman_region32_t intersection;
+	pixman_region32_init(&intersection);
+	pixman_region32_intersect(&intersection, a, b);
+	bool overlap = pixman_region32_not_empty(&intersection);
+	pixman_region32_fini(&intersection);
+	return overlap;
+}
+
+static bool draw_op(struct wlr_renderer *renderer,
+		const struct wlr_render_op *op, pixman_region32_t *region) {
+	switch (op->type) {
+	case WLR_RENDER_OP_CLEAR:
+		wlr_renderer_clear_region(renderer, op->color, region);
+		return true;
+	case WLR_RENDER_OP_TEXTURE:
+		return wlr_render_subtexture_with_matrix_region(renderer,
+			op->texture, &op->box, op->matrix, op->alpha, region);
+	case WLR_RENDER_OP_QUAD:;
+		int nrects;
+		pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+		for (int i = 0; i < nrects; ++i) {
+			struct wlr_box box = {
+				.x = rects[i].x1,
+				.y = rects[i].y1,
+				.width = rects[i].x2 - rects[i].x1,
+				.height = rects[i].y2 - rects[i].y1,
+			};
+			wlr_renderer_scissor(renderer, &box);
+			wlr_render_quad_with_matrix(renderer, op->color, op->matrix);
+		}
+		wlr_renderer_scissor(renderer, NULL);
+		return true;
+	}
+	return false;
+}
+
+bool wlr_render_pass_submit(struct wlr_render_pass *pass,
+		struct wlr_renderer *renderer) {
+	size_t len = pass->ops_len;
+	struct pass_draw *draws = calloc(len, sizeof(struct pass_draw));
+	size_t *order = calloc(len, sizeof(size_t));
+	if (len > 0 && (draws == NULL || order == NULL)) {
+		// Draw everything as recorded
+		wlr_log(WLR_ERROR, "Allocation failed");
+		free(draws);
+		free(order);
+		bool ok = true;
+		for (size_t i = 0; i < len; ++i) {
+			ok = draw_op(renderer, &pass->ops[i], &pass->ops[i].clip) && ok;
+		}
+		return ok;
+	}
+
+	// Discard what the operations above cover, topmost first
+	pixman_region32_t covered;
+	pixman_region32_init(&covered);
+	for (size_t i = len; i-- > 0;) {
+		const struct wlr_render_op *op = &pass->ops[i];
+		draws[i].op = op;
+		pixman_region32_init(&draws[i].visible);
+		pixman_region32_subtract(&draws[i].visible, &op->clip, &covered);
+		pixman_region32_union(&covered, &covered, &op->opaque);
+	}
+	pixman_region32_fini(&covered);
+
+	// Move each draw right after the last one it can be batched with, as long
+	// as it doesn't overlap any draw in between
+	size_t n = 0;
+	for (size_t i = 0; i < len; ++i) {
+		struct pass_draw *draw = &draws[i];
+		if (!pixman_region32_not_empty(&draw->visible)) {
+			continue;
+		}
+
+		size_t pos = n;
+		for (size_t j = n; j-- > 0 && n - j <= WLR_RENDER_PASS_REORDER_WINDOW;) {
+			struct pass_draw *other = &draws[order[j]];
+			if (ops_can_batch(other->op, draw->op)) {
+				pos = j + 1;
+				break;
+			}
+			if (regions_overlap(&other->visible, &draw->visible)) {
+				break;
+			}
+		}
+		memmove(&order[pos + 1], &order[pos], (n - pos) * sizeof(size_t));
+		order[pos] = i;
+		n++;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < n; ++i) {
+		struct pass_draw *draw = &draws[order[i]];
+		ok = draw_op(renderer, draw->op, &draw->visible) && ok;
+	}
+	wlr_renderer_scissor(renderer, NULL);
+
+	for (size_t i = 0; i < len; ++i) {
+		pixman_region32_fini(&draws[i].visible);
+	}
+	free(draws);
+	free(order);
+	return ok;
+}
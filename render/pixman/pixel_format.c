@@ -0,0 +1,65 @@
+#include <pixman.h>
+#include "render/pixman.h"
+
+/*
+ * Both the wayland and the pixman formats are in native endianness, so
+ * WL_SHM_FORMAT_ARGB8888 is PIXMAN_a8r8g8b8.
+ */
+static const struct wlr_pixman_pixel_format formats[] = {
+	{
+		.wl_format = WL_SHM_FORMAT_ARGB8888,
+		.pixman_format = PIXMAN_a8r8g8b8,
+		.bpp = 32,
+		.has_alpha = true,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_XRGB8888,
+		.pixman_format = PIXMAN_x8r8g8b8,
+		.bpp = 32,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_XBGR8888,
+		.pixman_format = PIXMAN_x8b8g8r8,
+		.bpp = 32,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_ABGR8888,
+		.pixman_format = PIXMAN_a8b8g8r8,
+		.bpp = 32,
+		.has_alpha = true,
+	},
+};
+
+static const enum wl_shm_format wl_formats[] = {
+	WL_SHM_FORMAT_ARGB8888,
+	WL_SHM_FORMAT_XRGB8888,
+	WL_SHM_FORMAT_ABGR8888,
+	WL_SHM_FORMAT_XBGR8888,
+};
+
+const struct wlr_pixman_pixel_format *get_pixman_format_from_wl(
+		enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+		if (formats[i].wl_format == fmt) {
+			return &formats[i];
+		}
+	}
+	return NULL;
+}
+
+const struct wlr_pixman_pixel_format *get_pixman_format_from_pixman(
+		pixman_format_code_t fmt) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+		if (formats[i].pixman_format == fmt) {
+			return &formats[i];
+		}
+	}
+	return NULL;
+}
+
+const enum wl_shm_format *get_pixman_wl_formats(size_t *len) {
+	*len = sizeof(wl_formats) / sizeof(wl_formats[0]);
+	return wl_formats;
+}
@@ -0,0 +1,375 @@
+#include <assert.h>
+#include <math.h>
+#include <pixman.h>
+#include <stdlib.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+static const struct wlr_renderer_impl renderer_impl;
+
+static struct wlr_pixman_renderer *pixman_get_renderer(
+		struct wlr_renderer *wlr_renderer) {
+	assert(wlr_renderer->impl == &renderer_impl);
+	return (struct wlr_pixman_renderer *)wlr_renderer;
+}
+
+static struct wlr_pixman_renderer *pixman_get_renderer_in_context(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	assert(renderer->image != NULL);
+	return renderer;
+}
+
+// Colors are premultiplied, like with the GLES2 renderer
+static pixman_color_t color_to_pixman(const float color[static 4]) {
+	return (pixman_color_t){
+		.red = color[0] * 0xFFFF,
+		.green = color[1] * 0xFFFF,
+		.blue = color[2] * 0xFFFF,
+		.alpha = color[3] * 0xFFFF,
+	};
+}
+
+// Computes the transform from the unit square to buffer coordinates, undoing
+// the projection to normalized device coordinates
+static void matrix_to_buffer(struct pixman_f_transform *ft,
+		const float matrix[static 9], uint32_t width, uint32_t height) {
+	double hw = width / 2.0, hh = height / 2.0;
+	*ft = (struct pixman_f_transform){ .m = {
+		{ hw * matrix[0], hw * matrix[1], hw * (matrix[2] + 1) },
+		{ -hh * matrix[3], -hh * matrix[4], hh * (1 - matrix[5]) },
+		{ 0, 0, 1 },
+	}};
+}
+
+// Returns false if the transformed unit square doesn't intersect the buffer
+static bool get_buffer_box(struct wlr_pixman_renderer *renderer,
+		const struct pixman_f_transform *ft, pixman_box32_t *box) {
+	double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (int i = 0; i < 4; ++i) {
+		double u = i & 1, v = i >> 1;
+		double x = ft->m[0][0] * u + ft->m[0][1] * v + ft->m[0][2];
+		double y = ft->m[1][0] * u + ft->m[1][1] * v + ft->m[1][2];
+		x1 = fmin(x1, x);
+		y1 = fmin(y1, y);
+		x2 = fmax(x2, x);
+		y2 = fmax(y2, y);
+	}
+
+	box->x1 = fmax(floor(x1), 0);
+	box->y1 = fmax(floor(y1), 0);
+	box->x2 = fmin(ceil(x2), renderer->width);
+	box->y2 = fmin(ceil(y2), renderer->height);
+	return box->x1 < box->x2 && box->y1 < box->y2;
+}
+
+static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
+		uint32_t height) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	renderer->width = width;
+	renderer->height = height;
+	pixman_image_set_clip_region32(renderer->image, NULL);
+}
+
+static void pixman_clear(struct wlr_renderer *wlr_renderer,
+		const float color[static 4]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	pixman_color_t pixman_color = color_to_pixman(color);
+	pixman_box32_t box = {
+		.x2 = renderer->width,
+		.y2 = renderer->height,
+	};
+	pixman_image_fill_boxes(PIXMAN_OP_SRC, renderer->image, &pixman_color,
+		1, &box);
+}
+
+static void pixman_scissor(struct wlr_renderer *wlr_renderer,
+		struct wlr_box *box) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	if (box == NULL) {
+		pixman_image_set_clip_region32(renderer->image, NULL);
+		return;
+	}
+
+	pixman_region32_t region;
+	pixman_region32_init_rect(&region, box->x, box->y, box->width,
+		box->height);
+	pixman_image_set_clip_region32(renderer->image, &region);
+	pixman_region32_fini(&region);
+}
+
+static bool pixman_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *src_box, const float matrix[static 9],
+		float alpha) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+
+	struct pixman_f_transform ft;
+	matrix_to_buffer(&ft, matrix, renderer->width, renderer->height);
+
+	pixman_box32_t box;
+	if (!get_buffer_box(renderer, &ft, &box)) {
+		return true;
+	}
+
+	// Map the source box to the unit square, then invert to get the
+	// transform from buffer coordinates to texels
+	for (int i = 0; i < 2; ++i) {
+		ft.m[i][0] /= src_box->width;
+		ft.m[i][1] /= src_box->height;
+		ft.m[i][2] -= ft.m[i][0] * src_box->x + ft.m[i][1] * src_box->y;
+	}
+	struct pixman_f_transform inverse;
+	if (!pixman_f_transform_invert(&inverse, &ft)) {
+		return true; // degenerate matrix, nothing is visible
+	}
+
+	// Integer translations are by far the most common case and have the
+	// fastest paths, so don't set a transform for them
+	int32_t src_x = box.x1, src_y = box.y1;
+	double tx = inverse.m[0][2], ty = inverse.m[1][2];
+	if (inverse.m[0][0] == 1 && inverse.m[0][1] == 0 &&
+			inverse.m[1][0] == 0 && inverse.m[1][1] == 1 &&
+			tx == round(tx) && ty == round(ty)) {
+		pixman_image_set_transform(texture->image, NULL);
+		pixman_image_set_filter(texture->image, PIXMAN_FILTER_NEAREST,
+			NULL, 0);
+		src_x += tx;
+		src_y += ty;
+	} else {
+		pixman_transform_t transform;
+		if (!pixman_transform_from_pixman_f_transform(&transform, &inverse)) {
+			wlr_log(WLR_ERROR, "Failed to convert texture transform");
+			return false;
+		}
+		pixman_image_set_transform(texture->image, &transform);
+		pixman_image_set_filter(texture->image, PIXMAN_FILTER_BILINEAR,
+			NULL, 0);
+	}
+
+	pixman_image_t *mask = NULL;
+	if (alpha < 1.0) {
+		pixman_color_t mask_color = { .alpha = alpha * 0xFFFF };
+		mask = pixman_image_create_solid_fill(&mask_color);
+		if (mask == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create pixman image");
+			return false;
+		}
+	}
+
+	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
+		renderer->image, src_x, src_y, 0, 0, box.x1, box.y1,
+		box.x2 - box.x1, box.y2 - box.y1);
+
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+	return true;
+}
+
+// Draws a solid unit square or the ellipse inscribed in it. pixman can't
+// rasterize arbitrary shapes, so a mask is computed unless the shape is an
+// axis-aligned rectangle.
+static void render_shape(struct wlr_pixman_renderer *renderer,
+		const float color[static 4], const float matrix[static 9],
+		bool ellipse) {
+	struct pixman_f_transform ft;
+	matrix_to_buffer(&ft, matrix, renderer->width, renderer->height);
+
+	pixman_color_t pixman_color = color_to_pixman(color);
+
+	bool axis_aligned = (ft.m[0][1] == 0 && ft.m[1][0] == 0) ||
+		(ft.m[0][0] == 0 && ft.m[1][1] == 0);
+	if (!ellipse && axis_aligned) {
+		// Only fill pixels whose center is inside the rectangle
+		double x1 = ft.m[0][2], y1 = ft.m[1][2];
+		double x2 = x1 + ft.m[0][0] + ft.m[0][1];
+		double y2 = y1 + ft.m[1][0] + ft.m[1][1];
+		pixman_box32_t box = {
+			.x1 = round(fmin(x1, x2)),
+			.y1 = round(fmin(y1, y2)),
+			.x2 = round(fmax(x1, x2)),
+			.y2 = round(fmax(y1, y2)),
+		};
+		pixman_image_fill_boxes(PIXMAN_OP_OVER, renderer->image,
+			&pixman_color, 1, &box);
+		return;
+	}
+
+	pixman_box32_t box;
+	struct pixman_f_transform inverse;
+	if (!get_buffer_box(renderer, &ft, &box) ||
+			!pixman_f_transform_invert(&inverse, &ft)) {
+		return;
+	}
+
+	int width = box.x2 - box.x1, height = box.y2 - box.y1;
+	int stride = (width + 3) & ~3;
+	uint8_t *mask_data = calloc(stride * height, 1);
+	if (mask_data == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			double px = box.x1 + x + 0.5, py = box.y1 + y + 0.5;
+			double u = inverse.m[0][0] * px + inverse.m[0][1] * py +
+				inverse.m[0][2];
+			double v = inverse.m[1][0] * px + inverse.m[1][1] * py +
+				inverse.m[1][2];
+			bool inside;
+			if (ellipse) {
+				inside = (u - 0.5) * (u - 0.5) + (v - 0.5) * (v - 0.5) <= 0.25;
+			} else {
+				inside = u >= 0 && u <= 1 && v >= 0 && v <= 1;
+			}
+			mask_data[y * stride + x] = inside ? 0xFF : 0;
+		}
+	}
+
+	pixman_image_t *mask = pixman_image_create_bits_no_clear(PIXMAN_a8,
+		width, height, (uint32_t *)mask_data, stride);
+	pixman_image_t *src = pixman_image_create_solid_fill(&pixman_color);
+	if (mask != NULL && src != NULL) {
+		pixman_image_composite32(PIXMAN_OP_OVER, src, mask, renderer->image,
+			0, 0, 0, 0, box.x1, box.y1, width, height);
+	} else {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+	}
+
+	if (src != NULL) {
+		pixman_image_unref(src);
+	}
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+	free(mask_data);
+}
+
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	render_shape(renderer, color, matrix, false);
+}
+
+static void pixman_render_ellipse_with_matrix(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	render_shape(renderer, color, matrix, true);
+}
+
+static const enum wl_shm_format *pixman_renderer_formats(
+		struct wlr_renderer *wlr_renderer, size_t *len) {
+	return get_pixman_wl_formats(len);
+}
+
+static bool pixman_format_supported(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt) {
+	return get_pixman_format_from_wl(wl_fmt) != NULL;
+}
+
+static enum wl_shm_format pixman_preferred_read_format(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	const struct wlr_pixman_pixel_format *fmt = get_pixman_format_from_pixman(
+		pixman_image_get_format(renderer->image));
+	return fmt != NULL ? fmt->wl_format : WL_SHM_FORMAT_XRGB8888;
+}
+
+static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt, uint32_t *flags, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	const struct wlr_pixman_pixel_format *fmt = get_pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
+		return false;
+	}
+
+	unsigned char *p = (unsigned char *)data + dst_y * stride +
+		dst_x * fmt->bpp / 8;
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(
+		fmt->pixman_format, width, height, (uint32_t *)p, stride);
+	if (dst == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		return false;
+	}
+
+	// The clip region of the render target doesn't apply when it's used as
+	// a source
+	pixman_image_composite32(PIXMAN_OP_SRC, renderer->image, NULL, dst,
+		src_x, src_y, 0, 0, 0, 0, width, height);
+	pixman_image_unref(dst);
+
+	if (flags != NULL) {
+		*flags = 0;
+	}
+	return true;
+}
+
+static struct wlr_texture *pixman_texture_from_pixels_impl(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	return pixman_texture_from_pixels(wl_fmt, stride, width, height, data);
+}
+
+static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	free(renderer);
+}
+
+static const struct wlr_renderer_impl renderer_impl = {
+	.destroy = pixman_destroy,
+	.begin = pixman_begin,
+	.clear = pixman_clear,
+	.scissor = pixman_scissor,
+	.render_subtexture_with_matrix = pixman_render_subtexture_with_matrix,
+	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_ellipse_with_matrix = pixman_render_ellipse_with_matrix,
+	.formats = pixman_renderer_formats,
+	.format_supported = pixman_format_supported,
+	.preferred_read_format = pixman_preferred_read_format,
+	.read_pixels = pixman_read_pixels,
+	.texture_from_pixels = pixman_texture_from_pixels_impl,
+};
+
+struct wlr_renderer *wlr_pixman_renderer_create(void) {
+	struct wlr_pixman_renderer *renderer =
+		calloc(1, sizeof(struct wlr_pixman_renderer));
+	if (renderer == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
+	wlr_log(WLR_INFO, "Using pixman software renderer");
+	return &renderer->wlr_renderer;
+}
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer) {
+	return wlr_renderer->impl == &renderer_impl;
+}
+
+void wlr_pixman_renderer_bind_image(struct wlr_renderer *wlr_renderer,
+		pixman_image_t *image) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	renderer->image = image;
+}
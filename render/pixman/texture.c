@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <pixman.h>
+#include <stdlib.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+static const struct wlr_texture_impl texture_impl;
+
+struct wlr_pixman_texture *pixman_get_texture(struct wlr_texture *wlr_texture) {
+	assert(wlr_texture->impl == &texture_impl);
+	return (struct wlr_pixman_texture *)wlr_texture;
+}
+
+static void pixman_texture_get_size(struct wlr_texture *wlr_texture,
+		int *width, int *height) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	*width = pixman_image_get_width(texture->image);
+	*height = pixman_image_get_height(texture->image);
+}
+
+static bool pixman_texture_is_opaque(struct wlr_texture *wlr_texture) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	return !texture->fmt->has_alpha;
+}
+
+static bool pixman_texture_write_pixels(struct wlr_texture *wlr_texture,
+		uint32_t stride, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
+		const void *data) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+
+	// pixman never writes to source images, so casting away const is fine
+	pixman_image_t *src = pixman_image_create_bits_no_clear(
+		texture->fmt->pixman_format, src_x + width, src_y + height,
+		(uint32_t *)data, stride);
+	if (src == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		return false;
+	}
+
+	pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, texture->image,
+		src_x, src_y, 0, 0, dst_x, dst_y, width, height);
+
+	pixman_image_unref(src);
+	return true;
+}
+
+static void pixman_texture_destroy(struct wlr_texture *wlr_texture) {
+	if (wlr_texture == NULL) {
+		return;
+	}
+
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	pixman_image_unref(texture->image);
+	free(texture);
+}
+
+static const struct wlr_texture_impl texture_impl = {
+	.get_size = pixman_texture_get_size,
+	.is_opaque = pixman_texture_is_opaque,
+	.write_pixels = pixman_texture_write_pixels,
+	.destroy = pixman_texture_destroy,
+};
+
+struct wlr_texture *pixman_texture_from_pixels(enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	const struct wlr_pixman_pixel_format *fmt = get_pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(WLR_ERROR, "Unsupported pixel format %"PRIu32, wl_fmt);
+		return NULL;
+	}
+
+	struct wlr_pixman_texture *texture =
+		calloc(1, sizeof(struct wlr_pixman_texture));
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_texture_init(&texture->wlr_texture, &texture_impl);
+	texture->fmt = fmt;
+
+	// The client may reuse its buffer as soon as it has been released, so
+	// the pixels have to be copied
+	texture->image = pixman_image_create_bits_no_clear(fmt->pixman_format,
+		width, height, NULL, 0);
+	if (texture->image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		free(texture);
+		return NULL;
+	}
+
+	if (data != NULL && !pixman_texture_write_pixels(&texture->wlr_texture,
+			stride, width, height, 0, 0, 0, 0, data)) {
+		pixman_texture_destroy(&texture->wlr_texture);
+		return NULL;
+	}
+
+	return &texture->wlr_texture;
+}
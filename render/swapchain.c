@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/render/swapchain.h>
+#include <wlr/util/log.h>
+
+struct wlr_swapchain *wlr_swapchain_create(struct wlr_allocator *alloc,
+		int width, int height, uint32_t format, const uint64_t *modifiers,
+		size_t modifiers_len, size_t len) {
+	assert(len >= 2 && len <= WLR_SWAPCHAIN_CAP);
+
+	struct wlr_swapchain *swapchain = calloc(1, sizeof(struct wlr_swapchain));
+	if (swapchain == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	swapchain->allocator = alloc;
+	swapchain->width = width;
+	swapchain->height = height;
+	swapchain->format = format;
+	swapchain->len = len;
+
+	if (modifiers_len > 0) {
+		swapchain->modifiers = malloc(modifiers_len * sizeof(uint64_t));
+		if (swapchain->modifiers == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			free(swapchain);
+			return NULL;
+		}
+		memcpy(swapchain->modifiers, modifiers,
+			modifiers_len * sizeof(uint64_t));
+		swapchain->modifiers_len = modifiers_len;
+	}
+
+	return swapchain;
+}
+
+void wlr_swapchain_destroy(struct wlr_swapchain *swapchain) {
+	if (swapchain == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < swapchain->len; ++i) {
+		wlr_allocator_buffer_destroy(swapchain->slots[i].buffer);
+	}
+	free(swapchain->modifiers);
+	free(swapchain);
+}
+
+struct wlr_allocator_buffer *wlr_swapchain_acquire(
+		struct wlr_swapchain *swapchain, int *age) {
+	struct wlr_swapchain_slot *slot = swapchain->back;
+	if (slot == NULL) {
+		// Prefer buffers which haven't been allocated yet, then the oldest
+		for (size_t i = 0; i < swapchain->len; ++i) {
+			struct wlr_swapchain_slot *s = &swapchain->slots[i];
+			if (s == swapchain->front) {
+				continue;
+			}
+			if (slot == NULL || s->age == 0 ||
+					(slot->age != 0 && s->age > slot->age)) {
+				slot = s;
+			}
+		}
+	}
+
+	if (slot->buffer == NULL) {
+		slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
+			swapchain->width, swapchain->height, swapchain->format,
+			swapchain->modifiers, swapchain->modifiers_len);
+		if (slot->buffer == NULL) {
+			return NULL;
+		}
+		slot->age = 0;
+	}
+
+	swapchain->back = slot;
+	if (age != NULL) {
+		*age = slot->age;
+	}
+	return slot->buffer;
+}
+
+void wlr_swapchain_submit(struct wlr_swapchain *swapchain) {
+	assert(swapchain->back != NULL);
+	for (size_t i = 0; i < swapchain->len; ++i) {
+		if (swapchain->slots[i].age > 0) {
+			swapchain->slots[i].age++;
+		}
+	}
+	swapchain->back->age = 1;
+	swapchain->front = swapchain->back;
+	swapchain->back = NULL;
+}
+
+struct wlr_allocator_buffer *wlr_swapchain_get_front(
+		struct wlr_swapchain *swapchain) {
+	return swapchain->front != NULL ? swapchain->front->buffer : NULL;
+}
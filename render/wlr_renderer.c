@@ -1,20 +1,23 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/render/gles2.h>
 #include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include "util/signal.h"
+#include "util/trace.h"
 
 void wlr_renderer_init(struct wlr_renderer *renderer,
 		const struct wlr_renderer_impl *impl) {
 	assert(impl->begin);
 	assert(impl->clear);
 	assert(impl->scissor);
-	assert(impl->render_texture_with_matrix);
+	assert(impl->render_subtexture_with_matrix);
 	assert(impl->render_quad_with_matrix);
 	assert(impl->render_ellipse_with_matrix);
 	assert(impl->formats);
@@ -39,6 +42,7 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 }
 
 void wlr_renderer_begin(struct wlr_renderer *r, int width, int height) {
+	wlr_trace(render_begin, r, width, height);
 	r->impl->begin(r, width, height);
 }
 
@@ -46,6 +50,7 @@ void wlr_renderer_end(struct wlr_renderer *r) {
 	if (r->impl->end) {
 		r->impl->end(r);
 	}
+	wlr_trace(render_end, r);
 }
 
 void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]) {
@@ -56,6 +61,33 @@ void wlr_renderer_scissor(struct wlr_renderer *r, struct wlr_box *box) {
 	r->impl->scissor(r, box);
 }
 
+static void scissor_region_rect(struct wlr_renderer *r,
+		const pixman_box32_t *rect) {
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+	wlr_renderer_scissor(r, &box);
+}
+
+void wlr_renderer_clear_region(struct wlr_renderer *r,
+		const float color[static 4], pixman_region32_t *region) {
+	if (r->impl->clear_region) {
+		r->impl->clear_region(r, color, region);
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_region_rect(r, &rects[i]);
+		wlr_renderer_clear(r, color);
+	}
+	wlr_renderer_scissor(r, NULL);
+}
+
 bool wlr_render_texture(struct wlr_renderer *r, struct wlr_texture *texture,
 		const float projection[static 9], int x, int y, float alpha) {
 	struct wlr_box box = { .x = x, .y = y };
@@ -71,7 +103,51 @@ bool wlr_render_texture(struct wlr_renderer *r, struct wlr_texture *texture,
 bool wlr_render_texture_with_matrix(struct wlr_renderer *r,
 		struct wlr_texture *texture, const float matrix[static 9],
 		float alpha) {
-	return r->impl->render_texture_with_matrix(r, texture, matrix, alpha);
+	struct wlr_fbox box = {0};
+	int width, height;
+	wlr_texture_get_size(texture, &width, &height);
+	box.width = width;
+	box.height = height;
+	return wlr_render_subtexture_with_matrix(r, texture, &box, matrix, alpha);
+}
+
+bool wlr_render_subtexture_with_matrix(struct wlr_renderer *r,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha) {
+	return r->impl->render_subtexture_with_matrix(r, texture, box, matrix,
+		alpha);
+}
+
+bool wlr_render_texture_with_matrix_region(struct wlr_renderer *r,
+		struct wlr_texture *texture, const float matrix[static 9],
+		float alpha, pixman_region32_t *region) {
+	struct wlr_fbox box = {0};
+	int width, height;
+	wlr_texture_get_size(texture, &width, &height);
+	box.width = width;
+	box.height = height;
+	return wlr_render_subtexture_with_matrix_region(r, texture, &box, matrix,
+		alpha, region);
+}
+
+bool wlr_render_subtexture_with_matrix_region(struct wlr_renderer *r,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha, pixman_region32_t *region) {
+	if (r->impl->render_subtexture_with_matrix_region) {
+		return r->impl->render_subtexture_with_matrix_region(r, texture, box,
+			matrix, alpha, region);
+	}
+
+	bool ok = true;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_region_rect(r, &rects[i]);
+		ok = wlr_render_subtexture_with_matrix(r, texture, box, matrix,
+			alpha) && ok;
+	}
+	wlr_renderer_scissor(r, NULL);
+	return ok;
 }
 
 void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
@@ -139,6 +215,13 @@ int wlr_renderer_get_dmabuf_modifiers(struct wlr_renderer *r, int format,
 	return r->impl->get_dmabuf_modifiers(r, format, modifiers);
 }
 
+bool wlr_renderer_get_drm_device(struct wlr_renderer *r, dev_t *dev) {
+	if (!r->impl->get_drm_device) {
+		return false;
+	}
+	return r->impl->get_drm_device(r, dev);
+}
+
 bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 		uint32_t *flags, uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
@@ -150,6 +233,120 @@ bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 		src_x, src_y, dst_x, dst_y, data);
 }
 
+struct wlr_renderer_readback *wlr_renderer_read_pixels_async(
+		struct wlr_renderer *r, enum wl_shm_format fmt, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y) {
+	if (!r->impl->read_pixels_async) {
+		return NULL;
+	}
+	return r->impl->read_pixels_async(r, fmt, width, height, src_x, src_y);
+}
+
+bool wlr_renderer_blit_dmabuf(struct wlr_renderer *r,
+		struct wlr_dmabuf_attributes *dst, uint32_t *flags, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+		uint32_t dst_y) {
+	if (!r->impl->blit_dmabuf) {
+		return false;
+	}
+	return r->impl->blit_dmabuf(r, dst, flags, width, height, src_x, src_y,
+		dst_x, dst_y);
+}
+
+bool wlr_renderer_copy_region(struct wlr_renderer *r,
+		const struct wlr_box *src, int dst_x, int dst_y) {
+	if (!r->impl->copy_region) {
+		return false;
+	}
+	return r->impl->copy_region(r, src, dst_x, dst_y);
+}
+
+bool wlr_renderer_bind_offscreen(struct wlr_renderer *r,
+		struct wlr_dmabuf_attributes *dmabuf, uint32_t width, uint32_t height) {
+	if (!r->impl->bind_offscreen || !r->impl->unbind_offscreen) {
+		return false;
+	}
+	return r->impl->bind_offscreen(r, dmabuf, width, height);
+}
+
+bool wlr_renderer_bind_offscreen_scaled(struct wlr_renderer *r,
+		const struct wlr_box *src, struct wlr_dmabuf_attributes *dmabuf,
+		uint32_t width, uint32_t height) {
+	if (!r->impl->bind_offscreen_scaled || !r->impl->unbind_offscreen) {
+		return false;
+	}
+	return r->impl->bind_offscreen_scaled(r, src, dmabuf, width, height);
+}
+
+bool wlr_renderer_bind_texture(struct wlr_renderer *r,
+		struct wlr_texture *texture) {
+	if (!r->impl->bind_texture || !r->impl->unbind_offscreen) {
+		return false;
+	}
+	return r->impl->bind_texture(r, texture);
+}
+
+void wlr_renderer_unbind_offscreen(struct wlr_renderer *r) {
+	if (r->impl->unbind_offscreen) {
+		r->impl->unbind_offscreen(r);
+	}
+}
+
+void wlr_renderer_readback_init(struct wlr_renderer_readback *readback,
+		const struct wlr_renderer_readback_impl *impl, uint32_t width,
+		uint32_t height) {
+	assert(impl->finish && impl->destroy);
+	readback->impl = impl;
+	readback->width = width;
+	readback->height = height;
+}
+
+bool wlr_renderer_readback_finish(struct wlr_renderer_readback *readback,
+		uint32_t *flags, uint32_t stride, uint32_t dst_x, uint32_t dst_y,
+		void *data) {
+	return readback->impl->finish(readback, flags, stride, dst_x, dst_y, data);
+}
+
+void wlr_renderer_readback_destroy(struct wlr_renderer_readback *readback) {
+	if (readback == NULL) {
+		return;
+	}
+	readback->impl->destroy(readback);
+}
+
+struct wlr_render_timer *wlr_render_timer_create(struct wlr_renderer *r) {
+	if (!r->impl->render_timer_create) {
+		return NULL;
+	}
+	return r->impl->render_timer_create(r);
+}
+
+void wlr_render_timer_init(struct wlr_render_timer *timer,
+		const struct wlr_render_timer_impl *impl) {
+	assert(impl->begin && impl->end && impl->get_duration && impl->destroy);
+	timer->impl = impl;
+}
+
+void wlr_render_timer_begin(struct wlr_render_timer *timer) {
+	timer->impl->begin(timer);
+}
+
+void wlr_render_timer_end(struct wlr_render_timer *timer) {
+	timer->impl->end(timer);
+}
+
+bool wlr_render_timer_get_duration(struct wlr_render_timer *timer,
+		int64_t *duration) {
+	return timer->impl->get_duration(timer, duration);
+}
+
+void wlr_render_timer_destroy(struct wlr_render_timer *timer) {
+	if (timer == NULL) {
+		return;
+	}
+	timer->impl->destroy(timer);
+}
+
 bool wlr_renderer_format_supported(struct wlr_renderer *r,
 		enum wl_shm_format fmt) {
 	return r->impl->format_supported(r, fmt);
@@ -189,6 +386,15 @@ void wlr_renderer_init_wl_display(struct wlr_renderer *r,
 struct wlr_renderer *wlr_renderer_autocreate(struct wlr_egl *egl,
 		EGLenum platform, void *remote_display, EGLint *config_attribs,
 		EGLint visual_id) {
+	// Backends without a native window system render into memory, so they
+	// can do without a GPU
+	bool allow_software = platform == EGL_PLATFORM_SURFACELESS_MESA;
+	const char *renderer_name = getenv("WLR_RENDERER");
+	if (allow_software && renderer_name != NULL &&
+			strcmp(renderer_name, "pixman") == 0) {
+		return wlr_pixman_renderer_create();
+	}
+
 	// Append GLES2-specific bits to the provided EGL config attributes
 	EGLint gles2_config_attribs[] = {
 		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
@@ -214,6 +420,11 @@ struct wlr_renderer *wlr_renderer_autocreate(struct wlr_egl *egl,
 	if (!wlr_egl_init(egl, platform, remote_display, all_config_attribs,
 			visual_id)) {
 		wlr_log(WLR_ERROR, "Could not initialize EGL");
+		if (allow_software) {
+			wlr_log(WLR_INFO, "Falling back to software rendering");
+			memset(egl, 0, sizeof(*egl));
+			return wlr_pixman_renderer_create();
+		}
 		return NULL;
 	}
 
@@ -3,15 +3,23 @@
 #include <stdlib.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_texture.h>
+#include "util/signal.h"
+#include "util/trace.h"
 
 void wlr_texture_init(struct wlr_texture *texture,
 		const struct wlr_texture_impl *impl) {
 	assert(impl->get_size);
 	assert(impl->write_pixels);
 	texture->impl = impl;
+	wl_signal_init(&texture->events.destroy);
+	wl_signal_init(&texture->events.update);
 }
 
 void wlr_texture_destroy(struct wlr_texture *texture) {
+	if (texture && texture->impl) {
+		wlr_signal_emit_safe(&texture->events.destroy, texture);
+	}
+
 	if (texture && texture->impl && texture->impl->destroy) {
 		texture->impl->destroy(texture);
 	} else {
@@ -22,6 +30,7 @@ void wlr_texture_destroy(struct wlr_texture *texture) {
 struct wlr_texture *wlr_texture_from_pixels(struct wlr_renderer *renderer,
 		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
 		uint32_t height, const void *data) {
+	wlr_trace(texture_upload, NULL, width, height);
 	return renderer->impl->texture_from_pixels(renderer, wl_fmt, stride, width,
 		height, data);
 }
@@ -31,6 +40,7 @@ struct wlr_texture *wlr_texture_from_wl_drm(struct wlr_renderer *renderer,
 	if (!renderer->impl->texture_from_wl_drm) {
 		return NULL;
 	}
+	wlr_trace(texture_import_wl_drm, data);
 	return renderer->impl->texture_from_wl_drm(renderer, data);
 }
 
@@ -39,6 +49,8 @@ struct wlr_texture *wlr_texture_from_dmabuf(struct wlr_renderer *renderer,
 	if (!renderer->impl->texture_from_dmabuf) {
 		return NULL;
 	}
+	wlr_trace(texture_import_dmabuf, attribs->width, attribs->height,
+		attribs->format);
 	return renderer->impl->texture_from_dmabuf(renderer, attribs);
 }
 
@@ -58,8 +70,13 @@ bool wlr_texture_write_pixels(struct wlr_texture *texture,
 		uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
 		const void *data) {
-	return texture->impl->write_pixels(texture, stride, width, height,
-		src_x, src_y, dst_x, dst_y, data);
+	wlr_trace(texture_upload, texture, width, height);
+	if (!texture->impl->write_pixels(texture, stride, width, height,
+			src_x, src_y, dst_x, dst_y, data)) {
+		return false;
+	}
+	wlr_signal_emit_safe(&texture->events.update, texture);
+	return true;
 }
 
 bool wlr_texture_to_dmabuf(struct wlr_texture *texture,
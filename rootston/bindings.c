@@ -7,6 +7,7 @@
 #include "rootston/view.h"
 
 static bool outputs_enabled = true;
+static bool outputs_dpms_on = true;
 
 static const char exec_prefix[] = "exec ";
 
@@ -58,6 +59,11 @@ void execute_binding_command(struct roots_seat *seat,
 			bool is_fullscreen = focus->fullscreen_output != NULL;
 			view_set_fullscreen(focus, !is_fullscreen, NULL);
 		}
+	} else if (strcmp(command, "toggle_tearing") == 0) {
+		struct roots_view *focus = roots_seat_get_focus(seat);
+		if (focus != NULL) {
+			focus->allow_tearing = !focus->allow_tearing;
+		}
 	} else if (strcmp(command, "next_window") == 0) {
 		roots_seat_cycle_focus(seat);
 	} else if (strcmp(command, "alpha") == 0) {
@@ -81,6 +87,12 @@ void execute_binding_command(struct roots_seat *seat,
 		wl_list_for_each(output, &input->server->desktop->outputs, link) {
 			wlr_output_enable(output->wlr_output, outputs_enabled);
 		}
+	} else if (strcmp(command, "toggle_dpms") == 0) {
+		outputs_dpms_on = !outputs_dpms_on;
+		struct roots_output *output;
+		wl_list_for_each(output, &input->server->desktop->outputs, link) {
+			wlr_output_set_dpms(output->wlr_output, outputs_dpms_on);
+		}
 	} else if (strcmp(command, "toggle_decoration_mode") == 0) {
 		struct roots_view *focus = roots_seat_get_focus(seat);
 		if (focus != NULL && focus->type == ROOTS_XDG_SHELL_VIEW) {
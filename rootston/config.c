@@ -27,9 +27,18 @@ static void usage(const char *name, int ret) {
 		"                file documentation.\n"
 		" -E <COMMAND>   Command that will be ran at startup.\n"
 		" -D             Enable damage tracking debugging.\n"
+		" -H             Overlay a heatmap of recent damage.\n"
 		" -l <LEVEL>     Set log verbosity, where,\n"
 		"                0:SILENT, 1:ERROR, 2:INFO, 3+:DEBUG\n"
-		"                (default: DEBUG)\n",
+		"                (default: DEBUG)\n"
+		" -R <FILE>      Record input events to a file.\n"
+		" -P <FILE>      Replay input events recorded with -R on\n"
+		"                headless input devices.\n"
+		" -S <SPEED>     Input replay speed factor (default: 1).\n"
+		" -T <FILE>      Record the requests of Wayland clients to a\n"
+		"                file, see examples/protocol-replay.\n"
+		" -B             Record a hash of the buffers attached to\n"
+		"                surfaces along with -T.\n",
 		name);
 
 	exit(ret);
@@ -201,6 +210,89 @@ static void add_binding_config(struct wl_list *bindings, const char* combination
 	}
 }
 
+static int keysym_cmp(const void *a, const void *b) {
+	xkb_keysym_t sym_a = *(const xkb_keysym_t *)a;
+	xkb_keysym_t sym_b = *(const xkb_keysym_t *)b;
+	return (sym_a > sym_b) - (sym_a < sym_b);
+}
+
+static uint32_t binding_hash(uint32_t modifiers, const xkb_keysym_t *keysyms,
+		size_t keysyms_len) {
+	// FNV-1a over the modifiers and keysyms
+	uint32_t hash = 2166136261u;
+	hash = (hash ^ modifiers) * 16777619u;
+	for (size_t i = 0; i < keysyms_len; ++i) {
+		hash = (hash ^ keysyms[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool binding_matches(struct roots_binding_config *bc, uint32_t hash,
+		uint32_t modifiers, const xkb_keysym_t *keysyms, size_t keysyms_len) {
+	return bc->hash == hash && bc->modifiers == modifiers &&
+		bc->keysyms_len == keysyms_len &&
+		memcmp(bc->keysyms, keysyms, keysyms_len * sizeof(xkb_keysym_t)) == 0;
+}
+
+/**
+ * Builds the binding lookup table. When several bindings have the same
+ * combination, the one which comes first in the list wins, as it did when the
+ * list was walked on each key press.
+ */
+static void compile_bindings(struct roots_config *config) {
+	size_t n = wl_list_length(&config->bindings);
+	size_t len = 8;
+	while (len < 2 * n) {
+		len *= 2;
+	}
+	config->binding_table = calloc(len, sizeof(*config->binding_table));
+	if (config->binding_table == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		exit(1);
+	}
+	config->binding_table_len = len;
+
+	struct roots_binding_config *bc;
+	wl_list_for_each(bc, &config->bindings, link) {
+		qsort(bc->keysyms, bc->keysyms_len, sizeof(xkb_keysym_t), keysym_cmp);
+		bc->hash = binding_hash(bc->modifiers, bc->keysyms, bc->keysyms_len);
+
+		size_t i = bc->hash & (len - 1);
+		while (config->binding_table[i] != NULL && !binding_matches(
+				config->binding_table[i], bc->hash, bc->modifiers,
+				bc->keysyms, bc->keysyms_len)) {
+			i = (i + 1) & (len - 1);
+		}
+		if (config->binding_table[i] == NULL) {
+			config->binding_table[i] = bc;
+		}
+	}
+}
+
+struct roots_binding_config *roots_config_get_binding(
+		struct roots_config *config, uint32_t modifiers,
+		const xkb_keysym_t *pressed_keysyms) {
+	xkb_keysym_t keysyms[ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP];
+	size_t keysyms_len = 0;
+	for (size_t i = 0; i < ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP; ++i) {
+		if (pressed_keysyms[i] != XKB_KEY_NoSymbol) {
+			keysyms[keysyms_len++] = pressed_keysyms[i];
+		}
+	}
+	qsort(keysyms, keysyms_len, sizeof(xkb_keysym_t), keysym_cmp);
+
+	uint32_t hash = binding_hash(modifiers, keysyms, keysyms_len);
+	size_t mask = config->binding_table_len - 1;
+	for (size_t i = hash & mask; config->binding_table[i] != NULL;
+			i = (i + 1) & mask) {
+		struct roots_binding_config *bc = config->binding_table[i];
+		if (binding_matches(bc, hash, modifiers, keysyms, keysyms_len)) {
+			return bc;
+		}
+	}
+	return NULL;
+}
+
 static void add_switch_config(struct wl_list *switches, const char *switch_name,
 		const char *action, const char *command) {
 	struct roots_switch_config *sc =
@@ -323,11 +415,50 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 			} else if (strcasecmp(value, "immediate") == 0) {
 				config->xwayland = true;
 				config->xwayland_lazy = false;
+			} else if (strcasecmp(value, "prewarm") == 0) {
+				config->xwayland = true;
+				config->xwayland_prewarm = true;
 			} else if (strcasecmp(value, "false") == 0) {
 				config->xwayland = false;
 			} else {
 				wlr_log(WLR_ERROR, "got unknown xwayland value: %s", value);
 			}
+		} else if (strcmp(name, "coalesce-pointer-motion") == 0) {
+			config->coalesce_pointer_motion = strcasecmp(value, "true") == 0;
+		} else if (strcmp(name, "track-input-latency") == 0) {
+			config->track_input_latency = strcasecmp(value, "true") == 0;
+		} else if (strcmp(name, "cursor-fast-path") == 0) {
+			config->cursor_fast_path = strcasecmp(value, "true") == 0;
+		} else if (strcmp(name, "blit-moved-views") == 0) {
+			config->blit_moved_views = strcasecmp(value, "true") == 0;
+		} else if (strcmp(name, "hidden-frame-rate") == 0) {
+			config->hidden_frame_rate = strtol(value, NULL, 10);
+			if (config->hidden_frame_rate < 0) {
+				wlr_log(WLR_ERROR, "got invalid hidden-frame-rate: %s", value);
+				config->hidden_frame_rate = 0;
+			}
+		} else if (strcmp(name, "unfocused-frame-rate") == 0) {
+			config->unfocused_frame_rate = strtol(value, NULL, 10);
+			if (config->unfocused_frame_rate < 0) {
+				wlr_log(WLR_ERROR, "got invalid unfocused-frame-rate: %s",
+					value);
+				config->unfocused_frame_rate = 0;
+			}
+		} else if (strcmp(name, "render-budget") == 0) {
+			config->render_budget = strtol(value, NULL, 10);
+			if (config->render_budget < 0) {
+				wlr_log(WLR_ERROR, "got invalid render-budget: %s", value);
+				config->render_budget = 0;
+			}
+		} else if (strcmp(name, "auto-refresh-rate") == 0) {
+			config->auto_refresh_rate = strcasecmp(value, "true") == 0;
+		} else if (strcmp(name, "texture-eviction-timeout") == 0) {
+			config->texture_eviction_timeout = strtol(value, NULL, 10);
+			if (config->texture_eviction_timeout < 0) {
+				wlr_log(WLR_ERROR,
+					"got invalid texture-eviction-timeout: %s", value);
+				config->texture_eviction_timeout = 0;
+			}
 		} else {
 			wlr_log(WLR_ERROR, "got unknown core config: %s", name);
 		}
@@ -368,6 +499,65 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 		} else if (strcmp(name, "scale") == 0) {
 			oc->scale = strtof(value, NULL);
 			assert(oc->scale > 0);
+		} else if (strcmp(name, "adaptive-sync") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				oc->adaptive_sync = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				oc->adaptive_sync = false;
+			} else {
+				wlr_log(WLR_ERROR, "got invalid output adaptive-sync value: %s",
+					value);
+			}
+		} else if (strcmp(name, "depth") == 0) {
+			oc->depth = strtol(value, NULL, 10);
+			if (oc->depth != 30 && oc->depth != 24 && oc->depth != 16) {
+				wlr_log(WLR_ERROR, "got invalid output depth value: %s", value);
+				oc->depth = 0;
+			}
+		} else if (strcmp(name, "lease") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				oc->lease = true;
+				oc->enable = false;
+			} else if (strcasecmp(value, "false") == 0) {
+				oc->lease = false;
+			} else {
+				wlr_log(WLR_ERROR, "got invalid output lease value: %s", value);
+			}
+		} else if (strcmp(name, "dynamic-resolution") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				oc->dynamic_resolution = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				oc->dynamic_resolution = false;
+			} else {
+				wlr_log(WLR_ERROR, "got invalid output dynamic-resolution "
+					"value: %s", value);
+			}
+		} else if (strcmp(name, "tearing") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				oc->tearing = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				oc->tearing = false;
+			} else {
+				wlr_log(WLR_ERROR, "got invalid output tearing value: %s",
+					value);
+			}
+		} else if (strcmp(name, "damage-tile-size") == 0) {
+			oc->damage_tile_size = strtol(value, NULL, 10);
+			if (oc->damage_tile_size < 0) {
+				wlr_log(WLR_ERROR, "got invalid output damage-tile-size "
+					"value: %s", value);
+				oc->damage_tile_size = 0;
+			}
+		} else if (strcmp(name, "idle-refresh-timeout") == 0) {
+			oc->idle_refresh_timeout = strtol(value, NULL, 10);
+			if (oc->idle_refresh_timeout < 0) {
+				wlr_log(WLR_ERROR, "got invalid output idle-refresh-timeout "
+					"value: %s", value);
+				oc->idle_refresh_timeout = 0;
+			}
+		} else if (strcmp(name, "mirror") == 0) {
+			free(oc->mirror);
+			oc->mirror = strdup(value);
 		} else if (strcmp(name, "rotate") == 0) {
 			if (strcmp(value, "normal") == 0) {
 				oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
@@ -486,6 +676,8 @@ struct roots_config *roots_config_create_from_args(int argc, char *argv[]) {
 
 	config->xwayland = true;
 	config->xwayland_lazy = true;
+	config->hidden_frame_rate = 1;
+	config->input_replay_speed = 1;
 	wl_list_init(&config->outputs);
 	wl_list_init(&config->devices);
 	wl_list_init(&config->keyboards);
@@ -495,7 +687,7 @@ struct roots_config *roots_config_create_from_args(int argc, char *argv[]) {
 
 	int c;
 	unsigned int log_verbosity = WLR_DEBUG;
-	while ((c = getopt(argc, argv, "C:E:hDl:")) != -1) {
+	while ((c = getopt(argc, argv, "C:E:hDHl:R:P:S:T:B")) != -1) {
 		switch (c) {
 		case 'C':
 			config->config_path = strdup(optarg);
@@ -506,6 +698,27 @@ struct roots_config *roots_config_create_from_args(int argc, char *argv[]) {
 		case 'D':
 			config->debug_damage_tracking = true;
 			break;
+		case 'H':
+			config->debug_damage_heatmap = true;
+			break;
+		case 'R':
+			config->input_record_path = strdup(optarg);
+			break;
+		case 'P':
+			config->input_replay_path = strdup(optarg);
+			break;
+		case 'S':
+			config->input_replay_speed = strtod(optarg, NULL);
+			if (config->input_replay_speed <= 0) {
+				usage(argv[0], 1);
+			}
+			break;
+		case 'T':
+			config->protocol_record_path = strdup(optarg);
+			break;
+		case 'B':
+			config->protocol_record_buffers = true;
+			break;
 		case 'l':
 			log_verbosity = strtoul(optarg, NULL, 10);
 			if (log_verbosity >= WLR_LOG_IMPORTANCE_LAST) {
@@ -556,6 +769,8 @@ struct roots_config *roots_config_create_from_args(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	compile_bindings(config);
+
 	return config;
 }
 
@@ -567,6 +782,7 @@ void roots_config_destroy(struct roots_config *config) {
 			free(omc);
 		}
 		free(oc->name);
+		free(oc->mirror);
 		free(oc);
 	}
 
@@ -606,8 +822,12 @@ void roots_config_destroy(struct roots_config *config) {
 		free(bc->command);
 		free(bc);
 	}
+	free(config->binding_table);
 
 	free(config->config_path);
+	free(config->input_record_path);
+	free(config->input_replay_path);
+	free(config->protocol_record_path);
 	free(config);
 }
 
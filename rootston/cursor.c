@@ -2,6 +2,9 @@
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <wlr/backend/drm.h>
+#include <wlr/backend/libinput.h>
+#include <wlr/backend/multi.h>
 #include <wlr/types/wlr_region.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/util/edges.h>
@@ -31,6 +34,155 @@ void roots_cursor_destroy(struct roots_cursor *cursor) {
 	// TODO
 }
 
+static void roots_cursor_publish_fast_path(struct roots_cursor *cursor) {
+	if (!cursor->fast_path_enabled) {
+		return;
+	}
+
+	struct wlr_output_layout *layout =
+		cursor->seat->input->server->desktop->layout;
+	struct wlr_output *output = NULL;
+	// The main loop must handle constrained motion itself
+	if (cursor->active_constraint == NULL) {
+		output = wlr_output_layout_output_at(layout,
+			cursor->cursor->x, cursor->cursor->y);
+	}
+	if (output != NULL && !wlr_output_is_drm(output)) {
+		output = NULL;
+	}
+
+	pthread_mutex_lock(&cursor->fast_path.lock);
+	cursor->fast_path.output = output;
+	if (output != NULL) {
+		cursor->fast_path.box = *wlr_output_layout_get_box(layout, output);
+		cursor->fast_path.scale = output->scale;
+		cursor->fast_path.x = cursor->cursor->x;
+		cursor->fast_path.y = cursor->cursor->y;
+	}
+	pthread_mutex_unlock(&cursor->fast_path.lock);
+}
+
+// Called with the fast path lock held
+static bool fast_path_device_is_mapped(struct roots_cursor *cursor,
+		struct libinput_device *device) {
+	if (cursor->fast_path.cursor_mapped) {
+		return true;
+	}
+	struct libinput_device **mapped;
+	wl_array_for_each(mapped, &cursor->fast_path.mapped_devices) {
+		if (*mapped == device) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Called from the libinput thread
+static void fast_path_handle_motion(
+		const struct wlr_libinput_motion_event *event, void *data) {
+	struct roots_cursor *cursor = data;
+
+	pthread_mutex_lock(&cursor->fast_path.lock);
+	struct wlr_output *output = cursor->fast_path.output;
+	if (output != NULL && !fast_path_device_is_mapped(cursor, event->device)) {
+		// Crossing to another output is left to the main loop
+		struct wlr_box *box = &cursor->fast_path.box;
+		double x = cursor->fast_path.x + event->delta_x;
+		double y = cursor->fast_path.y + event->delta_y;
+		x = fmax(box->x, fmin(x, box->x + box->width - 1));
+		y = fmax(box->y, fmin(y, box->y + box->height - 1));
+		cursor->fast_path.x = x;
+		cursor->fast_path.y = y;
+
+		float scale = cursor->fast_path.scale;
+		wlr_drm_connector_move_cursor_async(output,
+			(x - box->x) * scale, (y - box->y) * scale);
+	}
+	pthread_mutex_unlock(&cursor->fast_path.lock);
+}
+
+static void handle_layout_change(struct wl_listener *listener, void *data) {
+	struct roots_cursor *cursor =
+		wl_container_of(listener, cursor, layout_change);
+	// Also drops outputs being destroyed
+	roots_cursor_publish_fast_path(cursor);
+}
+
+static void find_libinput_backend(struct wlr_backend *backend, void *data) {
+	struct wlr_backend **libinput = data;
+	if (wlr_backend_is_libinput(backend)) {
+		*libinput = backend;
+	}
+}
+
+void roots_cursor_init_fast_path(struct roots_cursor *cursor) {
+	struct roots_server *server = cursor->seat->input->server;
+	struct wlr_backend *libinput = NULL;
+	if (wlr_backend_is_multi(server->backend)) {
+		wlr_multi_for_each_backend(server->backend, find_libinput_backend,
+			&libinput);
+	}
+	if (libinput == NULL) {
+		wlr_log(WLR_ERROR, "Cursor fast path requires the libinput backend");
+		return;
+	}
+
+	pthread_mutex_init(&cursor->fast_path.lock, NULL);
+	wl_array_init(&cursor->fast_path.mapped_devices);
+	cursor->fast_path_enabled = true;
+
+	cursor->layout_change.notify = handle_layout_change;
+	wl_signal_add(&server->desktop->layout->events.change,
+		&cursor->layout_change);
+
+	wlr_libinput_backend_set_motion_handler(libinput,
+		fast_path_handle_motion, cursor);
+}
+
+static bool device_is_mapped(struct roots_config *config,
+		struct wlr_input_device *device) {
+	struct roots_device_config *dconfig =
+		roots_config_get_device(config, device);
+	if (dconfig != NULL &&
+			(dconfig->mapped_output != NULL || dconfig->mapped_box != NULL)) {
+		return true;
+	}
+	return device->output_name != NULL;
+}
+
+void roots_cursor_update_fast_path_devices(struct roots_cursor *cursor) {
+	if (!cursor->fast_path_enabled) {
+		return;
+	}
+
+	struct roots_seat *seat = cursor->seat;
+	struct roots_config *config = seat->input->config;
+	struct roots_cursor_config *cc =
+		roots_config_get_cursor(config, seat->seat->name);
+
+	pthread_mutex_lock(&cursor->fast_path.lock);
+	cursor->fast_path.cursor_mapped = cc != NULL &&
+		(cc->mapped_output != NULL || cc->mapped_box != NULL);
+	cursor->fast_path.mapped_devices.size = 0;
+	struct roots_pointer *pointer;
+	wl_list_for_each(pointer, &seat->pointers, link) {
+		if (!wlr_input_device_is_libinput(pointer->device) ||
+				!device_is_mapped(config, pointer->device)) {
+			continue;
+		}
+		struct libinput_device **mapped =
+			wl_array_add(&cursor->fast_path.mapped_devices, sizeof(*mapped));
+		if (mapped == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			// Skip all devices rather than moving a mapped one
+			cursor->fast_path.cursor_mapped = true;
+			break;
+		}
+		*mapped = wlr_libinput_get_device_handle(pointer->device);
+	}
+	pthread_mutex_unlock(&cursor->fast_path.lock);
+}
+
 static void seat_view_deco_motion(struct roots_seat_view *view,
 		double deco_sx, double deco_sy) {
 	struct roots_cursor *cursor = view->seat->cursor;
@@ -167,69 +319,102 @@ void roots_cursor_update_focus(struct roots_cursor *cursor) {
 	roots_passthrough_cursor(cursor, timespec_to_msec(&now));
 }
 
-void roots_cursor_update_position(struct roots_cursor *cursor,
-		uint32_t time) {
-	struct roots_seat *seat = cursor->seat;
-	struct roots_view *view;
+void roots_cursor_apply_grab(struct roots_cursor *cursor) {
+	if (!cursor->grab_pending) {
+		return;
+	}
+	cursor->grab_pending = false;
+
+	struct roots_view *view = roots_seat_get_focus(cursor->seat);
+	if (view == NULL) {
+		return;
+	}
+
+	double dx = cursor->cursor->x - cursor->offs_x;
+	double dy = cursor->cursor->y - cursor->offs_y;
 	switch (cursor->mode) {
 	case ROOTS_CURSOR_PASSTHROUGH:
-		roots_passthrough_cursor(cursor, time);
 		break;
 	case ROOTS_CURSOR_MOVE:
-		view = roots_seat_get_focus(seat);
-		if (view != NULL) {
-			double dx = cursor->cursor->x - cursor->offs_x;
-			double dy = cursor->cursor->y - cursor->offs_y;
-			view_move(view, cursor->view_x + dx,
-				cursor->view_y + dy);
-		}
+		view_move(view, cursor->view_x + dx,
+			cursor->view_y + dy);
 		break;
-	case ROOTS_CURSOR_RESIZE:
-		view = roots_seat_get_focus(seat);
-		if (view != NULL) {
-			double dx = cursor->cursor->x - cursor->offs_x;
-			double dy = cursor->cursor->y - cursor->offs_y;
-			double x = view->box.x;
-			double y = view->box.y;
-			int width = cursor->view_width;
-			int height = cursor->view_height;
-			if (cursor->resize_edges & WLR_EDGE_TOP) {
-				y = cursor->view_y + dy;
-				height -= dy;
-				if (height < 1) {
-					y += height;
-				}
-			} else if (cursor->resize_edges & WLR_EDGE_BOTTOM) {
-				height += dy;
+	case ROOTS_CURSOR_RESIZE: {
+		double x = view->box.x;
+		double y = view->box.y;
+		int width = cursor->view_width;
+		int height = cursor->view_height;
+		if (cursor->resize_edges & WLR_EDGE_TOP) {
+			y = cursor->view_y + dy;
+			height -= dy;
+			if (height < 1) {
+				y += height;
 			}
-			if (cursor->resize_edges & WLR_EDGE_LEFT) {
-				x = cursor->view_x + dx;
-				width -= dx;
-				if (width < 1) {
-					x += width;
-				}
-			} else if (cursor->resize_edges & WLR_EDGE_RIGHT) {
-				width += dx;
+		} else if (cursor->resize_edges & WLR_EDGE_BOTTOM) {
+			height += dy;
+		}
+		if (cursor->resize_edges & WLR_EDGE_LEFT) {
+			x = cursor->view_x + dx;
+			width -= dx;
+			if (width < 1) {
+				x += width;
 			}
-			view_move_resize(view, x, y,
-					width < 1 ? 1 : width,
-					height < 1 ? 1 : height);
+		} else if (cursor->resize_edges & WLR_EDGE_RIGHT) {
+			width += dx;
 		}
+		view_move_resize(view, x, y,
+				width < 1 ? 1 : width,
+				height < 1 ? 1 : height);
 		break;
+	}
+	case ROOTS_CURSOR_ROTATE: {
+		int ox = view->box.x + view->wlr_surface->current.width/2,
+			oy = view->box.y + view->wlr_surface->current.height/2;
+		int ux = cursor->offs_x - ox,
+			uy = cursor->offs_y - oy;
+		int vx = cursor->cursor->x - ox,
+			vy = cursor->cursor->y - oy;
+		float angle = atan2(ux*vy - uy*vx, vx*ux + vy*uy);
+		int steps = 12;
+		angle = round(angle/M_PI*steps) / (steps/M_PI);
+		view_rotate(view, cursor->view_rotation + angle);
+		break;
+	}
+	}
+}
+
+// Grabs are applied by the next frame of an output showing the view, so that
+// the view is moved, damaged and configured once per frame however fast the
+// pointer reports motion
+static void roots_cursor_queue_grab(struct roots_cursor *cursor) {
+	struct roots_view *view = roots_seat_get_focus(cursor->seat);
+	if (view == NULL) {
+		return;
+	}
+
+	cursor->grab_pending = true;
+	if (wl_list_empty(&view->outputs)) {
+		roots_cursor_apply_grab(cursor);
+		return;
+	}
+
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &view->outputs, view_link) {
+		wlr_output_schedule_frame(view_output->output->wlr_output);
+	}
+}
+
+void roots_cursor_update_position(struct roots_cursor *cursor,
+		uint32_t time) {
+	roots_cursor_publish_fast_path(cursor);
+	switch (cursor->mode) {
+	case ROOTS_CURSOR_PASSTHROUGH:
+		roots_passthrough_cursor(cursor, time);
+		break;
+	case ROOTS_CURSOR_MOVE:
+	case ROOTS_CURSOR_RESIZE:
 	case ROOTS_CURSOR_ROTATE:
-		view = roots_seat_get_focus(seat);
-		if (view != NULL) {
-			int ox = view->box.x + view->wlr_surface->current.width/2,
-				oy = view->box.y + view->wlr_surface->current.height/2;
-			int ux = cursor->offs_x - ox,
-				uy = cursor->offs_y - oy;
-			int vx = cursor->cursor->x - ox,
-				vy = cursor->cursor->y - oy;
-			float angle = atan2(ux*vy - uy*vx, vx*ux + vy*uy);
-			int steps = 12;
-			angle = round(angle/M_PI*steps) / (steps/M_PI);
-			view_rotate(view, cursor->view_rotation + angle);
-		}
+		roots_cursor_queue_grab(cursor);
 		break;
 	}
 }
@@ -282,6 +467,8 @@ static void roots_cursor_press_button(struct roots_cursor *cursor,
 
 		if (state == WLR_BUTTON_RELEASED &&
 				cursor->mode != ROOTS_CURSOR_PASSTHROUGH) {
+			// The view ends up where the pointer was released
+			roots_cursor_apply_grab(cursor);
 			cursor->mode = ROOTS_CURSOR_PASSTHROUGH;
 		}
 
@@ -304,6 +491,27 @@ static void roots_cursor_press_button(struct roots_cursor *cursor,
 	}
 }
 
+static void roots_cursor_notify_input(struct roots_cursor *cursor,
+		uint64_t time_usec) {
+	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
+	if (desktop->work_queue != NULL) {
+		wlr_work_queue_notify_input(desktop->work_queue);
+	}
+
+	struct wlr_surface *surface =
+		cursor->seat->seat->pointer_state.focused_surface;
+	if (desktop->input_latency == NULL || surface == NULL) {
+		return;
+	}
+
+	struct wlr_output *output = wlr_output_layout_output_at(desktop->layout,
+		cursor->cursor->x, cursor->cursor->y);
+	if (output != NULL) {
+		wlr_input_latency_tracker_notify_input(desktop->input_latency,
+			surface, output, time_usec);
+	}
+}
+
 void roots_cursor_handle_motion(struct roots_cursor *cursor,
 		struct wlr_event_pointer_motion *event) {
 	double dx = event->delta_x;
@@ -314,7 +522,7 @@ void roots_cursor_handle_motion(struct roots_cursor *cursor,
 
 	wlr_relative_pointer_manager_v1_send_relative_motion(
 		cursor->seat->input->server->desktop->relative_pointer_manager,
-		cursor->seat->seat, (uint64_t)event->time_msec * 1000, dx, dy,
+		cursor->seat->seat, event->time_usec, dx, dy,
 		dx_unaccel, dy_unaccel);
 
 	if (cursor->active_constraint) {
@@ -336,8 +544,8 @@ void roots_cursor_handle_motion(struct roots_cursor *cursor,
 			double sy2 = ly2 - view->box.y;
 
 			double sx2_confined, sy2_confined;
-			if (!wlr_region_confine(&cursor->confine, sx1, sy1, sx2, sy2,
-					&sx2_confined, &sy2_confined)) {
+			if (!wlr_region_index_confine(&cursor->confine_index,
+					sx1, sy1, sx2, sy2, &sx2_confined, &sy2_confined)) {
 				return;
 			}
 
@@ -348,6 +556,7 @@ void roots_cursor_handle_motion(struct roots_cursor *cursor,
 
 	wlr_cursor_move(cursor->cursor, event->device, dx, dy);
 	roots_cursor_update_position(cursor, event->time_msec);
+	roots_cursor_notify_input(cursor, event->time_usec);
 }
 
 void roots_cursor_handle_motion_absolute(struct roots_cursor *cursor,
@@ -360,13 +569,13 @@ void roots_cursor_handle_motion_absolute(struct roots_cursor *cursor,
 	double dy = ly - cursor->cursor->y;
 	wlr_relative_pointer_manager_v1_send_relative_motion(
 		cursor->seat->input->server->desktop->relative_pointer_manager,
-		cursor->seat->seat, (uint64_t)event->time_msec * 1000, dx, dy, dx, dy);
+		cursor->seat->seat, event->time_usec, dx, dy, dx, dy);
 
 	if (cursor->pointer_view) {
 		struct roots_view *view = cursor->pointer_view->view;
 
 		if (cursor->active_constraint &&
-				!pixman_region32_contains_point(&cursor->confine,
+				!wlr_region_index_contains_point(&cursor->confine_index,
 					floor(lx - view->box.x), floor(ly - view->box.y), NULL)) {
 			return;
 		}
@@ -374,18 +583,21 @@ void roots_cursor_handle_motion_absolute(struct roots_cursor *cursor,
 
 	wlr_cursor_warp_closest(cursor->cursor, event->device, lx, ly);
 	roots_cursor_update_position(cursor, event->time_msec);
+	roots_cursor_notify_input(cursor, event->time_usec);
 }
 
 void roots_cursor_handle_button(struct roots_cursor *cursor,
 		struct wlr_event_pointer_button *event) {
 	roots_cursor_press_button(cursor, event->device, event->time_msec,
 		event->button, event->state, cursor->cursor->x, cursor->cursor->y);
+	roots_cursor_notify_input(cursor, event->time_usec);
 }
 
 void roots_cursor_handle_axis(struct roots_cursor *cursor,
 		struct wlr_event_pointer_axis *event) {
 	wlr_seat_pointer_notify_axis(cursor->seat->seat, event->time_msec,
 		event->orientation, event->delta, event->delta_discrete, event->source);
+	roots_cursor_notify_input(cursor, event->time_usec);
 }
 
 void roots_cursor_handle_frame(struct roots_cursor *cursor) {
@@ -468,6 +680,10 @@ void roots_cursor_handle_touch_motion(struct roots_cursor *cursor,
 	}
 }
 
+void roots_cursor_handle_touch_frame(struct roots_cursor *cursor) {
+	wlr_seat_touch_notify_frame(cursor->seat->seat);
+}
+
 void roots_cursor_handle_tool_axis(struct roots_cursor *cursor,
 		struct wlr_event_tablet_tool_axis *event) {
 	double x = NAN, y = NAN;
@@ -490,7 +706,7 @@ void roots_cursor_handle_tool_axis(struct roots_cursor *cursor,
 		struct roots_view *view = cursor->pointer_view->view;
 
 		if (cursor->active_constraint &&
-				!pixman_region32_contains_point(&cursor->confine,
+				!wlr_region_index_contains_point(&cursor->confine_index,
 					floor(lx - view->box.x), floor(ly - view->box.y), NULL)) {
 			return;
 		}
@@ -546,6 +762,18 @@ void roots_cursor_handle_focus_change(struct roots_cursor *cursor,
 		sx, sy);
 }
 
+// Copies the region of the active constraint and rebuilds its index, which
+// motion events query instead of the region
+static void roots_cursor_update_confine(struct roots_cursor *cursor) {
+	pixman_region32_clear(&cursor->confine);
+	// A locked pointer will result in an empty region, thus disallowing all movement
+	if (cursor->active_constraint->type == WLR_POINTER_CONSTRAINT_V1_CONFINED) {
+		pixman_region32_copy(&cursor->confine,
+			&cursor->active_constraint->region);
+	}
+	wlr_region_index_update(&cursor->confine_index, &cursor->confine);
+}
+
 void roots_cursor_handle_constraint_commit(struct roots_cursor *cursor) {
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 
@@ -559,6 +787,8 @@ void roots_cursor_handle_constraint_commit(struct roots_cursor *cursor) {
 		roots_cursor_update_focus(cursor);
 	} else {
 		roots_cursor_constrain(cursor, cursor->active_constraint, sx, sy);
+		// The region may have changed with the commit
+		roots_cursor_update_confine(cursor);
 	}
 }
 
@@ -589,8 +819,12 @@ void roots_cursor_constrain(struct roots_cursor *cursor,
 	}
 
 	cursor->active_constraint = constraint;
+	roots_cursor_publish_fast_path(cursor);
 
 	if (constraint == NULL) {
+		// Don't keep the previous constraint's region around
+		pixman_region32_clear(&cursor->confine);
+		wlr_region_index_finish(&cursor->confine_index);
 		return;
 	}
 
@@ -601,8 +835,6 @@ void roots_cursor_constrain(struct roots_cursor *cursor,
 		&cursor->constraint_commit);
 	cursor->constraint_commit.notify = handle_constraint_commit;
 
-	pixman_region32_clear(&cursor->confine);
-
 	pixman_region32_t *region = &constraint->region;
 
 	if (!pixman_region32_contains_point(region, floor(sx), floor(sy), NULL)) {
@@ -625,8 +857,5 @@ void roots_cursor_constrain(struct roots_cursor *cursor,
 		}
 	}
 
-	// A locked pointer will result in an empty region, thus disallowing all movement
-	if (constraint->type == WLR_POINTER_CONSTRAINT_V1_CONFINED) {
-		pixman_region32_copy(&cursor->confine, region);
-	}
+	roots_cursor_update_confine(cursor);
 }
@@ -8,6 +8,7 @@
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_control_v1.h>
+#include <wlr/types/wlr_drm_lease_v1.h>
 #include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_gamma_control.h>
@@ -99,9 +100,31 @@ static bool view_at(struct roots_view *view, double lx, double ly,
 	return false;
 }
 
+struct view_at_data {
+	struct wlr_surface **surface;
+	double *sx, *sy;
+};
+
+static bool view_index_accept(struct wlr_spatial_index_entry *entry,
+		double lx, double ly, void *_data) {
+	struct view_at_data *data = _data;
+	return view_at(entry->data, lx, ly, data->surface, data->sx, data->sy);
+}
+
 static struct roots_view *desktop_view_at(struct roots_desktop *desktop,
 		double lx, double ly, struct wlr_surface **surface,
 		double *sx, double *sy) {
+	if (desktop->view_index != NULL) {
+		struct view_at_data data = {
+			.surface = surface,
+			.sx = sx,
+			.sy = sy,
+		};
+		struct wlr_spatial_index_entry *entry = wlr_spatial_index_at(
+			desktop->view_index, lx, ly, view_index_accept, &data);
+		return entry != NULL ? entry->data : NULL;
+	}
+
 	struct roots_view *view;
 	wl_list_for_each(view, &desktop->views, link) {
 		if (view_at(view, lx, ly, surface, sx, sy)) {
@@ -212,6 +235,8 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 		view_get_box(view, &box);
 
 		if (wlr_output_layout_intersects(desktop->layout, NULL, &box)) {
+			// Outputs may have moved under the view
+			view_update_bounds(view);
 			continue;
 		}
 
@@ -294,6 +319,30 @@ static void handle_pointer_constraint(struct wl_listener *listener,
 	}
 }
 
+static void handle_drm_lease_request(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_lease_request_v1 *request = data;
+	// Only outputs configured for leasing are offered, grant them all
+	wlr_drm_lease_request_v1_grant(request);
+}
+
+#if WLR_HAS_XWAYLAND
+static void handle_xwayland_ready(struct wl_listener *listener, void *data) {
+	struct roots_desktop *desktop =
+		wl_container_of(listener, desktop, xwayland_ready);
+	struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(
+		desktop->xcursor_manager, desktop->xwayland_cursor, 1);
+	if (xcursor == NULL) {
+		wlr_log(WLR_ERROR, "Cannot load XWayland XCursor theme");
+	} else {
+		struct wlr_xcursor_image *image = xcursor->images[0];
+		wlr_xwayland_set_cursor(desktop->xwayland, image->buffer,
+			image->width * 4, image->width, image->height, image->hotspot_x,
+			image->hotspot_y);
+	}
+}
+#endif
+
 struct roots_desktop *desktop_create(struct roots_server *server,
 		struct roots_config *config) {
 	wlr_log(WLR_DEBUG, "Initializing roots desktop");
@@ -306,6 +355,12 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 	wl_list_init(&desktop->views);
 	wl_list_init(&desktop->outputs);
 
+	desktop->view_index = wlr_spatial_index_create(0);
+	if (desktop->view_index == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create view index, "
+			"falling back to searching all views");
+	}
+
 	desktop->new_output.notify = handle_new_output;
 	wl_signal_add(&server->backend->events.new_output, &desktop->new_output);
 
@@ -319,6 +374,8 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 
 	desktop->compositor = wlr_compositor_create(server->wl_display,
 		server->renderer);
+	wlr_compositor_set_texture_eviction(desktop->compositor,
+		config->texture_eviction_timeout * 1000);
 
 	desktop->xdg_shell_v6 = wlr_xdg_shell_v6_create(server->wl_display);
 	wl_signal_add(&desktop->xdg_shell_v6->events.new_surface,
@@ -378,23 +435,21 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 	if (config->xwayland) {
 		desktop->xwayland = wlr_xwayland_create(server->wl_display,
 			desktop->compositor, config->xwayland_lazy);
+		desktop->xwayland_prewarm =
+			config->xwayland_lazy && config->xwayland_prewarm;
 		wl_signal_add(&desktop->xwayland->events.new_surface,
 			&desktop->xwayland_surface);
 		desktop->xwayland_surface.notify = handle_xwayland_surface;
 
+		// The cursor theme is only loaded once Xwayland is up
+		desktop->xwayland_cursor = cursor_default;
+		wl_signal_add(&desktop->xwayland->events.ready,
+			&desktop->xwayland_ready);
+		desktop->xwayland_ready.notify = handle_xwayland_ready;
+
 		setenv("DISPLAY", desktop->xwayland->display_name, true);
 
-		if (wlr_xcursor_manager_load(desktop->xcursor_manager, 1)) {
-			wlr_log(WLR_ERROR, "Cannot load XWayland XCursor theme");
-		}
-		struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(
-			desktop->xcursor_manager, cursor_default, 1);
-		if (xcursor != NULL) {
-			struct wlr_xcursor_image *image = xcursor->images[0];
-			wlr_xwayland_set_cursor(desktop->xwayland, image->buffer,
-				image->width * 4, image->width, image->height, image->hotspot_x,
-				image->hotspot_y);
-		}
+		wlr_xcursor_manager_load(desktop->xcursor_manager, 1);
 	}
 #endif
 
@@ -402,6 +457,13 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 		server->wl_display);
 	desktop->gamma_control_manager_v1 = wlr_gamma_control_manager_v1_create(
 		server->wl_display);
+	desktop->drm_lease_manager = wlr_drm_lease_v1_manager_create(
+		server->wl_display, server->backend);
+	if (desktop->drm_lease_manager != NULL) {
+		desktop->drm_lease_request.notify = handle_drm_lease_request;
+		wl_signal_add(&desktop->drm_lease_manager->events.request,
+			&desktop->drm_lease_request);
+	}
 	desktop->screenshooter = wlr_screenshooter_create(server->wl_display);
 	desktop->export_dmabuf_manager_v1 =
 		wlr_export_dmabuf_manager_v1_create(server->wl_display);
@@ -452,13 +514,28 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 		wlr_presentation_create(server->wl_display, server->backend);
 	desktop->foreign_toplevel_manager_v1 =
 		wlr_foreign_toplevel_manager_v1_create(server->wl_display);
+	// Taskbars don't need to follow title animations at the frame rate
+	wlr_foreign_toplevel_manager_v1_set_update_rate(
+		desktop->foreign_toplevel_manager_v1, 10);
 	desktop->relative_pointer_manager =
 		wlr_relative_pointer_manager_v1_create(server->wl_display);
 	desktop->pointer_gestures =
 		wlr_pointer_gestures_v1_create(server->wl_display);
+	desktop->viewporter = wlr_viewporter_create(server->wl_display);
+	desktop->linux_dmabuf = wlr_linux_dmabuf_v1_from_display(server->wl_display);
+
+	if (config->track_input_latency) {
+		desktop->input_latency = wlr_input_latency_tracker_create();
+	}
+	desktop->work_queue = wlr_work_queue_get(server->wl_display);
 
 	wlr_primary_selection_v1_device_manager_create(server->wl_display);
-	wlr_data_control_manager_v1_create(server->wl_display);
+	struct wlr_data_control_manager_v1 *data_control =
+		wlr_data_control_manager_v1_create(server->wl_display);
+	if (data_control != NULL) {
+		wlr_data_control_manager_v1_set_selection_cache(data_control,
+			4 * 1024 * 1024);
+	}
 
 	return desktop;
 }
@@ -69,6 +69,10 @@ static void handle_new_input(struct wl_listener *listener, void *data) {
 
 	roots_seat_add_device(seat, device);
 
+	if (input->recorder != NULL) {
+		wlr_input_recorder_add_device(input->recorder, device);
+	}
+
 	if (dc && wlr_input_device_is_libinput(device)) {
 		struct libinput_device *libinput_dev =
 			wlr_libinput_get_device_handle(device);
@@ -96,6 +100,16 @@ struct roots_input *input_create(struct roots_server *server,
 
 	wl_list_init(&input->seats);
 
+	if (config->input_record_path != NULL) {
+		input->record_file = fopen(config->input_record_path, "w");
+		if (input->record_file == NULL) {
+			wlr_log_errno(WLR_ERROR, "Failed to open %s",
+				config->input_record_path);
+		} else {
+			input->recorder = wlr_input_recorder_create(input->record_file);
+		}
+	}
+
 	input->new_input.notify = handle_new_input;
 	wl_signal_add(&server->backend->events.new_input, &input->new_input);
 
@@ -103,7 +117,50 @@ struct roots_input *input_create(struct roots_server *server,
 }
 
 void input_destroy(struct roots_input *input) {
-	// TODO
+	// TODO: destroy the seats and free the input
+	if (input->motion_idle != NULL) {
+		wl_event_source_remove(input->motion_idle);
+		input->motion_idle = NULL;
+	}
+	wlr_input_recorder_destroy(input->recorder);
+	input->recorder = NULL;
+	if (input->record_file != NULL) {
+		fclose(input->record_file);
+		input->record_file = NULL;
+	}
+}
+
+static void input_handle_motion_idle(void *data) {
+	struct roots_input *input = data;
+	input->motion_idle = NULL;
+
+	// Seats take turns being flushed first, so that a seat with a lot of
+	// motion to process doesn't always delay the same other seats
+	int n_seats = wl_list_length(&input->seats);
+	if (n_seats == 0) {
+		return;
+	}
+	int first = input->motion_round++ % n_seats;
+	for (int pass = 0; pass < 2; ++pass) {
+		int i = 0;
+		struct roots_seat *seat;
+		wl_list_for_each(seat, &input->seats, link) {
+			if ((pass == 0) == (i >= first)) {
+				roots_seat_flush_motion(seat);
+			}
+			++i;
+		}
+	}
+}
+
+void input_schedule_motion_flush(struct roots_input *input) {
+	if (input->motion_idle != NULL) {
+		return;
+	}
+	struct wl_event_loop *ev =
+		wl_display_get_event_loop(input->server->wl_display);
+	input->motion_idle =
+		wl_event_loop_add_idle(ev, input_handle_motion_idle, input);
 }
 
 struct roots_seat *input_seat_from_wlr_seat(struct roots_input *input,
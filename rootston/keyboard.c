@@ -24,16 +24,6 @@ static ssize_t pressed_keysyms_index(xkb_keysym_t *pressed_keysyms,
 	return -1;
 }
 
-static size_t pressed_keysyms_length(xkb_keysym_t *pressed_keysyms) {
-	size_t n = 0;
-	for (size_t i = 0; i < ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP; ++i) {
-		if (pressed_keysyms[i] != XKB_KEY_NoSymbol) {
-			++n;
-		}
-	}
-	return n;
-}
-
 static void pressed_keysyms_add(xkb_keysym_t *pressed_keysyms,
 		xkb_keysym_t keysym) {
 	ssize_t i = pressed_keysyms_index(pressed_keysyms, keysym);
@@ -137,27 +127,11 @@ static bool keyboard_execute_binding(struct roots_keyboard *keyboard,
 	}
 
 	// User-defined bindings
-	size_t n = pressed_keysyms_length(pressed_keysyms);
-	struct wl_list *bindings = &keyboard->input->server->config->bindings;
-	struct roots_binding_config *bc;
-	wl_list_for_each(bc, bindings, link) {
-		if (modifiers ^ bc->modifiers || n != bc->keysyms_len) {
-			continue;
-		}
-
-		bool ok = true;
-		for (size_t i = 0; i < bc->keysyms_len; i++) {
-			ssize_t j = pressed_keysyms_index(pressed_keysyms, bc->keysyms[i]);
-			if (j < 0) {
-				ok = false;
-				break;
-			}
-		}
-
-		if (ok) {
-			keyboard_binding_execute(keyboard, bc->command);
-			return true;
-		}
+	struct roots_binding_config *bc = roots_config_get_binding(
+		keyboard->input->server->config, modifiers, pressed_keysyms);
+	if (bc != NULL) {
+		keyboard_binding_execute(keyboard, bc->command);
+		return true;
 	}
 
 	return false;
@@ -208,6 +182,11 @@ void roots_keyboard_handle_key(struct roots_keyboard *keyboard,
 		struct wlr_event_keyboard_key *event) {
 	xkb_keycode_t keycode = event->keycode + 8;
 
+	struct roots_desktop *desktop = keyboard->input->server->desktop;
+	if (desktop->work_queue != NULL) {
+		wlr_work_queue_notify_input(desktop->work_queue);
+	}
+
 	bool handled = false;
 	uint32_t modifiers;
 	const xkb_keysym_t *keysyms;
@@ -317,24 +296,11 @@ struct roots_keyboard *roots_keyboard_create(struct wlr_input_device *device,
 	rules.layout = config->layout;
 	rules.variant = config->variant;
 	rules.options = config->options;
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	if (context == NULL) {
-		wlr_log(WLR_ERROR, "Cannot create XKB context");
-		return NULL;
-	}
-
-	struct xkb_keymap *keymap = xkb_map_new_from_names(context, &rules,
-		XKB_KEYMAP_COMPILE_NO_FLAGS);
-	if (keymap == NULL) {
-		xkb_context_unref(context);
+	if (!wlr_keyboard_set_keymap_from_names(device->keyboard, &rules)) {
 		wlr_log(WLR_ERROR, "Cannot create XKB keymap");
 		return NULL;
 	}
 
-	wlr_keyboard_set_keymap(device->keyboard, keymap);
-	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
-
 	int repeat_rate = (config->repeat_rate > 0) ? config->repeat_rate : 25;
 	int repeat_delay = (config->repeat_delay > 0) ? config->repeat_delay : 600;
 	wlr_keyboard_set_repeat_info(device->keyboard, repeat_rate, repeat_delay);
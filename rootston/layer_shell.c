@@ -214,12 +214,16 @@ void arrange_layers(struct roots_output *output) {
 	arrange_layer(output->wlr_output, &output->desktop->server->input->seats,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND],
 			&usable_area, true);
-	memcpy(&output->usable_area, &usable_area, sizeof(struct wlr_box));
-
-	struct roots_view *view;
-	wl_list_for_each(view, &output->desktop->views, link) {
-		if (view->maximized) {
-			view_arrange_maximized(view);
+	if (memcmp(&output->usable_area, &usable_area,
+			sizeof(struct wlr_box)) != 0) {
+		memcpy(&output->usable_area, &usable_area, sizeof(struct wlr_box));
+
+		// Maximized views only depend on the usable area
+		struct roots_view *view;
+		wl_list_for_each(view, &output->desktop->views, link) {
+			if (view->maximized) {
+				view_arrange_maximized(view);
+			}
 		}
 	}
 
@@ -281,7 +285,12 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 	if (wlr_output != NULL) {
 		struct roots_output *output = wlr_output->data;
 		struct wlr_box old_geo = layer->geo;
-		arrange_layers(output);
+		// Panels redrawing their contents don't need to be arranged again
+		if (layer_surface->current_changed &
+				(WLR_LAYER_SURFACE_V1_STATE_LAYOUT |
+				WLR_LAYER_SURFACE_V1_STATE_KEYBOARD_INTERACTIVE)) {
+			arrange_layers(output);
+		}
 
 		// Cursor changes which happen as a consequence of resizing a layer
 		// surface are applied in arrange_layers. Because the resize happens
@@ -8,6 +8,8 @@
 #include <wlr/backend/multi.h>
 #include <wlr/config.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_input_recorder.h>
+#include <wlr/types/wlr_protocol_recorder.h>
 #include <wlr/util/log.h>
 #include "rootston/config.h"
 #include "rootston/server.h"
@@ -21,12 +23,42 @@ int main(int argc, char **argv) {
 	server.wl_event_loop = wl_display_get_event_loop(server.wl_display);
 	assert(server.config && server.wl_display && server.wl_event_loop);
 
+	FILE *protocol_record_file = NULL;
+	if (server.config->protocol_record_path != NULL) {
+		const char *path = server.config->protocol_record_path;
+		struct wlr_protocol_recorder *recorder = NULL;
+		protocol_record_file = fopen(path, "w");
+		if (protocol_record_file == NULL) {
+			wlr_log_errno(WLR_ERROR, "Failed to open %s", path);
+		} else {
+			recorder = wlr_protocol_recorder_create(server.wl_display,
+				protocol_record_file);
+		}
+		if (recorder != NULL) {
+			recorder->hash_buffers = server.config->protocol_record_buffers;
+		} else {
+			wlr_log(WLR_ERROR, "Failed to record Wayland requests to %s",
+				path);
+		}
+	}
+
 	server.backend = wlr_backend_autocreate(server.wl_display, NULL);
 	if (server.backend == NULL) {
 		wlr_log(WLR_ERROR, "could not start backend");
 		return 1;
 	}
 
+	struct wlr_backend *replay_backend = NULL;
+	if (server.config->input_replay_path != NULL) {
+		// Replayed input devices are added to their own headless backend
+		replay_backend = wlr_headless_backend_create(server.wl_display, NULL);
+		if (replay_backend == NULL ||
+				!wlr_multi_backend_add(server.backend, replay_backend)) {
+			wlr_log(WLR_ERROR, "could not create input replay backend");
+			return 1;
+		}
+	}
+
 	server.renderer = wlr_backend_get_renderer(server.backend);
 	assert(server.renderer);
 	server.data_device_manager =
@@ -53,6 +85,19 @@ int main(int argc, char **argv) {
 	}
 
 	setenv("WAYLAND_DISPLAY", socket, true);
+
+	FILE *replay_file = NULL;
+	if (replay_backend != NULL) {
+		const char *path = server.config->input_replay_path;
+		replay_file = fopen(path, "r");
+		if (replay_file == NULL) {
+			wlr_log_errno(WLR_ERROR, "Failed to open %s", path);
+		} else if (wlr_input_replay_create(replay_backend,
+				server.wl_event_loop, replay_file,
+				server.config->input_replay_speed) == NULL) {
+			wlr_log(WLR_ERROR, "Failed to replay input from %s", path);
+		}
+	}
 #if WLR_HAS_XWAYLAND
 	if (server.desktop->xwayland != NULL) {
 		struct roots_seat *xwayland_seat =
@@ -78,6 +123,14 @@ int main(int argc, char **argv) {
 	wlr_xwayland_destroy(server.desktop->xwayland);
 #endif
 	wl_display_destroy_clients(server.wl_display);
+	input_destroy(server.input);
 	wl_display_destroy(server.wl_display);
+	if (replay_file != NULL) {
+		fclose(replay_file);
+	}
+	if (protocol_record_file != NULL) {
+		// The recorder is destroyed along with the display
+		fclose(protocol_record_file);
+	}
 	return 0;
 }
@@ -2,9 +2,11 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend/drm.h>
 #include <wlr/config.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_presentation_time.h>
@@ -202,9 +204,10 @@ void output_for_each_surface(struct roots_output *output,
 		}
 #endif
 	} else {
-		struct roots_view *view;
-		wl_list_for_each_reverse(view, &desktop->views, link) {
-			output_view_for_each_surface(output, view, iterator, user_data);
+		struct roots_view_output *view_output;
+		wl_list_for_each_reverse(view_output, &output->views, output_link) {
+			output_view_for_each_surface(output, view_output->view,
+				iterator, user_data);
 		}
 	}
 
@@ -229,19 +232,27 @@ void scale_box(struct wlr_box *box, float scale) {
 	box->y = round(box->y * scale);
 }
 
+// Gets the position of the decoration in layout coordinates once the view is
+// rotated, along with its unrotated box
+static void get_decoration_layout_box(struct roots_view *view,
+		double *x, double *y, struct wlr_box *deco_box) {
+	view_get_deco_box(view, deco_box);
+	double sx = deco_box->x - view->box.x;
+	double sy = deco_box->y - view->box.y;
+	rotate_child_position(&sx, &sy, deco_box->width, deco_box->height,
+		view->wlr_surface->current.width,
+		view->wlr_surface->current.height, view->rotation);
+	*x = sx + view->box.x;
+	*y = sy + view->box.y;
+}
+
 void get_decoration_box(struct roots_view *view,
 		struct roots_output *output, struct wlr_box *box) {
 	struct wlr_output *wlr_output = output->wlr_output;
 
+	double x, y;
 	struct wlr_box deco_box;
-	view_get_deco_box(view, &deco_box);
-	double sx = deco_box.x - view->box.x;
-	double sy = deco_box.y - view->box.y;
-	rotate_child_position(&sx, &sy, deco_box.width, deco_box.height,
-		view->wlr_surface->current.width,
-		view->wlr_surface->current.height, view->rotation);
-	double x = sx + view->box.x;
-	double y = sy + view->box.y;
+	get_decoration_layout_box(view, &x, &y, &deco_box);
 
 	wlr_output_layout_output_coords(output->desktop->layout, wlr_output, &x, &y);
 
@@ -251,7 +262,106 @@ void get_decoration_box(struct roots_view *view,
 	box->height = deco_box.height * wlr_output->scale;
 }
 
+// Gets the box of the view in output buffer coordinates if it is entirely
+// opaque, so that its pixels don't depend on what's below
+bool output_get_view_opaque_box(struct roots_output *output,
+		struct roots_view *view, struct wlr_box *box) {
+	struct wlr_surface *surface = view->wlr_surface;
+	if (surface == NULL || view->alpha != 1.0 || view->rotation != 0.0) {
+		return false;
+	}
+
+	if (view->decorated) {
+		// Decorations are drawn opaque below the whole view
+		get_decoration_box(view, output, box);
+		return true;
+	}
+
+	if (wlr_surface_get_texture(surface) == NULL ||
+			pixman_region32_contains_rectangle(&surface->opaque_region,
+				&(pixman_box32_t){0, 0, surface->current.width,
+				surface->current.height}) != PIXMAN_REGION_IN) {
+		return false;
+	}
+
+	double x = view->box.x, y = view->box.y;
+	wlr_output_layout_output_coords(output->desktop->layout,
+		output->wlr_output, &x, &y);
+	box->x = x;
+	box->y = y;
+	box->width = surface->current.width;
+	box->height = surface->current.height;
+	scale_box(box, output->wlr_output->scale);
+	return true;
+}
+
+void output_begin_view_move(struct roots_output *output,
+		struct roots_view *view) {
+	struct roots_output_move *move = &output->move;
+	if (!output->desktop->config->blit_moved_views || move->invalid) {
+		return;
+	}
+
+	if (move->view == NULL) {
+		if (!output_get_view_opaque_box(output, view, &move->src)) {
+			move->invalid = true;
+			return;
+		}
+		move->view = view;
+	} else if (move->view != view) {
+		// Only the pixels of a single view are copied
+		move->invalid = true;
+		return;
+	}
+	move->moving = true;
+}
+
+void output_end_view_move(struct roots_output *output) {
+	output->move.moving = false;
+}
+
+void output_cancel_view_move(struct roots_output *output,
+		struct roots_view *view) {
+	if (output->move.view == view) {
+		output_reset_view_move(output, true);
+	}
+}
+
+void output_reset_view_move(struct roots_output *output, bool invalid) {
+	struct roots_output_move *move = &output->move;
+	move->view = NULL;
+	move->moving = false;
+	move->invalid = invalid;
+	pixman_region32_clear(&move->damage);
+	pixman_region32_clear(&move->other_damage);
+}
+
+// Content damage is never caused by a move, even if it happens at the same time
+static void output_add_damage(struct roots_output *output,
+		pixman_region32_t *damage, bool content) {
+	struct roots_output_move *move = &output->move;
+	if (output->desktop->config->blit_moved_views && !move->invalid) {
+		pixman_region32_t *region = move->moving && !content ?
+			&move->damage : &move->other_damage;
+		pixman_region32_union(region, region, damage);
+	}
+	wlr_output_damage_add(output->damage, damage);
+}
+
+static void output_add_damage_box(struct roots_output *output,
+		struct wlr_box *box) {
+	struct roots_output_move *move = &output->move;
+	if (output->desktop->config->blit_moved_views && !move->invalid) {
+		pixman_region32_t *region =
+			move->moving ? &move->damage : &move->other_damage;
+		pixman_region32_union_rect(region, region,
+			box->x, box->y, box->width, box->height);
+	}
+	wlr_output_damage_add_box(output->damage, box);
+}
+
 void output_damage_whole(struct roots_output *output) {
+	output->move.invalid = true;
 	wlr_output_damage_add_whole(output->damage);
 }
 
@@ -310,13 +420,13 @@ static void damage_surface_iterator(struct roots_output *output,
 		pixman_region32_translate(&damage, box.x, box.y);
 		wlr_region_rotated_bounds(&damage, &damage, rotation,
 			center_x, center_y);
-		wlr_output_damage_add(output->damage, &damage);
+		output_add_damage(output, &damage, true);
 		pixman_region32_fini(&damage);
 	}
 
 	if (*whole) {
 		wlr_box_rotated_bounds(&box, &box, rotation);
-		wlr_output_damage_add_box(output->damage, &box);
+		output_add_damage_box(output, &box);
 	}
 
 	wlr_output_schedule_frame(output->wlr_output);
@@ -329,18 +439,71 @@ void output_damage_whole_local_surface(struct roots_output *output,
 		damage_surface_iterator, &whole);
 }
 
-static void damage_whole_decoration(struct roots_view *view,
-		struct roots_output *output) {
-	if (!view->decorated || view->wlr_surface == NULL) {
-		return;
+static void damage_decoration_state(struct roots_desktop *desktop,
+		struct roots_view *view) {
+	struct roots_output *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		if (!view_accept_damage(output, view)) {
+			continue;
+		}
+
+		struct wlr_output *wlr_output = output->wlr_output;
+		double x = view->deco_damage.x, y = view->deco_damage.y;
+		wlr_output_layout_output_coords(desktop->layout, wlr_output, &x, &y);
+		struct wlr_box box = {
+			.x = x * wlr_output->scale,
+			.y = y * wlr_output->scale,
+			.width = view->deco_damage.width * wlr_output->scale,
+			.height = view->deco_damage.height * wlr_output->scale,
+		};
+		wlr_box_rotated_bounds(&box, &box, view->deco_damage.rotation);
+
+		struct wlr_box output_box = {0};
+		wlr_output_transformed_resolution(wlr_output,
+			&output_box.width, &output_box.height);
+		struct wlr_box intersection;
+		if (wlr_box_intersection(&intersection, &box, &output_box)) {
+			output_add_damage_box(output, &box);
+		}
 	}
+}
 
-	struct wlr_box box;
-	get_decoration_box(view, output, &box);
+void desktop_damage_view_decoration(struct roots_desktop *desktop,
+		struct roots_view *view, bool visible) {
+	visible = visible && view->decorated && view->wlr_surface != NULL;
 
-	wlr_box_rotated_bounds(&box, &box, view->rotation);
+	double x = 0, y = 0;
+	struct wlr_box deco_box = {0};
+	if (visible) {
+		get_decoration_layout_box(view, &x, &y, &deco_box);
+	}
 
-	wlr_output_damage_add_box(output->damage, &box);
+	if (visible == view->deco_damage.visible && !view->deco_damage.stale &&
+			(!visible || (x == view->deco_damage.x &&
+			y == view->deco_damage.y &&
+			deco_box.width == view->deco_damage.width &&
+			deco_box.height == view->deco_damage.height &&
+			view->rotation == view->deco_damage.rotation &&
+			view->alpha == view->deco_damage.alpha))) {
+		return;
+	}
+
+	if (view->deco_damage.visible) {
+		damage_decoration_state(desktop, view);
+	}
+
+	view->deco_damage.visible = visible;
+	view->deco_damage.stale = false;
+	view->deco_damage.x = x;
+	view->deco_damage.y = y;
+	view->deco_damage.width = deco_box.width;
+	view->deco_damage.height = deco_box.height;
+	view->deco_damage.rotation = view->rotation;
+	view->deco_damage.alpha = view->alpha;
+
+	if (visible) {
+		damage_decoration_state(desktop, view);
+	}
 }
 
 void output_damage_whole_view(struct roots_output *output,
@@ -349,8 +512,6 @@ void output_damage_whole_view(struct roots_output *output,
 		return;
 	}
 
-	damage_whole_decoration(view, output);
-
 	bool whole = true;
 	output_view_for_each_surface(output, view, damage_surface_iterator, &whole);
 }
@@ -369,14 +530,97 @@ void output_damage_from_local_surface(struct roots_output *output,
 		damage_surface_iterator, &whole);
 }
 
-void output_damage_from_view(struct roots_output *output,
-		struct roots_view *view) {
-	if (!view_accept_damage(output, view)) {
+struct layout_damage_data {
+	struct roots_view *view;
+	pixman_region32_t *damage;
+	int min_scale; // smallest buffer scale of the damaged surfaces
+};
+
+static void layout_damage_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *_data) {
+	struct layout_damage_data *data = _data;
+	struct roots_view *view = data->view;
+	if (!wlr_surface_has_buffer(surface) ||
+			!pixman_region32_not_empty(&surface->buffer_damage)) {
 		return;
 	}
 
-	bool whole = false;
-	output_view_for_each_surface(output, view, damage_surface_iterator, &whole);
+	int sw = surface->current.width;
+	int sh = surface->current.height;
+	double _sx = sx + surface->sx;
+	double _sy = sy + surface->sy;
+	rotate_child_position(&_sx, &_sy, sw, sh, view->box.width,
+		view->box.height, view->rotation);
+	int x = view->box.x + _sx;
+	int y = view->box.y + _sy;
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	wlr_surface_get_effective_damage(surface, &damage);
+	pixman_region32_translate(&damage, x, y);
+	wlr_region_rotated_bounds(&damage, &damage, view->rotation,
+		x + sw/2, y + sh/2);
+	pixman_region32_union(data->damage, data->damage, &damage);
+	pixman_region32_fini(&damage);
+
+	if (data->min_scale == 0 || surface->current.scale < data->min_scale) {
+		data->min_scale = surface->current.scale;
+	}
+}
+
+void desktop_damage_from_view(struct roots_desktop *desktop,
+		struct roots_view *view) {
+	// Collect the damage once in layout coordinates, then only clip, scale
+	// and translate it for the outputs it touches
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	struct layout_damage_data data = {
+		.view = view,
+		.damage = &damage,
+	};
+	view_for_each_surface(view, layout_damage_iterator, &data);
+
+	pixman_region32_t output_damage;
+	pixman_region32_init(&output_damage);
+	struct roots_output *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		if (!view_accept_damage(output, view)) {
+			continue;
+		}
+
+		// Frame done events are due to the surfaces of the view even if
+		// their commit had no damage
+		struct roots_view_output *view_output;
+		wl_list_for_each(view_output, &view->outputs, view_link) {
+			if (view_output->output == output) {
+				wlr_output_schedule_frame(output->wlr_output);
+				break;
+			}
+		}
+
+		struct wlr_output *wlr_output = output->wlr_output;
+		int width, height;
+		wlr_output_effective_resolution(wlr_output, &width, &height);
+		pixman_region32_intersect_rect(&output_damage, &damage,
+			wlr_output->lx, wlr_output->ly, width, height);
+		if (!pixman_region32_not_empty(&output_damage)) {
+			continue;
+		}
+
+		pixman_region32_translate(&output_damage,
+			-wlr_output->lx, -wlr_output->ly);
+		wlr_region_scale(&output_damage, &output_damage, wlr_output->scale);
+		if (ceil(wlr_output->scale) > data.min_scale) {
+			// When scaling up a surface, it'll become blurry so we need to
+			// expand the damage region
+			wlr_region_expand(&output_damage, &output_damage,
+				ceil(wlr_output->scale) - data.min_scale);
+		}
+		output_add_damage(output, &output_damage, true);
+		wlr_output_schedule_frame(wlr_output);
+	}
+	pixman_region32_fini(&output_damage);
+	pixman_region32_fini(&damage);
 }
 
 static void set_mode(struct wlr_output *output,
@@ -385,7 +629,8 @@ static void set_mode(struct wlr_output *output,
 
 	if (wl_list_empty(&output->modes)) {
 		// Output has no mode, try setting a custom one
-		wlr_output_set_custom_mode(output, oc->mode.width, oc->mode.height, mhz);
+		wlr_output_pending_set_custom_mode(output, oc->mode.width,
+			oc->mode.height, mhz);
 		return;
 	}
 
@@ -403,15 +648,42 @@ static void set_mode(struct wlr_output *output,
 		wlr_log(WLR_ERROR, "Configured mode for %s not available", output->name);
 	} else {
 		wlr_log(WLR_DEBUG, "Assigning configured mode to %s", output->name);
-		wlr_output_set_mode(output, best);
+		wlr_output_pending_set_mode(output, best);
 	}
 }
 
+static void output_log_input_latency(struct roots_output *output) {
+	struct wlr_input_latency_tracker *tracker = output->desktop->input_latency;
+	if (tracker == NULL) {
+		return;
+	}
+	struct wlr_input_latency_output *latency_output =
+		wlr_input_latency_tracker_get_output(tracker, output->wlr_output);
+	if (latency_output == NULL || latency_output->histogram.count == 0) {
+		return;
+	}
+
+	struct wlr_input_latency_histogram *histogram = &latency_output->histogram;
+	wlr_log(WLR_INFO, "Input latency on output '%s': %"PRIu64" samples, "
+		"p50 < %"PRIu64"us, p99 < %"PRIu64"us, max %"PRIu64"us",
+		output->wlr_output->name, histogram->count,
+		wlr_input_latency_histogram_percentile(histogram, 0.5),
+		wlr_input_latency_histogram_percentile(histogram, 0.99),
+		histogram->max);
+}
+
 static void output_destroy(struct roots_output *output) {
 	// TODO: cursor
 	//example_config_configure_cursor(sample->config, sample->cursor,
 	//	sample->compositor);
 
+	output_log_input_latency(output);
+
+	struct roots_view_output *view_output, *tmp;
+	wl_list_for_each_safe(view_output, tmp, &output->views, output_link) {
+		view_output_destroy(view_output);
+	}
+
 	wl_list_remove(&output->link);
 	wl_list_remove(&output->destroy.link);
 	wl_list_remove(&output->mode.link);
@@ -419,6 +691,20 @@ static void output_destroy(struct roots_output *output) {
 	wl_list_remove(&output->present.link);
 	wl_list_remove(&output->damage_frame.link);
 	wl_list_remove(&output->damage_destroy.link);
+	if (output->mirror != NULL) {
+		wl_list_remove(&output->mirror_destroy.link);
+		wlr_output_mirror_destroy(output->mirror);
+	}
+	if (output->hidden_frame_timer != NULL) {
+		wl_event_source_remove(output->hidden_frame_timer);
+	}
+	if (output->dynamic_res.enabled) {
+		wl_list_remove(&output->frame_stats.link);
+	}
+	wlr_texture_destroy(output->dynamic_res.texture);
+	wlr_render_pass_destroy(output->pass);
+	pixman_region32_fini(&output->move.damage);
+	pixman_region32_fini(&output->move.other_damage);
 	free(output);
 }
 
@@ -431,6 +717,20 @@ static void output_damage_handle_frame(struct wl_listener *listener,
 		void *data) {
 	struct roots_output *output =
 		wl_container_of(listener, output, damage_frame);
+
+	// Clients get the latest pointer position once per frame, and grabbed
+	// views follow it
+	struct roots_seat *seat;
+	wl_list_for_each(seat, &output->desktop->server->input->seats, link) {
+		wlr_seat_pointer_flush_motion(seat->seat);
+		roots_cursor_apply_grab(seat->cursor);
+	}
+
+	if (output->mirror != NULL) {
+		// The mirror renders this output
+		return;
+	}
+
 	output_render(output);
 }
 
@@ -441,6 +741,38 @@ static void output_damage_handle_destroy(struct wl_listener *listener,
 	output_destroy(output);
 }
 
+void output_update_content_rate(struct roots_output *output) {
+	if (output->content_rate == NULL) {
+		return;
+	}
+	struct roots_view *view = output->fullscreen_view;
+	wlr_output_content_rate_set_surface(output->content_rate,
+		view != NULL ? view->wlr_surface : NULL);
+}
+
+static void output_handle_mirror_destroy(struct wl_listener *listener,
+		void *data) {
+	struct roots_output *output =
+		wl_container_of(listener, output, mirror_destroy);
+	wl_list_remove(&output->mirror_destroy.link);
+	output->mirror = NULL;
+	output_damage_whole(output);
+}
+
+static void output_start_mirror(struct roots_output *output,
+		struct roots_output *src) {
+	output->mirror = wlr_output_mirror_create(src->wlr_output, output->damage);
+	if (output->mirror == NULL) {
+		wlr_log(WLR_ERROR, "Failed to mirror output '%s' on '%s'",
+			src->wlr_output->name, output->wlr_output->name);
+		return;
+	}
+	output->mirror_destroy.notify = output_handle_mirror_destroy;
+	wl_signal_add(&output->mirror->events.destroy, &output->mirror_destroy);
+	wlr_log(WLR_DEBUG, "Mirroring output '%s' on '%s'",
+		src->wlr_output->name, output->wlr_output->name);
+}
+
 static void output_handle_mode(struct wl_listener *listener, void *data) {
 	struct roots_output *output =
 		wl_container_of(listener, output, mode);
@@ -453,30 +785,83 @@ static void output_handle_transform(struct wl_listener *listener, void *data) {
 	arrange_layers(output);
 }
 
-static void surface_send_presented_iterator(struct roots_output *output,
-		struct wlr_surface *surface, struct wlr_box *_box, float rotation,
-		void *data) {
-	struct wlr_presentation_event *event = data;
-	wlr_presentation_send_surface_presented(output->desktop->presentation,
-		surface, event);
+#if WLR_HAS_XWAYLAND
+static void handle_xwayland_prewarm(void *data) {
+	struct roots_desktop *desktop = data;
+	wlr_log(WLR_DEBUG, "Starting Xwayland in the background");
+	if (!wlr_xwayland_start(desktop->xwayland)) {
+		wlr_log(WLR_ERROR, "Failed to start Xwayland");
+	}
 }
+#endif
 
 static void output_handle_present(struct wl_listener *listener, void *data) {
+	// Presentation feedback is sent by wlr_presentation for the surfaces
+	// sampled when rendering
+#if WLR_HAS_XWAYLAND
 	struct roots_output *output =
 		wl_container_of(listener, output, present);
-	struct wlr_output_event_present *output_event = data;
-
-	struct wlr_presentation_event event = {
-		.output = output->wlr_output,
-		.tv_sec = (uint64_t)output_event->when->tv_sec,
-		.tv_nsec = (uint32_t)output_event->when->tv_nsec,
-		.refresh = (uint32_t)output_event->refresh,
-		.seq = (uint64_t)output_event->seq,
-		.flags = output_event->flags,
-	};
+	struct roots_desktop *desktop = output->desktop;
+	if (desktop->xwayland_prewarm) {
+		// Start the server once the pending events have been handled, so
+		// that it doesn't delay the compositor's own work
+		desktop->xwayland_prewarm = false;
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(desktop->server->wl_display);
+		wl_event_loop_add_idle(loop, handle_xwayland_prewarm, desktop);
+	}
+#endif
+}
+
+// Lowest scale of the rendering resolution
+#define DYNAMIC_RES_MIN_SCALE 0.5
+#define DYNAMIC_RES_STEP 0.125
+// Frames in a row over budget before the resolution is lowered, and under
+// budget before it is raised again
+#define DYNAMIC_RES_SLOW_FRAMES 3
+#define DYNAMIC_RES_FAST_FRAMES 120
+
+static void output_handle_frame_stats(struct wl_listener *listener,
+		void *data) {
+	struct roots_output *output =
+		wl_container_of(listener, output, frame_stats);
+	struct wlr_output_event_frame_stats *event = data;
+	if (output->wlr_output->refresh <= 0) {
+		return;
+	}
+
+	// Overloaded GPUs are the point, the CPU time only measures how long
+	// submitting the frame took
+	int64_t period = 1000000000000 / output->wlr_output->refresh;
+	int64_t time = event->gpu_time >= 0 ? event->gpu_time : event->cpu_time;
+	float scale = output->dynamic_res.scale;
+	if (time * 10 > period * 8) {
+		output->dynamic_res.fast_frames = 0;
+		if (++output->dynamic_res.slow_frames >= DYNAMIC_RES_SLOW_FRAMES &&
+				scale > DYNAMIC_RES_MIN_SCALE) {
+			scale -= DYNAMIC_RES_STEP;
+		}
+	} else if (time * 2 < period) {
+		// Leaves room for the cost of the next step, which grows with
+		// the square of the scale
+		output->dynamic_res.slow_frames = 0;
+		if (++output->dynamic_res.fast_frames >= DYNAMIC_RES_FAST_FRAMES &&
+				scale < 1.0) {
+			scale += DYNAMIC_RES_STEP;
+		}
+	} else {
+		output->dynamic_res.slow_frames = 0;
+		output->dynamic_res.fast_frames = 0;
+	}
 
-	output_for_each_surface(output,
-		surface_send_presented_iterator, &event);
+	if (scale != output->dynamic_res.scale) {
+		wlr_log(WLR_DEBUG, "Rendering output '%s' at %.0f%% of its resolution",
+			output->wlr_output->name, scale * 100);
+		output->dynamic_res.scale = scale;
+		output->dynamic_res.slow_frames = 0;
+		output->dynamic_res.fast_frames = 0;
+		output_damage_whole(output);
+	}
 }
 
 void handle_new_output(struct wl_listener *listener, void *data) {
@@ -496,9 +881,23 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 	output->desktop = desktop;
 	output->wlr_output = wlr_output;
 	wlr_output->data = output;
+	output->dynamic_res.scale = 1.0;
+	wl_list_init(&output->views);
+	pixman_region32_init(&output->move.damage);
+	pixman_region32_init(&output->move.other_damage);
 	wl_list_insert(&desktop->outputs, &output->link);
 
 	output->damage = wlr_output_damage_create(wlr_output);
+	output->pass = wlr_render_pass_create(wlr_output->width,
+		wlr_output->height);
+	wlr_output_damage_set_render_budget(output->damage,
+		(int64_t)desktop->config->render_budget * 1000000);
+	if (desktop->config->debug_damage_heatmap) {
+		wlr_output_damage_enable_debug(output->damage, true);
+	}
+	if (desktop->config->auto_refresh_rate) {
+		output->content_rate = wlr_output_content_rate_create(wlr_output);
+	}
 
 	output->destroy.notify = output_handle_destroy;
 	wl_signal_add(&wlr_output->events.destroy, &output->destroy);
@@ -509,6 +908,14 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 	output->present.notify = output_handle_present;
 	wl_signal_add(&wlr_output->events.present, &output->present);
 
+	if (desktop->input_latency != NULL) {
+		wlr_input_latency_tracker_add_output(desktop->input_latency,
+			wlr_output);
+	}
+	if (desktop->work_queue != NULL) {
+		wlr_work_queue_add_output(desktop->work_queue, wlr_output);
+	}
+
 	output->damage_frame.notify = output_damage_handle_frame;
 	wl_signal_add(&output->damage->events.frame, &output->damage_frame);
 	output->damage_destroy.notify = output_damage_handle_destroy;
@@ -522,10 +929,12 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 	struct roots_output_config *output_config =
 		roots_config_get_output(config, wlr_output);
 
+	// Stage the whole configuration, so that it's applied with a single
+	// modeset
 	if ((!output_config || output_config->enable) && !wl_list_empty(&wlr_output->modes)) {
 		struct wlr_output_mode *mode =
 			wl_container_of(wlr_output->modes.prev, mode, link);
-		wlr_output_set_mode(wlr_output, mode);
+		wlr_output_pending_set_mode(wlr_output, mode);
 	}
 
 	if (output_config) {
@@ -535,22 +944,77 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 				wl_list_for_each(mode_config, &output_config->modes, link) {
 					wlr_drm_connector_add_mode(wlr_output, &mode_config->info);
 				}
-			} else if (!wl_list_empty(&output_config->modes)) {
-				wlr_log(WLR_ERROR, "Can only add modes for DRM backend");
+				if (output_config->depth != 0) {
+					wlr_drm_connector_set_depth(wlr_output,
+						output_config->depth);
+				}
+			} else {
+				if (!wl_list_empty(&output_config->modes)) {
+					wlr_log(WLR_ERROR, "Can only add modes for DRM backend");
+				}
+				if (output_config->depth != 0) {
+					wlr_log(WLR_ERROR, "Can only set depth for DRM backend");
+				}
 			}
 
 			if (output_config->mode.width) {
 				set_mode(wlr_output, output_config);
 			}
 
-			wlr_output_set_scale(wlr_output, output_config->scale);
-			wlr_output_set_transform(wlr_output, output_config->transform);
-			wlr_output_layout_add(desktop->layout, wlr_output, output_config->x,
-				output_config->y);
+			wlr_output_pending_set_scale(wlr_output, output_config->scale);
+			wlr_output_pending_set_transform(wlr_output,
+				output_config->transform);
+			if (output_config->adaptive_sync) {
+				wlr_output_pending_enable_adaptive_sync(wlr_output, true);
+			}
+			if (!wlr_output_commit(wlr_output)) {
+				wlr_log(WLR_ERROR, "Failed to apply the configuration of "
+					"output '%s'", wlr_output->name);
+			}
+			output->allow_tearing = output_config->tearing;
+			if (output_config->dynamic_resolution) {
+				output->dynamic_res.enabled = true;
+				output->frame_stats.notify = output_handle_frame_stats;
+				wl_signal_add(&wlr_output->events.frame_stats,
+					&output->frame_stats);
+				wlr_output_enable_frame_stats(wlr_output, true);
+			}
+			if (output_config->damage_tile_size > 0 &&
+					!wlr_output_damage_set_tile_size(output->damage,
+					output_config->damage_tile_size)) {
+				wlr_log(WLR_ERROR, "Failed to enable damage tiles on output "
+					"'%s'", wlr_output->name);
+			}
+			if (output_config->idle_refresh_timeout > 0 &&
+					!wlr_output_damage_set_idle_refresh(output->damage,
+					output_config->idle_refresh_timeout)) {
+				wlr_log(WLR_ERROR, "Failed to enable idle refresh on output "
+					"'%s'", wlr_output->name);
+			}
+			if (output_config->mirror != NULL) {
+				// Mirrors aren't part of the layout
+				struct roots_output *src;
+				wl_list_for_each(src, &desktop->outputs, link) {
+					if (src != output && strcmp(src->wlr_output->name,
+							output_config->mirror) == 0) {
+						output_start_mirror(output, src);
+						break;
+					}
+				}
+			} else {
+				wlr_output_layout_add(desktop->layout, wlr_output,
+					output_config->x, output_config->y);
+			}
 		} else {
-			wlr_output_enable(wlr_output, false);
+			wlr_output_pending_enable(wlr_output, false);
+			wlr_output_commit(wlr_output);
+			if (output_config->lease && desktop->drm_lease_manager != NULL) {
+				wlr_drm_lease_v1_manager_offer_output(
+					desktop->drm_lease_manager, wlr_output);
+			}
 		}
 	} else {
+		wlr_output_commit(wlr_output);
 		wlr_output_layout_add_auto(desktop->layout, wlr_output);
 	}
 
@@ -560,6 +1024,18 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 		roots_seat_configure_xcursor(seat);
 	}
 
+	// Start outputs waiting for this one to be mirrored
+	struct roots_output *dst;
+	wl_list_for_each(dst, &desktop->outputs, link) {
+		struct roots_output_config *dst_config =
+			roots_config_get_output(config, dst->wlr_output);
+		if (dst != output && dst->mirror == NULL && dst_config != NULL &&
+				dst_config->enable && dst_config->mirror != NULL &&
+				strcmp(dst_config->mirror, wlr_output->name) == 0) {
+			output_start_mirror(dst, output);
+		}
+	}
+
 	arrange_layers(output);
 	output_damage_whole(output);
 }
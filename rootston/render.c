@@ -1,53 +1,125 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
 #include <wlr/config.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "rootston/layers.h"
 #include "rootston/output.h"
 #include "rootston/server.h"
 
+// Views whose surfaces haven't changed for this many frames are drawn from a
+// cached composition of their surfaces
+#define VIEW_CACHE_IDLE_FRAMES 30
+
+/*
+ * Rendering happens in two passes over the same surfaces. The first one only
+ * collects the opaque region of each surface. In between, each region is
+ * replaced by the union of the opaque regions of the surfaces above it, so
+ * that the second pass can skip what will be covered anyway.
+ */
 struct render_data {
+	struct wlr_render_pass *pass;
 	pixman_region32_t *damage;
 	float alpha;
+
+	bool collect_opaque;
+	bool occlusion_failed;
+	struct wl_array occluded; // pixman_region32_t, one per rendered element
+	size_t index;
+	struct wl_array hidden; // struct wlr_surface *, fully occluded surfaces
+
+	// Set while going through the surfaces of a view drawn from its cache,
+	// which are only checked for occlusion
+	bool cached;
+	pixman_region32_t *cache_occluded; // occluding the last surface
 };
 
-static void scissor_output(struct wlr_output *wlr_output,
-		pixman_box32_t *rect) {
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(wlr_output->backend);
-	assert(renderer);
+static void finish_occluded_regions(struct render_data *data) {
+	pixman_region32_t *region;
+	wl_array_for_each(region, &data->occluded) {
+		pixman_region32_fini(region);
+	}
+	wl_array_release(&data->occluded);
+	wl_array_init(&data->occluded);
+}
 
-	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
-		.width = rect->x2 - rect->x1,
-		.height = rect->y2 - rect->y1,
-	};
+static void push_opaque_region(struct render_data *data,
+		pixman_region32_t *opaque) {
+	pixman_region32_t *region = NULL;
+	if (!data->occlusion_failed) {
+		region = wl_array_add(&data->occluded, sizeof(*region));
+	}
+	if (region == NULL) {
+		pixman_region32_fini(opaque);
+		if (!data->occlusion_failed) {
+			// Render everything rather than using misaligned regions
+			wlr_log(WLR_ERROR, "Allocation failed");
+			finish_occluded_regions(data);
+			data->occlusion_failed = true;
+		}
+		return;
+	}
+	*region = *opaque;
+}
+
+// Returns the region occluding the next element, NULL if occlusion data isn't
+// available
+static pixman_region32_t *next_occluded_region(struct render_data *data) {
+	size_t len = data->occluded.size / sizeof(pixman_region32_t);
+	if (data->index >= len) {
+		return NULL;
+	}
+	pixman_region32_t *regions = data->occluded.data;
+	return &regions[data->index++];
+}
+
+// Turns each collected opaque region into the region occluding its element,
+// and returns the union of all opaque regions in total
+static void compute_occluded_regions(struct render_data *data,
+		pixman_region32_t *total) {
+	size_t len = data->occluded.size / sizeof(pixman_region32_t);
+	pixman_region32_t *regions = data->occluded.data;
+	for (size_t i = len; i-- > 0;) {
+		pixman_region32_t opaque = regions[i];
+		pixman_region32_init(&regions[i]);
+		pixman_region32_copy(&regions[i], total);
+		pixman_region32_union(total, total, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+}
+
+// Returns whether the pixels of a view can be moved around on this output,
+// its box isn't pixel-aligned with fractional scales
+static bool output_can_occlude(struct wlr_output *wlr_output) {
+	return wlr_output->scale == (int)wlr_output->scale;
+}
 
+// Converts a damage region to buffer coordinates, where the scissor box and
+// render pass regions are
+static void output_damage_to_buffer(struct wlr_output *wlr_output,
+		pixman_region32_t *damage) {
 	int ow, oh;
 	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
 
 	enum wl_output_transform transform =
 		wlr_output_transform_invert(wlr_output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
-
-	wlr_renderer_scissor(renderer, &box);
+	wlr_region_transform(damage, damage, transform, ow, oh);
 }
 
 static void render_texture(struct wlr_output *wlr_output,
-		pixman_region32_t *output_damage, struct wlr_texture *texture,
+		struct wlr_render_pass *pass, pixman_region32_t *output_damage,
+		struct wlr_texture *texture, const struct wlr_fbox *src_box,
 		const struct wlr_box *box, const float matrix[static 9],
 		float rotation, float alpha) {
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(wlr_output->backend);
-	assert(renderer);
-
 	struct wlr_box rotated;
 	wlr_box_rotated_bounds(&rotated, box, rotation);
 
@@ -61,12 +133,9 @@ static void render_texture(struct wlr_output *wlr_output,
 		goto damage_finish;
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(wlr_output, &rects[i]);
-		wlr_render_texture_with_matrix(renderer, texture, matrix, alpha);
-	}
+	output_damage_to_buffer(wlr_output, &damage);
+	wlr_render_pass_add_texture(pass, texture, src_box, matrix, alpha,
+		&damage, NULL);
 
 damage_finish:
 	pixman_region32_fini(&damage);
@@ -77,16 +146,60 @@ static void render_surface_iterator(struct roots_output *output,
 		void *_data) {
 	struct render_data *data = _data;
 	struct wlr_output *wlr_output = output->wlr_output;
-	pixman_region32_t *output_damage = data->damage;
 	float alpha = data->alpha;
 
-	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	struct wlr_texture *texture = wlr_surface_get_texture_for_renderer(
+		surface, wlr_backend_get_renderer(wlr_output->backend));
+
+	struct wlr_box box = *_box;
+	scale_box(&box, wlr_output->scale);
+
+	if (data->collect_opaque) {
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		if (texture != NULL && alpha == 1.0 && rotation == 0.0 &&
+				surface->current.width > 0 && surface->current.height > 0) {
+			// Scale to the box actually drawn, rounding inwards so that
+			// fractional scales can't make the region too large
+			wlr_region_scale_xy_inner(&opaque, &surface->opaque_region,
+				(float)box.width / surface->current.width,
+				(float)box.height / surface->current.height);
+			pixman_region32_translate(&opaque, box.x, box.y);
+			pixman_region32_intersect_rect(&opaque, &opaque,
+				box.x, box.y, box.width, box.height);
+		}
+		push_opaque_region(data, &opaque);
+		return;
+	}
+
+	pixman_region32_t *occluded = next_occluded_region(data);
+	data->cache_occluded = occluded;
 	if (!texture) {
 		return;
 	}
 
-	struct wlr_box box = *_box;
-	scale_box(&box, wlr_output->scale);
+	if (occluded != NULL) {
+		struct wlr_box rotated;
+		wlr_box_rotated_bounds(&rotated, &box, rotation);
+		if (wlr_surface_is_occluded(surface, &rotated, occluded)) {
+			struct wlr_surface **hidden =
+				wl_array_add(&data->hidden, sizeof(*hidden));
+			if (hidden != NULL) {
+				*hidden = surface;
+			}
+		}
+	}
+
+	if (data->cached) {
+		return;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, data->damage);
+	if (occluded != NULL) {
+		pixman_region32_subtract(&damage, &damage, occluded);
+	}
 
 	float matrix[9];
 	enum wl_output_transform transform =
@@ -94,8 +207,13 @@ static void render_surface_iterator(struct roots_output *output,
 	wlr_matrix_project_box(matrix, &box, transform, rotation,
 		wlr_output->transform_matrix);
 
-	render_texture(wlr_output, output_damage,
-		texture, &box, matrix, rotation, alpha);
+	struct wlr_fbox src_box;
+	wlr_surface_get_buffer_source_box(surface, &src_box);
+
+	render_texture(wlr_output, data->pass, &damage, texture, &src_box, &box,
+		matrix, rotation, alpha);
+
+	pixman_region32_fini(&damage);
 }
 
 static void render_decorations(struct roots_output *output,
@@ -104,13 +222,23 @@ static void render_decorations(struct roots_output *output,
 		return;
 	}
 
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(output->wlr_output->backend);
-	assert(renderer);
-
 	struct wlr_box box;
 	get_decoration_box(view, output, &box);
 
+	if (data->collect_opaque) {
+		// The decoration is drawn below the whole view
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		if (view->alpha == 1.0 && view->rotation == 0.0) {
+			pixman_region32_union_rect(&opaque, &opaque, box.x, box.y,
+				box.width, box.height);
+		}
+		push_opaque_region(data, &opaque);
+		return;
+	}
+
+	pixman_region32_t *occluded = next_occluded_region(data);
+
 	struct wlr_box rotated;
 	wlr_box_rotated_bounds(&rotated, &box, view->rotation);
 
@@ -119,6 +247,9 @@ static void render_decorations(struct roots_output *output,
 	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
 		rotated.width, rotated.height);
 	pixman_region32_intersect(&damage, &damage, data->damage);
+	if (occluded != NULL) {
+		pixman_region32_subtract(&damage, &damage, occluded);
+	}
 	bool damaged = pixman_region32_not_empty(&damage);
 	if (!damaged) {
 		goto damage_finish;
@@ -129,18 +260,183 @@ static void render_decorations(struct roots_output *output,
 		view->rotation, output->wlr_output->transform_matrix);
 	float color[] = { 0.2, 0.2, 0.2, view->alpha };
 
-	int nrects;
-	pixman_box32_t *rects =
-		pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output->wlr_output, &rects[i]);
-		wlr_render_quad_with_matrix(renderer, color, matrix);
-	}
+	output_damage_to_buffer(output->wlr_output, &damage);
+	wlr_render_pass_add_quad(data->pass, color, matrix, &damage, NULL);
 
 damage_finish:
 	pixman_region32_fini(&damage);
 }
 
+struct view_cache_data {
+	struct wlr_renderer *renderer;
+	float scale;
+	int x1, y1, x2, y2; // bounds of the surfaces, view-local
+	size_t n_surfaces;
+	float projection[9];
+};
+
+static void view_cache_bounds_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *_data) {
+	struct view_cache_data *data = _data;
+	if (!wlr_surface_has_buffer(surface)) {
+		return;
+	}
+
+	int x = sx + surface->sx;
+	int y = sy + surface->sy;
+	if (data->n_surfaces == 0) {
+		data->x1 = x;
+		data->y1 = y;
+		data->x2 = x + surface->current.width;
+		data->y2 = y + surface->current.height;
+	} else {
+		if (x < data->x1) {
+			data->x1 = x;
+		}
+		if (y < data->y1) {
+			data->y1 = y;
+		}
+		if (x + surface->current.width > data->x2) {
+			data->x2 = x + surface->current.width;
+		}
+		if (y + surface->current.height > data->y2) {
+			data->y2 = y + surface->current.height;
+		}
+	}
+	data->n_surfaces++;
+}
+
+static void view_cache_render_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *_data) {
+	struct view_cache_data *data = _data;
+	struct wlr_texture *texture =
+		wlr_surface_get_texture_for_renderer(surface, data->renderer);
+	if (texture == NULL) {
+		return;
+	}
+
+	struct wlr_box box = {
+		.x = sx + surface->sx - data->x1,
+		.y = sy + surface->sy - data->y1,
+		.width = surface->current.width,
+		.height = surface->current.height,
+	};
+	scale_box(&box, data->scale);
+
+	float matrix[9];
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(surface->current.transform);
+	wlr_matrix_project_box(matrix, &box, transform, 0, data->projection);
+
+	struct wlr_fbox src_box;
+	wlr_surface_get_buffer_source_box(surface, &src_box);
+	wlr_render_subtexture_with_matrix(data->renderer, texture, &src_box,
+		matrix, 1.0);
+}
+
+static bool view_cache_usable(struct roots_output *output,
+		struct roots_view *view) {
+	// Surfaces rotate around the view's center, the cache can't
+	return view->wlr_surface != NULL && view->rotation == 0.0 &&
+		output_can_occlude(output->wlr_output);
+}
+
+// Flattens the surfaces of a view which haven't changed for a while into a
+// single texture. Must be called before the output is made current.
+static void update_view_cache(struct roots_output *output,
+		struct roots_view *view) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	if (view->cache.texture != NULL ||
+			view->cache.idle_frames < VIEW_CACHE_IDLE_FRAMES ||
+			!view_cache_usable(output, view)) {
+		return;
+	}
+
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+	struct view_cache_data data = {
+		.renderer = renderer,
+		.scale = wlr_output->scale,
+	};
+	view_for_each_surface(view, view_cache_bounds_iterator, &data);
+	if (data.n_surfaces < 2) {
+		// A single surface is already drawn with a single quad
+		return;
+	}
+
+	struct wlr_box box = {
+		.width = data.x2 - data.x1,
+		.height = data.y2 - data.y1,
+	};
+	scale_box(&box, data.scale);
+	// Don't retry before the surfaces have been idle for a while again
+	view->cache.idle_frames = 0;
+	struct wlr_texture *texture = wlr_texture_from_pixels(renderer,
+		WL_SHM_FORMAT_ARGB8888, box.width * 4, box.width, box.height, NULL);
+	if (texture == NULL) {
+		return;
+	}
+	if (!wlr_renderer_bind_texture(renderer, texture)) {
+		wlr_texture_destroy(texture);
+		return;
+	}
+
+	wlr_matrix_projection(data.projection, box.width, box.height,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+	wlr_renderer_begin(renderer, box.width, box.height);
+	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+	view_for_each_surface(view, view_cache_render_iterator, &data);
+	wlr_renderer_end(renderer);
+	wlr_renderer_unbind_offscreen(renderer);
+
+	view->cache.texture = texture;
+	view->cache.scale = data.scale;
+	view->cache.box = (struct wlr_box){
+		.x = data.x1,
+		.y = data.y1,
+		.width = data.x2 - data.x1,
+		.height = data.y2 - data.y1,
+	};
+}
+
+static void render_view_cache(struct roots_output *output,
+		struct roots_view *view, struct render_data *data) {
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	// Keep the occlusion data in step with the opaque regions collected for
+	// each surface, the topmost one is occluded by what is above the view
+	data->cached = true;
+	data->cache_occluded = NULL;
+	output_view_for_each_surface(output, view, render_surface_iterator, data);
+	data->cached = false;
+
+	struct wlr_box box = {
+		.x = view->box.x + view->cache.box.x - wlr_output->lx,
+		.y = view->box.y + view->cache.box.y - wlr_output->ly,
+		.width = view->cache.box.width,
+		.height = view->cache.box.height,
+	};
+	scale_box(&box, wlr_output->scale);
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, data->damage);
+	if (data->cache_occluded != NULL) {
+		pixman_region32_subtract(&damage, &damage, data->cache_occluded);
+	}
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		wlr_output->transform_matrix);
+	int width, height;
+	wlr_texture_get_size(view->cache.texture, &width, &height);
+	struct wlr_fbox src_box = { .width = width, .height = height };
+	render_texture(wlr_output, data->pass, &damage, view->cache.texture,
+		&src_box, &box, matrix, 0, data->alpha);
+
+	pixman_region32_fini(&damage);
+}
+
 static void render_view(struct roots_output *output, struct roots_view *view,
 		struct render_data *data) {
 	// Do not render views fullscreened on other outputs
@@ -152,34 +448,413 @@ static void render_view(struct roots_output *output, struct roots_view *view,
 	if (view->fullscreen_output == NULL) {
 		render_decorations(output, view, data);
 	}
+	if (!data->collect_opaque && view->cache.texture != NULL &&
+			view->cache.scale == output->wlr_output->scale &&
+			view_cache_usable(output, view)) {
+		render_view_cache(output, view, data);
+		return;
+	}
 	output_view_for_each_surface(output, view, render_surface_iterator, data);
 }
 
 static void render_layer(struct roots_output *output,
-		pixman_region32_t *damage, struct wl_list *layer_surfaces) {
-	struct render_data data = {
-		.damage = damage,
-		.alpha = 1.0f,
-	};
+		struct render_data *data, struct wl_list *layer_surfaces) {
+	data->alpha = 1.0f;
 	output_layer_for_each_surface(output, layer_surfaces,
-		render_surface_iterator, &data);
+		render_surface_iterator, data);
 }
 
 static void render_drag_icons(struct roots_output *output,
-		pixman_region32_t *damage, struct roots_input *input) {
-	struct render_data data = {
-		.damage = damage,
-		.alpha = 1.0f,
-	};
+		struct render_data *data, struct roots_input *input) {
+	data->alpha = 1.0f;
 	output_drag_icons_for_each_surface(output, input,
-		render_surface_iterator, &data);
+		render_surface_iterator, data);
+}
+
+static void render_output_elements(struct roots_output *output,
+		struct render_data *data) {
+	struct roots_desktop *desktop = output->desktop;
+
+	render_layer(output, data,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+	render_layer(output, data,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+
+	// If a view is fullscreen on this output, render it
+	if (output->fullscreen_view != NULL) {
+		struct roots_view *view = output->fullscreen_view;
+
+		render_view(output, view, data);
+
+		// During normal rendering the xwayland window tree isn't traversed
+		// because all windows are rendered. Here we only want to render
+		// the fullscreen window's children so we have to traverse the tree.
+#if WLR_HAS_XWAYLAND
+		if (view->type == ROOTS_XWAYLAND_VIEW) {
+			struct roots_xwayland_surface *xwayland_surface =
+				roots_xwayland_surface_from_view(view);
+			output_xwayland_children_for_each_surface(output,
+				xwayland_surface->xwayland_surface,
+				render_surface_iterator, data);
+		}
+#endif
+	} else {
+		// Render all views
+		struct roots_view_output *view_output;
+		wl_list_for_each_reverse(view_output, &output->views, output_link) {
+			render_view(output, view_output->view, data);
+		}
+		// Render top layer above shell views
+		render_layer(output, data,
+			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+	}
+
+	render_drag_icons(output, data, desktop->server->input);
+
+	render_layer(output, data,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+}
+
+struct frame_done_data {
+	struct timespec *when;
+	// Set if a frame has been submitted, to sample surfaces for presentation
+	// feedback
+	struct wlr_presentation *presentation;
+	struct wl_array *hidden;
+	int interval; // msec
+	int delay; // msec until the first throttled surface is due, 0 if none
+};
+
+static void frame_done_data_add_delay(struct frame_done_data *data,
+		int delay) {
+	if (delay > 0 && (data->delay == 0 || delay < data->delay)) {
+		data->delay = delay;
+	}
 }
 
 static void surface_send_frame_done_iterator(struct roots_output *output,
 		struct wlr_surface *surface, struct wlr_box *box, float rotation,
+		void *_data) {
+	struct frame_done_data *data = _data;
+
+	// Hidden content hasn't been displayed: its presentation feedback is held
+	// until it is sampled or discarded by a new commit
+	struct wlr_surface **hidden;
+	wl_array_for_each(hidden, data->hidden) {
+		if (*hidden != surface) {
+			continue;
+		}
+		frame_done_data_add_delay(data,
+			wlr_surface_send_frame_done_throttled(surface, data->when,
+				data->interval));
+		return;
+	}
+
+	if (data->presentation != NULL) {
+		wlr_presentation_surface_sampled_on_output(data->presentation,
+			surface, output->wlr_output);
+	}
+	frame_done_data_add_delay(data,
+		wlr_surface_send_frame_done(surface, data->when));
+}
+
+static int handle_hidden_frame_timer(void *data) {
+	struct roots_output *output = data;
+	wlr_output_schedule_frame(output->wlr_output);
+	return 0;
+}
+
+static void send_frame_done(struct roots_output *output,
+		struct render_data *render_data, struct timespec *when,
+		bool submitted) {
+	struct roots_server *server = output->desktop->server;
+	int rate = server->config->hidden_frame_rate;
+	if (output->damage->degraded && (rate == 0 || rate > 1)) {
+		// Spend the frame budget on visible surfaces
+		rate = 1;
+	}
+
+	struct frame_done_data data = {
+		.when = when,
+		.presentation = submitted ? output->desktop->presentation : NULL,
+		.hidden = &render_data->hidden,
+		.interval = rate > 0 ? 1000 / rate : 0,
+	};
+	output_for_each_surface(output, surface_send_frame_done_iterator, &data);
+
+	if (data.delay == 0) {
+		return;
+	}
+
+	// Nothing may damage the output until throttled surfaces are due
+	if (output->hidden_frame_timer == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(server->wl_display);
+		output->hidden_frame_timer = wl_event_loop_add_timer(loop,
+			handle_hidden_frame_timer, output);
+		if (output->hidden_frame_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create hidden frame timer");
+			return;
+		}
+	}
+	wl_event_source_timer_update(output->hidden_frame_timer, data.delay);
+}
+
+static void count_surface_iterator(struct roots_output *output,
+		struct wlr_surface *surface, struct wlr_box *box, float rotation,
+		void *data) {
+	size_t *n = data;
+	(*n)++;
+}
+
+static bool scan_out_fullscreen_view(struct roots_output *output) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct roots_desktop *desktop = output->desktop;
+	struct roots_view *view = output->fullscreen_view;
+	if (view == NULL || view->wlr_surface == NULL || view->alpha != 1.0f ||
+			desktop->server->config->debug_damage_tracking ||
+			desktop->server->config->debug_damage_heatmap) {
+		return false;
+	}
+
+	// The fullscreen surface must be the only thing visible on the output
+	size_t n_surfaces = 0;
+	output_view_for_each_surface(output, view,
+		count_surface_iterator, &n_surfaces);
+#if WLR_HAS_XWAYLAND
+	if (view->type == ROOTS_XWAYLAND_VIEW) {
+		struct roots_xwayland_surface *xwayland_surface =
+			roots_xwayland_surface_from_view(view);
+		output_xwayland_children_for_each_surface(output,
+			xwayland_surface->xwayland_surface,
+			count_surface_iterator, &n_surfaces);
+	}
+#endif
+	output_drag_icons_for_each_surface(output, desktop->server->input,
+		count_surface_iterator, &n_surfaces);
+	output_layer_for_each_surface(output,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY],
+		count_surface_iterator, &n_surfaces);
+	if (n_surfaces > 1) {
+		return false;
+	}
+
+	struct wlr_surface *surface = view->wlr_surface;
+	if (surface->buffer == NULL ||
+			surface->current.viewport.has_src ||
+			surface->current.viewport.has_dst ||
+			surface->current.transform != wlr_output->transform ||
+			(float)surface->current.scale != wlr_output->scale) {
+		return false;
+	}
+
+	wlr_output_set_tearing(wlr_output,
+		output->allow_tearing && view->allow_tearing);
+	return wlr_output_attach_buffer(wlr_output, surface->buffer);
+}
+
+static void add_surface_box_iterator(struct roots_output *output,
+		struct wlr_surface *surface, struct wlr_box *_box, float rotation,
 		void *data) {
-	struct timespec *when = data;
-	wlr_surface_send_frame_done(surface, when);
+	pixman_region32_t *region = data;
+
+	struct wlr_box box = *_box;
+	scale_box(&box, output->wlr_output->scale);
+	wlr_box_rotated_bounds(&box, &box, rotation);
+
+	pixman_region32_union_rect(region, region, box.x, box.y,
+		box.width, box.height);
+}
+
+// Copies the pixels of a view which moved since the last frame, if they are
+// still in the back buffer, and removes them from the region to repaint. Only
+// the parts of the view which weren't visible before need to be redrawn.
+static void copy_moved_view(struct roots_output *output,
+		pixman_region32_t *damage, pixman_region32_t *repaint) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct roots_output_move *move = &output->move;
+	struct roots_view *view = move->view;
+	if (view == NULL || move->invalid || output->damage->buffer_age != 1 ||
+			output->fullscreen_view != NULL ||
+			!output_can_occlude(wlr_output)) {
+		return;
+	}
+
+	// Nothing may be stacked between the view and the upper layers
+	struct roots_view_output *top =
+		wl_container_of(output->views.next, top, output_link);
+	if (wl_list_empty(&output->views) || top->view != view) {
+		return;
+	}
+
+	struct wlr_box dst;
+	if (!output_get_view_opaque_box(output, view, &dst) ||
+			dst.width != move->src.width || dst.height != move->src.height) {
+		return;
+	}
+	int dx = dst.x - move->src.x;
+	int dy = dst.y - move->src.y;
+
+	// Software cursors are part of the last frame too
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &wlr_output->cursors, link) {
+		if (cursor->enabled && cursor->visible &&
+				cursor != wlr_output->hardware_cursor) {
+			return;
+		}
+	}
+
+	pixman_region32_t copy, excluded;
+	pixman_region32_init(&copy);
+	pixman_region32_init(&excluded);
+
+	// All of the damage must come from known sources, e.g. not from a mode
+	// change
+	pixman_region32_union(&excluded, &move->damage, &move->other_damage);
+	pixman_region32_subtract(&excluded, damage, &excluded);
+	if (pixman_region32_not_empty(&excluded)) {
+		goto finish;
+	}
+
+	// Both the source and the destination must be on the output
+	int width, height;
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	pixman_region32_union_rect(&copy, &copy, dst.x, dst.y,
+		dst.width, dst.height);
+	pixman_region32_intersect_rect(&copy, &copy, 0, 0, width, height);
+	pixman_region32_intersect_rect(&copy, &copy, dx, dy, width, height);
+
+	// Skip pixels which changed for other reasons or which are covered by
+	// elements above the view, at the source or the destination
+	pixman_region32_copy(&excluded, &move->other_damage);
+	output_layer_for_each_surface(output,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP],
+		add_surface_box_iterator, &excluded);
+	output_layer_for_each_surface(output,
+		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY],
+		add_surface_box_iterator, &excluded);
+	output_drag_icons_for_each_surface(output,
+		output->desktop->server->input, add_surface_box_iterator, &excluded);
+	pixman_region32_subtract(&copy, &copy, &excluded);
+	pixman_region32_translate(&excluded, dx, dy);
+	pixman_region32_subtract(&copy, &copy, &excluded);
+	if (!pixman_region32_not_empty(&copy)) {
+		goto finish;
+	}
+
+	// The source and destination of separate rectangles may overlap, copy
+	// the extents at once instead. What isn't part of the copy in there is
+	// damaged, so it is repainted.
+	pixman_box32_t *extents = pixman_region32_extents(&copy);
+	struct wlr_box dst_box = {
+		.x = extents->x1,
+		.y = extents->y1,
+		.width = extents->x2 - extents->x1,
+		.height = extents->y2 - extents->y1,
+	};
+	if (pixman_region32_contains_rectangle(damage, extents) !=
+			PIXMAN_REGION_IN) {
+		goto finish;
+	}
+	struct wlr_box src_box = dst_box;
+	src_box.x -= dx;
+	src_box.y -= dy;
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(wlr_output->transform);
+	wlr_box_transform(&src_box, &src_box, transform, width, height);
+	wlr_box_transform(&dst_box, &dst_box, transform, width, height);
+
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+	wlr_renderer_scissor(renderer, NULL);
+	if (wlr_renderer_copy_region(renderer, &src_box, dst_box.x, dst_box.y)) {
+		pixman_region32_subtract(repaint, repaint, &copy);
+	}
+
+finish:
+	pixman_region32_fini(&copy);
+	pixman_region32_fini(&excluded);
+}
+
+// Returns the texture the frame is rendered into when the output renders at a
+// reduced resolution, NULL otherwise. Must be called before the output is
+// made current, the damage is adjusted for the texture.
+static struct wlr_texture *prepare_scaled_render(struct roots_output *output) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	float scale = output->dynamic_res.scale;
+	if (scale == 1.0) {
+		wlr_texture_destroy(output->dynamic_res.texture);
+		output->dynamic_res.texture = NULL;
+		return NULL;
+	}
+
+	int width = ceil(wlr_output->width * scale);
+	int height = ceil(wlr_output->height * scale);
+	struct wlr_texture *texture = output->dynamic_res.texture;
+	if (texture != NULL) {
+		int tex_width, tex_height;
+		wlr_texture_get_size(texture, &tex_width, &tex_height);
+		if (tex_width != width || tex_height != height) {
+			wlr_texture_destroy(texture);
+			texture = output->dynamic_res.texture = NULL;
+		}
+	}
+
+	int ow, oh;
+	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
+	pixman_region32_t *damage = &output->damage->current;
+	if (texture == NULL) {
+		struct wlr_renderer *renderer =
+			wlr_backend_get_renderer(wlr_output->backend);
+		texture = wlr_texture_from_pixels(renderer, WL_SHM_FORMAT_XRGB8888,
+			width * 4, width, height, NULL);
+		if (texture == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate a %dx%d texture to render "
+				"output '%s'", width, height, wlr_output->name);
+			return NULL;
+		}
+		output->dynamic_res.texture = texture;
+		pixman_region32_union_rect(damage, damage, 0, 0, ow, oh);
+	}
+
+	// Texels span more than a pixel and are interpolated with their
+	// neighbours when upscaled, redraw a bit around the damage
+	wlr_region_expand(damage, damage, ceil(1.0 / scale) + 1);
+	pixman_region32_intersect_rect(damage, damage, 0, 0, ow, oh);
+	return texture;
+}
+
+// Upscales the frame rendered at a reduced resolution to the output
+static void render_scaled_texture(struct roots_output *output,
+		struct wlr_texture *texture, pixman_region32_t *output_damage) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+
+	// The texture holds the frame as it would be in the buffer, transform
+	// included
+	struct wlr_box box = {
+		.width = wlr_output->width,
+		.height = wlr_output->height,
+	};
+	float projection[9], matrix[9];
+	wlr_matrix_projection(projection, box.width, box.height,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		projection);
+
+	int width, height;
+	wlr_texture_get_size(texture, &width, &height);
+	struct wlr_fbox src_box = { .width = width, .height = height };
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, output_damage);
+	output_damage_to_buffer(wlr_output, &damage);
+	wlr_render_subtexture_with_matrix_region(renderer, texture, &src_box,
+		matrix, 1.0, &damage);
+	pixman_region32_fini(&damage);
 }
 
 void output_render(struct roots_output *output) {
@@ -220,7 +895,15 @@ void output_render(struct roots_output *output) {
 		clear_color[0] = clear_color[1] = clear_color[2] = 0;
 	}
 
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &output->views, output_link) {
+		update_view_cache(output, view_output->view);
+	}
+
+	struct wlr_texture *scaled = prepare_scaled_render(output);
+
 	bool needs_swap;
+	bool submitted = false;
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
 	if (!wlr_output_damage_make_current(output->damage, &needs_swap, &damage)) {
@@ -228,16 +911,48 @@ void output_render(struct roots_output *output) {
 	}
 
 	struct render_data data = {
+		.pass = output->pass,
 		.damage = &damage,
 		.alpha = 1.0,
 	};
+	wl_array_init(&data.occluded);
+	wl_array_init(&data.hidden);
+
+	pixman_region32_t repaint;
+	pixman_region32_init(&repaint);
 
 	if (!needs_swap) {
 		// Output doesn't need swap and isn't damaged, skip rendering completely
+		output_reset_view_move(output, false);
+		goto damage_finish;
+	}
+
+	if (scan_out_fullscreen_view(output)) {
+		// The client buffer is displayed as-is, skip rendering completely
+		if (scaled != NULL) {
+			// Damage isn't tracked for the texture meanwhile
+			wlr_texture_destroy(scaled);
+			output->dynamic_res.texture = NULL;
+		}
+		if (wlr_output_damage_swap_buffers(output->damage, &now, &damage)) {
+			output->last_frame = desktop->last_frame = now;
+			submitted = true;
+		}
+		output_reset_view_move(output, true);
 		goto damage_finish;
 	}
 
+	if (scaled != NULL && !wlr_renderer_bind_texture(renderer, scaled)) {
+		wlr_log(WLR_ERROR, "Failed to render output '%s' at a reduced "
+			"resolution", wlr_output->name);
+		wlr_texture_destroy(scaled);
+		output->dynamic_res.texture = scaled = NULL;
+		output->dynamic_res.scale = 1.0;
+	}
+
+	// Scaled down to the texture, if any
 	wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+	wlr_render_pass_reset(output->pass, wlr_output->width, wlr_output->height);
 
 	if (!pixman_region32_not_empty(&damage)) {
 		// Output isn't damaged but needs buffer swap
@@ -245,57 +960,45 @@ void output_render(struct roots_output *output) {
 	}
 
 	if (server->config->debug_damage_tracking) {
-		wlr_renderer_clear(renderer, (float[]){1, 1, 0, 1});
+		wlr_render_pass_add_clear(output->pass, (float[]){1, 1, 0, 1}, NULL);
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output->wlr_output, &rects[i]);
-		wlr_renderer_clear(renderer, clear_color);
+	// The whole damage is still swapped, only less of it is painted
+	pixman_region32_copy(&repaint, &damage);
+	if (!server->config->debug_damage_tracking && scaled == NULL) {
+		copy_moved_view(output, &damage, &repaint);
 	}
+	data.damage = &repaint;
 
-	render_layer(output, &damage,
-		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
-	render_layer(output, &damage,
-		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
-
-	// If a view is fullscreen on this output, render it
-	if (output->fullscreen_view != NULL) {
-		struct roots_view *view = output->fullscreen_view;
-
-		render_view(output, view, &data);
-
-		// During normal rendering the xwayland window tree isn't traversed
-		// because all windows are rendered. Here we only want to render
-		// the fullscreen window's children so we have to traverse the tree.
-#if WLR_HAS_XWAYLAND
-		if (view->type == ROOTS_XWAYLAND_VIEW) {
-			struct roots_xwayland_surface *xwayland_surface =
-				roots_xwayland_surface_from_view(view);
-			output_xwayland_children_for_each_surface(output,
-				xwayland_surface->xwayland_surface,
-				render_surface_iterator, &data);
-		}
-#endif
-	} else {
-		// Render all views
-		struct roots_view *view;
-		wl_list_for_each_reverse(view, &desktop->views, link) {
-			render_view(output, view, &data);
-		}
-		// Render top layer above shell views
-		render_layer(output, &damage,
-			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+	// Damage tracking debugging needs to see everything being drawn
+	pixman_region32_t clear_damage;
+	pixman_region32_init(&clear_damage);
+	if (!server->config->debug_damage_tracking) {
+		data.collect_opaque = true;
+		render_output_elements(output, &data);
+		data.collect_opaque = false;
+		compute_occluded_regions(&data, &clear_damage);
 	}
+	pixman_region32_subtract(&clear_damage, &repaint, &clear_damage);
 
-	render_drag_icons(output, &damage, server->input);
+	output_damage_to_buffer(wlr_output, &clear_damage);
+	wlr_render_pass_add_clear(output->pass, clear_color, &clear_damage);
+	pixman_region32_fini(&clear_damage);
 
-	render_layer(output, &damage,
-		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+	render_output_elements(output, &data);
+	wlr_render_pass_submit(output->pass, renderer);
 
 renderer_end:
+	if (scaled != NULL) {
+		wlr_renderer_scissor(renderer, NULL);
+		wlr_renderer_end(renderer);
+		wlr_renderer_unbind_offscreen(renderer);
+		wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+		render_scaled_texture(output, scaled, &damage);
+	}
+	// Drawn at the full resolution in any case
 	wlr_output_render_software_cursors(wlr_output, &damage);
+	wlr_output_damage_render_debug(output->damage, renderer);
 	wlr_renderer_scissor(renderer, NULL);
 	wlr_renderer_end(renderer);
 
@@ -311,14 +1014,27 @@ renderer_end:
 	wlr_region_transform(&damage, &damage, transform, width, height);
 
 	if (!wlr_output_damage_swap_buffers(output->damage, &now, &damage)) {
+		// The next buffer may not hold the last frame
+		output_reset_view_move(output, true);
 		goto damage_finish;
 	}
 	output->last_frame = desktop->last_frame = now;
+	submitted = true;
+	output_reset_view_move(output, false);
+
+	wl_list_for_each(view_output, &output->views, output_link) {
+		struct roots_view *view = view_output->view;
+		if (view->cache.idle_frames < VIEW_CACHE_IDLE_FRAMES) {
+			view->cache.idle_frames++;
+		}
+	}
 
 damage_finish:
+	finish_occluded_regions(&data);
+	pixman_region32_fini(&repaint);
 	pixman_region32_fini(&damage);
 
-	// Send frame done events to all surfaces
-	output_for_each_surface(output, surface_send_frame_done_iterator,
-		&now);
+	// Send frame done events to all surfaces, hidden ones are throttled
+	send_frame_done(output, &data, &now, submitted);
+	wl_array_release(&data.hidden);
 }
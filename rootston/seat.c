@@ -27,6 +27,7 @@ static void handle_keyboard_key(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, keyboard, keyboard_key);
 	struct roots_desktop *desktop = keyboard->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, keyboard->seat->seat);
+	roots_seat_flush_motion(keyboard->seat);
 	struct wlr_event_keyboard_key *event = data;
 	roots_keyboard_handle_key(keyboard, event);
 }
@@ -40,23 +41,83 @@ static void handle_keyboard_modifiers(struct wl_listener *listener,
 	roots_keyboard_handle_modifiers(keyboard);
 }
 
+void roots_seat_flush_motion(struct roots_seat *seat) {
+	struct roots_cursor *cursor = seat->cursor;
+	enum roots_seat_motion_type type = seat->pending_motion.type;
+	seat->pending_motion.type = ROOTS_SEAT_MOTION_NONE;
+	switch (type) {
+	case ROOTS_SEAT_MOTION_NONE:
+		break;
+	case ROOTS_SEAT_MOTION_RELATIVE:
+		roots_cursor_handle_motion(cursor, &seat->pending_motion.relative);
+		break;
+	case ROOTS_SEAT_MOTION_ABSOLUTE:
+		roots_cursor_handle_motion_absolute(cursor,
+			&seat->pending_motion.absolute);
+		break;
+	}
+
+	if (seat->pending_motion.frame) {
+		seat->pending_motion.frame = false;
+		roots_cursor_handle_frame(cursor);
+	}
+}
+
+/**
+ * Pointer motion is queued per seat and processed once per event loop
+ * iteration: hit-testing, constraints and interactive grabs then run once per
+ * seat however many motion events its devices sent, and the cursor planes are
+ * moved once.
+ */
+static void seat_queue_motion(struct roots_seat *seat,
+		enum roots_seat_motion_type type) {
+	if (seat->pending_motion.type != ROOTS_SEAT_MOTION_NONE &&
+			seat->pending_motion.type != type) {
+		roots_seat_flush_motion(seat);
+	}
+	seat->pending_motion.type = type;
+	input_schedule_motion_flush(seat->input);
+}
+
 static void handle_cursor_motion(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, motion);
-	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
-	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	struct roots_seat *seat = cursor->seat;
+	struct roots_desktop *desktop = seat->input->server->desktop;
+	wlr_idle_notify_activity(desktop->idle, seat->seat);
 	struct wlr_event_pointer_motion *event = data;
-	roots_cursor_handle_motion(cursor, event);
+
+	struct wlr_event_pointer_motion *pending = &seat->pending_motion.relative;
+	if (seat->pending_motion.type != ROOTS_SEAT_MOTION_RELATIVE ||
+			pending->device != event->device) {
+		roots_seat_flush_motion(seat);
+		*pending = *event;
+	} else {
+		pending->time_msec = event->time_msec;
+		pending->time_usec = event->time_usec;
+		pending->delta_x += event->delta_x;
+		pending->delta_y += event->delta_y;
+		pending->unaccel_dx += event->unaccel_dx;
+		pending->unaccel_dy += event->unaccel_dy;
+	}
+	seat_queue_motion(seat, ROOTS_SEAT_MOTION_RELATIVE);
 }
 
 static void handle_cursor_motion_absolute(struct wl_listener *listener,
 		void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, motion_absolute);
-	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
-	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	struct roots_seat *seat = cursor->seat;
+	struct roots_desktop *desktop = seat->input->server->desktop;
+	wlr_idle_notify_activity(desktop->idle, seat->seat);
 	struct wlr_event_pointer_motion_absolute *event = data;
-	roots_cursor_handle_motion_absolute(cursor, event);
+
+	if (seat->pending_motion.type == ROOTS_SEAT_MOTION_ABSOLUTE &&
+			seat->pending_motion.absolute.device != event->device) {
+		roots_seat_flush_motion(seat);
+	}
+	seat->pending_motion.absolute = *event;
+	seat_queue_motion(seat, ROOTS_SEAT_MOTION_ABSOLUTE);
 }
 
 static void handle_cursor_button(struct wl_listener *listener, void *data) {
@@ -64,6 +125,7 @@ static void handle_cursor_button(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, button);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_event_pointer_button *event = data;
 	roots_cursor_handle_button(cursor, event);
 }
@@ -73,6 +135,7 @@ static void handle_cursor_axis(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, axis);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_event_pointer_axis *event = data;
 	roots_cursor_handle_axis(cursor, event);
 }
@@ -82,12 +145,18 @@ static void handle_cursor_frame(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, frame);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	if (cursor->seat->pending_motion.type != ROOTS_SEAT_MOTION_NONE) {
+		// Sent after the coalesced motion
+		cursor->seat->pending_motion.frame = true;
+		return;
+	}
 	roots_cursor_handle_frame(cursor);
 }
 
 static void handle_swipe_begin(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, swipe_begin);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_swipe_begin *event = data;
@@ -98,6 +167,7 @@ static void handle_swipe_begin(struct wl_listener *listener, void *data) {
 static void handle_swipe_update(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, swipe_update);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_swipe_update *event = data;
@@ -108,6 +178,7 @@ static void handle_swipe_update(struct wl_listener *listener, void *data) {
 static void handle_swipe_end(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, swipe_end);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_swipe_end *event = data;
@@ -118,6 +189,7 @@ static void handle_swipe_end(struct wl_listener *listener, void *data) {
 static void handle_pinch_begin(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, pinch_begin);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_pinch_begin *event = data;
@@ -128,6 +200,7 @@ static void handle_pinch_begin(struct wl_listener *listener, void *data) {
 static void handle_pinch_update(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, pinch_update);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_pinch_update *event = data;
@@ -139,6 +212,7 @@ static void handle_pinch_update(struct wl_listener *listener, void *data) {
 static void handle_pinch_end(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, pinch_end);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_pointer_gestures_v1 *gestures =
 		cursor->seat->input->server->desktop->pointer_gestures;
 	struct wlr_event_pointer_pinch_end *event = data;
@@ -155,11 +229,21 @@ static void handle_switch_toggle(struct wl_listener *listener, void *data) {
 	roots_switch_handle_toggle(lid_switch, event);
 }
 
+// Touch and tablet input doesn't go through the pointer's latency tracking
+static void seat_notify_work_queue(struct roots_seat *seat) {
+	struct roots_desktop *desktop = seat->input->server->desktop;
+	if (desktop->work_queue != NULL) {
+		wlr_work_queue_notify_input(desktop->work_queue);
+	}
+}
+
 static void handle_touch_down(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, touch_down);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_touch_down *event = data;
 	roots_cursor_handle_touch_down(cursor, event);
 }
@@ -169,6 +253,8 @@ static void handle_touch_up(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, touch_up);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_touch_up *event = data;
 	roots_cursor_handle_touch_up(cursor, event);
 }
@@ -178,10 +264,18 @@ static void handle_touch_motion(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, touch_motion);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_touch_motion *event = data;
 	roots_cursor_handle_touch_motion(cursor, event);
 }
 
+static void handle_touch_frame(struct wl_listener *listener, void *data) {
+	struct roots_cursor *cursor =
+		wl_container_of(listener, cursor, touch_frame);
+	roots_cursor_handle_touch_frame(cursor);
+}
+
 static void handle_tablet_tool_position(struct roots_cursor *cursor,
 		struct roots_tablet *tablet,
 		struct wlr_tablet_tool *tool,
@@ -232,6 +326,8 @@ static void handle_tool_axis(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, tool_axis);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_tablet_tool_axis *event = data;
 	struct roots_tablet_tool *roots_tool = event->tool->data;
 
@@ -294,6 +390,8 @@ static void handle_tool_tip(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, tool_tip);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_tablet_tool_tip *event = data;
 	struct roots_tablet_tool *roots_tool = event->tool->data;
 
@@ -323,6 +421,8 @@ static void handle_tool_button(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, tool_button);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_tablet_tool_button *event = data;
 	struct roots_tablet_tool *roots_tool = event->tool->data;
 
@@ -353,6 +453,8 @@ static void handle_tool_proximity(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, cursor, tool_proximity);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
+	seat_notify_work_queue(cursor->seat);
 	struct wlr_event_tablet_tool_proximity *event = data;
 
 	struct wlr_tablet_tool *tool = event->tool;
@@ -391,6 +493,7 @@ static void handle_request_set_cursor(struct wl_listener *listener,
 		wl_container_of(listener, cursor, request_set_cursor);
 	struct roots_desktop *desktop = cursor->seat->input->server->desktop;
 	wlr_idle_notify_activity(desktop->idle, cursor->seat->seat);
+	roots_seat_flush_motion(cursor->seat);
 	struct wlr_seat_pointer_request_set_cursor_event *event = data;
 	roots_cursor_handle_request_set_cursor(cursor, event);
 }
@@ -483,6 +586,8 @@ void roots_seat_configure_cursor(struct roots_seat *seat) {
 				output->wlr_output);
 		}
 	}
+
+	roots_cursor_update_fast_path_devices(seat->cursor);
 }
 
 static void roots_seat_init_cursor(struct roots_seat *seat) {
@@ -494,6 +599,10 @@ static void roots_seat_init_cursor(struct roots_seat *seat) {
 	struct wlr_cursor *wlr_cursor = seat->cursor->cursor;
 	struct roots_desktop *desktop = seat->input->server->desktop;
 	wlr_cursor_attach_output_layout(wlr_cursor, desktop->layout);
+	if (seat->input->server->config->cursor_fast_path &&
+			strcmp(seat->seat->name, ROOTS_CONFIG_DEFAULT_SEAT_NAME) == 0) {
+		roots_cursor_init_fast_path(seat->cursor);
+	}
 
 	roots_seat_configure_cursor(seat);
 	roots_seat_configure_xcursor(seat);
@@ -543,6 +652,9 @@ static void roots_seat_init_cursor(struct roots_seat *seat) {
 		&seat->cursor->touch_motion);
 	seat->cursor->touch_motion.notify = handle_touch_motion;
 
+	wl_signal_add(&wlr_cursor->events.touch_frame, &seat->cursor->touch_frame);
+	seat->cursor->touch_frame.notify = handle_touch_frame;
+
 	wl_signal_add(&wlr_cursor->events.tablet_tool_axis,
 		&seat->cursor->tool_axis);
 	seat->cursor->tool_axis.notify = handle_tool_axis;
@@ -753,6 +865,9 @@ struct roots_seat *roots_seat_create(struct roots_input *input, char *name) {
 		return NULL;
 	}
 	seat->seat->data = seat;
+	if (input->server->config->coalesce_pointer_motion) {
+		wlr_seat_pointer_set_coalesce_motion(seat->seat, true);
+	}
 
 	roots_seat_init_cursor(seat);
 	if (!seat->cursor) {
@@ -848,11 +963,15 @@ static void handle_pointer_destroy(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, pointer, device_destroy);
 	struct roots_seat *seat = pointer->seat;
 
+	// Queued motion refers to the device
+	roots_seat_flush_motion(seat);
+
 	wl_list_remove(&pointer->link);
 	wlr_cursor_detach_input_device(seat->cursor->cursor, pointer->device);
 	wl_list_remove(&pointer->device_destroy.link);
 	free(pointer);
 
+	roots_cursor_update_fast_path_devices(seat->cursor);
 	seat_update_capabilities(seat);
 }
 
@@ -1189,11 +1308,8 @@ void roots_seat_configure_xcursor(struct roots_seat *seat) {
 
 	struct roots_output *output;
 	wl_list_for_each(output, &seat->input->server->desktop->outputs, link) {
-		float scale = output->wlr_output->scale;
-		if (wlr_xcursor_manager_load(seat->cursor->xcursor_manager, scale)) {
-			wlr_log(WLR_ERROR, "Cannot load xcursor theme for output '%s' "
-				"with scale %f", output->wlr_output->name, scale);
-		}
+		wlr_xcursor_manager_load(seat->cursor->xcursor_manager,
+			output->wlr_output->scale);
 	}
 
 	wlr_xcursor_manager_set_cursor_image(seat->cursor->xcursor_manager,
@@ -1324,8 +1440,7 @@ void roots_seat_set_focus(struct roots_seat *seat, struct roots_view *view) {
 	// Make sure the view will be rendered on top of others, even if it's
 	// already focused in this seat
 	if (view != NULL) {
-		wl_list_remove(&view->link);
-		wl_list_insert(&seat->input->server->desktop->views, &view->link);
+		view_raise(view);
 	}
 
 	bool unfullscreen = true;
@@ -1605,6 +1720,9 @@ void roots_seat_end_compositor_grab(struct roots_seat *seat) {
 		return;
 	}
 
+	// The view goes back to where it was, pending motion is dropped
+	cursor->grab_pending = false;
+
 	switch(cursor->mode) {
 		case ROOTS_CURSOR_MOVE:
 			view_move(view, cursor->view_x, cursor->view_y);
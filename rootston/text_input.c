@@ -85,21 +85,32 @@ static void handle_im_destroy(struct wl_listener *listener, void *data) {
 	}
 }
 
+/**
+ * Sends the given fields of the text input state to the input method, see
+ * enum wlr_text_input_v3_state_field.
+ */
 static void relay_send_im_done(struct roots_input_method_relay *relay,
-		struct wlr_text_input_v3 *input) {
+		struct wlr_text_input_v3 *input, uint32_t fields) {
 	struct wlr_input_method_v2 *input_method = relay->input_method;
 	if (!input_method) {
 		wlr_log(WLR_INFO, "Sending IM_DONE but im is gone");
 		return;
 	}
-	// TODO: only send each of those if they were modified
-	wlr_input_method_v2_send_surrounding_text(input_method,
-		input->current.surrounding.text, input->current.surrounding.cursor,
-		input->current.surrounding.anchor);
-	wlr_input_method_v2_send_text_change_cause(input_method,
-		input->current.text_change_cause);
-	wlr_input_method_v2_send_content_type(input_method,
-		input->current.content_type.hint, input->current.content_type.purpose);
+	if (fields & WLR_TEXT_INPUT_V3_STATE_SURROUNDING_TEXT) {
+		wlr_input_method_v2_send_surrounding_text(input_method,
+			input->current.surrounding.text,
+			input->current.surrounding.cursor,
+			input->current.surrounding.anchor);
+	}
+	if (fields & WLR_TEXT_INPUT_V3_STATE_TEXT_CHANGE_CAUSE) {
+		wlr_input_method_v2_send_text_change_cause(input_method,
+			input->current.text_change_cause);
+	}
+	if (fields & WLR_TEXT_INPUT_V3_STATE_CONTENT_TYPE) {
+		wlr_input_method_v2_send_content_type(input_method,
+			input->current.content_type.hint,
+			input->current.content_type.purpose);
+	}
 	wlr_input_method_v2_send_done(input_method);
 	// TODO: pass intent, display popup size
 }
@@ -126,7 +137,8 @@ static void handle_text_input_enable(struct wl_listener *listener, void *data) {
 	struct roots_text_input *text_input = text_input_to_roots(relay,
 		(struct wlr_text_input_v3*)data);
 	wlr_input_method_v2_send_activate(relay->input_method);
-	relay_send_im_done(relay, text_input->input);
+	// Activation resets the input method state
+	relay_send_im_done(relay, text_input->input, ~(uint32_t)0);
 }
 
 static void handle_text_input_commit(struct wl_listener *listener,
@@ -144,7 +156,12 @@ static void handle_text_input_commit(struct wl_listener *listener,
 		wlr_log(WLR_INFO, "Text input committed, but input method is gone");
 		return;
 	}
-	relay_send_im_done(relay, text_input->input);
+	uint32_t changed = text_input->input->current_changed &
+		~WLR_TEXT_INPUT_V3_STATE_CURSOR_RECTANGLE;
+	if (changed == 0) {
+		return;
+	}
+	relay_send_im_done(relay, text_input->input, changed);
 }
 
 static void relay_disable_text_input(struct roots_input_method_relay *relay,
@@ -154,7 +171,7 @@ static void relay_disable_text_input(struct roots_input_method_relay *relay,
 		return;
 	}
 	wlr_input_method_v2_send_deactivate(relay->input_method);
-	relay_send_im_done(relay, text_input->input);
+	relay_send_im_done(relay, text_input->input, 0);
 }
 
 static void handle_text_input_disable(struct wl_listener *listener,
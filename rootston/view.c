@@ -1,7 +1,12 @@
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wlr/backend/drm.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/log.h>
 #include "rootston/desktop.h"
 #include "rootston/input.h"
 #include "rootston/seat.h"
@@ -18,6 +23,7 @@ void view_init(struct roots_view *view, const struct roots_view_interface *impl,
 	wl_signal_init(&view->events.unmap);
 	wl_signal_init(&view->events.destroy);
 	wl_list_init(&view->children);
+	wl_list_init(&view->outputs);
 }
 
 void view_destroy(struct roots_view *view) {
@@ -34,6 +40,7 @@ void view_destroy(struct roots_view *view) {
 	// Can happen if fullscreened while unmapped, and hasn't been mapped
 	if (view->fullscreen_output != NULL) {
 		view->fullscreen_output->fullscreen_view = NULL;
+		output_update_content_rate(view->fullscreen_output);
 	}
 
 	view->impl->destroy(view);
@@ -96,38 +103,55 @@ enum roots_deco_part view_get_deco_part(struct roots_view *view, double sx,
 	return parts;
 }
 
-static void view_update_output(const struct roots_view *view,
-		const struct wlr_box *before) {
-	struct roots_desktop *desktop = view->desktop;
+static void view_handle_output_enter(struct wl_listener *listener,
+		void *data) {
+	struct roots_view *view =
+		wl_container_of(listener, view, layout_surface_output_enter);
+	struct wlr_output *output = data;
+	if (view->toplevel_handle) {
+		wlr_foreign_toplevel_handle_v1_output_enter(view->toplevel_handle,
+			output);
+	}
+}
 
-	if (view->wlr_surface == NULL) {
+static void view_handle_output_leave(struct wl_listener *listener,
+		void *data) {
+	struct roots_view *view =
+		wl_container_of(listener, view, layout_surface_output_leave);
+	struct wlr_output *output = data;
+	if (view->toplevel_handle) {
+		wlr_foreign_toplevel_handle_v1_output_leave(view->toplevel_handle,
+			output);
+	}
+}
+
+// The layout surface sends enter and leave events, only for the outputs the
+// view started or stopped intersecting
+static void view_update_output(struct roots_view *view) {
+	if (view->layout_surface == NULL) {
 		return;
 	}
 
 	struct wlr_box box;
 	view_get_box(view, &box);
+	wlr_output_layout_surface_set_box(view->layout_surface, &box);
+}
 
-	struct roots_output *output;
-	wl_list_for_each(output, &desktop->outputs, link) {
-		bool intersected = before != NULL && wlr_output_layout_intersects(
-			desktop->layout, output->wlr_output, before);
-		bool intersects = wlr_output_layout_intersects(desktop->layout,
-			output->wlr_output, &box);
-		if (intersected && !intersects) {
-			wlr_surface_send_leave(view->wlr_surface, output->wlr_output);
-			if (view->toplevel_handle) {
-				wlr_foreign_toplevel_handle_v1_output_leave(
-					view->toplevel_handle, output->wlr_output);
-			}
-		}
-		if (!intersected && intersects) {
-			wlr_surface_send_enter(view->wlr_surface, output->wlr_output);
-			if (view->toplevel_handle) {
-				wlr_foreign_toplevel_handle_v1_output_enter(
-					view->toplevel_handle, output->wlr_output);
-			}
-		}
+static void view_create_layout_surface(struct roots_view *view) {
+	view->layout_surface = wlr_output_layout_surface_create(
+		view->desktop->layout, view->wlr_surface);
+	if (view->layout_surface == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
 	}
+	view->layout_surface_output_enter.notify = view_handle_output_enter;
+	wl_signal_add(&view->layout_surface->events.output_enter,
+		&view->layout_surface_output_enter);
+	view->layout_surface_output_leave.notify = view_handle_output_leave;
+	wl_signal_add(&view->layout_surface->events.output_leave,
+		&view->layout_surface_output_leave);
+
+	view_update_output(view);
 }
 
 void view_move(struct roots_view *view, double x, double y) {
@@ -135,14 +159,12 @@ void view_move(struct roots_view *view, double x, double y) {
 		return;
 	}
 
-	struct wlr_box before;
-	view_get_box(view, &before);
 	if (view->impl->move) {
 		view->impl->move(view, x, y);
 	} else {
 		view_update_position(view, x, y);
 	}
-	view_update_output(view, &before);
+	view_update_output(view);
 }
 
 void view_activate(struct roots_view *view, bool activate) {
@@ -154,15 +176,18 @@ void view_activate(struct roots_view *view, bool activate) {
 		wlr_foreign_toplevel_handle_v1_set_activated(view->toplevel_handle,
 			activate);
 	}
+
+	if (view->wlr_surface != NULL) {
+		wlr_surface_set_max_frame_rate(view->wlr_surface,
+			activate ? 0 : view->desktop->config->unfocused_frame_rate);
+	}
 }
 
 void view_resize(struct roots_view *view, uint32_t width, uint32_t height) {
-	struct wlr_box before;
-	view_get_box(view, &before);
 	if (view->impl->resize) {
 		view->impl->resize(view, width, height);
 	}
-	view_update_output(view, &before);
+	view_update_output(view);
 }
 
 void view_move_resize(struct roots_view *view, double x, double y,
@@ -259,6 +284,55 @@ void view_maximize(struct roots_view *view, bool maximized) {
 	}
 }
 
+/**
+ * Advertises the formats which can be scanned out to fullscreen views, so that
+ * clients allocate buffers eligible for direct scan-out.
+ */
+static void view_update_dmabuf_feedback(struct roots_view *view) {
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf = view->desktop->linux_dmabuf;
+	if (linux_dmabuf == NULL || view->wlr_surface == NULL) {
+		return;
+	}
+
+	struct wlr_output *output = view->fullscreen_output != NULL ?
+		view->fullscreen_output->wlr_output : NULL;
+	size_t formats_len = 0;
+	const struct wlr_dmabuf_format *formats = NULL;
+	if (output != NULL && wlr_output_is_drm(output)) {
+		formats = wlr_drm_connector_get_scanout_formats(output, &formats_len);
+	}
+
+	dev_t device;
+	struct wlr_renderer *renderer = view->desktop->server->renderer;
+	if (formats == NULL || !wlr_renderer_get_drm_device(renderer, &device)) {
+		wlr_linux_dmabuf_v1_set_surface_feedback(linux_dmabuf,
+			view->wlr_surface, NULL);
+		return;
+	}
+
+	// Scan-out formats first, then everything the renderer can import
+	const struct wlr_linux_dmabuf_feedback_v1_tranche tranches[] = {
+		{
+			.target_device = device,
+			.flags = WLR_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_SCANOUT,
+			.formats = formats,
+			.formats_len = formats_len,
+		},
+		{
+			.target_device = device,
+		},
+	};
+	const struct wlr_linux_dmabuf_feedback_v1 feedback = {
+		.main_device = device,
+		.tranches = tranches,
+		.tranches_len = sizeof(tranches) / sizeof(tranches[0]),
+	};
+	if (!wlr_linux_dmabuf_v1_set_surface_feedback(linux_dmabuf,
+			view->wlr_surface, &feedback)) {
+		wlr_log(WLR_DEBUG, "Failed to set scan-out dmabuf feedback");
+	}
+}
+
 void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 		struct wlr_output *output) {
 	bool was_fullscreen = view->fullscreen_output != NULL;
@@ -301,6 +375,7 @@ void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 		roots_output->fullscreen_view = view;
 		view->fullscreen_output = roots_output;
 		output_damage_whole(roots_output);
+		output_update_content_rate(roots_output);
 	}
 
 	if (was_fullscreen && !fullscreen) {
@@ -310,8 +385,11 @@ void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 
 		output_damage_whole(view->fullscreen_output);
 		view->fullscreen_output->fullscreen_view = NULL;
+		output_update_content_rate(view->fullscreen_output);
 		view->fullscreen_output = NULL;
 	}
+
+	view_update_dmabuf_feedback(view);
 }
 
 void view_rotate(struct roots_view *view, float rotation) {
@@ -370,11 +448,180 @@ bool view_center(struct roots_view *view) {
 	return true;
 }
 
+struct view_bounds {
+	struct roots_view *view;
+	int x1, y1, x2, y2;
+};
+
+static void view_bounds_add(struct view_bounds *bounds,
+		const struct wlr_box *box) {
+	if (wlr_box_empty(box)) {
+		return;
+	}
+	if (box->x < bounds->x1) {
+		bounds->x1 = box->x;
+	}
+	if (box->y < bounds->y1) {
+		bounds->y1 = box->y;
+	}
+	if (box->x + box->width > bounds->x2) {
+		bounds->x2 = box->x + box->width;
+	}
+	if (box->y + box->height > bounds->y2) {
+		bounds->y2 = box->y + box->height;
+	}
+}
+
+static void view_bounds_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct view_bounds *bounds = data;
+	struct wlr_box box = {
+		.x = bounds->view->box.x + sx,
+		.y = bounds->view->box.y + sy,
+		.width = surface->current.width,
+		.height = surface->current.height,
+	};
+	view_bounds_add(bounds, &box);
+}
+
+static struct roots_view_output *view_find_output(struct roots_view *view,
+		struct roots_output *output) {
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &view->outputs, view_link) {
+		if (view_output->output == output) {
+			return view_output;
+		}
+	}
+	return NULL;
+}
+
+static void view_add_output(struct roots_view *view,
+		struct roots_output *output) {
+	struct roots_view_output *view_output =
+		calloc(1, sizeof(struct roots_view_output));
+	if (view_output == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	view_output->view = view;
+	view_output->output = output;
+	wl_list_insert(&view->outputs, &view_output->view_link);
+
+	// Keep the stacking order: insert right below the closest view above
+	// this one on the output
+	struct wl_list *prev = &output->views;
+	for (struct wl_list *l = view->link.prev; l != &view->desktop->views;
+			l = l->prev) {
+		struct roots_view *above = wl_container_of(l, above, link);
+		struct roots_view_output *above_output =
+			view_find_output(above, output);
+		if (above_output != NULL) {
+			prev = &above_output->output_link;
+			break;
+		}
+	}
+	wl_list_insert(prev, &view_output->output_link);
+}
+
+void view_output_destroy(struct roots_view_output *view_output) {
+	if (view_output == NULL) {
+		return;
+	}
+	wl_list_remove(&view_output->view_link);
+	wl_list_remove(&view_output->output_link);
+	free(view_output);
+}
+
+static void view_clear_outputs(struct roots_view *view) {
+	struct roots_view_output *view_output, *tmp;
+	wl_list_for_each_safe(view_output, tmp, &view->outputs, view_link) {
+		view_output_destroy(view_output);
+	}
+}
+
+// Updates the box containing everything rendered for the view or found by
+// view_at, including decorations and popups, and which outputs it intersects
+void view_update_bounds(struct roots_view *view) {
+	if (view->wlr_surface == NULL) {
+		return;
+	}
+
+	struct wlr_box deco_box;
+	view_get_deco_box(view, &deco_box);
+	struct view_bounds bounds = {
+		.view = view,
+		.x1 = deco_box.x,
+		.y1 = deco_box.y,
+		.x2 = deco_box.x + deco_box.width,
+		.y2 = deco_box.y + deco_box.height,
+	};
+	view_for_each_surface(view, view_bounds_iterator, &bounds);
+
+	struct wlr_box box = {
+		.x = bounds.x1,
+		.y = bounds.y1,
+		.width = bounds.x2 - bounds.x1,
+		.height = bounds.y2 - bounds.y1,
+	};
+
+	if (view->rotation != 0.0) {
+		// The view rotates around its center, use the enclosing circle
+		double cx = view->box.x + (double)view->box.width / 2;
+		double cy = view->box.y + (double)view->box.height / 2;
+		double dx = fmax(fabs(bounds.x1 - cx), fabs(bounds.x2 - cx));
+		double dy = fmax(fabs(bounds.y1 - cy), fabs(bounds.y2 - cy));
+		double r = ceil(sqrt(dx * dx + dy * dy));
+		box.x = floor(cx - r);
+		box.y = floor(cy - r);
+		box.width = box.height = 2 * r + 1;
+	}
+
+	if (view->index_entry != NULL) {
+		wlr_spatial_index_entry_set_box(view->index_entry, &box);
+	}
+
+	struct roots_desktop *desktop = view->desktop;
+	struct roots_output *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		bool intersects = !wlr_box_empty(&box) &&
+			wlr_output_layout_intersects(desktop->layout,
+				output->wlr_output, &box);
+		struct roots_view_output *view_output =
+			view_find_output(view, output);
+		if (intersects && view_output == NULL) {
+			view_add_output(view, output);
+		} else if (!intersects && view_output != NULL) {
+			view_output_destroy(view_output);
+		}
+	}
+}
+
+void view_raise(struct roots_view *view) {
+	if (view->desktop->views.next != &view->link) {
+		// The decoration may now be drawn over other views
+		view->deco_damage.stale = true;
+	}
+
+	wl_list_remove(&view->link);
+	wl_list_insert(&view->desktop->views, &view->link);
+	if (view->index_entry != NULL) {
+		wlr_spatial_index_entry_raise(view->index_entry);
+	}
+
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &view->outputs, view_link) {
+		wl_list_remove(&view_output->output_link);
+		wl_list_insert(&view_output->output->views,
+			&view_output->output_link);
+	}
+}
+
 void view_child_destroy(struct roots_view_child *child) {
 	if (child == NULL) {
 		return;
 	}
 	view_damage_whole(child->view);
+	view_invalidate_cache(child->view);
 	wl_list_remove(&child->link);
 	wl_list_remove(&child->commit.link);
 	wl_list_remove(&child->new_subsurface.link);
@@ -436,6 +683,7 @@ static void subsurface_handle_map(struct wl_listener *listener,
 	struct roots_subsurface *subsurface =
 		wl_container_of(listener, subsurface, map);
 	struct roots_view *view = subsurface->view_child.view;
+	view_invalidate_cache(view);
 	view_damage_whole(view);
 	input_update_cursor_focus(view->desktop->server->input);
 }
@@ -445,6 +693,7 @@ static void subsurface_handle_unmap(struct wl_listener *listener,
 	struct roots_subsurface *subsurface =
 		wl_container_of(listener, subsurface, unmap);
 	struct roots_view *view = subsurface->view_child.view;
+	view_invalidate_cache(view);
 	view_damage_whole(view);
 	input_update_cursor_focus(view->desktop->server->input);
 }
@@ -491,8 +740,18 @@ void view_map(struct roots_view *view, struct wlr_surface *surface) {
 		&view->new_subsurface);
 
 	wl_list_insert(&view->desktop->views, &view->link);
+	if (view->desktop->view_index != NULL) {
+		struct wlr_box box = {0};
+		view->index_entry =
+			wlr_spatial_index_add(view->desktop->view_index, &box, view);
+	}
 	view_damage_whole(view);
 	input_update_cursor_focus(view->desktop->server->input);
+
+	if (view->fullscreen_output != NULL) {
+		view_update_dmabuf_feedback(view);
+		output_update_content_rate(view->fullscreen_output);
+	}
 }
 
 void view_unmap(struct roots_view *view) {
@@ -501,9 +760,26 @@ void view_unmap(struct roots_view *view) {
 	wl_signal_emit(&view->events.unmap, view);
 
 	view_damage_whole(view);
+	desktop_damage_view_decoration(view->desktop, view, false);
 	wl_list_remove(&view->link);
+	wlr_spatial_index_entry_destroy(view->index_entry);
+	view->index_entry = NULL;
+	view_clear_outputs(view);
+
+	struct roots_output *output;
+	wl_list_for_each(output, &view->desktop->outputs, link) {
+		output_cancel_view_move(output, view);
+	}
 
 	wl_list_remove(&view->new_subsurface.link);
+	view_invalidate_cache(view);
+
+	if (view->layout_surface != NULL) {
+		wl_list_remove(&view->layout_surface_output_enter.link);
+		wl_list_remove(&view->layout_surface_output_leave.link);
+		wlr_output_layout_surface_destroy(view->layout_surface);
+		view->layout_surface = NULL;
+	}
 
 	struct roots_view_child *child, *tmp;
 	wl_list_for_each_safe(child, tmp, &view->children, link) {
@@ -513,7 +789,9 @@ void view_unmap(struct roots_view *view) {
 	if (view->fullscreen_output != NULL) {
 		output_damage_whole(view->fullscreen_output);
 		view->fullscreen_output->fullscreen_view = NULL;
+		output_update_content_rate(view->fullscreen_output);
 		view->fullscreen_output = NULL;
+		view_update_dmabuf_feedback(view);
 	}
 
 	view->wlr_surface = NULL;
@@ -542,20 +820,32 @@ void view_setup(struct roots_view *view) {
 	}
 
 	view_create_foreign_toplevel_handle(view);
-	view_update_output(view, NULL);
+	view_create_layout_surface(view);
 }
 
+// Each change to the view's surfaces or geometry damages it, which is also
+// when its bounds need updating
 void view_apply_damage(struct roots_view *view) {
-	struct roots_output *output;
-	wl_list_for_each(output, &view->desktop->outputs, link) {
-		output_damage_from_view(output, view);
-	}
+	view_invalidate_cache(view);
+	view_update_bounds(view);
+
+	// Damage may extend beyond the current bounds if the view shrunk
+	desktop_damage_from_view(view->desktop, view);
+}
+
+void view_invalidate_cache(struct roots_view *view) {
+	wlr_texture_destroy(view->cache.texture);
+	view->cache.texture = NULL;
+	view->cache.idle_frames = 0;
 }
 
 void view_damage_whole(struct roots_view *view) {
-	struct roots_output *output;
-	wl_list_for_each(output, &view->desktop->outputs, link) {
-		output_damage_whole_view(output, view);
+	view_update_bounds(view);
+	desktop_damage_view_decoration(view->desktop, view, true);
+
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &view->outputs, view_link) {
+		output_damage_whole_view(view_output->output, view);
 	}
 }
 
@@ -573,10 +863,21 @@ void view_update_position(struct roots_view *view, int x, int y) {
 		return;
 	}
 
+	struct roots_view_output *view_output;
+	wl_list_for_each(view_output, &view->outputs, view_link) {
+		output_begin_view_move(view_output->output, view);
+	}
+
 	view_damage_whole(view);
 	view->box.x = x;
 	view->box.y = y;
 	view_damage_whole(view);
+	view_update_output(view);
+
+	struct roots_output *output;
+	wl_list_for_each(output, &view->desktop->outputs, link) {
+		output_end_view_move(output);
+	}
 }
 
 void view_update_size(struct roots_view *view, int width, int height) {
@@ -588,6 +889,7 @@ void view_update_size(struct roots_view *view, int width, int height) {
 	view->box.width = width;
 	view->box.height = height;
 	view_damage_whole(view);
+	view_update_output(view);
 }
 
 void view_update_decorated(struct roots_view *view, bool decorated) {
@@ -652,6 +954,8 @@ void view_create_foreign_toplevel_handle(struct roots_view *view) {
 	view->toplevel_handle =
 		wlr_foreign_toplevel_handle_v1_create(
 			view->desktop->foreign_toplevel_manager_v1);
+	wlr_foreign_toplevel_handle_v1_set_surface(view->toplevel_handle,
+		view->wlr_surface);
 
 	view->toplevel_handle_request_maximize.notify =
 		handle_toplevel_handle_request_maximize;
@@ -36,12 +36,14 @@ static void popup_handle_destroy(struct wl_listener *listener, void *data) {
 
 static void popup_handle_map(struct wl_listener *listener, void *data) {
 	struct roots_xdg_popup *popup = wl_container_of(listener, popup, map);
+	view_invalidate_cache(popup->view_child.view);
 	view_damage_whole(popup->view_child.view);
 	input_update_cursor_focus(popup->view_child.view->desktop->server->input);
 }
 
 static void popup_handle_unmap(struct wl_listener *listener, void *data) {
 	struct roots_xdg_popup *popup = wl_container_of(listener, popup, unmap);
+	view_invalidate_cache(popup->view_child.view);
 	view_damage_whole(popup->view_child.view);
 }
 
@@ -455,6 +457,9 @@ void handle_xdg_shell_surface(struct wl_listener *listener, void *data) {
 	wlr_log(WLR_DEBUG, "new xdg toplevel: title=%s, app_id=%s",
 		surface->toplevel->title, surface->toplevel->app_id);
 	wlr_xdg_surface_ping(surface);
+	// Interactive resizes configure on every pointer motion, don't let slow
+	// clients fall behind
+	wlr_xdg_surface_set_configure_throttle(surface, true);
 
 	struct roots_xdg_surface *roots_surface =
 		calloc(1, sizeof(struct roots_xdg_surface));
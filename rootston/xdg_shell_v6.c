@@ -35,6 +35,7 @@ static void popup_handle_destroy(struct wl_listener *listener, void *data) {
 static void popup_handle_map(struct wl_listener *listener, void *data) {
 	struct roots_xdg_popup_v6 *popup =
 		wl_container_of(listener, popup, map);
+	view_invalidate_cache(popup->view_child.view);
 	view_damage_whole(popup->view_child.view);
 	input_update_cursor_focus(popup->view_child.view->desktop->server->input);
 }
@@ -42,6 +43,7 @@ static void popup_handle_map(struct wl_listener *listener, void *data) {
 static void popup_handle_unmap(struct wl_listener *listener, void *data) {
 	struct roots_xdg_popup_v6 *popup =
 		wl_container_of(listener, popup, unmap);
+	view_invalidate_cache(popup->view_child.view);
 	view_damage_whole(popup->view_child.view);
 }
 
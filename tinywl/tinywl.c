@@ -8,6 +8,7 @@
 #include <wayland-server.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_data_device.h>
@@ -15,12 +16,14 @@
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include <xkbcommon/xkbcommon.h>
 
 /* For brevity's sake, struct members are annotated where they are used. */
@@ -35,6 +38,9 @@ struct tinywl_server {
 	struct wlr_backend *backend;
 	struct wlr_renderer *renderer;
 
+	struct wlr_compositor *compositor;
+	struct wl_listener new_surface;
+
 	struct wlr_xdg_shell *xdg_shell;
 	struct wl_listener new_xdg_surface;
 	struct wl_list views;
@@ -66,7 +72,9 @@ struct tinywl_output {
 	struct wl_list link;
 	struct tinywl_server *server;
 	struct wlr_output *wlr_output;
+	struct wlr_output_damage *damage;
 	struct wl_listener frame;
+	struct wl_listener destroy;
 };
 
 struct tinywl_view {
@@ -82,6 +90,13 @@ struct tinywl_view {
 	int x, y;
 };
 
+struct tinywl_surface {
+	struct tinywl_server *server;
+	struct wlr_surface *wlr_surface;
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
 struct tinywl_keyboard {
 	struct wl_list link;
 	struct tinywl_server *server;
@@ -91,6 +106,49 @@ struct tinywl_keyboard {
 	struct wl_listener key;
 };
 
+static void damage_layout_region(struct tinywl_server *server,
+		pixman_region32_t *region) {
+	/* Damage is the part of the screen which changed and needs to be drawn
+	 * again. Instead of redrawing everything on every frame, we accumulate it
+	 * per output with wlr_output_damage, which also schedules a frame. Here we
+	 * convert a region in layout coordinates to each output's pixels. */
+	struct tinywl_output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		double ox = 0, oy = 0;
+		wlr_output_layout_output_coords(
+				server->output_layout, output->wlr_output, &ox, &oy);
+		pixman_region32_t damage;
+		pixman_region32_init(&damage);
+		pixman_region32_copy(&damage, region);
+		pixman_region32_translate(&damage, ox, oy);
+		wlr_region_scale(&damage, &damage, output->wlr_output->scale);
+		wlr_output_damage_add(output->damage, &damage);
+		pixman_region32_fini(&damage);
+	}
+}
+
+static void damage_layout_box(struct tinywl_server *server,
+		int x, int y, int width, int height) {
+	pixman_region32_t region;
+	pixman_region32_init_rect(&region, x, y, width, height);
+	damage_layout_region(server, &region);
+	pixman_region32_fini(&region);
+}
+
+static void damage_whole_surface(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct tinywl_view *view = data;
+	damage_layout_box(view->server, view->x + sx, view->y + sy,
+		surface->current.width, surface->current.height);
+}
+
+static void damage_whole_view(struct tinywl_view *view) {
+	/* Used when a view appears, disappears, moves or is raised: everything it
+	 * covers needs to be drawn again. */
+	wlr_xdg_surface_for_each_surface(view->xdg_surface,
+			damage_whole_surface, view);
+}
+
 static void focus_view(struct tinywl_view *view, struct wlr_surface *surface) {
 	/* Note: this function only deals with keyboard focus. */
 	if (view == NULL) {
@@ -117,6 +175,8 @@ static void focus_view(struct tinywl_view *view, struct wlr_surface *surface) {
 	/* Move the view to the front */
 	wl_list_remove(&view->link);
 	wl_list_insert(&server->views, &view->link);
+	/* The parts which were hidden under other views are now visible */
+	damage_whole_view(view);
 	/* Activate the new surface */
 	wlr_xdg_toplevel_set_activated(view->xdg_surface, true);
 	/*
@@ -342,9 +402,12 @@ static struct tinywl_view *desktop_view_at(
 }
 
 static void process_cursor_move(struct tinywl_server *server, uint32_t time) {
-	/* Move the grabbed view to the new position. */
+	/* Move the grabbed view to the new position. Both the area it leaves and
+	 * the area it moves to need to be repainted. */
+	damage_whole_view(server->grabbed_view);
 	server->grabbed_view->x = server->cursor->x - server->grab_x;
 	server->grabbed_view->y = server->cursor->y - server->grab_y;
+	damage_whole_view(server->grabbed_view);
 }
 
 static void process_cursor_resize(struct tinywl_server *server, uint32_t time) {
@@ -383,8 +446,10 @@ static void process_cursor_resize(struct tinywl_server *server, uint32_t time) {
 	} else if (server->resize_edges & WLR_EDGE_RIGHT) {
 		width += dx;
 	}
+	damage_whole_view(view);
 	view->x = x;
 	view->y = y;
+	damage_whole_view(view);
 	wlr_xdg_toplevel_set_size(view->xdg_surface, width, height);
 }
 
@@ -518,8 +583,28 @@ struct render_data {
 	struct wlr_renderer *renderer;
 	struct tinywl_view *view;
 	struct timespec *when;
+	pixman_region32_t *damage;
+	int surfaces, surfaces_drawn;
 };
 
+static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
+	/* Damage is tracked in output coordinates, but the scissor box is in
+	 * buffer coordinates, which differ when the output is rotated. */
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+	wlr_box_transform(&box, &box, transform, ow, oh);
+	wlr_renderer_scissor(renderer, &box);
+}
+
 static void render_surface(struct wlr_surface *surface,
 		int sx, int sy, void *data) {
 	/* This function is called for every surface that needs to be rendered. */
@@ -536,6 +621,7 @@ static void render_surface(struct wlr_surface *surface,
 	if (texture == NULL) {
 		return;
 	}
+	rdata->surfaces++;
 
 	/* The view has a position in layout coordinates. If you have two displays,
 	 * one next to the other, both 1080p, a view on the rightmost display might
@@ -572,70 +658,154 @@ static void render_surface(struct wlr_surface *surface,
 	wlr_matrix_project_box(matrix, &box, transform, 0,
 		output->transform_matrix);
 
-	/* This takes our matrix, the texture, and an alpha, and performs the actual
-	 * rendering on the GPU. */
-	wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+	/* Only the damaged part of the surface needs to be drawn again, the rest of
+	 * the output buffer still holds what we drew in previous frames. */
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, box.x, box.y, box.width, box.height);
+	pixman_region32_intersect(&damage, &damage, rdata->damage);
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		/* This takes our matrix, the texture, and an alpha, and performs the
+		 * actual rendering on the GPU. The scissor box restricts drawing to
+		 * the damaged rectangle. */
+		scissor_output(output, &rects[i]);
+		wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+	}
+	if (nrects > 0) {
+		rdata->surfaces_drawn++;
+	}
+	pixman_region32_fini(&damage);
 
 	/* This lets the client know that we've displayed that frame and it can
-	 * prepare another one now if it likes. */
+	 * prepare another one now if it likes. This is needed even if nothing was
+	 * drawn, otherwise the client would wait forever. */
 	wlr_surface_send_frame_done(surface, rdata->when);
 }
 
 static void output_frame(struct wl_listener *listener, void *data) {
 	/* This function is called every time an output is ready to display a frame,
-	 * generally at the output's refresh rate (e.g. 60Hz). */
+	 * generally at the output's refresh rate (e.g. 60Hz), if something on it
+	 * was damaged. */
 	struct tinywl_output *output =
 		wl_container_of(listener, output, frame);
+	struct wlr_output *wlr_output = output->wlr_output;
 	struct wlr_renderer *renderer = output->server->renderer;
 
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	/* wlr_output_make_current makes the OpenGL context current. */
-	if (!wlr_output_make_current(output->wlr_output, NULL)) {
+	/* wlr_output_damage_make_current makes the OpenGL context current, and
+	 * gives us the region which needs to be repainted. This is the damage
+	 * accumulated since this buffer was last displayed, which includes the
+	 * damage of previous frames if the backend swaps between several
+	 * buffers. */
+	bool needs_swap;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (!wlr_output_damage_make_current(output->damage, &needs_swap, &damage)) {
+		pixman_region32_fini(&damage);
 		return;
 	}
-	/* The "effective" resolution can change if you rotate your outputs. */
-	int width, height;
-	wlr_output_effective_resolution(output->wlr_output, &width, &height);
-	/* Begin the renderer (calls glViewport and some other GL sanity checks) */
-	wlr_renderer_begin(renderer, width, height);
 
-	float color[4] = {0.3, 0.3, 0.3, 1.0};
-	wlr_renderer_clear(renderer, color);
+	struct render_data rdata = {
+		.output = wlr_output,
+		.renderer = renderer,
+		.when = &now,
+		.damage = &damage,
+	};
+
+	if (needs_swap) {
+		/* Begin the renderer (calls glViewport and some other GL sanity
+		 * checks). The buffer size doesn't depend on the output transform. */
+		wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+
+		/* Clear the damaged part of the background. */
+		float color[4] = {0.3, 0.3, 0.3, 1.0};
+		int nrects;
+		pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+		for (int i = 0; i < nrects; ++i) {
+			scissor_output(wlr_output, &rects[i]);
+			wlr_renderer_clear(renderer, color);
+		}
+	}
 
 	/* Each subsequent window we render is rendered on top of the last. Because
-	 * our view list is ordered front-to-back, we iterate over it backwards. */
+	 * our view list is ordered front-to-back, we iterate over it backwards.
+	 * If nothing needs to be repainted, the damage is empty and this only
+	 * sends frame done events. */
 	struct tinywl_view *view;
 	wl_list_for_each_reverse(view, &output->server->views, link) {
 		if (!view->mapped) {
 			/* An unmapped view should not be rendered. */
 			continue;
 		}
-		struct render_data rdata = {
-			.output = output->wlr_output,
-			.view = view,
-			.renderer = renderer,
-			.when = &now,
-		};
+		rdata.view = view;
 		/* This calls our render_surface function for each surface among the
 		 * xdg_surface's toplevel and popups. */
 		wlr_xdg_surface_for_each_surface(view->xdg_surface,
 				render_surface, &rdata);
 	}
 
+	if (!needs_swap) {
+		/* Nothing changed on this output, keep displaying the same buffer. */
+		pixman_region32_fini(&damage);
+		return;
+	}
+
 	/* Hardware cursors are rendered by the GPU on a separate plane, and can be
 	 * moved around without re-rendering what's beneath them - which is more
 	 * efficient. However, not all hardware supports hardware cursors. For this
 	 * reason, wlroots provides a software fallback, which we ask it to render
 	 * here. wlr_cursor handles configuring hardware vs software cursors for you,
 	 * and this function is a no-op when hardware cursors are in use. */
-	wlr_output_render_software_cursors(output->wlr_output, NULL);
+	wlr_output_render_software_cursors(wlr_output, &damage);
 
-	/* Conclude rendering and swap the buffers, showing the final frame
-	 * on-screen. */
+	/* Conclude rendering. */
+	wlr_renderer_scissor(renderer, NULL);
 	wlr_renderer_end(renderer);
-	wlr_output_swap_buffers(output->wlr_output, NULL, NULL);
+
+#ifdef TINYWL_RENDER_STATS
+	/* Built with `make RENDER_STATS=1`: prints how much of the output was
+	 * repainted and how long it took, to check that small changes only cause
+	 * small repaints. */
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	int64_t area = 0;
+	for (int i = 0; i < nrects; ++i) {
+		area += (int64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+	int64_t output_area = (int64_t)wlr_output->width * wlr_output->height;
+	wlr_log(WLR_INFO, "%s: %d damage rects (%.1f%% of the output), "
+		"%d/%d surfaces drawn in %.2f ms", wlr_output->name, nrects,
+		output_area > 0 ? 100.0 * area / output_area : 0.0,
+		rdata.surfaces_drawn, rdata.surfaces,
+		(end.tv_sec - now.tv_sec) * 1000.0 +
+		(end.tv_nsec - now.tv_nsec) / 1000000.0);
+#endif
+
+	/* Swap the buffers, showing the final frame on-screen. The damage is
+	 * passed along so that the backend and wlr_output_damage know which part
+	 * of the buffer changed. It is expected in buffer coordinates. */
+	int width, height;
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(wlr_output->transform);
+	wlr_region_transform(&damage, &damage, transform, width, height);
+	wlr_output_damage_swap_buffers(output->damage, &now, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static void output_destroy(struct wl_listener *listener, void *data) {
+	/* The output damage is destroyed along with the output. */
+	struct tinywl_output *output = wl_container_of(listener, output, destroy);
+	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->destroy.link);
+	wl_list_remove(&output->link);
+	free(output);
 }
 
 static void server_new_output(struct wl_listener *listener, void *data) {
@@ -661,9 +831,14 @@ static void server_new_output(struct wl_listener *listener, void *data) {
 		calloc(1, sizeof(struct tinywl_output));
 	output->wlr_output = wlr_output;
 	output->server = server;
-	/* Sets up a listener for the frame notify event. */
+	/* wlr_output_damage keeps track of the damaged parts of the output, and
+	 * only emits frame events when something needs to be repainted. Sets up a
+	 * listener for its frame notify event. */
+	output->damage = wlr_output_damage_create(wlr_output);
 	output->frame.notify = output_frame;
-	wl_signal_add(&wlr_output->events.frame, &output->frame);
+	wl_signal_add(&output->damage->events.frame, &output->frame);
+	output->destroy.notify = output_destroy;
+	wl_signal_add(&output->damage->events.destroy, &output->destroy);
 	wl_list_insert(&server->outputs, &output->link);
 
 	/* Adds this to the output layout. The add_auto function arranges outputs
@@ -682,6 +857,7 @@ static void xdg_surface_map(struct wl_listener *listener, void *data) {
 	/* Called when the surface is mapped, or ready to display on-screen. */
 	struct tinywl_view *view = wl_container_of(listener, view, map);
 	view->mapped = true;
+	damage_whole_view(view);
 	focus_view(view, view->xdg_surface->surface);
 }
 
@@ -689,6 +865,7 @@ static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
 	/* Called when the surface is unmapped, and should no longer be shown. */
 	struct tinywl_view *view = wl_container_of(listener, view, unmap);
 	view->mapped = false;
+	damage_whole_view(view);
 }
 
 static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
@@ -749,6 +926,90 @@ static void xdg_toplevel_request_resize(
 	begin_interactive(view, TINYWL_CURSOR_RESIZE, event->edges);
 }
 
+/* Used to find where a surface is among the surfaces of a view. */
+struct surface_position {
+	struct wlr_surface *surface;
+	bool found;
+	int sx, sy;
+};
+
+static void find_surface(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct surface_position *pos = data;
+	if (surface == pos->surface) {
+		pos->found = true;
+		pos->sx = sx;
+		pos->sy = sy;
+	}
+}
+
+static void surface_commit(struct wl_listener *listener, void *data) {
+	/* Called when a client commits new state for a surface, for instance a new
+	 * buffer. The client tells us which part of the buffer changed, which we
+	 * add to the damage of the outputs showing it. */
+	struct tinywl_surface *tsurface =
+		wl_container_of(listener, tsurface, commit);
+	struct tinywl_server *server = tsurface->server;
+	struct wlr_surface *surface = tsurface->wlr_surface;
+
+	/* Toplevels, popups and subsurfaces all end up here, so we look for the
+	 * view the surface belongs to. Other surfaces, e.g. cursor images, are
+	 * ignored: wlr_cursor takes care of them. */
+	struct surface_position pos = { .surface = surface };
+	struct tinywl_view *view;
+	wl_list_for_each(view, &server->views, link) {
+		wlr_xdg_surface_for_each_surface(view->xdg_surface,
+				find_surface, &pos);
+		if (pos.found) {
+			break;
+		}
+	}
+	if (!pos.found) {
+		return;
+	}
+
+	/* The effective damage is in surface-local coordinates. It also covers
+	 * the previous bounds of the surface if it shrank or was unmapped. */
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	wlr_surface_get_effective_damage(surface, &damage);
+	pixman_region32_translate(&damage,
+		view->x + pos.sx, view->y + pos.sy);
+	damage_layout_region(server, &damage);
+	pixman_region32_fini(&damage);
+
+	/* The client may be waiting for a frame done event even if nothing was
+	 * damaged, make sure we render a frame to send it. */
+	struct tinywl_output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+}
+
+static void surface_destroy(struct wl_listener *listener, void *data) {
+	struct tinywl_surface *tsurface =
+		wl_container_of(listener, tsurface, destroy);
+	wl_list_remove(&tsurface->commit.link);
+	wl_list_remove(&tsurface->destroy.link);
+	free(tsurface);
+}
+
+static void server_new_surface(struct wl_listener *listener, void *data) {
+	/* This event is raised by wlr_compositor for every surface created by a
+	 * client, before it is given a role such as xdg_toplevel. */
+	struct tinywl_server *server =
+		wl_container_of(listener, server, new_surface);
+	struct wlr_surface *surface = data;
+
+	struct tinywl_surface *tsurface = calloc(1, sizeof(struct tinywl_surface));
+	tsurface->server = server;
+	tsurface->wlr_surface = surface;
+	tsurface->commit.notify = surface_commit;
+	wl_signal_add(&surface->events.commit, &tsurface->commit);
+	tsurface->destroy.notify = surface_destroy;
+	wl_signal_add(&surface->events.destroy, &tsurface->destroy);
+}
+
 static void server_new_xdg_surface(struct wl_listener *listener, void *data) {
 	/* This event is raised when wlr_xdg_shell receives a new xdg surface from a
 	 * client, either a toplevel (application window) or popup. */
@@ -828,9 +1089,16 @@ int main(int argc, char *argv[]) {
 	 * necessary for clients to allocate surfaces and the data device manager
 	 * handles the clipboard. Each of these wlroots interfaces has room for you
 	 * to dig your fingers in and play with their behavior if you want. */
-	wlr_compositor_create(server.wl_display, server.renderer);
+	server.compositor =
+		wlr_compositor_create(server.wl_display, server.renderer);
 	wlr_data_device_manager_create(server.wl_display);
 
+	/* Listen to new surfaces, to know when their content changes and damage
+	 * the outputs accordingly. */
+	server.new_surface.notify = server_new_surface;
+	wl_signal_add(&server.compositor->events.new_surface,
+			&server.new_surface);
+
 	/* Creates an output layout, which a wlroots utility for working with an
 	 * arrangement of screens in a physical layout. */
 	server.output_layout = wlr_output_layout_create();
@@ -4,6 +4,7 @@
 #include <strings.h>
 #include <unistd.h>
 #include <wayland-server.h>
+#include <wlr/types/wlr_client_stats.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
@@ -87,6 +88,10 @@ static void data_offer_handle_accept(struct wl_client *client,
 
 static void data_offer_handle_receive(struct wl_client *client,
 		struct wl_resource *resource, const char *mime_type, int32_t fd) {
+	struct wlr_client_stats *stats = wlr_client_stats_get(client);
+	if (stats != NULL) {
+		stats->data_transfers++;
+	}
 	struct wlr_data_offer *offer = data_offer_from_resource(resource);
 	if (offer == NULL) {
 		close(fd);
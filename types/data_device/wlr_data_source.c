@@ -8,6 +8,7 @@
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
+#include <wlr/util/mime_type.h>
 #include "types/wlr_data_device.h"
 #include "util/signal.h"
 
@@ -41,9 +42,9 @@ void wlr_data_source_destroy(struct wlr_data_source *source) {
 
 	wlr_signal_emit_safe(&source->events.destroy, source);
 
-	char **p;
+	const char **p;
 	wl_array_for_each(p, &source->mime_types) {
-		free(*p);
+		wlr_mime_type_unref(*p);
 	}
 	wl_array_release(&source->mime_types);
 
@@ -190,29 +191,30 @@ static void data_source_offer(struct wl_client *client,
 			"wl_data_device.set_selection");
 	}
 
+	const char *interned = wlr_mime_type_intern(mime_type);
+	if (interned == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
 	const char **mime_type_ptr;
 	wl_array_for_each(mime_type_ptr, &source->source.mime_types) {
-		if (strcmp(*mime_type_ptr, mime_type) == 0) {
+		if (*mime_type_ptr == interned) {
 			wlr_log(WLR_DEBUG, "Ignoring duplicate MIME type offer %s",
 				mime_type);
+			wlr_mime_type_unref(interned);
 			return;
 		}
 	}
 
-	char *dup_mime_type = strdup(mime_type);
-	if (dup_mime_type == NULL) {
-		wl_resource_post_no_memory(resource);
-		return;
-	}
-
-	char **p = wl_array_add(&source->source.mime_types, sizeof(*p));
+	const char **p = wl_array_add(&source->source.mime_types, sizeof(*p));
 	if (p == NULL) {
-		free(dup_mime_type);
+		wlr_mime_type_unref(interned);
 		wl_resource_post_no_memory(resource);
 		return;
 	}
 
-	*p = dup_mime_type;
+	*p = interned;
 }
 
 static const struct wl_data_source_interface data_source_impl = {
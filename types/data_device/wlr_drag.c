@@ -19,12 +19,75 @@ static void drag_handle_seat_client_destroy(struct wl_listener *listener,
 	wl_list_remove(&drag->seat_client_destroy.link);
 }
 
+static void drag_send_motion(struct wlr_drag *drag) {
+	if (drag->focus == NULL || drag->focus_client == NULL) {
+		return;
+	}
+
+	uint32_t time = drag->motion.time;
+	double sx = drag->motion.sx, sy = drag->motion.sy;
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &drag->focus_client->data_devices) {
+		wl_data_device_send_motion(resource, time, wl_fixed_from_double(sx),
+			wl_fixed_from_double(sy));
+	}
+
+	struct wlr_drag_motion_event event = {
+		.drag = drag,
+		.time = time,
+		.sx = sx,
+		.sy = sy,
+	};
+	wlr_signal_emit_safe(&drag->events.motion, &event);
+}
+
+static void drag_handle_motion_idle(void *data) {
+	struct wlr_drag *drag = data;
+	drag->motion.idle = NULL;
+	drag_send_motion(drag);
+}
+
+/**
+ * Motion events are coalesced until the event loop is idle, so that targets
+ * get at most one motion per batch of input events.
+ */
+static void drag_queue_motion(struct wlr_drag *drag, uint32_t time,
+		double sx, double sy) {
+	drag->motion.time = time;
+	drag->motion.sx = sx;
+	drag->motion.sy = sy;
+	if (drag->motion.idle != NULL) {
+		return;
+	}
+
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(drag->seat->display);
+	drag->motion.idle =
+		wl_event_loop_add_idle(loop, drag_handle_motion_idle, drag);
+	if (drag->motion.idle == NULL) {
+		drag_send_motion(drag);
+	}
+}
+
+// Sends the queued motion, if any, before an event which depends on it
+static void drag_flush_motion(struct wlr_drag *drag) {
+	if (drag->motion.idle == NULL) {
+		return;
+	}
+	wl_event_source_remove(drag->motion.idle);
+	drag->motion.idle = NULL;
+	drag_send_motion(drag);
+}
+
 static void drag_set_focus(struct wlr_drag *drag,
 		struct wlr_surface *surface, double sx, double sy) {
 	if (drag->focus == surface) {
 		return;
 	}
 
+	// Queued motion is relative to the previous focus
+	drag_flush_motion(drag);
+
 	if (drag->focus_client) {
 		wl_list_remove(&drag->seat_client_destroy.link);
 
@@ -124,6 +187,11 @@ static void drag_destroy(struct wlr_drag *drag) {
 	}
 	drag->cancelling = true;
 
+	if (drag->motion.idle != NULL) {
+		wl_event_source_remove(drag->motion.idle);
+		drag->motion.idle = NULL;
+	}
+
 	wlr_signal_emit_safe(&drag->events.destroy, drag);
 
 	if (drag->started) {
@@ -163,25 +231,14 @@ static void drag_handle_pointer_motion(struct wlr_seat_pointer_grab *grab,
 		uint32_t time, double sx, double sy) {
 	struct wlr_drag *drag = grab->data;
 	if (drag->focus != NULL && drag->focus_client != NULL) {
-		struct wl_resource *resource;
-		wl_resource_for_each(resource, &drag->focus_client->data_devices) {
-			wl_data_device_send_motion(resource, time, wl_fixed_from_double(sx),
-				wl_fixed_from_double(sy));
-		}
-
-		struct wlr_drag_motion_event event = {
-			.drag = drag,
-			.time = time,
-			.sx = sx,
-			.sy = sy,
-		};
-		wlr_signal_emit_safe(&drag->events.motion, &event);
+		drag_queue_motion(drag, time, sx, sy);
 	}
 }
 
 static void drag_drop(struct wlr_drag *drag, uint32_t time) {
 	assert(drag->focus_client);
 
+	drag_flush_motion(drag);
 	drag->dropped = true;
 
 	struct wl_resource *resource;
@@ -268,12 +325,7 @@ static void drag_handle_touch_motion(struct wlr_seat_touch_grab *grab,
 		uint32_t time, struct wlr_touch_point *point) {
 	struct wlr_drag *drag = grab->data;
 	if (drag->focus && drag->focus_client) {
-		struct wl_resource *resource;
-		wl_resource_for_each(resource, &drag->focus_client->data_devices) {
-			wl_data_device_send_motion(resource, time,
-				wl_fixed_from_double(point->sx),
-				wl_fixed_from_double(point->sy));
-		}
+		drag_queue_motion(drag, time, point->sx, point->sy);
 	}
 }
 
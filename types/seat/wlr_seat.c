@@ -14,6 +14,65 @@
 
 #define SEAT_VERSION 6
 
+#define SEAT_CLIENT_BUCKETS_MIN_LEN 16
+
+static struct wl_list *seat_client_bucket(struct wlr_seat *seat,
+		struct wl_client *client) {
+	// Fibonacci hashing, the low bits of the pointer are always zero
+	uint64_t hash = ((uintptr_t)client >> 4) * 11400714819323198485ull;
+	return &seat->client_buckets[(hash >> 32) &
+		(seat->client_buckets_len - 1)];
+}
+
+static bool seat_resize_client_buckets(struct wlr_seat *seat, size_t len) {
+	struct wl_list *buckets = calloc(len, sizeof(struct wl_list));
+	if (buckets == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		wl_list_init(&buckets[i]);
+	}
+
+	free(seat->client_buckets);
+	seat->client_buckets = buckets;
+	seat->client_buckets_len = len;
+
+	struct wlr_seat_client *client;
+	wl_list_for_each(client, &seat->clients, link) {
+		wl_list_insert(seat_client_bucket(seat, client->client),
+			&client->bucket_link);
+	}
+	return true;
+}
+
+static bool seat_add_client(struct wlr_seat *seat,
+		struct wlr_seat_client *client) {
+	if (seat->client_buckets == NULL) {
+		if (!seat_resize_client_buckets(seat, SEAT_CLIENT_BUCKETS_MIN_LEN)) {
+			return false;
+		}
+	}
+
+	wl_list_insert(&seat->clients, &client->link);
+	wl_list_insert(seat_client_bucket(seat, client->client),
+		&client->bucket_link);
+	seat->clients_len++;
+
+	// Keep at most one client per bucket on average. If growing fails, the
+	// table still works with longer chains.
+	if (seat->clients_len > seat->client_buckets_len) {
+		seat_resize_client_buckets(seat, 2 * seat->client_buckets_len);
+	}
+	return true;
+}
+
+static void seat_remove_client(struct wlr_seat *seat,
+		struct wlr_seat_client *client) {
+	wl_list_remove(&client->bucket_link);
+	wl_list_remove(&client->link);
+	seat->clients_len--;
+}
+
 static void seat_handle_get_pointer(struct wl_client *client,
 		struct wl_resource *seat_resource, uint32_t id) {
 	struct wlr_seat_client *seat_client =
@@ -94,7 +153,7 @@ static void seat_client_handle_resource_destroy(
 		wl_list_init(link);
 	}
 
-	wl_list_remove(&client->link);
+	seat_remove_client(client->seat, client);
 	free(client);
 }
 
@@ -141,7 +200,12 @@ static void seat_handle_bind(struct wl_client *client, void *_wlr_seat,
 		wl_list_init(&seat_client->data_devices);
 		wl_signal_init(&seat_client->events.destroy);
 
-		wl_list_insert(&wlr_seat->clients, &seat_client->link);
+		if (!seat_add_client(wlr_seat, seat_client)) {
+			free(seat_client);
+			wl_resource_destroy(wl_resource);
+			wl_client_post_no_memory(client);
+			return;
+		}
 	}
 
 	wl_resource_set_implementation(wl_resource, &seat_impl,
@@ -182,10 +246,17 @@ void wlr_seat_destroy(struct wlr_seat *seat) {
 		}
 	}
 
+	if (seat->pointer_state.motion_timer != NULL) {
+		wl_event_source_remove(seat->pointer_state.motion_timer);
+	}
+	if (seat->touch_state.frame_source != NULL) {
+		wl_event_source_remove(seat->touch_state.frame_source);
+	}
 	wl_global_destroy(seat->global);
 	free(seat->pointer_state.default_grab);
 	free(seat->keyboard_state.default_grab);
 	free(seat->touch_state.default_grab);
+	free(seat->client_buckets);
 	free(seat->name);
 	free(seat);
 }
@@ -298,8 +369,13 @@ struct wlr_seat *wlr_seat_create(struct wl_display *display, const char *name) {
 
 struct wlr_seat_client *wlr_seat_client_for_wl_client(struct wlr_seat *wlr_seat,
 		struct wl_client *wl_client) {
+	if (wlr_seat->client_buckets == NULL) {
+		return NULL;
+	}
+
 	struct wlr_seat_client *seat_client;
-	wl_list_for_each(seat_client, &wlr_seat->clients, link) {
+	wl_list_for_each(seat_client, seat_client_bucket(wlr_seat, wl_client),
+			bucket_link) {
 		if (seat_client->client == wl_client) {
 			return seat_client;
 		}
@@ -2,9 +2,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <time.h>
-#include <unistd.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_gtk_primary_selection.h>
@@ -12,8 +10,8 @@
 #include <wlr/util/log.h>
 #include "types/wlr_data_device.h"
 #include "types/wlr_seat.h"
-#include "util/shm.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 static void default_keyboard_enter(struct wlr_seat_keyboard_grab *grab,
 		struct wlr_surface *surface, uint32_t keycodes[], size_t num_keycodes,
@@ -67,6 +65,7 @@ static void keyboard_handle_resource_destroy(struct wl_resource *resource) {
 
 void wlr_seat_keyboard_send_key(struct wlr_seat *wlr_seat, uint32_t time,
 		uint32_t key, uint32_t state) {
+	wlr_trace(seat_keyboard_key, wlr_seat, time, key, state);
 	struct wlr_seat_client *client = wlr_seat->keyboard_state.focused_client;
 	if (!client) {
 		return;
@@ -127,6 +126,12 @@ void wlr_seat_set_keyboard(struct wlr_seat *seat,
 		return;
 	}
 
+	// Keyboards sharing a keymap share its file, don't resend it
+	int prev_keymap_fd = -1;
+	if (seat->keyboard_state.keyboard) {
+		prev_keymap_fd = seat->keyboard_state.keyboard->keymap_fd;
+	}
+
 	if (seat->keyboard_state.keyboard) {
 		wl_list_remove(&seat->keyboard_state.keyboard_destroy.link);
 		wl_list_remove(&seat->keyboard_state.keyboard_keymap.link);
@@ -150,8 +155,12 @@ void wlr_seat_set_keyboard(struct wlr_seat *seat,
 			handle_keyboard_repeat_info;
 
 		struct wlr_seat_client *client;
+		bool keymap_changed =
+			keyboard->keymap_fd < 0 || keyboard->keymap_fd != prev_keymap_fd;
 		wl_list_for_each(client, &seat->clients, link) {
-			seat_client_send_keymap(client, keyboard);
+			if (keymap_changed) {
+				seat_client_send_keymap(client, keyboard);
+			}
 			seat_client_send_repeat_info(client, keyboard);
 		}
 
@@ -336,7 +345,7 @@ void wlr_seat_keyboard_notify_key(struct wlr_seat *seat, uint32_t time,
 
 static void seat_client_send_keymap(struct wlr_seat_client *client,
 		struct wlr_keyboard *keyboard) {
-	if (!keyboard) {
+	if (!keyboard || keyboard->keymap_fd < 0) {
 		return;
 	}
 
@@ -348,28 +357,11 @@ static void seat_client_send_keymap(struct wlr_seat_client *client,
 			continue;
 		}
 
-		int keymap_fd = allocate_shm_file(keyboard->keymap_size);
-		if (keymap_fd < 0) {
-			wlr_log(WLR_ERROR, "creating a keymap file for %zu bytes failed", keyboard->keymap_size);
-			continue;
-		}
-
-		void *ptr = mmap(NULL, keyboard->keymap_size, PROT_READ | PROT_WRITE,
-				MAP_SHARED, keymap_fd, 0);
-		if (ptr == MAP_FAILED) {
-			wlr_log(WLR_ERROR, "failed to mmap() %zu bytes", keyboard->keymap_size);
-			close(keymap_fd);
-			continue;
-		}
-
-		strcpy(ptr, keyboard->keymap_string);
-		munmap(ptr, keyboard->keymap_size);
-
+		// The file descriptor is duplicated when sent, all clients and seats
+		// share the keyboard's keymap file
 		wl_keyboard_send_keymap(resource,
-			WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, keymap_fd,
+			WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, keyboard->keymap_fd,
 			keyboard->keymap_size);
-
-		close(keymap_fd);
 	}
 }
 
@@ -8,6 +8,7 @@
 #include <wlr/util/log.h>
 #include "types/wlr_seat.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 static void default_pointer_enter(struct wlr_seat_pointer_grab *grab,
 		struct wlr_surface *surface, double sx, double sy) {
@@ -135,6 +136,9 @@ void wlr_seat_pointer_enter(struct wlr_seat *wlr_seat,
 		return;
 	}
 
+	// Held back motion belongs to the previously entered surface
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	struct wlr_seat_client *client = NULL;
 	if (surface) {
 		struct wl_client *wl_client = wl_resource_get_client(surface->resource);
@@ -209,8 +213,9 @@ void wlr_seat_pointer_clear_focus(struct wlr_seat *wlr_seat) {
 	wlr_seat_pointer_enter(wlr_seat, NULL, 0, 0);
 }
 
-void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
+static void pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
 		double sx, double sy) {
+	wlr_trace(seat_pointer_motion, wlr_seat, time);
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
 	if (client == NULL) {
 		return;
@@ -234,13 +239,92 @@ void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
 	wlr_seat->pointer_state.sy = sy;
 }
 
+void wlr_seat_pointer_flush_motion(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!state->pending_motion.pending) {
+		return;
+	}
+	bool frame = state->pending_motion.frame;
+	state->pending_motion.pending = false;
+	state->pending_motion.frame = false;
+	if (state->motion_timer != NULL) {
+		wl_event_source_timer_update(state->motion_timer, 0);
+	}
+
+	pointer_send_motion(wlr_seat, state->pending_motion.time_msec,
+		state->pending_motion.sx, state->pending_motion.sy);
+	if (frame) {
+		wlr_seat_pointer_send_frame(wlr_seat);
+	}
+}
+
+static int pointer_handle_motion_timer(void *data) {
+	struct wlr_seat *wlr_seat = data;
+	wlr_seat_pointer_flush_motion(wlr_seat);
+	return 0;
+}
+
+void wlr_seat_pointer_set_coalesce_motion(struct wlr_seat *wlr_seat,
+		bool coalesce) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!coalesce) {
+		wlr_seat_pointer_flush_motion(wlr_seat);
+		if (state->motion_timer != NULL) {
+			wl_event_source_remove(state->motion_timer);
+			state->motion_timer = NULL;
+		}
+		state->coalesce_motion = false;
+		return;
+	}
+
+	if (state->motion_timer == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(wlr_seat->display);
+		state->motion_timer = wl_event_loop_add_timer(loop,
+			pointer_handle_motion_timer, wlr_seat);
+		if (state->motion_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create motion coalescing timer");
+			return;
+		}
+	}
+	state->coalesce_motion = true;
+}
+
+void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
+		double sx, double sy) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!state->coalesce_motion) {
+		pointer_send_motion(wlr_seat, time, sx, sy);
+		return;
+	}
+
+	if (state->focused_client == NULL) {
+		return;
+	}
+
+	// Only keep the latest position, the timer makes sure it's sent even if
+	// the compositor doesn't flush motion
+	if (!state->pending_motion.pending) {
+		wl_event_source_timer_update(state->motion_timer,
+			WLR_SEAT_POINTER_COALESCE_MOTION_MS);
+	}
+	state->pending_motion.pending = true;
+	state->pending_motion.time_msec = time;
+	state->pending_motion.sx = sx;
+	state->pending_motion.sy = sy;
+}
+
 uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 		uint32_t button, enum wlr_button_state state) {
+	wlr_trace(seat_pointer_button, wlr_seat, time, button, state);
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
 	if (client == NULL) {
 		return 0;
 	}
 
+	// Events must be received in order
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	uint32_t serial = wl_display_next_serial(wlr_seat->display);
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
@@ -261,6 +345,8 @@ void wlr_seat_pointer_send_axis(struct wlr_seat *wlr_seat, uint32_t time,
 		return;
 	}
 
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
 		if (wlr_seat_client_from_pointer_resource(resource) == NULL) {
@@ -293,6 +379,12 @@ void wlr_seat_pointer_send_frame(struct wlr_seat *wlr_seat) {
 		return;
 	}
 
+	// This frame only contains held back motion, it's sent along with it
+	if (wlr_seat->pointer_state.pending_motion.pending) {
+		wlr_seat->pointer_state.pending_motion.frame = true;
+		return;
+	}
+
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
 		if (wlr_seat_client_from_pointer_resource(resource) == NULL) {
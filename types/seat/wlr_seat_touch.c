@@ -8,6 +8,7 @@
 #include <wlr/util/log.h>
 #include "types/wlr_seat.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 static uint32_t default_touch_down(struct wlr_seat_touch_grab *grab,
 		uint32_t time, struct wlr_touch_point *point) {
@@ -33,6 +34,10 @@ static void default_touch_enter(struct wlr_seat_touch_grab *grab,
 	// not handled by default
 }
 
+static void default_touch_frame(struct wlr_seat_touch_grab *grab) {
+	wlr_seat_touch_send_frame(grab->seat);
+}
+
 static void default_touch_cancel(struct wlr_seat_touch_grab *grab) {
 	// cannot be cancelled
 }
@@ -42,6 +47,7 @@ const struct wlr_touch_grab_interface default_touch_grab_impl = {
 	.up = default_touch_up,
 	.motion = default_touch_motion,
 	.enter = default_touch_enter,
+	.frame = default_touch_frame,
 	.cancel = default_touch_cancel,
 };
 
@@ -258,6 +264,15 @@ void wlr_seat_touch_point_focus(struct wlr_seat *seat,
 	}
 }
 
+void wlr_seat_touch_notify_frame(struct wlr_seat *seat) {
+	struct wlr_seat_touch_grab *grab = seat->touch_state.grab;
+	if (grab->interface->frame) {
+		grab->interface->frame(grab);
+	} else {
+		wlr_seat_touch_send_frame(seat);
+	}
+}
+
 void wlr_seat_touch_point_clear_focus(struct wlr_seat *seat, uint32_t time,
 		int32_t touch_id) {
 	struct wlr_touch_point *point = wlr_seat_touch_get_point(seat, touch_id);
@@ -269,9 +284,49 @@ void wlr_seat_touch_point_clear_focus(struct wlr_seat *seat, uint32_t time,
 	touch_point_clear_focus(point);
 }
 
+static void handle_touch_frame_idle(void *data) {
+	struct wlr_seat *seat = data;
+	seat->touch_state.frame_source = NULL;
+	wlr_seat_touch_send_frame(seat);
+}
+
+static void seat_client_queue_touch_frame(struct wlr_seat_client *client) {
+	struct wlr_seat *seat = client->seat;
+	client->needs_touch_frame = true;
+	if (seat->touch_state.frame_source == NULL) {
+		struct wl_event_loop *loop = wl_display_get_event_loop(seat->display);
+		seat->touch_state.frame_source =
+			wl_event_loop_add_idle(loop, handle_touch_frame_idle, seat);
+	}
+}
+
+void wlr_seat_touch_send_frame(struct wlr_seat *seat) {
+	if (seat->touch_state.frame_source != NULL) {
+		wl_event_source_remove(seat->touch_state.frame_source);
+		seat->touch_state.frame_source = NULL;
+	}
+
+	struct wlr_seat_client *client;
+	wl_list_for_each(client, &seat->clients, link) {
+		if (!client->needs_touch_frame) {
+			continue;
+		}
+		client->needs_touch_frame = false;
+
+		struct wl_resource *resource;
+		wl_resource_for_each(resource, &client->touches) {
+			if (seat_client_from_touch_resource(resource) == NULL) {
+				continue;
+			}
+			wl_touch_send_frame(resource);
+		}
+	}
+}
+
 uint32_t wlr_seat_touch_send_down(struct wlr_seat *seat,
 		struct wlr_surface *surface, uint32_t time, int32_t touch_id, double sx,
 		double sy) {
+	wlr_trace(seat_touch_down, seat, time, touch_id);
 	struct wlr_touch_point *point = wlr_seat_touch_get_point(seat, touch_id);
 	if (!point) {
 		wlr_log(WLR_ERROR, "got touch down for unknown touch point");
@@ -286,13 +341,14 @@ uint32_t wlr_seat_touch_send_down(struct wlr_seat *seat,
 		}
 		wl_touch_send_down(resource, serial, time, surface->resource,
 			touch_id, wl_fixed_from_double(sx), wl_fixed_from_double(sy));
-		wl_touch_send_frame(resource);
 	}
+	seat_client_queue_touch_frame(point->client);
 
 	return serial;
 }
 
 void wlr_seat_touch_send_up(struct wlr_seat *seat, uint32_t time, int32_t touch_id) {
+	wlr_trace(seat_touch_up, seat, time, touch_id);
 	struct wlr_touch_point *point = wlr_seat_touch_get_point(seat, touch_id);
 	if (!point) {
 		wlr_log(WLR_ERROR, "got touch up for unknown touch point");
@@ -306,12 +362,13 @@ void wlr_seat_touch_send_up(struct wlr_seat *seat, uint32_t time, int32_t touch_
 			continue;
 		}
 		wl_touch_send_up(resource, serial, time, touch_id);
-		wl_touch_send_frame(resource);
 	}
+	seat_client_queue_touch_frame(point->client);
 }
 
 void wlr_seat_touch_send_motion(struct wlr_seat *seat, uint32_t time, int32_t touch_id,
 		double sx, double sy) {
+	wlr_trace(seat_touch_motion, seat, time, touch_id);
 	struct wlr_touch_point *point = wlr_seat_touch_get_point(seat, touch_id);
 	if (!point) {
 		wlr_log(WLR_ERROR, "got touch motion for unknown touch point");
@@ -325,8 +382,8 @@ void wlr_seat_touch_send_motion(struct wlr_seat *seat, uint32_t time, int32_t to
 		}
 		wl_touch_send_motion(resource, time, touch_id, wl_fixed_from_double(sx),
 			wl_fixed_from_double(sy));
-		wl_touch_send_frame(resource);
 	}
+	seat_client_queue_touch_frame(point->client);
 }
 
 int wlr_seat_touch_num_points(struct wlr_seat *seat) {
@@ -89,6 +89,9 @@ void destroy_tablet_tool_v2(struct wl_resource *resource) {
 	if (client->frame_source) {
 		wl_event_source_remove(client->frame_source);
 	}
+	if (client->frame_timer) {
+		wl_event_source_remove(client->frame_timer);
+	}
 
 	if (client->tool && client->tool->current_client == client) {
 		client->tool->current_client = NULL;
@@ -286,24 +289,141 @@ static inline int64_t timespec_to_msec(const struct timespec *a) {
 	return (int64_t)a->tv_sec * 1000 + a->tv_nsec / 1000000;
 }
 
+static bool axis_changed(struct wlr_tablet_tool_client_v2 *tool,
+		enum wlr_tablet_tool_v2_axis axis, bool changed) {
+	if (!(tool->pending_axes & axis)) {
+		return false;
+	}
+	return changed || !(tool->sent_axes & axis);
+}
+
+// Sends the pending axis changes, skipping axes whose value didn't change
+static void send_tool_axes(struct wlr_tablet_tool_client_v2 *tool) {
+	struct wlr_tablet_tool_v2_axes *pending = &tool->pending;
+	struct wlr_tablet_tool_v2_axes *sent = &tool->sent;
+
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_MOTION,
+			pending->x != sent->x || pending->y != sent->y)) {
+		zwp_tablet_tool_v2_send_motion(tool->resource,
+			pending->x, pending->y);
+	}
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_PRESSURE,
+			pending->pressure != sent->pressure)) {
+		zwp_tablet_tool_v2_send_pressure(tool->resource, pending->pressure);
+	}
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_DISTANCE,
+			pending->distance != sent->distance)) {
+		zwp_tablet_tool_v2_send_distance(tool->resource, pending->distance);
+	}
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_TILT,
+			pending->tilt_x != sent->tilt_x ||
+			pending->tilt_y != sent->tilt_y)) {
+		zwp_tablet_tool_v2_send_tilt(tool->resource,
+			pending->tilt_x, pending->tilt_y);
+	}
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_ROTATION,
+			pending->rotation != sent->rotation)) {
+		zwp_tablet_tool_v2_send_rotation(tool->resource, pending->rotation);
+	}
+	if (axis_changed(tool, WLR_TABLET_TOOL_V2_AXIS_SLIDER,
+			pending->slider != sent->slider)) {
+		zwp_tablet_tool_v2_send_slider(tool->resource, pending->slider);
+	}
+
+	*sent = *pending;
+	tool->sent_axes |= tool->pending_axes;
+	tool->pending_axes = 0;
+}
+
 static void send_tool_frame(void *data) {
 	struct wlr_tablet_tool_client_v2 *tool = data;
 
+	send_tool_axes(tool);
+
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 	zwp_tablet_tool_v2_send_frame(tool->resource, timespec_to_msec(&now));
 	tool->frame_source = NULL;
+	tool->last_frame = now;
+}
+
+static int handle_tool_frame_timer(void *data) {
+	struct wlr_tablet_tool_client_v2 *tool = data;
+	tool->frame_timer_armed = false;
+	if (!tool->frame_source) {
+		send_tool_frame(tool);
+	}
+	return 0;
 }
 
 static void queue_tool_frame(struct wlr_tablet_tool_client_v2 *tool) {
 	struct wl_display *display = wl_client_get_display(tool->client);
 	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	if (tool->frame_timer_armed) {
+		wl_event_source_timer_update(tool->frame_timer, 0);
+		tool->frame_timer_armed = false;
+	}
 	if (!tool->frame_source) {
 		tool->frame_source =
 			wl_event_loop_add_idle(loop, send_tool_frame, tool);
 	}
 }
 
+// Queues a frame for axis changes, paced by the tool's axis frame interval
+static void queue_tool_axis_frame(struct wlr_tablet_tool_client_v2 *tool) {
+	int interval = tool->tool ? tool->tool->axis_frame_interval : 0;
+	if (tool->frame_source || tool->frame_timer_armed) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t elapsed = timespec_to_msec(&now) -
+		timespec_to_msec(&tool->last_frame);
+	if (interval <= 0 || tool->full_rate || elapsed >= interval) {
+		queue_tool_frame(tool);
+		return;
+	}
+
+	if (!tool->frame_timer) {
+		struct wl_display *display = wl_client_get_display(tool->client);
+		struct wl_event_loop *loop = wl_display_get_event_loop(display);
+		tool->frame_timer = wl_event_loop_add_timer(loop,
+			handle_tool_frame_timer, tool);
+		if (!tool->frame_timer) {
+			queue_tool_frame(tool);
+			return;
+		}
+	}
+	wl_event_source_timer_update(tool->frame_timer, interval - elapsed);
+	tool->frame_timer_armed = true;
+}
+
+// Sends everything queued so far in a frame right away
+static void flush_tool_frame(struct wlr_tablet_tool_client_v2 *tool) {
+	if (!tool->frame_source && !tool->frame_timer_armed &&
+			tool->pending_axes == 0) {
+		return;
+	}
+	if (tool->frame_source) {
+		wl_event_source_remove(tool->frame_source);
+	}
+	if (tool->frame_timer_armed) {
+		wl_event_source_timer_update(tool->frame_timer, 0);
+		tool->frame_timer_armed = false;
+	}
+	send_tool_frame(tool);
+}
+
+static void tool_set_axis(struct wlr_tablet_tool_client_v2 *tool,
+		enum wlr_tablet_tool_v2_axis axis) {
+	tool->pending_axes |= axis;
+	if (tool->full_rate) {
+		send_tool_axes(tool);
+	}
+	queue_tool_axis_frame(tool);
+}
+
 void wlr_send_tablet_v2_tablet_tool_proximity_in(
 		struct wlr_tablet_v2_tablet_tool *tool,
 		struct wlr_tablet_v2_tablet *tablet,
@@ -347,6 +467,8 @@ void wlr_send_tablet_v2_tablet_tool_proximity_in(
 	}
 
 	tool->current_client = tool_client;
+	tool_client->pending_axes = 0;
+	tool_client->sent_axes = 0;
 
 	uint32_t serial = wl_display_next_serial(wl_client_get_display(client));
 	tool->focused_surface = surface;
@@ -373,15 +495,16 @@ void wlr_send_tablet_v2_tablet_tool_motion(
 		return;
 	}
 
-	zwp_tablet_tool_v2_send_motion(tool->current_client->resource,
-		wl_fixed_from_double(x), wl_fixed_from_double(y));
-
-	queue_tool_frame(tool->current_client);
+	struct wlr_tablet_tool_client_v2 *client = tool->current_client;
+	client->pending.x = wl_fixed_from_double(x);
+	client->pending.y = wl_fixed_from_double(y);
+	tool_set_axis(client, WLR_TABLET_TOOL_V2_AXIS_MOTION);
 }
 
 void wlr_send_tablet_v2_tablet_tool_proximity_out(
 		struct wlr_tablet_v2_tablet_tool *tool) {
 	if (tool->current_client) {
+		send_tool_axes(tool->current_client);
 		for (size_t i = 0; i < tool->num_buttons; ++i) {
 			zwp_tablet_tool_v2_send_button(tool->current_client->resource,
 				tool->pressed_serials[i],
@@ -391,10 +514,7 @@ void wlr_send_tablet_v2_tablet_tool_proximity_out(
 		if (tool->is_down) {
 			zwp_tablet_tool_v2_send_up(tool->current_client->resource);
 		}
-		if (tool->current_client->frame_source) {
-			wl_event_source_remove(tool->current_client->frame_source);
-			send_tool_frame(tool->current_client);
-		}
+		flush_tool_frame(tool->current_client);
 		zwp_tablet_tool_v2_send_proximity_out(tool->current_client->resource);
 
 		tool->current_client = NULL;
@@ -405,20 +525,16 @@ void wlr_send_tablet_v2_tablet_tool_proximity_out(
 void wlr_send_tablet_v2_tablet_tool_pressure(
 		struct wlr_tablet_v2_tablet_tool *tool, double pressure) {
 	if (tool->current_client) {
-		zwp_tablet_tool_v2_send_pressure(tool->current_client->resource,
-			pressure * 65535);
-
-		queue_tool_frame(tool->current_client);
+		tool->current_client->pending.pressure = pressure * 65535;
+		tool_set_axis(tool->current_client, WLR_TABLET_TOOL_V2_AXIS_PRESSURE);
 	}
 }
 
 void wlr_send_tablet_v2_tablet_tool_distance(
 		struct wlr_tablet_v2_tablet_tool *tool, double distance) {
 	if (tool->current_client) {
-		zwp_tablet_tool_v2_send_distance(tool->current_client->resource,
-			distance * 65535);
-
-		queue_tool_frame(tool->current_client);
+		tool->current_client->pending.distance = distance * 65535;
+		tool_set_axis(tool->current_client, WLR_TABLET_TOOL_V2_AXIS_DISTANCE);
 	}
 }
 
@@ -428,10 +544,10 @@ void wlr_send_tablet_v2_tablet_tool_tilt(
 		return;
 	}
 
-	zwp_tablet_tool_v2_send_tilt(tool->current_client->resource,
-		wl_fixed_from_double(x), wl_fixed_from_double(y));
-
-	queue_tool_frame(tool->current_client);
+	struct wlr_tablet_tool_client_v2 *client = tool->current_client;
+	client->pending.tilt_x = wl_fixed_from_double(x);
+	client->pending.tilt_y = wl_fixed_from_double(y);
+	tool_set_axis(client, WLR_TABLET_TOOL_V2_AXIS_TILT);
 }
 
 void wlr_send_tablet_v2_tablet_tool_rotation(
@@ -440,10 +556,8 @@ void wlr_send_tablet_v2_tablet_tool_rotation(
 		return;
 	}
 
-	zwp_tablet_tool_v2_send_rotation(tool->current_client->resource,
-		wl_fixed_from_double(degrees));
-
-	queue_tool_frame(tool->current_client);
+	tool->current_client->pending.rotation = wl_fixed_from_double(degrees);
+	tool_set_axis(tool->current_client, WLR_TABLET_TOOL_V2_AXIS_ROTATION);
 }
 
 void wlr_send_tablet_v2_tablet_tool_slider(
@@ -452,10 +566,8 @@ void wlr_send_tablet_v2_tablet_tool_slider(
 		return;
 	}
 
-	zwp_tablet_tool_v2_send_slider(tool->current_client->resource,
-		position * 65535);
-
-	queue_tool_frame(tool->current_client);
+	tool->current_client->pending.slider = position * 65535;
+	tool_set_axis(tool->current_client, WLR_TABLET_TOOL_V2_AXIS_SLIDER);
 }
 
 void wlr_send_tablet_v2_tablet_tool_button(
@@ -471,6 +583,7 @@ void wlr_send_tablet_v2_tablet_tool_button(
 			tool->pressed_serials[index] = serial;
 		}
 
+		send_tool_axes(tool->current_client);
 		zwp_tablet_tool_v2_send_button(tool->current_client->resource,
 			serial, button, state);
 		queue_tool_frame(tool->current_client);
@@ -480,6 +593,7 @@ void wlr_send_tablet_v2_tablet_tool_button(
 void wlr_send_tablet_v2_tablet_tool_wheel(
 	struct wlr_tablet_v2_tablet_tool *tool, double degrees, int32_t clicks) {
 	if (tool->current_client) {
+		send_tool_axes(tool->current_client);
 		zwp_tablet_tool_v2_send_wheel(tool->current_client->resource,
 			clicks, degrees);
 
@@ -498,6 +612,7 @@ void wlr_send_tablet_v2_tablet_tool_down(struct wlr_tablet_v2_tablet_tool *tool)
 			wl_resource_get_client(tool->current_client->resource);
 		uint32_t serial = wl_display_next_serial(wl_client_get_display(client));
 
+		send_tool_axes(tool->current_client);
 		zwp_tablet_tool_v2_send_down(tool->current_client->resource,
 			serial);
 		queue_tool_frame(tool->current_client);
@@ -514,12 +629,27 @@ void wlr_send_tablet_v2_tablet_tool_up(struct wlr_tablet_v2_tablet_tool *tool) {
 	tool->down_serial = 0;
 
 	if (tool->current_client) {
+		send_tool_axes(tool->current_client);
 		zwp_tablet_tool_v2_send_up(tool->current_client->resource);
 		queue_tool_frame(tool->current_client);
 	}
 }
 
 
+void wlr_tablet_v2_tablet_tool_set_client_full_rate(
+		struct wlr_tablet_v2_tablet_tool *tool, struct wl_client *client,
+		bool full_rate) {
+	struct wlr_tablet_tool_client_v2 *tool_client;
+	wl_list_for_each(tool_client, &tool->clients, tool_link) {
+		if (tool_client->client == client) {
+			if (full_rate) {
+				send_tool_axes(tool_client);
+			}
+			tool_client->full_rate = full_rate;
+		}
+	}
+}
+
 void wlr_tablet_v2_tablet_tool_notify_proximity_in(
 	struct wlr_tablet_v2_tablet_tool *tool,
 	struct wlr_tablet_v2_tablet *tablet,
@@ -5,6 +5,7 @@
 #include <wayland-server-protocol.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/util/log.h>
+#include "util/transform.h"
 
 void wlr_box_closest_point(const struct wlr_box *box, double x, double y,
 		double *dest_x, double *dest_y) {
@@ -68,50 +69,16 @@ bool wlr_box_contains_point(const struct wlr_box *box, double x, double y) {
 
 void wlr_box_transform(struct wlr_box *dest, const struct wlr_box *box,
 		enum wl_output_transform transform, int width, int height) {
-	struct wlr_box src = *box;
-
-	if (transform % 2 == 0) {
-		dest->width = src.width;
-		dest->height = src.height;
-	} else {
-		dest->width = src.height;
-		dest->height = src.width;
-	}
+	int32_t coords[] = { box->x, box->y, box->width, box->height };
+	transform_box_coords(coords, transform, width, height);
+	*dest = (struct wlr_box){ coords[0], coords[1], coords[2], coords[3] };
+}
 
-	switch (transform) {
-	case WL_OUTPUT_TRANSFORM_NORMAL:
-		dest->x = src.x;
-		dest->y = src.y;
-		break;
-	case WL_OUTPUT_TRANSFORM_90:
-		dest->x = src.y;
-		dest->y = width - src.x - src.width;
-		break;
-	case WL_OUTPUT_TRANSFORM_180:
-		dest->x = width - src.x - src.width;
-		dest->y = height - src.y - src.height;
-		break;
-	case WL_OUTPUT_TRANSFORM_270:
-		dest->x = height - src.y - src.height;
-		dest->y = src.x;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED:
-		dest->x = width - src.x - src.width;
-		dest->y = src.y;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-		dest->x = height - src.y - src.height;
-		dest->y = width - src.x - src.width;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-		dest->x = src.x;
-		dest->y = height - src.y - src.height;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-		dest->x = src.y;
-		dest->y = src.x;
-		break;
-	}
+void wlr_fbox_transform(struct wlr_fbox *dest, const struct wlr_fbox *box,
+		enum wl_output_transform transform, double width, double height) {
+	double coords[] = { box->x, box->y, box->width, box->height };
+	transform_fbox_coords(coords, transform, width, height);
+	*dest = (struct wlr_fbox){ coords[0], coords[1], coords[2], coords[3] };
 }
 
 void wlr_box_rotated_bounds(struct wlr_box *dest, const struct wlr_box *box,
@@ -1,10 +1,16 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/util/log.h>
 
+// Large wl_shm buffers are uploaded in chunks of this many bytes, one per event
+// loop iteration, so that uploading them doesn't delay input dispatch
+#define SHM_UPLOAD_CHUNK_SIZE (4 * 1024 * 1024)
+
 bool wlr_resource_is_buffer(struct wl_resource *resource) {
 	return strcmp(wl_resource_get_class(resource), wl_buffer_interface.name) == 0;
 }
@@ -35,10 +41,282 @@ bool wlr_buffer_get_resource_size(struct wl_resource *resource,
 }
 
 
+static bool buffer_upload_is_pending(struct wlr_buffer *buffer) {
+	return buffer->upload.timer != NULL;
+}
+
+// Uploads up to `max_rows` more rows of the wl_shm buffer to the texture.
+// Returns true once the whole buffer has been uploaded.
+static bool buffer_upload_rows(struct wlr_buffer *buffer, int32_t max_rows) {
+	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(buffer->resource);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buf);
+	int32_t width = wl_shm_buffer_get_width(shm_buf);
+	int32_t height = wl_shm_buffer_get_height(shm_buf);
+
+	int32_t y = buffer->upload.next_row;
+	int32_t rows = height - y;
+	if (rows > max_rows) {
+		rows = max_rows;
+	}
+
+	wl_shm_buffer_begin_access(shm_buf);
+	void *data = wl_shm_buffer_get_data(shm_buf);
+	if (!wlr_texture_write_pixels(buffer->texture, stride, width, rows,
+			0, y, 0, y, data)) {
+		wlr_log(WLR_ERROR, "Failed to upload buffer rows");
+	}
+	wl_shm_buffer_end_access(shm_buf);
+
+	buffer->upload.next_row = y + rows;
+	return buffer->upload.next_row >= height;
+}
+
+static void buffer_cancel_upload(struct wlr_buffer *buffer) {
+	if (buffer_upload_is_pending(buffer)) {
+		wl_event_source_remove(buffer->upload.timer);
+		buffer->upload.timer = NULL;
+	}
+}
+
+static void buffer_finish_upload(struct wlr_buffer *buffer) {
+	buffer_upload_rows(buffer, INT32_MAX);
+	buffer_cancel_upload(buffer);
+
+	if (!buffer->retained) {
+		// We have uploaded the data, we don't need to access the wl_buffer
+		// anymore
+		wl_buffer_send_release(buffer->resource);
+		buffer->released = true;
+	}
+}
+
+static int buffer_handle_upload_timer(void *data) {
+	struct wlr_buffer *buffer = data;
+
+	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(buffer->resource);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buf);
+	int32_t rows = SHM_UPLOAD_CHUNK_SIZE / stride;
+	if (buffer_upload_rows(buffer, rows > 0 ? rows : 1)) {
+		buffer_finish_upload(buffer);
+	} else {
+		// Idle sources would run again before any input is dispatched
+		wl_event_source_timer_update(buffer->upload.timer, 1);
+	}
+	return 0;
+}
+
+static struct wlr_texture *buffer_import_texture(struct wlr_buffer *buffer) {
+	struct wl_resource *resource = buffer->resource;
+	struct wlr_renderer *renderer = buffer->renderer;
+
+	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(resource);
+	if (shm_buf != NULL) {
+		wl_shm_buffer_begin_access(shm_buf);
+		void *data = wl_shm_buffer_get_data(shm_buf);
+		struct wlr_texture *texture = wlr_texture_from_pixels(renderer,
+			wl_shm_buffer_get_format(shm_buf),
+			wl_shm_buffer_get_stride(shm_buf),
+			wl_shm_buffer_get_width(shm_buf),
+			wl_shm_buffer_get_height(shm_buf), data);
+		wl_shm_buffer_end_access(shm_buf);
+		return texture;
+	} else if (wlr_renderer_resource_is_wl_drm_buffer(renderer, resource)) {
+		return wlr_texture_from_wl_drm(renderer, resource);
+	} else if (wlr_dmabuf_v1_resource_is_buffer(resource)) {
+		struct wlr_dmabuf_v1_buffer *dmabuf =
+			wlr_dmabuf_v1_buffer_from_buffer_resource(resource);
+		return wlr_texture_from_dmabuf(renderer, &dmabuf->attributes);
+	}
+	return NULL;
+}
+
+static void buffer_restore_texture(struct wlr_buffer *buffer) {
+	buffer->evicted = false;
+	if (buffer->resource == NULL) {
+		// The contents are gone along with the wl_buffer
+		return;
+	}
+
+	buffer->texture = buffer_import_texture(buffer);
+	if (buffer->texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to import evicted texture");
+		return;
+	}
+	if (buffer->usage != NULL) {
+		buffer->usage->bytes += buffer->size;
+		if (buffer->usage->bytes > buffer->usage->peak_bytes) {
+			buffer->usage->peak_bytes = buffer->usage->bytes;
+		}
+	}
+}
+
+void wlr_buffer_finish_upload(struct wlr_buffer *buffer) {
+	if (buffer == NULL) {
+		return;
+	}
+	if (buffer_upload_is_pending(buffer)) {
+		buffer_finish_upload(buffer);
+	} else if (buffer->evicted) {
+		buffer_restore_texture(buffer);
+	}
+}
+
+bool wlr_buffer_evict_texture(struct wlr_buffer *buffer) {
+	if (buffer->texture == NULL || buffer->resource == NULL ||
+			buffer->n_refs > 1 || buffer_upload_is_pending(buffer)) {
+		return false;
+	}
+	if (wl_shm_buffer_get(buffer->resource) != NULL) {
+		if (!buffer->retained || buffer->released) {
+			// The client may have re-used the memory already
+			return false;
+		}
+	} else if (!wlr_renderer_resource_is_wl_drm_buffer(buffer->renderer,
+			buffer->resource) &&
+			!wlr_dmabuf_v1_resource_is_buffer(buffer->resource)) {
+		return false;
+	}
+
+	buffer_finish_foreign_textures(buffer);
+	wlr_texture_destroy(buffer->texture);
+	buffer->texture = NULL;
+	buffer->evicted = true;
+	if (buffer->usage != NULL) {
+		buffer->usage->bytes -= buffer->size;
+	}
+	return true;
+}
+
+static void usage_handle_client_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_buffer_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+
+	// Buffers can outlive their client while they're referenced
+	struct wlr_buffer *buffer, *tmp;
+	wl_list_for_each_safe(buffer, tmp, &usage->buffers, usage_link) {
+		wl_list_remove(&buffer->usage_link);
+		wl_list_init(&buffer->usage_link);
+		buffer->usage = NULL;
+	}
+
+	wl_list_remove(&usage->client_destroy.link);
+	free(usage);
+}
+
+static struct wlr_buffer_client_usage *usage_from_client(
+		struct wl_client *client) {
+	struct wl_listener *listener = wl_client_get_destroy_listener(client,
+		usage_handle_client_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_buffer_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+	return usage;
+}
+
+const struct wlr_buffer_client_usage *wlr_buffer_get_client_usage(
+		struct wl_client *client) {
+	return usage_from_client(client);
+}
+
+static void buffer_account(struct wlr_buffer *buffer,
+		struct wl_client *client) {
+	wl_list_init(&buffer->usage_link);
+
+	int width, height;
+	wlr_texture_get_size(buffer->texture, &width, &height);
+	buffer->size = (size_t)width * height * 4;
+
+	struct wlr_buffer_client_usage *usage = usage_from_client(client);
+	if (usage == NULL) {
+		usage = calloc(1, sizeof(struct wlr_buffer_client_usage));
+		if (usage == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return;
+		}
+		usage->client = client;
+		wl_list_init(&usage->buffers);
+		usage->client_destroy.notify = usage_handle_client_destroy;
+		wl_client_add_destroy_listener(client, &usage->client_destroy);
+	}
+
+	buffer->usage = usage;
+	wl_list_insert(&usage->buffers, &buffer->usage_link);
+	usage->n_buffers++;
+	usage->bytes += buffer->size;
+	if (usage->bytes > usage->peak_bytes) {
+		usage->peak_bytes = usage->bytes;
+	}
+}
+
+static void buffer_unaccount(struct wlr_buffer *buffer) {
+	struct wlr_buffer_client_usage *usage = buffer->usage;
+	if (usage != NULL) {
+		usage->n_buffers--;
+		if (buffer->texture != NULL) {
+			usage->bytes -= buffer->size;
+		}
+	}
+	wl_list_remove(&buffer->usage_link);
+}
+
+struct wlr_buffer_foreign_texture {
+	struct wlr_renderer *renderer;
+	struct wlr_texture *texture;
+
+	struct wl_listener renderer_destroy;
+	struct wl_list link; // wlr_buffer::foreign_textures
+};
+
+static void foreign_texture_destroy(
+		struct wlr_buffer_foreign_texture *foreign) {
+	wl_list_remove(&foreign->renderer_destroy.link);
+	wl_list_remove(&foreign->link);
+	wlr_texture_destroy(foreign->texture);
+	free(foreign);
+}
+
+static void foreign_texture_handle_renderer_destroy(
+		struct wl_listener *listener, void *data) {
+	struct wlr_buffer_foreign_texture *foreign =
+		wl_container_of(listener, foreign, renderer_destroy);
+	foreign_texture_destroy(foreign);
+}
+
+static void buffer_finish_foreign_textures(struct wlr_buffer *buffer) {
+	struct wlr_buffer_foreign_texture *foreign, *tmp;
+	wl_list_for_each_safe(foreign, tmp, &buffer->foreign_textures, link) {
+		foreign_texture_destroy(foreign);
+	}
+}
+
+static void buffer_destroy(struct wlr_buffer *buffer) {
+	buffer_finish_foreign_textures(buffer);
+	buffer_unaccount(buffer);
+	buffer_cancel_upload(buffer);
+	wl_list_remove(&buffer->resource_destroy.link);
+	wlr_texture_destroy(buffer->texture);
+	free(buffer);
+}
+
 static void buffer_resource_handle_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_buffer *buffer =
 		wl_container_of(listener, buffer, resource_destroy);
+	if (buffer->n_refs == 0) {
+		// Only kept around for its cached texture
+		buffer_destroy(buffer);
+		return;
+	}
+
+	if (buffer_upload_is_pending(buffer)) {
+		// The pixels are still readable until the shm buffer is destroyed
+		buffer_upload_rows(buffer, INT32_MAX);
+		buffer_cancel_upload(buffer);
+	}
+
 	wl_list_remove(&buffer->resource_destroy.link);
 	wl_list_init(&buffer->resource_destroy.link);
 	buffer->resource = NULL;
@@ -51,36 +329,68 @@ static void buffer_resource_handle_destroy(struct wl_listener *listener,
 	// which case we'll read garbage. We decide to accept this risk.
 }
 
-struct wlr_buffer *wlr_buffer_create(struct wlr_renderer *renderer,
-		struct wl_resource *resource) {
+static struct wlr_buffer *buffer_create(struct wlr_renderer *renderer,
+		struct wl_resource *resource, bool retain) {
 	assert(wlr_resource_is_buffer(resource));
 
 	struct wlr_texture *texture = NULL;
 	bool released = false;
+	bool chunked = false;
 
 	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(resource);
 	if (shm_buf != NULL) {
+		// wl_shm buffers are always copied. Wrapping the client's pages
+		// (udmabuf, GL_EXT_memory_object_fd) needs the pool's file
+		// descriptor, which libwayland closes once the pool is mapped.
 		enum wl_shm_format fmt = wl_shm_buffer_get_format(shm_buf);
 		int32_t stride = wl_shm_buffer_get_stride(shm_buf);
 		int32_t width = wl_shm_buffer_get_width(shm_buf);
 		int32_t height = wl_shm_buffer_get_height(shm_buf);
 
-		wl_shm_buffer_begin_access(shm_buf);
-		void *data = wl_shm_buffer_get_data(shm_buf);
-		texture = wlr_texture_from_pixels(renderer, fmt, stride,
-			width, height, data);
-		wl_shm_buffer_end_access(shm_buf);
+		if ((int64_t)stride * height > SHM_UPLOAD_CHUNK_SIZE) {
+			// Only allocate the texture now, the pixels are uploaded from
+			// the event loop and the buffer is released afterwards
+			texture = wlr_texture_from_pixels(renderer, fmt, stride,
+				width, height, NULL);
+			chunked = true;
+		} else {
+			wl_shm_buffer_begin_access(shm_buf);
+			void *data = wl_shm_buffer_get_data(shm_buf);
+			texture = wlr_texture_from_pixels(renderer, fmt, stride,
+				width, height, data);
+			wl_shm_buffer_end_access(shm_buf);
 
-		// We have uploaded the data, we don't need to access the wl_buffer
-		// anymore
-		wl_buffer_send_release(resource);
-		released = true;
+			if (!retain) {
+				// We have uploaded the data, we don't need to access the
+				// wl_buffer anymore
+				wl_buffer_send_release(resource);
+				released = true;
+			}
+		}
 	} else if (wlr_renderer_resource_is_wl_drm_buffer(renderer, resource)) {
 		texture = wlr_texture_from_wl_drm(renderer, resource);
 	} else if (wlr_dmabuf_v1_resource_is_buffer(resource)) {
+		// Clients usually cycle through a few DMA-BUFs, re-use the texture
+		// imported the last time this one was attached
+		struct wl_listener *listener = wl_resource_get_destroy_listener(
+			resource, buffer_resource_handle_destroy);
+		if (listener != NULL) {
+			struct wlr_buffer *buffer =
+				wl_container_of(listener, buffer, resource_destroy);
+			if (buffer->n_refs == 0) {
+				buffer->released = false;
+			}
+			return wlr_buffer_ref(buffer);
+		}
+
+		// On first commit, use the texture imported by linux-dmabuf when it
+		// checked the buffer
 		struct wlr_dmabuf_v1_buffer *dmabuf =
 			wlr_dmabuf_v1_buffer_from_buffer_resource(resource);
-		texture = wlr_texture_from_dmabuf(renderer, &dmabuf->attributes);
+		texture = wlr_dmabuf_v1_buffer_take_texture(dmabuf, renderer);
+		if (texture == NULL) {
+			texture = wlr_texture_from_dmabuf(renderer, &dmabuf->attributes);
+		}
 
 		// We have imported the DMA-BUF, but we need to prevent the client from
 		// re-using the same DMA-BUF for the next frames, so we don't release
@@ -106,15 +416,43 @@ struct wlr_buffer *wlr_buffer_create(struct wlr_renderer *renderer,
 	}
 	buffer->resource = resource;
 	buffer->texture = texture;
+	buffer->renderer = renderer;
 	buffer->released = released;
+	buffer->retained = retain && shm_buf != NULL;
 	buffer->n_refs = 1;
+	wl_list_init(&buffer->foreign_textures);
+	buffer_account(buffer, wl_resource_get_client(resource));
 
 	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
 	buffer->resource_destroy.notify = buffer_resource_handle_destroy;
 
+	if (chunked) {
+		struct wl_display *display =
+			wl_client_get_display(wl_resource_get_client(resource));
+		buffer->upload.timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(display),
+			buffer_handle_upload_timer, buffer);
+		if (buffer->upload.timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create upload timer");
+			wlr_buffer_unref(buffer);
+			return NULL;
+		}
+		wl_event_source_timer_update(buffer->upload.timer, 1);
+	}
+
 	return buffer;
 }
 
+struct wlr_buffer *wlr_buffer_create(struct wlr_renderer *renderer,
+		struct wl_resource *resource) {
+	return buffer_create(renderer, resource, false);
+}
+
+struct wlr_buffer *wlr_buffer_create_retained(struct wlr_renderer *renderer,
+		struct wl_resource *resource) {
+	return buffer_create(renderer, resource, true);
+}
+
 struct wlr_buffer *wlr_buffer_ref(struct wlr_buffer *buffer) {
 	buffer->n_refs++;
 	return buffer;
@@ -133,11 +471,17 @@ void wlr_buffer_unref(struct wlr_buffer *buffer) {
 
 	if (!buffer->released && buffer->resource != NULL) {
 		wl_buffer_send_release(buffer->resource);
+		buffer->released = true;
 	}
 
-	wl_list_remove(&buffer->resource_destroy.link);
-	wlr_texture_destroy(buffer->texture);
-	free(buffer);
+	if (buffer->resource != NULL &&
+			wlr_dmabuf_v1_resource_is_buffer(buffer->resource)) {
+		// Keep the imported texture until the client destroys the wl_buffer,
+		// in case the same buffer is attached again
+		return;
+	}
+
+	buffer_destroy(buffer);
 }
 
 struct wlr_buffer *wlr_buffer_apply_damage(struct wlr_buffer *buffer,
@@ -148,6 +492,10 @@ struct wlr_buffer *wlr_buffer_apply_damage(struct wlr_buffer *buffer,
 		// Someone else still has a reference to the buffer
 		return NULL;
 	}
+	if (buffer->texture == NULL || buffer->resource == NULL) {
+		// Evicted, or lost along with the previous wl_buffer
+		return NULL;
+	}
 
 	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(resource);
 	struct wl_shm_buffer *old_shm_buf = wl_shm_buffer_get(buffer->resource);
@@ -191,15 +539,103 @@ struct wlr_buffer *wlr_buffer_apply_damage(struct wlr_buffer *buffer,
 
 	wl_shm_buffer_end_access(shm_buf);
 
-	// We have uploaded the data, we don't need to access the wl_buffer
-	// anymore
-	wl_buffer_send_release(resource);
+	// Copies made through memory are out-of-date
+	buffer_finish_foreign_textures(buffer);
+
+	if (buffer->retained) {
+		// Keep the new wl_buffer to be able to evict the texture, the client
+		// gets the previous one back instead
+		if (!buffer->released && buffer->resource != resource) {
+			wl_buffer_send_release(buffer->resource);
+		}
+	} else {
+		// We have uploaded the data, we don't need to access the wl_buffer
+		// anymore
+		wl_buffer_send_release(resource);
+	}
 
 	wl_list_remove(&buffer->resource_destroy.link);
 	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
 	buffer->resource_destroy.notify = buffer_resource_handle_destroy;
 
 	buffer->resource = resource;
-	buffer->released = true;
+	buffer->released = !buffer->retained;
 	return buffer;
 }
+
+bool wlr_buffer_get_dmabuf(struct wlr_buffer *buffer,
+		struct wlr_dmabuf_attributes *attribs) {
+	if (buffer->resource == NULL ||
+			!wlr_dmabuf_v1_resource_is_buffer(buffer->resource)) {
+		return false;
+	}
+
+	struct wlr_dmabuf_v1_buffer *dmabuf =
+		wlr_dmabuf_v1_buffer_from_buffer_resource(buffer->resource);
+	memcpy(attribs, &dmabuf->attributes, sizeof(*attribs));
+	return true;
+}
+
+static struct wlr_texture *import_foreign_texture(struct wlr_buffer *buffer,
+		struct wlr_renderer *renderer) {
+	struct wlr_texture *texture = NULL;
+
+	struct wlr_dmabuf_attributes attribs;
+	if (wlr_buffer_get_dmabuf(buffer, &attribs)) {
+		texture = wlr_texture_from_dmabuf(renderer, &attribs);
+	}
+	if (texture == NULL && buffer->texture != NULL &&
+			wlr_texture_to_dmabuf(buffer->texture, &attribs)) {
+		texture = wlr_texture_from_dmabuf(renderer, &attribs);
+		wlr_dmabuf_attributes_finish(&attribs);
+	}
+	if (texture != NULL) {
+		return texture;
+	}
+
+	// The device can't read the buffer's memory layout, fallback to a copy
+	// of the linear wl_shm pixels while they're still readable
+	struct wl_shm_buffer *shm_buf = buffer->resource != NULL ?
+		wl_shm_buffer_get(buffer->resource) : NULL;
+	if (shm_buf == NULL || buffer->released) {
+		return NULL;
+	}
+	wl_shm_buffer_begin_access(shm_buf);
+	texture = wlr_texture_from_pixels(renderer,
+		wl_shm_buffer_get_format(shm_buf), wl_shm_buffer_get_stride(shm_buf),
+		wl_shm_buffer_get_width(shm_buf), wl_shm_buffer_get_height(shm_buf),
+		wl_shm_buffer_get_data(shm_buf));
+	wl_shm_buffer_end_access(shm_buf);
+	return texture;
+}
+
+struct wlr_texture *wlr_buffer_get_texture(struct wlr_buffer *buffer,
+		struct wlr_renderer *renderer) {
+	if (renderer == buffer->renderer) {
+		return buffer->texture;
+	}
+
+	struct wlr_buffer_foreign_texture *foreign;
+	wl_list_for_each(foreign, &buffer->foreign_textures, link) {
+		if (foreign->renderer == renderer) {
+			return foreign->texture;
+		}
+	}
+
+	struct wlr_texture *texture = import_foreign_texture(buffer, renderer);
+	if (texture == NULL) {
+		return NULL;
+	}
+
+	foreign = calloc(1, sizeof(*foreign));
+	if (foreign == NULL) {
+		wlr_texture_destroy(texture);
+		return NULL;
+	}
+	foreign->renderer = renderer;
+	foreign->texture = texture;
+	wl_signal_add(&renderer->events.destroy, &foreign->renderer_destroy);
+	foreign->renderer_destroy.notify = foreign_texture_handle_renderer_destroy;
+	wl_list_insert(&buffer->foreign_textures, &foreign->link);
+	return texture;
+}
@@ -0,0 +1,28 @@
+#include <stdlib.h>
+#include <wlr/types/wlr_client_stats.h>
+
+static void handle_client_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_client_stats *stats =
+		wl_container_of(listener, stats, client_destroy);
+	wl_list_remove(&stats->client_destroy.link);
+	free(stats);
+}
+
+struct wlr_client_stats *wlr_client_stats_get(struct wl_client *client) {
+	struct wl_listener *listener =
+		wl_client_get_destroy_listener(client, handle_client_destroy);
+	if (listener != NULL) {
+		struct wlr_client_stats *stats =
+			wl_container_of(listener, stats, client_destroy);
+		return stats;
+	}
+
+	struct wlr_client_stats *stats = calloc(1, sizeof(struct wlr_client_stats));
+	if (stats == NULL) {
+		return NULL;
+	}
+	stats->client = client;
+	stats->client_destroy.notify = handle_client_destroy;
+	wl_client_add_destroy_listener(client, &stats->client_destroy);
+	return stats;
+}
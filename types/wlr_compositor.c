@@ -1,6 +1,9 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wayland-server.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_region.h>
 #include <wlr/types/wlr_surface.h>
@@ -149,6 +152,7 @@ static void compositor_create_surface(struct wl_client *client,
 	if (surface == NULL) {
 		return;
 	}
+	surface->retain_buffers = compositor->texture_eviction.timeout > 0;
 
 	wlr_signal_emit_safe(&compositor->events.new_surface, surface);
 }
@@ -191,6 +195,9 @@ void wlr_compositor_destroy(struct wlr_compositor *compositor) {
 	}
 	wlr_signal_emit_safe(&compositor->events.destroy, compositor);
 	subcompositor_finish(&compositor->subcompositor);
+	if (compositor->texture_eviction.timer != NULL) {
+		wl_event_source_remove(compositor->texture_eviction.timer);
+	}
 	wl_list_remove(&compositor->display_destroy.link);
 	wl_global_destroy(compositor->global);
 	struct wl_resource *resource, *tmp;
@@ -206,6 +213,86 @@ void wlr_compositor_destroy(struct wlr_compositor *compositor) {
 	free(compositor);
 }
 
+static inline int64_t timespec_to_msec(const struct timespec *a) {
+	return (int64_t)a->tv_sec * 1000 + a->tv_nsec / 1000000;
+}
+
+static int handle_texture_eviction_timer(void *data) {
+	struct wlr_compositor *compositor = data;
+	int timeout = compositor->texture_eviction.timeout;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t now_msec = timespec_to_msec(&now);
+
+	// Check twice per timeout, so that textures are evicted at most
+	// 1.5 × timeout after their last use
+	int next = timeout / 2;
+	size_t n_evicted = 0;
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &compositor->surface_resources) {
+		struct wlr_surface *surface = wlr_surface_from_resource(resource);
+		if (surface->buffer == NULL || surface->buffer->texture == NULL) {
+			continue;
+		}
+		if (now_msec - surface->last_texture_use < timeout) {
+			continue;
+		}
+		if (wlr_buffer_evict_texture(surface->buffer)) {
+			n_evicted++;
+		}
+	}
+
+	if (n_evicted > 0) {
+		wlr_log(WLR_DEBUG, "Evicted %zu idle surface textures", n_evicted);
+	}
+	wl_event_source_timer_update(compositor->texture_eviction.timer,
+		next > 0 ? next : 1);
+	return 0;
+}
+
+void wlr_compositor_set_texture_eviction(struct wlr_compositor *compositor,
+		int timeout) {
+	if (timeout < 0) {
+		timeout = 0;
+	}
+	compositor->texture_eviction.timeout = timeout;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// wl_shm buffers already released can't be evicted, the setting applies
+	// to them starting from the next buffer of each surface
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &compositor->surface_resources) {
+		struct wlr_surface *surface = wlr_surface_from_resource(resource);
+		surface->retain_buffers = timeout > 0;
+		surface->last_texture_use = timespec_to_msec(&now);
+	}
+
+	if (timeout == 0) {
+		if (compositor->texture_eviction.timer != NULL) {
+			wl_event_source_remove(compositor->texture_eviction.timer);
+			compositor->texture_eviction.timer = NULL;
+		}
+		return;
+	}
+
+	if (compositor->texture_eviction.timer == NULL) {
+		compositor->texture_eviction.timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(compositor->display),
+			handle_texture_eviction_timer, compositor);
+		if (compositor->texture_eviction.timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create texture eviction timer");
+			compositor->texture_eviction.timeout = 0;
+			return;
+		}
+	}
+	int next = timeout / 2;
+	wl_event_source_timer_update(compositor->texture_eviction.timer,
+		next > 0 ? next : 1);
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_compositor *compositor =
 		wl_container_of(listener, compositor, display_destroy);
@@ -229,6 +316,7 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 		return NULL;
 	}
 	compositor->renderer = renderer;
+	compositor->display = display;
 
 	wl_list_init(&compositor->resources);
 	wl_list_init(&compositor->surface_resources);
@@ -9,6 +9,7 @@
 #include <wlr/types/wlr_output.h>
 #include <wlr/util/log.h>
 #include "util/signal.h"
+#include "util/transform.h"
 
 struct wlr_cursor_device {
 	struct wlr_cursor *cursor;
@@ -17,6 +18,16 @@ struct wlr_cursor_device {
 	struct wlr_output *mapped_output;
 	struct wlr_box *mapped_box;
 
+	// Cached by cursor_device_update_mapping, invalidated whenever the layout
+	// or a mapping changes
+	bool mapping_valid;
+	struct wlr_box *mapping; // see get_mapping, may point to mapping_box
+	struct wlr_box mapping_box, layout_box;
+	// Output transform applied to absolute events: the transformed x is
+	// transform_offset[0] + transform_scale[0] * (x or y if transform_swap)
+	bool transform_swap;
+	double transform_scale[2], transform_offset[2];
+
 	struct wl_listener motion;
 	struct wl_listener motion_absolute;
 	struct wl_listener button;
@@ -33,6 +44,7 @@ struct wlr_cursor_device {
 	struct wl_listener touch_up;
 	struct wl_listener touch_motion;
 	struct wl_listener touch_cancel;
+	struct wl_listener touch_frame;
 
 	struct wl_listener tablet_tool_axis;
 	struct wl_listener tablet_tool_proximity;
@@ -53,6 +65,7 @@ struct wlr_cursor_output_cursor {
 struct wlr_cursor_state {
 	struct wlr_cursor *cursor;
 	struct wl_list devices; // wlr_cursor_device::link
+	struct wlr_cursor_device *last_device; // last looked up, may be NULL
 	struct wl_list output_cursors; // wlr_cursor_output_cursor::link
 	struct wlr_output_layout *layout;
 	struct wlr_output *mapped_output;
@@ -101,6 +114,7 @@ struct wlr_cursor *wlr_cursor_create(void) {
 	wl_signal_init(&cur->events.touch_down);
 	wl_signal_init(&cur->events.touch_motion);
 	wl_signal_init(&cur->events.touch_cancel);
+	wl_signal_init(&cur->events.touch_frame);
 
 	// tablet tool signals
 	wl_signal_init(&cur->events.tablet_tool_tip);
@@ -159,6 +173,7 @@ static void cursor_device_destroy(struct wlr_cursor_device *c_device) {
 		wl_list_remove(&c_device->touch_up.link);
 		wl_list_remove(&c_device->touch_motion.link);
 		wl_list_remove(&c_device->touch_cancel.link);
+		wl_list_remove(&c_device->touch_frame.link);
 	} else if (dev->type == WLR_INPUT_DEVICE_TABLET_TOOL) {
 		wl_list_remove(&c_device->tablet_tool_axis.link);
 		wl_list_remove(&c_device->tablet_tool_proximity.link);
@@ -166,6 +181,9 @@ static void cursor_device_destroy(struct wlr_cursor_device *c_device) {
 		wl_list_remove(&c_device->tablet_tool_button.link);
 	}
 
+	if (c_device->cursor->state->last_device == c_device) {
+		c_device->cursor->state->last_device = NULL;
+	}
 	wl_list_remove(&c_device->link);
 	wl_list_remove(&c_device->destroy.link);
 	free(c_device);
@@ -185,6 +203,12 @@ void wlr_cursor_destroy(struct wlr_cursor *cur) {
 
 static struct wlr_cursor_device *get_cursor_device(struct wlr_cursor *cur,
 		struct wlr_input_device *device) {
+	// Events usually come from the same device many times in a row
+	struct wlr_cursor_device *last = cur->state->last_device;
+	if (last != NULL && last->device == device) {
+		return last;
+	}
+
 	struct wlr_cursor_device *c_device, *ret = NULL;
 	wl_list_for_each(c_device, &cur->state->devices, link) {
 		if (c_device->device == device) {
@@ -193,9 +217,19 @@ static struct wlr_cursor_device *get_cursor_device(struct wlr_cursor *cur,
 		}
 	}
 
+	if (ret != NULL) {
+		cur->state->last_device = ret;
+	}
 	return ret;
 }
 
+static void cursor_invalidate_mappings(struct wlr_cursor *cur) {
+	struct wlr_cursor_device *c_device;
+	wl_list_for_each(c_device, &cur->state->devices, link) {
+		c_device->mapping_valid = false;
+	}
+}
+
 static void cursor_warp_unchecked(struct wlr_cursor *cur,
 		double lx, double ly) {
 	assert(cur->state->layout);
@@ -227,11 +261,8 @@ static void cursor_warp_unchecked(struct wlr_cursor *cur,
  * If none of these are set, returns NULL and absolute movement should be
  * relative to the extents of the layout.
  */
-static struct wlr_box *get_mapping(struct wlr_cursor *cur,
-		struct wlr_input_device *dev) {
-	assert(cur->state->layout);
-	struct wlr_cursor_device *c_device = get_cursor_device(cur, dev);
-
+static struct wlr_box *compute_mapping(struct wlr_cursor *cur,
+		struct wlr_cursor_device *c_device) {
 	if (c_device) {
 		if (c_device->mapped_box) {
 			return c_device->mapped_box;
@@ -253,6 +284,66 @@ static struct wlr_box *get_mapping(struct wlr_cursor *cur,
 	return NULL;
 }
 
+static void apply_output_transform(double *x, double *y,
+	enum wl_output_transform transform);
+static struct wlr_output *get_mapped_output(
+	struct wlr_cursor_device *cursor_device);
+
+static void cursor_device_update_mapping(struct wlr_cursor_device *c_device) {
+	if (c_device->mapping_valid) {
+		return;
+	}
+	struct wlr_cursor *cur = c_device->cursor;
+
+	// Boxes given by the compositor are used as is, they may be changed in
+	// place. Layout boxes are recomputed on each query so they're copied.
+	if (cur->state->layout != NULL) {
+		struct wlr_box *mapping = compute_mapping(cur, c_device);
+		if (mapping != NULL && mapping != c_device->mapped_box &&
+				mapping != cur->state->mapped_box) {
+			c_device->mapping_box = *mapping;
+			mapping = &c_device->mapping_box;
+		}
+		c_device->mapping = mapping;
+		c_device->layout_box =
+			*wlr_output_layout_get_box(cur->state->layout, NULL);
+	} else {
+		c_device->mapping = NULL;
+		c_device->layout_box = (struct wlr_box){0};
+	}
+
+	// Each output transform maps x to either x or y, and the same for y, so
+	// the transform is recovered by applying it to the unit vectors
+	enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
+	struct wlr_output *output = get_mapped_output(c_device);
+	if (output) {
+		transform = output->transform;
+	}
+	double ox = 0.0, oy = 0.0, xx = 1.0, xy = 0.0;
+	apply_output_transform(&ox, &oy, transform);
+	apply_output_transform(&xx, &xy, transform);
+	c_device->transform_swap = xx == ox;
+	c_device->transform_offset[0] = ox;
+	c_device->transform_offset[1] = oy;
+	c_device->transform_scale[0] = c_device->transform_swap ? 1.0 - 2.0 * ox :
+		xx - ox;
+	c_device->transform_scale[1] = c_device->transform_swap ? xy - oy :
+		1.0 - 2.0 * oy;
+
+	c_device->mapping_valid = true;
+}
+
+static struct wlr_box *get_mapping(struct wlr_cursor *cur,
+		struct wlr_input_device *dev) {
+	assert(cur->state->layout);
+	struct wlr_cursor_device *c_device = get_cursor_device(cur, dev);
+	if (c_device == NULL) {
+		return compute_mapping(cur, NULL);
+	}
+	cursor_device_update_mapping(c_device);
+	return c_device->mapping;
+}
+
 bool wlr_cursor_warp(struct wlr_cursor *cur, struct wlr_input_device *dev,
 		double lx, double ly) {
 	assert(cur->state->layout);
@@ -291,9 +382,19 @@ void wlr_cursor_absolute_to_layout_coords(struct wlr_cursor *cur,
 		double *lx, double *ly) {
 	assert(cur->state->layout);
 
-	struct wlr_box *mapping = get_mapping(cur, dev);
-	if (!mapping) {
-		mapping = wlr_output_layout_get_box(cur->state->layout, NULL);
+	struct wlr_cursor_device *c_device = get_cursor_device(cur, dev);
+	struct wlr_box *mapping;
+	if (c_device != NULL) {
+		cursor_device_update_mapping(c_device);
+		mapping = c_device->mapping;
+		if (!mapping) {
+			mapping = &c_device->layout_box;
+		}
+	} else {
+		mapping = compute_mapping(cur, NULL);
+		if (!mapping) {
+			mapping = wlr_output_layout_get_box(cur->state->layout, NULL);
+		}
 	}
 
 	*lx = !isnan(x) ? mapping->width * x + mapping->x : cur->x;
@@ -353,45 +454,10 @@ static void handle_pointer_motion(struct wl_listener *listener, void *data) {
 
 static void apply_output_transform(double *x, double *y,
 		enum wl_output_transform transform) {
-	double dx = 0.0, dy = 0.0;
-	double width = 1.0, height = 1.0;
-
-	switch (transform) {
-	case WL_OUTPUT_TRANSFORM_NORMAL:
-		dx = *x;
-		dy = *y;
-		break;
-	case WL_OUTPUT_TRANSFORM_90:
-		dx = *y;
-		dy = width - *x;
-		break;
-	case WL_OUTPUT_TRANSFORM_180:
-		dx = width - *x;
-		dy = height - *y;
-		break;
-	case WL_OUTPUT_TRANSFORM_270:
-		dx = height - *y;
-		dy = *x;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED:
-		dx = width - *x;
-		dy = *y;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-		dx = height - *y;
-		dy = width - *x;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-		dx = *x;
-		dy = height - *y;
-		break;
-	case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-		dx = *y;
-		dy = *x;
-		break;
-	}
-	*x = dx;
-	*y = dy;
+	double coords[] = { *x, *y, 0.0, 0.0 };
+	transform_fbox_coords(coords, transform, 1.0, 1.0);
+	*x = coords[0];
+	*y = coords[1];
 }
 
 
@@ -409,17 +475,22 @@ static struct wlr_output *get_mapped_output(struct wlr_cursor_device *cursor_dev
 }
 
 
+static void transform_absolute(struct wlr_cursor_device *c_device,
+		double *x, double *y) {
+	cursor_device_update_mapping(c_device);
+	double in_x = c_device->transform_swap ? *y : *x;
+	double in_y = c_device->transform_swap ? *x : *y;
+	*x = c_device->transform_offset[0] + c_device->transform_scale[0] * in_x;
+	*y = c_device->transform_offset[1] + c_device->transform_scale[1] * in_y;
+}
+
 static void handle_pointer_motion_absolute(struct wl_listener *listener,
 		void *data) {
 	struct wlr_event_pointer_motion_absolute *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion_absolute);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.motion_absolute, event);
 }
 
@@ -489,11 +560,7 @@ static void handle_touch_down(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_down);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.touch_down, event);
 }
 
@@ -502,11 +569,7 @@ static void handle_touch_motion(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_motion);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.touch_motion, event);
 }
 
@@ -517,16 +580,18 @@ static void handle_touch_cancel(struct wl_listener *listener, void *data) {
 	wlr_signal_emit_safe(&device->cursor->events.touch_cancel, event);
 }
 
+static void handle_touch_frame(struct wl_listener *listener, void *data) {
+	struct wlr_cursor_device *device;
+	device = wl_container_of(listener, device, touch_frame);
+	wlr_signal_emit_safe(&device->cursor->events.touch_frame, device->cursor);
+}
+
 static void handle_tablet_tool_tip(struct wl_listener *listener, void *data) {
 	struct wlr_event_tablet_tool_tip *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_tip);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_tip, event);
 }
 
@@ -535,11 +600,7 @@ static void handle_tablet_tool_axis(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_axis);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_axis, event);
 }
 
@@ -557,11 +618,7 @@ static void handle_tablet_tool_proximity(struct wl_listener *listener,
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_proximity);
 
-	struct wlr_output *output =
-		get_mapped_output(device);
-	if (output) {
-		apply_output_transform(&event->x, &event->y, output->transform);
-	}
+	transform_absolute(device, &event->x, &event->y);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_proximity, event);
 }
 
@@ -633,6 +690,9 @@ static struct wlr_cursor_device *cursor_device_create(
 
 		wl_signal_add(&device->touch->events.cancel, &c_device->touch_cancel);
 		c_device->touch_cancel.notify = handle_touch_cancel;
+
+		wl_signal_add(&device->touch->events.frame, &c_device->touch_frame);
+		c_device->touch_frame.notify = handle_touch_frame;
 	} else if (device->type == WLR_INPUT_DEVICE_TABLET_TOOL) {
 		wl_signal_add(&device->tablet->events.tip,
 			&c_device->tablet_tool_tip);
@@ -691,6 +751,7 @@ static void handle_layout_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_state *state =
 		wl_container_of(listener, state, layout_destroy);
 	cursor_detach_output_layout(state->cursor);
+	cursor_invalidate_mappings(state->cursor);
 }
 
 static void handle_layout_output_destroy(struct wl_listener *listener,
@@ -743,6 +804,8 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, state, layout_change);
 	struct wlr_output_layout *layout = data;
 
+	cursor_invalidate_mappings(state->cursor);
+
 	if (!wlr_output_layout_contains_point(layout, NULL, state->cursor->x,
 			state->cursor->y)) {
 		// the output we were on has gone away so go to the closest boundary
@@ -758,6 +821,7 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 void wlr_cursor_attach_output_layout(struct wlr_cursor *cur,
 		struct wlr_output_layout *l) {
 	cursor_detach_output_layout(cur);
+	cursor_invalidate_mappings(cur);
 
 	if (l == NULL) {
 		return;
@@ -781,6 +845,7 @@ void wlr_cursor_attach_output_layout(struct wlr_cursor *cur,
 void wlr_cursor_map_to_output(struct wlr_cursor *cur,
 		struct wlr_output *output) {
 	cur->state->mapped_output = output;
+	cursor_invalidate_mappings(cur);
 }
 
 void wlr_cursor_map_input_to_output(struct wlr_cursor *cur,
@@ -793,6 +858,7 @@ void wlr_cursor_map_input_to_output(struct wlr_cursor *cur,
 	}
 
 	c_device->mapped_output = output;
+	c_device->mapping_valid = false;
 }
 
 void wlr_cursor_map_to_region(struct wlr_cursor *cur,
@@ -803,6 +869,7 @@ void wlr_cursor_map_to_region(struct wlr_cursor *cur,
 	}
 
 	cur->state->mapped_box = box;
+	cursor_invalidate_mappings(cur);
 }
 
 void wlr_cursor_map_input_to_region(struct wlr_cursor *cur,
@@ -821,4 +888,5 @@ void wlr_cursor_map_input_to_region(struct wlr_cursor *cur,
 	}
 
 	c_device->mapped_box = box;
+	c_device->mapping_valid = false;
 }
@@ -1,12 +1,17 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <wlr/types/wlr_client_stats.h>
 #include <wlr/types/wlr_data_control_v1.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/util/log.h>
+#include <wlr/util/mime_type.h>
+#include "util/shm.h"
 #include "util/signal.h"
 #include "wlr-data-control-unstable-v1-protocol.h"
 
@@ -46,29 +51,30 @@ static void source_handle_offer(struct wl_client *client,
 		return;
 	}
 
+	const char *interned = wlr_mime_type_intern(mime_type);
+	if (interned == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
 	const char **mime_type_ptr;
 	wl_array_for_each(mime_type_ptr, &source->mime_types) {
-		if (strcmp(*mime_type_ptr, mime_type) == 0) {
+		if (*mime_type_ptr == interned) {
 			wlr_log(WLR_DEBUG, "Ignoring duplicate MIME type offer %s",
 				mime_type);
+			wlr_mime_type_unref(interned);
 			return;
 		}
 	}
 
-	char *dup_mime_type = strdup(mime_type);
-	if (dup_mime_type == NULL) {
-		wl_resource_post_no_memory(resource);
-		return;
-	}
-
-	char **p = wl_array_add(&source->mime_types, sizeof(char *));
+	const char **p = wl_array_add(&source->mime_types, sizeof(char *));
 	if (p == NULL) {
-		free(dup_mime_type);
+		wlr_mime_type_unref(interned);
 		wl_resource_post_no_memory(resource);
 		return;
 	}
 
-	*p = dup_mime_type;
+	*p = interned;
 }
 
 static void source_handle_destroy(struct wl_client *client,
@@ -86,9 +92,9 @@ static void data_control_source_destroy(struct data_control_source *source) {
 		return;
 	}
 
-	char **p;
+	const char **p;
 	wl_array_for_each(p, &source->mime_types) {
-		free(*p);
+		wlr_mime_type_unref(*p);
 	}
 	wl_array_release(&source->mime_types);
 
@@ -237,8 +243,363 @@ static struct data_offer *data_offer_from_offer_resource(
 	return wl_resource_get_user_data(resource);
 }
 
+// Selections are read in chunks of this size, and cached data is written
+// to clients in chunks of this size
+#define SELECTION_CACHE_CHUNK_SIZE 65536
+
+struct selection_cache_entry {
+	struct selection_cache *cache;
+	struct wl_list link; // selection_cache::entries
+	const char *mime_type; // interned
+
+	int shm_fd; // holds the data read so far
+	size_t size;
+	bool complete;
+
+	int pipe_fd; // -1 once done reading
+	struct wl_event_source *read_source;
+};
+
+struct selection_cache {
+	struct wlr_data_control_manager_v1 *manager;
+	struct wl_list link; // wlr_data_control_manager_v1::selection_caches
+	struct wlr_seat *seat;
+	bool primary;
+
+	// The cached source, either a wlr_data_source or a
+	// wlr_primary_selection_source
+	void *source;
+	struct wl_list entries; // selection_cache_entry::link
+	size_t size; // total size of the entries
+
+	struct wl_listener seat_destroy;
+	struct wl_listener seat_set_selection;
+};
+
+// Writes cached data to a client, independently of the cache entry it was
+// made from
+struct selection_cache_transfer {
+	struct wl_list link; // wlr_data_control_manager_v1::selection_transfers
+	int shm_fd, fd;
+	size_t size, offset;
+	struct wl_event_source *write_source;
+};
+
+static void selection_transfer_destroy(
+		struct selection_cache_transfer *transfer) {
+	wl_list_remove(&transfer->link);
+	wl_event_source_remove(transfer->write_source);
+	close(transfer->shm_fd);
+	close(transfer->fd);
+	free(transfer);
+}
+
+static int selection_transfer_handle_writable(int fd, uint32_t mask,
+		void *data) {
+	struct selection_cache_transfer *transfer = data;
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		selection_transfer_destroy(transfer);
+		return 0;
+	}
+
+	char buf[SELECTION_CACHE_CHUNK_SIZE];
+	size_t len = transfer->size - transfer->offset;
+	if (len > sizeof(buf)) {
+		len = sizeof(buf);
+	}
+	ssize_t n = pread(transfer->shm_fd, buf, len, transfer->offset);
+	if (n > 0) {
+		n = write(transfer->fd, buf, n);
+	}
+	if (n < 0 && errno == EAGAIN) {
+		return 0;
+	}
+	if (n <= 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to send cached selection");
+		selection_transfer_destroy(transfer);
+		return 0;
+	}
+
+	transfer->offset += n;
+	if (transfer->offset == transfer->size) {
+		selection_transfer_destroy(transfer);
+	}
+	return 0;
+}
+
+static bool selection_cache_entry_send(struct selection_cache_entry *entry,
+		int fd) {
+	struct wlr_data_control_manager_v1 *manager = entry->cache->manager;
+
+	struct selection_cache_transfer *transfer =
+		calloc(1, sizeof(struct selection_cache_transfer));
+	if (transfer == NULL) {
+		return false;
+	}
+	transfer->shm_fd = dup(entry->shm_fd);
+	if (transfer->shm_fd < 0) {
+		free(transfer);
+		return false;
+	}
+	transfer->fd = fd;
+	transfer->size = entry->size;
+
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		goto error;
+	}
+	transfer->write_source = wl_event_loop_add_fd(manager->event_loop, fd,
+		WL_EVENT_WRITABLE, selection_transfer_handle_writable, transfer);
+	if (transfer->write_source == NULL) {
+		goto error;
+	}
+	wl_list_insert(&manager->selection_transfers, &transfer->link);
+
+	if (transfer->size == 0) {
+		selection_transfer_destroy(transfer);
+	}
+	return true;
+
+error:
+	close(transfer->shm_fd);
+	free(transfer);
+	return false;
+}
+
+static void selection_cache_entry_finish_read(
+		struct selection_cache_entry *entry) {
+	if (entry->pipe_fd < 0) {
+		return;
+	}
+	wl_event_source_remove(entry->read_source);
+	entry->read_source = NULL;
+	close(entry->pipe_fd);
+	entry->pipe_fd = -1;
+}
+
+static void selection_cache_entry_destroy(
+		struct selection_cache_entry *entry) {
+	selection_cache_entry_finish_read(entry);
+	entry->cache->size -= entry->size;
+	wl_list_remove(&entry->link);
+	close(entry->shm_fd);
+	wlr_mime_type_unref(entry->mime_type);
+	free(entry);
+}
+
+static int selection_cache_entry_handle_readable(int fd, uint32_t mask,
+		void *data) {
+	struct selection_cache_entry *entry = data;
+	struct selection_cache *cache = entry->cache;
+
+	char buf[SELECTION_CACHE_CHUNK_SIZE];
+	ssize_t n = read(fd, buf, sizeof(buf));
+	if (n < 0 && errno == EAGAIN) {
+		return 0;
+	}
+	if (n == 0) {
+		entry->complete = true;
+		selection_cache_entry_finish_read(entry);
+		return 0;
+	}
+	if (n < 0 || cache->size + n > cache->manager->selection_cache_size) {
+		// Too large for the cache, receive requests go to the source
+		selection_cache_entry_destroy(entry);
+		return 0;
+	}
+
+	ssize_t written = pwrite(entry->shm_fd, buf, n, entry->size);
+	if (written != n) {
+		wlr_log_errno(WLR_ERROR, "Failed to cache selection");
+		selection_cache_entry_destroy(entry);
+		return 0;
+	}
+	entry->size += n;
+	cache->size += n;
+	return 0;
+}
+
+static void selection_cache_add_entry(struct selection_cache *cache,
+		const char *mime_type) {
+	struct selection_cache_entry *entry =
+		calloc(1, sizeof(struct selection_cache_entry));
+	if (entry == NULL) {
+		return;
+	}
+	entry->cache = cache;
+	entry->pipe_fd = -1;
+	entry->mime_type = wlr_mime_type_ref(mime_type);
+	entry->shm_fd = create_shm_file();
+	if (entry->shm_fd < 0) {
+		goto error;
+	}
+
+	int fds[2];
+	if (pipe(fds) != 0) {
+		goto error;
+	}
+	if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) < 0 ||
+			fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		goto error;
+	}
+	entry->pipe_fd = fds[0];
+	entry->read_source = wl_event_loop_add_fd(cache->manager->event_loop,
+		entry->pipe_fd, WL_EVENT_READABLE,
+		selection_cache_entry_handle_readable, entry);
+	if (entry->read_source == NULL) {
+		close(fds[0]);
+		close(fds[1]);
+		entry->pipe_fd = -1;
+		goto error;
+	}
+	wl_list_insert(cache->entries.prev, &entry->link);
+
+	// The source takes ownership of the write end
+	if (cache->primary) {
+		wlr_primary_selection_source_send(cache->source, mime_type, fds[1]);
+	} else {
+		wlr_data_source_send(cache->source, mime_type, fds[1]);
+	}
+	return;
+
+error:
+	wlr_log_errno(WLR_ERROR, "Failed to create selection cache entry");
+	if (entry->shm_fd >= 0) {
+		close(entry->shm_fd);
+	}
+	wlr_mime_type_unref(entry->mime_type);
+	free(entry);
+}
+
+static void *seat_get_selection_source(struct wlr_seat *seat, bool primary) {
+	if (primary) {
+		return seat->primary_selection_source;
+	}
+	return seat->selection_source;
+}
+
+static void selection_cache_reset(struct selection_cache *cache) {
+	struct selection_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache->entries, link) {
+		selection_cache_entry_destroy(entry);
+	}
+
+	cache->source = seat_get_selection_source(cache->seat, cache->primary);
+	if (cache->source == NULL) {
+		return;
+	}
+
+	struct wl_array *mime_types;
+	if (cache->primary) {
+		struct wlr_primary_selection_source *source = cache->source;
+		mime_types = &source->mime_types;
+	} else {
+		struct wlr_data_source *source = cache->source;
+		mime_types = &source->mime_types;
+	}
+
+	char **p;
+	wl_array_for_each(p, mime_types) {
+		selection_cache_add_entry(cache, *p);
+	}
+}
+
+static void selection_cache_destroy(struct selection_cache *cache) {
+	struct selection_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache->entries, link) {
+		selection_cache_entry_destroy(entry);
+	}
+	wl_list_remove(&cache->seat_destroy.link);
+	wl_list_remove(&cache->seat_set_selection.link);
+	wl_list_remove(&cache->link);
+	free(cache);
+}
+
+static void selection_cache_handle_seat_destroy(struct wl_listener *listener,
+		void *data) {
+	struct selection_cache *cache =
+		wl_container_of(listener, cache, seat_destroy);
+	selection_cache_destroy(cache);
+}
+
+static void selection_cache_handle_seat_set_selection(
+		struct wl_listener *listener, void *data) {
+	struct selection_cache *cache =
+		wl_container_of(listener, cache, seat_set_selection);
+	selection_cache_reset(cache);
+}
+
+static void selection_cache_create(struct wlr_data_control_manager_v1 *manager,
+		struct wlr_seat *seat, bool primary) {
+	struct selection_cache *cache = calloc(1, sizeof(struct selection_cache));
+	if (cache == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	cache->manager = manager;
+	cache->seat = seat;
+	cache->primary = primary;
+	wl_list_init(&cache->entries);
+
+	cache->seat_destroy.notify = selection_cache_handle_seat_destroy;
+	wl_signal_add(&seat->events.destroy, &cache->seat_destroy);
+	cache->seat_set_selection.notify =
+		selection_cache_handle_seat_set_selection;
+	if (primary) {
+		wl_signal_add(&seat->events.set_primary_selection,
+			&cache->seat_set_selection);
+	} else {
+		wl_signal_add(&seat->events.set_selection,
+			&cache->seat_set_selection);
+	}
+	wl_list_insert(&manager->selection_caches, &cache->link);
+
+	selection_cache_reset(cache);
+}
+
+static void manager_ensure_selection_caches(
+		struct wlr_data_control_manager_v1 *manager, struct wlr_seat *seat) {
+	if (manager->selection_cache_size == 0) {
+		return;
+	}
+	struct selection_cache *cache;
+	wl_list_for_each(cache, &manager->selection_caches, link) {
+		if (cache->seat == seat) {
+			return;
+		}
+	}
+	selection_cache_create(manager, seat, false);
+	selection_cache_create(manager, seat, true);
+}
+
+// Sends the cached selection data, returns false if it isn't cached
+static bool selection_cache_send(struct wlr_data_control_manager_v1 *manager,
+		struct wlr_seat *seat, bool primary, const char *mime_type, int fd) {
+	void *source = seat_get_selection_source(seat, primary);
+	struct selection_cache *cache;
+	wl_list_for_each(cache, &manager->selection_caches, link) {
+		if (cache->seat != seat || cache->primary != primary ||
+				cache->source != source) {
+			continue;
+		}
+		struct selection_cache_entry *entry;
+		wl_list_for_each(entry, &cache->entries, link) {
+			if (entry->complete && strcmp(entry->mime_type, mime_type) == 0) {
+				return selection_cache_entry_send(entry, fd);
+			}
+		}
+	}
+	return false;
+}
+
 static void offer_handle_receive(struct wl_client *client,
 		struct wl_resource *resource, const char *mime_type, int fd) {
+	struct wlr_client_stats *stats = wlr_client_stats_get(client);
+	if (stats != NULL) {
+		stats->data_transfers++;
+	}
 	struct data_offer *offer = data_offer_from_offer_resource(resource);
 	if (offer == NULL) {
 		close(fd);
@@ -251,6 +612,11 @@ static void offer_handle_receive(struct wl_client *client,
 		return;
 	}
 
+	if (selection_cache_send(device->manager, device->seat,
+			offer->is_primary, mime_type, fd)) {
+		return;
+	}
+
 	if (offer->is_primary) {
 		if (device->seat->primary_selection_source == NULL) {
 			close(fd);
@@ -627,6 +993,7 @@ static void manager_handle_get_data_device(struct wl_client *client,
 		&device->seat_set_primary_selection);
 
 	wl_list_insert(&manager->devices, &device->link);
+	manager_ensure_selection_caches(manager, device->seat);
 	wlr_signal_emit_safe(&manager->events.new_device, device);
 
 	// At this point maybe the compositor decided to destroy the device. If
@@ -684,6 +1051,9 @@ struct wlr_data_control_manager_v1 *wlr_data_control_manager_v1_create(
 	}
 	wl_list_init(&manager->resources);
 	wl_list_init(&manager->devices);
+	wl_list_init(&manager->selection_caches);
+	wl_list_init(&manager->selection_transfers);
+	manager->event_loop = wl_display_get_event_loop(display);
 	wl_signal_init(&manager->events.destroy);
 	wl_signal_init(&manager->events.new_device);
 
@@ -719,6 +1089,39 @@ void wlr_data_control_manager_v1_destroy(
 		wl_resource_destroy(resource);
 	}
 
+	struct selection_cache *cache, *cache_tmp;
+	wl_list_for_each_safe(cache, cache_tmp, &manager->selection_caches, link) {
+		selection_cache_destroy(cache);
+	}
+
+	struct selection_cache_transfer *transfer, *transfer_tmp;
+	wl_list_for_each_safe(transfer, transfer_tmp,
+			&manager->selection_transfers, link) {
+		selection_transfer_destroy(transfer);
+	}
+
 	wl_list_remove(&manager->display_destroy.link);
 	free(manager);
 }
+
+void wlr_data_control_manager_v1_set_selection_cache(
+		struct wlr_data_control_manager_v1 *manager, size_t max_size) {
+	manager->selection_cache_size = max_size;
+
+	if (max_size == 0) {
+		struct selection_cache *cache, *tmp;
+		wl_list_for_each_safe(cache, tmp, &manager->selection_caches, link) {
+			selection_cache_destroy(cache);
+		}
+		return;
+	}
+
+	struct selection_cache *cache;
+	wl_list_for_each(cache, &manager->selection_caches, link) {
+		selection_cache_reset(cache);
+	}
+	struct wlr_data_control_device_v1 *device;
+	wl_list_for_each(device, &manager->devices, link) {
+		manager_ensure_selection_caches(manager, device->seat);
+	}
+}
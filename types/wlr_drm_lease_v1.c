@@ -0,0 +1,574 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <wlr/backend/drm.h>
+#include <wlr/backend/multi.h>
+#include <wlr/types/wlr_drm_lease_v1.h>
+#include <wlr/util/log.h>
+#include "drm-lease-v1-protocol.h"
+#include "util/signal.h"
+
+#define DRM_LEASE_DEVICE_V1_VERSION 1
+
+static const struct wp_drm_lease_device_v1_interface device_impl;
+static const struct wp_drm_lease_connector_v1_interface connector_impl;
+static const struct wp_drm_lease_request_v1_interface request_impl;
+static const struct wp_drm_lease_v1_interface lease_impl;
+
+static struct wlr_drm_lease_device_v1 *device_from_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource, &wp_drm_lease_device_v1_interface,
+		&device_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static struct wlr_drm_lease_connector_v1 *connector_from_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource,
+		&wp_drm_lease_connector_v1_interface, &connector_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static struct wlr_drm_lease_request_v1 *request_from_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource,
+		&wp_drm_lease_request_v1_interface, &request_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static struct wlr_drm_lease_v1 *lease_from_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource, &wp_drm_lease_v1_interface,
+		&lease_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static void send_done(struct wlr_drm_lease_device_v1 *device) {
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &device->resources) {
+		wp_drm_lease_device_v1_send_done(resource);
+	}
+}
+
+static void connector_handle_destroy(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct wp_drm_lease_connector_v1_interface connector_impl = {
+	.destroy = connector_handle_destroy,
+};
+
+static void connector_handle_resource_destroy(struct wl_resource *resource) {
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void connector_send_to(struct wlr_drm_lease_connector_v1 *connector,
+		struct wl_resource *device_resource) {
+	struct wl_client *client = wl_resource_get_client(device_resource);
+	struct wl_resource *resource = wl_resource_create(client,
+		&wp_drm_lease_connector_v1_interface,
+		wl_resource_get_version(device_resource), 0);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &connector_impl, connector,
+		connector_handle_resource_destroy);
+	wl_list_insert(&connector->resources, wl_resource_get_link(resource));
+
+	struct wlr_output *output = connector->output;
+	char description[128];
+	snprintf(description, sizeof(description), "%s %s", output->make,
+		output->model);
+
+	wp_drm_lease_device_v1_send_connector(device_resource, resource);
+	wp_drm_lease_connector_v1_send_name(resource, output->name);
+	wp_drm_lease_connector_v1_send_description(resource, description);
+	wp_drm_lease_connector_v1_send_connector_id(resource,
+		wlr_drm_connector_get_id(output));
+	wp_drm_lease_connector_v1_send_done(resource);
+}
+
+static void connector_advertise(struct wlr_drm_lease_connector_v1 *connector) {
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &connector->device->resources) {
+		connector_send_to(connector, resource);
+	}
+}
+
+// Makes the connector's objects inert, clients need new ones to lease it
+static void connector_withdraw(struct wlr_drm_lease_connector_v1 *connector) {
+	struct wl_resource *resource, *tmp;
+	wl_resource_for_each_safe(resource, tmp, &connector->resources) {
+		wp_drm_lease_connector_v1_send_withdrawn(resource);
+		wl_resource_set_user_data(resource, NULL);
+		wl_list_remove(wl_resource_get_link(resource));
+		wl_list_init(wl_resource_get_link(resource));
+	}
+
+	struct wlr_drm_lease_request_v1 *request;
+	wl_list_for_each(request, &connector->device->requests, link) {
+		for (size_t i = 0; i < request->n_connectors; ++i) {
+			if (request->connectors[i] == connector) {
+				request->connectors[i] = NULL;
+				request->invalid = true;
+			}
+		}
+	}
+}
+
+static void lease_destroy(struct wlr_drm_lease_v1 *lease) {
+	for (size_t i = 0; i < lease->n_connectors; ++i) {
+		struct wlr_drm_lease_connector_v1 *connector = lease->connectors[i];
+		if (connector != NULL) {
+			connector->active_lease = NULL;
+			connector_advertise(connector);
+		}
+	}
+	send_done(lease->device);
+
+	if (lease->resource != NULL) {
+		wp_drm_lease_v1_send_finished(lease->resource);
+		wl_resource_set_user_data(lease->resource, NULL);
+	}
+	wl_list_remove(&lease->destroy.link);
+	wl_list_remove(&lease->link);
+	free(lease->connectors);
+	free(lease);
+}
+
+static void lease_handle_drm_lease_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_lease_v1 *lease = wl_container_of(listener, lease, destroy);
+	lease_destroy(lease);
+}
+
+static void lease_handle_destroy(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct wp_drm_lease_v1_interface lease_impl = {
+	.destroy = lease_handle_destroy,
+};
+
+static void lease_handle_resource_destroy(struct wl_resource *resource) {
+	struct wlr_drm_lease_v1 *lease = lease_from_resource(resource);
+	if (lease == NULL) {
+		return;
+	}
+	lease->resource = NULL;
+	wlr_drm_lease_v1_revoke(lease);
+}
+
+void wlr_drm_lease_v1_revoke(struct wlr_drm_lease_v1 *lease) {
+	// Destroys the wlr_drm_lease_v1 through its destroy signal
+	wlr_drm_lease_terminate(lease->drm_lease);
+}
+
+void wlr_drm_lease_request_v1_reject(struct wlr_drm_lease_request_v1 *request) {
+	assert(request->lease_resource != NULL && !request->handled);
+	request->handled = true;
+	wp_drm_lease_v1_send_finished(request->lease_resource);
+}
+
+struct wlr_drm_lease_v1 *wlr_drm_lease_request_v1_grant(
+		struct wlr_drm_lease_request_v1 *request) {
+	assert(request->lease_resource != NULL && !request->handled);
+	if (request->invalid || request->device == NULL) {
+		wlr_drm_lease_request_v1_reject(request);
+		return NULL;
+	}
+
+	struct wlr_output *outputs[request->n_connectors];
+	for (size_t i = 0; i < request->n_connectors; ++i) {
+		struct wlr_drm_lease_connector_v1 *connector = request->connectors[i];
+		if (connector->active_lease != NULL) {
+			wlr_drm_lease_request_v1_reject(request);
+			return NULL;
+		}
+		outputs[i] = connector->output;
+	}
+
+	struct wlr_drm_lease_v1 *lease = calloc(1, sizeof(struct wlr_drm_lease_v1));
+	if (lease == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		wlr_drm_lease_request_v1_reject(request);
+		return NULL;
+	}
+
+	int fd;
+	lease->drm_lease =
+		wlr_drm_create_lease(outputs, request->n_connectors, &fd);
+	if (lease->drm_lease == NULL) {
+		free(lease);
+		wlr_drm_lease_request_v1_reject(request);
+		return NULL;
+	}
+
+	request->handled = true;
+	lease->device = request->device;
+	lease->resource = request->lease_resource;
+	wl_resource_set_user_data(lease->resource, lease);
+	wl_list_insert(&lease->device->leases, &lease->link);
+	lease->destroy.notify = lease_handle_drm_lease_destroy;
+	wl_signal_add(&lease->drm_lease->events.destroy, &lease->destroy);
+
+	// The lease owns the connectors until it ends
+	lease->connectors = request->connectors;
+	lease->n_connectors = request->n_connectors;
+	request->connectors = NULL;
+	request->n_connectors = 0;
+	for (size_t i = 0; i < lease->n_connectors; ++i) {
+		lease->connectors[i]->active_lease = lease;
+		connector_withdraw(lease->connectors[i]);
+	}
+	send_done(lease->device);
+
+	wp_drm_lease_v1_send_lease_fd(lease->resource, fd);
+	close(fd);
+	return lease;
+}
+
+static void request_handle_request_connector(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *connector_resource) {
+	struct wlr_drm_lease_request_v1 *request = request_from_resource(resource);
+	struct wlr_drm_lease_connector_v1 *connector =
+		connector_from_resource(connector_resource);
+	if (connector == NULL || request->device == NULL) {
+		// Withdrawn, the request will fail
+		request->invalid = true;
+		return;
+	}
+	if (connector->device != request->device) {
+		wl_resource_post_error(resource,
+			WP_DRM_LEASE_REQUEST_V1_ERROR_WRONG_DEVICE,
+			"Connector belongs to another device");
+		return;
+	}
+	for (size_t i = 0; i < request->n_connectors; ++i) {
+		if (request->connectors[i] == connector) {
+			wl_resource_post_error(resource,
+				WP_DRM_LEASE_REQUEST_V1_ERROR_DUPLICATE_CONNECTOR,
+				"Connector requested twice");
+			return;
+		}
+	}
+
+	struct wlr_drm_lease_connector_v1 **connectors = realloc(
+		request->connectors,
+		(request->n_connectors + 1) * sizeof(*request->connectors));
+	if (connectors == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+	request->connectors = connectors;
+	request->connectors[request->n_connectors++] = connector;
+}
+
+static void request_handle_submit(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct wlr_drm_lease_request_v1 *request = request_from_resource(resource);
+
+	struct wl_resource *lease_resource = wl_resource_create(client,
+		&wp_drm_lease_v1_interface, wl_resource_get_version(resource), id);
+	if (lease_resource == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+	wl_resource_set_implementation(lease_resource, &lease_impl, NULL,
+		lease_handle_resource_destroy);
+
+	if (request->n_connectors == 0 && !request->invalid) {
+		wl_resource_post_error(resource,
+			WP_DRM_LEASE_REQUEST_V1_ERROR_EMPTY_LEASE,
+			"Lease request has no connectors");
+		return;
+	}
+
+	request->lease_resource = lease_resource;
+	if (request->invalid || request->device == NULL) {
+		wlr_drm_lease_request_v1_reject(request);
+	} else {
+		wlr_signal_emit_safe(&request->device->manager->events.request,
+			request);
+		if (!request->handled) {
+			wlr_drm_lease_request_v1_reject(request);
+		}
+	}
+
+	wl_resource_destroy(resource);
+}
+
+static const struct wp_drm_lease_request_v1_interface request_impl = {
+	.request_connector = request_handle_request_connector,
+	.submit = request_handle_submit,
+};
+
+static void request_handle_resource_destroy(struct wl_resource *resource) {
+	struct wlr_drm_lease_request_v1 *request = request_from_resource(resource);
+	wl_list_remove(&request->link);
+	free(request->connectors);
+	free(request);
+}
+
+static void device_handle_create_lease_request(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct wlr_drm_lease_device_v1 *device = device_from_resource(resource);
+
+	struct wlr_drm_lease_request_v1 *request =
+		calloc(1, sizeof(struct wlr_drm_lease_request_v1));
+	if (request == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+	request->resource = wl_resource_create(client,
+		&wp_drm_lease_request_v1_interface, wl_resource_get_version(resource),
+		id);
+	if (request->resource == NULL) {
+		free(request);
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+	wl_resource_set_implementation(request->resource, &request_impl, request,
+		request_handle_resource_destroy);
+
+	request->device = device;
+	if (device != NULL) {
+		wl_list_insert(&device->requests, &request->link);
+	} else {
+		wl_list_init(&request->link);
+	}
+}
+
+static void device_handle_release(struct wl_client *client,
+		struct wl_resource *resource) {
+	wp_drm_lease_device_v1_send_released(resource);
+	wl_resource_destroy(resource);
+}
+
+static const struct wp_drm_lease_device_v1_interface device_impl = {
+	.create_lease_request = device_handle_create_lease_request,
+	.release = device_handle_release,
+};
+
+static void device_handle_resource_destroy(struct wl_resource *resource) {
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void device_bind(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wlr_drm_lease_device_v1 *device = data;
+
+	struct wl_resource *resource = wl_resource_create(client,
+		&wp_drm_lease_device_v1_interface, version, id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &device_impl, device,
+		device_handle_resource_destroy);
+	wl_list_insert(&device->resources, wl_resource_get_link(resource));
+
+	int fd = wlr_drm_backend_get_non_master_fd(device->backend);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "Failed to get a DRM fd for the lease device");
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wp_drm_lease_device_v1_send_drm_fd(resource, fd);
+	close(fd);
+
+	struct wlr_drm_lease_connector_v1 *connector;
+	wl_list_for_each(connector, &device->connectors, link) {
+		if (connector->active_lease == NULL) {
+			connector_send_to(connector, resource);
+		}
+	}
+	wp_drm_lease_device_v1_send_done(resource);
+}
+
+static void connector_destroy(struct wlr_drm_lease_connector_v1 *connector) {
+	if (connector->active_lease != NULL) {
+		struct wlr_drm_lease_v1 *lease = connector->active_lease;
+		for (size_t i = 0; i < lease->n_connectors; ++i) {
+			if (lease->connectors[i] == connector) {
+				lease->connectors[i] = NULL;
+			}
+		}
+		wlr_drm_lease_v1_revoke(lease);
+	}
+	connector_withdraw(connector);
+	wl_list_remove(&connector->output_destroy.link);
+	wl_list_remove(&connector->link);
+	free(connector);
+}
+
+static void connector_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_lease_connector_v1 *connector =
+		wl_container_of(listener, connector, output_destroy);
+	struct wlr_drm_lease_device_v1 *device = connector->device;
+	connector_destroy(connector);
+	send_done(device);
+}
+
+bool wlr_drm_lease_v1_manager_offer_output(
+		struct wlr_drm_lease_v1_manager *manager, struct wlr_output *output) {
+	struct wlr_drm_lease_device_v1 *device, *found = NULL;
+	wl_list_for_each(device, &manager->devices, link) {
+		if (device->backend == output->backend) {
+			found = device;
+			break;
+		}
+	}
+	if (found == NULL) {
+		wlr_log(WLR_ERROR, "Cannot offer output '%s' for lease: not a DRM "
+			"output of this manager", output->name);
+		return false;
+	}
+
+	struct wlr_drm_lease_connector_v1 *connector;
+	wl_list_for_each(connector, &found->connectors, link) {
+		if (connector->output == output) {
+			return true;
+		}
+	}
+
+	connector = calloc(1, sizeof(struct wlr_drm_lease_connector_v1));
+	if (connector == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	connector->output = output;
+	connector->device = found;
+	wl_list_init(&connector->resources);
+	connector->output_destroy.notify = connector_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &connector->output_destroy);
+	wl_list_insert(&found->connectors, &connector->link);
+
+	connector_advertise(connector);
+	send_done(found);
+	return true;
+}
+
+void wlr_drm_lease_v1_manager_withdraw_output(
+		struct wlr_drm_lease_v1_manager *manager, struct wlr_output *output) {
+	struct wlr_drm_lease_device_v1 *device;
+	wl_list_for_each(device, &manager->devices, link) {
+		struct wlr_drm_lease_connector_v1 *connector;
+		wl_list_for_each(connector, &device->connectors, link) {
+			if (connector->output == output) {
+				connector_destroy(connector);
+				send_done(device);
+				return;
+			}
+		}
+	}
+}
+
+static void device_destroy(struct wlr_drm_lease_device_v1 *device) {
+	struct wlr_drm_lease_connector_v1 *connector, *connector_tmp;
+	wl_list_for_each_safe(connector, connector_tmp, &device->connectors,
+			link) {
+		connector_destroy(connector);
+	}
+
+	struct wlr_drm_lease_request_v1 *request, *request_tmp;
+	wl_list_for_each_safe(request, request_tmp, &device->requests, link) {
+		request->device = NULL;
+		wl_list_remove(&request->link);
+		wl_list_init(&request->link);
+	}
+
+	struct wl_resource *resource, *resource_tmp;
+	wl_resource_for_each_safe(resource, resource_tmp, &device->resources) {
+		wl_resource_set_user_data(resource, NULL);
+		wl_list_remove(wl_resource_get_link(resource));
+		wl_list_init(wl_resource_get_link(resource));
+	}
+
+	wl_global_destroy(device->global);
+	wl_list_remove(&device->backend_destroy.link);
+	wl_list_remove(&device->link);
+	free(device);
+}
+
+static void device_handle_backend_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_drm_lease_device_v1 *device =
+		wl_container_of(listener, device, backend_destroy);
+	device_destroy(device);
+}
+
+static void manager_add_device(struct wlr_backend *backend, void *data) {
+	struct wlr_drm_lease_v1_manager *manager = data;
+	if (!wlr_backend_is_drm(backend)) {
+		return;
+	}
+
+	struct wlr_drm_lease_device_v1 *device =
+		calloc(1, sizeof(struct wlr_drm_lease_device_v1));
+	if (device == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	device->global = wl_global_create(manager->display,
+		&wp_drm_lease_device_v1_interface, DRM_LEASE_DEVICE_V1_VERSION,
+		device, device_bind);
+	if (device->global == NULL) {
+		free(device);
+		return;
+	}
+
+	device->manager = manager;
+	device->backend = backend;
+	wl_list_init(&device->resources);
+	wl_list_init(&device->connectors);
+	wl_list_init(&device->leases);
+	wl_list_init(&device->requests);
+	device->backend_destroy.notify = device_handle_backend_destroy;
+	wl_signal_add(&backend->events.destroy, &device->backend_destroy);
+	wl_list_insert(&manager->devices, &device->link);
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_drm_lease_v1_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	struct wlr_drm_lease_device_v1 *device, *tmp;
+	wl_list_for_each_safe(device, tmp, &manager->devices, link) {
+		device_destroy(device);
+	}
+	wl_list_remove(&manager->display_destroy.link);
+	free(manager);
+}
+
+struct wlr_drm_lease_v1_manager *wlr_drm_lease_v1_manager_create(
+		struct wl_display *display, struct wlr_backend *backend) {
+	struct wlr_drm_lease_v1_manager *manager =
+		calloc(1, sizeof(struct wlr_drm_lease_v1_manager));
+	if (manager == NULL) {
+		return NULL;
+	}
+	manager->display = display;
+	wl_list_init(&manager->devices);
+	wl_signal_init(&manager->events.request);
+
+	if (wlr_backend_is_multi(backend)) {
+		wlr_multi_for_each_backend(backend, manager_add_device, manager);
+	} else {
+		manager_add_device(backend, manager);
+	}
+	if (wl_list_empty(&manager->devices)) {
+		wlr_log(WLR_DEBUG, "No DRM backend, DRM leases are unavailable");
+		free(manager);
+		return NULL;
+	}
+
+	manager->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+	return manager;
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/dmabuf.h>
@@ -39,7 +40,7 @@ static void frame_destroy(struct wlr_export_dmabuf_frame_v1 *frame) {
 	}
 	wl_list_remove(&frame->link);
 	wl_list_remove(&frame->output_swap_buffers.link);
-	wlr_dmabuf_attributes_finish(&frame->attribs);
+	wl_list_remove(&frame->output_present.link);
 	// Make the frame resource inert
 	wl_resource_set_user_data(frame->resource, NULL);
 	free(frame);
@@ -50,15 +51,136 @@ static void frame_handle_resource_destroy(struct wl_resource *resource) {
 	frame_destroy(frame);
 }
 
+static void export_output_destroy(struct wlr_export_dmabuf_output_v1 *export) {
+	for (size_t i = 0; i < export->buffers_len; ++i) {
+		wlr_dmabuf_attributes_finish(&export->buffers[i].attribs);
+	}
+	wl_list_remove(&export->output_destroy.link);
+	wl_list_remove(&export->link);
+	free(export);
+}
+
+static void export_output_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_export_dmabuf_output_v1 *export =
+		wl_container_of(listener, export, output_destroy);
+	export_output_destroy(export);
+}
+
+static struct wlr_export_dmabuf_output_v1 *export_output_get_or_create(
+		struct wlr_export_dmabuf_manager_v1 *manager,
+		struct wlr_output *output) {
+	struct wlr_export_dmabuf_output_v1 *export;
+	wl_list_for_each(export, &manager->outputs, link) {
+		if (export->output == output) {
+			return export;
+		}
+	}
+
+	export = calloc(1, sizeof(struct wlr_export_dmabuf_output_v1));
+	if (export == NULL) {
+		return NULL;
+	}
+	export->output = output;
+	wl_signal_add(&output->events.destroy, &export->output_destroy);
+	export->output_destroy.notify = export_output_handle_output_destroy;
+	wl_list_insert(&manager->outputs, &export->link);
+	return export;
+}
+
+/**
+ * Exports the buffer currently displayed by the output. If it has already
+ * been exported, the cached DMA-BUF is returned instead, so that clients
+ * importing it can keep their imports around. The returned attributes are
+ * owned by the cache.
+ */
+static struct wlr_dmabuf_attributes *export_output_export(
+		struct wlr_export_dmabuf_output_v1 *export) {
+	struct wlr_dmabuf_attributes attribs;
+	if (!wlr_output_export_dmabuf(export->output, &attribs)) {
+		return NULL;
+	}
+
+	// Buffers are identified by the inode of their first DMA-BUF
+	struct stat st;
+	if (fstat(attribs.fd[0], &st) != 0) {
+		wlr_log_errno(WLR_ERROR, "fstat failed");
+		wlr_dmabuf_attributes_finish(&attribs);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < export->buffers_len; ++i) {
+		if (export->buffers[i].dev == st.st_dev &&
+				export->buffers[i].ino == st.st_ino) {
+			wlr_dmabuf_attributes_finish(&attribs);
+			return &export->buffers[i].attribs;
+		}
+	}
+
+	size_t i = export->next_buffer;
+	if (i < export->buffers_len) {
+		wlr_dmabuf_attributes_finish(&export->buffers[i].attribs);
+	} else {
+		export->buffers_len++;
+	}
+	export->buffers[i].attribs = attribs;
+	export->buffers[i].dev = st.st_dev;
+	export->buffers[i].ino = st.st_ino;
+	export->next_buffer = (i + 1) % WLR_EXPORT_DMABUF_V1_CACHE_LEN;
+	return &export->buffers[i].attribs;
+}
+
 static void frame_output_handle_swap_buffers(struct wl_listener *listener,
 		void *data) {
 	struct wlr_export_dmabuf_frame_v1 *frame =
 		wl_container_of(listener, frame, output_swap_buffers);
-	struct wlr_output_event_swap_buffers *event = data;
-
 	wl_list_remove(&frame->output_swap_buffers.link);
 	wl_list_init(&frame->output_swap_buffers.link);
+	frame->swapped = true;
+}
+
+static void frame_output_handle_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_export_dmabuf_frame_v1 *frame =
+		wl_container_of(listener, frame, output_present);
+	struct wlr_output_event_present *event = data;
+	struct wlr_output *output = frame->output;
+
+	if (!frame->swapped) {
+		// This is a frame rendered before the capture was requested
+		return;
+	}
+
+	// The presented buffer won't be rendered into until the next frame, it's
+	// the right time to export it
+	struct wlr_export_dmabuf_output_v1 *export =
+		export_output_get_or_create(frame->manager, output);
+	struct wlr_dmabuf_attributes *attribs =
+		export != NULL ? export_output_export(export) : NULL;
+	if (attribs == NULL) {
+		zwlr_export_dmabuf_frame_v1_send_cancel(frame->resource,
+			ZWLR_EXPORT_DMABUF_FRAME_V1_CANCEL_REASON_TEMPORARY);
+		frame_destroy(frame);
+		return;
+	}
 
+	uint32_t frame_flags = ZWLR_EXPORT_DMABUF_FRAME_V1_FLAGS_TRANSIENT;
+	uint32_t mod_high = attribs->modifier >> 32;
+	uint32_t mod_low = attribs->modifier & 0xFFFFFFFF;
+
+	zwlr_export_dmabuf_frame_v1_send_frame(frame->resource,
+		output->width, output->height, 0, 0, attribs->flags, frame_flags,
+		attribs->format, mod_high, mod_low, attribs->n_planes);
+
+	// File descriptors are duplicated when sent, the cache keeps its own
+	for (int i = 0; i < attribs->n_planes; ++i) {
+		off_t size = lseek(attribs->fd[i], 0, SEEK_END);
+
+		zwlr_export_dmabuf_frame_v1_send_object(frame->resource, i,
+			attribs->fd[i], size, attribs->offset[i], attribs->stride[i], i);
+	}
+
+	// Clients can pace their requests with the presentation time
 	time_t tv_sec = event->when->tv_sec;
 	uint32_t tv_sec_hi = (sizeof(tv_sec) > 4) ? tv_sec >> 32 : 0;
 	uint32_t tv_sec_lo = tv_sec & 0xFFFFFFFF;
@@ -93,6 +215,7 @@ static void manager_handle_capture_output(struct wl_client *client,
 	frame->manager = manager;
 	frame->output = output;
 	wl_list_init(&frame->output_swap_buffers.link);
+	wl_list_init(&frame->output_present.link);
 
 	uint32_t version = wl_resource_get_version(manager_resource);
 	frame->resource = wl_resource_create(client,
@@ -114,37 +237,18 @@ static void manager_handle_capture_output(struct wl_client *client,
 		return;
 	}
 
-	struct wlr_dmabuf_attributes *attribs = &frame->attribs;
-	if (!wlr_output_export_dmabuf(output, attribs)) {
-		zwlr_export_dmabuf_frame_v1_send_cancel(frame->resource,
-			ZWLR_EXPORT_DMABUF_FRAME_V1_CANCEL_REASON_TEMPORARY);
-		frame_destroy(frame);
-		return;
-	}
-
 	if (overlay_cursor) {
 		wlr_output_lock_software_cursors(frame->output, true);
 		frame->cursor_locked = true;
 	}
 
-	uint32_t frame_flags = ZWLR_EXPORT_DMABUF_FRAME_V1_FLAGS_TRANSIENT;
-	uint32_t mod_high = attribs->modifier >> 32;
-	uint32_t mod_low = attribs->modifier & 0xFFFFFFFF;
-
-	zwlr_export_dmabuf_frame_v1_send_frame(frame->resource,
-		output->width, output->height, 0, 0, attribs->flags, frame_flags,
-		attribs->format, mod_high, mod_low, attribs->n_planes);
-
-	for (int i = 0; i < attribs->n_planes; ++i) {
-		off_t size = lseek(attribs->fd[i], 0, SEEK_END);
-
-		zwlr_export_dmabuf_frame_v1_send_object(frame->resource, i,
-			attribs->fd[i], size, attribs->offset[i], attribs->stride[i], i);
-	}
-
+	// The buffer is exported once the next frame has been presented
 	wl_list_remove(&frame->output_swap_buffers.link);
 	wl_signal_add(&output->events.swap_buffers, &frame->output_swap_buffers);
 	frame->output_swap_buffers.notify = frame_output_handle_swap_buffers;
+	wl_list_remove(&frame->output_present.link);
+	wl_signal_add(&output->events.present, &frame->output_present);
+	frame->output_present.notify = frame_output_handle_present;
 }
 
 static void manager_handle_destroy(struct wl_client *client,
@@ -192,6 +296,7 @@ struct wlr_export_dmabuf_manager_v1 *wlr_export_dmabuf_manager_v1_create(
 	}
 	wl_list_init(&manager->resources);
 	wl_list_init(&manager->frames);
+	wl_list_init(&manager->outputs);
 	wl_signal_init(&manager->events.destroy);
 
 	manager->global = wl_global_create(display,
@@ -224,5 +329,9 @@ void wlr_export_dmabuf_manager_v1_destroy(
 	wl_list_for_each_safe(frame, frame_tmp, &manager->frames, link) {
 		wl_resource_destroy(frame->resource);
 	}
+	struct wlr_export_dmabuf_output_v1 *export, *export_tmp;
+	wl_list_for_each_safe(export, export_tmp, &manager->outputs, link) {
+		export_output_destroy(export);
+	}
 	free(manager);
 }
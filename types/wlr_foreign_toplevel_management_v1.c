@@ -3,8 +3,10 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include "util/signal.h"
 #include "wlr-foreign-toplevel-management-unstable-v1-protocol.h"
@@ -21,6 +23,11 @@ static struct wlr_foreign_toplevel_handle_v1 *toplevel_handle_from_resource(
 	return wl_resource_get_user_data(resource);
 }
 
+struct wlr_foreign_toplevel_handle_v1 *wlr_foreign_toplevel_handle_v1_from_resource(
+		struct wl_resource *resource) {
+	return toplevel_handle_from_resource(resource);
+}
+
 static void toplevel_handle_send_maximized_event(struct wl_resource *resource,
 		bool state) {
 	struct wlr_foreign_toplevel_handle_v1 *toplevel =
@@ -139,49 +146,127 @@ static const struct zwlr_foreign_toplevel_handle_v1_interface toplevel_handle_im
 	.destroy = foreign_toplevel_handle_destroy
 };
 
-static void toplevel_idle_send_done(void *data) {
-	struct wlr_foreign_toplevel_handle_v1 *toplevel = data;
+static int64_t get_current_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void toplevel_send_state(
+	struct wlr_foreign_toplevel_handle_v1 *toplevel);
+
+static void toplevel_send_update(
+		struct wlr_foreign_toplevel_handle_v1 *toplevel) {
+	uint32_t pending = toplevel->pending;
+	toplevel->pending = 0;
+	toplevel->last_update = get_current_time_msec();
+
 	struct wl_resource *resource;
+	if ((pending & WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_TITLE) &&
+			toplevel->title != NULL) {
+		wl_resource_for_each(resource, &toplevel->resources) {
+			zwlr_foreign_toplevel_handle_v1_send_title(resource,
+				toplevel->title);
+		}
+	}
+	if ((pending & WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_APP_ID) &&
+			toplevel->app_id != NULL) {
+		wl_resource_for_each(resource, &toplevel->resources) {
+			zwlr_foreign_toplevel_handle_v1_send_app_id(resource,
+				toplevel->app_id);
+		}
+	}
+	if (pending & WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_STATE) {
+		toplevel_send_state(toplevel);
+	}
+
 	wl_resource_for_each(resource, &toplevel->resources) {
 		zwlr_foreign_toplevel_handle_v1_send_done(resource);
 	}
+}
 
+static void toplevel_idle_send_done(void *data) {
+	struct wlr_foreign_toplevel_handle_v1 *toplevel = data;
 	toplevel->idle_source = NULL;
+	toplevel_send_update(toplevel);
+}
+
+static int toplevel_handle_update_timer(void *data) {
+	struct wlr_foreign_toplevel_handle_v1 *toplevel = data;
+	toplevel->update_timer_armed = false;
+	toplevel_send_update(toplevel);
+	return 0;
 }
 
 static void toplevel_update_idle_source(
 	struct wlr_foreign_toplevel_handle_v1 *toplevel) {
-	if (toplevel->idle_source) {
+	if (toplevel->idle_source || toplevel->update_timer_armed) {
 		return;
 	}
 
+	int rate = toplevel->manager->max_update_rate;
+	if (rate > 0) {
+		int64_t delay = 1000 / rate -
+			(get_current_time_msec() - toplevel->last_update);
+		if (delay > 0) {
+			if (toplevel->update_timer == NULL) {
+				toplevel->update_timer = wl_event_loop_add_timer(
+					toplevel->manager->event_loop,
+					toplevel_handle_update_timer, toplevel);
+			}
+			if (toplevel->update_timer != NULL) {
+				wl_event_source_timer_update(toplevel->update_timer, delay);
+				toplevel->update_timer_armed = true;
+				return;
+			}
+			wlr_log(WLR_ERROR, "Failed to create toplevel update timer");
+		}
+	}
+
 	toplevel->idle_source = wl_event_loop_add_idle(toplevel->manager->event_loop,
 		toplevel_idle_send_done, toplevel);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_title(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, const char *title) {
+	if (toplevel->title != NULL && strcmp(toplevel->title, title) == 0) {
+		return;
+	}
 	free(toplevel->title);
 	toplevel->title = strdup(title);
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &toplevel->resources) {
-		zwlr_foreign_toplevel_handle_v1_send_title(resource, title);
-	}
-
+	toplevel->pending |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_TITLE;
 	toplevel_update_idle_source(toplevel);
 }
 
+static void toplevel_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_foreign_toplevel_handle_v1 *toplevel =
+		wl_container_of(listener, toplevel, surface_destroy);
+	wlr_foreign_toplevel_handle_v1_set_surface(toplevel, NULL);
+}
+
+void wlr_foreign_toplevel_handle_v1_set_surface(
+		struct wlr_foreign_toplevel_handle_v1 *toplevel,
+		struct wlr_surface *surface) {
+	wl_list_remove(&toplevel->surface_destroy.link);
+	wl_list_init(&toplevel->surface_destroy.link);
+	toplevel->surface = surface;
+	if (surface != NULL) {
+		wl_signal_add(&surface->events.destroy, &toplevel->surface_destroy);
+		toplevel->surface_destroy.notify = toplevel_handle_surface_destroy;
+	}
+}
+
 void wlr_foreign_toplevel_handle_v1_set_app_id(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, const char *app_id) {
+	if (toplevel->app_id != NULL && strcmp(toplevel->app_id, app_id) == 0) {
+		return;
+	}
 	free(toplevel->app_id);
 	toplevel->app_id = strdup(app_id);
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &toplevel->resources) {
-		zwlr_foreign_toplevel_handle_v1_send_app_id(resource, app_id);
-	}
-
+	toplevel->pending |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_APP_ID;
 	toplevel_update_idle_source(toplevel);
 }
 
@@ -323,37 +408,49 @@ static void toplevel_send_state(struct wlr_foreign_toplevel_handle_v1 *toplevel)
 	}
 
 	wl_array_release(&states);
+}
+
+static void toplevel_set_state(struct wlr_foreign_toplevel_handle_v1 *toplevel,
+		uint32_t state) {
+	if (toplevel->state == state) {
+		return;
+	}
+	toplevel->state = state;
+	toplevel->pending |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_PENDING_STATE;
 	toplevel_update_idle_source(toplevel);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_maximized(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool maximized) {
+	uint32_t state = toplevel->state;
 	if (maximized) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
+		state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
 	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
+		state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
 	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel, state);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_minimized(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool minimized) {
+	uint32_t state = toplevel->state;
 	if (minimized) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
+		state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
 	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
+		state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
 	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel, state);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_activated(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool activated) {
+	uint32_t state = toplevel->state;
 	if (activated) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
+		state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
 	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
+		state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
 	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel, state);
 }
 
 void wlr_foreign_toplevel_handle_v1_destroy(
@@ -380,7 +477,11 @@ void wlr_foreign_toplevel_handle_v1_destroy(
 	if (toplevel->idle_source) {
 		wl_event_source_remove(toplevel->idle_source);
 	}
+	if (toplevel->update_timer) {
+		wl_event_source_remove(toplevel->update_timer);
+	}
 
+	wl_list_remove(&toplevel->surface_destroy.link);
 	wl_list_remove(&toplevel->link);
 
 	free(toplevel->title);
@@ -426,6 +527,7 @@ wlr_foreign_toplevel_handle_v1_create(
 
 	wl_list_init(&toplevel->resources);
 	wl_list_init(&toplevel->outputs);
+	wl_list_init(&toplevel->surface_destroy.link);
 
 	wl_signal_init(&toplevel->events.request_maximize);
 	wl_signal_init(&toplevel->events.request_minimize);
@@ -541,6 +643,11 @@ void wlr_foreign_toplevel_manager_v1_destroy(
 	free(manager);
 }
 
+void wlr_foreign_toplevel_manager_v1_set_update_rate(
+		struct wlr_foreign_toplevel_manager_v1 *manager, int rate) {
+	manager->max_update_rate = rate > 0 ? rate : 0;
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_foreign_toplevel_manager_v1 *manager =
 		wl_container_of(listener, manager, display_destroy);
@@ -1,6 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/util/log.h>
@@ -25,11 +27,31 @@ static void idle_timeout_destroy(struct wlr_idle_timeout *timer) {
 	free(timer);
 }
 
+static int64_t get_current_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void idle_timeout_arm(struct wlr_idle_timeout *timer, int delay) {
+	wl_event_source_timer_update(timer->idle_source, delay);
+	timer->armed = delay > 0;
+}
+
 static int idle_notify(void *data) {
 	struct wlr_idle_timeout *timer = data;
+	timer->armed = false;
 	if (timer->idle_state) {
 		return 0;
 	}
+
+	// There may have been activity since the timer was armed
+	int64_t elapsed = get_current_time_msec() - timer->last_activity;
+	if (elapsed < timer->timeout) {
+		idle_timeout_arm(timer, timer->timeout - elapsed);
+		return 0;
+	}
+
 	timer->idle_state = true;
 	org_kde_kwin_idle_timeout_send_idle(timer->resource);
 	return 1;
@@ -39,6 +61,9 @@ static void handle_activity(struct wlr_idle_timeout *timer) {
 	if (!timer->enabled) {
 		return;
 	}
+	// Reading the monotonic clock doesn't involve a syscall, unlike
+	// re-arming the timer
+	timer->last_activity = get_current_time_msec();
 
 	// in case the previous state was sleeping send a resume event and switch state
 	if (timer->idle_state) {
@@ -46,10 +71,12 @@ static void handle_activity(struct wlr_idle_timeout *timer) {
 		org_kde_kwin_idle_timeout_send_resumed(timer->resource);
 	}
 
-	// rearm the timer
-	wl_event_source_timer_update(timer->idle_source, timer->timeout);
 	if (timer->timeout == 0) {
 		idle_notify(timer);
+	} else if (!timer->armed) {
+		// An armed timer checks the time of the last activity when it fires,
+		// this avoids re-arming it on every input event
+		idle_timeout_arm(timer, timer->timeout);
 	}
 }
 
@@ -147,9 +174,10 @@ static void create_idle_timer(struct wl_client *client,
 		wl_resource_post_no_memory(idle_resource);
 		return;
 	}
+	timer->last_activity = get_current_time_msec();
 	if (timer->enabled) {
 		// arm the timer
-		wl_event_source_timer_update(timer->idle_source, timer->timeout);
+		idle_timeout_arm(timer, timer->timeout);
 		if (timer->timeout == 0) {
 			idle_notify(timer);
 		}
@@ -169,13 +197,14 @@ void wlr_idle_set_enabled(struct wlr_idle *idle, struct wlr_seat *seat,
 		enabled ? "Enabling" : "Disabling",
 		seat ? seat->name : "all seats");
 	idle->enabled = enabled;
+	int64_t now = get_current_time_msec();
 	struct wlr_idle_timeout *timer;
 	wl_list_for_each(timer, &idle->idle_timers, link) {
 		if (seat != NULL && timer->seat != seat) {
 			continue;
 		}
-		int timeout = enabled ? timer->timeout : 0;
-		wl_event_source_timer_update(timer->idle_source, timeout);
+		timer->last_activity = now;
+		idle_timeout_arm(timer, enabled ? timer->timeout : 0);
 		timer->enabled = enabled;
 	}
 }
@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_input_latency.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+static uint64_t get_current_time_usec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void histogram_add(struct wlr_input_latency_histogram *histogram,
+		uint64_t latency) {
+	size_t i = 0;
+	while (i + 1 < WLR_INPUT_LATENCY_BUCKETS && latency >= (2ull << i)) {
+		++i;
+	}
+	histogram->buckets[i]++;
+
+	if (histogram->count == 0 || latency < histogram->min) {
+		histogram->min = latency;
+	}
+	if (latency > histogram->max) {
+		histogram->max = latency;
+	}
+	histogram->sum += latency;
+	histogram->count++;
+}
+
+void wlr_input_latency_histogram_reset(
+		struct wlr_input_latency_histogram *histogram) {
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+uint64_t wlr_input_latency_histogram_percentile(
+		const struct wlr_input_latency_histogram *histogram,
+		double percentile) {
+	if (histogram->count == 0) {
+		return 0;
+	}
+
+	uint64_t target = percentile * histogram->count;
+	uint64_t count = 0;
+	for (size_t i = 0; i < WLR_INPUT_LATENCY_BUCKETS; ++i) {
+		count += histogram->buckets[i];
+		if (count > target) {
+			uint64_t bound = (2ull << i) - 1;
+			return bound < histogram->max ? bound : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+static void sample_destroy(struct wlr_input_latency_sample *sample) {
+	wl_list_remove(&sample->surface_commit.link);
+	wl_list_remove(&sample->surface_destroy.link);
+	wl_list_remove(&sample->link);
+	free(sample);
+}
+
+static void sample_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_latency_sample *sample =
+		wl_container_of(listener, sample, surface_commit);
+	sample->state = WLR_INPUT_LATENCY_SAMPLE_COMMITTED;
+	sample->commit_usec = get_current_time_usec();
+
+	// Only the first commit after the input event is measured
+	wl_list_remove(&sample->surface_commit.link);
+	wl_list_init(&sample->surface_commit.link);
+	wl_list_remove(&sample->surface_destroy.link);
+	wl_list_init(&sample->surface_destroy.link);
+	sample->surface = NULL;
+}
+
+static void sample_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_latency_sample *sample =
+		wl_container_of(listener, sample, surface_destroy);
+	sample_destroy(sample);
+}
+
+static void latency_output_destroy(struct wlr_input_latency_output *output) {
+	struct wlr_input_latency_sample *sample, *tmp;
+	wl_list_for_each_safe(sample, tmp, &output->tracker->samples, link) {
+		if (sample->output == output) {
+			sample_destroy(sample);
+		}
+	}
+
+	wl_list_remove(&output->output_swap_buffers.link);
+	wl_list_remove(&output->output_present.link);
+	wl_list_remove(&output->output_destroy.link);
+	wl_list_remove(&output->link);
+	free(output);
+}
+
+static void latency_output_handle_swap_buffers(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_latency_output *output =
+		wl_container_of(listener, output, output_swap_buffers);
+
+	// Commits made before this buffer swap are in the new frame
+	struct wlr_input_latency_sample *sample;
+	wl_list_for_each(sample, &output->tracker->samples, link) {
+		if (sample->output == output &&
+				sample->state == WLR_INPUT_LATENCY_SAMPLE_COMMITTED) {
+			sample->state = WLR_INPUT_LATENCY_SAMPLE_RENDERED;
+		}
+	}
+}
+
+static void latency_output_handle_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_latency_output *output =
+		wl_container_of(listener, output, output_present);
+	struct wlr_output_event_present *event = data;
+
+	uint64_t present_usec;
+	if (event->when != NULL) {
+		present_usec = (uint64_t)event->when->tv_sec * 1000000 +
+			event->when->tv_nsec / 1000;
+	} else {
+		present_usec = get_current_time_usec();
+	}
+
+	struct wlr_input_latency_sample *sample, *tmp;
+	wl_list_for_each_safe(sample, tmp, &output->tracker->samples, link) {
+		if (sample->output != output ||
+				sample->state != WLR_INPUT_LATENCY_SAMPLE_RENDERED) {
+			continue;
+		}
+		if (present_usec >= sample->input_usec) {
+			histogram_add(&output->histogram,
+				present_usec - sample->input_usec);
+		}
+		sample_destroy(sample);
+	}
+}
+
+static void latency_output_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_latency_output *output =
+		wl_container_of(listener, output, output_destroy);
+	latency_output_destroy(output);
+}
+
+struct wlr_input_latency_output *wlr_input_latency_tracker_get_output(
+		struct wlr_input_latency_tracker *tracker, struct wlr_output *output) {
+	struct wlr_input_latency_output *latency_output;
+	wl_list_for_each(latency_output, &tracker->outputs, link) {
+		if (latency_output->output == output) {
+			return latency_output;
+		}
+	}
+	return NULL;
+}
+
+struct wlr_input_latency_output *wlr_input_latency_tracker_add_output(
+		struct wlr_input_latency_tracker *tracker, struct wlr_output *output) {
+	struct wlr_input_latency_output *latency_output =
+		wlr_input_latency_tracker_get_output(tracker, output);
+	if (latency_output != NULL) {
+		return latency_output;
+	}
+
+	latency_output = calloc(1, sizeof(struct wlr_input_latency_output));
+	if (latency_output == NULL) {
+		return NULL;
+	}
+	latency_output->tracker = tracker;
+	latency_output->output = output;
+
+	wl_signal_add(&output->events.swap_buffers,
+		&latency_output->output_swap_buffers);
+	latency_output->output_swap_buffers.notify =
+		latency_output_handle_swap_buffers;
+	wl_signal_add(&output->events.present, &latency_output->output_present);
+	latency_output->output_present.notify = latency_output_handle_present;
+	wl_signal_add(&output->events.destroy, &latency_output->output_destroy);
+	latency_output->output_destroy.notify =
+		latency_output_handle_output_destroy;
+
+	wl_list_insert(&tracker->outputs, &latency_output->link);
+	return latency_output;
+}
+
+void wlr_input_latency_tracker_notify_input(
+		struct wlr_input_latency_tracker *tracker, struct wlr_surface *surface,
+		struct wlr_output *output, uint64_t time_usec) {
+	struct wlr_input_latency_output *latency_output =
+		wlr_input_latency_tracker_get_output(tracker, output);
+	if (latency_output == NULL || surface == NULL) {
+		return;
+	}
+
+	struct wlr_input_latency_sample *sample;
+	wl_list_for_each(sample, &tracker->samples, link) {
+		if (sample->surface == surface) {
+			// Keep the oldest input event the surface hasn't reacted to
+			return;
+		}
+	}
+
+	sample = calloc(1, sizeof(struct wlr_input_latency_sample));
+	if (sample == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	sample->output = latency_output;
+	sample->surface = surface;
+	sample->state = WLR_INPUT_LATENCY_SAMPLE_DELIVERED;
+	sample->input_usec = time_usec;
+
+	wl_signal_add(&surface->events.commit, &sample->surface_commit);
+	sample->surface_commit.notify = sample_handle_surface_commit;
+	wl_signal_add(&surface->events.destroy, &sample->surface_destroy);
+	sample->surface_destroy.notify = sample_handle_surface_destroy;
+
+	wl_list_insert(&tracker->samples, &sample->link);
+}
+
+struct wlr_input_latency_tracker *wlr_input_latency_tracker_create(void) {
+	struct wlr_input_latency_tracker *tracker =
+		calloc(1, sizeof(struct wlr_input_latency_tracker));
+	if (tracker == NULL) {
+		return NULL;
+	}
+	wl_list_init(&tracker->outputs);
+	wl_list_init(&tracker->samples);
+	wl_signal_init(&tracker->events.destroy);
+	return tracker;
+}
+
+void wlr_input_latency_tracker_destroy(
+		struct wlr_input_latency_tracker *tracker) {
+	if (tracker == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&tracker->events.destroy, tracker);
+
+	struct wlr_input_latency_output *output, *tmp;
+	wl_list_for_each_safe(output, tmp, &tracker->outputs, link) {
+		latency_output_destroy(output);
+	}
+	assert(wl_list_empty(&tracker->samples));
+	free(tracker);
+}
@@ -50,6 +50,8 @@ static void im_commit(struct wl_client *client, struct wl_resource *resource,
 	if (!input_method) {
 		return;
 	}
+	free(input_method->current.commit_text);
+	free(input_method->current.preedit.text);
 	input_method->current = input_method->pending;
 	input_method->current_serial = serial;
 	struct wlr_input_method_v2_state default_state = {0};
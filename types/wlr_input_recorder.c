@@ -0,0 +1,791 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_input_device.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/types/wlr_input_recorder.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_tablet_tool.h>
+#include <wlr/types/wlr_touch.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+#define RECORDING_HEADER "# wlroots input recording\n"
+
+enum tool_capability {
+	TOOL_TILT = 1,
+	TOOL_PRESSURE = 2,
+	TOOL_DISTANCE = 4,
+	TOOL_ROTATION = 8,
+	TOOL_SLIDER = 16,
+	TOOL_WHEEL = 32,
+};
+
+static const char *device_type_names[] = {
+	[WLR_INPUT_DEVICE_KEYBOARD] = "keyboard",
+	[WLR_INPUT_DEVICE_POINTER] = "pointer",
+	[WLR_INPUT_DEVICE_TOUCH] = "touch",
+	[WLR_INPUT_DEVICE_TABLET_TOOL] = "tablet_tool",
+	[WLR_INPUT_DEVICE_TABLET_PAD] = NULL,
+	[WLR_INPUT_DEVICE_SWITCH] = NULL,
+};
+
+static uint64_t get_current_time_usec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Starts a line of the recording. Events are stamped when they are received
+ * rather than with their own timestamps, which backends take from different
+ * clocks.
+ */
+static FILE *begin_event(struct wlr_input_recorder_device *rec_dev,
+		const char *name) {
+	struct wlr_input_recorder *recorder = rec_dev->recorder;
+	uint64_t time_usec = get_current_time_usec();
+	uint64_t usec = time_usec > recorder->start_usec ?
+		time_usec - recorder->start_usec : 0;
+	fprintf(recorder->file, "%" PRIu64 " %d %s", usec, rec_dev->id, name);
+	return recorder->file;
+}
+
+static void print_tool(FILE *f, struct wlr_tablet_tool *tool) {
+	uint32_t caps = (tool->tilt ? TOOL_TILT : 0) |
+		(tool->pressure ? TOOL_PRESSURE : 0) |
+		(tool->distance ? TOOL_DISTANCE : 0) |
+		(tool->rotation ? TOOL_ROTATION : 0) |
+		(tool->slider ? TOOL_SLIDER : 0) |
+		(tool->wheel ? TOOL_WHEEL : 0);
+	fprintf(f, " %d %" PRIu64 " %" PRIu32, tool->type, tool->hardware_serial,
+		caps);
+}
+
+static void recorder_device_destroy(
+		struct wlr_input_recorder_device *rec_dev) {
+	wl_list_remove(&rec_dev->motion.link);
+	wl_list_remove(&rec_dev->motion_absolute.link);
+	wl_list_remove(&rec_dev->button.link);
+	wl_list_remove(&rec_dev->axis.link);
+	wl_list_remove(&rec_dev->frame.link);
+	wl_list_remove(&rec_dev->key.link);
+	wl_list_remove(&rec_dev->touch_down.link);
+	wl_list_remove(&rec_dev->touch_up.link);
+	wl_list_remove(&rec_dev->touch_motion.link);
+	wl_list_remove(&rec_dev->touch_cancel.link);
+	wl_list_remove(&rec_dev->touch_frame.link);
+	wl_list_remove(&rec_dev->tool_axis.link);
+	wl_list_remove(&rec_dev->tool_proximity.link);
+	wl_list_remove(&rec_dev->tool_tip.link);
+	wl_list_remove(&rec_dev->tool_button.link);
+	wl_list_remove(&rec_dev->destroy.link);
+	wl_list_remove(&rec_dev->link);
+	free(rec_dev);
+}
+
+static void handle_motion(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, motion);
+	struct wlr_event_pointer_motion *event = data;
+	FILE *f = begin_event(rec_dev, "motion");
+	fprintf(f, " %.17g %.17g %.17g %.17g\n", event->delta_x, event->delta_y,
+		event->unaccel_dx, event->unaccel_dy);
+}
+
+static void handle_motion_absolute(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, motion_absolute);
+	struct wlr_event_pointer_motion_absolute *event = data;
+	FILE *f = begin_event(rec_dev, "motion_absolute");
+	fprintf(f, " %.17g %.17g\n", event->x, event->y);
+}
+
+static void handle_button(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, button);
+	struct wlr_event_pointer_button *event = data;
+	FILE *f = begin_event(rec_dev, "button");
+	fprintf(f, " %" PRIu32 " %d\n", event->button, event->state);
+}
+
+static void handle_axis(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, axis);
+	struct wlr_event_pointer_axis *event = data;
+	FILE *f = begin_event(rec_dev, "axis");
+	fprintf(f, " %d %d %.17g %" PRId32 "\n", event->source,
+		event->orientation, event->delta, event->delta_discrete);
+}
+
+static void handle_frame(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, frame);
+	FILE *f = begin_event(rec_dev, "frame");
+	fputc('\n', f);
+}
+
+static void handle_key(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, key);
+	struct wlr_event_keyboard_key *event = data;
+	FILE *f = begin_event(rec_dev, "key");
+	fprintf(f, " %" PRIu32 " %d\n", event->keycode, event->state);
+}
+
+static void handle_touch_down(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, touch_down);
+	struct wlr_event_touch_down *event = data;
+	FILE *f = begin_event(rec_dev, "touch_down");
+	fprintf(f, " %" PRId32 " %.17g %.17g\n", event->touch_id,
+		event->x, event->y);
+}
+
+static void handle_touch_up(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, touch_up);
+	struct wlr_event_touch_up *event = data;
+	FILE *f = begin_event(rec_dev, "touch_up");
+	fprintf(f, " %" PRId32 "\n", event->touch_id);
+}
+
+static void handle_touch_motion(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, touch_motion);
+	struct wlr_event_touch_motion *event = data;
+	FILE *f = begin_event(rec_dev, "touch_motion");
+	fprintf(f, " %" PRId32 " %.17g %.17g\n", event->touch_id,
+		event->x, event->y);
+}
+
+static void handle_touch_cancel(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, touch_cancel);
+	struct wlr_event_touch_cancel *event = data;
+	FILE *f = begin_event(rec_dev, "touch_cancel");
+	fprintf(f, " %" PRId32 "\n", event->touch_id);
+}
+
+static void handle_touch_frame(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, touch_frame);
+	FILE *f = begin_event(rec_dev, "touch_frame");
+	fputc('\n', f);
+}
+
+static void handle_tool_axis(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, tool_axis);
+	struct wlr_event_tablet_tool_axis *event = data;
+	FILE *f = begin_event(rec_dev, "tool_axis");
+	print_tool(f, event->tool);
+	fprintf(f, " %" PRIu32 " %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g "
+		"%.17g %.17g %.17g\n", event->updated_axes, event->x, event->y,
+		event->dx, event->dy, event->pressure, event->distance,
+		event->tilt_x, event->tilt_y, event->rotation, event->slider,
+		event->wheel_delta);
+}
+
+static void handle_tool_proximity(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, tool_proximity);
+	struct wlr_event_tablet_tool_proximity *event = data;
+	FILE *f = begin_event(rec_dev, "tool_proximity");
+	print_tool(f, event->tool);
+	fprintf(f, " %.17g %.17g %d\n", event->x, event->y, event->state);
+}
+
+static void handle_tool_tip(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, tool_tip);
+	struct wlr_event_tablet_tool_tip *event = data;
+	FILE *f = begin_event(rec_dev, "tool_tip");
+	print_tool(f, event->tool);
+	fprintf(f, " %.17g %.17g %d\n", event->x, event->y, event->state);
+}
+
+static void handle_tool_button(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, tool_button);
+	struct wlr_event_tablet_tool_button *event = data;
+	FILE *f = begin_event(rec_dev, "tool_button");
+	print_tool(f, event->tool);
+	fprintf(f, " %" PRIu32 " %d\n", event->button, event->state);
+}
+
+static void handle_device_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_input_recorder_device *rec_dev =
+		wl_container_of(listener, rec_dev, destroy);
+	FILE *f = begin_event(rec_dev, "remove");
+	fputc('\n', f);
+	recorder_device_destroy(rec_dev);
+}
+
+struct wlr_input_recorder *wlr_input_recorder_create(FILE *file) {
+	struct wlr_input_recorder *recorder =
+		calloc(1, sizeof(struct wlr_input_recorder));
+	if (recorder == NULL) {
+		return NULL;
+	}
+	recorder->file = file;
+	recorder->start_usec = get_current_time_usec();
+	wl_list_init(&recorder->devices);
+	wl_signal_init(&recorder->events.destroy);
+	fputs(RECORDING_HEADER, file);
+	return recorder;
+}
+
+void wlr_input_recorder_destroy(struct wlr_input_recorder *recorder) {
+	if (recorder == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&recorder->events.destroy, recorder);
+	struct wlr_input_recorder_device *rec_dev, *tmp;
+	wl_list_for_each_safe(rec_dev, tmp, &recorder->devices, link) {
+		recorder_device_destroy(rec_dev);
+	}
+	fflush(recorder->file);
+	free(recorder);
+}
+
+bool wlr_input_recorder_add_device(struct wlr_input_recorder *recorder,
+		struct wlr_input_device *device) {
+	if (device_type_names[device->type] == NULL) {
+		return false;
+	}
+
+	struct wlr_input_recorder_device *rec_dev =
+		calloc(1, sizeof(struct wlr_input_recorder_device));
+	if (rec_dev == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	rec_dev->recorder = recorder;
+	rec_dev->device = device;
+	rec_dev->id = recorder->next_device_id++;
+	wl_list_insert(&recorder->devices, &rec_dev->link);
+
+	wl_list_init(&rec_dev->motion.link);
+	wl_list_init(&rec_dev->motion_absolute.link);
+	wl_list_init(&rec_dev->button.link);
+	wl_list_init(&rec_dev->axis.link);
+	wl_list_init(&rec_dev->frame.link);
+	wl_list_init(&rec_dev->key.link);
+	wl_list_init(&rec_dev->touch_down.link);
+	wl_list_init(&rec_dev->touch_up.link);
+	wl_list_init(&rec_dev->touch_motion.link);
+	wl_list_init(&rec_dev->touch_cancel.link);
+	wl_list_init(&rec_dev->touch_frame.link);
+	wl_list_init(&rec_dev->tool_axis.link);
+	wl_list_init(&rec_dev->tool_proximity.link);
+	wl_list_init(&rec_dev->tool_tip.link);
+	wl_list_init(&rec_dev->tool_button.link);
+
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_POINTER:
+		rec_dev->motion.notify = handle_motion;
+		wl_signal_add(&device->pointer->events.motion, &rec_dev->motion);
+		rec_dev->motion_absolute.notify = handle_motion_absolute;
+		wl_signal_add(&device->pointer->events.motion_absolute,
+			&rec_dev->motion_absolute);
+		rec_dev->button.notify = handle_button;
+		wl_signal_add(&device->pointer->events.button, &rec_dev->button);
+		rec_dev->axis.notify = handle_axis;
+		wl_signal_add(&device->pointer->events.axis, &rec_dev->axis);
+		rec_dev->frame.notify = handle_frame;
+		wl_signal_add(&device->pointer->events.frame, &rec_dev->frame);
+		break;
+	case WLR_INPUT_DEVICE_KEYBOARD:
+		rec_dev->key.notify = handle_key;
+		wl_signal_add(&device->keyboard->events.key, &rec_dev->key);
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:
+		rec_dev->touch_down.notify = handle_touch_down;
+		wl_signal_add(&device->touch->events.down, &rec_dev->touch_down);
+		rec_dev->touch_up.notify = handle_touch_up;
+		wl_signal_add(&device->touch->events.up, &rec_dev->touch_up);
+		rec_dev->touch_motion.notify = handle_touch_motion;
+		wl_signal_add(&device->touch->events.motion, &rec_dev->touch_motion);
+		rec_dev->touch_cancel.notify = handle_touch_cancel;
+		wl_signal_add(&device->touch->events.cancel, &rec_dev->touch_cancel);
+		rec_dev->touch_frame.notify = handle_touch_frame;
+		wl_signal_add(&device->touch->events.frame, &rec_dev->touch_frame);
+		break;
+	case WLR_INPUT_DEVICE_TABLET_TOOL:
+		rec_dev->tool_axis.notify = handle_tool_axis;
+		wl_signal_add(&device->tablet->events.axis, &rec_dev->tool_axis);
+		rec_dev->tool_proximity.notify = handle_tool_proximity;
+		wl_signal_add(&device->tablet->events.proximity,
+			&rec_dev->tool_proximity);
+		rec_dev->tool_tip.notify = handle_tool_tip;
+		wl_signal_add(&device->tablet->events.tip, &rec_dev->tool_tip);
+		rec_dev->tool_button.notify = handle_tool_button;
+		wl_signal_add(&device->tablet->events.button, &rec_dev->tool_button);
+		break;
+	case WLR_INPUT_DEVICE_TABLET_PAD:
+	case WLR_INPUT_DEVICE_SWITCH:
+		assert(false);
+	}
+	rec_dev->destroy.notify = handle_device_destroy;
+	wl_signal_add(&device->events.destroy, &rec_dev->destroy);
+
+	FILE *f = begin_event(rec_dev, "device");
+	fprintf(f, " %s %s\n", device_type_names[device->type], device->name);
+	return true;
+}
+
+static void replay_device_destroy_tools(
+		struct wlr_input_replay_device *replay_dev) {
+	struct wlr_input_replay_tool *tool, *tmp;
+	wl_list_for_each_safe(tool, tmp, &replay_dev->tools, link) {
+		wlr_signal_emit_safe(&tool->tool.events.destroy, &tool->tool);
+		wl_list_remove(&tool->link);
+		free(tool);
+	}
+}
+
+static void replay_device_handle_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_replay_device *replay_dev =
+		wl_container_of(listener, replay_dev, destroy);
+	replay_device_destroy_tools(replay_dev);
+	wl_list_remove(&replay_dev->destroy.link);
+	wl_list_remove(&replay_dev->link);
+	free(replay_dev);
+}
+
+static struct wlr_input_replay_device *replay_get_device(
+		struct wlr_input_replay *replay, int id) {
+	struct wlr_input_replay_device *replay_dev;
+	wl_list_for_each(replay_dev, &replay->devices, link) {
+		if (replay_dev->id == id) {
+			return replay_dev;
+		}
+	}
+	return NULL;
+}
+
+static bool replay_add_device(struct wlr_input_replay *replay, int id,
+		const char *args) {
+	char type_name[32];
+	if (sscanf(args, "%31s", type_name) != 1) {
+		return false;
+	}
+	enum wlr_input_device_type type;
+	size_t n_types = sizeof(device_type_names) / sizeof(device_type_names[0]);
+	for (type = 0; type < n_types; ++type) {
+		if (device_type_names[type] != NULL &&
+				strcmp(device_type_names[type], type_name) == 0) {
+			break;
+		}
+	}
+	if (type == n_types || replay_get_device(replay, id) != NULL) {
+		return false;
+	}
+
+	struct wlr_input_replay_device *replay_dev =
+		calloc(1, sizeof(struct wlr_input_replay_device));
+	if (replay_dev == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	replay_dev->replay = replay;
+	replay_dev->id = id;
+	wl_list_init(&replay_dev->tools);
+
+	replay_dev->device = wlr_headless_add_input_device(replay->backend, type);
+	if (replay_dev->device == NULL) {
+		free(replay_dev);
+		return false;
+	}
+	wl_list_insert(&replay->devices, &replay_dev->link);
+	replay_dev->destroy.notify = replay_device_handle_destroy;
+	wl_signal_add(&replay_dev->device->events.destroy, &replay_dev->destroy);
+	return true;
+}
+
+static struct wlr_tablet_tool *replay_get_tool(
+		struct wlr_input_replay_device *replay_dev, const char **args) {
+	int type, n;
+	uint64_t serial;
+	uint32_t caps;
+	if (sscanf(*args, "%d %" SCNu64 " %" SCNu32 "%n", &type, &serial, &caps,
+			&n) != 3 || type < WLR_TABLET_TOOL_TYPE_PEN ||
+			type > WLR_TABLET_TOOL_TYPE_LENS) {
+		return NULL;
+	}
+	*args += n;
+
+	struct wlr_input_replay_tool *tool;
+	wl_list_for_each(tool, &replay_dev->tools, link) {
+		if ((int)tool->tool.type == type &&
+				tool->tool.hardware_serial == serial) {
+			return &tool->tool;
+		}
+	}
+
+	tool = calloc(1, sizeof(struct wlr_input_replay_tool));
+	if (tool == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	tool->tool.type = type;
+	tool->tool.hardware_serial = serial;
+	tool->tool.tilt = caps & TOOL_TILT;
+	tool->tool.pressure = caps & TOOL_PRESSURE;
+	tool->tool.distance = caps & TOOL_DISTANCE;
+	tool->tool.rotation = caps & TOOL_ROTATION;
+	tool->tool.slider = caps & TOOL_SLIDER;
+	tool->tool.wheel = caps & TOOL_WHEEL;
+	wl_signal_init(&tool->tool.events.destroy);
+	wl_list_insert(&replay_dev->tools, &tool->link);
+	return &tool->tool;
+}
+
+static bool replay_tablet_event(struct wlr_input_replay_device *replay_dev,
+		const char *name, const char *args, uint64_t now) {
+	struct wlr_input_device *device = replay_dev->device;
+	struct wlr_tablet *tablet = device->tablet;
+	struct wlr_tablet_tool *tool = replay_get_tool(replay_dev, &args);
+	if (tool == NULL) {
+		return false;
+	}
+	uint32_t time_msec = now / 1000;
+
+	if (strcmp(name, "tool_axis") == 0) {
+		struct wlr_event_tablet_tool_axis event = {
+			.device = device,
+			.tool = tool,
+			.time_msec = time_msec,
+			.time_usec = now,
+		};
+		if (sscanf(args, "%" SCNu32 " %lf %lf %lf %lf %lf %lf %lf %lf %lf "
+				"%lf %lf", &event.updated_axes, &event.x, &event.y,
+				&event.dx, &event.dy, &event.pressure, &event.distance,
+				&event.tilt_x, &event.tilt_y, &event.rotation,
+				&event.slider, &event.wheel_delta) != 12) {
+			return false;
+		}
+		wlr_signal_emit_safe(&tablet->events.axis, &event);
+	} else if (strcmp(name, "tool_proximity") == 0) {
+		struct wlr_event_tablet_tool_proximity event = {
+			.device = device,
+			.tool = tool,
+			.time_msec = time_msec,
+			.time_usec = now,
+		};
+		int state;
+		if (sscanf(args, "%lf %lf %d", &event.x, &event.y, &state) != 3) {
+			return false;
+		}
+		event.state = state;
+		wlr_signal_emit_safe(&tablet->events.proximity, &event);
+	} else if (strcmp(name, "tool_tip") == 0) {
+		struct wlr_event_tablet_tool_tip event = {
+			.device = device,
+			.tool = tool,
+			.time_msec = time_msec,
+			.time_usec = now,
+		};
+		int state;
+		if (sscanf(args, "%lf %lf %d", &event.x, &event.y, &state) != 3) {
+			return false;
+		}
+		event.state = state;
+		wlr_signal_emit_safe(&tablet->events.tip, &event);
+	} else if (strcmp(name, "tool_button") == 0) {
+		struct wlr_event_tablet_tool_button event = {
+			.device = device,
+			.tool = tool,
+			.time_msec = time_msec,
+			.time_usec = now,
+		};
+		int state;
+		if (sscanf(args, "%" SCNu32 " %d", &event.button, &state) != 2) {
+			return false;
+		}
+		event.state = state;
+		wlr_signal_emit_safe(&tablet->events.button, &event);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool replay_event(struct wlr_input_replay_device *replay_dev,
+		const char *name, const char *args, uint64_t now) {
+	struct wlr_input_device *device = replay_dev->device;
+	uint32_t time_msec = now / 1000;
+
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_POINTER:;
+		struct wlr_pointer *pointer = device->pointer;
+		if (strcmp(name, "motion") == 0) {
+			struct wlr_event_pointer_motion event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%lf %lf %lf %lf", &event.delta_x,
+					&event.delta_y, &event.unaccel_dx,
+					&event.unaccel_dy) != 4) {
+				return false;
+			}
+			wlr_signal_emit_safe(&pointer->events.motion, &event);
+		} else if (strcmp(name, "motion_absolute") == 0) {
+			struct wlr_event_pointer_motion_absolute event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%lf %lf", &event.x, &event.y) != 2) {
+				return false;
+			}
+			wlr_signal_emit_safe(&pointer->events.motion_absolute, &event);
+		} else if (strcmp(name, "button") == 0) {
+			struct wlr_event_pointer_button event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			int state;
+			if (sscanf(args, "%" SCNu32 " %d", &event.button,
+					&state) != 2) {
+				return false;
+			}
+			event.state = state;
+			wlr_signal_emit_safe(&pointer->events.button, &event);
+		} else if (strcmp(name, "axis") == 0) {
+			struct wlr_event_pointer_axis event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			int source, orientation;
+			if (sscanf(args, "%d %d %lf %" SCNd32, &source, &orientation,
+					&event.delta, &event.delta_discrete) != 4) {
+				return false;
+			}
+			event.source = source;
+			event.orientation = orientation;
+			wlr_signal_emit_safe(&pointer->events.axis, &event);
+		} else if (strcmp(name, "frame") == 0) {
+			wlr_signal_emit_safe(&pointer->events.frame, pointer);
+		} else {
+			return false;
+		}
+		return true;
+	case WLR_INPUT_DEVICE_KEYBOARD:;
+		struct wlr_event_keyboard_key key = {
+			.time_msec = time_msec,
+			.time_usec = now,
+			.update_state = true,
+		};
+		int state;
+		if (strcmp(name, "key") != 0 ||
+				sscanf(args, "%" SCNu32 " %d", &key.keycode, &state) != 2) {
+			return false;
+		}
+		key.state = state;
+		wlr_keyboard_notify_key(device->keyboard, &key);
+		return true;
+	case WLR_INPUT_DEVICE_TOUCH:;
+		struct wlr_touch *touch = device->touch;
+		if (strcmp(name, "touch_down") == 0) {
+			struct wlr_event_touch_down event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%" SCNd32 " %lf %lf", &event.touch_id,
+					&event.x, &event.y) != 3) {
+				return false;
+			}
+			wlr_signal_emit_safe(&touch->events.down, &event);
+		} else if (strcmp(name, "touch_up") == 0) {
+			struct wlr_event_touch_up event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%" SCNd32, &event.touch_id) != 1) {
+				return false;
+			}
+			wlr_signal_emit_safe(&touch->events.up, &event);
+		} else if (strcmp(name, "touch_motion") == 0) {
+			struct wlr_event_touch_motion event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%" SCNd32 " %lf %lf", &event.touch_id,
+					&event.x, &event.y) != 3) {
+				return false;
+			}
+			wlr_signal_emit_safe(&touch->events.motion, &event);
+		} else if (strcmp(name, "touch_cancel") == 0) {
+			struct wlr_event_touch_cancel event = {
+				.device = device,
+				.time_msec = time_msec,
+				.time_usec = now,
+			};
+			if (sscanf(args, "%" SCNd32, &event.touch_id) != 1) {
+				return false;
+			}
+			wlr_signal_emit_safe(&touch->events.cancel, &event);
+		} else if (strcmp(name, "touch_frame") == 0) {
+			wlr_signal_emit_safe(&touch->events.frame, touch);
+		} else {
+			return false;
+		}
+		return true;
+	case WLR_INPUT_DEVICE_TABLET_TOOL:
+		return replay_tablet_event(replay_dev, name, args, now);
+	case WLR_INPUT_DEVICE_TABLET_PAD:
+	case WLR_INPUT_DEVICE_SWITCH:
+		break;
+	}
+	return false;
+}
+
+static void replay_line(struct wlr_input_replay *replay, uint64_t now) {
+	int id, n;
+	char name[32];
+	if (sscanf(replay->line, "%*s %d %31s%n", &id, name, &n) != 2) {
+		goto error;
+	}
+	const char *args = replay->line + n;
+
+	if (strcmp(name, "device") == 0) {
+		if (!replay_add_device(replay, id, args)) {
+			goto error;
+		}
+		return;
+	}
+
+	struct wlr_input_replay_device *replay_dev = replay_get_device(replay, id);
+	if (replay_dev == NULL) {
+		goto error;
+	}
+	if (strcmp(name, "remove") == 0) {
+		replay_device_destroy_tools(replay_dev);
+		wlr_input_device_destroy(replay_dev->device);
+		return;
+	}
+	if (!replay_event(replay_dev, name, args, now)) {
+		goto error;
+	}
+	return;
+
+error:
+	wlr_log(WLR_ERROR, "Invalid input recording event on line %lu",
+		replay->line_number);
+}
+
+/**
+ * Reads the next event, sets the line to NULL at the end of the file.
+ */
+static void replay_read_line(struct wlr_input_replay *replay) {
+	while (getline(&replay->line, &replay->line_size, replay->file) >= 0) {
+		replay->line_number++;
+		if (replay->line[0] == '#' || replay->line[0] == '\n') {
+			continue;
+		}
+		if (sscanf(replay->line, "%" SCNu64, &replay->line_usec) != 1) {
+			wlr_log(WLR_ERROR, "Invalid input recording event on line %lu",
+				replay->line_number);
+			continue;
+		}
+		return;
+	}
+	free(replay->line);
+	replay->line = NULL;
+	replay->line_size = 0;
+}
+
+static int replay_handle_timer(void *data) {
+	struct wlr_input_replay *replay = data;
+	uint64_t now = get_current_time_usec();
+	while (replay->line != NULL) {
+		uint64_t due = replay->start_usec +
+			(uint64_t)(replay->line_usec / replay->speed);
+		if (due > now) {
+			wl_event_source_timer_update(replay->timer,
+				(due - now + 999) / 1000);
+			return 0;
+		}
+		replay_line(replay, now);
+		replay_read_line(replay);
+	}
+
+	wlr_log(WLR_DEBUG, "Input replay done");
+	wlr_signal_emit_safe(&replay->events.done, replay);
+	return 0;
+}
+
+static void replay_handle_backend_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_input_replay *replay =
+		wl_container_of(listener, replay, backend_destroy);
+	wlr_input_replay_destroy(replay);
+}
+
+struct wlr_input_replay *wlr_input_replay_create(struct wlr_backend *backend,
+		struct wl_event_loop *loop, FILE *file, double speed) {
+	if (!wlr_backend_is_headless(backend)) {
+		wlr_log(WLR_ERROR, "Input can only be replayed on a headless backend");
+		return NULL;
+	}
+	if (speed <= 0) {
+		wlr_log(WLR_ERROR, "Invalid input replay speed %f", speed);
+		return NULL;
+	}
+
+	struct wlr_input_replay *replay =
+		calloc(1, sizeof(struct wlr_input_replay));
+	if (replay == NULL) {
+		return NULL;
+	}
+	replay->timer = wl_event_loop_add_timer(loop, replay_handle_timer, replay);
+	if (replay->timer == NULL) {
+		free(replay);
+		return NULL;
+	}
+	replay->backend = backend;
+	replay->file = file;
+	replay->speed = speed;
+	wl_list_init(&replay->devices);
+	wl_signal_init(&replay->events.done);
+	wl_signal_init(&replay->events.destroy);
+
+	replay->backend_destroy.notify = replay_handle_backend_destroy;
+	wl_signal_add(&backend->events.destroy, &replay->backend_destroy);
+
+	replay->start_usec = get_current_time_usec();
+	replay_read_line(replay);
+	// Start from the event loop, so that the caller can add listeners
+	wl_event_source_timer_update(replay->timer, 1);
+	return replay;
+}
+
+void wlr_input_replay_destroy(struct wlr_input_replay *replay) {
+	if (replay == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&replay->events.destroy, replay);
+	struct wlr_input_replay_device *replay_dev, *tmp;
+	wl_list_for_each_safe(replay_dev, tmp, &replay->devices, link) {
+		replay_device_destroy_tools(replay_dev);
+		wlr_input_device_destroy(replay_dev->device);
+	}
+	wl_event_source_remove(replay->timer);
+	wl_list_remove(&replay->backend_destroy.link);
+	free(replay->line);
+	free(replay);
+}
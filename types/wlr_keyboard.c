@@ -1,11 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
 #include "util/array.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <wayland-server.h>
 #include <wlr/interfaces/wlr_keyboard.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/util/log.h>
+#include "util/shm.h"
 #include "util/signal.h"
 
 static void keyboard_led_update(struct wlr_keyboard *keyboard) {
@@ -115,9 +119,134 @@ void wlr_keyboard_notify_key(struct wlr_keyboard *keyboard,
 	}
 }
 
+/**
+ * Compiled keymaps are shared by all keyboards using them, along with their
+ * serialized string and keymap file. Keymaps compiled from names can be found
+ * again by their RMLVO names, so that identical keyboards don't recompile
+ * them.
+ */
+struct keyboard_keymap {
+	struct xkb_keymap *keymap;
+	char *string;
+	size_t size; // including the NUL byte
+	// Read-only file containing string, shared with all clients
+	int fd;
+	size_t refs;
+
+	bool has_names;
+	char *rules, *model, *layout, *variant, *options;
+
+	struct wl_list link; // keymaps
+};
+
+static struct wl_list keymaps = {
+	.prev = &keymaps,
+	.next = &keymaps,
+};
+
+// Used to compile keymaps from names, destroyed with the last keymap
+static struct xkb_context *keymap_context = NULL;
+
+/**
+ * Writes the keymap string into a file which can be sent to any number of
+ * clients. Clients only get a read-only file descriptor, so they can't alter
+ * the keymap seen by others.
+ */
+static int keymap_create_file(const char *string, size_t size) {
+	int rw_fd, ro_fd;
+	if (!allocate_shm_file_pair(size, &rw_fd, &ro_fd)) {
+		wlr_log(WLR_ERROR, "creating a keymap file for %zu bytes failed",
+			size);
+		return -1;
+	}
+
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
+	close(rw_fd);
+	if (ptr == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "failed to mmap() %zu bytes", size);
+		close(ro_fd);
+		return -1;
+	}
+
+	memcpy(ptr, string, size);
+	munmap(ptr, size);
+	return ro_fd;
+}
+
+static void keymap_destroy(struct keyboard_keymap *km) {
+	wl_list_remove(&km->link);
+	xkb_keymap_unref(km->keymap);
+	free(km->string);
+	close(km->fd);
+	free(km->rules);
+	free(km->model);
+	free(km->layout);
+	free(km->variant);
+	free(km->options);
+	free(km);
+
+	if (wl_list_empty(&keymaps)) {
+		xkb_context_unref(keymap_context);
+		keymap_context = NULL;
+	}
+}
+
+static struct keyboard_keymap *keymap_create(struct xkb_keymap *keymap) {
+	struct keyboard_keymap *km = calloc(1, sizeof(struct keyboard_keymap));
+	if (km == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	km->string = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (km->string == NULL) {
+		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
+		free(km);
+		return NULL;
+	}
+	km->size = strlen(km->string) + 1;
+
+	km->fd = keymap_create_file(km->string, km->size);
+	if (km->fd < 0) {
+		free(km->string);
+		free(km);
+		return NULL;
+	}
+
+	km->keymap = xkb_keymap_ref(keymap);
+	wl_list_insert(&keymaps, &km->link);
+	return km;
+}
+
+static struct keyboard_keymap *keymap_find(struct xkb_keymap *keymap) {
+	struct keyboard_keymap *km;
+	wl_list_for_each(km, &keymaps, link) {
+		if (km->keymap == keymap) {
+			return km;
+		}
+	}
+	return NULL;
+}
+
+static void keyboard_release_keymap(struct wlr_keyboard *kb) {
+	if (kb->keymap != NULL) {
+		struct keyboard_keymap *km = keymap_find(kb->keymap);
+		assert(km != NULL && km->refs > 0);
+		xkb_keymap_unref(kb->keymap);
+		kb->keymap = NULL;
+		if (--km->refs == 0) {
+			keymap_destroy(km);
+		}
+	}
+	kb->keymap_string = NULL;
+	kb->keymap_size = 0;
+	kb->keymap_fd = -1;
+}
+
 void wlr_keyboard_init(struct wlr_keyboard *kb,
 		const struct wlr_keyboard_impl *impl) {
 	kb->impl = impl;
+	kb->keymap_fd = -1;
 	wl_signal_init(&kb->events.key);
 	wl_signal_init(&kb->events.modifiers);
 	wl_signal_init(&kb->events.keymap);
@@ -133,8 +262,7 @@ void wlr_keyboard_destroy(struct wlr_keyboard *kb) {
 		return;
 	}
 	xkb_state_unref(kb->xkb_state);
-	xkb_keymap_unref(kb->keymap);
-	free(kb->keymap_string);
+	keyboard_release_keymap(kb);
 	if (kb->impl && kb->impl->destroy) {
 		kb->impl->destroy(kb);
 	} else {
@@ -151,8 +279,21 @@ void wlr_keyboard_led_update(struct wlr_keyboard *kb, uint32_t leds) {
 
 void wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 		struct xkb_keymap *keymap) {
-	xkb_keymap_unref(kb->keymap);
+	struct keyboard_keymap *km = keymap_find(keymap);
+	if (km == NULL) {
+		km = keymap_create(keymap);
+		if (km == NULL) {
+			goto err;
+		}
+	}
+	// Take the new reference first, the old keymap may be the same
+	km->refs++;
+	keyboard_release_keymap(kb);
+
 	kb->keymap = xkb_keymap_ref(keymap);
+	kb->keymap_string = km->string;
+	kb->keymap_size = km->size;
+	kb->keymap_fd = km->fd;
 
 	xkb_state_unref(kb->xkb_state);
 	kb->xkb_state = xkb_state_new(kb->keymap);
@@ -185,16 +326,6 @@ void wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 		kb->mod_indexes[i] = xkb_map_mod_get_index(kb->keymap, mod_names[i]);
 	}
 
-	char *tmp_keymap_string = xkb_keymap_get_as_string(kb->keymap,
-		XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (tmp_keymap_string == NULL) {
-		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
-		goto err;
-	}
-	free(kb->keymap_string);
-	kb->keymap_string = tmp_keymap_string;
-	kb->keymap_size = strlen(kb->keymap_string) + 1;
-
 	for (size_t i = 0; i < kb->num_keycodes; ++i) {
 		xkb_keycode_t keycode = kb->keycodes[i] + 8;
 		xkb_state_update_key(kb->xkb_state, keycode, XKB_KEY_DOWN);
@@ -208,10 +339,92 @@ void wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 err:
 	xkb_state_unref(kb->xkb_state);
 	kb->xkb_state = NULL;
-	xkb_keymap_unref(keymap);
-	kb->keymap = NULL;
-	free(kb->keymap_string);
-	kb->keymap_string = NULL;
+	keyboard_release_keymap(kb);
+}
+
+static bool name_equal(const char *a, const char *b) {
+	if (a == NULL || b == NULL) {
+		return a == b;
+	}
+	return strcmp(a, b) == 0;
+}
+
+static bool name_dup(char **dst, const char *src) {
+	if (src == NULL) {
+		*dst = NULL;
+		return true;
+	}
+	*dst = strdup(src);
+	return *dst != NULL;
+}
+
+static struct keyboard_keymap *keymap_create_from_names(
+		const struct xkb_rule_names *names) {
+	if (keymap_context == NULL) {
+		keymap_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		if (keymap_context == NULL) {
+			wlr_log(WLR_ERROR, "Cannot create XKB context");
+			return NULL;
+		}
+	}
+
+	struct xkb_keymap *keymap = xkb_keymap_new_from_names(keymap_context,
+		names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	struct keyboard_keymap *km = NULL;
+	if (keymap != NULL) {
+		km = keymap_create(keymap);
+		xkb_keymap_unref(keymap);
+	} else {
+		wlr_log(WLR_ERROR, "Cannot create XKB keymap");
+	}
+	if (km == NULL) {
+		if (wl_list_empty(&keymaps)) {
+			xkb_context_unref(keymap_context);
+			keymap_context = NULL;
+		}
+		return NULL;
+	}
+
+	km->has_names = true;
+	if (!name_dup(&km->rules, names->rules) ||
+			!name_dup(&km->model, names->model) ||
+			!name_dup(&km->layout, names->layout) ||
+			!name_dup(&km->variant, names->variant) ||
+			!name_dup(&km->options, names->options)) {
+		// Still usable, just not shared
+		km->has_names = false;
+	}
+	return km;
+}
+
+bool wlr_keyboard_set_keymap_from_names(struct wlr_keyboard *kb,
+		const struct xkb_rule_names *names) {
+	struct keyboard_keymap *km, *found = NULL;
+	wl_list_for_each(km, &keymaps, link) {
+		if (km->has_names && name_equal(km->rules, names->rules) &&
+				name_equal(km->model, names->model) &&
+				name_equal(km->layout, names->layout) &&
+				name_equal(km->variant, names->variant) &&
+				name_equal(km->options, names->options)) {
+			found = km;
+			break;
+		}
+	}
+
+	if (found == NULL) {
+		found = keymap_create_from_names(names);
+		if (found == NULL) {
+			return false;
+		}
+	}
+
+	// Keep the keymap alive if it's the keyboard's current one
+	found->refs++;
+	wlr_keyboard_set_keymap(kb, found->keymap);
+	if (--found->refs == 0) {
+		keymap_destroy(found);
+	}
+	return kb->keymap != NULL;
 }
 
 void wlr_keyboard_set_repeat_info(struct wlr_keyboard *kb, int32_t rate,
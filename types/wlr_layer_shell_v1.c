@@ -280,6 +280,28 @@ static void layer_surface_role_commit(struct wlr_surface *wlr_surface) {
 		return;
 	}
 
+	struct wlr_layer_surface_v1_state *current = &surface->current;
+	struct wlr_layer_surface_v1_state *pending = &surface->client_pending;
+	surface->current_changed = 0;
+	if (current->anchor != pending->anchor) {
+		surface->current_changed |= WLR_LAYER_SURFACE_V1_STATE_ANCHOR;
+	}
+	if (current->exclusive_zone != pending->exclusive_zone) {
+		surface->current_changed |= WLR_LAYER_SURFACE_V1_STATE_EXCLUSIVE_ZONE;
+	}
+	if (memcmp(&current->margin, &pending->margin,
+			sizeof(current->margin)) != 0) {
+		surface->current_changed |= WLR_LAYER_SURFACE_V1_STATE_MARGIN;
+	}
+	if (current->keyboard_interactive != pending->keyboard_interactive) {
+		surface->current_changed |=
+			WLR_LAYER_SURFACE_V1_STATE_KEYBOARD_INTERACTIVE;
+	}
+	if (current->desired_width != pending->desired_width ||
+			current->desired_height != pending->desired_height) {
+		surface->current_changed |= WLR_LAYER_SURFACE_V1_STATE_DESIRED_SIZE;
+	}
+
 	surface->current.anchor = surface->client_pending.anchor;
 	surface->current.exclusive_zone = surface->client_pending.exclusive_zone;
 	surface->current.margin = surface->client_pending.margin;
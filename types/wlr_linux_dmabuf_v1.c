@@ -2,15 +2,52 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-server.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include "linux-dmabuf-unstable-v1-protocol.h"
+#include "util/shm.h"
 #include "util/signal.h"
 
-#define LINUX_DMABUF_VERSION 3
+// Version 4 is only advertised if the renderer's DRM device is known
+#define LINUX_DMABUF_VERSION 4
+
+struct wlr_linux_dmabuf_v1_feedback_compiled_tranche {
+	dev_t target_device;
+	uint32_t flags; // enum zwp_linux_dmabuf_feedback_v1_tranche_flags
+	struct wl_array indices; // uint16_t, into the format table
+};
+
+struct wlr_linux_dmabuf_v1_feedback_compiled {
+	dev_t main_device;
+	int table_fd; // read-only
+	size_t table_size;
+	size_t tranches_len;
+	struct wlr_linux_dmabuf_v1_feedback_compiled_tranche tranches[];
+};
+
+// Format table entry layout, as defined by the protocol
+struct wlr_linux_dmabuf_v1_feedback_table_entry {
+	uint32_t format;
+	uint32_t pad; // unused
+	uint64_t modifier;
+};
+
+struct wlr_linux_dmabuf_v1_surface {
+	struct wlr_surface *surface;
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf;
+	struct wl_list link; // wlr_linux_dmabuf_v1::surfaces
+
+	struct wl_list feedback_resources; // wl_resource_get_link
+	// NULL if the default feedback is used
+	struct wlr_linux_dmabuf_v1_feedback_compiled *feedback;
+
+	struct wl_listener surface_destroy;
+};
 
 static void buffer_handle_destroy(struct wl_client *client,
 		struct wl_resource *resource) {
@@ -53,6 +90,7 @@ struct wlr_dmabuf_v1_buffer *wlr_dmabuf_v1_buffer_from_buffer_resource(
 }
 
 static void linux_dmabuf_buffer_destroy(struct wlr_dmabuf_v1_buffer *buffer) {
+	wlr_texture_destroy(buffer->texture);
 	wlr_dmabuf_attributes_finish(&buffer->attributes);
 	free(buffer);
 }
@@ -127,12 +165,22 @@ static bool check_import_dmabuf(struct wlr_dmabuf_v1_buffer *buffer) {
 		return false;
 	}
 
-	// We can import the image, good. No need to keep it since wlr_surface will
-	// import it again on commit.
-	wlr_texture_destroy(texture);
+	// We can import the image, good. Keep it for wlr_buffer_create, so that
+	// the first commit doesn't import it a second time.
+	buffer->texture = texture;
 	return true;
 }
 
+struct wlr_texture *wlr_dmabuf_v1_buffer_take_texture(
+		struct wlr_dmabuf_v1_buffer *buffer, struct wlr_renderer *renderer) {
+	if (buffer->renderer != renderer) {
+		return NULL;
+	}
+	struct wlr_texture *texture = buffer->texture;
+	buffer->texture = NULL;
+	return texture;
+}
+
 static void params_create_common(struct wl_client *client,
 		struct wl_resource *params_resource, uint32_t buffer_id, int32_t width,
 		int32_t height, uint32_t format, uint32_t flags) {
@@ -364,6 +412,343 @@ err:
 	wl_resource_post_no_memory(linux_dmabuf_resource);
 }
 
+static void feedback_compiled_destroy(
+		struct wlr_linux_dmabuf_v1_feedback_compiled *feedback) {
+	if (feedback == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < feedback->tranches_len; ++i) {
+		wl_array_release(&feedback->tranches[i].indices);
+	}
+	if (feedback->table_fd >= 0) {
+		close(feedback->table_fd);
+	}
+	free(feedback);
+}
+
+// Collects the format and modifier pairs the renderer can import
+static bool get_renderer_formats(struct wlr_renderer *renderer,
+		struct wl_array *pairs) {
+	int *formats = NULL;
+	int num_formats = wlr_renderer_get_dmabuf_formats(renderer, &formats);
+	if (num_formats < 0) {
+		return false;
+	}
+
+	for (int i = 0; i < num_formats; i++) {
+		uint64_t *modifiers = NULL;
+		int num_modifiers = wlr_renderer_get_dmabuf_modifiers(renderer,
+			formats[i], &modifiers);
+		if (num_modifiers < 0) {
+			free(formats);
+			return false;
+		}
+
+		// DRM_FORMAT_MOD_INVALID stands for an implicit modifier
+		int num_pairs = num_modifiers > 0 ? num_modifiers : 1;
+		struct wlr_dmabuf_format *pair =
+			wl_array_add(pairs, num_pairs * sizeof(*pair));
+		if (pair == NULL) {
+			free(modifiers);
+			free(formats);
+			return false;
+		}
+		for (int j = 0; j < num_pairs; j++) {
+			pair[j].format = formats[i];
+			pair[j].modifier = num_modifiers > 0 ?
+				modifiers[j] : DRM_FORMAT_MOD_INVALID;
+		}
+		free(modifiers);
+	}
+	free(formats);
+	return true;
+}
+
+static ssize_t find_format(const struct wl_array *pairs,
+		const struct wlr_dmabuf_format *format) {
+	const struct wlr_dmabuf_format *data = pairs->data;
+	size_t len = pairs->size / sizeof(*data);
+	for (size_t i = 0; i < len; ++i) {
+		if (data[i].format == format->format &&
+				data[i].modifier == format->modifier) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool feedback_write_table(
+		struct wlr_linux_dmabuf_v1_feedback_compiled *compiled,
+		const struct wl_array *table) {
+	const struct wlr_dmabuf_format *pairs = table->data;
+	size_t len = table->size / sizeof(*pairs);
+	size_t size = len *
+		sizeof(struct wlr_linux_dmabuf_v1_feedback_table_entry);
+
+	int rw_fd, ro_fd;
+	if (!allocate_shm_file_pair(size, &rw_fd, &ro_fd)) {
+		wlr_log(WLR_ERROR, "Failed to allocate shm file for format table");
+		return false;
+	}
+
+	struct wlr_linux_dmabuf_v1_feedback_table_entry *entries =
+		mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
+	close(rw_fd);
+	if (entries == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(ro_fd);
+		return false;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		entries[i] = (struct wlr_linux_dmabuf_v1_feedback_table_entry){
+			.format = pairs[i].format,
+			.modifier = pairs[i].modifier,
+		};
+	}
+	munmap(entries, size);
+
+	compiled->table_fd = ro_fd;
+	compiled->table_size = size;
+	return true;
+}
+
+/**
+ * Builds the format table and the per-tranche indices sent to clients.
+ */
+static struct wlr_linux_dmabuf_v1_feedback_compiled *feedback_compile(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
+		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
+	struct wl_array renderer_formats;
+	wl_array_init(&renderer_formats);
+	if (!get_renderer_formats(linux_dmabuf->renderer, &renderer_formats)) {
+		wl_array_release(&renderer_formats);
+		return NULL;
+	}
+
+	struct wlr_linux_dmabuf_v1_feedback_compiled *compiled =
+		calloc(1, sizeof(*compiled) +
+		feedback->tranches_len * sizeof(compiled->tranches[0]));
+	if (compiled == NULL) {
+		wl_array_release(&renderer_formats);
+		return NULL;
+	}
+	compiled->main_device = feedback->main_device;
+	compiled->table_fd = -1;
+	compiled->tranches_len = feedback->tranches_len;
+
+	// Each pair appears once in the table, tranches refer to it by index
+	struct wl_array table;
+	wl_array_init(&table);
+	for (size_t i = 0; i < feedback->tranches_len; ++i) {
+		const struct wlr_linux_dmabuf_feedback_v1_tranche *tranche =
+			&feedback->tranches[i];
+		struct wlr_linux_dmabuf_v1_feedback_compiled_tranche *out =
+			&compiled->tranches[i];
+		out->target_device = tranche->target_device;
+		if (tranche->flags & WLR_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_SCANOUT) {
+			out->flags |= ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT;
+		}
+		wl_array_init(&out->indices);
+
+		const struct wlr_dmabuf_format *formats = tranche->formats;
+		size_t formats_len = tranche->formats_len;
+		if (formats == NULL) {
+			formats = renderer_formats.data;
+			formats_len = renderer_formats.size / sizeof(*formats);
+		}
+
+		for (size_t j = 0; j < formats_len; ++j) {
+			if (find_format(&renderer_formats, &formats[j]) < 0) {
+				continue;
+			}
+
+			ssize_t idx = find_format(&table, &formats[j]);
+			if (idx < 0) {
+				if (table.size / sizeof(formats[j]) > UINT16_MAX) {
+					wlr_log(WLR_ERROR, "Too many formats in feedback");
+					goto error;
+				}
+				struct wlr_dmabuf_format *entry =
+					wl_array_add(&table, sizeof(*entry));
+				if (entry == NULL) {
+					goto error;
+				}
+				*entry = formats[j];
+				idx = table.size / sizeof(*entry) - 1;
+			}
+
+			uint16_t *index = wl_array_add(&out->indices, sizeof(*index));
+			if (index == NULL) {
+				goto error;
+			}
+			*index = idx;
+		}
+	}
+
+	if (table.size == 0) {
+		wlr_log(WLR_ERROR, "Feedback doesn't contain any supported format");
+		goto error;
+	}
+	if (!feedback_write_table(compiled, &table)) {
+		goto error;
+	}
+
+	wl_array_release(&table);
+	wl_array_release(&renderer_formats);
+	return compiled;
+
+error:
+	wl_array_release(&table);
+	wl_array_release(&renderer_formats);
+	feedback_compiled_destroy(compiled);
+	return NULL;
+}
+
+static void feedback_send(struct wl_resource *resource,
+		const struct wlr_linux_dmabuf_v1_feedback_compiled *feedback) {
+	zwp_linux_dmabuf_feedback_v1_send_format_table(resource,
+		feedback->table_fd, feedback->table_size);
+
+	struct wl_array device = {
+		.size = sizeof(feedback->main_device),
+		.data = (void *)&feedback->main_device,
+	};
+	zwp_linux_dmabuf_feedback_v1_send_main_device(resource, &device);
+
+	for (size_t i = 0; i < feedback->tranches_len; ++i) {
+		const struct wlr_linux_dmabuf_v1_feedback_compiled_tranche *tranche =
+			&feedback->tranches[i];
+		struct wl_array target_device = {
+			.size = sizeof(tranche->target_device),
+			.data = (void *)&tranche->target_device,
+		};
+		zwp_linux_dmabuf_feedback_v1_send_tranche_target_device(resource,
+			&target_device);
+		zwp_linux_dmabuf_feedback_v1_send_tranche_formats(resource,
+			(struct wl_array *)&tranche->indices);
+		zwp_linux_dmabuf_feedback_v1_send_tranche_flags(resource,
+			tranche->flags);
+		zwp_linux_dmabuf_feedback_v1_send_tranche_done(resource);
+	}
+
+	zwp_linux_dmabuf_feedback_v1_send_done(resource);
+}
+
+static void feedback_handle_destroy(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct zwp_linux_dmabuf_feedback_v1_interface feedback_impl = {
+	.destroy = feedback_handle_destroy,
+};
+
+static void feedback_handle_resource_destroy(struct wl_resource *resource) {
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static struct wl_resource *feedback_resource_create(struct wl_client *client,
+		struct wl_resource *linux_dmabuf_resource, uint32_t id) {
+	uint32_t version = wl_resource_get_version(linux_dmabuf_resource);
+	struct wl_resource *resource = wl_resource_create(client,
+		&zwp_linux_dmabuf_feedback_v1_interface, version, id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return NULL;
+	}
+	wl_resource_set_implementation(resource, &feedback_impl, NULL,
+		feedback_handle_resource_destroy);
+	wl_list_init(wl_resource_get_link(resource));
+	return resource;
+}
+
+static void surface_destroy(struct wlr_linux_dmabuf_v1_surface *surface) {
+	struct wl_resource *resource, *tmp;
+	wl_resource_for_each_safe(resource, tmp, &surface->feedback_resources) {
+		struct wl_list *link = wl_resource_get_link(resource);
+		wl_list_remove(link);
+		wl_list_init(link);
+	}
+
+	feedback_compiled_destroy(surface->feedback);
+	wl_list_remove(&surface->surface_destroy.link);
+	wl_list_remove(&surface->link);
+	free(surface);
+}
+
+static void surface_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_linux_dmabuf_v1_surface *surface =
+		wl_container_of(listener, surface, surface_destroy);
+	surface_destroy(surface);
+}
+
+static struct wlr_linux_dmabuf_v1_surface *surface_get_or_create(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
+		struct wlr_surface *wlr_surface) {
+	struct wlr_linux_dmabuf_v1_surface *surface;
+	wl_list_for_each(surface, &linux_dmabuf->surfaces, link) {
+		if (surface->surface == wlr_surface) {
+			return surface;
+		}
+	}
+
+	surface = calloc(1, sizeof(*surface));
+	if (surface == NULL) {
+		return NULL;
+	}
+	surface->surface = wlr_surface;
+	surface->linux_dmabuf = linux_dmabuf;
+	wl_list_init(&surface->feedback_resources);
+
+	surface->surface_destroy.notify = surface_handle_surface_destroy;
+	wl_signal_add(&wlr_surface->events.destroy, &surface->surface_destroy);
+
+	wl_list_insert(&linux_dmabuf->surfaces, &surface->link);
+	return surface;
+}
+
+static void linux_dmabuf_get_default_feedback(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf =
+		wlr_linux_dmabuf_v1_from_resource(resource);
+
+	struct wl_resource *feedback_resource =
+		feedback_resource_create(client, resource, id);
+	if (feedback_resource == NULL) {
+		return;
+	}
+	feedback_send(feedback_resource, linux_dmabuf->default_feedback);
+}
+
+static void linux_dmabuf_get_surface_feedback(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *surface_resource) {
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf =
+		wlr_linux_dmabuf_v1_from_resource(resource);
+	struct wlr_surface *wlr_surface =
+		wlr_surface_from_resource(surface_resource);
+
+	struct wlr_linux_dmabuf_v1_surface *surface =
+		surface_get_or_create(linux_dmabuf, wlr_surface);
+	if (surface == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	struct wl_resource *feedback_resource =
+		feedback_resource_create(client, resource, id);
+	if (feedback_resource == NULL) {
+		return;
+	}
+	wl_list_insert(&surface->feedback_resources,
+		wl_resource_get_link(feedback_resource));
+
+	feedback_send(feedback_resource, surface->feedback != NULL ?
+		surface->feedback : linux_dmabuf->default_feedback);
+}
+
 static void linux_dmabuf_destroy(struct wl_client *client,
 		struct wl_resource *resource) {
 	wl_resource_destroy(resource);
@@ -372,8 +757,44 @@ static void linux_dmabuf_destroy(struct wl_client *client,
 static const struct zwp_linux_dmabuf_v1_interface linux_dmabuf_impl = {
 	.destroy = linux_dmabuf_destroy,
 	.create_params = linux_dmabuf_create_params,
+	.get_default_feedback = linux_dmabuf_get_default_feedback,
+	.get_surface_feedback = linux_dmabuf_get_surface_feedback,
 };
 
+bool wlr_linux_dmabuf_v1_set_surface_feedback(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
+		struct wlr_surface *wlr_surface,
+		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
+	if (linux_dmabuf->default_feedback == NULL) {
+		return false;
+	}
+
+	struct wlr_linux_dmabuf_v1_feedback_compiled *compiled = NULL;
+	if (feedback != NULL) {
+		compiled = feedback_compile(linux_dmabuf, feedback);
+		if (compiled == NULL) {
+			return false;
+		}
+	}
+
+	struct wlr_linux_dmabuf_v1_surface *surface =
+		surface_get_or_create(linux_dmabuf, wlr_surface);
+	if (surface == NULL) {
+		feedback_compiled_destroy(compiled);
+		return false;
+	}
+
+	feedback_compiled_destroy(surface->feedback);
+	surface->feedback = compiled;
+
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &surface->feedback_resources) {
+		feedback_send(resource, compiled != NULL ?
+			compiled : linux_dmabuf->default_feedback);
+	}
+	return true;
+}
+
 struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_from_resource(
 		struct wl_resource *resource) {
 	assert(wl_resource_instance_of(resource, &zwp_linux_dmabuf_v1_interface,
@@ -444,7 +865,11 @@ static void linux_dmabuf_bind(struct wl_client *client, void *data,
 	wl_resource_set_implementation(resource, &linux_dmabuf_impl,
 		linux_dmabuf, linux_dmabuf_resource_destroy);
 	wl_list_insert(&linux_dmabuf->resources, wl_resource_get_link(resource));
-	linux_dmabuf_send_formats(linux_dmabuf, resource, version);
+
+	// Starting with version 4, formats are advertised via feedback objects
+	if (version < ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
+		linux_dmabuf_send_formats(linux_dmabuf, resource, version);
+	}
 }
 
 void wlr_linux_dmabuf_v1_destroy(struct wlr_linux_dmabuf_v1 *linux_dmabuf) {
@@ -457,6 +882,13 @@ void wlr_linux_dmabuf_v1_destroy(struct wlr_linux_dmabuf_v1 *linux_dmabuf) {
 	wl_list_remove(&linux_dmabuf->display_destroy.link);
 	wl_list_remove(&linux_dmabuf->renderer_destroy.link);
 
+	struct wlr_linux_dmabuf_v1_surface *surface, *surface_tmp;
+	wl_list_for_each_safe(surface, surface_tmp, &linux_dmabuf->surfaces,
+			link) {
+		surface_destroy(surface);
+	}
+	feedback_compiled_destroy(linux_dmabuf->default_feedback);
+
 	struct wl_resource *resource, *tmp;
 	wl_resource_for_each_safe(resource, tmp, &linux_dmabuf->resources) {
 		wl_resource_destroy(resource);
@@ -489,13 +921,36 @@ struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_create(struct wl_display *displa
 	linux_dmabuf->renderer = renderer;
 
 	wl_list_init(&linux_dmabuf->resources);
+	wl_list_init(&linux_dmabuf->surfaces);
 	wl_signal_init(&linux_dmabuf->events.destroy);
 
+	// Feedback needs to tell clients which device to allocate buffers on
+	uint32_t version = LINUX_DMABUF_VERSION;
+	dev_t main_device;
+	if (wlr_renderer_get_drm_device(renderer, &main_device)) {
+		struct wlr_linux_dmabuf_feedback_v1_tranche tranche = {
+			.target_device = main_device,
+		};
+		struct wlr_linux_dmabuf_feedback_v1 feedback = {
+			.main_device = main_device,
+			.tranches = &tranche,
+			.tranches_len = 1,
+		};
+		linux_dmabuf->default_feedback =
+			feedback_compile(linux_dmabuf, &feedback);
+	}
+	if (linux_dmabuf->default_feedback == NULL) {
+		wlr_log(WLR_DEBUG, "Renderer DRM device unknown, "
+			"disabling linux-dmabuf feedback");
+		version = ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION - 1;
+	}
+
 	linux_dmabuf->global =
 		wl_global_create(display, &zwp_linux_dmabuf_v1_interface,
-			LINUX_DMABUF_VERSION, linux_dmabuf, linux_dmabuf_bind);
+			version, linux_dmabuf, linux_dmabuf_bind);
 	if (!linux_dmabuf->global) {
 		wlr_log(WLR_ERROR, "could not create linux dmabuf v1 wl global");
+		feedback_compiled_destroy(linux_dmabuf->default_feedback);
 		free(linux_dmabuf);
 		return NULL;
 	}
@@ -508,3 +963,15 @@ struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_create(struct wl_display *displa
 
 	return linux_dmabuf;
 }
+
+struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_from_display(
+		struct wl_display *display) {
+	struct wl_listener *listener =
+		wl_display_get_destroy_listener(display, handle_display_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf =
+		wl_container_of(listener, linux_dmabuf, display_destroy);
+	return linux_dmabuf;
+}
@@ -18,12 +18,13 @@ bool wlr_list_init(struct wlr_list *list) {
 
 static bool list_resize(struct wlr_list *list) {
 	if (list->length == list->capacity) {
-		void *new_items = realloc(list->items,
-			sizeof(void *) * (list->capacity + 10));
+		// Grow geometrically so that pushing n items is linear
+		size_t capacity = list->capacity > 0 ? list->capacity * 2 : 10;
+		void *new_items = realloc(list->items, sizeof(void *) * capacity);
 		if (!new_items) {
 			return false;
 		}
-		list->capacity += 10;
+		list->capacity = capacity;
 		list->items = new_items;
 	}
 	return true;
@@ -81,14 +82,18 @@ void *wlr_list_peek(struct wlr_list *list) {
 }
 
 ssize_t wlr_list_cat(struct wlr_list *list, const struct wlr_list *source) {
-	size_t old_len = list->length;
-	size_t i;
-	for (i = 0; i < source->length; ++i) {
-		if (wlr_list_push(list, source->items[i]) == -1) {
-			list->length = old_len;
+	size_t length = list->length + source->length;
+	if (length > list->capacity) {
+		void *new_items = realloc(list->items, sizeof(void *) * length);
+		if (!new_items) {
 			return -1;
 		}
+		list->capacity = length;
+		list->items = new_items;
 	}
+	memcpy(&list->items[list->length], source->items,
+		sizeof(void *) * source->length);
+	list->length = length;
 	return list->length;
 }
 
@@ -9,6 +9,7 @@
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_seat.h>
@@ -16,16 +17,29 @@
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "util/signal.h"
+#include "util/startup.h"
+#include "util/trace.h"
 
 #define OUTPUT_VERSION 3
 
+enum output_done_field {
+	OUTPUT_DONE_GEOMETRY = 1 << 0,
+	OUTPUT_DONE_MODE = 1 << 1,
+	OUTPUT_DONE_SCALE = 1 << 2,
+};
+
+static void output_send_geometry(struct wl_resource *resource) {
+	struct wlr_output *output = wlr_output_from_resource(resource);
+	wl_output_send_geometry(resource, output->lx, output->ly,
+		output->phys_width, output->phys_height, output->subpixel,
+		output->make, output->model, output->transform);
+}
+
 static void output_send_to_resource(struct wl_resource *resource) {
 	struct wlr_output *output = wlr_output_from_resource(resource);
 	const uint32_t version = wl_resource_get_version(resource);
 	if (version >= WL_OUTPUT_GEOMETRY_SINCE_VERSION) {
-		wl_output_send_geometry(resource, output->lx, output->ly,
-			output->phys_width, output->phys_height, output->subpixel,
-			output->make, output->model, output->transform);
+		output_send_geometry(resource);
 	}
 	if (version >= WL_OUTPUT_MODE_SINCE_VERSION) {
 		struct wlr_output_mode *mode;
@@ -52,13 +66,8 @@ static void output_send_to_resource(struct wl_resource *resource) {
 	}
 }
 
-static void output_send_current_mode_to_resource(
-		struct wl_resource *resource) {
+static void output_send_current_mode(struct wl_resource *resource) {
 	struct wlr_output *output = wlr_output_from_resource(resource);
-	const uint32_t version = wl_resource_get_version(resource);
-	if (version < WL_OUTPUT_MODE_SINCE_VERSION) {
-		return;
-	}
 	if (output->current_mode != NULL) {
 		struct wlr_output_mode *mode = output->current_mode;
 		uint32_t flags = mode->flags & WL_OUTPUT_MODE_PREFERRED;
@@ -69,9 +78,52 @@ static void output_send_current_mode_to_resource(
 		wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, output->width,
 			output->height, output->refresh);
 	}
-	if (version >= WL_OUTPUT_DONE_SINCE_VERSION) {
-		wl_output_send_done(resource);
+}
+
+static void output_handle_idle_done(void *data) {
+	struct wlr_output *output = data;
+	output->idle_done = NULL;
+	uint32_t fields = output->pending_done;
+	output->pending_done = 0;
+
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &output->resources) {
+		const uint32_t version = wl_resource_get_version(resource);
+		if ((fields & OUTPUT_DONE_GEOMETRY) &&
+				version >= WL_OUTPUT_GEOMETRY_SINCE_VERSION) {
+			output_send_geometry(resource);
+		}
+		if ((fields & OUTPUT_DONE_MODE) &&
+				version >= WL_OUTPUT_MODE_SINCE_VERSION) {
+			output_send_current_mode(resource);
+		}
+		if ((fields & OUTPUT_DONE_SCALE) &&
+				version >= WL_OUTPUT_SCALE_SINCE_VERSION) {
+			wl_output_send_scale(resource, (uint32_t)ceil(output->scale));
+		}
+		if (version >= WL_OUTPUT_DONE_SINCE_VERSION) {
+			wl_output_send_done(resource);
+		}
+	}
+}
+
+/**
+ * Queues the changed properties to be sent to clients. All changes made
+ * during the same event loop iteration are sent together, followed by a single
+ * done event, so that clients never see an intermediate state.
+ */
+static void output_schedule_done(struct wlr_output *output, uint32_t fields) {
+	if (output->global == NULL || wl_list_empty(&output->resources)) {
+		// Resources created later get the whole state when binding
+		return;
+	}
+	output->pending_done |= fields;
+	if (output->idle_done != NULL) {
+		return;
 	}
+	struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+	output->idle_done =
+		wl_event_loop_add_idle(ev, output_handle_idle_done, output);
 }
 
 static void output_handle_resource_destroy(struct wl_resource *resource) {
@@ -118,6 +170,11 @@ void wlr_output_destroy_global(struct wlr_output *output) {
 	if (output->global == NULL) {
 		return;
 	}
+	if (output->idle_done != NULL) {
+		wl_event_source_remove(output->idle_done);
+		output->idle_done = NULL;
+	}
+	output->pending_done = 0;
 	// Make all output resources inert
 	struct wl_resource *resource, *tmp;
 	wl_resource_for_each_safe(resource, tmp, &output->resources) {
@@ -135,6 +192,8 @@ void wlr_output_update_enabled(struct wlr_output *output, bool enabled) {
 	}
 
 	output->enabled = enabled;
+	// A disabled output is re-enabled with its display on
+	output->dpms_off = false;
 	wlr_signal_emit_safe(&output->events.enable, output);
 }
 
@@ -154,6 +213,175 @@ bool wlr_output_enable(struct wlr_output *output, bool enable) {
 	return false;
 }
 
+bool wlr_output_set_dpms(struct wlr_output *output, bool on) {
+	if (!output->enabled) {
+		return false;
+	}
+	if (output->dpms_off == !on) {
+		return true;
+	}
+
+	// Backends without DPMS support keep displaying the last frame
+	if (output->impl->set_dpms && !output->impl->set_dpms(output, on)) {
+		return false;
+	}
+
+	output->dpms_off = !on;
+	if (!on && output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+		output->idle_frame = NULL;
+	}
+	wlr_signal_emit_safe(&output->events.dpms, output);
+
+	if (on) {
+		// The buffers may not hold the last frame anymore
+		wlr_output_damage_whole(output);
+		wlr_output_schedule_frame(output);
+	}
+	return true;
+}
+
+void wlr_output_pending_enable(struct wlr_output *output, bool enable) {
+	output->pending.committed |= WLR_OUTPUT_STATE_ENABLED;
+	output->pending.enabled = enable;
+}
+
+void wlr_output_pending_set_mode(struct wlr_output *output,
+		struct wlr_output_mode *mode) {
+	output->pending.committed |= WLR_OUTPUT_STATE_MODE;
+	output->pending.mode = mode;
+}
+
+void wlr_output_pending_set_custom_mode(struct wlr_output *output,
+		int32_t width, int32_t height, int32_t refresh) {
+	output->pending.committed |= WLR_OUTPUT_STATE_MODE;
+	output->pending.mode = NULL;
+	output->pending.custom_width = width;
+	output->pending.custom_height = height;
+	output->pending.custom_refresh = refresh;
+}
+
+void wlr_output_pending_set_transform(struct wlr_output *output,
+		enum wl_output_transform transform) {
+	output->pending.committed |= WLR_OUTPUT_STATE_TRANSFORM;
+	output->pending.transform = transform;
+}
+
+void wlr_output_pending_set_scale(struct wlr_output *output, float scale) {
+	output->pending.committed |= WLR_OUTPUT_STATE_SCALE;
+	output->pending.scale = scale;
+}
+
+void wlr_output_pending_enable_adaptive_sync(struct wlr_output *output,
+		bool enabled) {
+	output->pending.committed |= WLR_OUTPUT_STATE_ADAPTIVE_SYNC;
+	output->pending.adaptive_sync_enabled = enabled;
+}
+
+bool wlr_output_pending_set_gamma(struct wlr_output *output, size_t size,
+		const uint16_t *r, const uint16_t *g, const uint16_t *b) {
+	uint16_t *gamma_lut = NULL;
+	if (size > 0) {
+		gamma_lut = malloc(3 * size * sizeof(uint16_t));
+		if (gamma_lut == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		memcpy(gamma_lut, r, size * sizeof(uint16_t));
+		memcpy(gamma_lut + size, g, size * sizeof(uint16_t));
+		memcpy(gamma_lut + 2 * size, b, size * sizeof(uint16_t));
+	}
+
+	free(output->pending.gamma_lut);
+	output->pending.committed |= WLR_OUTPUT_STATE_GAMMA;
+	output->pending.gamma_size = size;
+	output->pending.gamma_lut = gamma_lut;
+	return true;
+}
+
+void wlr_output_rollback(struct wlr_output *output) {
+	free(output->pending.gamma_lut);
+	memset(&output->pending, 0, sizeof(output->pending));
+}
+
+// Applies the pending changes which the backend submits to the hardware with
+// the next modeset or page-flip
+static bool output_commit_hw_state(struct wlr_output *output) {
+	struct wlr_output_state *pending = &output->pending;
+	bool ok = true;
+	if (pending->committed & WLR_OUTPUT_STATE_GAMMA) {
+		size_t size = pending->gamma_size;
+		uint16_t *lut = pending->gamma_lut;
+		if (!wlr_output_set_gamma(output, size, lut, lut + size,
+				lut + 2 * size)) {
+			wlr_log(WLR_ERROR, "Failed to set gamma of output '%s'",
+				output->name);
+			ok = false;
+		}
+	}
+	if ((pending->committed & WLR_OUTPUT_STATE_ADAPTIVE_SYNC) &&
+			!wlr_output_enable_adaptive_sync(output,
+				pending->adaptive_sync_enabled)) {
+		wlr_log(WLR_ERROR, "Failed to %s adaptive sync on output '%s'",
+			pending->adaptive_sync_enabled ? "enable" : "disable",
+			output->name);
+		ok = false;
+	}
+	return ok;
+}
+
+bool wlr_output_commit(struct wlr_output *output) {
+	struct wlr_output_state *pending = &output->pending;
+	bool ok = true;
+
+	bool disable = (pending->committed & WLR_OUTPUT_STATE_ENABLED) &&
+		!pending->enabled;
+	if (disable) {
+		ok = wlr_output_enable(output, false);
+	} else {
+		// An enabled output stages hardware state ahead of the modeset, so
+		// that both land in the same commit. A disabled output has nothing
+		// to attach it to until it's enabled.
+		bool was_enabled = output->enabled;
+		if (was_enabled && !output_commit_hw_state(output)) {
+			ok = false;
+		}
+
+		// Setting a mode enables the output
+		if (pending->committed & WLR_OUTPUT_STATE_MODE) {
+			bool mode_ok = pending->mode != NULL ?
+				wlr_output_set_mode(output, pending->mode) :
+				wlr_output_set_custom_mode(output, pending->custom_width,
+					pending->custom_height, pending->custom_refresh);
+			if (!mode_ok) {
+				wlr_log(WLR_ERROR, "Failed to set mode of output '%s'",
+					output->name);
+				ok = false;
+			}
+		}
+		// No-op if the modeset has already enabled the output
+		if ((pending->committed & WLR_OUTPUT_STATE_ENABLED) &&
+				!wlr_output_enable(output, true)) {
+			ok = false;
+		}
+
+		if (!was_enabled && !output_commit_hw_state(output)) {
+			ok = false;
+		}
+	}
+
+	if ((pending->committed & WLR_OUTPUT_STATE_TRANSFORM) &&
+			pending->transform != output->transform) {
+		wlr_output_set_transform(output, pending->transform);
+	}
+	if (pending->committed & WLR_OUTPUT_STATE_SCALE) {
+		wlr_output_set_scale(output, pending->scale);
+	}
+
+	wlr_output_rollback(output);
+	return ok;
+}
+
 bool wlr_output_set_mode(struct wlr_output *output,
 		struct wlr_output_mode *mode) {
 	if (!output->impl || !output->impl->set_mode) {
@@ -201,10 +429,7 @@ void wlr_output_update_custom_mode(struct wlr_output *output, int32_t width,
 
 	output->refresh = refresh;
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &output->resources) {
-		output_send_current_mode_to_resource(resource);
-	}
+	output_schedule_done(output, OUTPUT_DONE_MODE);
 
 	wlr_signal_emit_safe(&output->events.mode, output);
 }
@@ -214,15 +439,30 @@ void wlr_output_set_transform(struct wlr_output *output,
 	output->impl->transform(output, transform);
 	output_update_matrix(output);
 
-	// TODO: only send geometry and done
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &output->resources) {
-		output_send_to_resource(resource);
-	}
+	output_schedule_done(output, OUTPUT_DONE_GEOMETRY);
 
 	wlr_signal_emit_safe(&output->events.transform, output);
 }
 
+bool wlr_output_enable_adaptive_sync(struct wlr_output *output,
+		bool enabled) {
+	if (!output->impl->set_adaptive_sync) {
+		return !enabled;
+	}
+
+	bool enabled_now =
+		output->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED;
+	if (enabled_now == enabled) {
+		return true;
+	}
+
+	return output->impl->set_adaptive_sync(output, enabled);
+}
+
+void wlr_output_set_tearing(struct wlr_output *output, bool tearing) {
+	output->tearing = tearing;
+}
+
 void wlr_output_set_position(struct wlr_output *output, int32_t lx,
 		int32_t ly) {
 	if (lx == output->lx && ly == output->ly) {
@@ -232,11 +472,7 @@ void wlr_output_set_position(struct wlr_output *output, int32_t lx,
 	output->lx = lx;
 	output->ly = ly;
 
-	// TODO: only send geometry and done
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &output->resources) {
-		output_send_to_resource(resource);
-	}
+	output_schedule_done(output, OUTPUT_DONE_GEOMETRY);
 }
 
 void wlr_output_set_scale(struct wlr_output *output, float scale) {
@@ -246,11 +482,7 @@ void wlr_output_set_scale(struct wlr_output *output, float scale) {
 
 	output->scale = scale;
 
-	// TODO: only send mode and done
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &output->resources) {
-		output_send_to_resource(resource);
-	}
+	output_schedule_done(output, OUTPUT_DONE_SCALE);
 
 	wlr_signal_emit_safe(&output->events.scale, output);
 }
@@ -262,10 +494,7 @@ void wlr_output_set_subpixel(struct wlr_output *output, enum wl_output_subpixel
 
 	output->subpixel = subpixel;
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &output->resources) {
-		output_send_to_resource(resource);
-	}
+	output_schedule_done(output, OUTPUT_DONE_GEOMETRY);
 }
 
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
@@ -280,6 +509,7 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	if (impl->set_cursor || impl->move_cursor) {
 		assert(impl->set_cursor && impl->move_cursor);
 	}
+	assert(!impl->set_cursor_pixels || impl->set_cursor);
 	output->backend = backend;
 	output->impl = impl;
 	output->display = display;
@@ -292,8 +522,12 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	wl_signal_init(&output->events.needs_swap);
 	wl_signal_init(&output->events.swap_buffers);
 	wl_signal_init(&output->events.present);
+	wl_signal_init(&output->events.frame_stats);
+	wl_signal_init(&output->events.flip_error);
 	wl_signal_init(&output->events.enable);
+	wl_signal_init(&output->events.dpms);
 	wl_signal_init(&output->events.mode);
+	wl_signal_init(&output->events.hardware_cursor);
 	wl_signal_init(&output->events.scale);
 	wl_signal_init(&output->events.transform);
 	wl_signal_init(&output->events.destroy);
@@ -332,8 +566,16 @@ void wlr_output_destroy(struct wlr_output *output) {
 	if (output->idle_frame != NULL) {
 		wl_event_source_remove(output->idle_frame);
 	}
+	if (output->render_deadline.timer != NULL) {
+		wl_event_source_remove(output->render_deadline.timer);
+	}
+	for (size_t i = 0; i < WLR_OUTPUT_FRAME_TIMERS; ++i) {
+		wlr_render_timer_destroy(output->frame_stats.timers[i]);
+	}
+	free(output->frame_timings.frames);
 
 	pixman_region32_fini(&output->damage);
+	wlr_output_rollback(output);
 
 	if (output->impl && output->impl->destroy) {
 		output->impl->destroy(output);
@@ -360,8 +602,254 @@ void wlr_output_effective_resolution(struct wlr_output *output,
 	*height /= output->scale;
 }
 
+static int64_t timespec_to_nsec(const struct timespec *ts) {
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int64_t output_now_nsec(struct wlr_output *output) {
+	clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return timespec_to_nsec(&now);
+}
+
+// Emits the frame recorded in a slot, if any. Returns false if its GPU time
+// isn't available yet, unless `force` is set.
+static bool frame_stats_emit_slot(struct wlr_output *output, size_t idx,
+		bool force) {
+	int64_t cpu_time = output->frame_stats.cpu_times[idx];
+	if (cpu_time < 0) {
+		return true;
+	}
+
+	int64_t gpu_time = -1;
+	struct wlr_render_timer *timer = output->frame_stats.timers[idx];
+	if (timer != NULL && !wlr_render_timer_get_duration(timer, &gpu_time)) {
+		if (!force) {
+			return false;
+		}
+		gpu_time = -1;
+	}
+
+	output->frame_stats.cpu_times[idx] = -1;
+	struct wlr_output_event_frame_stats event = {
+		.output = output,
+		.cpu_time = cpu_time,
+		.gpu_time = gpu_time,
+	};
+	wlr_signal_emit_safe(&output->events.frame_stats, &event);
+	return true;
+}
+
+// Emits finished frames oldest first, stopping at the first one still in
+// flight so that events stay in order
+static void frame_stats_collect(struct wlr_output *output) {
+	for (size_t i = 0; i < WLR_OUTPUT_FRAME_TIMERS; ++i) {
+		size_t idx = (output->frame_stats.idx + i) % WLR_OUTPUT_FRAME_TIMERS;
+		if (!frame_stats_emit_slot(output, idx, false)) {
+			return;
+		}
+	}
+}
+
+void wlr_output_enable_frame_stats(struct wlr_output *output, bool enabled) {
+	if (output->frame_stats.enabled == enabled) {
+		return;
+	}
+	output->frame_stats.enabled = enabled;
+	output->frame_stats.frame_start = 0;
+	output->frame_stats.idx = 0;
+
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	for (size_t i = 0; i < WLR_OUTPUT_FRAME_TIMERS; ++i) {
+		output->frame_stats.cpu_times[i] = -1;
+		wlr_render_timer_destroy(output->frame_stats.timers[i]);
+		output->frame_stats.timers[i] = NULL;
+		if (enabled && renderer != NULL) {
+			output->frame_stats.timers[i] = wlr_render_timer_create(renderer);
+		}
+	}
+}
+
+bool wlr_output_enable_frame_timings(struct wlr_output *output,
+		bool enabled) {
+	if (output->frame_timings.enabled == enabled) {
+		return true;
+	}
+
+	if (enabled) {
+		output->frame_timings.frames = calloc(WLR_OUTPUT_FRAME_TIMINGS_LEN,
+			sizeof(struct wlr_output_frame_timing));
+		if (output->frame_timings.frames == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+	} else {
+		free(output->frame_timings.frames);
+		output->frame_timings.frames = NULL;
+	}
+
+	output->frame_timings.enabled = enabled;
+	output->frame_timings.len = 0;
+	output->frame_timings.idx = 0;
+	output->frame_timings.missed = 0;
+	memset(&output->frame_timings.current, 0,
+		sizeof(output->frame_timings.current));
+	return true;
+}
+
+// Returns the i-th recorded frame, oldest first
+static struct wlr_output_frame_timing *frame_timings_get(
+		struct wlr_output *output, size_t i) {
+	size_t idx = (output->frame_timings.idx + WLR_OUTPUT_FRAME_TIMINGS_LEN -
+		output->frame_timings.len + i) % WLR_OUTPUT_FRAME_TIMINGS_LEN;
+	return &output->frame_timings.frames[idx];
+}
+
+static void frame_timings_push(struct wlr_output *output) {
+	size_t idx = output->frame_timings.idx;
+	output->frame_timings.frames[idx] = output->frame_timings.current;
+	output->frame_timings.idx = (idx + 1) % WLR_OUTPUT_FRAME_TIMINGS_LEN;
+	if (output->frame_timings.len < WLR_OUTPUT_FRAME_TIMINGS_LEN) {
+		output->frame_timings.len++;
+	}
+}
+
+// Records the presentation of the frame swapped by the commit `commit_seq`.
+// Presents of commits without a recorded frame, or of a frame already
+// presented (e.g. after a cursor-only page-flip), are ignored. `last_present`
+// and `refresh` describe the previous presentation.
+static void frame_timings_present(struct wlr_output *output,
+		uint32_t commit_seq, int64_t present, int64_t last_present,
+		int64_t refresh) {
+	struct wlr_output_frame_timing *frame = NULL;
+	for (size_t i = output->frame_timings.len; i-- > 0;) {
+		struct wlr_output_frame_timing *f = frame_timings_get(output, i);
+		if (f->commit_seq == commit_seq) {
+			frame = f;
+			break;
+		}
+	}
+	if (frame == NULL || frame->present != 0) {
+		return;
+	}
+	frame->present = present;
+
+	if (last_present == 0 || refresh <= 0) {
+		return;
+	}
+
+	// The frame should have made it to the first vblank after the swap
+	int64_t expected = last_present + refresh;
+	if (expected < frame->swap_buffers) {
+		expected +=
+			((frame->swap_buffers - expected) / refresh + 1) * refresh;
+	}
+	int64_t late = present - expected;
+	if (late > refresh / 2) {
+		frame->missed = (late + refresh / 2) / refresh;
+		output->frame_timings.missed += frame->missed;
+	}
+}
+
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+		struct wlr_output_frame_timing *frames, size_t len) {
+	size_t n = output->frame_timings.len;
+	if (len > n) {
+		len = n;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		frames[i] = *frame_timings_get(output, n - len + i);
+	}
+	return len;
+}
+
+static int compare_int64(const void *_a, const void *_b) {
+	const int64_t *a = _a, *b = _b;
+	return (*a > *b) - (*a < *b);
+}
+
+// Sorts `samples` and computes nearest-rank percentiles
+static void compute_percentiles(struct wlr_output_timing_percentiles *pct,
+		int64_t *samples, size_t len) {
+	memset(pct, 0, sizeof(*pct));
+	if (len == 0) {
+		return;
+	}
+	qsort(samples, len, sizeof(samples[0]), compare_int64);
+	pct->p50 = samples[(len * 50 + 99) / 100 - 1];
+	pct->p90 = samples[(len * 90 + 99) / 100 - 1];
+	pct->p99 = samples[(len * 99 + 99) / 100 - 1];
+	pct->max = samples[len - 1];
+}
+
+bool wlr_output_get_frame_timings_summary(struct wlr_output *output,
+		struct wlr_output_frame_timings_summary *summary) {
+	memset(summary, 0, sizeof(*summary));
+	if (!output->frame_timings.enabled) {
+		return false;
+	}
+	summary->missed = output->frame_timings.missed;
+
+	int64_t frame_times[WLR_OUTPUT_FRAME_TIMINGS_LEN];
+	int64_t render_times[WLR_OUTPUT_FRAME_TIMINGS_LEN];
+	int64_t render_to_present[WLR_OUTPUT_FRAME_TIMINGS_LEN];
+	size_t frame_times_len = 0, render_len = 0;
+
+	int64_t prev_present = 0;
+	for (size_t i = 0; i < output->frame_timings.len; ++i) {
+		struct wlr_output_frame_timing *frame = frame_timings_get(output, i);
+		if (frame->present == 0) {
+			prev_present = 0;
+			continue;
+		}
+		summary->frames++;
+
+		if (prev_present != 0) {
+			frame_times[frame_times_len++] = frame->present - prev_present;
+		}
+		prev_present = frame->present;
+
+		if (frame->make_current != 0) {
+			render_times[render_len] =
+				frame->swap_buffers - frame->make_current;
+			render_to_present[render_len] =
+				frame->present - frame->make_current;
+			render_len++;
+		}
+	}
+
+	compute_percentiles(&summary->frame_time, frame_times, frame_times_len);
+	compute_percentiles(&summary->render_time, render_times, render_len);
+	compute_percentiles(&summary->render_to_present, render_to_present,
+		render_len);
+	return true;
+}
+
 bool wlr_output_make_current(struct wlr_output *output, int *buffer_age) {
-	return output->impl->make_current(output, buffer_age);
+	if (!output->impl->make_current(output, buffer_age)) {
+		return false;
+	}
+
+	if (output->frame_timings.enabled &&
+			output->frame_timings.current.frame != 0 &&
+			output->frame_timings.current.make_current == 0) {
+		output->frame_timings.current.make_current = output_now_nsec(output);
+	}
+
+	if (output->frame_stats.enabled) {
+		output->frame_stats.frame_start = output_now_nsec(output);
+
+		size_t idx = output->frame_stats.idx;
+		struct wlr_render_timer *timer = output->frame_stats.timers[idx];
+		if (timer != NULL) {
+			// This is the oldest slot, give up on its result if the GPU
+			// still hasn't caught up
+			frame_stats_emit_slot(output, idx, true);
+			wlr_render_timer_begin(timer);
+		}
+	}
+	return true;
 }
 
 bool wlr_output_preferred_read_format(struct wlr_output *output,
@@ -395,6 +883,8 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		when = &now;
 	}
 
+	wlr_trace(output_swap_buffers, output);
+
 	struct wlr_output_event_swap_buffers event = {
 		.output = output,
 		.when = when,
@@ -402,6 +892,43 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 	};
 	wlr_signal_emit_safe(&output->events.swap_buffers, &event);
 
+	if (output->render_deadline.frame_start != 0) {
+		int64_t duration =
+			output_now_nsec(output) - output->render_deadline.frame_start;
+		size_t idx = output->render_deadline.samples_idx;
+		output->render_deadline.samples[idx] = duration;
+		output->render_deadline.samples_idx =
+			(idx + 1) % WLR_OUTPUT_RENDER_TIME_SAMPLES;
+		if (output->render_deadline.samples_len <
+				WLR_OUTPUT_RENDER_TIME_SAMPLES) {
+			output->render_deadline.samples_len++;
+		}
+		output->render_deadline.frame_start = 0;
+	}
+
+	if (output->frame_stats.frame_start != 0) {
+		size_t idx = output->frame_stats.idx;
+		struct wlr_render_timer *timer = output->frame_stats.timers[idx];
+		if (timer != NULL) {
+			wlr_render_timer_end(timer);
+		}
+		output->frame_stats.cpu_times[idx] =
+			output_now_nsec(output) - output->frame_stats.frame_start;
+		output->frame_stats.frame_start = 0;
+		output->frame_stats.idx = (idx + 1) % WLR_OUTPUT_FRAME_TIMERS;
+		frame_stats_collect(output);
+	}
+
+	// Backends may send the present event before returning
+	output->commit_seq++;
+	if (output->frame_timings.current.frame != 0) {
+		output->frame_timings.current.commit_seq = output->commit_seq;
+		output->frame_timings.current.swap_buffers = output_now_nsec(output);
+		frame_timings_push(output);
+		memset(&output->frame_timings.current, 0,
+			sizeof(output->frame_timings.current));
+	}
+
 	pixman_region32_t render_damage;
 	pixman_region32_init(&render_damage);
 	pixman_region32_union_rect(&render_damage, &render_damage, 0, 0,
@@ -432,11 +959,144 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 	return true;
 }
 
-void wlr_output_send_frame(struct wlr_output *output) {
+bool wlr_output_set_damage_region(struct wlr_output *output,
+		pixman_region32_t *damage) {
+	if (!output->impl->set_damage_region) {
+		return false;
+	}
+	return output->impl->set_damage_region(output, damage);
+}
+
+bool wlr_output_attach_buffer(struct wlr_output *output,
+		struct wlr_buffer *buffer) {
+	if (!output->impl->attach_buffer) {
+		return false;
+	}
+	if (output->attach_render_locks > 0) {
+		return false;
+	}
+
+	// If the output has at least one software cursor, refuse to attach the
+	// buffer: the cursor needs to be composited
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &output->cursors, link) {
+		if (cursor->enabled && cursor->visible &&
+				cursor != output->hardware_cursor) {
+			return false;
+		}
+	}
+
+	return output->impl->attach_buffer(output, buffer);
+}
+
+size_t wlr_output_assign_overlays(struct wlr_output *output,
+		struct wlr_output_overlay *overlays, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		overlays[i].accepted = false;
+	}
+
+	if (!output->impl->assign_overlays || output->attach_render_locks > 0) {
+		return 0;
+	}
+
+	return output->impl->assign_overlays(output, overlays, len);
+}
+
+static void output_emit_frame(struct wlr_output *output) {
 	output->frame_pending = false;
+	output->render_deadline.frame_delayed = false;
+	if (output->dpms_off) {
+		// Nothing is displayed, the frame is scheduled again on wake-up
+		return;
+	}
+	if (output->render_deadline.enabled) {
+		output->render_deadline.frame_start = output_now_nsec(output);
+	}
+	if (output->frame_timings.enabled) {
+		memset(&output->frame_timings.current, 0,
+			sizeof(output->frame_timings.current));
+		output->frame_timings.current.frame = output_now_nsec(output);
+	}
+	wlr_trace(output_frame, output);
 	wlr_signal_emit_safe(&output->events.frame, output);
 }
 
+static int render_deadline_handle_timer(void *data) {
+	struct wlr_output *output = data;
+	output_emit_frame(output);
+	return 0;
+}
+
+// Returns how long the frame event can be delayed, in milliseconds
+static int render_deadline_get_delay(struct wlr_output *output) {
+	if (!output->render_deadline.enabled ||
+			output->render_deadline.samples_len == 0 ||
+			output->render_deadline.refresh <= 0) {
+		return 0;
+	}
+
+	// Be pessimistic and budget for the slowest recent frame, plus some slack
+	// for the backend to submit the buffer
+	int64_t render_time = 0;
+	for (size_t i = 0; i < output->render_deadline.samples_len; ++i) {
+		if (output->render_deadline.samples[i] > render_time) {
+			render_time = output->render_deadline.samples[i];
+		}
+	}
+	render_time += 1000000;
+
+	int64_t next_vblank = output->render_deadline.last_present +
+		output->render_deadline.refresh;
+	int64_t delay = next_vblank - render_time - output_now_nsec(output);
+	if (delay <= 0) {
+		return 0;
+	}
+	return delay / 1000000;
+}
+
+void wlr_output_send_frame(struct wlr_output *output) {
+	int delay = render_deadline_get_delay(output);
+	if (delay > 0 && output->render_deadline.timer != NULL) {
+		// frame_pending stays set until the timer fires
+		output->render_deadline.frame_delayed = true;
+		wl_event_source_timer_update(output->render_deadline.timer, delay);
+		return;
+	}
+
+	output_emit_frame(output);
+}
+
+void wlr_output_enable_render_deadline(struct wlr_output *output,
+		bool enabled) {
+	if (output->render_deadline.enabled == enabled) {
+		return;
+	}
+
+	if (enabled) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->render_deadline.timer = wl_event_loop_add_timer(ev,
+			render_deadline_handle_timer, output);
+		if (output->render_deadline.timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create render deadline timer");
+			return;
+		}
+	} else {
+		wl_event_source_remove(output->render_deadline.timer);
+		output->render_deadline.timer = NULL;
+	}
+
+	bool frame_delayed = output->render_deadline.frame_delayed;
+	output->render_deadline.enabled = enabled;
+	output->render_deadline.frame_start = 0;
+	output->render_deadline.samples_len = 0;
+	output->render_deadline.samples_idx = 0;
+
+	if (frame_delayed) {
+		// Don't leave a delayed frame behind
+		output_emit_frame(output);
+	}
+}
+
 static void schedule_frame_handle_idle_timer(void *data) {
 	struct wlr_output *output = data;
 	output->idle_frame = NULL;
@@ -449,7 +1109,8 @@ static void schedule_frame_handle_idle_timer(void *data) {
 }
 
 void wlr_output_schedule_frame(struct wlr_output *output) {
-	if (output->frame_pending || output->idle_frame != NULL) {
+	if (output->dpms_off || output->frame_pending ||
+			output->idle_frame != NULL) {
 		return;
 	}
 
@@ -468,6 +1129,9 @@ void wlr_output_send_present(struct wlr_output *output,
 	}
 
 	event->output = output;
+	if (event->commit_seq == 0) {
+		event->commit_seq = output->commit_seq;
+	}
 
 	struct timespec now;
 	if (event->when == NULL) {
@@ -481,9 +1145,42 @@ void wlr_output_send_present(struct wlr_output *output,
 		event->when = &now;
 	}
 
+	int64_t present = timespec_to_nsec(event->when);
+	wlr_trace(output_present, output, present, event->seq);
+	if (output->frame_timings.enabled) {
+		int refresh = output->render_deadline.refresh > 0 ?
+			output->render_deadline.refresh : event->refresh;
+		frame_timings_present(output, event->commit_seq, present,
+			output->render_deadline.last_present, refresh);
+	}
+
+	output->render_deadline.last_present = present;
+	output->render_deadline.refresh = event->refresh;
+
+	startup_mark_presented();
 	wlr_signal_emit_safe(&output->events.present, event);
 }
 
+bool wlr_output_predict_next_present(struct wlr_output *output,
+		struct timespec *when) {
+	int64_t last_present = output->render_deadline.last_present;
+	int64_t refresh = output->render_deadline.refresh;
+	if (last_present == 0 || refresh <= 0) {
+		return false;
+	}
+
+	// Skip the refresh cycles which went by without a presentation
+	int64_t next = last_present + refresh;
+	int64_t now = output_now_nsec(output);
+	if (next <= now) {
+		next += ((now - next) / refresh + 1) * refresh;
+	}
+
+	when->tv_sec = next / 1000000000;
+	when->tv_nsec = next % 1000000000;
+	return true;
+}
+
 bool wlr_output_set_gamma(struct wlr_output *output, size_t size,
 		const uint16_t *r, const uint16_t *g, const uint16_t *b) {
 	if (!output->impl->set_gamma) {
@@ -546,6 +1243,7 @@ void wlr_output_lock_software_cursors(struct wlr_output *output, bool lock) {
 			WL_OUTPUT_TRANSFORM_NORMAL, 0, 0, true);
 		output_cursor_damage_whole(output->hardware_cursor);
 		output->hardware_cursor = NULL;
+		wlr_signal_emit_safe(&output->events.hardware_cursor, output);
 	}
 
 	// If it's possible to use hardware cursors again, don't switch immediately
@@ -553,25 +1251,27 @@ void wlr_output_lock_software_cursors(struct wlr_output *output, bool lock) {
 	// again.
 }
 
-static void output_scissor(struct wlr_output *output, pixman_box32_t *rect) {
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
-
-	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
-		.width = rect->x2 - rect->x1,
-		.height = rect->y2 - rect->y1,
-	};
+void wlr_output_lock_attach_render(struct wlr_output *output, bool lock) {
+	if (lock) {
+		++output->attach_render_locks;
+	} else {
+		assert(output->attach_render_locks > 0);
+		--output->attach_render_locks;
+	}
+	wlr_log(WLR_DEBUG, "%s direct scan-out on output '%s' (locks: %d)",
+		lock ? "Disabling" : "Enabling", output->name,
+		output->attach_render_locks);
+}
 
+// Converts a damage region to buffer coordinates
+static void output_damage_to_buffer(struct wlr_output *output,
+		pixman_region32_t *damage) {
 	int ow, oh;
 	wlr_output_transformed_resolution(output, &ow, &oh);
 
 	enum wl_output_transform transform =
 		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
-
-	wlr_renderer_scissor(renderer, &box);
+	wlr_region_transform(damage, damage, transform, ow, oh);
 }
 
 static void output_cursor_get_box(struct wlr_output_cursor *cursor,
@@ -585,7 +1285,8 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 
 	struct wlr_texture *texture = cursor->texture;
 	if (cursor->surface != NULL) {
-		texture = wlr_surface_get_texture(cursor->surface);
+		texture = wlr_surface_get_texture_for_renderer(cursor->surface,
+			renderer);
 	}
 	if (texture == NULL) {
 		return;
@@ -607,13 +1308,9 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
 		cursor->output->transform_matrix);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&surface_damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		output_scissor(cursor->output, &rects[i]);
-		wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0f);
-	}
-	wlr_renderer_scissor(renderer, NULL);
+	output_damage_to_buffer(cursor->output, &surface_damage);
+	wlr_render_texture_with_matrix_region(renderer, texture, matrix, 1.0f,
+		&surface_damage);
 
 surface_damage_finish:
 	pixman_region32_fini(&surface_damage);
@@ -647,6 +1344,61 @@ void wlr_output_render_software_cursors(struct wlr_output *output,
 	pixman_region32_fini(&render_damage);
 }
 
+bool wlr_output_get_hardware_cursor_box(struct wlr_output *output,
+		struct wlr_box *box) {
+	struct wlr_output_cursor *cursor = output->hardware_cursor;
+	if (cursor == NULL || !cursor->enabled || !cursor->visible) {
+		return false;
+	}
+
+	output_cursor_get_box(cursor, box);
+
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+	wlr_box_transform(box, box, wlr_output_transform_invert(output->transform),
+		ow, oh);
+	return true;
+}
+
+void wlr_output_render_hardware_cursor(struct wlr_output *output,
+		const struct wlr_box *box) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	struct wlr_output_cursor *cursor = output->hardware_cursor;
+	if (cursor == NULL || !cursor->enabled || !cursor->visible ||
+			box->width <= 0 || box->height <= 0) {
+		return;
+	}
+
+	struct wlr_texture *texture = cursor->texture;
+	if (cursor->surface != NULL) {
+		texture = wlr_surface_get_texture_for_renderer(cursor->surface,
+			renderer);
+	}
+	if (texture == NULL) {
+		return;
+	}
+
+	// Maps the output's clip space to the part of it held by the target
+	float sx = (float)output->width / box->width;
+	float sy = (float)output->height / box->height;
+	const float crop[9] = {
+		sx, 0.0f, sx * (1.0f - 2.0f * box->x / output->width) - 1.0f,
+		0.0f, sy, 1.0f - sy * (1.0f - 2.0f * box->y / output->height),
+		0.0f, 0.0f, 1.0f,
+	};
+	float projection[9];
+	wlr_matrix_multiply(projection, crop, output->transform_matrix);
+
+	struct wlr_box cursor_box;
+	output_cursor_get_box(cursor, &cursor_box);
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &cursor_box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		projection);
+	wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0f);
+}
 
 /**
  * Returns the cursor box, scaled for its output.
@@ -703,12 +1455,45 @@ static void output_cursor_update_visible(struct wlr_output_cursor *cursor) {
 	cursor->visible = visible;
 }
 
+// Hands the pixels of the cursor surface's shm buffer to the backend, which
+// may write them to the hardware cursor without rendering
+static bool output_cursor_attempt_pixels(struct wlr_output_cursor *cursor) {
+	struct wlr_output *output = cursor->output;
+	struct wlr_surface *surface = cursor->surface;
+	if (!output->impl->set_cursor_pixels || surface == NULL ||
+			surface->buffer == NULL || surface->buffer->resource == NULL ||
+			surface->current.viewport.has_src ||
+			surface->current.viewport.has_dst ||
+			surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+			surface->current.scale != output->scale) {
+		return false;
+	}
+
+	struct wl_shm_buffer *shm_buffer =
+		wl_shm_buffer_get(surface->buffer->resource);
+	if (shm_buffer == NULL ||
+			wl_shm_buffer_get_format(shm_buffer) != WL_SHM_FORMAT_ARGB8888) {
+		return false;
+	}
+
+	wl_shm_buffer_begin_access(shm_buffer);
+	bool ok = output->impl->set_cursor_pixels(output,
+		wl_shm_buffer_get_data(shm_buffer),
+		wl_shm_buffer_get_stride(shm_buffer),
+		wl_shm_buffer_get_width(shm_buffer),
+		wl_shm_buffer_get_height(shm_buffer),
+		cursor->hotspot_x, cursor->hotspot_y);
+	wl_shm_buffer_end_access(shm_buffer);
+	return ok;
+}
+
 static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
 	int32_t scale = cursor->output->scale;
 	enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
 	struct wlr_texture *texture = cursor->texture;
 	if (cursor->surface != NULL) {
-		texture = wlr_surface_get_texture(cursor->surface);
+		texture = wlr_surface_get_texture_for_renderer(cursor->surface,
+			wlr_backend_get_renderer(cursor->output->backend));
 		scale = cursor->surface->current.scale;
 		transform = cursor->surface->current.transform;
 	}
@@ -724,15 +1509,80 @@ static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
 		assert(cursor->output->impl->move_cursor);
 		cursor->output->impl->move_cursor(cursor->output,
 			(int)cursor->x, (int)cursor->y);
-		if (cursor->output->impl->set_cursor(cursor->output, texture,
+		if (output_cursor_attempt_pixels(cursor) ||
+				cursor->output->impl->set_cursor(cursor->output, texture,
 				scale, transform, cursor->hotspot_x, cursor->hotspot_y, true)) {
 			cursor->output->hardware_cursor = cursor;
+			wlr_signal_emit_safe(&cursor->output->events.hardware_cursor,
+				cursor->output);
 			return true;
 		}
 	}
 	return false;
 }
 
+static bool output_cursor_image_matches(
+		const struct wlr_output_cursor_image *image, const uint8_t *pixels,
+		int32_t stride, uint32_t width, uint32_t height) {
+	if (image->texture == NULL || image->width != width ||
+			image->height != height) {
+		return false;
+	}
+	for (uint32_t y = 0; y < height; ++y) {
+		if (memcmp(image->pixels + y * width * 4, pixels + y * stride,
+				width * 4) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct wlr_texture *output_cursor_get_image_texture(
+		struct wlr_output_cursor *cursor, struct wlr_renderer *renderer,
+		const uint8_t *pixels, int32_t stride, uint32_t width,
+		uint32_t height) {
+	struct wlr_output_cursor_image *images = cursor->images;
+
+	size_t i = 0;
+	while (i < WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN &&
+			!output_cursor_image_matches(&images[i], pixels, stride,
+				width, height)) {
+		++i;
+	}
+
+	if (i == WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN) {
+		// Replace the least recently used image
+		i = WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN - 1;
+
+		uint8_t *copy = malloc(width * height * 4);
+		if (copy == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return NULL;
+		}
+		struct wlr_texture *texture = wlr_texture_from_pixels(renderer,
+			WL_SHM_FORMAT_ARGB8888, stride, width, height, pixels);
+		if (texture == NULL) {
+			free(copy);
+			return NULL;
+		}
+		for (uint32_t y = 0; y < height; ++y) {
+			memcpy(copy + y * width * 4, pixels + y * stride, width * 4);
+		}
+
+		wlr_texture_destroy(images[i].texture);
+		free(images[i].pixels);
+		images[i].texture = texture;
+		images[i].pixels = copy;
+		images[i].width = width;
+		images[i].height = height;
+	}
+
+	struct wlr_output_cursor_image image = images[i];
+	memmove(&images[1], &images[0], i * sizeof(images[0]));
+	images[0] = image;
+	return image.texture;
+}
+
 bool wlr_output_cursor_set_image(struct wlr_output_cursor *cursor,
 		const uint8_t *pixels, int32_t stride, uint32_t width, uint32_t height,
 		int32_t hotspot_x, int32_t hotspot_y) {
@@ -748,13 +1598,12 @@ bool wlr_output_cursor_set_image(struct wlr_output_cursor *cursor,
 	cursor->hotspot_y = hotspot_y;
 	output_cursor_update_visible(cursor);
 
-	wlr_texture_destroy(cursor->texture);
 	cursor->texture = NULL;
 
 	cursor->enabled = false;
 	if (pixels != NULL) {
-		cursor->texture = wlr_texture_from_pixels(renderer,
-			WL_SHM_FORMAT_ARGB8888, stride, width, height, pixels);
+		cursor->texture = output_cursor_get_image_texture(cursor, renderer,
+			pixels, stride, width, height);
 		if (cursor->texture == NULL) {
 			return false;
 		}
@@ -831,6 +1680,8 @@ void wlr_output_cursor_set_surface(struct wlr_output_cursor *cursor,
 			assert(cursor->output->impl->set_cursor);
 			cursor->output->impl->set_cursor(cursor->output, NULL,
 				1, WL_OUTPUT_TRANSFORM_NORMAL, hotspot_x, hotspot_y, false);
+			wlr_signal_emit_safe(&cursor->output->events.hardware_cursor,
+				cursor->output);
 		}
 		return;
 	}
@@ -856,6 +1707,8 @@ void wlr_output_cursor_set_surface(struct wlr_output_cursor *cursor,
 			assert(cursor->output->impl->set_cursor);
 			cursor->output->impl->set_cursor(cursor->output, NULL, 1,
 				WL_OUTPUT_TRANSFORM_NORMAL, 0, 0, true);
+			wlr_signal_emit_safe(&cursor->output->events.hardware_cursor,
+				cursor->output);
 		}
 	}
 }
@@ -888,7 +1741,12 @@ bool wlr_output_cursor_move(struct wlr_output_cursor *cursor,
 	}
 
 	assert(cursor->output->impl->move_cursor);
-	return cursor->output->impl->move_cursor(cursor->output, (int)x, (int)y);
+	if (!cursor->output->impl->move_cursor(cursor->output, (int)x, (int)y)) {
+		return false;
+	}
+	wlr_signal_emit_safe(&cursor->output->events.hardware_cursor,
+		cursor->output);
+	return true;
 }
 
 struct wlr_output_cursor *wlr_output_cursor_create(struct wlr_output *output) {
@@ -921,8 +1779,13 @@ void wlr_output_cursor_destroy(struct wlr_output_cursor *cursor) {
 				WL_OUTPUT_TRANSFORM_NORMAL, 0, 0, true);
 		}
 		cursor->output->hardware_cursor = NULL;
+		wlr_signal_emit_safe(&cursor->output->events.hardware_cursor,
+			cursor->output);
+	}
+	for (size_t i = 0; i < WLR_OUTPUT_CURSOR_IMAGE_CACHE_LEN; ++i) {
+		wlr_texture_destroy(cursor->images[i].texture);
+		free(cursor->images[i].pixels);
 	}
-	wlr_texture_destroy(cursor->texture);
 	wl_list_remove(&cursor->link);
 	free(cursor);
 }
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wlr/types/wlr_output_content_rate.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+// Largest deviation of an interval from the average, in percent. Leaves room
+// for the 3:2 pattern of a 24 fps client woken up by a 60 Hz output.
+#define INTERVAL_TOLERANCE 25
+// Changes of the measured rate smaller than this, in percent, are ignored
+#define RATE_TOLERANCE 2
+// Largest difference between a refresh rate and a multiple of the content
+// rate, in tenths of a percent
+#define REFRESH_TOLERANCE 5
+
+static int64_t timespec_to_nsec(const struct timespec *t) {
+	return (int64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
+
+static bool refresh_fits(int32_t refresh, int32_t content_rate) {
+	if (refresh <= 0) {
+		return false;
+	}
+	int32_t k = (refresh + content_rate / 2) / content_rate;
+	if (k < 1) {
+		return false;
+	}
+	int64_t target = (int64_t)k * content_rate;
+	return llabs(refresh - target) * 1000 <= target * REFRESH_TOLERANCE;
+}
+
+static void set_mode(struct wlr_output_content_rate *content_rate,
+		struct wlr_output_mode *mode) {
+	struct wlr_output *output = content_rate->output;
+	wlr_log(WLR_DEBUG, "Switching output '%s' to %"PRId32"x%"PRId32
+		"@%"PRId32" for %"PRId32" mHz content", output->name, mode->width,
+		mode->height, mode->refresh, content_rate->content_rate);
+	content_rate->switching = true;
+	if (!wlr_output_set_mode(output, mode)) {
+		wlr_log(WLR_ERROR, "Failed to set mode of output '%s'", output->name);
+	}
+	content_rate->switching = false;
+}
+
+static void restore_mode(struct wlr_output_content_rate *content_rate) {
+	struct wlr_output_mode *mode = content_rate->restore_mode;
+	if (mode == NULL) {
+		return;
+	}
+	content_rate->restore_mode = NULL;
+	if (mode != content_rate->output->current_mode) {
+		set_mode(content_rate, mode);
+	}
+}
+
+static void update_mode(struct wlr_output_content_rate *content_rate) {
+	struct wlr_output *output = content_rate->output;
+	if (content_rate->content_rate == 0 || !output->enabled) {
+		restore_mode(content_rate);
+		return;
+	}
+
+	struct wlr_output_mode *base = content_rate->restore_mode != NULL ?
+		content_rate->restore_mode : output->current_mode;
+	if (base == NULL) {
+		return;
+	}
+	if (refresh_fits(base->refresh, content_rate->content_rate)) {
+		restore_mode(content_rate);
+		return;
+	}
+
+	struct wlr_output_mode *mode, *best = NULL;
+	wl_list_for_each(mode, &output->modes, link) {
+		if (mode->width != base->width || mode->height != base->height ||
+				!refresh_fits(mode->refresh, content_rate->content_rate)) {
+			continue;
+		}
+		if (best == NULL || mode->refresh > best->refresh) {
+			best = mode;
+		}
+	}
+	if (best == NULL) {
+		restore_mode(content_rate);
+		return;
+	}
+
+	if (content_rate->restore_mode == NULL) {
+		content_rate->restore_mode = base;
+	}
+	if (best != output->current_mode) {
+		set_mode(content_rate, best);
+	}
+}
+
+// Returns the frame rate of the last commits in mHz, 0 if irregular
+static int32_t measure_content_rate(
+		struct wlr_output_content_rate *content_rate) {
+	const size_t len = WLR_OUTPUT_CONTENT_RATE_SAMPLES;
+	size_t oldest = content_rate->commits_idx;
+	size_t newest = (content_rate->commits_idx + len - 1) % len;
+	int64_t span = timespec_to_nsec(&content_rate->commits[newest]) -
+		timespec_to_nsec(&content_rate->commits[oldest]);
+	if (span <= 0) {
+		return 0;
+	}
+	int64_t avg = span / (len - 1);
+
+	for (size_t i = 1; i < len; ++i) {
+		size_t prev = (oldest + i - 1) % len;
+		size_t cur = (oldest + i) % len;
+		int64_t interval = timespec_to_nsec(&content_rate->commits[cur]) -
+			timespec_to_nsec(&content_rate->commits[prev]);
+		if (llabs(interval - avg) * 100 > avg * INTERVAL_TOLERANCE) {
+			return 0;
+		}
+	}
+
+	return (int32_t)((int64_t)(len - 1) * 1000000000000 / span);
+}
+
+static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	struct wlr_output_content_rate *content_rate =
+		wl_container_of(listener, content_rate, surface_commit);
+	struct wlr_surface *surface = content_rate->surface;
+	if (!(surface->current.committed & WLR_SURFACE_STATE_BUFFER) ||
+			!wlr_surface_has_buffer(surface)) {
+		return;
+	}
+
+	const size_t len = WLR_OUTPUT_CONTENT_RATE_SAMPLES;
+	clock_gettime(CLOCK_MONOTONIC,
+		&content_rate->commits[content_rate->commits_idx]);
+	content_rate->commits_idx = (content_rate->commits_idx + 1) % len;
+	if (content_rate->commits_len < len) {
+		content_rate->commits_len++;
+		return;
+	}
+
+	int32_t rate = measure_content_rate(content_rate);
+	int32_t prev = content_rate->content_rate;
+	if ((rate == 0) == (prev == 0) &&
+			abs(rate - prev) * 100 <= prev * RATE_TOLERANCE) {
+		return;
+	}
+	content_rate->content_rate = rate;
+	update_mode(content_rate);
+}
+
+static void handle_surface_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_output_content_rate *content_rate =
+		wl_container_of(listener, content_rate, surface_destroy);
+	wlr_output_content_rate_set_surface(content_rate, NULL);
+}
+
+static void handle_output_mode(struct wl_listener *listener, void *data) {
+	struct wlr_output_content_rate *content_rate =
+		wl_container_of(listener, content_rate, output_mode);
+	if (!content_rate->switching) {
+		// The compositor picked another mode, leave it alone
+		content_rate->restore_mode = NULL;
+	}
+}
+
+static void handle_output_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_output_content_rate *content_rate =
+		wl_container_of(listener, content_rate, output_destroy);
+	content_rate->restore_mode = NULL;
+	wlr_output_content_rate_destroy(content_rate);
+}
+
+struct wlr_output_content_rate *wlr_output_content_rate_create(
+		struct wlr_output *output) {
+	struct wlr_output_content_rate *content_rate =
+		calloc(1, sizeof(struct wlr_output_content_rate));
+	if (content_rate == NULL) {
+		return NULL;
+	}
+	content_rate->output = output;
+	wl_signal_init(&content_rate->events.destroy);
+	wl_list_init(&content_rate->surface_commit.link);
+	wl_list_init(&content_rate->surface_destroy.link);
+
+	wl_signal_add(&output->events.mode, &content_rate->output_mode);
+	content_rate->output_mode.notify = handle_output_mode;
+	wl_signal_add(&output->events.destroy, &content_rate->output_destroy);
+	content_rate->output_destroy.notify = handle_output_destroy;
+
+	return content_rate;
+}
+
+void wlr_output_content_rate_destroy(
+		struct wlr_output_content_rate *content_rate) {
+	if (content_rate == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&content_rate->events.destroy, content_rate);
+	wlr_output_content_rate_set_surface(content_rate, NULL);
+	wl_list_remove(&content_rate->output_mode.link);
+	wl_list_remove(&content_rate->output_destroy.link);
+	free(content_rate);
+}
+
+void wlr_output_content_rate_set_surface(
+		struct wlr_output_content_rate *content_rate,
+		struct wlr_surface *surface) {
+	if (content_rate->surface == surface) {
+		return;
+	}
+
+	wl_list_remove(&content_rate->surface_commit.link);
+	wl_list_init(&content_rate->surface_commit.link);
+	wl_list_remove(&content_rate->surface_destroy.link);
+	wl_list_init(&content_rate->surface_destroy.link);
+	content_rate->surface = surface;
+	content_rate->commits_len = content_rate->commits_idx = 0;
+	content_rate->content_rate = 0;
+	restore_mode(content_rate);
+
+	if (surface != NULL) {
+		wl_signal_add(&surface->events.commit, &content_rate->surface_commit);
+		content_rate->surface_commit.notify = handle_surface_commit;
+		wl_signal_add(&surface->events.destroy,
+			&content_rate->surface_destroy);
+		content_rate->surface_destroy.notify = handle_surface_destroy;
+	}
+}
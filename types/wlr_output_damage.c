@@ -1,11 +1,176 @@
+#include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wayland-server.h>
+#include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include "util/signal.h"
+#include "util/trace.h"
+
+static void output_damage_flush_tiles(
+		struct wlr_output_damage *output_damage) {
+	if (!output_damage->tiles_dirty) {
+		return;
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+
+	// One box per horizontal run of damaged tiles, pixman coalesces rows
+	size_t boxes_cap = 16, boxes_len = 0;
+	pixman_box32_t *boxes = malloc(boxes_cap * sizeof(pixman_box32_t));
+	if (boxes == NULL) {
+		wlr_output_damage_add_whole(output_damage);
+		goto out;
+	}
+
+	int tile_size = output_damage->tile_size;
+	for (int y = 0; y < output_damage->tiles_height; ++y) {
+		uint64_t *row = &output_damage->tiles[y * output_damage->tiles_stride];
+		int run_start = -1;
+		for (int x = 0; x <= output_damage->tiles_width; ++x) {
+			bool set = false;
+			if (x < output_damage->tiles_width) {
+				uint64_t word = row[x / 64];
+				if (word == 0 && run_start < 0) {
+					// Skip the rest of an empty word
+					x += 63 - x % 64;
+					continue;
+				}
+				set = word & ((uint64_t)1 << (x % 64));
+			}
+
+			if (set && run_start < 0) {
+				run_start = x;
+			} else if (!set && run_start >= 0) {
+				if (boxes_len == boxes_cap) {
+					boxes_cap *= 2;
+					pixman_box32_t *new_boxes =
+						realloc(boxes, boxes_cap * sizeof(pixman_box32_t));
+					if (new_boxes == NULL) {
+						free(boxes);
+						wlr_output_damage_add_whole(output_damage);
+						goto out;
+					}
+					boxes = new_boxes;
+				}
+				boxes[boxes_len++] = (pixman_box32_t){
+					.x1 = run_start * tile_size,
+					.y1 = y * tile_size,
+					.x2 = x * tile_size,
+					.y2 = (y + 1) * tile_size,
+				};
+				run_start = -1;
+			}
+		}
+	}
+
+	pixman_region32_t tiles_damage;
+	pixman_region32_init_rects(&tiles_damage, boxes, boxes_len);
+	pixman_region32_intersect_rect(&tiles_damage, &tiles_damage,
+		0, 0, width, height);
+	pixman_region32_union(&output_damage->current, &output_damage->current,
+		&tiles_damage);
+	pixman_region32_fini(&tiles_damage);
+	free(boxes);
+
+out:
+	memset(output_damage->tiles, 0, output_damage->tiles_height *
+		output_damage->tiles_stride * sizeof(uint64_t));
+	output_damage->tiles_dirty = false;
+}
+
+static void output_damage_add_tiles(struct wlr_output_damage *output_damage,
+		const pixman_box32_t *box) {
+	int tile_size = output_damage->tile_size;
+	int x1 = box->x1 < 0 ? 0 : box->x1 / tile_size;
+	int y1 = box->y1 < 0 ? 0 : box->y1 / tile_size;
+	int x2 = (box->x2 + tile_size - 1) / tile_size;
+	int y2 = (box->y2 + tile_size - 1) / tile_size;
+	if (x2 > output_damage->tiles_width) {
+		x2 = output_damage->tiles_width;
+	}
+	if (y2 > output_damage->tiles_height) {
+		y2 = output_damage->tiles_height;
+	}
+	if (box->x2 <= 0 || box->y2 <= 0 || x1 >= x2 || y1 >= y2) {
+		return;
+	}
+
+	// Set bits [x1, x2) of each row a whole word at a time
+	size_t first = x1 / 64, last = (x2 - 1) / 64;
+	uint64_t first_mask = ~(uint64_t)0 << (x1 % 64);
+	uint64_t last_mask = ~(uint64_t)0 >> (63 - (x2 - 1) % 64);
+	for (int y = y1; y < y2; ++y) {
+		uint64_t *row = &output_damage->tiles[y * output_damage->tiles_stride];
+		if (first == last) {
+			row[first] |= first_mask & last_mask;
+			continue;
+		}
+		row[first] |= first_mask;
+		for (size_t i = first + 1; i < last; ++i) {
+			row[i] = ~(uint64_t)0;
+		}
+		row[last] |= last_mask;
+	}
+	output_damage->tiles_dirty = true;
+}
+
+static bool output_damage_alloc_tiles(struct wlr_output_damage *output_damage) {
+	output_damage_flush_tiles(output_damage);
+	free(output_damage->tiles);
+	output_damage->tiles = NULL;
+	output_damage->tiles_width = output_damage->tiles_height = 0;
+	output_damage->tiles_stride = 0;
+
+	int tile_size = output_damage->tile_size;
+	if (tile_size <= 0) {
+		return true;
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+	int tiles_width = (width + tile_size - 1) / tile_size;
+	int tiles_height = (height + tile_size - 1) / tile_size;
+	size_t stride = (tiles_width + 63) / 64;
+	if (tiles_height == 0 || stride == 0) {
+		return true;
+	}
+
+	output_damage->tiles = calloc(tiles_height * stride, sizeof(uint64_t));
+	if (output_damage->tiles == NULL) {
+		return false;
+	}
+	output_damage->tiles_width = tiles_width;
+	output_damage->tiles_height = tiles_height;
+	output_damage->tiles_stride = stride;
+	return true;
+}
+
+static void output_damage_resize_tiles(
+		struct wlr_output_damage *output_damage) {
+	if (output_damage->tile_size > 0 &&
+			!output_damage_alloc_tiles(output_damage)) {
+		wlr_log(WLR_ERROR, "Failed to allocate damage tiles, "
+			"falling back to region damage");
+		output_damage->tile_size = 0;
+	}
+}
+
+static void output_damage_wake_idle_refresh(
+		struct wlr_output_damage *output_damage) {
+	if (output_damage->idle_refresh.idle &&
+			!output_damage->idle_refresh.switching) {
+		output_damage->idle_refresh.wake = true;
+	}
+}
 
 static void output_handle_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_output_damage *output_damage =
@@ -16,18 +181,21 @@ static void output_handle_destroy(struct wl_listener *listener, void *data) {
 static void output_handle_mode(struct wl_listener *listener, void *data) {
 	struct wlr_output_damage *output_damage =
 		wl_container_of(listener, output_damage, output_mode);
+	output_damage_resize_tiles(output_damage);
 	wlr_output_damage_add_whole(output_damage);
 }
 
 static void output_handle_transform(struct wl_listener *listener, void *data) {
 	struct wlr_output_damage *output_damage =
 		wl_container_of(listener, output_damage, output_transform);
+	output_damage_resize_tiles(output_damage);
 	wlr_output_damage_add_whole(output_damage);
 }
 
 static void output_handle_scale(struct wl_listener *listener, void *data) {
 	struct wlr_output_damage *output_damage =
 		wl_container_of(listener, output_damage, output_scale);
+	output_damage_resize_tiles(output_damage);
 	wlr_output_damage_add_whole(output_damage);
 }
 
@@ -36,9 +204,108 @@ static void output_handle_needs_swap(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, output_damage, output_needs_swap);
 	pixman_region32_union(&output_damage->current, &output_damage->current,
 		&output_damage->output->damage);
+	output_damage_wake_idle_refresh(output_damage);
 	wlr_output_schedule_frame(output_damage->output);
 }
 
+static void output_handle_hardware_cursor(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_damage *output_damage =
+		wl_container_of(listener, output_damage, output_hardware_cursor);
+	if (output_damage->idle_refresh.idle) {
+		output_damage_wake_idle_refresh(output_damage);
+		wlr_output_schedule_frame(output_damage->output);
+	}
+}
+
+static struct wlr_output_mode *find_idle_mode(struct wlr_output *output) {
+	struct wlr_output_mode *current = output->current_mode;
+	struct wlr_output_mode *best = NULL, *mode;
+	wl_list_for_each(mode, &output->modes, link) {
+		if (mode->width != current->width ||
+				mode->height != current->height ||
+				mode->refresh <= 0 || mode->refresh >= current->refresh) {
+			continue;
+		}
+		if (best == NULL || mode->refresh < best->refresh) {
+			best = mode;
+		}
+	}
+	return best;
+}
+
+static void output_damage_enter_idle_refresh(
+		struct wlr_output_damage *output_damage) {
+	struct wlr_output *output = output_damage->output;
+
+	output_damage->idle_refresh.switching = true;
+	if (output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) {
+		// Without new frames, the display already drops to its minimum rate
+	} else if (wlr_output_enable_adaptive_sync(output, true)) {
+		output_damage->idle_refresh.adaptive_sync = true;
+	} else if (output->current_mode != NULL) {
+		struct wlr_output_mode *restore_mode = output->current_mode;
+		struct wlr_output_mode *idle_mode = find_idle_mode(output);
+		if (idle_mode != NULL && wlr_output_set_mode(output, idle_mode)) {
+			output_damage->idle_refresh.idle_mode = idle_mode;
+			output_damage->idle_refresh.restore_mode = restore_mode;
+		}
+	}
+	output_damage->idle_refresh.switching = false;
+
+	output_damage->idle_refresh.idle = true;
+	output_damage->idle_refresh.wake = false;
+	wlr_log(WLR_DEBUG, "Output %s is idle, lowering its refresh rate",
+		output->name);
+}
+
+static void output_damage_leave_idle_refresh(
+		struct wlr_output_damage *output_damage) {
+	struct wlr_output *output = output_damage->output;
+	if (!output_damage->idle_refresh.idle) {
+		return;
+	}
+
+	// Leave the output alone if the compositor changed it in the meantime
+	output_damage->idle_refresh.switching = true;
+	if (output_damage->idle_refresh.adaptive_sync &&
+			output->adaptive_sync_status ==
+			WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) {
+		wlr_output_enable_adaptive_sync(output, false);
+	}
+	if (output_damage->idle_refresh.idle_mode != NULL && output->enabled &&
+			output->current_mode == output_damage->idle_refresh.idle_mode) {
+		wlr_output_set_mode(output, output_damage->idle_refresh.restore_mode);
+	}
+	output_damage->idle_refresh.switching = false;
+
+	output_damage->idle_refresh.idle = false;
+	output_damage->idle_refresh.wake = false;
+	output_damage->idle_refresh.adaptive_sync = false;
+	output_damage->idle_refresh.idle_mode = NULL;
+	output_damage->idle_refresh.restore_mode = NULL;
+	wlr_log(WLR_DEBUG, "Output %s is active, restoring its refresh rate",
+		output->name);
+}
+
+static int handle_idle_refresh_timer(void *data) {
+	struct wlr_output_damage *output_damage = data;
+	struct wlr_output *output = output_damage->output;
+	if (!output->enabled || output->dpms_off ||
+			output_damage->idle_refresh.idle) {
+		return 0;
+	}
+	if (output->frame_pending || output_damage->tiles_dirty ||
+			pixman_region32_not_empty(&output_damage->current)) {
+		// Still busy, check again later
+		wl_event_source_timer_update(output_damage->idle_refresh.timer,
+			output_damage->idle_refresh.timeout);
+		return 0;
+	}
+	output_damage_enter_idle_refresh(output_damage);
+	return 0;
+}
+
 static void output_handle_frame(struct wl_listener *listener, void *data) {
 	struct wlr_output_damage *output_damage =
 		wl_container_of(listener, output_damage, output_frame);
@@ -47,6 +314,10 @@ static void output_handle_frame(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	if (output_damage->idle_refresh.wake) {
+		output_damage_leave_idle_refresh(output_damage);
+	}
+
 	wlr_signal_emit_safe(&output_damage->events.frame, output_damage);
 }
 
@@ -60,11 +331,15 @@ struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 	output_damage->output = output;
 	output_damage->max_rects = 20;
 	wl_signal_init(&output_damage->events.frame);
+	wl_signal_init(&output_damage->events.degraded);
 	wl_signal_init(&output_damage->events.destroy);
 
 	pixman_region32_init(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
-		pixman_region32_init(&output_damage->previous[i]);
+	if (!wlr_output_damage_set_previous_len(output_damage,
+			WLR_OUTPUT_DAMAGE_PREVIOUS_LEN)) {
+		pixman_region32_fini(&output_damage->current);
+		free(output_damage);
+		return NULL;
 	}
 
 	wl_signal_add(&output->events.destroy, &output_damage->output_destroy);
@@ -79,6 +354,11 @@ struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 	output_damage->output_needs_swap.notify = output_handle_needs_swap;
 	wl_signal_add(&output->events.frame, &output_damage->output_frame);
 	output_damage->output_frame.notify = output_handle_frame;
+	wl_signal_add(&output->events.hardware_cursor,
+		&output_damage->output_hardware_cursor);
+	output_damage->output_hardware_cursor.notify =
+		output_handle_hardware_cursor;
+	wl_list_init(&output_damage->output_frame_stats.link);
 
 	return output_damage;
 }
@@ -94,24 +374,326 @@ void wlr_output_damage_destroy(struct wlr_output_damage *output_damage) {
 	wl_list_remove(&output_damage->output_scale.link);
 	wl_list_remove(&output_damage->output_needs_swap.link);
 	wl_list_remove(&output_damage->output_frame.link);
+	wl_list_remove(&output_damage->output_hardware_cursor.link);
+	wl_list_remove(&output_damage->output_frame_stats.link);
+	if (output_damage->idle_refresh.timer != NULL) {
+		wl_event_source_remove(output_damage->idle_refresh.timer);
+	}
 	pixman_region32_fini(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < output_damage->previous_len; ++i) {
 		pixman_region32_fini(&output_damage->previous[i]);
 	}
+	free(output_damage->previous);
+	free(output_damage->tiles);
+	if (output_damage->debug.enabled) {
+		for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_DEBUG_FRAMES; ++i) {
+			pixman_region32_fini(&output_damage->debug.frames[i]);
+		}
+	}
 	free(output_damage);
 }
 
+bool wlr_output_damage_set_previous_len(struct wlr_output_damage *output_damage,
+		size_t len) {
+	if (len == output_damage->previous_len) {
+		return true;
+	}
+
+	pixman_region32_t *previous = calloc(len, sizeof(pixman_region32_t));
+	if (len > 0 && previous == NULL) {
+		return false;
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+
+	// Keep the most recent frames, and consider older ones fully damaged
+	for (size_t i = 0; i < len; ++i) {
+		if (i < output_damage->previous_len) {
+			size_t j = (output_damage->previous_idx + i) %
+				output_damage->previous_len;
+			pixman_region32_init(&previous[i]);
+			pixman_region32_copy(&previous[i], &output_damage->previous[j]);
+		} else {
+			pixman_region32_init_rect(&previous[i], 0, 0, width, height);
+		}
+	}
+
+	for (size_t i = 0; i < output_damage->previous_len; ++i) {
+		pixman_region32_fini(&output_damage->previous[i]);
+	}
+	free(output_damage->previous);
+
+	output_damage->previous = previous;
+	output_damage->previous_len = len;
+	output_damage->previous_idx = 0;
+	return true;
+}
+
+bool wlr_output_damage_set_tile_size(struct wlr_output_damage *output_damage,
+		int tile_size) {
+	if (tile_size < 0) {
+		tile_size = 0;
+	}
+	if (tile_size == output_damage->tile_size) {
+		return true;
+	}
+
+	output_damage_flush_tiles(output_damage);
+	output_damage->tile_size = tile_size;
+	if (!output_damage_alloc_tiles(output_damage)) {
+		output_damage->tile_size = 0;
+		return false;
+	}
+	return true;
+}
+
+void wlr_output_damage_enable_debug(struct wlr_output_damage *output_damage,
+		bool enabled) {
+	if (output_damage->debug.enabled == enabled) {
+		return;
+	}
+	output_damage->debug.enabled = enabled;
+	output_damage->debug.frames_idx = 0;
+	output_damage->debug.area_len = 0;
+	output_damage->debug.area_idx = 0;
+
+	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_DEBUG_FRAMES; ++i) {
+		if (enabled) {
+			pixman_region32_init(&output_damage->debug.frames[i]);
+		} else {
+			pixman_region32_fini(&output_damage->debug.frames[i]);
+		}
+	}
+
+	// Repaint the whole output to show or hide the overlay
+	wlr_output_damage_add_whole(output_damage);
+}
+
+static void output_damage_record_debug(
+		struct wlr_output_damage *output_damage) {
+	// same as decrementing, but works on unsigned integers
+	output_damage->debug.frames_idx += WLR_OUTPUT_DAMAGE_DEBUG_FRAMES - 1;
+	output_damage->debug.frames_idx %= WLR_OUTPUT_DAMAGE_DEBUG_FRAMES;
+	pixman_region32_copy(
+		&output_damage->debug.frames[output_damage->debug.frames_idx],
+		&output_damage->current);
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+
+	// Rectangles of a region don't overlap
+	int64_t area = 0;
+	int n_rects;
+	pixman_box32_t *rects =
+		pixman_region32_rectangles(&output_damage->current, &n_rects);
+	for (int i = 0; i < n_rects; ++i) {
+		area += (int64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+
+	size_t idx = output_damage->debug.area_idx;
+	output_damage->debug.area[idx] =
+		width > 0 && height > 0 ? (float)area / ((int64_t)width * height) : 0;
+	output_damage->debug.area_idx = (idx + 1) % WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN;
+	if (output_damage->debug.area_len < WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN) {
+		output_damage->debug.area_len++;
+	}
+}
+
+// Returns true if the overlay still shows damage which hasn't faded out
+static bool output_damage_debug_fading(
+		struct wlr_output_damage *output_damage) {
+	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_DEBUG_FRAMES; ++i) {
+		if (pixman_region32_not_empty(&output_damage->debug.frames[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void wlr_output_damage_render_debug(struct wlr_output_damage *output_damage,
+		struct wlr_renderer *renderer) {
+	if (!output_damage->debug.enabled) {
+		return;
+	}
+	struct wlr_output *output = output_damage->output;
+	wlr_renderer_scissor(renderer, NULL);
+
+	// Oldest first, overlapping damage adds up to a brighter red
+	for (size_t i = WLR_OUTPUT_DAMAGE_DEBUG_FRAMES; i-- > 0;) {
+		size_t j = (output_damage->debug.frames_idx + i) %
+			WLR_OUTPUT_DAMAGE_DEBUG_FRAMES;
+		float alpha = 0.3f * (WLR_OUTPUT_DAMAGE_DEBUG_FRAMES - i) /
+			WLR_OUTPUT_DAMAGE_DEBUG_FRAMES;
+		const float color[4] = { alpha, 0, 0, alpha }; // premultiplied
+
+		int n_rects;
+		pixman_box32_t *rects = pixman_region32_rectangles(
+			&output_damage->debug.frames[j], &n_rects);
+		for (int k = 0; k < n_rects; ++k) {
+			struct wlr_box box = {
+				.x = rects[k].x1,
+				.y = rects[k].y1,
+				.width = rects[k].x2 - rects[k].x1,
+				.height = rects[k].y2 - rects[k].y1,
+			};
+			wlr_render_rect(renderer, &box, color, output->transform_matrix);
+		}
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output, &width, &height);
+	const int bar_width = 2, graph_height = 64, margin = 8;
+	struct wlr_box graph_box = {
+		.x = margin,
+		.y = height - graph_height - margin,
+		.width = WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN * bar_width,
+		.height = graph_height,
+	};
+	const float background[4] = { 0, 0, 0, 0.6f };
+	wlr_render_rect(renderer, &graph_box, background, output->transform_matrix);
+
+	// Most recent frame on the right
+	size_t len = output_damage->debug.area_len;
+	for (size_t i = 0; i < len; ++i) {
+		size_t j = (output_damage->debug.area_idx +
+			WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN - len + i) %
+			WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN;
+		float area = output_damage->debug.area[j];
+		int bar_height = ceilf(area * graph_height);
+		if (bar_height == 0) {
+			continue;
+		}
+		struct wlr_box box = {
+			.x = graph_box.x + (WLR_OUTPUT_DAMAGE_DEBUG_GRAPH_LEN - len + i) *
+				bar_width,
+			.y = graph_box.y + graph_height - bar_height,
+			.width = bar_width,
+			.height = bar_height,
+		};
+		const float full[4] = { 1, 0, 0, 1 };
+		const float partial[4] = { 0, 1, 0, 1 };
+		wlr_render_rect(renderer, &box, area >= 0.99f ? full : partial,
+			output->transform_matrix);
+	}
+}
+
+static void output_damage_set_degraded(struct wlr_output_damage *output_damage,
+		bool degraded) {
+	if (output_damage->degraded == degraded) {
+		return;
+	}
+	output_damage->degraded = degraded;
+	wlr_log(WLR_DEBUG, "Output %s render time %s budget",
+		output_damage->output->name, degraded ? "over" : "back within");
+	wlr_signal_emit_safe(&output_damage->events.degraded, output_damage);
+}
+
+static void output_handle_frame_stats(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_damage *output_damage =
+		wl_container_of(listener, output_damage, output_frame_stats);
+	struct wlr_output_event_frame_stats *event = data;
+	if (output_damage->render_time.budget == 0) {
+		return;
+	}
+
+	// The frame is as slow as the slowest of the CPU and the GPU
+	size_t idx = output_damage->render_time.samples_idx;
+	output_damage->render_time.samples[idx] =
+		event->gpu_time > event->cpu_time ? event->gpu_time : event->cpu_time;
+	output_damage->render_time.samples_idx =
+		(idx + 1) % WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES;
+	if (output_damage->render_time.samples_len <
+			WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES) {
+		output_damage->render_time.samples_len++;
+	}
+
+	// Wait for a full window so that a single slow frame doesn't count
+	size_t len = output_damage->render_time.samples_len;
+	if (len < WLR_OUTPUT_DAMAGE_BUDGET_SAMPLES) {
+		return;
+	}
+	int64_t sum = 0;
+	for (size_t i = 0; i < len; ++i) {
+		sum += output_damage->render_time.samples[i];
+	}
+	int64_t avg = sum / (int64_t)len;
+
+	int64_t budget = output_damage->render_time.budget;
+	if (avg > budget) {
+		output_damage_set_degraded(output_damage, true);
+	} else if (avg < budget * 3 / 4) {
+		output_damage_set_degraded(output_damage, false);
+	}
+}
+
+void wlr_output_damage_set_render_budget(
+		struct wlr_output_damage *output_damage, int64_t budget) {
+	if (budget < 0) {
+		budget = 0;
+	}
+	output_damage->render_time.budget = budget;
+	output_damage->render_time.samples_len = 0;
+	output_damage->render_time.samples_idx = 0;
+	output_damage_set_degraded(output_damage, false);
+	// Frame statistics may have other users, they are left enabled
+	if (budget > 0 && wl_list_empty(&output_damage->output_frame_stats.link)) {
+		wl_signal_add(&output_damage->output->events.frame_stats,
+			&output_damage->output_frame_stats);
+		output_damage->output_frame_stats.notify = output_handle_frame_stats;
+		wlr_output_enable_frame_stats(output_damage->output, true);
+	}
+}
+
+bool wlr_output_damage_set_idle_refresh(
+		struct wlr_output_damage *output_damage, int timeout) {
+	if (timeout < 0) {
+		timeout = 0;
+	}
+
+	if (timeout > 0 && output_damage->idle_refresh.timer == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(output_damage->output->display);
+		output_damage->idle_refresh.timer = wl_event_loop_add_timer(loop,
+			handle_idle_refresh_timer, output_damage);
+		if (output_damage->idle_refresh.timer == NULL) {
+			return false;
+		}
+	}
+
+	output_damage->idle_refresh.timeout = timeout;
+	if (timeout == 0) {
+		output_damage_leave_idle_refresh(output_damage);
+	}
+	if (output_damage->idle_refresh.timer != NULL) {
+		wl_event_source_timer_update(output_damage->idle_refresh.timer,
+			timeout);
+	}
+	return true;
+}
+
 bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		bool *needs_swap, pixman_region32_t *damage) {
 	struct wlr_output *output = output_damage->output;
 
+	output_damage_flush_tiles(output_damage);
+
 	int buffer_age = -1;
 	if (!wlr_output_make_current(output, &buffer_age)) {
 		return false;
 	}
+	output_damage->buffer_age = buffer_age > 0 ? buffer_age : 0;
+
+	if (output_damage->debug.enabled) {
+		output_damage_record_debug(output_damage);
+	}
 
-	// Check if we can use damage tracking
-	if (buffer_age <= 0 || buffer_age - 1 > WLR_OUTPUT_DAMAGE_PREVIOUS_LEN) {
+	// Check if we can use damage tracking, the debug overlay needs to be
+	// repainted as it fades out
+	if (output_damage->debug.enabled || buffer_age <= 0 ||
+			(size_t)buffer_age - 1 > output_damage->previous_len) {
 		int width, height;
 		wlr_output_transformed_resolution(output, &width, &height);
 
@@ -123,19 +705,24 @@ bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		// Accumulate damage from old buffers
 		size_t idx = output_damage->previous_idx;
 		for (int i = 0; i < buffer_age - 1; ++i) {
-			int j = (idx + i) % WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+			size_t j = (idx + i) % output_damage->previous_len;
 			pixman_region32_union(damage, damage, &output_damage->previous[j]);
 		}
 
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > output_damage->max_rects) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage, extents->x1, extents->y1,
-				extents->x2 - extents->x1, extents->y2 - extents->y1);
+		// Limit the number of rectangles, without falling back to the
+		// extents when the damage is scattered
+		int max_rects = output_damage->max_rects;
+		if (output_damage->degraded) {
+			// Fewer, larger rectangles cost fewer draw calls
+			max_rects = max_rects / 4 > 0 ? max_rects / 4 : 1;
 		}
+		wlr_region_simplify(damage, damage, max_rects);
 	}
 
+	// Only the damaged region is going to be redrawn, let tilers skip loading
+	// the rest of the buffer
+	wlr_output_set_damage_region(output, damage);
+
 	*needs_swap = output->needs_swap || pixman_region32_not_empty(damage);
 	return true;
 }
@@ -146,19 +733,54 @@ bool wlr_output_damage_swap_buffers(struct wlr_output_damage *output_damage,
 		return false;
 	}
 
-	// same as decrementing, but works on unsigned integers
-	output_damage->previous_idx += WLR_OUTPUT_DAMAGE_PREVIOUS_LEN - 1;
-	output_damage->previous_idx %= WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+	// Tiles damaged while rendering are recorded with this frame's damage,
+	// as they would be without tiles
+	output_damage_flush_tiles(output_damage);
 
-	pixman_region32_copy(&output_damage->previous[output_damage->previous_idx],
-		&output_damage->current);
+	if (output_damage->previous_len > 0) {
+		// same as decrementing, but works on unsigned integers
+		output_damage->previous_idx += output_damage->previous_len - 1;
+		output_damage->previous_idx %= output_damage->previous_len;
+
+		pixman_region32_copy(
+			&output_damage->previous[output_damage->previous_idx],
+			&output_damage->current);
+	}
 	pixman_region32_clear(&output_damage->current);
 
+	if (output_damage->idle_refresh.timeout > 0 &&
+			!output_damage->idle_refresh.idle) {
+		wl_event_source_timer_update(output_damage->idle_refresh.timer,
+			output_damage->idle_refresh.timeout);
+	}
+
+	if (output_damage->debug.enabled &&
+			output_damage_debug_fading(output_damage)) {
+		wlr_output_schedule_frame(output_damage->output);
+	}
+
 	return true;
 }
 
 void wlr_output_damage_add(struct wlr_output_damage *output_damage,
 		pixman_region32_t *damage) {
+	wlr_trace(output_damage_add, output_damage->output,
+		pixman_region32_n_rects(damage));
+
+	if (pixman_region32_not_empty(damage)) {
+		output_damage_wake_idle_refresh(output_damage);
+	}
+
+	if (output_damage->tiles != NULL) {
+		int n_rects;
+		pixman_box32_t *rects = pixman_region32_rectangles(damage, &n_rects);
+		for (int i = 0; i < n_rects; ++i) {
+			output_damage_add_tiles(output_damage, &rects[i]);
+		}
+		wlr_output_schedule_frame(output_damage->output);
+		return;
+	}
+
 	int width, height;
 	wlr_output_transformed_resolution(output_damage->output, &width, &height);
 
@@ -170,6 +792,10 @@ void wlr_output_damage_add(struct wlr_output_damage *output_damage,
 }
 
 void wlr_output_damage_add_whole(struct wlr_output_damage *output_damage) {
+	wlr_trace(output_damage_add_whole, output_damage->output);
+
+	output_damage_wake_idle_refresh(output_damage);
+
 	int width, height;
 	wlr_output_transformed_resolution(output_damage->output, &width, &height);
 
@@ -181,6 +807,23 @@ void wlr_output_damage_add_whole(struct wlr_output_damage *output_damage) {
 
 void wlr_output_damage_add_box(struct wlr_output_damage *output_damage,
 		struct wlr_box *box) {
+	wlr_trace(output_damage_add_box, output_damage->output,
+		box->x, box->y, box->width, box->height);
+
+	output_damage_wake_idle_refresh(output_damage);
+
+	if (output_damage->tiles != NULL) {
+		pixman_box32_t rect = {
+			.x1 = box->x,
+			.y1 = box->y,
+			.x2 = box->x + box->width,
+			.y2 = box->y + box->height,
+		};
+		output_damage_add_tiles(output_damage, &rect);
+		wlr_output_schedule_frame(output_damage->output);
+		return;
+	}
+
 	int width, height;
 	wlr_output_transformed_resolution(output_damage->output, &width, &height);
 
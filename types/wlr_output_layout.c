@@ -5,11 +5,23 @@
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include "util/signal.h"
 
 struct wlr_output_layout_state {
 	struct wlr_box _box; // should never be read directly, use the getter
+
+	// Index rebuilt by output_layout_reconfigure, so that queries don't need
+	// to recompute output boxes
+	struct wlr_box extents;
+	// Outputs sorted by their left edge
+	struct wlr_output_layout_output **sorted;
+	size_t sorted_len, sorted_cap;
+	bool index_valid;
+
+	struct wl_list surfaces; // wlr_output_layout_surface::link
+	uint32_t used_bits; // wlr_output_layout_output_state::bit
 };
 
 struct wlr_output_layout_output_state {
@@ -17,6 +29,9 @@ struct wlr_output_layout_output_state {
 	struct wlr_output_layout_output *l_output;
 
 	struct wlr_box _box; // should never be read directly, use the getter
+	struct wlr_box box; // cached layout box
+	size_t index; // position in the outputs list
+	uint32_t bit; // in wlr_output_layout_surface::outputs, 0 if untracked
 	bool auto_configured;
 
 	struct wl_listener mode;
@@ -37,6 +52,7 @@ struct wlr_output_layout *wlr_output_layout_create(void) {
 		return NULL;
 	}
 	wl_list_init(&layout->outputs);
+	wl_list_init(&layout->state->surfaces);
 
 	wl_signal_init(&layout->events.add);
 	wl_signal_init(&layout->events.change);
@@ -45,9 +61,66 @@ struct wlr_output_layout *wlr_output_layout_create(void) {
 	return layout;
 }
 
+static void layout_surface_send_output(
+		struct wlr_output_layout_surface *layout_surface,
+		struct wlr_output *output, bool enter) {
+	if (enter) {
+		wlr_surface_send_enter(layout_surface->surface, output);
+		wlr_signal_emit_safe(&layout_surface->events.output_enter, output);
+	} else {
+		wlr_surface_send_leave(layout_surface->surface, output);
+		wlr_signal_emit_safe(&layout_surface->events.output_leave, output);
+	}
+}
+
+static void layout_surface_update(
+		struct wlr_output_layout_surface *layout_surface) {
+	struct wlr_output_layout *layout = layout_surface->layout;
+	if (layout == NULL || layout_surface->surface == NULL) {
+		return;
+	}
+
+	uint32_t outputs = 0;
+	struct wlr_output_layout_output *l_output;
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		struct wlr_box intersection;
+		if (wlr_box_intersection(&intersection, &l_output->state->box,
+				&layout_surface->box)) {
+			outputs |= l_output->state->bit;
+		}
+	}
+
+	uint32_t changed = outputs ^ layout_surface->outputs;
+	if (changed == 0) {
+		return;
+	}
+	layout_surface->outputs = outputs;
+
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		if (changed & l_output->state->bit) {
+			layout_surface_send_output(layout_surface, l_output->output,
+				outputs & l_output->state->bit);
+		}
+	}
+}
+
 static void output_layout_output_destroy(
 		struct wlr_output_layout_output *l_output) {
+	struct wlr_output_layout *layout = l_output->state->layout;
 	wlr_signal_emit_safe(&l_output->events.destroy, l_output);
+
+	uint32_t bit = l_output->state->bit;
+	struct wlr_output_layout_surface *layout_surface, *tmp;
+	wl_list_for_each_safe(layout_surface, tmp, &layout->state->surfaces,
+			link) {
+		if (layout_surface->outputs & bit) {
+			layout_surface->outputs &= ~bit;
+			layout_surface_send_output(layout_surface, l_output->output,
+				false);
+		}
+	}
+	layout->state->used_bits &= ~bit;
+
 	wlr_output_destroy_global(l_output->output);
 	wl_list_remove(&l_output->state->mode.link);
 	wl_list_remove(&l_output->state->scale.link);
@@ -56,6 +129,9 @@ static void output_layout_output_destroy(
 	wl_list_remove(&l_output->link);
 	free(l_output->state);
 	free(l_output);
+
+	// The index is rebuilt when the layout is reconfigured
+	layout->state->index_valid = false;
 }
 
 void wlr_output_layout_destroy(struct wlr_output_layout *layout) {
@@ -70,21 +146,100 @@ void wlr_output_layout_destroy(struct wlr_output_layout *layout) {
 		output_layout_output_destroy(l_output);
 	}
 
+	struct wlr_output_layout_surface *layout_surface, *tmp;
+	wl_list_for_each_safe(layout_surface, tmp, &layout->state->surfaces,
+			link) {
+		wl_list_remove(&layout_surface->link);
+		wl_list_init(&layout_surface->link);
+		layout_surface->layout = NULL;
+	}
+
+	free(layout->state->sorted);
 	free(layout->state);
 	free(layout);
 }
 
-static struct wlr_box *output_layout_output_get_box(
+static struct wlr_box *output_layout_output_update_box(
 		struct wlr_output_layout_output *l_output) {
-	l_output->state->_box.x = l_output->x;
-	l_output->state->_box.y = l_output->y;
+	l_output->state->box.x = l_output->x;
+	l_output->state->box.y = l_output->y;
 	int width, height;
 	wlr_output_effective_resolution(l_output->output, &width, &height);
-	l_output->state->_box.width = width;
-	l_output->state->_box.height = height;
+	l_output->state->box.width = width;
+	l_output->state->box.height = height;
+	return &l_output->state->box;
+}
+
+static struct wlr_box *output_layout_output_get_box(
+		struct wlr_output_layout_output *l_output) {
+	// Callers may modify the returned box, don't hand out the cached one
+	l_output->state->_box = l_output->state->box;
 	return &l_output->state->_box;
 }
 
+static int sorted_output_cmp(const void *_a, const void *_b) {
+	const struct wlr_output_layout_output *a =
+		*(struct wlr_output_layout_output *const *)_a;
+	const struct wlr_output_layout_output *b =
+		*(struct wlr_output_layout_output *const *)_b;
+	if (a->state->box.x != b->state->box.x) {
+		return a->state->box.x < b->state->box.x ? -1 : 1;
+	}
+	return a->state->index < b->state->index ? -1 : 1;
+}
+
+static void output_layout_update_index(struct wlr_output_layout *layout) {
+	struct wlr_output_layout_state *state = layout->state;
+	state->index_valid = false;
+	state->sorted_len = 0;
+
+	int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+	if (!wl_list_empty(&layout->outputs)) {
+		min_x = min_y = INT_MAX;
+		max_x = max_y = INT_MIN;
+	}
+	size_t len = 0;
+	struct wlr_output_layout_output *l_output;
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		struct wlr_box *box = &l_output->state->box;
+		if (box->x < min_x) {
+			min_x = box->x;
+		}
+		if (box->y < min_y) {
+			min_y = box->y;
+		}
+		if (box->x + box->width > max_x) {
+			max_x = box->x + box->width;
+		}
+		if (box->y + box->height > max_y) {
+			max_y = box->y + box->height;
+		}
+		l_output->state->index = len++;
+	}
+	state->extents.x = min_x;
+	state->extents.y = min_y;
+	state->extents.width = max_x - min_x;
+	state->extents.height = max_y - min_y;
+
+	if (len > state->sorted_cap) {
+		struct wlr_output_layout_output **sorted =
+			realloc(state->sorted, len * sizeof(*sorted));
+		if (sorted == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return;
+		}
+		state->sorted = sorted;
+		state->sorted_cap = len;
+	}
+
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		state->sorted[state->sorted_len++] = l_output;
+	}
+	qsort(state->sorted, state->sorted_len, sizeof(*state->sorted),
+		sorted_output_cmp);
+	state->index_valid = true;
+}
+
 /**
  * This must be called whenever the layout changes to reconfigure the auto
  * configured outputs and emit the `changed` event.
@@ -104,7 +259,7 @@ static void output_layout_reconfigure(struct wlr_output_layout *layout) {
 			continue;
 		}
 
-		struct wlr_box *box = output_layout_output_get_box(l_output);
+		struct wlr_box *box = output_layout_output_update_box(l_output);
 		if (box->x + box->width > max_x) {
 			max_x = box->x + box->width;
 			max_x_y = box->y;
@@ -121,16 +276,24 @@ static void output_layout_reconfigure(struct wlr_output_layout *layout) {
 		if (!l_output->state->auto_configured) {
 			continue;
 		}
-		struct wlr_box *box = output_layout_output_get_box(l_output);
 		l_output->x = max_x;
 		l_output->y = max_x_y;
+		struct wlr_box *box = output_layout_output_update_box(l_output);
 		max_x += box->width;
 	}
 
+	output_layout_update_index(layout);
+
 	wl_list_for_each(l_output, &layout->outputs, link) {
 		wlr_output_set_position(l_output->output, l_output->x, l_output->y);
 	}
 
+	struct wlr_output_layout_surface *layout_surface, *tmp;
+	wl_list_for_each_safe(layout_surface, tmp, &layout->state->surfaces,
+			link) {
+		layout_surface_update(layout_surface);
+	}
+
 	wlr_signal_emit_safe(&layout->events.change, layout);
 }
 
@@ -185,6 +348,17 @@ static struct wlr_output_layout_output *output_layout_output_create(
 	l_output->state->l_output = l_output;
 	l_output->state->layout = layout;
 	l_output->output = output;
+	for (uint32_t bit = 1; bit != 0; bit <<= 1) {
+		if (!(layout->state->used_bits & bit)) {
+			l_output->state->bit = bit;
+			layout->state->used_bits |= bit;
+			break;
+		}
+	}
+	if (l_output->state->bit == 0) {
+		wlr_log(WLR_DEBUG, "Too many outputs, surfaces won't be sent "
+			"enter and leave events for %s", output->name);
+	}
 	wl_signal_init(&l_output->events.destroy);
 	wl_list_insert(&layout->outputs, &l_output->link);
 
@@ -252,10 +426,26 @@ bool wlr_output_layout_intersects(struct wlr_output_layout *layout,
 	struct wlr_box out_box;
 
 	if (reference == NULL) {
-		struct wlr_output_layout_output *l_output;
-		wl_list_for_each(l_output, &layout->outputs, link) {
-			struct wlr_box *output_box =
-				output_layout_output_get_box(l_output);
+		struct wlr_output_layout_state *state = layout->state;
+		if (!state->index_valid) {
+			struct wlr_output_layout_output *l_output;
+			wl_list_for_each(l_output, &layout->outputs, link) {
+				if (wlr_box_intersection(&out_box, &l_output->state->box,
+						target_lbox)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		if (!wlr_box_intersection(&out_box, &state->extents, target_lbox)) {
+			return false;
+		}
+		for (size_t i = 0; i < state->sorted_len; ++i) {
+			struct wlr_box *output_box = &state->sorted[i]->state->box;
+			if (output_box->x >= target_lbox->x + target_lbox->width) {
+				break;
+			}
 			if (wlr_box_intersection(&out_box, output_box, target_lbox)) {
 				return true;
 			}
@@ -273,16 +463,43 @@ bool wlr_output_layout_intersects(struct wlr_output_layout *layout,
 	}
 }
 
-struct wlr_output *wlr_output_layout_output_at(struct wlr_output_layout *layout,
-		double lx, double ly) {
-	struct wlr_output_layout_output *l_output;
-	wl_list_for_each(l_output, &layout->outputs, link) {
-		struct wlr_box *box = output_layout_output_get_box(l_output);
-		if (wlr_box_contains_point(box, lx, ly)) {
-			return l_output->output;
+static struct wlr_output_layout_output *output_layout_output_at(
+		struct wlr_output_layout *layout, double lx, double ly) {
+	struct wlr_output_layout_state *state = layout->state;
+	if (!state->index_valid) {
+		struct wlr_output_layout_output *l_output;
+		wl_list_for_each(l_output, &layout->outputs, link) {
+			if (wlr_box_contains_point(&l_output->state->box, lx, ly)) {
+				return l_output;
+			}
 		}
+		return NULL;
 	}
-	return NULL;
+
+	if (!wlr_box_contains_point(&state->extents, lx, ly)) {
+		return NULL;
+	}
+
+	// Overlapping outputs are resolved in list order, like a linear walk
+	struct wlr_output_layout_output *found = NULL;
+	for (size_t i = 0; i < state->sorted_len; ++i) {
+		struct wlr_output_layout_output *l_output = state->sorted[i];
+		if (l_output->state->box.x > lx) {
+			break;
+		}
+		if (wlr_box_contains_point(&l_output->state->box, lx, ly) &&
+				(found == NULL || l_output->state->index < found->state->index)) {
+			found = l_output;
+		}
+	}
+	return found;
+}
+
+struct wlr_output *wlr_output_layout_output_at(struct wlr_output_layout *layout,
+		double lx, double ly) {
+	struct wlr_output_layout_output *l_output =
+		output_layout_output_at(layout, lx, ly);
+	return l_output != NULL ? l_output->output : NULL;
 }
 
 void wlr_output_layout_move(struct wlr_output_layout *layout,
@@ -332,6 +549,17 @@ void wlr_output_layout_closest_point(struct wlr_output_layout *layout,
 		return;
 	}
 
+	if (reference == NULL && output_layout_output_at(layout, lx, ly) != NULL) {
+		// The point is already on an output
+		if (dest_lx) {
+			*dest_lx = lx;
+		}
+		if (dest_ly) {
+			*dest_ly = ly;
+		}
+		return;
+	}
+
 	double min_x = DBL_MAX, min_y = DBL_MAX, min_distance = DBL_MAX;
 	struct wlr_output_layout_output *l_output;
 	wl_list_for_each(l_output, &layout->outputs, link) {
@@ -340,8 +568,8 @@ void wlr_output_layout_closest_point(struct wlr_output_layout *layout,
 		}
 
 		double output_x, output_y, output_distance;
-		struct wlr_box *box = output_layout_output_get_box(l_output);
-		wlr_box_closest_point(box, lx, ly, &output_x, &output_y);
+		wlr_box_closest_point(&l_output->state->box, lx, ly,
+			&output_x, &output_y);
 
 		// calculate squared distance suitable for comparison
 		output_distance =
@@ -380,32 +608,10 @@ struct wlr_box *wlr_output_layout_get_box(
 		}
 	} else {
 		// layout extents
-		int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
-		if (!wl_list_empty(&layout->outputs)) {
-			min_x = min_y = INT_MAX;
-			max_x = max_y = INT_MIN;
-			wl_list_for_each(l_output, &layout->outputs, link) {
-				struct wlr_box *box = output_layout_output_get_box(l_output);
-				if (box->x < min_x) {
-					min_x = box->x;
-				}
-				if (box->y < min_y) {
-					min_y = box->y;
-				}
-				if (box->x + box->width > max_x) {
-					max_x = box->x + box->width;
-				}
-				if (box->y + box->height > max_y) {
-					max_y = box->y + box->height;
-				}
-			}
+		if (!layout->state->index_valid) {
+			output_layout_update_index(layout);
 		}
-
-		layout->state->_box.x = min_x;
-		layout->state->_box.y = min_y;
-		layout->state->_box.width = max_x - min_x;
-		layout->state->_box.height = max_y - min_y;
-
+		layout->state->_box = layout->state->extents;
 		return &layout->state->_box;
 	}
 
@@ -521,3 +727,65 @@ struct wlr_output *wlr_output_layout_farthest_output(
 	return wlr_output_layout_output_in_direction(layout, direction,
 			reference, ref_lx, ref_ly, FARTHEST);
 }
+
+static void layout_surface_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_layout_surface *layout_surface =
+		wl_container_of(listener, layout_surface, surface_destroy);
+	wl_list_remove(&layout_surface->surface_destroy.link);
+	wl_list_init(&layout_surface->surface_destroy.link);
+	layout_surface->surface = NULL;
+	layout_surface->outputs = 0;
+}
+
+struct wlr_output_layout_surface *wlr_output_layout_surface_create(
+		struct wlr_output_layout *layout, struct wlr_surface *surface) {
+	struct wlr_output_layout_surface *layout_surface =
+		calloc(1, sizeof(struct wlr_output_layout_surface));
+	if (layout_surface == NULL) {
+		return NULL;
+	}
+	layout_surface->layout = layout;
+	layout_surface->surface = surface;
+	wl_signal_init(&layout_surface->events.output_enter);
+	wl_signal_init(&layout_surface->events.output_leave);
+
+	layout_surface->surface_destroy.notify =
+		layout_surface_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &layout_surface->surface_destroy);
+	wl_list_insert(&layout->state->surfaces, &layout_surface->link);
+	return layout_surface;
+}
+
+void wlr_output_layout_surface_destroy(
+		struct wlr_output_layout_surface *layout_surface) {
+	if (layout_surface == NULL) {
+		return;
+	}
+	wl_list_remove(&layout_surface->surface_destroy.link);
+	wl_list_remove(&layout_surface->link);
+	free(layout_surface);
+}
+
+void wlr_output_layout_surface_set_box(
+		struct wlr_output_layout_surface *layout_surface,
+		const struct wlr_box *box) {
+	if (layout_surface->box.x == box->x && layout_surface->box.y == box->y &&
+			layout_surface->box.width == box->width &&
+			layout_surface->box.height == box->height) {
+		return;
+	}
+	layout_surface->box = *box;
+	layout_surface_update(layout_surface);
+}
+
+bool wlr_output_layout_surface_intersects(
+		struct wlr_output_layout_surface *layout_surface,
+		struct wlr_output *output) {
+	if (layout_surface->layout == NULL) {
+		return false;
+	}
+	struct wlr_output_layout_output *l_output =
+		wlr_output_layout_get(layout_surface->layout, output);
+	return l_output != NULL && (layout_surface->outputs & l_output->state->bit);
+}
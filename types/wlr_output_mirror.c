@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output_mirror.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include "util/signal.h"
+
+static void mirror_update_texture(struct wlr_output_mirror *mirror) {
+	struct wlr_output *dst = mirror->dst_damage->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(dst->backend);
+
+	struct wlr_dmabuf_attributes attribs;
+	if (!wlr_output_export_dmabuf(mirror->src, &attribs)) {
+		return;
+	}
+	// The EGL image holds its own reference to the buffer
+	struct wlr_texture *texture = wlr_texture_from_dmabuf(renderer, &attribs);
+	wlr_dmabuf_attributes_finish(&attribs);
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to import mirrored output buffer");
+		return;
+	}
+
+	wlr_texture_destroy(mirror->texture);
+	mirror->texture = texture;
+}
+
+static void mirror_damage_dst(struct wlr_output_mirror *mirror,
+		pixman_region32_t *src_damage) {
+	struct wlr_output *src = mirror->src;
+	struct wlr_output *dst = mirror->dst_damage->output;
+
+	int src_width, src_height, dst_width, dst_height;
+	wlr_output_transformed_resolution(src, &src_width, &src_height);
+	wlr_output_transformed_resolution(dst, &dst_width, &dst_height);
+	if (src_width <= 0 || src_height <= 0) {
+		return;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	wlr_region_transform(&damage, src_damage, src->transform,
+		src->width, src->height);
+	if (src_width != dst_width || src_height != dst_height) {
+		wlr_region_scale_xy(&damage, &damage,
+			(float)dst_width / src_width, (float)dst_height / src_height);
+		// Filtering samples neighbouring pixels
+		wlr_region_expand(&damage, &damage, 1);
+	}
+	wlr_output_damage_add(mirror->dst_damage, &damage);
+	pixman_region32_fini(&damage);
+}
+
+static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+	wlr_box_transform(&box, &box, transform, ow, oh);
+
+	wlr_renderer_scissor(renderer, &box);
+}
+
+static void mirror_render(struct wlr_output_mirror *mirror) {
+	struct wlr_output *dst = mirror->dst_damage->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(dst->backend);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	bool needs_swap;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (!wlr_output_damage_make_current(mirror->dst_damage, &needs_swap,
+			&damage)) {
+		goto damage_finish;
+	}
+	if (!needs_swap) {
+		goto damage_finish;
+	}
+
+	wlr_renderer_begin(renderer, dst->width, dst->height);
+
+	int width, height;
+	wlr_output_transformed_resolution(dst, &width, &height);
+
+	float matrix[9];
+	if (mirror->texture != NULL) {
+		struct wlr_box box = { .width = width, .height = height };
+		enum wl_output_transform transform =
+			wlr_output_transform_invert(mirror->src->transform);
+		wlr_matrix_project_box(matrix, &box, transform, 0,
+			dst->transform_matrix);
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(dst, &rects[i]);
+		wlr_renderer_clear(renderer, (float[]){ 0, 0, 0, 1 });
+		if (mirror->texture != NULL) {
+			wlr_render_texture_with_matrix(renderer, mirror->texture,
+				matrix, 1.0);
+		}
+	}
+
+	wlr_output_render_software_cursors(dst, &damage);
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_end(renderer);
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(dst->transform);
+	wlr_region_transform(&damage, &damage, transform, width, height);
+
+	wlr_output_damage_swap_buffers(mirror->dst_damage, &now, &damage);
+
+damage_finish:
+	pixman_region32_fini(&damage);
+}
+
+static void mirror_handle_src_swap_buffers(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_mirror *mirror =
+		wl_container_of(listener, mirror, src_swap_buffers);
+	struct wlr_output_event_swap_buffers *event = data;
+
+	if (event->damage != NULL) {
+		pixman_region32_union(&mirror->pending_damage, &mirror->pending_damage,
+			event->damage);
+	} else {
+		pixman_region32_union_rect(&mirror->pending_damage,
+			&mirror->pending_damage, 0, 0,
+			mirror->src->width, mirror->src->height);
+	}
+}
+
+static void mirror_handle_src_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_mirror *mirror =
+		wl_container_of(listener, mirror, src_present);
+
+	if (!pixman_region32_not_empty(&mirror->pending_damage)) {
+		return;
+	}
+
+	// The swapped buffer is only exported once it's on screen, so that the
+	// source doesn't render into it while it's being mirrored
+	mirror_update_texture(mirror);
+	mirror_damage_dst(mirror, &mirror->pending_damage);
+	pixman_region32_clear(&mirror->pending_damage);
+}
+
+static void mirror_handle_dst_frame(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_mirror *mirror =
+		wl_container_of(listener, mirror, dst_frame);
+	mirror_render(mirror);
+}
+
+static void mirror_handle_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_output_mirror *mirror =
+		wl_container_of(listener, mirror, src_destroy);
+	wlr_output_mirror_destroy(mirror);
+}
+
+static void mirror_handle_dst_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_output_mirror *mirror =
+		wl_container_of(listener, mirror, dst_destroy);
+	wlr_output_mirror_destroy(mirror);
+}
+
+struct wlr_output_mirror *wlr_output_mirror_create(struct wlr_output *src,
+		struct wlr_output_damage *dst_damage) {
+	if (src->impl->export_dmabuf == NULL) {
+		wlr_log(WLR_ERROR, "Cannot mirror output '%s': buffers can't be "
+			"exported", src->name);
+		return NULL;
+	}
+
+	struct wlr_output_mirror *mirror =
+		calloc(1, sizeof(struct wlr_output_mirror));
+	if (mirror == NULL) {
+		return NULL;
+	}
+	mirror->src = src;
+	mirror->dst_damage = dst_damage;
+	wl_signal_init(&mirror->events.destroy);
+	pixman_region32_init(&mirror->pending_damage);
+
+	wl_signal_add(&src->events.swap_buffers, &mirror->src_swap_buffers);
+	mirror->src_swap_buffers.notify = mirror_handle_src_swap_buffers;
+	wl_signal_add(&src->events.present, &mirror->src_present);
+	mirror->src_present.notify = mirror_handle_src_present;
+	wl_signal_add(&src->events.destroy, &mirror->src_destroy);
+	mirror->src_destroy.notify = mirror_handle_destroy;
+	wl_signal_add(&dst_damage->events.frame, &mirror->dst_frame);
+	mirror->dst_frame.notify = mirror_handle_dst_frame;
+	wl_signal_add(&dst_damage->events.destroy, &mirror->dst_destroy);
+	mirror->dst_destroy.notify = mirror_handle_dst_destroy;
+
+	// Hardware cursors aren't part of the exported buffer
+	wlr_output_lock_software_cursors(src, true);
+
+	// Show the current content right away
+	mirror_update_texture(mirror);
+	wlr_output_damage_add_whole(dst_damage);
+
+	return mirror;
+}
+
+void wlr_output_mirror_destroy(struct wlr_output_mirror *mirror) {
+	if (mirror == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&mirror->events.destroy, mirror);
+	wlr_output_lock_software_cursors(mirror->src, false);
+	wl_list_remove(&mirror->src_swap_buffers.link);
+	wl_list_remove(&mirror->src_present.link);
+	wl_list_remove(&mirror->src_destroy.link);
+	wl_list_remove(&mirror->dst_frame.link);
+	wl_list_remove(&mirror->dst_destroy.link);
+	wlr_texture_destroy(mirror->texture);
+	pixman_region32_fini(&mirror->pending_damage);
+	free(mirror);
+}
@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 199309L
 #include <assert.h>
 #include <stdlib.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/backend.h>
@@ -21,6 +22,8 @@ static void feedback_handle_resource_destroy(struct wl_resource *resource) {
 		presentation_feedback_from_resource(resource);
 	wl_list_remove(&feedback->surface_commit.link);
 	wl_list_remove(&feedback->surface_destroy.link);
+	wl_list_remove(&feedback->output_present.link);
+	wl_list_remove(&feedback->output_destroy.link);
 	wl_list_remove(&feedback->link);
 	free(feedback);
 }
@@ -60,7 +63,9 @@ static void feedback_handle_surface_commit(struct wl_listener *listener,
 	struct wlr_presentation_feedback *feedback =
 		wl_container_of(listener, feedback, surface_commit);
 
-	if (feedback->committed) {
+	if (feedback->output != NULL) {
+		// The content update has been sampled, it will be presented
+	} else if (feedback->committed) {
 		// The content update has been superseded
 		feedback_send_discarded(feedback);
 	} else {
@@ -75,6 +80,30 @@ static void feedback_handle_surface_destroy(struct wl_listener *listener,
 	feedback_send_discarded(feedback);
 }
 
+static void feedback_handle_output_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_presentation_feedback *feedback =
+		wl_container_of(listener, feedback, output_present);
+	struct wlr_output_event_present *output_event = data;
+
+	struct wlr_presentation_event event = {
+		.output = output_event->output,
+		.tv_sec = (uint64_t)output_event->when->tv_sec,
+		.tv_nsec = (uint32_t)output_event->when->tv_nsec,
+		.refresh = (uint32_t)output_event->refresh,
+		.seq = (uint64_t)output_event->seq,
+		.flags = output_event->flags,
+	};
+	feedback_send_presented(feedback, &event);
+}
+
+static void feedback_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_presentation_feedback *feedback =
+		wl_container_of(listener, feedback, output_destroy);
+	feedback_send_discarded(feedback);
+}
+
 static const struct wp_presentation_interface presentation_impl;
 
 static struct wlr_presentation *presentation_from_resource(
@@ -117,6 +146,9 @@ static void presentation_handle_feedback(struct wl_client *client,
 	feedback->surface_destroy.notify = feedback_handle_surface_destroy;
 	wl_signal_add(&surface->events.destroy, &feedback->surface_destroy);
 
+	wl_list_init(&feedback->output_present.link);
+	wl_list_init(&feedback->output_destroy.link);
+
 	wl_list_insert(&presentation->feedbacks, &feedback->link);
 }
 
@@ -221,3 +253,22 @@ void wlr_presentation_send_surface_presented(
 		}
 	}
 }
+
+void wlr_presentation_surface_sampled_on_output(
+		struct wlr_presentation *presentation, struct wlr_surface *surface,
+		struct wlr_output *output) {
+	struct wlr_presentation_feedback *feedback;
+	wl_list_for_each(feedback, &presentation->feedbacks, link) {
+		// Surfaces on several outputs are reported for the first one
+		if (feedback->surface != surface || !feedback->committed ||
+				feedback->output != NULL) {
+			continue;
+		}
+
+		feedback->output = output;
+		feedback->output_present.notify = feedback_handle_output_present;
+		wl_signal_add(&output->events.present, &feedback->output_present);
+		feedback->output_destroy.notify = feedback_handle_output_destroy;
+		wl_signal_add(&output->events.destroy, &feedback->output_destroy);
+	}
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/util/log.h>
+#include <wlr/util/mime_type.h>
 #include "util/signal.h"
 
 void wlr_primary_selection_source_init(
@@ -21,9 +22,9 @@ void wlr_primary_selection_source_destroy(
 
 	wlr_signal_emit_safe(&source->events.destroy, source);
 
-	char **p;
+	const char **p;
 	wl_array_for_each(p, &source->mime_types) {
-		free(*p);
+		wlr_mime_type_unref(*p);
 	}
 	wl_array_release(&source->mime_types);
 
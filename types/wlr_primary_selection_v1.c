@@ -4,10 +4,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <wlr/types/wlr_client_stats.h>
 #include <wlr/types/wlr_primary_selection_v1.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
+#include <wlr/util/mime_type.h>
 #include "primary-selection-unstable-v1-protocol.h"
 #include "util/signal.h"
 
@@ -24,6 +26,10 @@ static struct wlr_primary_selection_v1_device *device_from_offer_resource(
 
 static void offer_handle_receive(struct wl_client *client,
 		struct wl_resource *resource, const char *mime_type, int32_t fd) {
+	struct wlr_client_stats *stats = wlr_client_stats_get(client);
+	if (stats != NULL) {
+		stats->data_transfers++;
+	}
 	struct wlr_primary_selection_v1_device *device =
 		device_from_offer_resource(resource);
 	if (device == NULL || device->seat->primary_selection_source == NULL) {
@@ -143,29 +149,30 @@ static void source_handle_offer(struct wl_client *client,
 		wlr_log(WLR_DEBUG, "Offering additional MIME type after set_selection");
 	}
 
+	const char *interned = wlr_mime_type_intern(mime_type);
+	if (interned == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
 	const char **mime_type_ptr;
 	wl_array_for_each(mime_type_ptr, &source->source.mime_types) {
-		if (strcmp(*mime_type_ptr, mime_type) == 0) {
+		if (*mime_type_ptr == interned) {
 			wlr_log(WLR_DEBUG, "Ignoring duplicate MIME type offer %s",
 				mime_type);
+			wlr_mime_type_unref(interned);
 			return;
 		}
 	}
 
-	char *dup_mime_type = strdup(mime_type);
-	if (dup_mime_type == NULL) {
-		wl_resource_post_no_memory(resource);
-		return;
-	}
-
-	char **p = wl_array_add(&source->source.mime_types, sizeof(*p));
+	const char **p = wl_array_add(&source->source.mime_types, sizeof(*p));
 	if (p == NULL) {
-		free(dup_mime_type);
+		wlr_mime_type_unref(interned);
 		wl_resource_post_no_memory(resource);
 		return;
 	}
 
-	*p = dup_mime_type;
+	*p = interned;
 }
 
 static void source_handle_destroy(struct wl_client *client,
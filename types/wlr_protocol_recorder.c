@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <wlr/types/wlr_protocol_recorder.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+#define RECORDING_HEADER "# wlroots protocol recording\n"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+static uint64_t get_current_time_usec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static FILE *begin_line(struct wlr_protocol_recorder_client *rec_client) {
+	struct wlr_protocol_recorder *recorder = rec_client->recorder;
+	uint64_t now = get_current_time_usec();
+	uint64_t usec = now > recorder->start_usec ?
+		now - recorder->start_usec : 0;
+	fprintf(recorder->file, "%" PRIu64 " %d", usec, rec_client->id);
+	return recorder->file;
+}
+
+static void recorder_client_destroy(
+		struct wlr_protocol_recorder_client *rec_client) {
+	wl_list_remove(&rec_client->destroy.link);
+	wl_list_remove(&rec_client->link);
+	free(rec_client);
+}
+
+static void handle_client_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_protocol_recorder_client *rec_client =
+		wl_container_of(listener, rec_client, destroy);
+	FILE *f = begin_line(rec_client);
+	fputs(" disconnect\n", f);
+	recorder_client_destroy(rec_client);
+}
+
+static struct wlr_protocol_recorder_client *get_client(
+		struct wlr_protocol_recorder *recorder, struct wl_client *client) {
+	struct wlr_protocol_recorder_client *rec_client;
+	wl_list_for_each(rec_client, &recorder->clients, link) {
+		if (rec_client->client == client) {
+			return rec_client;
+		}
+	}
+
+	rec_client = calloc(1, sizeof(struct wlr_protocol_recorder_client));
+	if (rec_client == NULL) {
+		return NULL;
+	}
+	rec_client->recorder = recorder;
+	rec_client->client = client;
+	rec_client->id = recorder->next_client_id++;
+	rec_client->destroy.notify = handle_client_destroy;
+	wl_client_add_destroy_listener(client, &rec_client->destroy);
+	wl_list_insert(&recorder->clients, &rec_client->link);
+	return rec_client;
+}
+
+static void print_string(FILE *f, const char *str) {
+	if (str == NULL) {
+		fputs(" -", f);
+		return;
+	}
+	fputs(" \"", f);
+	for (const unsigned char *c = (const unsigned char *)str; *c; ++c) {
+		if (*c == '"' || *c == '\\') {
+			fprintf(f, "\\%c", *c);
+		} else if (*c >= 0x20 && *c < 0x7f) {
+			fputc(*c, f);
+		} else {
+			fprintf(f, "\\x%02x", *c);
+		}
+	}
+	fputc('"', f);
+}
+
+static void print_array(FILE *f, struct wl_array *array) {
+	fputs(" [", f);
+	if (array != NULL) {
+		const unsigned char *bytes = array->data;
+		for (size_t i = 0; i < array->size; ++i) {
+			fprintf(f, "%02x", bytes[i]);
+		}
+	}
+	fputc(']', f);
+}
+
+static void print_fd(FILE *f, int fd) {
+	// Replayed file descriptors only need to be as large, e.g. for shm pools
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		fputs(" -1", f);
+		return;
+	}
+	fprintf(f, " %jd", (intmax_t)st.st_size);
+}
+
+static void record_buffer_hash(struct wlr_protocol_recorder_client *rec_client,
+		struct wl_resource *buffer_resource) {
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer_resource);
+	if (shm_buffer == NULL) {
+		return;
+	}
+
+	uint64_t hash = FNV_OFFSET_BASIS;
+	wl_shm_buffer_begin_access(shm_buffer);
+	const unsigned char *data = wl_shm_buffer_get_data(shm_buffer);
+	size_t size = (size_t)wl_shm_buffer_get_stride(shm_buffer) *
+		wl_shm_buffer_get_height(shm_buffer);
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * FNV_PRIME;
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+
+	FILE *f = begin_line(rec_client);
+	fprintf(f, " buffer %" PRIu32 " %016" PRIx64 "\n",
+		wl_resource_get_id(buffer_resource), hash);
+}
+
+static void handle_message(void *data, enum wl_protocol_logger_type type,
+		const struct wl_protocol_logger_message *message) {
+	struct wlr_protocol_recorder *recorder = data;
+	if (type != WL_PROTOCOL_LOGGER_REQUEST) {
+		return;
+	}
+
+	struct wl_resource *resource = message->resource;
+	struct wlr_protocol_recorder_client *rec_client =
+		get_client(recorder, wl_resource_get_client(resource));
+	if (rec_client == NULL) {
+		return;
+	}
+
+	const char *class = wl_resource_get_class(resource);
+	if (recorder->hash_buffers && strcmp(class, "wl_surface") == 0 &&
+			strcmp(message->message->name, "attach") == 0 &&
+			message->arguments[0].o != NULL) {
+		record_buffer_hash(rec_client,
+			(struct wl_resource *)message->arguments[0].o);
+	}
+
+	FILE *f = begin_line(rec_client);
+	fprintf(f, " %s@%" PRIu32 ".%s", class, wl_resource_get_id(resource),
+		message->message->name);
+
+	const char *signature = message->message->signature;
+	int i = 0;
+	for (const char *c = signature; *c != '\0' &&
+			i < message->arguments_count; ++c) {
+		const union wl_argument *arg = &message->arguments[i];
+		switch (*c) {
+		case 'i':
+		case 'f':
+			fprintf(f, " %" PRId32, arg->i);
+			break;
+		case 'u':
+		case 'n':
+			fprintf(f, " %" PRIu32, arg->u);
+			break;
+		case 'o':
+			fprintf(f, " %" PRIu32, arg->o == NULL ? 0 :
+				wl_resource_get_id((struct wl_resource *)arg->o));
+			break;
+		case 's':
+			print_string(f, arg->s);
+			break;
+		case 'a':
+			print_array(f, arg->a);
+			break;
+		case 'h':
+			print_fd(f, arg->h);
+			break;
+		default:
+			// Version and nullability markers
+			continue;
+		}
+		++i;
+	}
+	fputc('\n', f);
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_protocol_recorder *recorder =
+		wl_container_of(listener, recorder, display_destroy);
+	wlr_protocol_recorder_destroy(recorder);
+}
+
+struct wlr_protocol_recorder *wlr_protocol_recorder_create(
+		struct wl_display *display, FILE *file) {
+	struct wlr_protocol_recorder *recorder =
+		calloc(1, sizeof(struct wlr_protocol_recorder));
+	if (recorder == NULL) {
+		return NULL;
+	}
+	recorder->logger =
+		wl_display_add_protocol_logger(display, handle_message, recorder);
+	if (recorder->logger == NULL) {
+		free(recorder);
+		return NULL;
+	}
+	recorder->file = file;
+	recorder->start_usec = get_current_time_usec();
+	recorder->next_client_id = 1;
+	wl_list_init(&recorder->clients);
+	wl_signal_init(&recorder->events.destroy);
+
+	recorder->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &recorder->display_destroy);
+
+	fputs(RECORDING_HEADER, file);
+	return recorder;
+}
+
+void wlr_protocol_recorder_destroy(struct wlr_protocol_recorder *recorder) {
+	if (recorder == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&recorder->events.destroy, recorder);
+	struct wlr_protocol_recorder_client *rec_client, *tmp;
+	wl_list_for_each_safe(rec_client, tmp, &recorder->clients, link) {
+		recorder_client_destroy(rec_client);
+	}
+	wl_protocol_logger_destroy(recorder->logger);
+	wl_list_remove(&recorder->display_destroy.link);
+	fflush(recorder->file);
+	free(recorder);
+}
@@ -0,0 +1,1392 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/backend.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include "util/signal.h"
+
+static struct wlr_scene *scene_root_from_node(struct wlr_scene_node *node) {
+	assert(node->type == WLR_SCENE_NODE_ROOT);
+	return (struct wlr_scene *)node;
+}
+
+static struct wlr_scene_tree *scene_tree_from_node(
+		struct wlr_scene_node *node) {
+	assert(node->type == WLR_SCENE_NODE_TREE);
+	return (struct wlr_scene_tree *)node;
+}
+
+struct wlr_scene_surface *wlr_scene_surface_from_node(
+		struct wlr_scene_node *node) {
+	assert(node->type == WLR_SCENE_NODE_SURFACE);
+	return (struct wlr_scene_surface *)node;
+}
+
+static struct wlr_scene_rect *scene_rect_from_node(
+		struct wlr_scene_node *node) {
+	assert(node->type == WLR_SCENE_NODE_RECT);
+	return (struct wlr_scene_rect *)node;
+}
+
+static struct wlr_scene_buffer *scene_buffer_from_node(
+		struct wlr_scene_node *node) {
+	assert(node->type == WLR_SCENE_NODE_BUFFER);
+	return (struct wlr_scene_buffer *)node;
+}
+
+static struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node) {
+	while (node->parent != NULL) {
+		node = node->parent;
+	}
+	return scene_root_from_node(node);
+}
+
+static void scene_node_state_init(struct wlr_scene_node_state *state) {
+	wl_list_init(&state->children);
+	wl_list_init(&state->link);
+	state->enabled = true;
+}
+
+static void scene_node_init(struct wlr_scene_node *node,
+		enum wlr_scene_node_type type, struct wlr_scene_node *parent) {
+	assert(type == WLR_SCENE_NODE_ROOT || parent != NULL);
+
+	node->type = type;
+	node->parent = parent;
+	scene_node_state_init(&node->state);
+	wl_signal_init(&node->events.destroy);
+
+	if (parent != NULL) {
+		wl_list_insert(parent->state.children.prev, &node->state.link);
+	}
+}
+
+static int scale_length(int length, int offset, float scale) {
+	return round((offset + length) * scale) - round(offset * scale);
+}
+
+static void scale_box(struct wlr_box *box, float scale) {
+	box->width = scale_length(box->width, box->x, scale);
+	box->height = scale_length(box->height, box->y, scale);
+	box->x = round(box->x * scale);
+	box->y = round(box->y * scale);
+}
+
+// Returns the size of the content displayed by the node itself, excluding
+// its children
+static void scene_node_get_size(struct wlr_scene_node *node,
+		int *width, int *height) {
+	*width = 0;
+	*height = 0;
+
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		return;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_scene_surface *scene_surface =
+			wlr_scene_surface_from_node(node);
+		*width = scene_surface->surface->current.width;
+		*height = scene_surface->surface->current.height;
+		break;
+	case WLR_SCENE_NODE_RECT:;
+		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
+		*width = scene_rect->width;
+		*height = scene_rect->height;
+		break;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_scene_buffer *scene_buffer = scene_buffer_from_node(node);
+		if (scene_buffer->buffer != NULL &&
+				scene_buffer->buffer->texture != NULL) {
+			wlr_texture_get_size(scene_buffer->buffer->texture,
+				width, height);
+		}
+		break;
+	}
+}
+
+// Computes the box of the content displayed at (lx, ly) in scene coordinates,
+// in output-local coordinates
+static void scene_output_get_box(struct wlr_scene_output *scene_output,
+		int lx, int ly, int width, int height, struct wlr_box *box) {
+	box->x = lx - scene_output->x;
+	box->y = ly - scene_output->y;
+	box->width = width;
+	box->height = height;
+	scale_box(box, scene_output->output->scale);
+}
+
+static void _scene_node_damage_whole(struct wlr_scene_node *node,
+		struct wlr_scene *scene, int lx, int ly) {
+	if (!node->state.enabled) {
+		return;
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		_scene_node_damage_whole(child, scene,
+			lx + child->state.x, ly + child->state.y);
+	}
+
+	int width, height;
+	scene_node_get_size(node, &width, &height);
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		struct wlr_box box;
+		scene_output_get_box(scene_output, lx, ly, width, height, &box);
+		wlr_output_damage_add_box(scene_output->damage, &box);
+	}
+}
+
+static void scene_node_damage_whole(struct wlr_scene_node *node) {
+	struct wlr_scene *scene = scene_node_get_root(node);
+	if (wl_list_empty(&scene->outputs)) {
+		return;
+	}
+
+	int lx, ly;
+	if (!wlr_scene_node_coords(node, &lx, &ly)) {
+		return;
+	}
+
+	_scene_node_damage_whole(node, scene, lx, ly);
+}
+
+static void scene_output_destroy(struct wlr_scene_output *scene_output);
+
+void wlr_scene_node_destroy(struct wlr_scene_node *node) {
+	if (node == NULL) {
+		return;
+	}
+
+	scene_node_damage_whole(node);
+	wlr_signal_emit_safe(&node->events.destroy, node);
+
+	struct wlr_scene_node *child, *child_tmp;
+	wl_list_for_each_safe(child, child_tmp,
+			&node->state.children, state.link) {
+		wlr_scene_node_destroy(child);
+	}
+
+	wl_list_remove(&node->state.link);
+
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:;
+		struct wlr_scene *scene = scene_root_from_node(node);
+		struct wlr_scene_output *scene_output, *scene_output_tmp;
+		wl_list_for_each_safe(scene_output, scene_output_tmp,
+				&scene->outputs, link) {
+			wlr_scene_output_destroy(scene_output);
+		}
+		free(scene);
+		break;
+	case WLR_SCENE_NODE_TREE:;
+		struct wlr_scene_tree *tree = scene_tree_from_node(node);
+		free(tree);
+		break;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_scene_surface *scene_surface =
+			wlr_scene_surface_from_node(node);
+		wl_list_remove(&scene_surface->surface_commit.link);
+		wl_list_remove(&scene_surface->surface_destroy.link);
+		free(scene_surface);
+		break;
+	case WLR_SCENE_NODE_RECT:;
+		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
+		free(scene_rect);
+		break;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_scene_buffer *scene_buffer = scene_buffer_from_node(node);
+		if (scene_buffer->buffer != NULL) {
+			wlr_buffer_unref(scene_buffer->buffer);
+		}
+		free(scene_buffer);
+		break;
+	}
+}
+
+struct wlr_scene *wlr_scene_create(void) {
+	struct wlr_scene *scene = calloc(1, sizeof(struct wlr_scene));
+	if (scene == NULL) {
+		return NULL;
+	}
+	scene_node_init(&scene->node, WLR_SCENE_NODE_ROOT, NULL);
+	wl_list_init(&scene->outputs);
+	return scene;
+}
+
+struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_node *parent) {
+	struct wlr_scene_tree *tree = calloc(1, sizeof(struct wlr_scene_tree));
+	if (tree == NULL) {
+		return NULL;
+	}
+	scene_node_init(&tree->node, WLR_SCENE_NODE_TREE, parent);
+	return tree;
+}
+
+static void scene_surface_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_surface *scene_surface =
+		wl_container_of(listener, scene_surface, surface_destroy);
+	wlr_scene_node_destroy(&scene_surface->node);
+}
+
+static void scene_surface_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_surface *scene_surface =
+		wl_container_of(listener, scene_surface, surface_commit);
+	struct wlr_surface *surface = scene_surface->surface;
+	struct wlr_scene *scene = scene_node_get_root(&scene_surface->node);
+
+	int lx, ly;
+	if (!wlr_scene_node_coords(&scene_surface->node, &lx, &ly)) {
+		return;
+	}
+
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		struct wlr_output *output = scene_output->output;
+
+		struct wlr_box box;
+		scene_output_get_box(scene_output, lx, ly,
+			surface->current.width, surface->current.height, &box);
+
+		int ow, oh;
+		wlr_output_transformed_resolution(output, &ow, &oh);
+		struct wlr_box output_box = { .width = ow, .height = oh };
+		struct wlr_box intersection;
+		bool visible = wlr_box_intersection(&intersection, &box, &output_box);
+
+		if (pixman_region32_not_empty(&surface->buffer_damage)) {
+			pixman_region32_t damage;
+			pixman_region32_init(&damage);
+			wlr_surface_get_effective_damage(surface, &damage);
+			wlr_region_scale(&damage, &damage, output->scale);
+			if (ceil(output->scale) > surface->current.scale) {
+				// When scaling up a surface, it'll become blurry so we need
+				// to expand the damage region
+				wlr_region_expand(&damage, &damage,
+					ceil(output->scale) - surface->current.scale);
+			}
+			pixman_region32_translate(&damage, box.x, box.y);
+			wlr_output_damage_add(scene_output->damage, &damage);
+			pixman_region32_fini(&damage);
+		}
+
+		// The surface may be waiting for a frame done event
+		if (visible) {
+			wlr_output_schedule_frame(output);
+		}
+	}
+}
+
+struct wlr_scene_surface *wlr_scene_surface_create(
+		struct wlr_scene_node *parent, struct wlr_surface *surface) {
+	struct wlr_scene_surface *scene_surface =
+		calloc(1, sizeof(struct wlr_scene_surface));
+	if (scene_surface == NULL) {
+		return NULL;
+	}
+	scene_node_init(&scene_surface->node, WLR_SCENE_NODE_SURFACE, parent);
+
+	scene_surface->surface = surface;
+
+	scene_surface->surface_destroy.notify =
+		scene_surface_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &scene_surface->surface_destroy);
+
+	scene_surface->surface_commit.notify = scene_surface_handle_surface_commit;
+	wl_signal_add(&surface->events.commit, &scene_surface->surface_commit);
+
+	scene_node_damage_whole(&scene_surface->node);
+
+	return scene_surface;
+}
+
+struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_node *parent,
+		int width, int height, const float color[static 4]) {
+	struct wlr_scene_rect *scene_rect =
+		calloc(1, sizeof(struct wlr_scene_rect));
+	if (scene_rect == NULL) {
+		return NULL;
+	}
+	scene_node_init(&scene_rect->node, WLR_SCENE_NODE_RECT, parent);
+
+	scene_rect->width = width;
+	scene_rect->height = height;
+	memcpy(scene_rect->color, color, sizeof(scene_rect->color));
+
+	scene_node_damage_whole(&scene_rect->node);
+
+	return scene_rect;
+}
+
+void wlr_scene_rect_set_size(struct wlr_scene_rect *rect, int width,
+		int height) {
+	if (rect->width == width && rect->height == height) {
+		return;
+	}
+
+	scene_node_damage_whole(&rect->node);
+	rect->width = width;
+	rect->height = height;
+	scene_node_damage_whole(&rect->node);
+}
+
+void wlr_scene_rect_set_color(struct wlr_scene_rect *rect,
+		const float color[static 4]) {
+	if (memcmp(rect->color, color, sizeof(rect->color)) == 0) {
+		return;
+	}
+
+	memcpy(rect->color, color, sizeof(rect->color));
+	scene_node_damage_whole(&rect->node);
+}
+
+struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_node *parent,
+		struct wlr_buffer *buffer) {
+	struct wlr_scene_buffer *scene_buffer =
+		calloc(1, sizeof(struct wlr_scene_buffer));
+	if (scene_buffer == NULL) {
+		return NULL;
+	}
+	scene_node_init(&scene_buffer->node, WLR_SCENE_NODE_BUFFER, parent);
+
+	if (buffer != NULL) {
+		scene_buffer->buffer = wlr_buffer_ref(buffer);
+	}
+
+	scene_node_damage_whole(&scene_buffer->node);
+
+	return scene_buffer;
+}
+
+void wlr_scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
+		struct wlr_buffer *buffer) {
+	if (buffer == scene_buffer->buffer) {
+		return;
+	}
+
+	scene_node_damage_whole(&scene_buffer->node);
+
+	if (scene_buffer->buffer != NULL) {
+		wlr_buffer_unref(scene_buffer->buffer);
+	}
+	scene_buffer->buffer = NULL;
+	if (buffer != NULL) {
+		scene_buffer->buffer = wlr_buffer_ref(buffer);
+	}
+
+	scene_node_damage_whole(&scene_buffer->node);
+}
+
+void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
+	if (node->state.enabled == enabled) {
+		return;
+	}
+
+	// One of these damage_whole() calls will short-circuit and be a no-op
+	scene_node_damage_whole(node);
+	node->state.enabled = enabled;
+	scene_node_damage_whole(node);
+}
+
+void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y) {
+	if (node->state.x == x && node->state.y == y) {
+		return;
+	}
+
+	scene_node_damage_whole(node);
+	node->state.x = x;
+	node->state.y = y;
+	scene_node_damage_whole(node);
+}
+
+void wlr_scene_node_place_above(struct wlr_scene_node *node,
+		struct wlr_scene_node *sibling) {
+	assert(node != sibling);
+	assert(node->parent == sibling->parent);
+
+	if (node->state.link.prev == &sibling->state.link) {
+		return;
+	}
+
+	wl_list_remove(&node->state.link);
+	wl_list_insert(&sibling->state.link, &node->state.link);
+
+	scene_node_damage_whole(node);
+	scene_node_damage_whole(sibling);
+}
+
+void wlr_scene_node_place_below(struct wlr_scene_node *node,
+		struct wlr_scene_node *sibling) {
+	assert(node != sibling);
+	assert(node->parent == sibling->parent);
+
+	if (node->state.link.next == &sibling->state.link) {
+		return;
+	}
+
+	wl_list_remove(&node->state.link);
+	wl_list_insert(sibling->state.link.prev, &node->state.link);
+
+	scene_node_damage_whole(node);
+	scene_node_damage_whole(sibling);
+}
+
+void wlr_scene_node_raise_to_top(struct wlr_scene_node *node) {
+	struct wlr_scene_node *current_top = wl_container_of(
+		node->parent->state.children.prev, current_top, state.link);
+	if (node == current_top) {
+		return;
+	}
+	wlr_scene_node_place_above(node, current_top);
+}
+
+void wlr_scene_node_lower_to_bottom(struct wlr_scene_node *node) {
+	struct wlr_scene_node *current_bottom = wl_container_of(
+		node->parent->state.children.next, current_bottom, state.link);
+	if (node == current_bottom) {
+		return;
+	}
+	wlr_scene_node_place_below(node, current_bottom);
+}
+
+void wlr_scene_node_reparent(struct wlr_scene_node *node,
+		struct wlr_scene_node *new_parent) {
+	assert(node->type != WLR_SCENE_NODE_ROOT && new_parent != NULL);
+
+	if (node->parent == new_parent) {
+		return;
+	}
+
+	// Ensure that a node cannot become its own ancestor
+	for (struct wlr_scene_node *ancestor = new_parent; ancestor != NULL;
+			ancestor = ancestor->parent) {
+		assert(ancestor != node);
+	}
+
+	scene_node_damage_whole(node);
+
+	wl_list_remove(&node->state.link);
+	node->parent = new_parent;
+	wl_list_insert(new_parent->state.children.prev, &node->state.link);
+
+	scene_node_damage_whole(node);
+}
+
+bool wlr_scene_node_coords(struct wlr_scene_node *node, int *lx_ptr,
+		int *ly_ptr) {
+	int lx = 0, ly = 0;
+	bool enabled = true;
+	while (node != NULL) {
+		lx += node->state.x;
+		ly += node->state.y;
+		enabled = enabled && node->state.enabled;
+		node = node->parent;
+	}
+
+	*lx_ptr = lx;
+	*ly_ptr = ly;
+	return enabled;
+}
+
+static void scene_node_for_each_surface(struct wlr_scene_node *node,
+		int lx, int ly, wlr_surface_iterator_func_t user_iterator,
+		void *user_data) {
+	if (!node->state.enabled) {
+		return;
+	}
+
+	lx += node->state.x;
+	ly += node->state.y;
+
+	if (node->type == WLR_SCENE_NODE_SURFACE) {
+		struct wlr_scene_surface *scene_surface =
+			wlr_scene_surface_from_node(node);
+		user_iterator(scene_surface->surface, lx, ly, user_data);
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		scene_node_for_each_surface(child, lx, ly, user_iterator, user_data);
+	}
+}
+
+void wlr_scene_node_for_each_surface(struct wlr_scene_node *node,
+		wlr_surface_iterator_func_t user_iterator, void *user_data) {
+	int lx = 0, ly = 0;
+	if (node->parent != NULL && !wlr_scene_node_coords(node->parent,
+			&lx, &ly)) {
+		return;
+	}
+	scene_node_for_each_surface(node, lx, ly, user_iterator, user_data);
+}
+
+struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
+		double lx, double ly, double *nx, double *ny) {
+	if (!node->state.enabled) {
+		return NULL;
+	}
+
+	lx -= node->state.x;
+	ly -= node->state.y;
+
+	struct wlr_scene_node *child;
+	wl_list_for_each_reverse(child, &node->state.children, state.link) {
+		struct wlr_scene_node *node_at =
+			wlr_scene_node_at(child, lx, ly, nx, ny);
+		if (node_at != NULL) {
+			return node_at;
+		}
+	}
+
+	bool intersects = false;
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		break;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_scene_surface *scene_surface =
+			wlr_scene_surface_from_node(node);
+		intersects = wlr_surface_point_accepts_input(scene_surface->surface,
+			lx, ly);
+		break;
+	case WLR_SCENE_NODE_RECT:
+	case WLR_SCENE_NODE_BUFFER:;
+		int width, height;
+		scene_node_get_size(node, &width, &height);
+		intersects = lx >= 0 && lx < width && ly >= 0 && ly < height;
+		break;
+	}
+
+	if (!intersects) {
+		return NULL;
+	}
+	if (nx != NULL) {
+		*nx = lx;
+	}
+	if (ny != NULL) {
+		*ny = ly;
+	}
+	return node;
+}
+
+/*
+ * Subsurface trees mirror a surface's subsurfaces with one tree node per
+ * surface, holding a surface node and one child tree per subsurface. The
+ * children are restacked and moved each time the surface commits, since
+ * that's when subsurface positions and stacking order are applied.
+ */
+struct scene_subsurface_tree {
+	struct wlr_scene_tree *tree;
+	struct wlr_surface *surface;
+	struct wlr_scene_surface *scene_surface;
+	struct wlr_subsurface *subsurface; // NULL for the root surface
+
+	struct wl_listener tree_destroy;
+	struct wl_listener surface_destroy;
+	struct wl_listener surface_commit;
+	struct wl_listener surface_new_subsurface;
+	struct wl_listener subsurface_destroy;
+	struct wl_listener subsurface_map;
+	struct wl_listener subsurface_unmap;
+};
+
+static struct scene_subsurface_tree *scene_subsurface_tree_create(
+	struct wlr_scene_node *parent, struct wlr_surface *surface,
+	struct wlr_subsurface *subsurface);
+
+static void subsurface_tree_handle_tree_destroy(struct wl_listener *listener,
+		void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, tree_destroy);
+	wl_list_remove(&subsurface_tree->tree_destroy.link);
+	wl_list_remove(&subsurface_tree->surface_destroy.link);
+	wl_list_remove(&subsurface_tree->surface_commit.link);
+	wl_list_remove(&subsurface_tree->surface_new_subsurface.link);
+	wl_list_remove(&subsurface_tree->subsurface_destroy.link);
+	wl_list_remove(&subsurface_tree->subsurface_map.link);
+	wl_list_remove(&subsurface_tree->subsurface_unmap.link);
+	free(subsurface_tree);
+}
+
+static void subsurface_tree_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, surface_destroy);
+	wlr_scene_node_destroy(&subsurface_tree->tree->node);
+}
+
+static void subsurface_tree_handle_subsurface_destroy(
+		struct wl_listener *listener, void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, subsurface_destroy);
+	wlr_scene_node_destroy(&subsurface_tree->tree->node);
+}
+
+static void subsurface_tree_handle_subsurface_map(struct wl_listener *listener,
+		void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, subsurface_map);
+	wlr_scene_node_set_enabled(&subsurface_tree->tree->node, true);
+}
+
+static void subsurface_tree_handle_subsurface_unmap(
+		struct wl_listener *listener, void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, subsurface_unmap);
+	wlr_scene_node_set_enabled(&subsurface_tree->tree->node, false);
+}
+
+static struct scene_subsurface_tree *subsurface_tree_get_child(
+		struct scene_subsurface_tree *subsurface_tree,
+		struct wlr_subsurface *subsurface) {
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &subsurface_tree->tree->node.state.children,
+			state.link) {
+		if (child->type != WLR_SCENE_NODE_TREE) {
+			continue;
+		}
+		struct scene_subsurface_tree *child_tree = child->data;
+		if (child_tree->subsurface == subsurface) {
+			return child_tree;
+		}
+	}
+	return NULL;
+}
+
+static void subsurface_tree_reconfigure(
+		struct scene_subsurface_tree *subsurface_tree) {
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &subsurface_tree->surface->subsurfaces,
+			parent_link) {
+		struct scene_subsurface_tree *child =
+			subsurface_tree_get_child(subsurface_tree, subsurface);
+		if (child == NULL) {
+			continue;
+		}
+		wlr_scene_node_set_position(&child->tree->node,
+			subsurface->current.x, subsurface->current.y);
+		wlr_scene_node_raise_to_top(&child->tree->node);
+	}
+}
+
+static void subsurface_tree_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, surface_commit);
+	subsurface_tree_reconfigure(subsurface_tree);
+}
+
+static bool subsurface_tree_add_child(
+		struct scene_subsurface_tree *subsurface_tree,
+		struct wlr_subsurface *subsurface) {
+	struct scene_subsurface_tree *child = scene_subsurface_tree_create(
+		&subsurface_tree->tree->node, subsurface->surface, subsurface);
+	if (child == NULL) {
+		return false;
+	}
+
+	wlr_scene_node_set_position(&child->tree->node,
+		subsurface->current.x, subsurface->current.y);
+	wlr_scene_node_set_enabled(&child->tree->node, subsurface->mapped);
+
+	child->subsurface_destroy.notify =
+		subsurface_tree_handle_subsurface_destroy;
+	wl_signal_add(&subsurface->events.destroy, &child->subsurface_destroy);
+
+	child->subsurface_map.notify = subsurface_tree_handle_subsurface_map;
+	wl_signal_add(&subsurface->events.map, &child->subsurface_map);
+
+	child->subsurface_unmap.notify = subsurface_tree_handle_subsurface_unmap;
+	wl_signal_add(&subsurface->events.unmap, &child->subsurface_unmap);
+
+	return true;
+}
+
+static void subsurface_tree_handle_surface_new_subsurface(
+		struct wl_listener *listener, void *data) {
+	struct scene_subsurface_tree *subsurface_tree =
+		wl_container_of(listener, subsurface_tree, surface_new_subsurface);
+	struct wlr_subsurface *subsurface = data;
+	if (!subsurface_tree_add_child(subsurface_tree, subsurface)) {
+		wlr_log(WLR_ERROR, "Failed to add subsurface to scene-graph");
+	}
+}
+
+static struct scene_subsurface_tree *scene_subsurface_tree_create(
+		struct wlr_scene_node *parent, struct wlr_surface *surface,
+		struct wlr_subsurface *subsurface) {
+	struct scene_subsurface_tree *subsurface_tree =
+		calloc(1, sizeof(struct scene_subsurface_tree));
+	if (subsurface_tree == NULL) {
+		return NULL;
+	}
+
+	subsurface_tree->tree = wlr_scene_tree_create(parent);
+	if (subsurface_tree->tree == NULL) {
+		goto error_subsurface_tree;
+	}
+	subsurface_tree->tree->node.data = subsurface_tree;
+
+	subsurface_tree->scene_surface =
+		wlr_scene_surface_create(&subsurface_tree->tree->node, surface);
+	if (subsurface_tree->scene_surface == NULL) {
+		goto error_tree;
+	}
+
+	subsurface_tree->surface = surface;
+	subsurface_tree->subsurface = subsurface;
+
+	// Only children of this tree are subsurface trees, the listeners must be
+	// set up before creating them so that destroying the tree works
+	subsurface_tree->tree_destroy.notify = subsurface_tree_handle_tree_destroy;
+	wl_signal_add(&subsurface_tree->tree->node.events.destroy,
+		&subsurface_tree->tree_destroy);
+
+	subsurface_tree->surface_destroy.notify =
+		subsurface_tree_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &subsurface_tree->surface_destroy);
+
+	subsurface_tree->surface_commit.notify =
+		subsurface_tree_handle_surface_commit;
+	wl_signal_add(&surface->events.commit, &subsurface_tree->surface_commit);
+
+	subsurface_tree->surface_new_subsurface.notify =
+		subsurface_tree_handle_surface_new_subsurface;
+	wl_signal_add(&surface->events.new_subsurface,
+		&subsurface_tree->surface_new_subsurface);
+
+	// Set up by the parent tree for subsurfaces
+	wl_list_init(&subsurface_tree->subsurface_destroy.link);
+	wl_list_init(&subsurface_tree->subsurface_map.link);
+	wl_list_init(&subsurface_tree->subsurface_unmap.link);
+
+	struct wlr_subsurface *child;
+	wl_list_for_each(child, &surface->subsurfaces, parent_link) {
+		if (!subsurface_tree_add_child(subsurface_tree, child)) {
+			wlr_scene_node_destroy(&subsurface_tree->tree->node);
+			return NULL;
+		}
+	}
+
+	return subsurface_tree;
+
+error_tree:
+	wlr_scene_node_destroy(&subsurface_tree->tree->node);
+error_subsurface_tree:
+	free(subsurface_tree);
+	return NULL;
+}
+
+struct wlr_scene_node *wlr_scene_subsurface_tree_create(
+		struct wlr_scene_node *parent, struct wlr_surface *surface) {
+	struct scene_subsurface_tree *subsurface_tree =
+		scene_subsurface_tree_create(parent, surface, NULL);
+	if (subsurface_tree == NULL) {
+		return NULL;
+	}
+	return &subsurface_tree->tree->node;
+}
+
+static void scene_output_handle_damage_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_output *scene_output =
+		wl_container_of(listener, scene_output, damage_destroy);
+	// The output damage is being destroyed along with the output
+	scene_output_destroy(scene_output);
+}
+
+struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
+		struct wlr_output *output) {
+	assert(wlr_scene_get_scene_output(scene, output) == NULL);
+
+	struct wlr_scene_output *scene_output =
+		calloc(1, sizeof(struct wlr_scene_output));
+	if (scene_output == NULL) {
+		return NULL;
+	}
+
+	scene_output->damage = wlr_output_damage_create(output);
+	if (scene_output->damage == NULL) {
+		free(scene_output);
+		return NULL;
+	}
+
+	scene_output->output = output;
+	scene_output->scene = scene;
+	wl_list_insert(&scene->outputs, &scene_output->link);
+
+	scene_output->damage_destroy.notify = scene_output_handle_damage_destroy;
+	wl_signal_add(&scene_output->damage->events.destroy,
+		&scene_output->damage_destroy);
+
+	wlr_output_damage_add_whole(scene_output->damage);
+
+	return scene_output;
+}
+
+static void scene_output_destroy(struct wlr_scene_output *scene_output) {
+	if (scene_output->hidden_frame_timer != NULL) {
+		wl_event_source_remove(scene_output->hidden_frame_timer);
+	}
+	wl_list_remove(&scene_output->damage_destroy.link);
+	wl_list_remove(&scene_output->link);
+	free(scene_output);
+}
+
+void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
+	if (scene_output == NULL) {
+		return;
+	}
+	struct wlr_output_damage *damage = scene_output->damage;
+	scene_output_destroy(scene_output);
+	wlr_output_damage_destroy(damage);
+}
+
+struct wlr_scene_output *wlr_scene_get_scene_output(struct wlr_scene *scene,
+		struct wlr_output *output) {
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		if (scene_output->output == output) {
+			return scene_output;
+		}
+	}
+	return NULL;
+}
+
+void wlr_scene_output_set_position(struct wlr_scene_output *scene_output,
+		int lx, int ly) {
+	if (scene_output->x == lx && scene_output->y == ly) {
+		return;
+	}
+
+	scene_output->x = lx;
+	scene_output->y = ly;
+	wlr_output_damage_add_whole(scene_output->damage);
+}
+
+/*
+ * Nodes visible on an output are collected in rendering order. Each entry
+ * first holds the opaque region of the node, which is then replaced by the
+ * union of the opaque regions of the entries above it, so that rendering can
+ * skip what will be covered anyway.
+ *
+ * Entries which are damaged and not fully occluded then get a snapshot of
+ * what to draw, so that rendering doesn't look at the scene-graph anymore.
+ * Textures are only imported or uploaded for these. Their buffers are
+ * referenced until the list is finished: a referenced buffer's texture is
+ * neither updated in place by a commit nor evicted, so the texture stays
+ * valid and unchanged even if the node is destroyed or its surface commits
+ * while the frame is being drawn.
+ */
+struct render_entry {
+	struct wlr_scene_node *node;
+	struct wlr_box box; // output-local coordinates
+	pixman_region32_t occluded;
+
+	bool snapshotted; // whether the fields below are set
+	struct wlr_buffer *buffer; // referenced, NULL for rects
+	struct wlr_texture *texture; // NULL for rects
+	struct wlr_fbox src_box;
+	enum wl_output_transform transform;
+	float color[4];
+};
+
+struct render_list {
+	struct wl_array entries; // struct render_entry
+	size_t len;
+};
+
+static void render_list_finish(struct render_list *list) {
+	struct render_entry *entries = list->entries.data;
+	for (size_t i = 0; i < list->len; ++i) {
+		pixman_region32_fini(&entries[i].occluded);
+		if (entries[i].buffer != NULL) {
+			wlr_buffer_unref(entries[i].buffer);
+		}
+	}
+	wl_array_release(&list->entries);
+}
+
+// Returns whether the node may have something to draw, without importing or
+// uploading anything
+static bool node_has_content(struct wlr_scene_node *node) {
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		return false;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_surface *surface = wlr_scene_surface_from_node(node)->surface;
+		return wlr_surface_has_buffer(surface);
+	case WLR_SCENE_NODE_RECT:
+		return true;
+	case WLR_SCENE_NODE_BUFFER:
+		return scene_buffer_from_node(node)->buffer != NULL;
+	}
+	return false;
+}
+
+// Fills the snapshot of the entry's node. Returns false if there is nothing
+// to draw.
+static bool render_entry_snapshot(struct render_entry *entry,
+		struct wlr_renderer *renderer) {
+	switch (entry->node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		return false;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_surface *surface =
+			wlr_scene_surface_from_node(entry->node)->surface;
+		entry->texture = wlr_surface_get_texture_for_renderer(surface,
+			renderer);
+		if (entry->texture == NULL) {
+			return false;
+		}
+		entry->buffer = wlr_buffer_ref(surface->buffer);
+		entry->transform =
+			wlr_output_transform_invert(surface->current.transform);
+		wlr_surface_get_buffer_source_box(surface, &entry->src_box);
+		return true;
+	case WLR_SCENE_NODE_RECT:
+		memcpy(entry->color, scene_rect_from_node(entry->node)->color,
+			sizeof(entry->color));
+		entry->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+		return true;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_buffer *buffer =
+			scene_buffer_from_node(entry->node)->buffer;
+		if (buffer == NULL) {
+			return false;
+		}
+		wlr_buffer_finish_upload(buffer);
+		entry->texture = wlr_buffer_get_texture(buffer, renderer);
+		if (entry->texture == NULL) {
+			return false;
+		}
+		entry->buffer = wlr_buffer_ref(buffer);
+		entry->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+		int width, height;
+		wlr_texture_get_size(entry->texture, &width, &height);
+		entry->src_box = (struct wlr_fbox){ .width = width, .height = height };
+		return true;
+	}
+	return false;
+}
+
+static void scene_output_get_opaque_region(
+		struct wlr_scene_output *scene_output, struct wlr_scene_node *node,
+		const struct wlr_box *box, pixman_region32_t *opaque) {
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		break;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_surface *surface =
+			wlr_scene_surface_from_node(node)->surface;
+		if (!wlr_surface_has_buffer(surface) || surface->current.width <= 0 ||
+				surface->current.height <= 0) {
+			break;
+		}
+		// Scale to the box actually drawn, rounding inwards so that
+		// fractional scales can't make the region too large
+		wlr_region_scale_xy_inner(opaque, &surface->opaque_region,
+			(float)box->width / surface->current.width,
+			(float)box->height / surface->current.height);
+		pixman_region32_translate(opaque, box->x, box->y);
+		pixman_region32_intersect_rect(opaque, opaque,
+			box->x, box->y, box->width, box->height);
+		break;
+	case WLR_SCENE_NODE_RECT:;
+		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
+		if (scene_rect->color[3] == 1.0f) {
+			pixman_region32_union_rect(opaque, opaque,
+				box->x, box->y, box->width, box->height);
+		}
+		break;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_buffer *buffer = scene_buffer_from_node(node)->buffer;
+		if (buffer != NULL && buffer->texture != NULL &&
+				wlr_texture_is_opaque(buffer->texture)) {
+			pixman_region32_union_rect(opaque, opaque,
+				box->x, box->y, box->width, box->height);
+		}
+		break;
+	}
+}
+
+static bool scene_output_collect(struct wlr_scene_output *scene_output,
+		struct wlr_scene_node *node, int lx, int ly,
+		struct render_list *list) {
+	if (!node->state.enabled) {
+		return true;
+	}
+
+	lx += node->state.x;
+	ly += node->state.y;
+
+	int width, height;
+	scene_node_get_size(node, &width, &height);
+
+	struct wlr_box box;
+	scene_output_get_box(scene_output, lx, ly, width, height, &box);
+
+	int ow, oh;
+	wlr_output_transformed_resolution(scene_output->output, &ow, &oh);
+	struct wlr_box output_box = { .width = ow, .height = oh };
+	struct wlr_box intersection;
+	if (width > 0 && height > 0 &&
+			wlr_box_intersection(&intersection, &box, &output_box) &&
+			node_has_content(node)) {
+		struct render_entry *entry =
+			wl_array_add(&list->entries, sizeof(*entry));
+		if (entry == NULL) {
+			return false;
+		}
+		*entry = (struct render_entry){ .node = node, .box = box };
+		pixman_region32_init(&entry->occluded);
+		scene_output_get_opaque_region(scene_output, node, &box,
+			&entry->occluded);
+		list->len++;
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		if (!scene_output_collect(scene_output, child, lx, ly, list)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Collects the nodes visible on the output and computes the region occluding
+// each of them. `total` is set to the union of all opaque regions.
+static bool scene_output_build_render_list(
+		struct wlr_scene_output *scene_output, struct render_list *list,
+		pixman_region32_t *total) {
+	wl_array_init(&list->entries);
+	list->len = 0;
+
+	if (!scene_output_collect(scene_output, &scene_output->scene->node,
+			0, 0, list)) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		render_list_finish(list);
+		return false;
+	}
+
+	struct render_entry *entries = list->entries.data;
+	for (size_t i = list->len; i-- > 0;) {
+		pixman_region32_t opaque = entries[i].occluded;
+		pixman_region32_init(&entries[i].occluded);
+		pixman_region32_copy(&entries[i].occluded, total);
+		pixman_region32_union(total, total, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+	return true;
+}
+
+// Returns whether some of the entry is damaged and not occluded
+static bool render_entry_is_damaged(struct render_entry *entry,
+		pixman_region32_t *output_damage) {
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, entry->box.x, entry->box.y,
+		entry->box.width, entry->box.height);
+	pixman_region32_intersect(&damage, &damage, output_damage);
+	pixman_region32_subtract(&damage, &damage, &entry->occluded);
+	bool damaged = pixman_region32_not_empty(&damage);
+	pixman_region32_fini(&damage);
+	return damaged;
+}
+
+// Snapshots the entries which will be drawn. Nodes outside of the damage
+// don't get their texture imported nor their upload finished.
+static void render_list_snapshot(struct render_list *list,
+		struct wlr_renderer *renderer, pixman_region32_t *damage) {
+	struct render_entry *entries = list->entries.data;
+	for (size_t i = 0; i < list->len; ++i) {
+		struct render_entry *entry = &entries[i];
+		if (render_entry_is_damaged(entry, damage)) {
+			entry->snapshotted = render_entry_snapshot(entry, renderer);
+		}
+	}
+}
+
+static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+	wlr_box_transform(&box, &box, transform, ow, oh);
+
+	wlr_renderer_scissor(renderer, &box);
+}
+
+static void render_entry(struct wlr_output *output,
+		struct render_entry *entry, pixman_region32_t *output_damage) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	if (!entry->snapshotted) {
+		return;
+	}
+
+	struct wlr_box *box = &entry->box;
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_union_rect(&damage, &damage, box->x, box->y,
+		box->width, box->height);
+	pixman_region32_intersect(&damage, &damage, output_damage);
+	pixman_region32_subtract(&damage, &damage, &entry->occluded);
+	if (!pixman_region32_not_empty(&damage)) {
+		goto damage_finish;
+	}
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, box, entry->transform, 0.0,
+		output->transform_matrix);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(output, &rects[i]);
+		if (entry->texture == NULL) {
+			wlr_render_quad_with_matrix(renderer, entry->color, matrix);
+		} else {
+			wlr_render_subtexture_with_matrix(renderer, entry->texture,
+				&entry->src_box, matrix, 1.0);
+		}
+	}
+
+damage_finish:
+	pixman_region32_fini(&damage);
+}
+
+// Displays the topmost surface's buffer as-is if it's the only thing visible
+// on the output
+static bool scene_output_scan_out(struct wlr_scene_output *scene_output,
+		struct render_list *list) {
+	struct wlr_output *output = scene_output->output;
+	if (list->len == 0) {
+		return false;
+	}
+
+	struct render_entry *entries = list->entries.data;
+	struct render_entry *top = &entries[list->len - 1];
+	if (top->node->type != WLR_SCENE_NODE_SURFACE) {
+		return false;
+	}
+
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+	if (top->box.x != 0 || top->box.y != 0 ||
+			top->box.width != ow || top->box.height != oh) {
+		return false;
+	}
+
+	// Anything below must be hidden by the surface
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	scene_output_get_opaque_region(scene_output, top->node, &top->box,
+		&opaque);
+	pixman_box32_t output_rect = { 0, 0, ow, oh };
+	bool covered = pixman_region32_contains_rectangle(&opaque,
+		&output_rect) == PIXMAN_REGION_IN;
+	pixman_region32_fini(&opaque);
+	if (list->len > 1 && !covered) {
+		return false;
+	}
+
+	struct wlr_surface *surface =
+		wlr_scene_surface_from_node(top->node)->surface;
+	if (surface->buffer == NULL ||
+			surface->current.viewport.has_src ||
+			surface->current.viewport.has_dst ||
+			surface->current.transform != output->transform ||
+			(float)surface->current.scale != output->scale) {
+		return false;
+	}
+
+	return wlr_output_attach_buffer(output, surface->buffer);
+}
+
+// Draws the damaged part of the output from the snapshots of the render list
+// only, without accessing the scene-graph
+static void scene_output_render(struct wlr_output *output,
+		struct render_list *list, pixman_region32_t *damage,
+		pixman_region32_t *opaque) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	wlr_renderer_begin(renderer, output->width, output->height);
+
+	if (pixman_region32_not_empty(damage)) {
+		pixman_region32_t clear_damage;
+		pixman_region32_init(&clear_damage);
+		pixman_region32_subtract(&clear_damage, damage, opaque);
+
+		int nrects;
+		pixman_box32_t *rects =
+			pixman_region32_rectangles(&clear_damage, &nrects);
+		for (int i = 0; i < nrects; ++i) {
+			scissor_output(output, &rects[i]);
+			wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 1.0 });
+		}
+		pixman_region32_fini(&clear_damage);
+
+		struct render_entry *entries = list->entries.data;
+		for (size_t i = 0; i < list->len; ++i) {
+			render_entry(output, &entries[i], damage);
+		}
+	}
+
+	wlr_output_render_software_cursors(output, damage);
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_end(renderer);
+}
+
+bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+
+	if (!output->enabled) {
+		return true;
+	}
+
+	struct render_list list;
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	if (!scene_output_build_render_list(scene_output, &list, &opaque)) {
+		pixman_region32_fini(&opaque);
+		return false;
+	}
+
+	bool ok = false;
+	bool needs_swap;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (!wlr_output_damage_make_current(scene_output->damage, &needs_swap,
+			&damage)) {
+		goto out;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (!needs_swap) {
+		// Output isn't damaged, skip rendering completely
+		ok = true;
+		goto out;
+	}
+
+	if (scene_output_scan_out(scene_output, &list)) {
+		// The client buffer is displayed as-is, skip rendering completely
+		ok = wlr_output_damage_swap_buffers(scene_output->damage, &now,
+			&damage);
+		goto out;
+	}
+
+	render_list_snapshot(&list, wlr_backend_get_renderer(output->backend),
+		&damage);
+	scene_output_render(output, &list, &damage, &opaque);
+
+	int width, height;
+	wlr_output_transformed_resolution(output, &width, &height);
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+	wlr_region_transform(&damage, &damage, transform, width, height);
+
+	ok = wlr_output_damage_swap_buffers(scene_output->damage, &now, &damage);
+
+out:
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&opaque);
+	render_list_finish(&list);
+	return ok;
+}
+
+static int handle_hidden_frame_timer(void *data) {
+	struct wlr_scene_output *scene_output = data;
+	wlr_output_schedule_frame(scene_output->output);
+	return 0;
+}
+
+void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
+		struct timespec *now) {
+	struct render_list list;
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	bool has_list =
+		scene_output_build_render_list(scene_output, &list, &opaque);
+	pixman_region32_fini(&opaque);
+	if (!has_list) {
+		return;
+	}
+
+	int interval = scene_output->hidden_frame_interval;
+	int delay = 0; // msec until the first throttled surface is due
+	struct render_entry *entries = list.entries.data;
+	for (size_t i = 0; i < list.len; ++i) {
+		struct render_entry *entry = &entries[i];
+		if (entry->node->type != WLR_SCENE_NODE_SURFACE) {
+			continue;
+		}
+		struct wlr_surface *surface =
+			wlr_scene_surface_from_node(entry->node)->surface;
+
+		int surface_delay;
+		if (interval > 0 && wlr_surface_has_buffer(surface) &&
+				wlr_surface_is_occluded(surface, &entry->box,
+					&entry->occluded)) {
+			surface_delay =
+				wlr_surface_send_frame_done_throttled(surface, now, interval);
+		} else {
+			surface_delay = wlr_surface_send_frame_done(surface, now);
+		}
+		if (surface_delay > 0 && (delay == 0 || surface_delay < delay)) {
+			delay = surface_delay;
+		}
+	}
+	render_list_finish(&list);
+
+	if (delay == 0) {
+		return;
+	}
+
+	// Nothing may damage the output until throttled surfaces are due
+	if (scene_output->hidden_frame_timer == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(scene_output->output->display);
+		scene_output->hidden_frame_timer = wl_event_loop_add_timer(loop,
+			handle_hidden_frame_timer, scene_output);
+		if (scene_output->hidden_frame_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create hidden frame timer");
+			return;
+		}
+	}
+	wl_event_source_timer_update(scene_output->hidden_frame_timer, delay);
+}
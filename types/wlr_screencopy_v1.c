@@ -1,14 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_foreign_toplevel_management_v1.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_screencopy_v1.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/backend.h>
 #include <wlr/util/log.h>
 #include "wlr-screencopy-unstable-v1-protocol.h"
+#include "wlroots-scaled-screencopy-unstable-v1-protocol.h"
+#include "wlroots-toplevel-screencopy-unstable-v1-protocol.h"
 #include "util/signal.h"
 
-#define SCREENCOPY_MANAGER_VERSION 1
+#define SCREENCOPY_MANAGER_VERSION 3
+#define TOPLEVEL_SCREENCOPY_MANAGER_VERSION 3
+#define SCALED_SCREENCOPY_MANAGER_VERSION 3
+
+// Output damage accumulated since a client's previous copy
+struct screencopy_damage {
+	struct wl_list link; // wlr_screencopy_v1_client::damages
+	struct wlr_output *output;
+	pixman_region32_t damage; // output-buffer-local coordinates
+	// Hardware cursor composited into the previous copy, empty if none
+	struct wlr_box cursor_box;
+	struct wl_listener output_swap_buffers;
+	struct wl_listener output_destroy;
+};
+
+// Toplevel damage accumulated since a client's previous copy
+struct screencopy_toplevel_damage {
+	struct wl_list link; // wlr_screencopy_v1_client::toplevel_damages
+	struct wlr_surface *surface;
+	pixman_region32_t damage; // surface-local coordinates
+	// Surfaces of the tree at the previous commit, to damage moves
+	pixman_region32_t layout;
+	struct wl_listener surface_commit;
+	struct wl_listener surface_destroy;
+};
+
+// State shared by a manager resource and the frames created from it
+struct wlr_screencopy_v1_client {
+	int ref;
+	struct wlr_screencopy_manager_v1 *manager;
+	struct wl_list damages; // screencopy_damage::link
+	struct wl_list toplevel_damages; // screencopy_toplevel_damage::link
+};
+
+static void screencopy_damage_destroy(struct screencopy_damage *damage) {
+	wl_list_remove(&damage->link);
+	wl_list_remove(&damage->output_swap_buffers.link);
+	wl_list_remove(&damage->output_destroy.link);
+	pixman_region32_fini(&damage->damage);
+	free(damage);
+}
+
+static void screencopy_damage_handle_output_swap_buffers(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_damage *damage =
+		wl_container_of(listener, damage, output_swap_buffers);
+	struct wlr_output_event_swap_buffers *event = data;
+	if (event->damage != NULL) {
+		pixman_region32_union(&damage->damage, &damage->damage, event->damage);
+	} else {
+		pixman_region32_union_rect(&damage->damage, &damage->damage, 0, 0,
+			damage->output->width, damage->output->height);
+	}
+	pixman_region32_intersect_rect(&damage->damage, &damage->damage, 0, 0,
+		damage->output->width, damage->output->height);
+}
+
+static void screencopy_damage_handle_output_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_damage *damage =
+		wl_container_of(listener, damage, output_destroy);
+	screencopy_damage_destroy(damage);
+}
+
+static struct screencopy_damage *screencopy_damage_get_or_create(
+		struct wlr_screencopy_v1_client *client, struct wlr_output *output) {
+	struct screencopy_damage *damage;
+	wl_list_for_each(damage, &client->damages, link) {
+		if (damage->output == output) {
+			return damage;
+		}
+	}
+
+	damage = calloc(1, sizeof(struct screencopy_damage));
+	if (damage == NULL) {
+		return NULL;
+	}
+	damage->output = output;
+	// Nothing has been copied yet, the whole output is damaged
+	pixman_region32_init_rect(&damage->damage, 0, 0,
+		output->width, output->height);
+	wl_list_insert(&client->damages, &damage->link);
+
+	// Frames are registered after this listener, so the damage of a buffer
+	// swap is already accumulated when frames are copied
+	wl_signal_add(&output->events.swap_buffers, &damage->output_swap_buffers);
+	damage->output_swap_buffers.notify =
+		screencopy_damage_handle_output_swap_buffers;
+	wl_signal_add(&output->events.destroy, &damage->output_destroy);
+	damage->output_destroy.notify = screencopy_damage_handle_output_destroy;
+
+	return damage;
+}
+
+static struct screencopy_damage *screencopy_damage_find(
+		struct wlr_screencopy_v1_client *client, struct wlr_output *output) {
+	struct screencopy_damage *damage;
+	wl_list_for_each(damage, &client->damages, link) {
+		if (damage->output == output) {
+			return damage;
+		}
+	}
+	return NULL;
+}
+
+static void screencopy_toplevel_damage_destroy(
+		struct screencopy_toplevel_damage *damage) {
+	wl_list_remove(&damage->link);
+	wl_list_remove(&damage->surface_commit.link);
+	wl_list_remove(&damage->surface_destroy.link);
+	pixman_region32_fini(&damage->damage);
+	pixman_region32_fini(&damage->layout);
+	free(damage);
+}
+
+static void toplevel_damage_add_surface_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct screencopy_toplevel_damage *damage = data;
+
+	pixman_region32_t surface_damage;
+	pixman_region32_init(&surface_damage);
+	wlr_surface_get_effective_damage(surface, &surface_damage);
+	pixman_region32_translate(&surface_damage, sx, sy);
+	pixman_region32_union(&damage->damage, &damage->damage, &surface_damage);
+	pixman_region32_fini(&surface_damage);
+}
+
+static void toplevel_layout_add_surface_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	pixman_region32_t *layout = data;
+	pixman_region32_union_rect(layout, layout, sx, sy,
+		surface->current.width, surface->current.height);
+}
+
+static void screencopy_toplevel_damage_handle_surface_commit(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_toplevel_damage *damage =
+		wl_container_of(listener, damage, surface_commit);
+
+	// Sub-surface damage is only accounted for when the toplevel is
+	// committed, which is also when frames are copied
+	wlr_surface_for_each_surface(damage->surface,
+		toplevel_damage_add_surface_iterator, damage);
+
+	pixman_region32_t layout;
+	pixman_region32_init(&layout);
+	wlr_surface_for_each_surface(damage->surface,
+		toplevel_layout_add_surface_iterator, &layout);
+	if (!pixman_region32_equal(&layout, &damage->layout)) {
+		pixman_region32_union(&damage->damage, &damage->damage,
+			&damage->layout);
+		pixman_region32_union(&damage->damage, &damage->damage, &layout);
+		pixman_region32_copy(&damage->layout, &layout);
+	}
+	pixman_region32_fini(&layout);
+}
+
+static void screencopy_toplevel_damage_handle_surface_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_toplevel_damage *damage =
+		wl_container_of(listener, damage, surface_destroy);
+	screencopy_toplevel_damage_destroy(damage);
+}
+
+static struct screencopy_toplevel_damage *screencopy_toplevel_damage_find(
+		struct wlr_screencopy_v1_client *client, struct wlr_surface *surface) {
+	struct screencopy_toplevel_damage *damage;
+	wl_list_for_each(damage, &client->toplevel_damages, link) {
+		if (damage->surface == surface) {
+			return damage;
+		}
+	}
+	return NULL;
+}
+
+static struct screencopy_toplevel_damage *
+		screencopy_toplevel_damage_get_or_create(
+		struct wlr_screencopy_v1_client *client, struct wlr_surface *surface) {
+	struct screencopy_toplevel_damage *damage =
+		screencopy_toplevel_damage_find(client, surface);
+	if (damage != NULL) {
+		return damage;
+	}
+
+	damage = calloc(1, sizeof(struct screencopy_toplevel_damage));
+	if (damage == NULL) {
+		return NULL;
+	}
+	damage->surface = surface;
+	// Nothing has been copied yet, the whole toplevel is damaged
+	pixman_region32_init(&damage->layout);
+	wlr_surface_for_each_surface(surface,
+		toplevel_layout_add_surface_iterator, &damage->layout);
+	pixman_region32_init(&damage->damage);
+	pixman_region32_copy(&damage->damage, &damage->layout);
+	wl_list_insert(&client->toplevel_damages, &damage->link);
+
+	// Frames are registered after this listener, so the damage of a commit is
+	// already accumulated when frames are copied
+	wl_signal_add(&surface->events.commit, &damage->surface_commit);
+	damage->surface_commit.notify =
+		screencopy_toplevel_damage_handle_surface_commit;
+	wl_signal_add(&surface->events.destroy, &damage->surface_destroy);
+	damage->surface_destroy.notify =
+		screencopy_toplevel_damage_handle_surface_destroy;
+
+	return damage;
+}
+
+static void client_unref(struct wlr_screencopy_v1_client *client) {
+	assert(client->ref > 0);
+	if (--client->ref > 0) {
+		return;
+	}
+	struct screencopy_damage *damage, *tmp;
+	wl_list_for_each_safe(damage, tmp, &client->damages, link) {
+		screencopy_damage_destroy(damage);
+	}
+	struct screencopy_toplevel_damage *toplevel_damage, *toplevel_tmp;
+	wl_list_for_each_safe(toplevel_damage, toplevel_tmp,
+			&client->toplevel_damages, link) {
+		screencopy_toplevel_damage_destroy(toplevel_damage);
+	}
+	free(client);
+}
 
 static const struct zwlr_screencopy_frame_v1_interface frame_impl;
 
@@ -26,14 +261,182 @@ static void frame_destroy(struct wlr_screencopy_frame_v1 *frame) {
 	if (frame->cursor_locked) {
 		wlr_output_lock_software_cursors(frame->output, false);
 	}
+	if (frame->render_locked) {
+		wlr_output_lock_attach_render(frame->output, false);
+	}
 	wl_list_remove(&frame->link);
 	wl_list_remove(&frame->output_swap_buffers.link);
+	wl_list_remove(&frame->output_hardware_cursor.link);
+	wl_list_remove(&frame->output_frame.link);
 	wl_list_remove(&frame->buffer_destroy.link);
+	wl_list_remove(&frame->surface_commit.link);
+	wl_list_remove(&frame->surface_destroy.link);
+	wlr_renderer_readback_destroy(frame->readback);
+	client_unref(frame->client);
 	// Make the frame resource inert
 	wl_resource_set_user_data(frame->resource, NULL);
 	free(frame);
 }
 
+static bool frame_is_scaled(struct wlr_screencopy_frame_v1 *frame) {
+	return frame->width != frame->box.width ||
+		frame->height != frame->box.height;
+}
+
+// Once the frame has been captured, the output doesn't need to be locked
+static void frame_release_locks(struct wlr_screencopy_frame_v1 *frame) {
+	if (frame->cursor_locked) {
+		wlr_output_lock_software_cursors(frame->output, false);
+		frame->cursor_locked = false;
+	}
+	if (frame->render_locked) {
+		wlr_output_lock_attach_render(frame->output, false);
+		frame->render_locked = false;
+	}
+}
+
+static void frame_send_ready(struct wlr_screencopy_frame_v1 *frame,
+		uint32_t flags, const struct timespec *when) {
+	zwlr_screencopy_frame_v1_send_flags(frame->resource, flags);
+
+	if (frame->with_damage) {
+		zwlr_screencopy_frame_v1_send_damage(frame->resource,
+			frame->damage.x, frame->damage.y,
+			frame->damage.width, frame->damage.height);
+	}
+
+	time_t tv_sec = when->tv_sec;
+	uint32_t tv_sec_hi = (sizeof(tv_sec) > 4) ? tv_sec >> 32 : 0;
+	uint32_t tv_sec_lo = tv_sec & 0xFFFFFFFF;
+	zwlr_screencopy_frame_v1_send_ready(frame->resource,
+		tv_sec_hi, tv_sec_lo, when->tv_nsec);
+
+	frame_destroy(frame);
+}
+
+static void frame_handle_output_frame(struct wl_listener *listener,
+		void *_data) {
+	struct wlr_screencopy_frame_v1 *frame =
+		wl_container_of(listener, frame, output_frame);
+
+	struct wl_shm_buffer *buffer = frame->buffer;
+	assert(buffer != NULL);
+
+	int32_t stride = wl_shm_buffer_get_stride(buffer);
+
+	// Partial copies must keep the orientation of the previous ones, only
+	// accept y-inverted data when the whole frame is copied
+	wl_shm_buffer_begin_access(buffer);
+	void *data = wl_shm_buffer_get_data(buffer);
+	uint32_t flags = 0;
+	bool ok = wlr_renderer_readback_finish(frame->readback,
+		frame->with_damage ? NULL : &flags, stride,
+		frame->damage.x, frame->damage.y, data);
+	wl_shm_buffer_end_access(buffer);
+
+	if (!ok) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	frame_send_ready(frame, flags, &frame->readback_when);
+}
+
+// Draws the hardware cursor into the DMA-BUF the output has been copied to
+static bool frame_render_hardware_cursor(
+		struct wlr_screencopy_frame_v1 *frame) {
+	struct wlr_output *output = frame->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	if (!wlr_renderer_bind_offscreen(renderer, &frame->dma_buffer->attributes,
+			frame->width, frame->height)) {
+		return false;
+	}
+	wlr_renderer_begin(renderer, frame->width, frame->height);
+	wlr_output_render_hardware_cursor(output, &frame->box);
+	wlr_renderer_end(renderer);
+	// Restores the output's viewport for the listeners reading it after us
+	wlr_renderer_unbind_offscreen(renderer);
+	return true;
+}
+
+static void frame_handle_output_hardware_cursor(struct wl_listener *listener,
+		void *data) {
+	struct wlr_screencopy_frame_v1 *frame =
+		wl_container_of(listener, frame, output_hardware_cursor);
+	if (wl_list_empty(&frame->output_swap_buffers.link)) {
+		return;
+	}
+	// Cursor changes don't damage the output, but the copy needs them
+	frame->output->needs_swap = true;
+	wlr_output_schedule_frame(frame->output);
+}
+
+// Scales the region down on the GPU, so that only the scaled pixels are read
+// back. The whole frame is copied each time.
+static void frame_copy_scaled(struct wlr_screencopy_frame_v1 *frame,
+		const struct timespec *when) {
+	struct wlr_output *output = frame->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer);
+
+	frame->damage = (struct wlr_box){
+		.width = frame->width,
+		.height = frame->height,
+	};
+
+	struct wlr_dmabuf_attributes *dmabuf = frame->dma_buffer != NULL ?
+		&frame->dma_buffer->attributes : NULL;
+	if (!wlr_renderer_bind_offscreen_scaled(renderer, &frame->box, dmabuf,
+			frame->width, frame->height)) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	uint32_t flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+	bool ok = true;
+	bool pending = false;
+	if (frame->buffer != NULL) {
+		struct wl_shm_buffer *buffer = frame->buffer;
+		enum wl_shm_format fmt = wl_shm_buffer_get_format(buffer);
+		int32_t stride = wl_shm_buffer_get_stride(buffer);
+
+		frame->readback = wlr_renderer_read_pixels_async(renderer, fmt,
+			frame->width, frame->height, 0, 0);
+		if (frame->readback != NULL) {
+			pending = true;
+		} else {
+			wl_shm_buffer_begin_access(buffer);
+			void *data = wl_shm_buffer_get_data(buffer);
+			ok = wlr_renderer_read_pixels(renderer, fmt, &flags, stride,
+				frame->width, frame->height, 0, 0, 0, 0, data);
+			wl_shm_buffer_end_access(buffer);
+		}
+	}
+
+	// The output's viewport is restored for the listeners reading it after us
+	wlr_renderer_unbind_offscreen(renderer);
+
+	if (!ok) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	if (pending) {
+		frame->readback_when = *when;
+		wl_signal_add(&output->events.frame, &frame->output_frame);
+		frame->output_frame.notify = frame_handle_output_frame;
+		frame_release_locks(frame);
+		return;
+	}
+
+	frame_send_ready(frame, flags, when);
+}
+
 static void frame_handle_output_swap_buffers(struct wl_listener *listener,
 		void *_data) {
 	struct wlr_screencopy_frame_v1 *frame =
@@ -43,25 +446,105 @@ static void frame_handle_output_swap_buffers(struct wl_listener *listener,
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
 	assert(renderer);
 
+	frame->damage = (struct wlr_box){
+		.width = frame->width,
+		.height = frame->height,
+	};
+	struct screencopy_damage *damage =
+		screencopy_damage_find(frame->client, output);
+	bool overlay_hardware_cursor =
+		frame->overlay_cursor && !frame->cursor_locked;
+	struct wlr_box cursor_box = {0};
+	if (overlay_hardware_cursor) {
+		wlr_output_get_hardware_cursor_box(output, &cursor_box);
+	}
+	if (damage != NULL && overlay_hardware_cursor) {
+		// The cursor has to be erased from where it was in the previous copy
+		pixman_region32_union_rect(&damage->damage, &damage->damage,
+			damage->cursor_box.x, damage->cursor_box.y,
+			damage->cursor_box.width, damage->cursor_box.height);
+		pixman_region32_union_rect(&damage->damage, &damage->damage,
+			cursor_box.x, cursor_box.y, cursor_box.width, cursor_box.height);
+	}
+	if (damage != NULL) {
+		if (frame->with_damage) {
+			pixman_region32_t region;
+			pixman_region32_init(&region);
+			pixman_region32_intersect_rect(&region, &damage->damage,
+				frame->box.x, frame->box.y,
+				frame->box.width, frame->box.height);
+			if (!pixman_region32_not_empty(&region)) {
+				// Wait for the frame to be damaged
+				pixman_region32_fini(&region);
+				return;
+			}
+			pixman_box32_t *extents = pixman_region32_extents(&region);
+			frame->damage = (struct wlr_box){
+				.x = extents->x1 - frame->box.x,
+				.y = extents->y1 - frame->box.y,
+				.width = extents->x2 - extents->x1,
+				.height = extents->y2 - extents->y1,
+			};
+			pixman_region32_fini(&region);
+		}
+		pixman_region32_clear(&damage->damage);
+		if (overlay_hardware_cursor) {
+			damage->cursor_box = cursor_box;
+		}
+	}
+
 	wl_list_remove(&frame->output_swap_buffers.link);
 	wl_list_init(&frame->output_swap_buffers.link);
 
-	int x = frame->box.x;
-	int y = frame->box.y;
+	if (frame_is_scaled(frame)) {
+		frame_copy_scaled(frame, event->when);
+		return;
+	}
+
+	int x = frame->box.x + frame->damage.x;
+	int y = frame->box.y + frame->damage.y;
+	int width = frame->damage.width;
+	int height = frame->damage.height;
+
+	if (frame->dma_buffer != NULL) {
+		uint32_t flags = 0;
+		if (!wlr_renderer_blit_dmabuf(renderer, &frame->dma_buffer->attributes,
+				&flags, width, height, x, y,
+				frame->damage.x, frame->damage.y) ||
+				(overlay_hardware_cursor &&
+				!frame_render_hardware_cursor(frame))) {
+			zwlr_screencopy_frame_v1_send_failed(frame->resource);
+			frame_destroy(frame);
+			return;
+		}
+		frame_send_ready(frame, flags, event->when);
+		return;
+	}
 
 	struct wl_shm_buffer *buffer = frame->buffer;
 	assert(buffer != NULL);
 
 	enum wl_shm_format fmt = wl_shm_buffer_get_format(buffer);
-	int32_t width = wl_shm_buffer_get_width(buffer);
-	int32_t height = wl_shm_buffer_get_height(buffer);
 	int32_t stride = wl_shm_buffer_get_stride(buffer);
 
+	// Don't stall the pipeline if possible: start the transfer now and copy
+	// the pixels into the client buffer once the frame has been presented
+	frame->readback = wlr_renderer_read_pixels_async(renderer, fmt,
+		width, height, x, y);
+	if (frame->readback != NULL) {
+		frame->readback_when = *event->when;
+		wl_signal_add(&output->events.frame, &frame->output_frame);
+		frame->output_frame.notify = frame_handle_output_frame;
+		frame_release_locks(frame);
+		return;
+	}
+
 	wl_shm_buffer_begin_access(buffer);
 	void *data = wl_shm_buffer_get_data(buffer);
 	uint32_t flags = 0;
-	bool ok = wlr_renderer_read_pixels(renderer, fmt, &flags, stride,
-		width, height, x, y, 0, 0, data);
+	bool ok = wlr_renderer_read_pixels(renderer, fmt,
+		frame->with_damage ? NULL : &flags, stride, width, height, x, y,
+		frame->damage.x, frame->damage.y, data);
 	wl_shm_buffer_end_access(buffer);
 
 	if (!ok) {
@@ -70,14 +553,132 @@ static void frame_handle_output_swap_buffers(struct wl_listener *listener,
 		return;
 	}
 
-	zwlr_screencopy_frame_v1_send_flags(frame->resource, flags);
+	frame_send_ready(frame, flags, event->when);
+}
 
-	time_t tv_sec = event->when->tv_sec;
-	uint32_t tv_sec_hi = (sizeof(tv_sec) > 4) ? tv_sec >> 32 : 0;
-	uint32_t tv_sec_lo = tv_sec & 0xFFFFFFFF;
-	zwlr_screencopy_frame_v1_send_ready(frame->resource,
-		tv_sec_hi, tv_sec_lo, event->when->tv_nsec);
+static void frame_render_surface_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct wlr_screencopy_frame_v1 *frame = data;
+	struct wlr_renderer *renderer = frame->surface->renderer;
+
+	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	if (texture == NULL) {
+		return;
+	}
+
+	struct wlr_box box = {
+		.x = sx * frame->scale - frame->box.x,
+		.y = sy * frame->scale - frame->box.y,
+		.width = surface->current.width * frame->scale,
+		.height = surface->current.height * frame->scale,
+	};
+
+	float projection[9];
+	wlr_matrix_projection(projection, frame->box.width, frame->box.height,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+
+	float matrix[9];
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(surface->current.transform);
+	wlr_matrix_project_box(matrix, &box, transform, 0, projection);
+
+	struct wlr_fbox src_box;
+	wlr_surface_get_buffer_source_box(surface, &src_box);
+
+	wlr_render_subtexture_with_matrix(renderer, texture, &src_box, matrix, 1.0);
+}
+
+static void frame_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct wlr_screencopy_frame_v1 *frame =
+		wl_container_of(listener, frame, surface_commit);
+	struct wlr_renderer *renderer = frame->surface->renderer;
+
+	frame->damage = (struct wlr_box){
+		.width = frame->box.width,
+		.height = frame->box.height,
+	};
+	struct screencopy_toplevel_damage *damage =
+		screencopy_toplevel_damage_find(frame->client, frame->surface);
+	if (damage != NULL) {
+		if (frame->with_damage) {
+			pixman_region32_t region;
+			pixman_region32_init(&region);
+			pixman_region32_intersect_rect(&region, &damage->damage,
+				frame->box.x / frame->scale, frame->box.y / frame->scale,
+				frame->box.width / frame->scale,
+				frame->box.height / frame->scale);
+			if (!pixman_region32_not_empty(&region)) {
+				// Wait for the toplevel to be damaged
+				pixman_region32_fini(&region);
+				return;
+			}
+			pixman_box32_t *extents = pixman_region32_extents(&region);
+			frame->damage = (struct wlr_box){
+				.x = extents->x1 * frame->scale - frame->box.x,
+				.y = extents->y1 * frame->scale - frame->box.y,
+				.width = (extents->x2 - extents->x1) * frame->scale,
+				.height = (extents->y2 - extents->y1) * frame->scale,
+			};
+			pixman_region32_fini(&region);
+		}
+		pixman_region32_clear(&damage->damage);
+	}
+
+	wl_list_remove(&frame->surface_commit.link);
+	wl_list_init(&frame->surface_commit.link);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// Only the surface tree is rendered, the cost doesn't depend on outputs
+	struct wlr_dmabuf_attributes *dmabuf = frame->dma_buffer != NULL ?
+		&frame->dma_buffer->attributes : NULL;
+	if (!wlr_renderer_bind_offscreen(renderer, dmabuf,
+			frame->box.width, frame->box.height)) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	float color[4] = { 0.0, 0.0, 0.0, 0.0 };
+	wlr_renderer_begin(renderer, frame->box.width, frame->box.height);
+	wlr_renderer_clear(renderer, color);
+	wlr_surface_for_each_surface(frame->surface,
+		frame_render_surface_iterator, frame);
+	wlr_renderer_end(renderer);
+
+	// The whole frame is read back, the damage is only reported
+	uint32_t flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+	bool ok = true;
+	if (frame->buffer != NULL) {
+		struct wl_shm_buffer *buffer = frame->buffer;
+		enum wl_shm_format fmt = wl_shm_buffer_get_format(buffer);
+		int32_t stride = wl_shm_buffer_get_stride(buffer);
+
+		wl_shm_buffer_begin_access(buffer);
+		void *pixels = wl_shm_buffer_get_data(buffer);
+		ok = wlr_renderer_read_pixels(renderer, fmt, &flags, stride,
+			frame->box.width, frame->box.height, 0, 0, 0, 0, pixels);
+		wl_shm_buffer_end_access(buffer);
+	}
+
+	wlr_renderer_unbind_offscreen(renderer);
+
+	if (!ok) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	frame_send_ready(frame, flags, &now);
+}
 
+static void frame_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_screencopy_frame_v1 *frame =
+		wl_container_of(listener, frame, surface_destroy);
+	zwlr_screencopy_frame_v1_send_failed(frame->resource);
 	frame_destroy(frame);
 }
 
@@ -89,30 +690,42 @@ static void frame_handle_buffer_destroy(struct wl_listener *listener,
 	frame_destroy(frame);
 }
 
-static void frame_handle_copy(struct wl_client *client,
-		struct wl_resource *frame_resource,
-		struct wl_resource *buffer_resource) {
-	struct wlr_screencopy_frame_v1 *frame = frame_from_resource(frame_resource);
-	if (frame == NULL) {
-		return;
-	}
+static bool frame_check_shm_buffer(struct wlr_screencopy_frame_v1 *frame,
+		struct wl_shm_buffer *buffer) {
+	enum wl_shm_format fmt = wl_shm_buffer_get_format(buffer);
+	int32_t width = wl_shm_buffer_get_width(buffer);
+	int32_t height = wl_shm_buffer_get_height(buffer);
+	int32_t stride = wl_shm_buffer_get_stride(buffer);
+	return fmt == frame->format && width == frame->width &&
+		height == frame->height && stride == frame->stride;
+}
 
+static bool frame_check_dma_buffer(struct wlr_screencopy_frame_v1 *frame,
+		struct wlr_dmabuf_v1_buffer *dma_buffer) {
+	struct wlr_dmabuf_attributes *attribs = &dma_buffer->attributes;
+	return frame->fourcc != 0 && attribs->format == frame->fourcc &&
+		attribs->width == frame->width &&
+		attribs->height == frame->height;
+}
+
+static void frame_copy(struct wlr_screencopy_frame_v1 *frame,
+		struct wl_resource *buffer_resource, bool with_damage) {
 	struct wlr_output *output = frame->output;
 
 	struct wl_shm_buffer *buffer = wl_shm_buffer_get(buffer_resource);
-	if (buffer == NULL) {
+	struct wlr_dmabuf_v1_buffer *dma_buffer = NULL;
+	if (buffer == NULL && wlr_dmabuf_v1_resource_is_buffer(buffer_resource)) {
+		dma_buffer = wlr_dmabuf_v1_buffer_from_buffer_resource(buffer_resource);
+	}
+	if (buffer == NULL && dma_buffer == NULL) {
 		wl_resource_post_error(frame->resource,
 			ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
 			"unsupported buffer type");
 		return;
 	}
 
-	enum wl_shm_format fmt = wl_shm_buffer_get_format(buffer);
-	int32_t width = wl_shm_buffer_get_width(buffer);
-	int32_t height = wl_shm_buffer_get_height(buffer);
-	int32_t stride = wl_shm_buffer_get_stride(buffer);
-	if (fmt != frame->format || width != frame->box.width ||
-			height != frame->box.height || stride != frame->stride) {
+	if ((buffer != NULL && !frame_check_shm_buffer(frame, buffer)) ||
+			(dma_buffer != NULL && !frame_check_dma_buffer(frame, dma_buffer))) {
 		wl_resource_post_error(frame->resource,
 			ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
 			"invalid buffer attributes");
@@ -120,7 +733,7 @@ static void frame_handle_copy(struct wl_client *client,
 	}
 
 	if (!wl_list_empty(&frame->output_swap_buffers.link) ||
-			frame->buffer != NULL) {
+			frame->buffer != NULL || frame->dma_buffer != NULL) {
 		wl_resource_post_error(frame->resource,
 			ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED,
 			"frame already used");
@@ -128,23 +741,87 @@ static void frame_handle_copy(struct wl_client *client,
 	}
 
 	frame->buffer = buffer;
+	frame->dma_buffer = dma_buffer;
+	frame->with_damage = with_damage;
+
+	wl_resource_add_destroy_listener(buffer_resource, &frame->buffer_destroy);
+	frame->buffer_destroy.notify = frame_handle_buffer_destroy;
+
+	if (frame->surface != NULL) {
+		wl_signal_add(&frame->surface->events.commit, &frame->surface_commit);
+		frame->surface_commit.notify = frame_handle_surface_commit;
+		return;
+	}
 
 	wl_signal_add(&output->events.swap_buffers, &frame->output_swap_buffers);
 	frame->output_swap_buffers.notify = frame_handle_output_swap_buffers;
 
-	wl_resource_add_destroy_listener(buffer_resource, &frame->buffer_destroy);
-	frame->buffer_destroy.notify = frame_handle_buffer_destroy;
+	// Pixels are read back from the renderer, so the frame must be composited
+	wlr_output_lock_attach_render(output, true);
+	frame->render_locked = true;
 
-	// Schedule a buffer swap
-	output->needs_swap = true;
-	wlr_output_schedule_frame(output);
+	// The hardware cursor can only be drawn into unscaled DMA-BUF copies
+	bool overlay_hardware_cursor = frame->overlay_cursor &&
+		dma_buffer != NULL && !frame_is_scaled(frame);
 
-	if (frame->overlay_cursor) {
+	// Schedule a buffer swap, unless waiting for damage which hasn't happened
+	// yet
+	struct screencopy_damage *damage =
+		screencopy_damage_find(frame->client, output);
+	bool damaged = true;
+	if (with_damage && damage != NULL) {
+		pixman_region32_t region;
+		pixman_region32_init(&region);
+		pixman_region32_intersect_rect(&region, &damage->damage,
+			frame->box.x, frame->box.y, frame->box.width, frame->box.height);
+		damaged = pixman_region32_not_empty(&region);
+		pixman_region32_fini(&region);
+
+		// Hardware cursor changes don't show up in the output damage
+		struct wlr_box cursor_box = {0};
+		if (overlay_hardware_cursor) {
+			wlr_output_get_hardware_cursor_box(output, &cursor_box);
+			damaged = damaged || memcmp(&cursor_box, &damage->cursor_box,
+				sizeof(cursor_box)) != 0;
+		}
+	}
+	if (damaged) {
+		output->needs_swap = true;
+		wlr_output_schedule_frame(output);
+	}
+
+	if (overlay_hardware_cursor) {
+		// The hardware cursor is drawn into the copy only
+		wl_signal_add(&output->events.hardware_cursor,
+			&frame->output_hardware_cursor);
+		frame->output_hardware_cursor.notify =
+			frame_handle_output_hardware_cursor;
+	} else if (frame->overlay_cursor) {
 		wlr_output_lock_software_cursors(output, true);
 		frame->cursor_locked = true;
 	}
 }
 
+static void frame_handle_copy(struct wl_client *client,
+		struct wl_resource *frame_resource,
+		struct wl_resource *buffer_resource) {
+	struct wlr_screencopy_frame_v1 *frame = frame_from_resource(frame_resource);
+	if (frame == NULL) {
+		return;
+	}
+	frame_copy(frame, buffer_resource, false);
+}
+
+static void frame_handle_copy_with_damage(struct wl_client *client,
+		struct wl_resource *frame_resource,
+		struct wl_resource *buffer_resource) {
+	struct wlr_screencopy_frame_v1 *frame = frame_from_resource(frame_resource);
+	if (frame == NULL) {
+		return;
+	}
+	frame_copy(frame, buffer_resource, true);
+}
+
 static void frame_handle_destroy(struct wl_client *client,
 		struct wl_resource *frame_resource) {
 	wl_resource_destroy(frame_resource);
@@ -153,6 +830,7 @@ static void frame_handle_destroy(struct wl_client *client,
 static const struct zwlr_screencopy_frame_v1_interface frame_impl = {
 	.copy = frame_handle_copy,
 	.destroy = frame_handle_destroy,
+	.copy_with_damage = frame_handle_copy_with_damage,
 };
 
 static void frame_handle_resource_destroy(struct wl_resource *frame_resource) {
@@ -163,17 +841,28 @@ static void frame_handle_resource_destroy(struct wl_resource *frame_resource) {
 
 static const struct zwlr_screencopy_manager_v1_interface manager_impl;
 
-static struct wlr_screencopy_manager_v1 *manager_from_resource(
+static struct wlr_screencopy_v1_client *client_from_resource(
 		struct wl_resource *resource) {
 	assert(wl_resource_instance_of(resource,
 		&zwlr_screencopy_manager_v1_interface, &manager_impl));
 	return wl_resource_get_user_data(resource);
 }
 
-static void capture_output(struct wl_client *client,
-		struct wlr_screencopy_manager_v1 *manager, uint32_t version, uint32_t id,
+static uint32_t convert_wl_shm_format_to_drm(enum wl_shm_format fmt) {
+	switch (fmt) {
+	case WL_SHM_FORMAT_XRGB8888:
+		return DRM_FORMAT_XRGB8888;
+	case WL_SHM_FORMAT_ARGB8888:
+		return DRM_FORMAT_ARGB8888;
+	default:
+		return (uint32_t)fmt;
+	}
+}
+
+static void capture_output(struct wl_client *wl_client,
+		struct wlr_screencopy_v1_client *client, uint32_t version, uint32_t id,
 		int32_t overlay_cursor, struct wlr_output *output,
-		const struct wlr_box *box) {
+		const struct wlr_box *box, int32_t width, int32_t height) {
 	struct wlr_box buffer_box = {0};
 	if (box == NULL) {
 		buffer_box.width = output->width;
@@ -182,7 +871,11 @@ static void capture_output(struct wl_client *client,
 		int ow, oh;
 		wlr_output_effective_resolution(output, &ow, &oh);
 
-		buffer_box = *box;
+		// Only the part of the region inside the output is read back
+		struct wlr_box output_box = { .width = ow, .height = oh };
+		if (!wlr_box_intersection(&buffer_box, box, &output_box)) {
+			buffer_box = (struct wlr_box){0};
+		}
 
 		wlr_box_transform(&buffer_box, &buffer_box, output->transform, ow, oh);
 		buffer_box.x *= output->scale;
@@ -194,27 +887,34 @@ static void capture_output(struct wl_client *client,
 	struct wlr_screencopy_frame_v1 *frame =
 		calloc(1, sizeof(struct wlr_screencopy_frame_v1));
 	if (frame == NULL) {
-		wl_client_post_no_memory(client);
+		wl_client_post_no_memory(wl_client);
 		return;
 	}
-	frame->manager = manager;
+	frame->manager = client->manager;
+	frame->client = client;
+	client->ref++;
 	frame->output = output;
 	frame->overlay_cursor = !!overlay_cursor;
 
-	frame->resource = wl_resource_create(client,
+	frame->resource = wl_resource_create(wl_client,
 		&zwlr_screencopy_frame_v1_interface, version, id);
 	if (frame->resource == NULL) {
+		client_unref(client);
 		free(frame);
-		wl_client_post_no_memory(client);
+		wl_client_post_no_memory(wl_client);
 		return;
 	}
 	wl_resource_set_implementation(frame->resource, &frame_impl, frame,
 		frame_handle_resource_destroy);
 
-	wl_list_insert(&manager->frames, &frame->link);
+	wl_list_insert(&client->manager->frames, &frame->link);
 
 	wl_list_init(&frame->output_swap_buffers.link);
+	wl_list_init(&frame->output_hardware_cursor.link);
+	wl_list_init(&frame->output_frame.link);
 	wl_list_init(&frame->buffer_destroy.link);
+	wl_list_init(&frame->surface_commit.link);
+	wl_list_init(&frame->surface_destroy.link);
 
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
 	assert(renderer);
@@ -225,11 +925,40 @@ static void capture_output(struct wl_client *client,
 		goto error;
 	}
 
+	if (screencopy_damage_get_or_create(client, output) == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		goto error;
+	}
+
+	if (wlr_box_empty(&buffer_box)) {
+		goto error;
+	}
 	frame->box = buffer_box;
-	frame->stride = 4 * buffer_box.width; // TODO: depends on read format
+	// The region is never scaled up
+	frame->width = width > 0 && width < buffer_box.width ?
+		width : buffer_box.width;
+	frame->height = height > 0 && height < buffer_box.height ?
+		height : buffer_box.height;
+	if (frame_is_scaled(frame) &&
+			renderer->impl->bind_offscreen_scaled == NULL) {
+		wlr_log(WLR_DEBUG, "Failed to capture scaled output region: "
+			"scaling not supported by renderer");
+		goto error;
+	}
+	frame->stride = 4 * frame->width; // TODO: depends on read format
 
 	zwlr_screencopy_frame_v1_send_buffer(frame->resource, frame->format,
-		buffer_box.width, buffer_box.height, frame->stride);
+		frame->width, frame->height, frame->stride);
+
+	if (version >= ZWLR_SCREENCOPY_FRAME_V1_LINUX_DMABUF_SINCE_VERSION) {
+		// DMA-BUFs are filled on the GPU, in the same layout as read pixels
+		if (renderer->impl->blit_dmabuf != NULL) {
+			frame->fourcc = convert_wl_shm_format_to_drm(frame->format);
+			zwlr_screencopy_frame_v1_send_linux_dmabuf(frame->resource,
+				frame->fourcc, frame->width, frame->height);
+		}
+		zwlr_screencopy_frame_v1_send_buffer_done(frame->resource);
+	}
 	return;
 
 error:
@@ -240,20 +969,53 @@ error:
 static void manager_handle_capture_output(struct wl_client *client,
 		struct wl_resource *manager_resource, uint32_t id,
 		int32_t overlay_cursor, struct wl_resource *output_resource) {
-	struct wlr_screencopy_manager_v1 *manager =
-		manager_from_resource(manager_resource);
+	struct wlr_screencopy_v1_client *screencopy_client =
+		client_from_resource(manager_resource);
 	uint32_t version = wl_resource_get_version(manager_resource);
 	struct wlr_output *output = wlr_output_from_resource(output_resource);
 
-	capture_output(client, manager, version, id, overlay_cursor, output, NULL);
+	capture_output(client, screencopy_client, version, id, overlay_cursor,
+		output, NULL, 0, 0);
 }
 
 static void manager_handle_capture_output_region(struct wl_client *client,
 		struct wl_resource *manager_resource, uint32_t id,
 		int32_t overlay_cursor, struct wl_resource *output_resource,
 		int32_t x, int32_t y, int32_t width, int32_t height) {
-	struct wlr_screencopy_manager_v1 *manager =
-		manager_from_resource(manager_resource);
+	struct wlr_screencopy_v1_client *screencopy_client =
+		client_from_resource(manager_resource);
+	uint32_t version = wl_resource_get_version(manager_resource);
+	struct wlr_output *output = wlr_output_from_resource(output_resource);
+
+	struct wlr_box box = {
+		.x = x,
+		.y = y,
+		.width = width,
+		.height = height,
+	};
+	capture_output(client, screencopy_client, version, id, overlay_cursor,
+		output, &box, 0, 0);
+}
+
+static const struct zwlroots_scaled_screencopy_manager_v1_interface
+	scaled_manager_impl;
+
+static struct wlr_screencopy_v1_client *client_from_scaled_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource,
+		&zwlroots_scaled_screencopy_manager_v1_interface,
+		&scaled_manager_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static void scaled_manager_handle_capture_output_region_scaled(
+		struct wl_client *client, struct wl_resource *manager_resource,
+		uint32_t id, int32_t overlay_cursor,
+		struct wl_resource *output_resource, int32_t x, int32_t y,
+		int32_t width, int32_t height, int32_t buffer_width,
+		int32_t buffer_height) {
+	struct wlr_screencopy_v1_client *screencopy_client =
+		client_from_scaled_resource(manager_resource);
 	uint32_t version = wl_resource_get_version(manager_resource);
 	struct wlr_output *output = wlr_output_from_resource(output_resource);
 
@@ -263,7 +1025,107 @@ static void manager_handle_capture_output_region(struct wl_client *client,
 		.width = width,
 		.height = height,
 	};
-	capture_output(client, manager, version, id, overlay_cursor, output, &box);
+	capture_output(client, screencopy_client, version, id, overlay_cursor,
+		output, &box, buffer_width, buffer_height);
+}
+
+static const struct zwlroots_toplevel_screencopy_manager_v1_interface
+	toplevel_manager_impl;
+
+static struct wlr_screencopy_v1_client *client_from_toplevel_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource,
+		&zwlroots_toplevel_screencopy_manager_v1_interface,
+		&toplevel_manager_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static void toplevel_manager_handle_capture_toplevel(
+		struct wl_client *wl_client, struct wl_resource *manager_resource,
+		uint32_t id, struct wl_resource *toplevel_resource) {
+	struct wlr_screencopy_v1_client *client =
+		client_from_toplevel_resource(manager_resource);
+	uint32_t version = wl_resource_get_version(manager_resource);
+	struct wlr_foreign_toplevel_handle_v1 *toplevel =
+		wlr_foreign_toplevel_handle_v1_from_resource(toplevel_resource);
+
+	struct wlr_screencopy_frame_v1 *frame =
+		calloc(1, sizeof(struct wlr_screencopy_frame_v1));
+	if (frame == NULL) {
+		wl_client_post_no_memory(wl_client);
+		return;
+	}
+	frame->manager = client->manager;
+	frame->client = client;
+	client->ref++;
+
+	frame->resource = wl_resource_create(wl_client,
+		&zwlr_screencopy_frame_v1_interface, version, id);
+	if (frame->resource == NULL) {
+		client_unref(client);
+		free(frame);
+		wl_client_post_no_memory(wl_client);
+		return;
+	}
+	wl_resource_set_implementation(frame->resource, &frame_impl, frame,
+		frame_handle_resource_destroy);
+
+	wl_list_insert(&client->manager->frames, &frame->link);
+
+	wl_list_init(&frame->output_swap_buffers.link);
+	wl_list_init(&frame->output_frame.link);
+	wl_list_init(&frame->buffer_destroy.link);
+	wl_list_init(&frame->surface_commit.link);
+	wl_list_init(&frame->surface_destroy.link);
+
+	struct wlr_surface *surface = toplevel != NULL ? toplevel->surface : NULL;
+	if (surface == NULL) {
+		goto error;
+	}
+	struct wlr_renderer *renderer = surface->renderer;
+	if (renderer->impl->bind_offscreen == NULL) {
+		wlr_log(WLR_DEBUG, "Failed to capture toplevel: "
+			"offscreen rendering not supported by renderer");
+		goto error;
+	}
+
+	frame->surface = surface;
+	wl_signal_add(&surface->events.destroy, &frame->surface_destroy);
+	frame->surface_destroy.notify = frame_handle_surface_destroy;
+
+	if (screencopy_toplevel_damage_get_or_create(client, surface) == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		goto error;
+	}
+
+	// The frame has the surface's scale, like the buffers of the toplevel
+	frame->scale = surface->current.scale > 0 ? surface->current.scale : 1;
+	wlr_surface_get_extends(surface, &frame->box);
+	frame->box.x *= frame->scale;
+	frame->box.y *= frame->scale;
+	frame->box.width *= frame->scale;
+	frame->box.height *= frame->scale;
+	if (frame->box.width <= 0 || frame->box.height <= 0) {
+		goto error;
+	}
+	frame->width = frame->box.width;
+	frame->height = frame->box.height;
+
+	// Pixels are read from a renderer-allocated RGBA texture
+	frame->format = WL_SHM_FORMAT_ABGR8888;
+	frame->stride = 4 * frame->width;
+
+	zwlr_screencopy_frame_v1_send_buffer(frame->resource, frame->format,
+		frame->width, frame->height, frame->stride);
+	frame->fourcc = DRM_FORMAT_ABGR8888;
+	zwlr_screencopy_frame_v1_send_linux_dmabuf(frame->resource,
+		frame->fourcc, frame->width, frame->height);
+	zwlr_screencopy_frame_v1_send_buffer_done(frame->resource);
+	return;
+
+error:
+	zwlr_screencopy_frame_v1_send_failed(frame->resource);
+	frame_destroy(frame);
 }
 
 static void manager_handle_destroy(struct wl_client *client,
@@ -277,26 +1139,125 @@ static const struct zwlr_screencopy_manager_v1_interface manager_impl = {
 	.destroy = manager_handle_destroy,
 };
 
-void manager_handle_resource_destroy(struct wl_resource *resource) {
+static const struct zwlroots_scaled_screencopy_manager_v1_interface
+		scaled_manager_impl = {
+	.capture_output_region_scaled =
+		scaled_manager_handle_capture_output_region_scaled,
+	.destroy = manager_handle_destroy,
+};
+
+static const struct zwlroots_toplevel_screencopy_manager_v1_interface
+		toplevel_manager_impl = {
+	.capture_toplevel = toplevel_manager_handle_capture_toplevel,
+	.destroy = manager_handle_destroy,
+};
+
+static void manager_handle_resource_destroy(struct wl_resource *resource) {
+	struct wlr_screencopy_v1_client *client = client_from_resource(resource);
+	wl_list_remove(wl_resource_get_link(resource));
+	client_unref(client);
+}
+
+static void toplevel_manager_handle_resource_destroy(
+		struct wl_resource *resource) {
+	struct wlr_screencopy_v1_client *client =
+		client_from_toplevel_resource(resource);
+	wl_list_remove(wl_resource_get_link(resource));
+	client_unref(client);
+}
+
+static void scaled_manager_handle_resource_destroy(
+		struct wl_resource *resource) {
+	struct wlr_screencopy_v1_client *client =
+		client_from_scaled_resource(resource);
 	wl_list_remove(wl_resource_get_link(resource));
+	client_unref(client);
+}
+
+static struct wlr_screencopy_v1_client *client_create(
+		struct wlr_screencopy_manager_v1 *manager) {
+	struct wlr_screencopy_v1_client *client =
+		calloc(1, sizeof(struct wlr_screencopy_v1_client));
+	if (client == NULL) {
+		return NULL;
+	}
+	client->ref = 1;
+	client->manager = manager;
+	wl_list_init(&client->damages);
+	wl_list_init(&client->toplevel_damages);
+	return client;
 }
 
 static void manager_bind(struct wl_client *client, void *data, uint32_t version,
 		uint32_t id) {
 	struct wlr_screencopy_manager_v1 *manager = data;
 
+	struct wlr_screencopy_v1_client *screencopy_client = client_create(manager);
+	if (screencopy_client == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
 	struct wl_resource *resource = wl_resource_create(client,
 		&zwlr_screencopy_manager_v1_interface, version, id);
 	if (resource == NULL) {
+		free(screencopy_client);
 		wl_client_post_no_memory(client);
 		return;
 	}
-	wl_resource_set_implementation(resource, &manager_impl, manager,
+	wl_resource_set_implementation(resource, &manager_impl, screencopy_client,
 		manager_handle_resource_destroy);
 
 	wl_list_insert(&manager->resources, wl_resource_get_link(resource));
 }
 
+static void toplevel_manager_bind(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wlr_screencopy_manager_v1 *manager = data;
+
+	struct wlr_screencopy_v1_client *screencopy_client = client_create(manager);
+	if (screencopy_client == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	struct wl_resource *resource = wl_resource_create(client,
+		&zwlroots_toplevel_screencopy_manager_v1_interface, version, id);
+	if (resource == NULL) {
+		free(screencopy_client);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &toplevel_manager_impl,
+		screencopy_client, toplevel_manager_handle_resource_destroy);
+
+	wl_list_insert(&manager->toplevel_resources,
+		wl_resource_get_link(resource));
+}
+
+static void scaled_manager_bind(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wlr_screencopy_manager_v1 *manager = data;
+
+	struct wlr_screencopy_v1_client *screencopy_client = client_create(manager);
+	if (screencopy_client == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	struct wl_resource *resource = wl_resource_create(client,
+		&zwlroots_scaled_screencopy_manager_v1_interface, version, id);
+	if (resource == NULL) {
+		free(screencopy_client);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &scaled_manager_impl,
+		screencopy_client, scaled_manager_handle_resource_destroy);
+
+	wl_list_insert(&manager->scaled_resources, wl_resource_get_link(resource));
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_screencopy_manager_v1 *manager =
 		wl_container_of(listener, manager, display_destroy);
@@ -318,7 +1279,26 @@ struct wlr_screencopy_manager_v1 *wlr_screencopy_manager_v1_create(
 		free(manager);
 		return NULL;
 	}
+	manager->toplevel_global = wl_global_create(display,
+		&zwlroots_toplevel_screencopy_manager_v1_interface,
+		TOPLEVEL_SCREENCOPY_MANAGER_VERSION, manager, toplevel_manager_bind);
+	if (manager->toplevel_global == NULL) {
+		wl_global_destroy(manager->global);
+		free(manager);
+		return NULL;
+	}
+	manager->scaled_global = wl_global_create(display,
+		&zwlroots_scaled_screencopy_manager_v1_interface,
+		SCALED_SCREENCOPY_MANAGER_VERSION, manager, scaled_manager_bind);
+	if (manager->scaled_global == NULL) {
+		wl_global_destroy(manager->toplevel_global);
+		wl_global_destroy(manager->global);
+		free(manager);
+		return NULL;
+	}
 	wl_list_init(&manager->resources);
+	wl_list_init(&manager->toplevel_resources);
+	wl_list_init(&manager->scaled_resources);
 	wl_list_init(&manager->frames);
 
 	wl_signal_init(&manager->events.destroy);
@@ -344,6 +1324,16 @@ void wlr_screencopy_manager_v1_destroy(
 	wl_resource_for_each_safe(resource, tmp_resource, &manager->resources) {
 		wl_resource_destroy(resource);
 	}
+	wl_resource_for_each_safe(resource, tmp_resource,
+			&manager->toplevel_resources) {
+		wl_resource_destroy(resource);
+	}
+	wl_resource_for_each_safe(resource, tmp_resource,
+			&manager->scaled_resources) {
+		wl_resource_destroy(resource);
+	}
+	wl_global_destroy(manager->scaled_global);
+	wl_global_destroy(manager->toplevel_global);
 	wl_global_destroy(manager->global);
 	free(manager);
 }
@@ -21,6 +21,10 @@ struct screenshot_state {
 	struct wl_shm_buffer *shm_buffer;
 	struct wlr_screenshot *screenshot;
 	struct wl_listener frame_listener;
+
+	// Pending pixel read-out, finished on the next output frame
+	struct wlr_renderer_readback *readback;
+	struct wl_listener readback_listener;
 };
 
 static void screenshot_destroy(struct wlr_screenshot *screenshot) {
@@ -38,6 +42,30 @@ static void handle_screenshot_resource_destroy(
 	}
 }
 
+static void output_handle_readback_frame(struct wl_listener *listener,
+		void *_data) {
+	struct screenshot_state *state = wl_container_of(listener, state,
+		readback_listener);
+	struct wl_shm_buffer *shm_buffer = state->shm_buffer;
+
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+	wl_shm_buffer_begin_access(shm_buffer);
+	void *data = wl_shm_buffer_get_data(shm_buffer);
+	bool ok = wlr_renderer_readback_finish(state->readback, NULL, stride,
+		0, 0, data);
+	wl_shm_buffer_end_access(shm_buffer);
+
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Cannot read pixels");
+	} else {
+		orbital_screenshot_send_done(state->screenshot->resource);
+	}
+
+	wl_list_remove(&listener->link);
+	wlr_renderer_readback_destroy(state->readback);
+	free(state);
+}
+
 static void output_handle_frame(struct wl_listener *listener, void *_data) {
 	struct screenshot_state *state = wl_container_of(listener, state,
 		frame_listener);
@@ -49,6 +77,18 @@ static void output_handle_frame(struct wl_listener *listener, void *_data) {
 	int32_t width = wl_shm_buffer_get_width(shm_buffer);
 	int32_t height = wl_shm_buffer_get_height(shm_buffer);
 	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+
+	// Copy the pixels once the frame has been presented if the renderer
+	// supports it, so that the GPU isn't stalled
+	state->readback = wlr_renderer_read_pixels_async(renderer, format,
+		width, height, 0, 0);
+	if (state->readback != NULL) {
+		wl_list_remove(&listener->link);
+		state->readback_listener.notify = output_handle_readback_frame;
+		wl_signal_add(&output->events.frame, &state->readback_listener);
+		return;
+	}
+
 	wl_shm_buffer_begin_access(shm_buffer);
 	void *data = wl_shm_buffer_get_data(shm_buffer);
 	bool ok = wlr_renderer_read_pixels(renderer, format, NULL, stride,
@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <wlr/types/wlr_spatial_index.h>
+#include <wlr/util/log.h>
+
+#define DEFAULT_CELL_SIZE 256
+// Entries covering more cells than this are tested on every query instead
+#define MAX_ENTRY_CELLS 64
+
+static int cell_coord(struct wlr_spatial_index *index, int v) {
+	if (v >= 0) {
+		return v / index->cell_size;
+	}
+	return -((-v + index->cell_size - 1) / index->cell_size);
+}
+
+static struct wl_array *get_bucket(struct wlr_spatial_index *index,
+		int x, int y) {
+	uint32_t hash = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u);
+	return &index->buckets[hash % WLR_SPATIAL_INDEX_BUCKETS];
+}
+
+struct wlr_spatial_index *wlr_spatial_index_create(int cell_size) {
+	struct wlr_spatial_index *index =
+		calloc(1, sizeof(struct wlr_spatial_index));
+	if (index == NULL) {
+		return NULL;
+	}
+	index->cell_size = cell_size > 0 ? cell_size : DEFAULT_CELL_SIZE;
+	wl_list_init(&index->entries);
+	wl_list_init(&index->large_entries);
+	for (size_t i = 0; i < WLR_SPATIAL_INDEX_BUCKETS; ++i) {
+		wl_array_init(&index->buckets[i]);
+	}
+	wl_array_init(&index->candidates);
+	return index;
+}
+
+void wlr_spatial_index_destroy(struct wlr_spatial_index *index) {
+	if (index == NULL) {
+		return;
+	}
+	struct wlr_spatial_index_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &index->entries, link) {
+		wlr_spatial_index_entry_destroy(entry);
+	}
+	for (size_t i = 0; i < WLR_SPATIAL_INDEX_BUCKETS; ++i) {
+		wl_array_release(&index->buckets[i]);
+	}
+	wl_array_release(&index->candidates);
+	free(index);
+}
+
+static void entry_remove_cells(struct wlr_spatial_index_entry *entry) {
+	struct wlr_spatial_index *index = entry->index;
+
+	if (entry->large) {
+		wl_list_remove(&entry->large_link);
+		wl_list_init(&entry->large_link);
+		entry->large = false;
+		return;
+	}
+
+	for (int y = entry->cell_y1; y <= entry->cell_y2; ++y) {
+		for (int x = entry->cell_x1; x <= entry->cell_x2; ++x) {
+			struct wl_array *bucket = get_bucket(index, x, y);
+			struct wlr_spatial_index_cell_ref *refs = bucket->data;
+			size_t len = bucket->size / sizeof(*refs);
+			for (size_t i = 0; i < len; ++i) {
+				if (refs[i].entry == entry && refs[i].x == x &&
+						refs[i].y == y) {
+					refs[i] = refs[len - 1];
+					bucket->size -= sizeof(*refs);
+					break;
+				}
+			}
+		}
+	}
+
+	// Empty range
+	entry->cell_x1 = entry->cell_y1 = 0;
+	entry->cell_x2 = entry->cell_y2 = -1;
+}
+
+static void entry_add_cells(struct wlr_spatial_index_entry *entry) {
+	struct wlr_spatial_index *index = entry->index;
+	const struct wlr_box *box = &entry->box;
+	if (wlr_box_empty(box)) {
+		return;
+	}
+
+	int x1 = cell_coord(index, box->x);
+	int y1 = cell_coord(index, box->y);
+	int x2 = cell_coord(index, box->x + box->width - 1);
+	int y2 = cell_coord(index, box->y + box->height - 1);
+
+	if ((int64_t)(x2 - x1 + 1) * (y2 - y1 + 1) > MAX_ENTRY_CELLS) {
+		goto large;
+	}
+
+	for (int y = y1; y <= y2; ++y) {
+		for (int x = x1; x <= x2; ++x) {
+			struct wlr_spatial_index_cell_ref *ref =
+				wl_array_add(get_bucket(index, x, y), sizeof(*ref));
+			if (ref == NULL) {
+				wlr_log(WLR_ERROR, "Allocation failed");
+				// Only keep the cells added so far in the range to remove them
+				entry->cell_x1 = x1;
+				entry->cell_y1 = y1;
+				entry->cell_x2 = x2;
+				entry->cell_y2 = y;
+				entry_remove_cells(entry);
+				goto large;
+			}
+			ref->x = x;
+			ref->y = y;
+			ref->entry = entry;
+		}
+	}
+
+	entry->cell_x1 = x1;
+	entry->cell_y1 = y1;
+	entry->cell_x2 = x2;
+	entry->cell_y2 = y2;
+	return;
+
+large:
+	entry->large = true;
+	wl_list_insert(&index->large_entries, &entry->large_link);
+}
+
+struct wlr_spatial_index_entry *wlr_spatial_index_add(
+		struct wlr_spatial_index *index, const struct wlr_box *box,
+		void *data) {
+	struct wlr_spatial_index_entry *entry =
+		calloc(1, sizeof(struct wlr_spatial_index_entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->index = index;
+	entry->data = data;
+	entry->z = ++index->top_z;
+	entry->box = *box;
+	entry->cell_x2 = entry->cell_y2 = -1;
+	wl_list_init(&entry->large_link);
+	wl_list_insert(&index->entries, &entry->link);
+
+	entry_add_cells(entry);
+	return entry;
+}
+
+void wlr_spatial_index_entry_destroy(struct wlr_spatial_index_entry *entry) {
+	if (entry == NULL) {
+		return;
+	}
+	entry_remove_cells(entry);
+	wl_list_remove(&entry->large_link);
+	wl_list_remove(&entry->link);
+	free(entry);
+}
+
+void wlr_spatial_index_entry_set_box(struct wlr_spatial_index_entry *entry,
+		const struct wlr_box *box) {
+	struct wlr_spatial_index *index = entry->index;
+	struct wlr_box old = entry->box;
+	entry->box = *box;
+
+	// Moving within the same cells doesn't require updating the grid
+	if (!entry->large && !wlr_box_empty(&old) && !wlr_box_empty(box) &&
+			cell_coord(index, old.x) == cell_coord(index, box->x) &&
+			cell_coord(index, old.y) == cell_coord(index, box->y) &&
+			cell_coord(index, old.x + old.width - 1) ==
+				cell_coord(index, box->x + box->width - 1) &&
+			cell_coord(index, old.y + old.height - 1) ==
+				cell_coord(index, box->y + box->height - 1)) {
+		return;
+	}
+
+	entry_remove_cells(entry);
+	entry_add_cells(entry);
+}
+
+void wlr_spatial_index_entry_raise(struct wlr_spatial_index_entry *entry) {
+	if (entry->z != entry->index->top_z) {
+		entry->z = ++entry->index->top_z;
+	}
+}
+
+void wlr_spatial_index_entry_lower(struct wlr_spatial_index_entry *entry) {
+	if (entry->z != entry->index->bottom_z) {
+		entry->z = --entry->index->bottom_z;
+	}
+}
+
+static bool add_candidate(struct wlr_spatial_index *index,
+		struct wlr_spatial_index_entry *entry) {
+	struct wlr_spatial_index_entry **candidate =
+		wl_array_add(&index->candidates, sizeof(*candidate));
+	if (candidate == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	*candidate = entry;
+	return true;
+}
+
+static int compare_candidates(const void *_a, const void *_b) {
+	const struct wlr_spatial_index_entry *a =
+		*(struct wlr_spatial_index_entry *const *)_a;
+	const struct wlr_spatial_index_entry *b =
+		*(struct wlr_spatial_index_entry *const *)_b;
+	if (a->z == b->z) {
+		return 0;
+	}
+	return a->z > b->z ? -1 : 1;
+}
+
+static struct wlr_spatial_index_entry *index_at_slow(
+		struct wlr_spatial_index *index, double x, double y,
+		wlr_spatial_index_accept_func_t accept, void *data) {
+	struct wlr_spatial_index_entry *best = NULL;
+	struct wlr_spatial_index_entry *entry;
+	// Accepting entries is the expensive part, only call it from the top
+	while (true) {
+		struct wlr_spatial_index_entry *next = NULL;
+		wl_list_for_each(entry, &index->entries, link) {
+			if ((best == NULL || entry->z < best->z) &&
+					(next == NULL || entry->z > next->z) &&
+					wlr_box_contains_point(&entry->box, x, y)) {
+				next = entry;
+			}
+		}
+		if (next == NULL || accept == NULL || accept(next, x, y, data)) {
+			return next;
+		}
+		best = next;
+	}
+}
+
+struct wlr_spatial_index_entry *wlr_spatial_index_at(
+		struct wlr_spatial_index *index, double x, double y,
+		wlr_spatial_index_accept_func_t accept, void *data) {
+	index->candidates.size = 0;
+
+	if (x < INT32_MIN || x > INT32_MAX || y < INT32_MIN || y > INT32_MAX) {
+		return NULL;
+	}
+	int cell_x = cell_coord(index, floor(x));
+	int cell_y = cell_coord(index, floor(y));
+
+	struct wl_array *bucket = get_bucket(index, cell_x, cell_y);
+	struct wlr_spatial_index_cell_ref *ref;
+	wl_array_for_each(ref, bucket) {
+		if (ref->x == cell_x && ref->y == cell_y &&
+				wlr_box_contains_point(&ref->entry->box, x, y)) {
+			if (!add_candidate(index, ref->entry)) {
+				return index_at_slow(index, x, y, accept, data);
+			}
+		}
+	}
+
+	struct wlr_spatial_index_entry *entry;
+	wl_list_for_each(entry, &index->large_entries, large_link) {
+		if (wlr_box_contains_point(&entry->box, x, y)) {
+			if (!add_candidate(index, entry)) {
+				return index_at_slow(index, x, y, accept, data);
+			}
+		}
+	}
+
+	size_t len = index->candidates.size / sizeof(entry);
+	struct wlr_spatial_index_entry **candidates = index->candidates.data;
+	qsort(candidates, len, sizeof(entry), compare_candidates);
+
+	for (size_t i = 0; i < len; ++i) {
+		if (accept == NULL || accept(candidates[i], x, y, data)) {
+			return candidates[i];
+		}
+	}
+	return NULL;
+}
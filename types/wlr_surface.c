@@ -1,8 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <wayland-server.h>
 #include <wlr/render/interface.h>
 #include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_client_stats.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_region.h>
@@ -11,6 +14,7 @@
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "util/signal.h"
+#include "util/trace.h"
 
 #define CALLBACK_VERSION 1
 #define SURFACE_VERSION 4
@@ -32,6 +36,25 @@ static int max(int fst, int snd) {
 	}
 }
 
+/**
+ * Empties the region but keeps its rectangle array around, pixman fills it
+ * again without allocating as long as it's large enough.
+ */
+static void region_clear(pixman_region32_t *region) {
+	if (region->data == NULL || region->data->size == 0) {
+		pixman_region32_clear(region);
+		return;
+	}
+	region->data->numRects = 0;
+	region->extents = (pixman_box32_t){0};
+}
+
+static void region_swap(pixman_region32_t *a, pixman_region32_t *b) {
+	pixman_region32_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
 static void surface_state_reset_buffer(struct wlr_surface_state *state) {
 	if (state->buffer_resource) {
 		wl_list_remove(&state->buffer_destroy.link);
@@ -67,6 +90,9 @@ static void surface_attach(struct wl_client *client,
 		struct wl_resource *resource,
 		struct wl_resource *buffer, int32_t dx, int32_t dy) {
 	struct wlr_surface *surface = wlr_surface_from_resource(resource);
+	if (surface->client_stats != NULL) {
+		surface->client_stats->buffer_attaches++;
+	}
 
 	surface->pending.committed |= WLR_SURFACE_STATE_BUFFER;
 	surface->pending.dx = dx;
@@ -74,6 +100,27 @@ static void surface_attach(struct wl_client *client,
 	surface_state_set_buffer(&surface->pending, buffer);
 }
 
+#define DEFAULT_MAX_DAMAGE_RECTS 64
+
+static void surface_add_damage(struct wlr_surface *surface,
+		pixman_region32_t *damage,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	pixman_region32_union_rect(damage, damage, x, y, width, height);
+	if (surface->client_stats != NULL) {
+		surface->client_stats->damage_rects++;
+	}
+
+	// Clients damaging many small rectangles, e.g. one per glyph, would
+	// otherwise make each union and all downstream damage handling slower.
+	// Simplify into fewer clusters than the limit, so that the next few
+	// requests don't trigger another simplification.
+	int max_rects = surface->max_damage_rects;
+	if (max_rects > 0 && pixman_region32_n_rects(damage) > max_rects) {
+		wlr_region_simplify(damage, damage,
+			max_rects / 4 > 0 ? max_rects / 4 : 1);
+	}
+}
+
 static void surface_damage(struct wl_client *client,
 		struct wl_resource *resource,
 		int32_t x, int32_t y, int32_t width, int32_t height) {
@@ -82,8 +129,7 @@ static void surface_damage(struct wl_client *client,
 		return;
 	}
 	surface->pending.committed |= WLR_SURFACE_STATE_SURFACE_DAMAGE;
-	pixman_region32_union_rect(&surface->pending.surface_damage,
-		&surface->pending.surface_damage,
+	surface_add_damage(surface, &surface->pending.surface_damage,
 		x, y, width, height);
 }
 
@@ -94,6 +140,9 @@ static void callback_handle_resource_destroy(struct wl_resource *resource) {
 static void surface_frame(struct wl_client *client,
 		struct wl_resource *resource, uint32_t callback) {
 	struct wlr_surface *surface = wlr_surface_from_resource(resource);
+	if (surface->client_stats != NULL) {
+		surface->client_stats->frame_callbacks++;
+	}
 
 	struct wl_resource *callback_resource = wl_resource_create(client,
 		&wl_callback_interface, CALLBACK_VERSION, callback);
@@ -119,7 +168,7 @@ static void surface_set_opaque_region(struct wl_client *client,
 		pixman_region32_t *region = wlr_region_from_resource(region_resource);
 		pixman_region32_copy(&surface->pending.opaque, region);
 	} else {
-		pixman_region32_clear(&surface->pending.opaque);
+		region_clear(&surface->pending.opaque);
 	}
 }
 
@@ -138,6 +187,58 @@ static void surface_set_input_region(struct wl_client *client,
 	}
 }
 
+/**
+ * Computes the buffer size with the buffer transform applied, in buffer
+ * pixels.
+ */
+static void surface_state_transformed_buffer_size(
+		struct wlr_surface_state *state, int *width, int *height) {
+	*width = state->buffer_width;
+	*height = state->buffer_height;
+	if ((state->transform & WL_OUTPUT_TRANSFORM_90) != 0) {
+		int tmp = *width;
+		*width = *height;
+		*height = tmp;
+	}
+}
+
+/**
+ * Computes the viewport source rectangle, in surface-local coordinates before
+ * the viewport destination size is applied.
+ */
+static void surface_state_viewport_src_box(struct wlr_surface_state *state,
+		struct wlr_fbox *box) {
+	if (state->viewport.has_src) {
+		*box = state->viewport.src;
+		return;
+	}
+
+	int width, height;
+	surface_state_transformed_buffer_size(state, &width, &height);
+	box->x = box->y = 0;
+	box->width = width / state->scale;
+	box->height = height / state->scale;
+}
+
+static bool surface_state_viewport_equal(struct wlr_surface_state *a,
+		struct wlr_surface_state *b) {
+	if (a->viewport.has_src != b->viewport.has_src ||
+			a->viewport.has_dst != b->viewport.has_dst) {
+		return false;
+	}
+	if (a->viewport.has_src && (a->viewport.src.x != b->viewport.src.x ||
+			a->viewport.src.y != b->viewport.src.y ||
+			a->viewport.src.width != b->viewport.src.width ||
+			a->viewport.src.height != b->viewport.src.height)) {
+		return false;
+	}
+	if (a->viewport.has_dst && (a->viewport.dst_width != b->viewport.dst_width ||
+			a->viewport.dst_height != b->viewport.dst_height)) {
+		return false;
+	}
+	return true;
+}
+
 static void surface_state_finalize(struct wlr_surface *surface,
 		struct wlr_surface_state *state) {
 	if ((state->committed & WLR_SURFACE_STATE_BUFFER)) {
@@ -149,15 +250,20 @@ static void surface_state_finalize(struct wlr_surface *surface,
 		}
 	}
 
-	int width = state->buffer_width / state->scale;
-	int height = state->buffer_height / state->scale;
-	if ((state->transform & WL_OUTPUT_TRANSFORM_90) != 0) {
-		int tmp = width;
-		width = height;
-		height = tmp;
+	if (state->buffer_width == 0 && state->buffer_height == 0) {
+		state->width = state->height = 0;
+	} else if (state->viewport.has_dst) {
+		state->width = state->viewport.dst_width;
+		state->height = state->viewport.dst_height;
+	} else if (state->viewport.has_src) {
+		state->width = state->viewport.src.width;
+		state->height = state->viewport.src.height;
+	} else {
+		int width, height;
+		surface_state_transformed_buffer_size(state, &width, &height);
+		state->width = width / state->scale;
+		state->height = height / state->scale;
 	}
-	state->width = width;
-	state->height = height;
 
 	pixman_region32_intersect_rect(&state->surface_damage,
 		&state->surface_damage, 0, 0, state->width, state->height);
@@ -167,25 +273,49 @@ static void surface_state_finalize(struct wlr_surface *surface,
 		state->buffer_height);
 }
 
+/**
+ * Converts a region from surface-local to buffer-local coordinates, clipped
+ * to the buffer.
+ */
+static void surface_state_damage_to_buffer(struct wlr_surface_state *state,
+		pixman_region32_t *dst, pixman_region32_t *src) {
+	pixman_region32_copy(dst, src);
+
+	if (state->viewport.has_src || state->viewport.has_dst) {
+		struct wlr_fbox src_box;
+		surface_state_viewport_src_box(state, &src_box);
+		wlr_region_scale_xy(dst, dst, src_box.width / state->width,
+			src_box.height / state->height);
+		pixman_region32_translate(dst, floor(src_box.x), floor(src_box.y));
+		// Account for fractional offsets and filtering of scaled buffers
+		wlr_region_expand(dst, dst, 1);
+	}
+
+	int width, height;
+	surface_state_transformed_buffer_size(state, &width, &height);
+	wlr_region_transform(dst, dst, wlr_output_transform_invert(state->transform),
+		width / state->scale, height / state->scale);
+	wlr_region_scale(dst, dst, state->scale);
+	pixman_region32_intersect_rect(dst, dst,
+		0, 0, state->buffer_width, state->buffer_height);
+}
+
 static void surface_update_damage(pixman_region32_t *buffer_damage,
 		struct wlr_surface_state *current, struct wlr_surface_state *pending) {
 	pixman_region32_clear(buffer_damage);
 
 	if (pending->width != current->width ||
-			pending->height != current->height) {
-		// Damage the whole buffer on resize
+			pending->height != current->height ||
+			!surface_state_viewport_equal(pending, current)) {
+		// Damage the whole buffer on resize or viewport change
 		pixman_region32_union_rect(buffer_damage, buffer_damage, 0, 0,
 			pending->buffer_width, pending->buffer_height);
 	} else {
 		// Copy over surface damage + buffer damage
 		pixman_region32_t surface_damage;
 		pixman_region32_init(&surface_damage);
-
-		pixman_region32_copy(&surface_damage, &pending->surface_damage);
-		wlr_region_transform(&surface_damage, &surface_damage,
-			wlr_output_transform_invert(pending->transform),
-			pending->width, pending->height);
-		wlr_region_scale(&surface_damage, &surface_damage, pending->scale);
+		surface_state_damage_to_buffer(pending, &surface_damage,
+			&pending->surface_damage);
 
 		pixman_region32_union(buffer_damage,
 			&pending->buffer_damage, &surface_damage);
@@ -194,8 +324,13 @@ static void surface_update_damage(pixman_region32_t *buffer_damage,
 	}
 }
 
-static void surface_state_copy(struct wlr_surface_state *state,
-		struct wlr_surface_state *next) {
+/**
+ * Applies the committed fields of `next` to `state`. When moving, regions are
+ * swapped rather than copied and `next` is cleared, so that their storage
+ * keeps going back and forth between the two states.
+ */
+static void surface_state_apply(struct wlr_surface_state *state,
+		struct wlr_surface_state *next, bool move) {
 	state->width = next->width;
 	state->height = next->height;
 	state->buffer_width = next->buffer_width;
@@ -213,21 +348,40 @@ static void surface_state_copy(struct wlr_surface_state *state,
 	} else {
 		state->dx = state->dy = 0;
 	}
-	if (next->committed & WLR_SURFACE_STATE_SURFACE_DAMAGE) {
-		pixman_region32_copy(&state->surface_damage, &next->surface_damage);
+	if (!(next->committed & WLR_SURFACE_STATE_SURFACE_DAMAGE)) {
+		region_clear(&state->surface_damage);
+	} else if (move) {
+		region_swap(&state->surface_damage, &next->surface_damage);
+		region_clear(&next->surface_damage);
 	} else {
-		pixman_region32_clear(&state->surface_damage);
+		pixman_region32_copy(&state->surface_damage, &next->surface_damage);
 	}
-	if (next->committed & WLR_SURFACE_STATE_BUFFER_DAMAGE) {
-		pixman_region32_copy(&state->buffer_damage, &next->buffer_damage);
+	if (!(next->committed & WLR_SURFACE_STATE_BUFFER_DAMAGE)) {
+		region_clear(&state->buffer_damage);
+	} else if (move) {
+		region_swap(&state->buffer_damage, &next->buffer_damage);
+		region_clear(&next->buffer_damage);
 	} else {
-		pixman_region32_clear(&state->buffer_damage);
+		pixman_region32_copy(&state->buffer_damage, &next->buffer_damage);
 	}
+	// The opaque and input regions of `next` aren't used again until the
+	// client sets them, no need to clear them
 	if (next->committed & WLR_SURFACE_STATE_OPAQUE_REGION) {
-		pixman_region32_copy(&state->opaque, &next->opaque);
+		if (move) {
+			region_swap(&state->opaque, &next->opaque);
+		} else {
+			pixman_region32_copy(&state->opaque, &next->opaque);
+		}
 	}
 	if (next->committed & WLR_SURFACE_STATE_INPUT_REGION) {
-		pixman_region32_copy(&state->input, &next->input);
+		if (move) {
+			region_swap(&state->input, &next->input);
+		} else {
+			pixman_region32_copy(&state->input, &next->input);
+		}
+	}
+	if (next->committed & WLR_SURFACE_STATE_VIEWPORT) {
+		state->viewport = next->viewport;
 	}
 
 	state->committed |= next->committed;
@@ -238,19 +392,13 @@ static void surface_state_copy(struct wlr_surface_state *state,
  */
 static void surface_state_move(struct wlr_surface_state *state,
 		struct wlr_surface_state *next) {
-	surface_state_copy(state, next);
+	surface_state_apply(state, next, true);
 
 	if (next->committed & WLR_SURFACE_STATE_BUFFER) {
 		surface_state_set_buffer(state, next->buffer_resource);
 		surface_state_reset_buffer(next);
 		next->dx = next->dy = 0;
 	}
-	if (next->committed & WLR_SURFACE_STATE_SURFACE_DAMAGE) {
-		pixman_region32_clear(&next->surface_damage);
-	}
-	if (next->committed & WLR_SURFACE_STATE_BUFFER_DAMAGE) {
-		pixman_region32_clear(&next->buffer_damage);
-	}
 	if (next->committed & WLR_SURFACE_STATE_FRAME_CALLBACK_LIST) {
 		wl_list_insert_list(&state->frame_callback_list,
 			&next->frame_callback_list);
@@ -260,24 +408,119 @@ static void surface_state_move(struct wlr_surface_state *state,
 	next->committed = 0;
 }
 
-static void surface_damage_subsurfaces(struct wlr_subsurface *subsurface) {
-	// XXX: This is probably the wrong way to do it, because this damage should
-	// come from the client, but weston doesn't do it correctly either and it
-	// seems to work ok. See the comment on weston_surface_damage for more info
-	// about a better approach.
-	struct wlr_surface *surface = subsurface->surface;
-	pixman_region32_union_rect(&surface->buffer_damage,
-		&surface->buffer_damage, 0, 0,
-		surface->current.buffer_width, surface->current.buffer_height);
+/**
+ * Damages the parts of the surface tree at (sx, sy) which overlap `region`.
+ * Both are in the coordinates of the parent of the tree's root.
+ */
+static void surface_damage_tree_region(struct wlr_surface *surface,
+		int sx, int sy, pixman_region32_t *region) {
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, region);
+	pixman_region32_translate(&damage, -sx, -sy);
+	pixman_region32_intersect_rect(&damage, &damage, 0, 0,
+		surface->current.width, surface->current.height);
+	if (pixman_region32_not_empty(&damage)) {
+		surface_state_damage_to_buffer(&surface->current, &damage, &damage);
+		pixman_region32_union(&surface->buffer_damage,
+			&surface->buffer_damage, &damage);
+	}
+	pixman_region32_fini(&damage);
 
+	struct wlr_subsurface *child;
+	wl_list_for_each(child, &surface->subsurfaces, parent_link) {
+		surface_damage_tree_region(child->surface,
+			sx + child->current.x, sy + child->current.y, region);
+	}
+}
+
+/**
+ * Damages a restacked subsurface. Restacking only changes what is displayed
+ * where the subsurface tree overlaps its siblings, so only that area is
+ * damaged.
+ */
+static void subsurface_damage_restack(struct wlr_subsurface *subsurface) {
+	// XXX: This damage should come from the client, but weston doesn't do it
+	// correctly either. See the comment on weston_surface_damage for more
+	// info about a better approach.
 	subsurface->reordered = false;
+	if (!subsurface->mapped) {
+		return;
+	}
+
+	pixman_region32_t siblings;
+	pixman_region32_init(&siblings);
+	struct wlr_subsurface *sibling;
+	wl_list_for_each(sibling, &subsurface->parent->subsurfaces, parent_link) {
+		if (sibling == subsurface || !sibling->mapped) {
+			continue;
+		}
+		struct wlr_box box;
+		wlr_surface_get_extends(sibling->surface, &box);
+		pixman_region32_union_rect(&siblings, &siblings,
+			sibling->current.x + box.x, sibling->current.y + box.y,
+			box.width, box.height);
+	}
+
+	surface_damage_tree_region(subsurface->surface,
+		subsurface->current.x, subsurface->current.y, &siblings);
+	pixman_region32_fini(&siblings);
+}
 
+/**
+ * Damages the old and new positions of the subsurfaces of a surface which
+ * moved by (-dx, -dy), in surface-local coordinates.
+ */
+static void surface_damage_moved_subsurfaces(struct wlr_surface *surface,
+		int dx, int dy) {
 	struct wlr_subsurface *child;
-	wl_list_for_each(child, &subsurface->surface->subsurfaces, parent_link) {
-		surface_damage_subsurfaces(child);
+	wl_list_for_each(child, &surface->subsurfaces, parent_link) {
+		struct wlr_surface *child_surface = child->surface;
+		pixman_region32_t damage;
+		pixman_region32_init_rect(&damage, 0, 0,
+			child_surface->current.width, child_surface->current.height);
+		pixman_region32_union_rect(&damage, &damage, dx, dy,
+			child_surface->current.width, child_surface->current.height);
+		// Not clipped to the buffer: the old position is outside of it
+		wlr_region_transform(&damage, &damage,
+			wlr_output_transform_invert(child_surface->current.transform),
+			child_surface->current.width, child_surface->current.height);
+		wlr_region_scale(&damage, &damage, child_surface->current.scale);
+		pixman_region32_union(&child_surface->buffer_damage,
+			&child_surface->buffer_damage, &damage);
+		pixman_region32_fini(&damage);
+
+		surface_damage_moved_subsurfaces(child_surface, dx, dy);
+	}
+}
+
+// Drops the cached trees of the surface and all of its ancestors
+static void surface_invalidate_tree(struct wlr_surface *surface) {
+	while (surface != NULL) {
+		surface->tree.valid = false;
+
+		if (!wlr_surface_is_subsurface(surface)) {
+			break;
+		}
+		struct wlr_subsurface *subsurface =
+			wlr_subsurface_from_wlr_surface(surface);
+		if (subsurface == NULL) {
+			break;
+		}
+		surface = subsurface->parent;
 	}
 }
 
+static inline int64_t timespec_to_msec(const struct timespec *a) {
+	return (int64_t)a->tv_sec * 1000 + a->tv_nsec / 1000000;
+}
+
+static int64_t get_current_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_msec(&now);
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	struct wl_resource *resource = surface->current.buffer_resource;
 	if (resource == NULL) {
@@ -287,7 +530,8 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		return;
 	}
 
-	if (surface->buffer != NULL && surface->buffer->released) {
+	if (surface->buffer != NULL &&
+			(surface->buffer->released || surface->buffer->retained)) {
 		struct wlr_buffer *updated_buffer = wlr_buffer_apply_damage(
 			surface->buffer, resource, &surface->buffer_damage);
 		if (updated_buffer != NULL) {
@@ -299,17 +543,25 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 	wlr_buffer_unref(surface->buffer);
 	surface->buffer = NULL;
 
-	struct wlr_buffer *buffer = wlr_buffer_create(surface->renderer, resource);
+	struct wlr_buffer *buffer;
+	if (surface->retain_buffers) {
+		buffer = wlr_buffer_create_retained(surface->renderer, resource);
+	} else {
+		buffer = wlr_buffer_create(surface->renderer, resource);
+	}
 	if (buffer == NULL) {
 		wlr_log(WLR_ERROR, "Failed to upload buffer");
 		return;
 	}
 
 	surface->buffer = buffer;
+	surface->last_texture_use = get_current_time_msec();
 }
 
 static void surface_update_opaque_region(struct wlr_surface *surface) {
-	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	// Opacity only depends on the format, don't wait for pending uploads
+	struct wlr_texture *texture =
+		surface->buffer != NULL ? surface->buffer->texture : NULL;
 	if (texture == NULL) {
 		pixman_region32_clear(&surface->opaque_region);
 		return;
@@ -333,6 +585,8 @@ static void surface_update_input_region(struct wlr_surface *surface) {
 }
 
 static void surface_commit_pending(struct wlr_surface *surface) {
+	wlr_trace(surface_commit, surface, surface->pending.committed);
+
 	surface_state_finalize(surface, &surface->pending);
 
 	if (surface->role && surface->role->precommit) {
@@ -346,7 +600,12 @@ static void surface_commit_pending(struct wlr_surface *surface) {
 	surface_update_damage(&surface->buffer_damage,
 		&surface->current, &surface->pending);
 
-	surface_state_copy(&surface->previous, &surface->current);
+	surface->previous.width = surface->current.width;
+	surface->previous.height = surface->current.height;
+	surface->previous.buffer_width = surface->current.buffer_width;
+	surface->previous.buffer_height = surface->current.buffer_height;
+	surface->previous.transform = surface->current.transform;
+	surface->previous.scale = surface->current.scale;
 	surface_state_move(&surface->current, &surface->pending);
 
 	if (invalid_buffer) {
@@ -357,14 +616,19 @@ static void surface_commit_pending(struct wlr_surface *surface) {
 
 	// commit subsurface order
 	struct wlr_subsurface *subsurface;
+	bool reordered = false;
 	wl_list_for_each_reverse(subsurface, &surface->subsurface_pending_list,
 			parent_pending_link) {
 		wl_list_remove(&subsurface->parent_link);
 		wl_list_insert(&surface->subsurfaces, &subsurface->parent_link);
-
-		if (subsurface->reordered) {
-			// TODO: damage all the subsurfaces
-			surface_damage_subsurfaces(subsurface);
+		reordered = reordered || subsurface->reordered;
+	}
+	if (reordered) {
+		surface_invalidate_tree(surface);
+		wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
+			if (subsurface->reordered) {
+				subsurface_damage_restack(subsurface);
+			}
 		}
 	}
 
@@ -395,23 +659,59 @@ static bool subsurface_is_synchronized(struct wlr_subsurface *subsurface) {
 }
 
 /**
- * Recursive function to commit the effectively synchronized children.
+ * Moves the subsurfaces of `surface` which have cached state in their tree
+ * to the end of `queue`. Unsynchronized ones are left alone, unless the
+ * surface itself is committed as part of a synchronized commit.
  */
-static void subsurface_parent_commit(struct wlr_subsurface *subsurface,
-		bool synchronized) {
-	struct wlr_surface *surface = subsurface->surface;
-	if (synchronized || subsurface->synchronized) {
+static void surface_queue_cached_subsurfaces(struct wlr_surface *surface,
+		struct wl_list *queue, bool synchronized) {
+	struct wlr_subsurface *subsurface, *tmp;
+	wl_list_for_each_safe(subsurface, tmp, &surface->cached_subsurfaces,
+			cached_link) {
+		if (synchronized || subsurface->synchronized) {
+			wl_list_remove(&subsurface->cached_link);
+			wl_list_insert(queue->prev, &subsurface->cached_link);
+		}
+	}
+}
+
+/**
+ * Commits the cached state of the queued subsurfaces and of the
+ * subsurfaces with cached state below them. Parents are committed before
+ * their children.
+ */
+static void subsurface_commit_queue(struct wl_list *queue) {
+	while (!wl_list_empty(queue)) {
+		struct wlr_subsurface *subsurface =
+			wl_container_of(queue->next, subsurface, cached_link);
+		wl_list_remove(&subsurface->cached_link);
+		wl_list_init(&subsurface->cached_link);
+
+		struct wlr_surface *surface = subsurface->surface;
 		if (subsurface->has_cache) {
-			surface_state_move(&surface->pending, &subsurface->cached);
+			surface_state_move(&surface->pending, subsurface->cached);
 			surface_commit_pending(surface);
 			subsurface->has_cache = false;
-			subsurface->cached.committed = 0;
 		}
 
-		struct wlr_subsurface *subsurface;
-		wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
-			subsurface_parent_commit(subsurface, true);
+		surface_queue_cached_subsurfaces(surface, queue, true);
+	}
+}
+
+/**
+ * Marks the subsurface and its ancestors as having cached state in their
+ * tree, so that commits only need to visit those.
+ */
+static void subsurface_mark_cached(struct wlr_subsurface *subsurface) {
+	while (subsurface->parent != NULL) {
+		if (wl_list_empty(&subsurface->cached_link)) {
+			wl_list_insert(&subsurface->parent->cached_subsurfaces,
+				&subsurface->cached_link);
+		}
+		if (!wlr_surface_is_subsurface(subsurface->parent)) {
+			break;
 		}
+		subsurface = wlr_subsurface_from_wlr_surface(subsurface->parent);
 	}
 }
 
@@ -419,11 +719,20 @@ static void subsurface_commit(struct wlr_subsurface *subsurface) {
 	struct wlr_surface *surface = subsurface->surface;
 
 	if (subsurface_is_synchronized(subsurface)) {
-		surface_state_move(&subsurface->cached, &surface->pending);
+		if (subsurface->cached == NULL) {
+			subsurface->cached = calloc(1, sizeof(struct wlr_surface_state));
+			if (subsurface->cached == NULL) {
+				wl_resource_post_no_memory(surface->resource);
+				return;
+			}
+			surface_state_init(subsurface->cached);
+		}
+		surface_state_move(subsurface->cached, &surface->pending);
 		subsurface->has_cache = true;
+		subsurface_mark_cached(subsurface);
 	} else {
 		if (subsurface->has_cache) {
-			surface_state_move(&surface->pending, &subsurface->cached);
+			surface_state_move(&surface->pending, subsurface->cached);
 			surface_commit_pending(surface);
 			subsurface->has_cache = false;
 		} else {
@@ -432,21 +741,66 @@ static void subsurface_commit(struct wlr_subsurface *subsurface) {
 	}
 }
 
+/**
+ * Commits the cached state of the effectively synchronized subsurfaces below
+ * `surface`. Only the subtrees with cached state are visited.
+ */
+static void surface_commit_children(struct wlr_surface *surface) {
+	if (wl_list_empty(&surface->cached_subsurfaces)) {
+		return;
+	}
+
+	struct wl_list queue;
+	wl_list_init(&queue);
+	surface_queue_cached_subsurfaces(surface, &queue, false);
+	subsurface_commit_queue(&queue);
+}
+
+static void surface_transaction_hold(struct wlr_surface *surface) {
+	struct wlr_surface_transaction *txn = surface->transaction.transaction;
+
+	if (surface->transaction.state == NULL) {
+		surface->transaction.state = calloc(1, sizeof(struct wlr_surface_state));
+		if (surface->transaction.state == NULL) {
+			wl_resource_post_no_memory(surface->resource);
+			return;
+		}
+		surface_state_init(surface->transaction.state);
+	}
+	surface_state_move(surface->transaction.state, &surface->pending);
+
+	if (surface->transaction.ready || (surface->transaction.is_ready != NULL &&
+			!surface->transaction.is_ready(surface,
+				surface->transaction.is_ready_data))) {
+		return;
+	}
+	surface->transaction.ready = true;
+	txn->n_waiting--;
+	if (txn->n_waiting == 0) {
+		wlr_surface_transaction_apply(txn);
+	}
+}
+
 static void surface_commit(struct wl_client *client,
 		struct wl_resource *resource) {
 	struct wlr_surface *surface = wlr_surface_from_resource(resource);
+	if (surface->client_stats != NULL) {
+		surface->client_stats->commits++;
+	}
 
 	struct wlr_subsurface *subsurface = wlr_surface_is_subsurface(surface) ?
 		wlr_subsurface_from_wlr_surface(surface) : NULL;
 	if (subsurface != NULL) {
 		subsurface_commit(subsurface);
+	} else if (surface->transaction.transaction != NULL) {
+		// Synchronized subsurfaces are committed along with the held state
+		surface_transaction_hold(surface);
+		return;
 	} else {
 		surface_commit_pending(surface);
 	}
 
-	wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
-		subsurface_parent_commit(subsurface, false);
-	}
+	surface_commit_children(surface);
 }
 
 static void surface_set_buffer_transform(struct wl_client *client,
@@ -483,8 +837,7 @@ static void surface_damage_buffer(struct wl_client *client,
 		return;
 	}
 	surface->pending.committed |= WLR_SURFACE_STATE_BUFFER_DAMAGE;
-	pixman_region32_union_rect(&surface->pending.buffer_damage,
-		&surface->pending.buffer_damage,
+	surface_add_damage(surface, &surface->pending.buffer_damage,
 		x, y, width, height);
 }
 
@@ -546,9 +899,14 @@ static void subsurface_destroy(struct wlr_subsurface *subsurface) {
 	wlr_signal_emit_safe(&subsurface->events.destroy, subsurface);
 
 	wl_list_remove(&subsurface->surface_destroy.link);
-	surface_state_finish(&subsurface->cached);
+	wl_list_remove(&subsurface->cached_link);
+	if (subsurface->cached != NULL) {
+		surface_state_finish(subsurface->cached);
+		free(subsurface->cached);
+	}
 
 	if (subsurface->parent) {
+		surface_invalidate_tree(subsurface->parent);
 		wl_list_remove(&subsurface->parent_link);
 		wl_list_remove(&subsurface->parent_pending_link);
 		wl_list_remove(&subsurface->parent_destroy.link);
@@ -566,15 +924,31 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 
 	wlr_signal_emit_safe(&surface->events.destroy, surface);
 
+	struct wlr_surface_transaction *txn = surface->transaction.transaction;
+	if (txn != NULL) {
+		wl_list_remove(&surface->transaction.link);
+		if (!surface->transaction.ready) {
+			txn->n_waiting--;
+		}
+		surface->transaction.transaction = NULL;
+		if (txn->n_waiting == 0) {
+			wlr_surface_transaction_apply(txn);
+		}
+	}
+
 	wl_list_remove(wl_resource_get_link(surface->resource));
 
 	wl_list_remove(&surface->renderer_destroy.link);
+	if (surface->transaction.state != NULL) {
+		surface_state_finish(surface->transaction.state);
+		free(surface->transaction.state);
+	}
 	surface_state_finish(&surface->pending);
 	surface_state_finish(&surface->current);
-	surface_state_finish(&surface->previous);
 	pixman_region32_fini(&surface->buffer_damage);
 	pixman_region32_fini(&surface->opaque_region);
 	pixman_region32_fini(&surface->input_region);
+	free(surface->tree.nodes);
 	wlr_buffer_unref(surface->buffer);
 	free(surface);
 }
@@ -609,16 +983,22 @@ struct wlr_surface *wlr_surface_create(struct wl_client *client,
 	wlr_log(WLR_DEBUG, "New wlr_surface %p (res %p)", surface, surface->resource);
 
 	surface->renderer = renderer;
+	surface->max_damage_rects = DEFAULT_MAX_DAMAGE_RECTS;
+	// Looked up once, the counters are updated on each request
+	surface->client_stats = wlr_client_stats_get(client);
 
 	surface_state_init(&surface->current);
 	surface_state_init(&surface->pending);
-	surface_state_init(&surface->previous);
+	surface->previous.transform = surface->current.transform;
+	surface->previous.scale = surface->current.scale;
+	wl_list_init(&surface->transaction.link);
 
 	wl_signal_init(&surface->events.commit);
 	wl_signal_init(&surface->events.destroy);
 	wl_signal_init(&surface->events.new_subsurface);
 	wl_list_init(&surface->subsurfaces);
 	wl_list_init(&surface->subsurface_pending_list);
+	wl_list_init(&surface->cached_subsurfaces);
 	pixman_region32_init(&surface->buffer_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
@@ -640,11 +1020,24 @@ struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface) {
 	if (surface->buffer == NULL) {
 		return NULL;
 	}
+	if (surface->retain_buffers) {
+		surface->last_texture_use = get_current_time_msec();
+	}
+	wlr_buffer_finish_upload(surface->buffer);
 	return surface->buffer->texture;
 }
 
+struct wlr_texture *wlr_surface_get_texture_for_renderer(
+		struct wlr_surface *surface, struct wlr_renderer *renderer) {
+	if (wlr_surface_get_texture(surface) == NULL) {
+		return NULL;
+	}
+	return wlr_buffer_get_texture(surface->buffer, renderer);
+}
+
 bool wlr_surface_has_buffer(struct wlr_surface *surface) {
-	return wlr_surface_get_texture(surface) != NULL;
+	return surface->buffer != NULL &&
+		(surface->buffer->texture != NULL || surface->buffer->evicted);
 }
 
 bool wlr_surface_set_role(struct wlr_surface *surface,
@@ -789,7 +1182,11 @@ static void subsurface_handle_set_desync(struct wl_client *client,
 
 		if (!subsurface_is_synchronized(subsurface)) {
 			// TODO: do a synchronized commit to flush the cache
-			subsurface_parent_commit(subsurface, true);
+			struct wl_list queue;
+			wl_list_init(&queue);
+			wl_list_remove(&subsurface->cached_link);
+			wl_list_insert(&queue, &subsurface->cached_link);
+			subsurface_commit_queue(&queue);
 		}
 	}
 }
@@ -869,9 +1266,11 @@ static void subsurface_role_commit(struct wlr_surface *surface) {
 		// Subsurface has moved
 		int dx = subsurface->current.x - subsurface->pending.x;
 		int dy = subsurface->current.y - subsurface->pending.y;
+		int tree_dx = dx, tree_dy = dy;
 
 		subsurface->current.x = subsurface->pending.x;
 		subsurface->current.y = subsurface->pending.y;
+		surface_invalidate_tree(subsurface->parent);
 
 		if ((surface->current.transform & WL_OUTPUT_TRANSFORM_90) != 0) {
 			int tmp = dx;
@@ -886,6 +1285,9 @@ static void subsurface_role_commit(struct wlr_surface *surface) {
 		pixman_region32_union_rect(&surface->buffer_damage,
 			&surface->buffer_damage, 0, 0,
 			surface->current.buffer_width, surface->current.buffer_height);
+
+		// The whole tree moved
+		surface_damage_moved_subsurfaces(surface, tree_dx, tree_dy);
 	}
 
 	subsurface_consider_map(subsurface, true);
@@ -916,9 +1318,12 @@ static void subsurface_handle_parent_destroy(struct wl_listener *listener,
 	struct wlr_subsurface *subsurface =
 		wl_container_of(listener, subsurface, parent_destroy);
 	subsurface_unmap(subsurface);
+	surface_invalidate_tree(subsurface->parent);
 	wl_list_remove(&subsurface->parent_link);
 	wl_list_remove(&subsurface->parent_pending_link);
 	wl_list_remove(&subsurface->parent_destroy.link);
+	wl_list_remove(&subsurface->cached_link);
+	wl_list_init(&subsurface->cached_link);
 	subsurface->parent = NULL;
 }
 
@@ -942,13 +1347,12 @@ struct wlr_subsurface *wlr_subsurface_create(struct wlr_surface *surface,
 		wl_client_post_no_memory(client);
 		return NULL;
 	}
-	surface_state_init(&subsurface->cached);
+	wl_list_init(&subsurface->cached_link);
 	subsurface->synchronized = true;
 	subsurface->surface = surface;
 	subsurface->resource =
 		wl_resource_create(client, &wl_subsurface_interface, version, id);
 	if (subsurface->resource == NULL) {
-		surface_state_finish(&subsurface->cached);
 		free(subsurface);
 		wl_client_post_no_memory(client);
 		return NULL;
@@ -973,6 +1377,7 @@ struct wlr_subsurface *wlr_subsurface_create(struct wlr_surface *surface,
 		&subsurface->parent_pending_link);
 
 	surface->role_data = subsurface;
+	surface_invalidate_tree(parent);
 
 	struct wl_list *resource_link = wl_resource_get_link(subsurface->resource);
 	if (resource_list != NULL) {
@@ -1050,18 +1455,63 @@ void wlr_surface_send_leave(struct wlr_surface *surface,
 	}
 }
 
-static inline int64_t timespec_to_msec(const struct timespec *a) {
-	return (int64_t)a->tv_sec * 1000 + a->tv_nsec / 1000000;
+void wlr_surface_set_max_damage_rects(struct wlr_surface *surface,
+		int max_rects) {
+	surface->max_damage_rects = max_rects > 0 ? max_rects : 0;
 }
 
-void wlr_surface_send_frame_done(struct wlr_surface *surface,
+void wlr_surface_set_max_frame_rate(struct wlr_surface *surface, int rate) {
+	surface->max_frame_rate = rate > 0 ? rate : 0;
+}
+
+int wlr_surface_send_frame_done(struct wlr_surface *surface,
 		const struct timespec *when) {
+	return wlr_surface_send_frame_done_throttled(surface, when, 0);
+}
+
+int wlr_surface_send_frame_done_throttled(struct wlr_surface *surface,
+		const struct timespec *when, int interval) {
+	if (wl_list_empty(&surface->current.frame_callback_list)) {
+		return 0;
+	}
+
+	int rate = surface->max_frame_rate;
+	if (rate == 0) {
+		rate = wlr_surface_get_root_surface(surface)->max_frame_rate;
+	}
+	if (rate > 0 && 1000 / rate > interval) {
+		interval = 1000 / rate;
+	}
+
+	int64_t now = timespec_to_msec(when);
+	int64_t elapsed = now - surface->last_frame_done;
+	if (interval > 0 && elapsed < interval) {
+		return interval - elapsed;
+	}
+	surface->last_frame_done = now;
+
 	struct wl_resource *resource, *tmp;
 	wl_resource_for_each_safe(resource, tmp,
 			&surface->current.frame_callback_list) {
-		wl_callback_send_done(resource, timespec_to_msec(when));
+		wl_callback_send_done(resource, now);
 		wl_resource_destroy(resource);
 	}
+	return 0;
+}
+
+bool wlr_surface_is_occluded(struct wlr_surface *surface,
+		const struct wlr_box *box, pixman_region32_t *occluded) {
+	if (surface->buffer == NULL || box->width <= 0 || box->height <= 0) {
+		return true;
+	}
+	pixman_box32_t rect = {
+		.x1 = box->x,
+		.y1 = box->y,
+		.x2 = box->x + box->width,
+		.y2 = box->y + box->height,
+	};
+	return pixman_region32_contains_rectangle(occluded, &rect) ==
+		PIXMAN_REGION_IN;
 }
 
 static void surface_for_each_surface(struct wlr_surface *surface, int x, int y,
@@ -1079,9 +1529,59 @@ static void surface_for_each_surface(struct wlr_surface *surface, int x, int y,
 	}
 }
 
+static bool surface_tree_append(struct wlr_surface *root,
+		struct wlr_surface *surface, int x, int y) {
+	if (root->tree.len == root->tree.cap) {
+		size_t cap = root->tree.cap == 0 ? 4 : root->tree.cap * 2;
+		struct wlr_surface_tree_node *nodes = realloc(root->tree.nodes,
+			cap * sizeof(struct wlr_surface_tree_node));
+		if (nodes == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		root->tree.nodes = nodes;
+		root->tree.cap = cap;
+	}
+	root->tree.nodes[root->tree.len++] = (struct wlr_surface_tree_node){
+		.surface = surface,
+		.x = x,
+		.y = y,
+	};
+
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
+		if (!surface_tree_append(root, subsurface->surface,
+				x + subsurface->current.x, y + subsurface->current.y)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool surface_update_tree(struct wlr_surface *surface) {
+	if (surface->tree.valid) {
+		return true;
+	}
+	surface->tree.len = 0;
+	surface->tree.valid = surface_tree_append(surface, surface, 0, 0);
+	return surface->tree.valid;
+}
+
 void wlr_surface_for_each_surface(struct wlr_surface *surface,
 		wlr_surface_iterator_func_t iterator, void *user_data) {
-	surface_for_each_surface(surface, 0, 0, iterator, user_data);
+	// The tree can't be rebuilt while a caller up the stack is walking it
+	if ((surface->tree.iterating > 0 && !surface->tree.valid) ||
+			!surface_update_tree(surface)) {
+		surface_for_each_surface(surface, 0, 0, iterator, user_data);
+		return;
+	}
+
+	surface->tree.iterating++;
+	for (size_t i = 0; i < surface->tree.len; ++i) {
+		struct wlr_surface_tree_node *node = &surface->tree.nodes[i];
+		iterator(node->surface, node->x, node->y, user_data);
+	}
+	surface->tree.iterating--;
 }
 
 struct bound_acc {
@@ -1116,6 +1616,29 @@ void wlr_surface_get_extends(struct wlr_surface *surface, struct wlr_box *box) {
 	box->height = acc.max_y - acc.min_y;
 }
 
+void wlr_surface_get_buffer_source_box(struct wlr_surface *surface,
+		struct wlr_fbox *box) {
+	box->x = box->y = 0;
+	box->width = surface->current.buffer_width;
+	box->height = surface->current.buffer_height;
+
+	if (surface->current.viewport.has_src) {
+		box->x = surface->current.viewport.src.x * surface->current.scale;
+		box->y = surface->current.viewport.src.y * surface->current.scale;
+		box->width = surface->current.viewport.src.width *
+			surface->current.scale;
+		box->height = surface->current.viewport.src.height *
+			surface->current.scale;
+
+		int width, height;
+		surface_state_transformed_buffer_size(&surface->current,
+			&width, &height);
+		wlr_fbox_transform(box, box,
+			wlr_output_transform_invert(surface->current.transform),
+			width, height);
+	}
+}
+
 void wlr_surface_get_effective_damage(struct wlr_surface *surface,
 		pixman_region32_t *damage) {
 	pixman_region32_clear(damage);
@@ -1126,6 +1649,21 @@ void wlr_surface_get_effective_damage(struct wlr_surface *surface,
 		surface->current.buffer_height);
 	wlr_region_scale(damage, damage, 1.0 / (float)surface->current.scale);
 
+	if (surface->current.viewport.has_src ||
+			surface->current.viewport.has_dst) {
+		struct wlr_fbox src_box;
+		surface_state_viewport_src_box(&surface->current, &src_box);
+		pixman_region32_translate(damage,
+			-floor(src_box.x), -floor(src_box.y));
+		wlr_region_scale_xy(damage, damage,
+			surface->current.width / src_box.width,
+			surface->current.height / src_box.height);
+		// Account for fractional offsets and filtering of scaled buffers
+		wlr_region_expand(damage, damage, 1);
+		pixman_region32_intersect_rect(damage, damage, 0, 0,
+			surface->current.width, surface->current.height);
+	}
+
 	// On resize, damage the previous bounds of the surface. The current bounds
 	// have already been damaged in surface_update_damage.
 	if (surface->previous.width > surface->current.width ||
@@ -1147,3 +1685,85 @@ void wlr_surface_get_effective_damage(struct wlr_surface *surface,
 			surface->previous.width, surface->previous.height);
 	}
 }
+
+static int transaction_handle_timeout(void *data) {
+	struct wlr_surface_transaction *txn = data;
+	wlr_log(WLR_DEBUG, "Surface transaction timed out with %zu surfaces "
+		"not ready", txn->n_waiting);
+	wlr_surface_transaction_apply(txn);
+	return 0;
+}
+
+struct wlr_surface_transaction *wlr_surface_transaction_create(
+		struct wl_display *display, int timeout_ms) {
+	struct wlr_surface_transaction *txn =
+		calloc(1, sizeof(struct wlr_surface_transaction));
+	if (txn == NULL) {
+		return NULL;
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	txn->timer = wl_event_loop_add_timer(loop, transaction_handle_timeout, txn);
+	if (txn->timer == NULL) {
+		free(txn);
+		return NULL;
+	}
+	wl_event_source_timer_update(txn->timer, timeout_ms);
+
+	wl_list_init(&txn->surfaces);
+	wl_signal_init(&txn->events.apply);
+	return txn;
+}
+
+bool wlr_surface_transaction_add(struct wlr_surface_transaction *txn,
+		struct wlr_surface *surface,
+		bool (*is_ready)(struct wlr_surface *surface, void *data), void *data) {
+	if (wlr_surface_is_subsurface(surface) ||
+			surface->transaction.transaction != NULL) {
+		return false;
+	}
+
+	surface->transaction.transaction = txn;
+	surface->transaction.ready = false;
+	surface->transaction.is_ready = is_ready;
+	surface->transaction.is_ready_data = data;
+	wl_list_insert(txn->surfaces.prev, &surface->transaction.link);
+	txn->n_waiting++;
+	return true;
+}
+
+// Commits the held state, leaving state pending since then untouched
+static void surface_apply_held_state(struct wlr_surface *surface) {
+	struct wlr_surface_state newer;
+	surface_state_init(&newer);
+	surface_state_move(&newer, &surface->pending);
+
+	// Transactions are rare, don't keep the state around
+	struct wlr_surface_state *held = surface->transaction.state;
+	surface->transaction.state = NULL;
+	surface_state_move(&surface->pending, held);
+	surface_state_finish(held);
+	free(held);
+	surface_commit_pending(surface);
+	surface_commit_children(surface);
+
+	surface_state_move(&surface->pending, &newer);
+	surface_state_finish(&newer);
+}
+
+void wlr_surface_transaction_apply(struct wlr_surface_transaction *txn) {
+	wl_event_source_remove(txn->timer);
+
+	struct wlr_surface *surface, *tmp;
+	wl_list_for_each_safe(surface, tmp, &txn->surfaces, transaction.link) {
+		wl_list_remove(&surface->transaction.link);
+		wl_list_init(&surface->transaction.link);
+		surface->transaction.transaction = NULL;
+		if (surface->transaction.state != NULL) {
+			surface_apply_held_state(surface);
+		}
+	}
+
+	wlr_signal_emit_safe(&txn->events.apply, txn);
+	free(txn);
+}
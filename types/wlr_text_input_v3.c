@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <wlr/types/wlr_text_input_v3.h>
 #include <wlr/util/log.h>
 #include "text-input-unstable-v3-protocol.h"
@@ -17,6 +18,11 @@ static void text_input_clear_focused_surface(struct wlr_text_input_v3 *text_inpu
 
 static const struct zwp_text_input_v3_interface text_input_impl;
 
+static bool text_equal(const char *a, const char *b) {
+	// NULL is equivalent to the empty string
+	return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
 static struct wlr_text_input_v3 *text_input_from_resource(
 		struct wl_resource *resource) {
 	assert(wl_resource_instance_of(resource, &zwp_text_input_v3_interface,
@@ -116,10 +122,13 @@ static void text_input_set_surrounding_text(struct wl_client *client,
 	if (!text_input) {
 		return;
 	}
-	free(text_input->pending.surrounding.text);
-	text_input->pending.surrounding.text = strdup(text);
-	if (!text_input->pending.surrounding.text) {
-		wl_client_post_no_memory(client);
+	// Some clients resend the whole text on every cursor move
+	if (!text_equal(text_input->pending.surrounding.text, text)) {
+		free(text_input->pending.surrounding.text);
+		text_input->pending.surrounding.text = strdup(text);
+		if (!text_input->pending.surrounding.text) {
+			wl_client_post_no_memory(client);
+		}
 	}
 
 	text_input->pending.surrounding.cursor = cursor;
@@ -164,12 +173,38 @@ static void text_input_commit(struct wl_client *client,
 	if (!text_input) {
 		return;
 	}
-	free(text_input->current.surrounding.text);
-	text_input->current = text_input->pending;
-	if (text_input->pending.surrounding.text) {
-		text_input->current.surrounding.text =
-			strdup(text_input->pending.surrounding.text);
+	struct wlr_text_input_v3_state *current = &text_input->current;
+	struct wlr_text_input_v3_state *pending = &text_input->pending;
+
+	uint32_t changed = 0;
+	char *surrounding_text = current->surrounding.text;
+	if (!text_equal(surrounding_text, pending->surrounding.text)) {
+		free(surrounding_text);
+		surrounding_text = NULL;
+		if (pending->surrounding.text) {
+			surrounding_text = strdup(pending->surrounding.text);
+		}
+		changed |= WLR_TEXT_INPUT_V3_STATE_SURROUNDING_TEXT;
 	}
+	if (current->surrounding.cursor != pending->surrounding.cursor ||
+			current->surrounding.anchor != pending->surrounding.anchor) {
+		changed |= WLR_TEXT_INPUT_V3_STATE_SURROUNDING_TEXT;
+	}
+	if (current->text_change_cause != pending->text_change_cause) {
+		changed |= WLR_TEXT_INPUT_V3_STATE_TEXT_CHANGE_CAUSE;
+	}
+	if (current->content_type.hint != pending->content_type.hint ||
+			current->content_type.purpose != pending->content_type.purpose) {
+		changed |= WLR_TEXT_INPUT_V3_STATE_CONTENT_TYPE;
+	}
+	if (memcmp(&current->cursor_rectangle, &pending->cursor_rectangle,
+			sizeof(current->cursor_rectangle)) != 0) {
+		changed |= WLR_TEXT_INPUT_V3_STATE_CURSOR_RECTANGLE;
+	}
+
+	*current = *pending;
+	current->surrounding.text = surrounding_text;
+	text_input->current_changed = changed;
 
 	bool old_enabled = text_input->current_enabled;
 	text_input->current_enabled = text_input->pending_enabled;
@@ -1,7 +1,9 @@
 #define _POSIX_C_SOURCE 199309L
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_virtual_keyboard_v1.h>
 #include <wlr/util/log.h>
@@ -9,6 +11,8 @@
 #include "util/signal.h"
 #include "virtual-keyboard-unstable-v1-protocol.h"
 
+// Number of compiled keymaps kept around, least recently used first out
+#define KEYMAP_CACHE_SIZE 8
 
 static void keyboard_led_update(struct wlr_keyboard *wlr_kb, uint32_t leds) {
 	// unsupported by virtual keyboard protocol
@@ -40,34 +44,105 @@ static struct wlr_virtual_keyboard_v1 *virtual_keyboard_from_resource(
 	return wl_resource_get_user_data(resource);
 }
 
+static uint64_t hash_keymap_string(const char *data, size_t size) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static void keymap_destroy(struct wlr_virtual_keyboard_keymap_v1 *keymap) {
+	wl_list_remove(&keymap->link);
+	xkb_keymap_unref(keymap->keymap);
+	free(keymap->string);
+	free(keymap);
+}
+
+// Returns a keymap owned by the cache
+static struct xkb_keymap *manager_get_keymap(
+		struct wlr_virtual_keyboard_manager_v1 *manager,
+		const char *data, size_t size) {
+	uint64_t hash = hash_keymap_string(data, size);
+	struct wlr_virtual_keyboard_keymap_v1 *keymap;
+	wl_list_for_each(keymap, &manager->keymaps, link) {
+		if (keymap->hash == hash && keymap->size == size &&
+				memcmp(keymap->string, data, size) == 0) {
+			wl_list_remove(&keymap->link);
+			wl_list_insert(&manager->keymaps, &keymap->link);
+			return keymap->keymap;
+		}
+	}
+
+	if (manager->xkb_context == NULL) {
+		manager->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		if (manager->xkb_context == NULL) {
+			return NULL;
+		}
+	}
+
+	keymap = calloc(1, sizeof(struct wlr_virtual_keyboard_keymap_v1));
+	if (keymap == NULL) {
+		return NULL;
+	}
+	// The client's data isn't necessarily NUL-terminated
+	keymap->string = malloc(size + 1);
+	if (keymap->string == NULL) {
+		free(keymap);
+		return NULL;
+	}
+	memcpy(keymap->string, data, size);
+	keymap->string[size] = '\0';
+	keymap->size = size;
+	keymap->hash = hash;
+
+	keymap->keymap = xkb_keymap_new_from_string(manager->xkb_context,
+		keymap->string, XKB_KEYMAP_FORMAT_TEXT_V1,
+		XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (keymap->keymap == NULL) {
+		free(keymap->string);
+		free(keymap);
+		return NULL;
+	}
+
+	wl_list_insert(&manager->keymaps, &keymap->link);
+	if (++manager->n_keymaps > KEYMAP_CACHE_SIZE) {
+		// Keyboards using it hold their own reference
+		struct wlr_virtual_keyboard_keymap_v1 *oldest =
+			wl_container_of(manager->keymaps.prev, oldest, link);
+		keymap_destroy(oldest);
+		manager->n_keymaps--;
+	}
+	return keymap->keymap;
+}
+
 static void virtual_keyboard_keymap(struct wl_client *client,
 		struct wl_resource *resource, uint32_t format, int32_t fd,
 		uint32_t size) {
 	struct wlr_virtual_keyboard_v1 *keyboard =
 		virtual_keyboard_from_resource(resource);
 
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	if (!context) {
-		goto context_fail;
-	}
 	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (!data) {
-		goto fd_fail;
+	close(fd);
+	if (data == MAP_FAILED) {
+		goto fail;
 	}
-	struct xkb_keymap *keymap = xkb_keymap_new_from_string(context, data,
-		XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	struct xkb_keymap *keymap =
+		manager_get_keymap(keyboard->manager, data, size);
 	munmap(data, size);
 	if (!keymap) {
-		goto keymap_fail;
+		goto fail;
+	}
+
+	// Identical keymaps compile to the same cached keymap, which doesn't
+	// need to be sent again to seat clients
+	if (keymap != keyboard->input_device.keyboard->keymap) {
+		wlr_keyboard_set_keymap(keyboard->input_device.keyboard, keymap);
 	}
-	wlr_keyboard_set_keymap(keyboard->input_device.keyboard, keymap);
-	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
 	return;
-keymap_fail:
-fd_fail:
-	xkb_context_unref(context);
-context_fail:
+fail:
 	wl_client_post_no_memory(client);
 }
 
@@ -78,6 +153,7 @@ static void virtual_keyboard_key(struct wl_client *client,
 		virtual_keyboard_from_resource(resource);
 	struct wlr_event_keyboard_key event = {
 		.time_msec = time,
+		.time_usec = (uint64_t)time * 1000,
 		.keycode = key,
 		.update_state = false,
 		.state = state,
@@ -166,6 +242,7 @@ static void virtual_keyboard_manager_create_virtual_keyboard(
 	struct wlr_seat_client *seat_client = wlr_seat_client_from_resource(seat);
 
 	virtual_keyboard->input_device.keyboard = keyboard;
+	virtual_keyboard->manager = manager;
 	virtual_keyboard->resource = keyboard_resource;
 	virtual_keyboard->seat = seat_client->seat;
 	wl_signal_init(&virtual_keyboard->events.destroy);
@@ -221,6 +298,7 @@ struct wlr_virtual_keyboard_manager_v1*
 
 	wl_list_init(&manager->resources);
 	wl_list_init(&manager->virtual_keyboards);
+	wl_list_init(&manager->keymaps);
 
 	wl_signal_init(&manager->events.new_virtual_keyboard);
 	wl_signal_init(&manager->events.destroy);
@@ -244,5 +322,10 @@ void wlr_virtual_keyboard_manager_v1_destroy(
 			link) {
 		wl_resource_destroy(keyboard->resource);
 	}
+	struct wlr_virtual_keyboard_keymap_v1 *keymap, *keymap_tmp;
+	wl_list_for_each_safe(keymap, keymap_tmp, &manager->keymaps, link) {
+		keymap_destroy(keymap);
+	}
+	xkb_context_unref(manager->xkb_context);
 	free(manager);
 }
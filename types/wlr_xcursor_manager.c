@@ -1,7 +1,82 @@
 #define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/util/log.h>
+
+/**
+ * Themes are shared by all managers of the process, so that seats using the
+ * same theme at the same size don't decode the cursor images several times.
+ */
+struct shared_theme {
+	char *name; // may be NULL
+	int size;
+	struct wlr_xcursor_theme *theme;
+	size_t refs;
+	struct wl_list link; // shared_themes
+};
+
+static struct wl_list shared_themes = {
+	.prev = &shared_themes,
+	.next = &shared_themes,
+};
+
+static bool theme_name_equal(const char *a, const char *b) {
+	if (a == NULL || b == NULL) {
+		return a == b;
+	}
+	return strcmp(a, b) == 0;
+}
+
+static struct wlr_xcursor_theme *shared_theme_ref(const char *name,
+		int size) {
+	struct shared_theme *shared;
+	wl_list_for_each(shared, &shared_themes, link) {
+		if (shared->size == size && theme_name_equal(shared->name, name)) {
+			shared->refs++;
+			return shared->theme;
+		}
+	}
+
+	shared = calloc(1, sizeof(struct shared_theme));
+	if (shared == NULL) {
+		return NULL;
+	}
+	if (name != NULL) {
+		shared->name = strdup(name);
+		if (shared->name == NULL) {
+			free(shared);
+			return NULL;
+		}
+	}
+	shared->size = size;
+	shared->theme = wlr_xcursor_theme_load(name, size);
+	if (shared->theme == NULL) {
+		free(shared->name);
+		free(shared);
+		return NULL;
+	}
+	shared->refs = 1;
+	wl_list_insert(&shared_themes, &shared->link);
+	return shared->theme;
+}
+
+static void shared_theme_unref(struct wlr_xcursor_theme *theme) {
+	struct shared_theme *shared;
+	wl_list_for_each(shared, &shared_themes, link) {
+		if (shared->theme != theme) {
+			continue;
+		}
+		if (--shared->refs == 0) {
+			wl_list_remove(&shared->link);
+			wlr_xcursor_theme_destroy(shared->theme);
+			free(shared->name);
+			free(shared);
+		}
+		return;
+	}
+}
 
 struct wlr_xcursor_manager *wlr_xcursor_manager_create(const char *name,
 		uint32_t size) {
@@ -25,7 +100,9 @@ void wlr_xcursor_manager_destroy(struct wlr_xcursor_manager *manager) {
 	struct wlr_xcursor_manager_theme *theme, *tmp;
 	wl_list_for_each_safe(theme, tmp, &manager->scaled_themes, link) {
 		wl_list_remove(&theme->link);
-		wlr_xcursor_theme_destroy(theme->theme);
+		if (theme->theme != NULL) {
+			shared_theme_unref(theme->theme);
+		}
 		free(theme);
 	}
 	free(manager->name);
@@ -46,21 +123,36 @@ int wlr_xcursor_manager_load(struct wlr_xcursor_manager *manager,
 		return 1;
 	}
 	theme->scale = scale;
-	theme->theme = wlr_xcursor_theme_load(manager->name, manager->size * scale);
-	if (theme->theme == NULL) {
-		free(theme);
-		return 1;
-	}
+	// The theme files are read when a cursor is first needed at this scale
 	wl_list_insert(&manager->scaled_themes, &theme->link);
 	return 0;
 }
 
+// Returns the cursor from a registered scale, loading its theme if needed.
+// A scale whose theme fails to load is unregistered.
+static struct wlr_xcursor *manager_theme_get_cursor(
+		struct wlr_xcursor_manager *manager,
+		struct wlr_xcursor_manager_theme *theme, const char *name) {
+	if (theme->theme == NULL) {
+		theme->theme = shared_theme_ref(manager->name,
+			manager->size * theme->scale);
+		if (theme->theme == NULL) {
+			wlr_log(WLR_ERROR, "Failed to load cursor theme %s at scale %f",
+				manager->name ? manager->name : "(default)", theme->scale);
+			wl_list_remove(&theme->link);
+			free(theme);
+			return NULL;
+		}
+	}
+	return wlr_xcursor_theme_get_cursor(theme->theme, name);
+}
+
 struct wlr_xcursor *wlr_xcursor_manager_get_xcursor(
 		struct wlr_xcursor_manager *manager, const char *name, float scale) {
 	struct wlr_xcursor_manager_theme *theme;
 	wl_list_for_each(theme, &manager->scaled_themes, link) {
 		if (theme->scale == scale) {
-			return wlr_xcursor_theme_get_cursor(theme->theme, name);
+			return manager_theme_get_cursor(manager, theme, name);
 		}
 	}
 	return NULL;
@@ -68,10 +160,10 @@ struct wlr_xcursor *wlr_xcursor_manager_get_xcursor(
 
 void wlr_xcursor_manager_set_cursor_image(struct wlr_xcursor_manager *manager,
 		const char *name, struct wlr_cursor *cursor) {
-	struct wlr_xcursor_manager_theme *theme;
-	wl_list_for_each(theme, &manager->scaled_themes, link) {
+	struct wlr_xcursor_manager_theme *theme, *tmp;
+	wl_list_for_each_safe(theme, tmp, &manager->scaled_themes, link) {
 		struct wlr_xcursor *xcursor =
-			wlr_xcursor_theme_get_cursor(theme->theme, name);
+			manager_theme_get_cursor(manager, theme, name);
 		if (xcursor == NULL) {
 			continue;
 		}
@@ -58,7 +58,26 @@ static void output_update(struct wlr_xdg_output_v1 *xdg_output) {
 	}
 }
 
+static void output_handle_idle_update(void *data) {
+	struct wlr_xdg_output_v1 *xdg_output = data;
+	xdg_output->idle_update = NULL;
+	output_update(xdg_output);
+}
+
+static void output_schedule_update(struct wlr_xdg_output_v1 *xdg_output) {
+	if (xdg_output->idle_update != NULL) {
+		return;
+	}
+	struct wl_event_loop *ev =
+		wl_display_get_event_loop(xdg_output->manager->display);
+	xdg_output->idle_update =
+		wl_event_loop_add_idle(ev, output_handle_idle_update, xdg_output);
+}
+
 static void output_destroy(struct wlr_xdg_output_v1 *output) {
+	if (output->idle_update != NULL) {
+		wl_event_source_remove(output->idle_update);
+	}
 	struct wl_resource *resource, *tmp;
 	wl_resource_for_each_safe(resource, tmp, &output->resources) {
 		wl_list_remove(wl_resource_get_link(resource));
@@ -177,9 +196,11 @@ static void add_output(struct wlr_xdg_output_manager_v1 *manager,
 
 static void output_manager_send_details(
 		struct wlr_xdg_output_manager_v1 *manager) {
+	// Layout changes usually come in bursts, e.g. when several outputs are
+	// moved: only send the final state
 	struct wlr_xdg_output_v1 *output;
 	wl_list_for_each(output, &manager->outputs, link) {
-		output_update(output);
+		output_schedule_update(output);
 	}
 }
 
@@ -211,6 +232,7 @@ struct wlr_xdg_output_manager_v1 *wlr_xdg_output_manager_v1_create(
 		return NULL;
 	}
 	manager->layout = layout;
+	manager->display = display;
 	manager->global = wl_global_create(display,
 		&zxdg_output_manager_v1_interface, OUTPUT_MANAGER_VERSION, manager,
 		output_manager_bind);
@@ -82,6 +82,7 @@ void unmap_xdg_surface(struct wlr_xdg_surface *surface) {
 		surface->configure_idle = NULL;
 	}
 	surface->configure_next_serial = 0;
+	surface->configure_outstanding = surface->configure_deferred = false;
 
 	surface->has_next_geometry = false;
 	memset(&surface->geometry, 0, sizeof(struct wlr_box));
@@ -142,6 +143,7 @@ static void surface_send_configure(void *user_data) {
 	struct wlr_xdg_surface *surface = user_data;
 
 	surface->configure_idle = NULL;
+	surface->configure_outstanding = surface->throttle_configures;
 
 	struct wlr_xdg_surface_configure *configure =
 		calloc(1, sizeof(struct wlr_xdg_surface_configure));
@@ -180,15 +182,18 @@ static uint32_t schedule_configure(struct wlr_xdg_surface *surface,
 	struct wl_display *display = wl_client_get_display(surface->client->client);
 	struct wl_event_loop *loop = wl_display_get_event_loop(display);
 
-	if (surface->configure_idle != NULL) {
+	if (surface->configure_idle != NULL || surface->configure_deferred) {
 		if (!pending_same) {
 			// configure request already scheduled
 			return surface->configure_next_serial;
 		}
 
 		// configure request not necessary anymore
-		wl_event_source_remove(surface->configure_idle);
-		surface->configure_idle = NULL;
+		if (surface->configure_idle != NULL) {
+			wl_event_source_remove(surface->configure_idle);
+			surface->configure_idle = NULL;
+		}
+		surface->configure_deferred = false;
 		return 0;
 	} else {
 		if (pending_same) {
@@ -197,12 +202,53 @@ static uint32_t schedule_configure(struct wlr_xdg_surface *surface,
 		}
 
 		surface->configure_next_serial = wl_display_next_serial(display);
-		surface->configure_idle = wl_event_loop_add_idle(loop,
-			surface_send_configure, surface);
+		if (surface->throttle_configures && surface->configure_outstanding) {
+			// Sent with the latest state once the client catches up
+			surface->configure_deferred = true;
+		} else {
+			surface->configure_idle = wl_event_loop_add_idle(loop,
+				surface_send_configure, surface);
+		}
 		return surface->configure_next_serial;
 	}
 }
 
+static void send_deferred_configure(struct wlr_xdg_surface *surface) {
+	if (!surface->configure_deferred) {
+		return;
+	}
+	surface->configure_deferred = false;
+
+	struct wl_display *display = wl_client_get_display(surface->client->client);
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	surface->configure_idle = wl_event_loop_add_idle(loop,
+		surface_send_configure, surface);
+}
+
+void wlr_xdg_surface_set_configure_throttle(struct wlr_xdg_surface *surface,
+		bool throttle) {
+	surface->throttle_configures = throttle;
+	if (!throttle) {
+		surface->configure_outstanding = false;
+		send_deferred_configure(surface);
+	}
+}
+
+static bool xdg_surface_transaction_is_ready(struct wlr_surface *wlr_surface,
+		void *data) {
+	struct wlr_xdg_surface *surface = data;
+	// Serials wrap around
+	return surface->configured &&
+		(int32_t)(surface->configure_serial - surface->transaction_serial) >= 0;
+}
+
+bool wlr_xdg_surface_transaction_add(struct wlr_xdg_surface *surface,
+		struct wlr_surface_transaction *txn, uint32_t serial) {
+	surface->transaction_serial = serial;
+	return wlr_surface_transaction_add(txn, surface->surface,
+		xdg_surface_transaction_is_ready, surface);
+}
+
 uint32_t schedule_xdg_surface_configure(struct wlr_xdg_surface *surface) {
 	bool pending_same = false;
 
@@ -359,6 +405,13 @@ void handle_xdg_surface_commit(struct wlr_surface *wlr_surface) {
 			surface->mapped) {
 		unmap_xdg_surface(surface);
 	}
+
+	if (surface->configure_outstanding &&
+			wl_list_empty(&surface->configure_list)) {
+		// The client has acked and committed the last configure
+		surface->configure_outstanding = false;
+		send_deferred_configure(surface);
+	}
 }
 
 void handle_xdg_surface_precommit(struct wlr_surface *wlr_surface) {
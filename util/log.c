@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 199506L
 #include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,7 +10,24 @@
 #include <wlr/util/log.h>
 
 static bool colored = true;
-static enum wlr_log_importance log_importance = WLR_ERROR;
+enum wlr_log_importance _wlr_log_verbosity = WLR_ERROR;
+
+// Messages longer than this are truncated when logging asynchronously
+#define LOG_ASYNC_LINE_SIZE 1024
+
+struct log_async {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+
+	char *buf;
+	size_t size;
+	size_t head, len; // bytes pending in buf, starting at head
+	size_t dropped; // messages dropped since the last write
+};
+
+static struct log_async *log_async = NULL;
 
 static const char *verbosity_colors[] = {
 	[WLR_SILENT] = "",
@@ -18,9 +36,105 @@ static const char *verbosity_colors[] = {
 	[WLR_DEBUG ] = "\x1B[1;30m",
 };
 
+static void write_all(const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(STDERR_FILENO, data, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+static void *log_async_run(void *data) {
+	struct log_async *async = data;
+
+	pthread_mutex_lock(&async->lock);
+	while (true) {
+		while (async->running && async->len == 0 && async->dropped == 0) {
+			pthread_cond_wait(&async->cond, &async->lock);
+		}
+
+		if (async->dropped > 0) {
+			char note[64];
+			int n = snprintf(note, sizeof(note),
+				"[log] %zu messages dropped\n", async->dropped);
+			async->dropped = 0;
+			pthread_mutex_unlock(&async->lock);
+			write_all(note, n);
+			pthread_mutex_lock(&async->lock);
+			continue;
+		}
+		if (async->len == 0) {
+			break; // Stopped and flushed
+		}
+
+		// Writers only ever append to the free part of the ring, so the
+		// pending bytes can be written out without holding the lock
+		size_t head = async->head;
+		size_t len = async->len;
+		if (len > async->size - head) {
+			len = async->size - head;
+		}
+		pthread_mutex_unlock(&async->lock);
+		write_all(async->buf + head, len);
+		pthread_mutex_lock(&async->lock);
+
+		async->head = (head + len) % async->size;
+		async->len -= len;
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	return NULL;
+}
+
+static void log_async_push(struct log_async *async, const char *data,
+		size_t len) {
+	pthread_mutex_lock(&async->lock);
+	if (async->size - async->len < len) {
+		async->dropped++;
+	} else {
+		size_t tail = (async->head + async->len) % async->size;
+		size_t first = async->size - tail;
+		if (first > len) {
+			first = len;
+		}
+		memcpy(async->buf + tail, data, first);
+		memcpy(async->buf, data + first, len - first);
+		async->len += len;
+	}
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+}
+
+static void log_stderr_async(struct log_async *async, unsigned c,
+		const char *time_prefix, const char *fmt, va_list args) {
+	char line[LOG_ASYNC_LINE_SIZE];
+	bool color = colored && isatty(STDERR_FILENO);
+	const char *reset = color ? "\x1B[0m\n" : "\n";
+	size_t reset_len = strlen(reset);
+	size_t max = sizeof(line) - reset_len;
+
+	int n = snprintf(line, max, "%s%s", time_prefix,
+		color ? verbosity_colors[c] : "");
+	size_t len = n < 0 ? 0 : ((size_t)n < max ? (size_t)n : max - 1);
+	n = vsnprintf(line + len, max - len, fmt, args);
+	if (n > 0) {
+		len += (size_t)n < max - len ? (size_t)n : max - len - 1;
+	}
+	memcpy(line + len, reset, reset_len);
+	len += reset_len;
+
+	log_async_push(async, line, len);
+}
+
 static void log_stderr(enum wlr_log_importance verbosity, const char *fmt,
 		va_list args) {
-	if (verbosity > log_importance) {
+	if (verbosity > _wlr_log_verbosity) {
 		return;
 	}
 	// prefix the time to the log message
@@ -31,10 +145,16 @@ static void log_stderr(enum wlr_log_importance verbosity, const char *fmt,
 
 	// generate time prefix
 	strftime(buffer, sizeof(buffer), "%F %T - ", tm_info);
-	fprintf(stderr, "%s", buffer);
 
 	unsigned c = (verbosity < WLR_LOG_IMPORTANCE_LAST) ? verbosity : WLR_LOG_IMPORTANCE_LAST - 1;
 
+	if (log_async != NULL) {
+		log_stderr_async(log_async, c, buffer, fmt, args);
+		return;
+	}
+
+	fprintf(stderr, "%s", buffer);
+
 	if (colored && isatty(STDERR_FILENO)) {
 		fprintf(stderr, "%s", verbosity_colors[c]);
 	}
@@ -51,18 +171,100 @@ static wlr_log_func_t log_callback = log_stderr;
 
 void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback) {
 	if (verbosity < WLR_LOG_IMPORTANCE_LAST) {
-		log_importance = verbosity;
+		_wlr_log_verbosity = verbosity;
 	}
 	if (callback) {
 		log_callback = callback;
 	}
 }
 
+// Stops the logging thread once it has written out all pending messages
+static void log_async_stop_thread(struct log_async *async) {
+	pthread_mutex_lock(&async->lock);
+	async->running = false;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+	pthread_join(async->thread, NULL);
+}
+
+static void log_async_stop_at_exit(void) {
+	struct log_async *async = log_async;
+	if (async == NULL) {
+		return;
+	}
+	log_async = NULL;
+	log_async_stop_thread(async);
+	// Other threads may still be logging into the ring, so it is never freed.
+	// Their messages are lost.
+}
+
+bool wlr_log_start_async(size_t buffer_size) {
+	static bool atexit_registered = false;
+
+	if (log_async != NULL) {
+		return true;
+	}
+	if (buffer_size < LOG_ASYNC_LINE_SIZE) {
+		buffer_size = LOG_ASYNC_LINE_SIZE;
+	}
+
+	struct log_async *async = calloc(1, sizeof(struct log_async));
+	if (async == NULL) {
+		return false;
+	}
+	async->buf = malloc(buffer_size);
+	if (async->buf == NULL) {
+		free(async);
+		return false;
+	}
+	async->size = buffer_size;
+	async->running = true;
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->cond, NULL);
+
+	if (pthread_create(&async->thread, NULL, log_async_run, async) != 0) {
+		pthread_cond_destroy(&async->cond);
+		pthread_mutex_destroy(&async->lock);
+		free(async->buf);
+		free(async);
+		return false;
+	}
+
+	if (!atexit_registered) {
+		atexit(log_async_stop_at_exit);
+		atexit_registered = true;
+	}
+
+	fflush(stderr);
+	log_async = async;
+	return true;
+}
+
+void wlr_log_stop_async(void) {
+	struct log_async *async = log_async;
+	if (async == NULL) {
+		return;
+	}
+	log_async = NULL;
+	log_async_stop_thread(async);
+
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->lock);
+	free(async->buf);
+	free(async);
+}
+
 void _wlr_vlog(enum wlr_log_importance verbosity, const char *fmt, va_list args) {
+	if (verbosity > _wlr_log_verbosity) {
+		return;
+	}
 	log_callback(verbosity, fmt, args);
 }
 
 void _wlr_log(enum wlr_log_importance verbosity, const char *fmt, ...) {
+	if (verbosity > _wlr_log_verbosity) {
+		return;
+	}
 	va_list args;
 	va_start(args, fmt);
 	log_callback(verbosity, fmt, args);
@@ -87,5 +289,5 @@ const char *_wlr_strip_path(const char *filepath) {
 }
 
 enum wlr_log_importance wlr_log_get_verbosity(void) {
-	return log_importance;
+	return _wlr_log_verbosity;
 }
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+#include <wlr/util/mime_type.h>
+
+#define MIME_TYPE_BUCKETS 64
+
+struct mime_type {
+	struct wl_list link; // buckets
+	size_t n_refs;
+	uint32_t hash;
+	char name[];
+};
+
+// Wayland objects are only used from one thread, and so are MIME types
+static struct wl_list buckets[MIME_TYPE_BUCKETS];
+static bool buckets_initialized = false;
+
+static uint32_t hash_string(const char *str) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (const unsigned char *c = (const unsigned char *)str; *c; ++c) {
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct mime_type *mime_type_from_name(const char *name) {
+	return (struct mime_type *)(name - offsetof(struct mime_type, name));
+}
+
+const char *wlr_mime_type_intern(const char *mime_type) {
+	if (!buckets_initialized) {
+		for (size_t i = 0; i < MIME_TYPE_BUCKETS; ++i) {
+			wl_list_init(&buckets[i]);
+		}
+		buckets_initialized = true;
+	}
+
+	uint32_t hash = hash_string(mime_type);
+	struct wl_list *bucket = &buckets[hash % MIME_TYPE_BUCKETS];
+
+	struct mime_type *entry;
+	wl_list_for_each(entry, bucket, link) {
+		if (entry->hash == hash && strcmp(entry->name, mime_type) == 0) {
+			entry->n_refs++;
+			return entry->name;
+		}
+	}
+
+	size_t len = strlen(mime_type);
+	entry = malloc(sizeof(struct mime_type) + len + 1);
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->n_refs = 1;
+	entry->hash = hash;
+	memcpy(entry->name, mime_type, len + 1);
+	wl_list_insert(bucket, &entry->link);
+	return entry->name;
+}
+
+const char *wlr_mime_type_ref(const char *mime_type) {
+	struct mime_type *entry = mime_type_from_name(mime_type);
+	entry->n_refs++;
+	return mime_type;
+}
+
+void wlr_mime_type_unref(const char *mime_type) {
+	if (mime_type == NULL) {
+		return;
+	}
+	struct mime_type *entry = mime_type_from_name(mime_type);
+	assert(entry->n_refs > 0);
+	entry->n_refs--;
+	if (entry->n_refs == 0) {
+		wl_list_remove(&entry->link);
+		free(entry);
+	}
+}
@@ -1,13 +1,134 @@
 #include <assert.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/util/region.h>
+#include "util/transform.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Vector kernels load each box as four 32-bit lanes: x1, y1, x2, y2
+static_assert(sizeof(pixman_box32_t) == 4 * sizeof(int32_t),
+	"pixman_box32_t must be made of four 32-bit coordinates");
+
+// Rectangle arrays are only needed until the resulting region is built, so the
+// same storage is reused by every call and every frame instead of allocating
+// one array per region. It is per-thread, regions aren't tied to the event
+// loop.
+static _Thread_local struct {
+	pixman_box32_t *rects;
+	size_t cap;
+} scratch;
+
+static pixman_box32_t *get_scratch_rects(size_t len) {
+	if (len <= scratch.cap) {
+		return scratch.rects;
+	}
+
+	size_t cap = scratch.cap > 0 ? scratch.cap : 16;
+	while (cap < len) {
+		cap *= 2;
+	}
+	pixman_box32_t *rects = realloc(scratch.rects, cap * sizeof(*rects));
+	if (rects == NULL) {
+		return NULL;
+	}
+	scratch.rects = rects;
+	scratch.cap = cap;
+	return rects;
+}
+
+static void region_set_rects(pixman_region32_t *dst, pixman_box32_t *rects,
+		int nrects) {
+	pixman_region32_fini(dst);
+	if (nrects == 1 && rects[0].x1 < rects[0].x2 && rects[0].y1 < rects[0].y2) {
+		// Single boxes are stored in the region itself, without allocating
+		pixman_region32_init_rect(dst, rects[0].x1, rects[0].y1,
+			rects[0].x2 - rects[0].x1, rects[0].y2 - rects[0].y1);
+	} else {
+		pixman_region32_init_rects(dst, rects, nrects);
+	}
+}
+
+#if defined(__SSE2__)
+static inline __m128 floor_ps(__m128 v) {
+	// Truncation rounds negative numbers up
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+#endif
+
+// Rounds x1 and y1 down and x2 and y2 up, ceil(v) being -floor(-v)
+static void scale_rects(pixman_box32_t *dst, const pixman_box32_t *src,
+		int nrects, float scale_x, float scale_y) {
+	int i = 0;
+#if defined(__SSE2__)
+	__m128 factor = _mm_setr_ps(scale_x, scale_y, -scale_x, -scale_y);
+	__m128 sign = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+	for (; i < nrects; ++i) {
+		__m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&src[i]));
+		v = _mm_mul_ps(floor_ps(_mm_mul_ps(v, factor)), sign);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_cvttps_epi32(v));
+	}
+#elif defined(__aarch64__)
+	const float factor_lanes[] = { scale_x, scale_y, -scale_x, -scale_y };
+	const float sign_lanes[] = { 1.0f, 1.0f, -1.0f, -1.0f };
+	float32x4_t factor = vld1q_f32(factor_lanes);
+	float32x4_t sign = vld1q_f32(sign_lanes);
+	for (; i < nrects; ++i) {
+		float32x4_t v = vcvtq_f32_s32(vld1q_s32((const int32_t *)&src[i]));
+		v = vmulq_f32(vrndmq_f32(vmulq_f32(v, factor)), sign);
+		vst1q_s32((int32_t *)&dst[i], vcvtq_s32_f32(v));
+	}
+#endif
+	for (; i < nrects; ++i) {
+		pixman_box32_t rect = src[i];
+		dst[i].x1 = floor(rect.x1 * scale_x);
+		dst[i].x2 = ceil(rect.x2 * scale_x);
+		dst[i].y1 = floor(rect.y1 * scale_y);
+		dst[i].y2 = ceil(rect.y2 * scale_y);
+	}
+}
+
+// Adds a per-coordinate offset to each box
+static void offset_rects(pixman_box32_t *dst, const pixman_box32_t *src,
+		int nrects, const int32_t offset[static 4]) {
+	int i = 0;
+#if defined(__SSE2__)
+	__m128i off = _mm_loadu_si128((const __m128i *)offset);
+	for (; i < nrects; ++i) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_add_epi32(v, off));
+	}
+#elif defined(__aarch64__)
+	int32x4_t off = vld1q_s32(offset);
+	for (; i < nrects; ++i) {
+		int32x4_t v = vld1q_s32((const int32_t *)&src[i]);
+		vst1q_s32((int32_t *)&dst[i], vaddq_s32(v, off));
+	}
+#endif
+	for (; i < nrects; ++i) {
+		dst[i].x1 = src[i].x1 + offset[0];
+		dst[i].y1 = src[i].y1 + offset[1];
+		dst[i].x2 = src[i].x2 + offset[2];
+		dst[i].y2 = src[i].y2 + offset[3];
+	}
+}
 
 void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 		float scale) {
-	if (scale == 1) {
+	wlr_region_scale_xy(dst, src, scale, scale);
+}
+
+void wlr_region_scale_xy(pixman_region32_t *dst, pixman_region32_t *src,
+		float scale_x, float scale_y) {
+	if (scale_x == 1 && scale_y == 1) {
 		pixman_region32_copy(dst, src);
 		return;
 	}
@@ -15,21 +136,229 @@ void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t *dst_rects = get_scratch_rects(nrects);
 	if (dst_rects == NULL) {
 		return;
 	}
 
+	scale_rects(dst_rects, src_rects, nrects, scale_x, scale_y);
+
+	region_set_rects(dst, dst_rects, nrects);
+}
+
+void wlr_region_scale_xy_inner(pixman_region32_t *dst, pixman_region32_t *src,
+		float scale_x, float scale_y) {
+	if (scale_x == 1 && scale_y == 1) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+
+	pixman_box32_t *dst_rects = get_scratch_rects(nrects);
+	if (dst_rects == NULL) {
+		pixman_region32_clear(dst);
+		return;
+	}
+
+	// Boxes which become empty are dropped by region_set_rects
 	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = floor(src_rects[i].x1 * scale);
-		dst_rects[i].x2 = ceil(src_rects[i].x2 * scale);
-		dst_rects[i].y1 = floor(src_rects[i].y1 * scale);
-		dst_rects[i].y2 = ceil(src_rects[i].y2 * scale);
+		pixman_box32_t rect = src_rects[i];
+		dst_rects[i].x1 = ceil(rect.x1 * scale_x);
+		dst_rects[i].x2 = floor(rect.x2 * scale_x);
+		dst_rects[i].y1 = ceil(rect.y1 * scale_y);
+		dst_rects[i].y2 = floor(rect.y2 * scale_y);
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_set_rects(dst, dst_rects, nrects);
+}
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void box_union(pixman_box32_t *dst, const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	dst->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+	dst->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+	dst->x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+	dst->y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+}
+
+// Area added to the union of two boxes by replacing them with their extents
+static int64_t box_merge_cost(const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	pixman_box32_t merged;
+	box_union(&merged, a, b);
+	return box_area(&merged) - box_area(a) - box_area(b);
+}
+
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+		int max_rects) {
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+	if (nrects <= max_rects) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+	if (max_rects <= 1) {
+		pixman_box32_t extents = *pixman_region32_extents(src);
+		pixman_region32_fini(dst);
+		pixman_region32_init_rect(dst, extents.x1, extents.y1,
+			extents.x2 - extents.x1, extents.y2 - extents.y1);
+		return;
+	}
+
+	pixman_box32_t *clusters = get_scratch_rects(max_rects);
+	if (clusters == NULL) {
+		// The unsimplified region still contains the original one
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	// Each rectangle either joins the cluster it grows the least, or starts
+	// a new cluster after the two closest clusters have been merged
+	int nclusters = 0;
+	for (int i = 0; i < nrects; ++i) {
+		const pixman_box32_t *rect = &src_rects[i];
+		if (nclusters < max_rects) {
+			clusters[nclusters++] = *rect;
+			continue;
+		}
+
+		int add_idx = 0;
+		int64_t add_cost = INT64_MAX;
+		for (int j = 0; j < nclusters; ++j) {
+			int64_t cost = box_merge_cost(&clusters[j], rect);
+			if (cost < add_cost) {
+				add_cost = cost;
+				add_idx = j;
+			}
+		}
+
+		int merge_a = 0, merge_b = 0;
+		int64_t merge_cost = INT64_MAX;
+		for (int j = 0; j < nclusters; ++j) {
+			for (int k = j + 1; k < nclusters; ++k) {
+				int64_t cost = box_merge_cost(&clusters[j], &clusters[k]);
+				if (cost < merge_cost) {
+					merge_cost = cost;
+					merge_a = j;
+					merge_b = k;
+				}
+			}
+		}
+
+		if (merge_cost < add_cost) {
+			box_union(&clusters[merge_a], &clusters[merge_a],
+				&clusters[merge_b]);
+			clusters[merge_b] = *rect;
+		} else {
+			box_union(&clusters[add_idx], &clusters[add_idx], rect);
+		}
+	}
+
+	region_set_rects(dst, clusters, nclusters);
+}
+
+/**
+ * Each transform maps the coordinates of a box to (off - src) or (off + src)
+ * where src is one of the source coordinates: lane i of the result is
+ * offset[i] + (negate[i] ? -1 : 1) * src[lanes[i]], lanes being in the x1, y1,
+ * x2, y2 order.
+ */
+struct rect_transform {
+	int lanes[4];
+	int32_t negate[4]; // -1 to negate, 0 otherwise
+	int32_t offset[4];
+};
+
+static void get_rect_transform(struct rect_transform *t,
+		enum wl_output_transform transform, int width, int height) {
+	const struct transform_axes *axes = &transform_axes[transform];
+	int s = axes->swap;
+	int32_t ext_x = s ? height : width, ext_y = s ? width : height;
+	// A flipped axis swaps its two edges
+	int fx = axes->flip_x, fy = axes->flip_y;
+	t->lanes[0] = s + 2 * fx;
+	t->lanes[1] = 1 - s + 2 * fy;
+	t->lanes[2] = s + 2 * (1 - fx);
+	t->lanes[3] = 1 - s + 2 * (1 - fy);
+	t->negate[0] = t->negate[2] = -fx;
+	t->negate[1] = t->negate[3] = -fy;
+	t->offset[0] = t->offset[2] = fx * ext_x;
+	t->offset[1] = t->offset[3] = fy * ext_y;
+}
+
+#if defined(__SSE2__)
+// Shuffles need immediate lanes, one loop is generated per transform
+#define TRANSFORM_RECTS_SSE2(l0, l1, l2, l3) \
+	for (; i < nrects; ++i) { \
+		__m128i v = _mm_loadu_si128((const __m128i *)&src[i]); \
+		v = _mm_shuffle_epi32(v, _MM_SHUFFLE(l3, l2, l1, l0)); \
+		v = _mm_sub_epi32(_mm_xor_si128(v, negate), negate); \
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_add_epi32(v, offset)); \
+	}
+#endif
+
+static void transform_rects(pixman_box32_t *dst, const pixman_box32_t *src,
+		int nrects, const struct rect_transform *t,
+		enum wl_output_transform transform) {
+	int i = 0;
+#if defined(__SSE2__)
+	__m128i negate = _mm_loadu_si128((const __m128i *)t->negate);
+	__m128i offset = _mm_loadu_si128((const __m128i *)t->offset);
+	switch (transform) {
+	case WL_OUTPUT_TRANSFORM_NORMAL:
+		TRANSFORM_RECTS_SSE2(0, 1, 2, 3);
+		break;
+	case WL_OUTPUT_TRANSFORM_90:
+		TRANSFORM_RECTS_SSE2(1, 2, 3, 0);
+		break;
+	case WL_OUTPUT_TRANSFORM_180:
+		TRANSFORM_RECTS_SSE2(2, 3, 0, 1);
+		break;
+	case WL_OUTPUT_TRANSFORM_270:
+		TRANSFORM_RECTS_SSE2(3, 0, 1, 2);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED:
+		TRANSFORM_RECTS_SSE2(2, 1, 0, 3);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+		TRANSFORM_RECTS_SSE2(3, 2, 1, 0);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+		TRANSFORM_RECTS_SSE2(0, 3, 2, 1);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+		TRANSFORM_RECTS_SSE2(1, 0, 3, 2);
+		break;
+	}
+#elif defined(__aarch64__)
+	uint8_t lanes[16];
+	for (int j = 0; j < 16; ++j) {
+		lanes[j] = t->lanes[j / 4] * 4 + j % 4;
+	}
+	uint8x16_t shuffle = vld1q_u8(lanes);
+	int32x4_t negate = vld1q_s32(t->negate);
+	int32x4_t offset = vld1q_s32(t->offset);
+	for (; i < nrects; ++i) {
+		uint8x16_t b = vld1q_u8((const uint8_t *)&src[i]);
+		int32x4_t v = vreinterpretq_s32_u8(vqtbl1q_u8(b, shuffle));
+		v = vsubq_s32(veorq_s32(v, negate), negate);
+		vst1q_s32((int32_t *)&dst[i], vaddq_s32(v, offset));
+	}
+#endif
+	for (; i < nrects; ++i) {
+		const int32_t *in = (const int32_t *)&src[i];
+		int32_t out[4];
+		for (int j = 0; j < 4; ++j) {
+			int32_t v = in[t->lanes[j]];
+			out[j] = t->offset[j] + (t->negate[j] ? -v : v);
+		}
+		dst[i] = (pixman_box32_t){ out[0], out[1], out[2], out[3] };
+	}
 }
 
 void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
@@ -42,67 +371,16 @@ void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t *dst_rects = get_scratch_rects(nrects);
 	if (dst_rects == NULL) {
 		return;
 	}
 
-	for (int i = 0; i < nrects; ++i) {
-		switch (transform) {
-		case WL_OUTPUT_TRANSFORM_NORMAL:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_90:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_180:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_270:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		}
-	}
+	struct rect_transform t;
+	get_rect_transform(&t, transform, width, height);
+	transform_rects(dst_rects, src_rects, nrects, &t, transform);
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_set_rects(dst, dst_rects, nrects);
 }
 
 void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
@@ -115,21 +393,15 @@ void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t *dst_rects = get_scratch_rects(nrects);
 	if (dst_rects == NULL) {
 		return;
 	}
 
-	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = src_rects[i].x1 - distance;
-		dst_rects[i].x2 = src_rects[i].x2 + distance;
-		dst_rects[i].y1 = src_rects[i].y1 - distance;
-		dst_rects[i].y2 = src_rects[i].y2 + distance;
-	}
+	const int32_t offset[] = { -distance, -distance, distance, distance };
+	offset_rects(dst_rects, src_rects, nrects, offset);
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_set_rects(dst, dst_rects, nrects);
 }
 
 void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
@@ -142,28 +414,29 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t *dst_rects = get_scratch_rects(nrects);
 	if (dst_rects == NULL) {
 		return;
 	}
 
+	double c = cos(rotation), s = sin(rotation);
 	for (int i = 0; i < nrects; ++i) {
 		double x1 = src_rects[i].x1 - ox;
 		double y1 = src_rects[i].y1 - oy;
 		double x2 = src_rects[i].x2 - ox;
 		double y2 = src_rects[i].y2 - oy;
 
-		double rx1 = x1 * cos(rotation) - y1 * sin(rotation);
-		double ry1 = x1 * sin(rotation) + y1 * cos(rotation);
+		double rx1 = x1 * c - y1 * s;
+		double ry1 = x1 * s + y1 * c;
 
-		double rx2 = x2 * cos(rotation) - y1 * sin(rotation);
-		double ry2 = x2 * sin(rotation) + y1 * cos(rotation);
+		double rx2 = x2 * c - y1 * s;
+		double ry2 = x2 * s + y1 * c;
 
-		double rx3 = x2 * cos(rotation) - y2 * sin(rotation);
-		double ry3 = x2 * sin(rotation) + y2 * cos(rotation);
+		double rx3 = x2 * c - y2 * s;
+		double ry3 = x2 * s + y2 * c;
 
-		double rx4 = x1 * cos(rotation) - y2 * sin(rotation);
-		double ry4 = x1 * sin(rotation) + y2 * cos(rotation);
+		double rx4 = x1 * c - y2 * s;
+		double ry4 = x1 * s + y2 * c;
 
 		x1 = fmin(fmin(rx1, rx2), fmin(rx3, rx4));
 		y1 = fmin(fmin(ry1, ry2), fmin(ry3, ry4));
@@ -176,13 +449,20 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 		dst_rects[i].y2 = ceil(oy + y2);
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_set_rects(dst, dst_rects, nrects);
+}
+
+// Finds the rectangle of the region containing a point
+typedef bool (*region_lookup_func_t)(void *region, int x, int y,
+	pixman_box32_t *box);
+
+static bool region_lookup(void *region, int x, int y, pixman_box32_t *box) {
+	return pixman_region32_contains_point(region, x, y, box);
 }
 
-static void region_confine(pixman_region32_t *region, double x1, double y1, double x2,
-		double y2, double *x2_out, double *y2_out, pixman_box32_t box) {
+static void region_confine(region_lookup_func_t lookup, void *region,
+		double x1, double y1, double x2, double y2,
+		double *x2_out, double *y2_out, pixman_box32_t box) {
 	double x_clamped = fmax(fmin(x2, box.x2 - 1), box.x1);
 	double y_clamped = fmax(fmin(y2, box.y2 - 1), box.y1);
 
@@ -209,8 +489,8 @@ static void region_confine(pixman_region32_t *region, double x1, double y1, doub
 	int x_ext = floor(x) + (dx == 0 ? 0 : dx > 0 ? 1 : -1);
 	int y_ext = floor(y) + (dy == 0 ? 0 : dy > 0 ? 1 : -1);
 
-	if (pixman_region32_contains_point(region, x_ext, y_ext, &box)) {
-		return region_confine(region, x1, y1, x2, y2, x2_out, y2_out, box);
+	if (lookup(region, x_ext, y_ext, &box)) {
+		return region_confine(lookup, region, x1, y1, x2, y2, x2_out, y2_out, box);
 	} else if (dx == 0 || dy == 0) {
 		*x2_out = x;
 		*y2_out = y;
@@ -221,8 +501,8 @@ static void region_confine(pixman_region32_t *region, double x1, double y1, doub
 		if ((bordering_x && bordering_y) || (!bordering_x && !bordering_y)) {
 			double x2_potential, y2_potential;
 			double tmp1, tmp2;
-			region_confine(region, x, y, x, y2, &tmp1, &y2_potential, box);
-			region_confine(region, x, y, x2, y, &x2_potential, &tmp2, box);
+			region_confine(lookup, region, x, y, x, y2, &tmp1, &y2_potential, box);
+			region_confine(lookup, region, x, y, x2, y, &x2_potential, &tmp2, box);
 			if (fabs(x2_potential - x) > fabs(y2_potential - y)) {
 				*x2_out = x2_potential;
 				*y2_out = y;
@@ -231,9 +511,9 @@ static void region_confine(pixman_region32_t *region, double x1, double y1, doub
 				*y2_out = y2_potential;
 			}
 		} else if (bordering_x) {
-			return region_confine(region, x, y, x, y2, x2_out, y2_out, box);
+			return region_confine(lookup, region, x, y, x, y2, x2_out, y2_out, box);
 		} else if (bordering_y) {
-			return region_confine(region, x, y, x2, y, x2_out, y2_out, box);
+			return region_confine(lookup, region, x, y, x2, y, x2_out, y2_out, box);
 		}
 	}
 }
@@ -242,9 +522,191 @@ bool wlr_region_confine(pixman_region32_t *region, double x1, double y1, double
 		double y2, double *x2_out, double *y2_out) {
 	pixman_box32_t box;
 	if (pixman_region32_contains_point(region, floor(x1), floor(y1), &box)) {
-		region_confine(region, x1, y1, x2, y2, x2_out, y2_out, box);
+		region_confine(region_lookup, region, x1, y1, x2, y2,
+			x2_out, y2_out, box);
 		return true;
 	} else {
 		return false;
 	}
 }
+
+// Rectangles are bucketed only as long as they aren't repeated in too many
+// cells, e.g. when a few large rectangles cross the whole grid
+#define REGION_INDEX_MAX_CELLS 4096
+#define REGION_INDEX_MAX_ENTRIES_PER_RECT 8
+
+static int region_index_cell_coord(int v, int v1, int v2, int n) {
+	return (int)((int64_t)(v - v1) * n / (v2 - v1));
+}
+
+void wlr_region_index_finish(struct wlr_region_index *index) {
+	free(index->rects);
+	free(index->cell_start);
+	free(index->cell_rects);
+	*index = (struct wlr_region_index){0};
+}
+
+static void region_index_get_cells(struct wlr_region_index *index,
+		const pixman_box32_t *r, int *c1, int *c2, int *r1, int *r2) {
+	const pixman_box32_t *ext = &index->extents;
+	*c1 = region_index_cell_coord(r->x1, ext->x1, ext->x2, index->cols);
+	*c2 = region_index_cell_coord(r->x2 - 1, ext->x1, ext->x2, index->cols);
+	*r1 = region_index_cell_coord(r->y1, ext->y1, ext->y2, index->rows);
+	*r2 = region_index_cell_coord(r->y2 - 1, ext->y1, ext->y2, index->rows);
+}
+
+static bool region_index_build_grid(struct wlr_region_index *index) {
+	const pixman_box32_t *ext = &index->extents;
+	int cols = ceil(sqrt(index->nrects));
+	if (cols * cols > REGION_INDEX_MAX_CELLS) {
+		cols = sqrt(REGION_INDEX_MAX_CELLS);
+	}
+	int rows = cols;
+	if (cols > ext->x2 - ext->x1) {
+		cols = ext->x2 - ext->x1;
+	}
+	if (rows > ext->y2 - ext->y1) {
+		rows = ext->y2 - ext->y1;
+	}
+	index->cols = cols;
+	index->rows = rows;
+	int ncells = cols * rows;
+
+	int *cell_start = calloc(ncells + 1, sizeof(int));
+	if (cell_start == NULL) {
+		goto error;
+	}
+
+	// First count the rectangles of each cell, then turn the counts into
+	// offsets and fill the cells
+	size_t nentries = 0;
+	for (int i = 0; i < index->nrects; ++i) {
+		int c1, c2, r1, r2;
+		region_index_get_cells(index, &index->rects[i], &c1, &c2, &r1, &r2);
+		for (int row = r1; row <= r2; ++row) {
+			for (int col = c1; col <= c2; ++col) {
+				cell_start[row * cols + col + 1]++;
+			}
+		}
+		nentries += (size_t)(c2 - c1 + 1) * (r2 - r1 + 1);
+	}
+	if (nentries > (size_t)index->nrects * REGION_INDEX_MAX_ENTRIES_PER_RECT) {
+		goto error;
+	}
+	for (int i = 0; i < ncells; ++i) {
+		cell_start[i + 1] += cell_start[i];
+	}
+
+	int *cell_rects = malloc(nentries * sizeof(int));
+	int *fill = calloc(ncells, sizeof(int));
+	if (cell_rects == NULL || fill == NULL) {
+		free(cell_rects);
+		free(fill);
+		goto error;
+	}
+	for (int i = 0; i < index->nrects; ++i) {
+		int c1, c2, r1, r2;
+		region_index_get_cells(index, &index->rects[i], &c1, &c2, &r1, &r2);
+		for (int row = r1; row <= r2; ++row) {
+			for (int col = c1; col <= c2; ++col) {
+				int cell = row * cols + col;
+				cell_rects[cell_start[cell] + fill[cell]++] = i;
+			}
+		}
+	}
+	free(fill);
+
+	index->cell_start = cell_start;
+	index->cell_rects = cell_rects;
+	return true;
+
+error:
+	free(cell_start);
+	index->cols = index->rows = 0;
+	return false;
+}
+
+void wlr_region_index_update(struct wlr_region_index *index,
+		pixman_region32_t *region) {
+	wlr_region_index_finish(index);
+
+	int nrects;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	if (nrects == 0) {
+		return;
+	}
+	index->rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (index->rects == NULL) {
+		return;
+	}
+	memcpy(index->rects, rects, nrects * sizeof(pixman_box32_t));
+	index->nrects = nrects;
+	index->extents = *pixman_region32_extents(region);
+
+	// A few rectangles are faster to check one by one
+	if (nrects > 4) {
+		region_index_build_grid(index);
+	}
+}
+
+static bool box_contains_point(const pixman_box32_t *box, int x, int y) {
+	return x >= box->x1 && x < box->x2 && y >= box->y1 && y < box->y2;
+}
+
+bool wlr_region_index_contains_point(struct wlr_region_index *index,
+		int x, int y, pixman_box32_t *box) {
+	if (index->nrects == 0 || !box_contains_point(&index->extents, x, y)) {
+		return false;
+	}
+
+	// Consecutive queries usually fall in the same rectangle
+	int found = -1;
+	if (box_contains_point(&index->rects[index->last_rect], x, y)) {
+		found = index->last_rect;
+	} else if (index->cols > 0) {
+		const pixman_box32_t *ext = &index->extents;
+		int col = region_index_cell_coord(x, ext->x1, ext->x2, index->cols);
+		int row = region_index_cell_coord(y, ext->y1, ext->y2, index->rows);
+		int cell = row * index->cols + col;
+		for (int i = index->cell_start[cell];
+				i < index->cell_start[cell + 1]; ++i) {
+			int r = index->cell_rects[i];
+			if (box_contains_point(&index->rects[r], x, y)) {
+				found = r;
+				break;
+			}
+		}
+	} else {
+		for (int i = 0; i < index->nrects; ++i) {
+			if (box_contains_point(&index->rects[i], x, y)) {
+				found = i;
+				break;
+			}
+		}
+	}
+
+	if (found < 0) {
+		return false;
+	}
+	index->last_rect = found;
+	if (box != NULL) {
+		*box = index->rects[found];
+	}
+	return true;
+}
+
+static bool region_index_lookup(void *index, int x, int y,
+		pixman_box32_t *box) {
+	return wlr_region_index_contains_point(index, x, y, box);
+}
+
+bool wlr_region_index_confine(struct wlr_region_index *index, double x1,
+		double y1, double x2, double y2, double *x2_out, double *y2_out) {
+	pixman_box32_t box;
+	if (!wlr_region_index_contains_point(index, floor(x1), floor(y1), &box)) {
+		return false;
+	}
+	region_confine(region_index_lookup, index, x1, y1, x2, y2,
+		x2_out, y2_out, box);
+	return true;
+}
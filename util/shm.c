@@ -53,3 +53,42 @@ int allocate_shm_file(size_t size) {
 
 	return fd;
 }
+
+bool allocate_shm_file_pair(size_t size, int *rw_fd_ptr, int *ro_fd_ptr) {
+	int retries = 100;
+	int rw_fd = -1;
+	char name[] = "/wlroots-XXXXXX";
+	do {
+		randname(name + strlen(name) - 6);
+
+		--retries;
+		// CLOEXEC is guaranteed to be set by shm_open
+		rw_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	} while (rw_fd < 0 && retries > 0 && errno == EEXIST);
+	if (rw_fd < 0) {
+		return false;
+	}
+
+	// Clients can't re-open the file with write permissions from a read-only
+	// file descriptor, since the name is unlinked right away
+	int ro_fd = shm_open(name, O_RDONLY, 0);
+	shm_unlink(name);
+	if (ro_fd < 0) {
+		close(rw_fd);
+		return false;
+	}
+
+	int ret;
+	do {
+		ret = ftruncate(rw_fd, size);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		close(rw_fd);
+		close(ro_fd);
+		return false;
+	}
+
+	*rw_fd_ptr = rw_fd;
+	*ro_fd_ptr = ro_fd;
+	return true;
+}
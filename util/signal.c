@@ -1,10 +1,84 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
 #include "util/signal.h"
 
+#define SIGNAL_STATS_LEN 32
+
+// Signals are only emitted from the event loop thread
+static struct wlr_signal_site *sites = NULL;
+
+static int compare_sites(const void *_a, const void *_b) {
+	const struct wlr_signal_site *a = *(struct wlr_signal_site *const *)_a;
+	const struct wlr_signal_site *b = *(struct wlr_signal_site *const *)_b;
+	if (a->count == b->count) {
+		return 0;
+	}
+	return a->count > b->count ? -1 : 1;
+}
+
+static void log_signal_stats(void) {
+	size_t len = 0;
+	for (struct wlr_signal_site *site = sites; site != NULL;
+			site = site->next) {
+		len++;
+	}
+
+	struct wlr_signal_site **sorted = calloc(len, sizeof(*sorted));
+	if (sorted == NULL) {
+		return;
+	}
+	size_t i = 0;
+	for (struct wlr_signal_site *site = sites; site != NULL;
+			site = site->next) {
+		sorted[i++] = site;
+	}
+	qsort(sorted, len, sizeof(*sorted), compare_sites);
+
+	wlr_log(WLR_INFO, "Most emitted signals:");
+	for (i = 0; i < len && i < SIGNAL_STATS_LEN; ++i) {
+		wlr_log(WLR_INFO, "%12" PRIu64 " %s (%s:%d)", sorted[i]->count,
+			sorted[i]->signal, _wlr_strip_path(sorted[i]->file),
+			sorted[i]->line);
+	}
+	free(sorted);
+}
+
+static void register_site(struct wlr_signal_site *site) {
+	if (sites == NULL) {
+		const char *env = getenv("WLR_SIGNAL_STATS");
+		if (env != NULL && strcmp(env, "1") == 0) {
+			atexit(log_signal_stats);
+		}
+	}
+	site->next = sites;
+	sites = site;
+}
+
 static void handle_noop(struct wl_listener *listener, void *data) {
 	// Do nothing
 }
 
-void wlr_signal_emit_safe(struct wl_signal *signal, void *data) {
+void _wlr_signal_emit_safe(struct wlr_signal_site *site,
+		struct wl_signal *signal, void *data) {
+	if (site->count++ == 0) {
+		register_site(site);
+	}
+
+	// Most signals have zero or one listener. A single listener can only
+	// remove itself or add listeners, which mustn't be called anyway, so it
+	// doesn't need the markers below.
+	struct wl_list *head = &signal->listener_list;
+	if (head->next == head) {
+		return;
+	}
+	if (head->next->next == head) {
+		struct wl_listener *l = wl_container_of(head->next, l, link);
+		l->notify(l, data);
+		return;
+	}
+
 	struct wl_listener cursor;
 	struct wl_listener end;
 
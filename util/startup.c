@@ -0,0 +1,41 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <wlr/util/log.h>
+#include "util/startup.h"
+
+static struct {
+	bool started, done;
+	int64_t start, prev; // nsec
+} timeline = {0};
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void startup_mark(const char *stage) {
+	if (timeline.done) {
+		return;
+	}
+
+	int64_t now = get_time_nsec();
+	if (!timeline.started) {
+		timeline.started = true;
+		timeline.start = timeline.prev = now;
+	}
+
+	wlr_log(WLR_DEBUG, "Startup: %s at %.1f ms (+%.1f ms)", stage,
+		(now - timeline.start) / 1e6, (now - timeline.prev) / 1e6);
+	timeline.prev = now;
+}
+
+void startup_mark_presented(void) {
+	if (timeline.done || !timeline.started) {
+		return;
+	}
+	startup_mark("first frame presented");
+	timeline.done = true;
+}
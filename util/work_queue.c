@@ -0,0 +1,250 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include <wlr/util/work_queue.h>
+#include "util/signal.h"
+
+static int64_t get_current_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void queue_schedule(struct wlr_work_queue *queue, int64_t delay) {
+	if (wl_list_empty(&queue->items)) {
+		wl_event_source_timer_update(queue->timer, 0);
+		return;
+	}
+	// A zero timeout disarms the timer, round up to the next msec
+	int ms = delay > 0 ? delay / 1000000 + 1 : 1;
+	wl_event_source_timer_update(queue->timer, ms);
+}
+
+static void item_destroy(struct wlr_work_item *item) {
+	wl_list_remove(&item->link);
+	if (item->destroy != NULL) {
+		item->destroy(item->data);
+	}
+	free(item);
+}
+
+static void item_insert(struct wlr_work_queue *queue,
+		struct wlr_work_item *item) {
+	// After the items of the same priority
+	struct wl_list *prev = &queue->items;
+	struct wlr_work_item *other;
+	wl_list_for_each(other, &queue->items, link) {
+		if (other->priority < item->priority) {
+			break;
+		}
+		prev = &other->link;
+	}
+	wl_list_insert(prev, &item->link);
+}
+
+// Returns the time by which work must be done for the next frames, INT64_MAX
+// if no frame is expected
+static int64_t queue_frame_deadline(struct wlr_work_queue *queue,
+		int64_t now) {
+	int64_t deadline = INT64_MAX;
+	struct wlr_work_queue_output *queue_output;
+	wl_list_for_each(queue_output, &queue->outputs, link) {
+		struct wlr_output *output = queue_output->output;
+		if (!output->enabled || output->dpms_off ||
+				queue_output->next_frame <= now) {
+			// The output is idle, or its frame timing is unknown
+			continue;
+		}
+		int64_t frame_deadline =
+			queue_output->next_frame - queue->frame_margin;
+		if (frame_deadline < deadline) {
+			deadline = frame_deadline;
+		}
+	}
+	return deadline;
+}
+
+static int handle_timer(void *data) {
+	struct wlr_work_queue *queue = data;
+
+	int64_t now = get_current_time_nsec();
+	int64_t input_end = queue->last_input + queue->input_delay;
+	if (now < input_end) {
+		queue_schedule(queue, input_end - now);
+		return 0;
+	}
+
+	int64_t frame_deadline = queue_frame_deadline(queue, now);
+	int64_t slice_end = now + queue->slice;
+	int64_t deadline = frame_deadline < slice_end ? frame_deadline : slice_end;
+	bool ran = false;
+	while (!wl_list_empty(&queue->items)) {
+		struct wlr_work_item *item =
+			wl_container_of(queue->items.next, item, link);
+		if (now + item->budget > frame_deadline) {
+			// Resume once the frame has been presented
+			queue_schedule(queue, frame_deadline + queue->frame_margin - now);
+			return 0;
+		}
+		if (ran && now + item->budget > slice_end) {
+			break;
+		}
+
+		bool more = item->func(item->data, deadline);
+		ran = true;
+		if (more) {
+			// Let the other items of the same priority run first
+			wl_list_remove(&item->link);
+			item_insert(queue, item);
+		} else {
+			item_destroy(item);
+		}
+		now = get_current_time_nsec();
+	}
+
+	queue_schedule(queue, 0);
+	return 0;
+}
+
+static void queue_output_destroy(struct wlr_work_queue_output *queue_output) {
+	wl_list_remove(&queue_output->link);
+	wl_list_remove(&queue_output->present.link);
+	wl_list_remove(&queue_output->destroy.link);
+	free(queue_output);
+}
+
+static void queue_output_handle_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_work_queue_output *queue_output =
+		wl_container_of(listener, queue_output, present);
+	struct wlr_output_event_present *event = data;
+	if (event->when == NULL || event->refresh <= 0) {
+		queue_output->next_frame = 0;
+		return;
+	}
+	queue_output->next_frame = (int64_t)event->when->tv_sec * 1000000000 +
+		event->when->tv_nsec + event->refresh;
+}
+
+static void queue_output_handle_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_work_queue_output *queue_output =
+		wl_container_of(listener, queue_output, destroy);
+	queue_output_destroy(queue_output);
+}
+
+static void queue_destroy(struct wlr_work_queue *queue) {
+	wlr_signal_emit_safe(&queue->events.destroy, queue);
+	struct wlr_work_item *item, *item_tmp;
+	wl_list_for_each_safe(item, item_tmp, &queue->items, link) {
+		item_destroy(item);
+	}
+	struct wlr_work_queue_output *queue_output, *output_tmp;
+	wl_list_for_each_safe(queue_output, output_tmp, &queue->outputs, link) {
+		queue_output_destroy(queue_output);
+	}
+	wl_event_source_remove(queue->timer);
+	wl_list_remove(&queue->display_destroy.link);
+	free(queue);
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_work_queue *queue =
+		wl_container_of(listener, queue, display_destroy);
+	queue_destroy(queue);
+}
+
+struct wlr_work_queue *wlr_work_queue_get(struct wl_display *display) {
+	struct wl_listener *listener =
+		wl_display_get_destroy_listener(display, handle_display_destroy);
+	if (listener != NULL) {
+		struct wlr_work_queue *queue =
+			wl_container_of(listener, queue, display_destroy);
+		return queue;
+	}
+
+	struct wlr_work_queue *queue = calloc(1, sizeof(struct wlr_work_queue));
+	if (queue == NULL) {
+		return NULL;
+	}
+	queue->event_loop = wl_display_get_event_loop(display);
+	queue->timer = wl_event_loop_add_timer(queue->event_loop, handle_timer,
+		queue);
+	if (queue->timer == NULL) {
+		free(queue);
+		return NULL;
+	}
+	queue->slice = WLR_WORK_QUEUE_SLICE;
+	queue->frame_margin = WLR_WORK_QUEUE_FRAME_MARGIN;
+	queue->input_delay = WLR_WORK_QUEUE_INPUT_DELAY;
+	wl_list_init(&queue->items);
+	wl_list_init(&queue->outputs);
+	wl_signal_init(&queue->events.destroy);
+
+	queue->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &queue->display_destroy);
+
+	return queue;
+}
+
+struct wlr_work_item *wlr_work_queue_add(struct wlr_work_queue *queue,
+		enum wlr_work_priority priority, int64_t budget, wlr_work_func_t func,
+		void (*destroy)(void *data), void *data) {
+	struct wlr_work_item *item = calloc(1, sizeof(struct wlr_work_item));
+	if (item == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	item->queue = queue;
+	item->priority = priority;
+	item->budget = budget;
+	item->func = func;
+	item->destroy = destroy;
+	item->data = data;
+
+	bool was_empty = wl_list_empty(&queue->items);
+	item_insert(queue, item);
+	if (was_empty) {
+		queue_schedule(queue, 0);
+	}
+	return item;
+}
+
+void wlr_work_item_cancel(struct wlr_work_item *item) {
+	struct wlr_work_queue *queue = item->queue;
+	item_destroy(item);
+	if (wl_list_empty(&queue->items)) {
+		queue_schedule(queue, 0);
+	}
+}
+
+bool wlr_work_queue_add_output(struct wlr_work_queue *queue,
+		struct wlr_output *output) {
+	struct wlr_work_queue_output *queue_output;
+	wl_list_for_each(queue_output, &queue->outputs, link) {
+		if (queue_output->output == output) {
+			return true;
+		}
+	}
+
+	queue_output = calloc(1, sizeof(struct wlr_work_queue_output));
+	if (queue_output == NULL) {
+		return false;
+	}
+	queue_output->queue = queue;
+	queue_output->output = output;
+
+	queue_output->present.notify = queue_output_handle_present;
+	wl_signal_add(&output->events.present, &queue_output->present);
+	queue_output->destroy.notify = queue_output_handle_destroy;
+	wl_signal_add(&output->events.destroy, &queue_output->destroy);
+
+	wl_list_insert(&queue->outputs, &queue_output->link);
+	return true;
+}
+
+void wlr_work_queue_notify_input(struct wlr_work_queue *queue) {
+	queue->last_input = get_current_time_nsec();
+}
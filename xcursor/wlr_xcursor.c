@@ -24,6 +24,7 @@
  */
 
 #define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -184,32 +185,69 @@ static struct wlr_xcursor *xcursor_create_from_xcursor_images(
 	return cursor;
 }
 
-static void load_callback(XcursorImages *images, void *data) {
+struct wlr_xcursor_theme_file {
+	char *name;
+	char *path;
+	bool loaded; // whether loading the file has been attempted
+};
+
+static void scan_callback(const char *name, const char *path, void *data) {
 	struct wlr_xcursor_theme *theme = data;
-	struct wlr_xcursor *cursor;
 
-	if (wlr_xcursor_theme_get_cursor(theme, images->name)) {
-		XcursorImagesDestroy(images);
+	// Files of the theme come before files of inherited themes, which are
+	// used if the former fail to load
+	struct wlr_xcursor_theme_file *files = realloc(theme->files,
+		(theme->file_count + 1) * sizeof(theme->files[0]));
+	if (files == NULL) {
 		return;
 	}
+	theme->files = files;
+
+	struct wlr_xcursor_theme_file *file = &theme->files[theme->file_count];
+	file->name = strdup(name);
+	file->path = strdup(path);
+	file->loaded = false;
+	if (file->name == NULL || file->path == NULL) {
+		free(file->name);
+		free(file->path);
+		return;
+	}
+	theme->file_count++;
+}
 
-	cursor = xcursor_create_from_xcursor_images(images, theme);
-
-	if (cursor) {
-		theme->cursor_count++;
-		theme->cursors =
-			realloc(theme->cursors,
-				theme->cursor_count * sizeof(theme->cursors[0]));
+static struct wlr_xcursor *theme_load_file(struct wlr_xcursor_theme *theme,
+		struct wlr_xcursor_theme_file *file) {
+	file->loaded = true;
 
-		if (theme->cursors == NULL) {
-			theme->cursor_count--;
-			free(cursor);
-		} else {
-			theme->cursors[theme->cursor_count - 1] = cursor;
-		}
+	XcursorImages *images =
+		xcursor_load_images(file->path, file->name, theme->size);
+	if (images == NULL) {
+		wlr_log(WLR_DEBUG, "Failed to load cursor '%s' from %s",
+			file->name, file->path);
+		return NULL;
 	}
 
+	struct wlr_xcursor *cursor =
+		xcursor_create_from_xcursor_images(images, theme);
 	XcursorImagesDestroy(images);
+	if (cursor == NULL) {
+		return NULL;
+	}
+
+	struct wlr_xcursor **cursors = realloc(theme->cursors,
+		(theme->cursor_count + 1) * sizeof(theme->cursors[0]));
+	if (cursors == NULL) {
+		xcursor_destroy(cursor);
+		return NULL;
+	}
+	theme->cursors = cursors;
+	theme->cursors[theme->cursor_count++] = cursor;
+
+	struct wlr_xcursor_image *image = cursor->images[0];
+	wlr_log(WLR_DEBUG, "Loaded cursor %s (%u images) %dx%d+%d,%d",
+		cursor->name, cursor->image_count, image->width, image->height,
+		image->hotspot_x, image->hotspot_y);
+	return cursor;
 }
 
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
@@ -231,22 +269,17 @@ struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 	theme->size = size;
 	theme->cursor_count = 0;
 	theme->cursors = NULL;
+	theme->file_count = 0;
+	theme->files = NULL;
 
-	xcursor_load_theme(name, size, load_callback, theme);
+	xcursor_scan_theme(name, scan_callback, theme);
 
-	if (theme->cursor_count == 0) {
+	if (theme->file_count == 0) {
 		load_default_theme(theme);
 	}
 
-	wlr_log(WLR_DEBUG, "Loaded cursor theme '%s', available cursors:",
-			theme->name);
-	for (size_t i = 0; i < theme->cursor_count; ++i) {
-		struct wlr_xcursor *c = theme->cursors[i];
-		struct wlr_xcursor_image *i = c->images[0];
-		wlr_log(WLR_DEBUG, "%s (%u images) %dx%d+%d,%d",
-				c->name, c->image_count,
-				i->width, i->height, i->hotspot_x, i->hotspot_y);
-	}
+	wlr_log(WLR_DEBUG, "Loaded cursor theme '%s' (%u cursor files)",
+			theme->name, theme->file_count);
 
 	return theme;
 
@@ -261,9 +294,14 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 	for (i = 0; i < theme->cursor_count; i++) {
 		xcursor_destroy(theme->cursors[i]);
 	}
+	for (i = 0; i < theme->file_count; i++) {
+		free(theme->files[i].name);
+		free(theme->files[i].path);
+	}
 
 	free(theme->name);
 	free(theme->cursors);
+	free(theme->files);
 	free(theme);
 }
 
@@ -277,6 +315,16 @@ struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme
 		}
 	}
 
+	for (i = 0; i < theme->file_count; i++) {
+		struct wlr_xcursor_theme_file *file = &theme->files[i];
+		if (file->loaded || strcmp(name, file->name) != 0) {
+			continue;
+		}
+		struct wlr_xcursor *cursor = theme_load_file(theme, file);
+		if (cursor != NULL) {
+			return cursor;
+		}
+	}
 	return NULL;
 }
 
@@ -25,9 +25,13 @@
 
 #define _DEFAULT_SOURCE
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "xcursor/xcursor.h"
 
 /*
@@ -873,16 +877,104 @@ XcursorLibraryLoadImages (const char *file, const char *theme, int size)
     return images;
 }
 
+struct xcursor_memory_file {
+	const unsigned char *data;
+	long size, pos;
+};
+
+static int
+xcursor_memory_file_read(XcursorFile *file, unsigned char *buf, int len)
+{
+	struct xcursor_memory_file *mem = file->closure;
+
+	if (len > mem->size - mem->pos)
+		len = mem->size - mem->pos;
+	memcpy(buf, mem->data + mem->pos, len);
+	mem->pos += len;
+	return len;
+}
+
+static int
+xcursor_memory_file_write(XcursorFile *file, unsigned char *buf, int len)
+{
+	return 0;
+}
+
+static int
+xcursor_memory_file_seek(XcursorFile *file, long offset, int whence)
+{
+	struct xcursor_memory_file *mem = file->closure;
+
+	if (whence == SEEK_CUR)
+		offset += mem->pos;
+	else if (whence == SEEK_END)
+		offset += mem->size;
+	if (offset < 0 || offset > mem->size)
+		return -1;
+	mem->pos = offset;
+	return 0;
+}
+
+/** Load the images of a cursor file
+ *
+ * The file is mapped in memory rather than read through stdio, so that
+ * only the pages holding the table of contents and the images at the
+ * requested size are read.
+ *
+ * \param path The path of the cursor file
+ * \param name The name given to the images
+ * \param size The desired size of the cursor images
+ * \return The images, to be destroyed with XcursorImagesDestroy(), or
+ * NULL on failure
+ */
+XcursorImages *
+xcursor_load_images(const char *path, const char *name, int size)
+{
+	struct xcursor_memory_file mem;
+	struct stat st;
+	XcursorFile file;
+	XcursorImages *images;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	mem.data = data;
+	mem.size = st.st_size;
+	mem.pos = 0;
+	file.closure = &mem;
+	file.read = xcursor_memory_file_read;
+	file.write = xcursor_memory_file_write;
+	file.seek = xcursor_memory_file_seek;
+
+	images = XcursorXcFileLoadImages(&file, size);
+	munmap(data, st.st_size);
+	if (images)
+		XcursorImagesSetName(images, name);
+	return images;
+}
+
 static void
-load_all_cursors_from_dir(const char *path, int size,
-			  void (*load_callback)(XcursorImages *, void *),
+scan_all_cursors_from_dir(const char *path,
+			  void (*scan_callback)(const char *, const char *,
+						void *),
 			  void *user_data)
 {
-	FILE *f;
 	DIR *dir = opendir(path);
 	struct dirent *ent;
 	char *full;
-	XcursorImages *images;
 
 	if (!dir)
 		return;
@@ -893,54 +985,42 @@ load_all_cursors_from_dir(const char *path, int size,
 		    (ent->d_type != DT_REG && ent->d_type != DT_LNK))
 			continue;
 #endif
+		if (ent->d_name[0] == '.')
+			continue;
 
 		full = _XcursorBuildFullname(path, "", ent->d_name);
 		if (!full)
 			continue;
 
-		f = fopen(full, "r");
-		if (!f) {
-			free(full);
-			continue;
-		}
-
-		images = XcursorFileLoadImages(f, size);
-
-		if (images) {
-			XcursorImagesSetName(images, ent->d_name);
-			load_callback(images, user_data);
-		}
-
-		fclose (f);
+		scan_callback(ent->d_name, full, user_data);
 		free(full);
 	}
 
 	closedir(dir);
 }
 
-/** Load all the cursor of a theme
+/** List the cursors of a theme
  *
- * This function loads all the cursor images of a given theme and its
- * inherited themes. Each cursor is loaded into an XcursorImages object
- * which is passed to the caller's load callback. If a cursor appears
- * more than once across all the inherited themes, the load callback
- * will be called multiple times, with possibly different XcursorImages
- * object which have the same name. The user is expected to destroy the
- * XcursorImages objects passed to the callback with
- * XcursorImagesDestroy().
+ * This function finds the cursor files of a given theme and its
+ * inherited themes without reading them. The scan callback is called
+ * with the name and the path of each file. If a cursor appears more
+ * than once across all the inherited themes, the scan callback will be
+ * called multiple times with the same name, first for the theme that
+ * takes precedence. The files can then be loaded on demand with
+ * xcursor_load_images().
  *
- * \param theme The name of theme that should be loaded
- * \param size The desired size of the cursor images
- * \param load_callback A callback function that will be called
- * for each cursor loaded. The first parameter is the XcursorImages
- * object representing the loaded cursor and the second is a pointer
- * to data provided by the user.
- * \param user_data The data that should be passed to the load callback
+ * \param theme The name of theme that should be scanned
+ * \param scan_callback A callback function that will be called
+ * for each cursor file found. The first parameter is the cursor name,
+ * the second is the path of the file, and the third is a pointer to
+ * data provided by the user. Both strings are only valid during the
+ * call.
+ * \param user_data The data that should be passed to the scan callback
  */
 void
-xcursor_load_theme(const char *theme, int size,
-		    void (*load_callback)(XcursorImages *, void *),
-		    void *user_data)
+xcursor_scan_theme(const char *theme,
+		   void (*scan_callback)(const char *, const char *, void *),
+		   void *user_data)
 {
 	char *full, *dir;
 	char *inherits = NULL;
@@ -959,7 +1039,7 @@ xcursor_load_theme(const char *theme, int size,
 		full = _XcursorBuildFullname(dir, "cursors", "");
 
 		if (full) {
-			load_all_cursors_from_dir(full, size, load_callback,
+			scan_all_cursors_from_dir(full, scan_callback,
 						  user_data);
 			free(full);
 		}
@@ -976,7 +1056,7 @@ xcursor_load_theme(const char *theme, int size,
 	}
 
 	for (i = inherits; i; i = _XcursorNextPath(i))
-		xcursor_load_theme(i, size, load_callback, user_data);
+		xcursor_scan_theme(i, scan_callback, user_data);
 
 	if (inherits)
 		free(inherits);
@@ -104,6 +104,42 @@ static void xwm_dnd_send_enter(struct wlr_xwm *xwm) {
 	xwm_dnd_send_event(xwm, xwm->atoms[DND_ENTER], &data);
 }
 
+static void xwm_dnd_flush_position(struct wlr_xwm *xwm);
+
+static int xwm_dnd_handle_status_timeout(void *data) {
+	struct wlr_xwm *xwm = data;
+	if (xwm->drag == NULL || !xwm->dnd_position.waiting_status) {
+		return 0;
+	}
+
+	// Unresponsive targets don't get to block the drag, nor accept the drop
+	wlr_log(WLR_DEBUG, "XdndStatus timed out, treating it as a refusal");
+	xwm->drag->source->accepted = false;
+	wlr_data_source_dnd_action(xwm->drag->source,
+		WL_DATA_DEVICE_MANAGER_DND_ACTION_NONE);
+
+	xwm->dnd_position.waiting_status = false;
+	xwm_dnd_flush_position(xwm);
+	return 0;
+}
+
+static void xwm_dnd_set_status_timeout(struct wlr_xwm *xwm, int timeout) {
+	if (xwm->dnd_position.status_timer == NULL) {
+		if (timeout == 0) {
+			return;
+		}
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(xwm->xwayland->wl_display);
+		xwm->dnd_position.status_timer = wl_event_loop_add_timer(loop,
+			xwm_dnd_handle_status_timeout, xwm);
+		if (xwm->dnd_position.status_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create XdndStatus timer");
+			return;
+		}
+	}
+	wl_event_source_timer_update(xwm->dnd_position.status_timer, timeout);
+}
+
 static void xwm_dnd_send_position(struct wlr_xwm *xwm, uint32_t time, int16_t x,
 		int16_t y) {
 	struct wlr_drag *drag = xwm->drag;
@@ -117,6 +153,34 @@ static void xwm_dnd_send_position(struct wlr_xwm *xwm, uint32_t time, int16_t x,
 		data_device_manager_dnd_action_to_atom(xwm, drag->source->actions);
 
 	xwm_dnd_send_event(xwm, xwm->atoms[DND_POSITION], &data);
+	xwm->dnd_position.waiting_status = true;
+	xwm->dnd_position.pending = false;
+	xwm_dnd_set_status_timeout(xwm, XDND_STATUS_TIMEOUT);
+}
+
+static void xwm_dnd_queue_position(struct wlr_xwm *xwm, uint32_t time,
+		int16_t x, int16_t y) {
+	if (!xwm->dnd_position.waiting_status) {
+		xwm_dnd_send_position(xwm, time, x, y);
+		return;
+	}
+	xwm->dnd_position.pending = true;
+	xwm->dnd_position.time = time;
+	xwm->dnd_position.x = x;
+	xwm->dnd_position.y = y;
+}
+
+static void xwm_dnd_flush_position(struct wlr_xwm *xwm) {
+	if (xwm->dnd_position.pending) {
+		xwm_dnd_send_position(xwm, xwm->dnd_position.time,
+			xwm->dnd_position.x, xwm->dnd_position.y);
+	}
+}
+
+static void xwm_dnd_reset_position(struct wlr_xwm *xwm) {
+	xwm->dnd_position.waiting_status = false;
+	xwm->dnd_position.pending = false;
+	xwm_dnd_set_status_timeout(xwm, 0);
 }
 
 static void xwm_dnd_send_drop(struct wlr_xwm *xwm, uint32_t time) {
@@ -125,6 +189,9 @@ static void xwm_dnd_send_drop(struct wlr_xwm *xwm, uint32_t time) {
 	struct wlr_xwayland_surface *dest = xwm->drag_focus;
 	assert(dest != NULL);
 
+	// The drop location is the last position
+	xwm_dnd_flush_position(xwm);
+
 	xcb_client_message_data_t data = { 0 };
 	data.data32[0] = xwm->dnd_window;
 	data.data32[2] = time;
@@ -194,6 +261,10 @@ int xwm_handle_selection_client_message(struct wlr_xwm *xwm,
 
 		wlr_log(WLR_DEBUG, "DND_STATUS window=%d accepted=%d action=%d",
 			target_window, accepted, action);
+
+		xwm->dnd_position.waiting_status = false;
+		xwm_dnd_set_status_timeout(xwm, 0);
+		xwm_dnd_flush_position(xwm);
 		return 1;
 	} else if (ev->type == xwm->atoms[DND_FINISHED]) {
 		// This should only happen after the drag has ended, but before the drag
@@ -261,6 +332,7 @@ static void seat_handle_drag_focus(struct wl_listener *listener, void *data) {
 	}
 
 	xwm->drag_focus = focus;
+	xwm_dnd_reset_position(xwm);
 
 	if (xwm->drag_focus != NULL) {
 		xwm_dnd_send_enter(xwm);
@@ -276,7 +348,7 @@ static void seat_handle_drag_motion(struct wl_listener *listener, void *data) {
 		return; // No xwayland surface focused
 	}
 
-	xwm_dnd_send_position(xwm, event->time, surface->x + (int16_t)event->sx,
+	xwm_dnd_queue_position(xwm, event->time, surface->x + (int16_t)event->sx,
 		surface->y + (int16_t)event->sy);
 }
 
@@ -307,6 +379,7 @@ static void seat_handle_drag_destroy(struct wl_listener *listener, void *data) {
 	wl_list_remove(&xwm->seat_drag_drop.link);
 	wl_list_remove(&xwm->seat_drag_destroy.link);
 	xwm->drag = NULL;
+	xwm_dnd_reset_position(xwm);
 }
 
 static void seat_handle_drag_source_destroy(struct wl_listener *listener,
@@ -321,6 +394,7 @@ static void seat_handle_drag_source_destroy(struct wl_listener *listener,
 void xwm_seat_handle_start_drag(struct wlr_xwm *xwm, struct wlr_drag *drag) {
 	xwm->drag = drag;
 	xwm->drag_focus = NULL;
+	xwm_dnd_reset_position(xwm);
 
 	if (drag != NULL) {
 		wl_signal_add(&drag->events.focus, &xwm->seat_drag_focus);
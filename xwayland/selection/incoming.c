@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,10 +8,47 @@
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/util/log.h>
+#include <wlr/util/mime_type.h>
 #include <xcb/xfixes.h>
 #include "xwayland/selection.h"
 #include "xwayland/xwm.h"
 
+static int xwm_data_source_write(int fd, uint32_t mask, void *data);
+
+/**
+ * Requests the next chunk of the selection property. Properties are read
+ * INCR_CHUNK_SIZE bytes at a time so that large selections don't need to be
+ * held in memory at once.
+ */
+static xcb_get_property_reply_t *xwm_get_property_chunk(
+		struct wlr_xwm_selection_transfer *transfer, bool delete) {
+	struct wlr_xwm *xwm = transfer->selection->xwm;
+
+	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn,
+		delete, // only done once the last chunk has been read
+		transfer->selection->window,
+		xwm->atoms[WL_SELECTION],
+		XCB_GET_PROPERTY_TYPE_ANY,
+		transfer->property_offset / 4, // offset, in 32-bit units
+		INCR_CHUNK_SIZE / 4 // length, in 32-bit units
+		);
+
+	return xcb_get_property_reply(xwm->xcb_conn, cookie, NULL);
+}
+
+static void xwm_data_source_add_write_source(
+		struct wlr_xwm_selection_transfer *transfer) {
+	if (transfer->source != NULL) {
+		return;
+	}
+
+	struct wlr_xwm *xwm = transfer->selection->xwm;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(xwm->xwayland->wl_display);
+	transfer->source = wl_event_loop_add_fd(loop, transfer->source_fd,
+		WL_EVENT_WRITABLE, xwm_data_source_write, transfer);
+}
+
 /**
  * Write the X11 selection to a Wayland client.
  */
@@ -18,75 +56,80 @@ static int xwm_data_source_write(int fd, uint32_t mask, void *data) {
 	struct wlr_xwm_selection_transfer *transfer = data;
 	struct wlr_xwm *xwm = transfer->selection->xwm;
 
-	char *property = xcb_get_property_value(transfer->property_reply);
-	int remainder = xcb_get_property_value_length(transfer->property_reply) -
-		transfer->property_start;
+	while (true) {
+		char *property = xcb_get_property_value(transfer->property_reply);
+		int length = xcb_get_property_value_length(transfer->property_reply);
+		int remainder = length - transfer->property_start;
+
+		ssize_t len = write(fd, property + transfer->property_start,
+			remainder);
+		if (len == -1 && errno == EAGAIN) {
+			xwm_data_source_add_write_source(transfer);
+			return 1;
+		} else if (len == -1) {
+			xwm_selection_transfer_destroy_property_reply(transfer);
+			xwm_selection_transfer_remove_source(transfer);
+			xwm_selection_transfer_close_source_fd(transfer);
+			wlr_log(WLR_ERROR, "write error to target fd: %m");
+			return 1;
+		}
 
-	ssize_t len = write(fd, property + transfer->property_start, remainder);
-	if (len == -1) {
-		xwm_selection_transfer_destroy_property_reply(transfer);
-		xwm_selection_transfer_remove_source(transfer);
-		xwm_selection_transfer_close_source_fd(transfer);
-		wlr_log(WLR_ERROR, "write error to target fd: %m");
-		return 1;
-	}
+		wlr_log(WLR_DEBUG, "wrote %zd (chunk size %zd) of %d bytes",
+			transfer->property_start + len, len, length);
 
-	wlr_log(WLR_DEBUG, "wrote %zd (chunk size %zd) of %d bytes",
-		transfer->property_start + len,
-		len, xcb_get_property_value_length(transfer->property_reply));
+		transfer->property_start += len;
+		if (len < remainder) {
+			xwm_data_source_add_write_source(transfer);
+			return 1;
+		}
 
-	transfer->property_start += len;
-	if (len == remainder) {
+		// The chunk buffer is reused for the rest of the property
+		bool more = transfer->property_reply->bytes_after > 0;
 		xwm_selection_transfer_destroy_property_reply(transfer);
-		xwm_selection_transfer_remove_source(transfer);
+		if (!more) {
+			break;
+		}
 
-		if (transfer->incr) {
-			wlr_log(WLR_DEBUG, "deleting property");
-			xcb_delete_property(xwm->xcb_conn, transfer->selection->window,
-				xwm->atoms[WL_SELECTION]);
-			xcb_flush(xwm->xcb_conn);
-		} else {
-			wlr_log(WLR_DEBUG, "transfer complete");
+		transfer->property_offset += length;
+		transfer->property_start = 0;
+		transfer->property_reply =
+			xwm_get_property_chunk(transfer, !transfer->incr);
+		if (transfer->property_reply == NULL) {
+			wlr_log(WLR_ERROR, "cannot get selection property");
+			xwm_selection_transfer_remove_source(transfer);
 			xwm_selection_transfer_close_source_fd(transfer);
+			return 1;
 		}
 	}
 
+	xwm_selection_transfer_remove_source(transfer);
+
+	if (transfer->incr) {
+		wlr_log(WLR_DEBUG, "deleting property");
+		xcb_delete_property(xwm->xcb_conn, transfer->selection->window,
+			xwm->atoms[WL_SELECTION]);
+		xcb_flush(xwm->xcb_conn);
+	} else {
+		wlr_log(WLR_DEBUG, "transfer complete");
+		xwm_selection_transfer_close_source_fd(transfer);
+	}
+
 	return 1;
 }
 
 static void xwm_write_property(struct wlr_xwm_selection_transfer *transfer,
 		xcb_get_property_reply_t *reply) {
-	struct wlr_xwm *xwm = transfer->selection->xwm;
-
 	transfer->property_start = 0;
 	transfer->property_reply = reply;
 
 	xwm_data_source_write(transfer->source_fd, WL_EVENT_WRITABLE, transfer);
-
-	if (transfer->property_reply != NULL) {
-		struct wl_event_loop *loop =
-			wl_display_get_event_loop(xwm->xwayland->wl_display);
-		transfer->source = wl_event_loop_add_fd(loop,
-			transfer->source_fd, WL_EVENT_WRITABLE, xwm_data_source_write,
-			transfer);
-	}
 }
 
 void xwm_get_incr_chunk(struct wlr_xwm_selection_transfer *transfer) {
-	struct wlr_xwm *xwm = transfer->selection->xwm;
 	wlr_log(WLR_DEBUG, "xwm_get_incr_chunk");
 
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn,
-		0, // delete
-		transfer->selection->window,
-		xwm->atoms[WL_SELECTION],
-		XCB_GET_PROPERTY_TYPE_ANY,
-		0, // offset
-		0x1fffffff // length
-		);
-
-	xcb_get_property_reply_t *reply =
-		xcb_get_property_reply(xwm->xcb_conn, cookie, NULL);
+	transfer->property_offset = 0;
+	xcb_get_property_reply_t *reply = xwm_get_property_chunk(transfer, false);
 	if (reply == NULL) {
 		wlr_log(WLR_ERROR, "cannot get selection property");
 		return;
@@ -106,24 +149,15 @@ void xwm_get_incr_chunk(struct wlr_xwm_selection_transfer *transfer) {
 
 static void xwm_selection_get_data(struct wlr_xwm_selection *selection) {
 	struct wlr_xwm *xwm = selection->xwm;
+	struct wlr_xwm_selection_transfer *transfer = &selection->incoming;
 
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn,
-		1, // delete
-		selection->window,
-		xwm->atoms[WL_SELECTION],
-		XCB_GET_PROPERTY_TYPE_ANY,
-		0, // offset
-		0x1fffffff // length
-		);
-
-	xcb_get_property_reply_t *reply =
-		xcb_get_property_reply(xwm->xcb_conn, cookie, NULL);
+	transfer->property_offset = 0;
+	xcb_get_property_reply_t *reply = xwm_get_property_chunk(transfer, true);
 	if (reply == NULL) {
 		wlr_log(WLR_ERROR, "Cannot get selection property");
 		return;
 	}
 
-	struct wlr_xwm_selection_transfer *transfer = &selection->incoming;
 	if (reply->type == xwm->atoms[INCR]) {
 		transfer->incr = true;
 		free(reply);
@@ -310,13 +344,19 @@ static bool source_get_targets(struct wlr_xwm_selection *selection,
 		}
 
 		if (mime_type != NULL) {
-			char **mime_type_ptr =
+			const char *interned = wlr_mime_type_intern(mime_type);
+			free(mime_type);
+			if (interned == NULL) {
+				continue;
+			}
+
+			const char **mime_type_ptr =
 				wl_array_add(mime_types, sizeof(*mime_type_ptr));
 			if (mime_type_ptr == NULL) {
-				free(mime_type);
+				wlr_mime_type_unref(interned);
 				break;
 			}
-			*mime_type_ptr = mime_type;
+			*mime_type_ptr = interned;
 
 			xcb_atom_t *atom_ptr =
 				wl_array_add(mime_types_atoms, sizeof(*atom_ptr));
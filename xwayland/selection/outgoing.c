@@ -76,19 +76,21 @@ static int xwm_data_source_read(int fd, uint32_t mask, void *data) {
 	struct wlr_xwm_selection_transfer *transfer = data;
 	struct wlr_xwm *xwm = transfer->selection->xwm;
 
-	void *p;
+	// The buffer holds exactly one chunk and is reused for every chunk, the
+	// source is removed while it's full
 	size_t current = transfer->source_data.size;
-	if (transfer->source_data.size < INCR_CHUNK_SIZE) {
-		p = wl_array_add(&transfer->source_data, INCR_CHUNK_SIZE);
-		if (p == NULL) {
+	assert(current < INCR_CHUNK_SIZE);
+	if (transfer->source_data.alloc < INCR_CHUNK_SIZE) {
+		if (wl_array_add(&transfer->source_data,
+				INCR_CHUNK_SIZE - current) == NULL) {
 			wlr_log(WLR_ERROR, "Could not allocate selection source_data");
 			goto error_out;
 		}
-	} else {
-		p = (char *)transfer->source_data.data + transfer->source_data.size;
+		transfer->source_data.size = current;
 	}
 
-	size_t available = transfer->source_data.alloc - current;
+	void *p = (char *)transfer->source_data.data + current;
+	size_t available = INCR_CHUNK_SIZE - current;
 	ssize_t len = read(fd, p, available);
 	if (len == -1) {
 		wlr_log(WLR_ERROR, "read error from data source: %m");
@@ -221,6 +221,9 @@ void xwm_selection_finish(struct wlr_xwm *xwm) {
 	if (xwm->dnd_window) {
 		xcb_destroy_window(xwm->xcb_conn, xwm->dnd_window);
 	}
+	if (xwm->dnd_position.status_timer) {
+		wl_event_source_remove(xwm->dnd_position.status_timer);
+	}
 	if (xwm->seat) {
 		if (xwm->seat->selection_source &&
 				data_source_is_xwayland(
@@ -258,14 +258,7 @@ static int xserver_handle_ready(int signal_number, void *data) {
 
 static int xwayland_socket_connected(int fd, uint32_t mask, void* data){
 	struct wlr_xwayland *wlr_xwayland = data;
-
-	wl_event_source_remove(wlr_xwayland->x_fd_read_event[0]);
-	wl_event_source_remove(wlr_xwayland->x_fd_read_event[1]);
-
-	wlr_xwayland->x_fd_read_event[0] = wlr_xwayland->x_fd_read_event[1] = NULL;
-
-	xwayland_start_server(wlr_xwayland);
-
+	wlr_xwayland_start(wlr_xwayland);
 	return 0;
 }
 
@@ -377,6 +370,20 @@ static bool xwayland_start_server_lazy(struct wlr_xwayland *wlr_xwayland) {
 	return true;
 }
 
+bool wlr_xwayland_start(struct wlr_xwayland *wlr_xwayland) {
+	if (wlr_xwayland->x_fd_read_event[0] == NULL) {
+		// Not waiting for a client, the server is already started
+		return true;
+	}
+
+	wl_event_source_remove(wlr_xwayland->x_fd_read_event[0]);
+	wl_event_source_remove(wlr_xwayland->x_fd_read_event[1]);
+
+	wlr_xwayland->x_fd_read_event[0] = wlr_xwayland->x_fd_read_event[1] = NULL;
+
+	return xwayland_start_server(wlr_xwayland);
+}
+
 void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland) {
 	if (!wlr_xwayland) {
 		return;
@@ -3,6 +3,8 @@
 #endif
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_surface.h>
@@ -14,6 +16,7 @@
 #include <xcb/render.h>
 #include <xcb/xfixes.h>
 #include "util/signal.h"
+#include "util/trace.h"
 #include "xwayland/xwm.h"
 
 const char *atom_map[ATOM_LAST] = {
@@ -93,11 +96,107 @@ struct wlr_xwayland_surface *wlr_xwayland_surface_from_wlr_surface(
 	return (struct wlr_xwayland_surface *)surface->role_data;
 }
 
-// TODO: replace this with hash table?
+#define XWM_BUCKETS_MIN_LEN 16
+
+static struct wl_list *id_bucket(struct wl_list *buckets, size_t len,
+		uint32_t id) {
+	// Fibonacci hashing, IDs allocated by a single X11 client only differ in
+	// their low bits
+	uint64_t hash = id * 11400714819323198485ull;
+	return &buckets[(hash >> 32) & (len - 1)];
+}
+
+static struct wl_list *create_buckets(size_t len) {
+	struct wl_list *buckets = calloc(len, sizeof(struct wl_list));
+	if (buckets == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		wl_list_init(&buckets[i]);
+	}
+	return buckets;
+}
+
+static void xwm_resize_surface_buckets(struct wlr_xwm *xwm, size_t len) {
+	struct wl_list *buckets = create_buckets(len);
+	if (buckets == NULL) {
+		// The table still works with longer chains
+		return;
+	}
+
+	free(xwm->surface_buckets);
+	xwm->surface_buckets = buckets;
+	xwm->surface_buckets_len = len;
+
+	struct wlr_xwayland_surface *surface;
+	wl_list_for_each(surface, &xwm->surfaces, link) {
+		wl_list_insert(id_bucket(buckets, len, surface->window_id),
+			&surface->bucket_link);
+	}
+}
+
+static void xwm_add_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	wl_list_insert(&xwm->surfaces, &surface->link);
+	wl_list_insert(id_bucket(xwm->surface_buckets, xwm->surface_buckets_len,
+		surface->window_id), &surface->bucket_link);
+	xwm->surfaces_len++;
+
+	if (xwm->surfaces_len > xwm->surface_buckets_len) {
+		xwm_resize_surface_buckets(xwm, 2 * xwm->surface_buckets_len);
+	}
+}
+
+static void xwm_remove_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	wl_list_remove(&surface->bucket_link);
+	wl_list_remove(&surface->link);
+	xwm->surfaces_len--;
+}
+
+static void xwm_resize_unpaired_buckets(struct wlr_xwm *xwm, size_t len) {
+	struct wl_list *buckets = create_buckets(len);
+	if (buckets == NULL) {
+		return;
+	}
+
+	free(xwm->unpaired_buckets);
+	xwm->unpaired_buckets = buckets;
+	xwm->unpaired_buckets_len = len;
+
+	struct wlr_xwayland_surface *surface;
+	wl_list_for_each(surface, &xwm->unpaired_surfaces, unpaired_link) {
+		wl_list_insert(id_bucket(buckets, len, surface->surface_id),
+			&surface->unpaired_bucket_link);
+	}
+}
+
+static void xwm_add_unpaired_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	assert(surface->surface_id != 0);
+	wl_list_insert(&xwm->unpaired_surfaces, &surface->unpaired_link);
+	wl_list_insert(id_bucket(xwm->unpaired_buckets, xwm->unpaired_buckets_len,
+		surface->surface_id), &surface->unpaired_bucket_link);
+	xwm->unpaired_len++;
+
+	if (xwm->unpaired_len > xwm->unpaired_buckets_len) {
+		xwm_resize_unpaired_buckets(xwm, 2 * xwm->unpaired_buckets_len);
+	}
+}
+
+static void xwm_remove_unpaired_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	wl_list_remove(&surface->unpaired_bucket_link);
+	wl_list_remove(&surface->unpaired_link);
+	xwm->unpaired_len--;
+}
+
 static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 		xcb_window_t window_id) {
+	struct wl_list *bucket = id_bucket(xwm->surface_buckets,
+		xwm->surface_buckets_len, window_id);
 	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
+	wl_list_for_each(surface, bucket, bucket_link) {
 		if (surface->window_id == window_id) {
 			return surface;
 		}
@@ -105,6 +204,19 @@ static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 	return NULL;
 }
 
+static struct wlr_xwayland_surface *lookup_unpaired_surface(
+		struct wlr_xwm *xwm, uint32_t surface_id) {
+	struct wl_list *bucket = id_bucket(xwm->unpaired_buckets,
+		xwm->unpaired_buckets_len, surface_id);
+	struct wlr_xwayland_surface *surface;
+	wl_list_for_each(surface, bucket, unpaired_bucket_link) {
+		if (surface->surface_id == surface_id) {
+			return surface;
+		}
+	}
+	return NULL;
+}
+
 static int xwayland_surface_handle_ping_timeout(void *data) {
 	struct wlr_xwayland_surface *surface = data;
 
@@ -113,6 +225,9 @@ static int xwayland_surface_handle_ping_timeout(void *data) {
 	return 1;
 }
 
+static void xsurface_finish_pending_reads(
+		struct wlr_xwayland_surface *xsurface);
+
 static struct wlr_xwayland_surface *xwayland_surface_create(
 		struct wlr_xwm *xwm, xcb_window_t window_id, int16_t x, int16_t y,
 		uint16_t width, uint16_t height, bool override_redirect) {
@@ -140,7 +255,13 @@ static struct wlr_xwayland_surface *xwayland_surface_create(
 	surface->width = width;
 	surface->height = height;
 	surface->override_redirect = override_redirect;
-	wl_list_insert(&xwm->surfaces, &surface->link);
+	surface->configure.sent.x = x;
+	surface->configure.sent.y = y;
+	surface->configure.sent.width = width;
+	surface->configure.sent.height = height;
+	wl_list_init(&surface->configure.link);
+	wl_list_init(&surface->pending_reads.link);
+	xwm_add_surface(xwm, surface);
 	wl_list_init(&surface->children);
 	wl_list_init(&surface->parent_link);
 	wl_signal_init(&surface->events.destroy);
@@ -163,18 +284,28 @@ static struct wlr_xwayland_surface *xwayland_surface_create(
 	wl_signal_init(&surface->events.set_override_redirect);
 	wl_signal_init(&surface->events.ping_timeout);
 
-	xcb_get_geometry_reply_t *geometry_reply =
-		xcb_get_geometry_reply(xwm->xcb_conn, geometry_cookie, NULL);
-	if (geometry_reply != NULL) {
-		surface->has_alpha = geometry_reply->depth == 32;
+	if (override_redirect) {
+		// Menus and tooltips shouldn't wait for a round-trip, the depth
+		// only matters once the window is drawn
+		surface->pending_reads.geometry = true;
+		surface->pending_reads.geometry_cookie = geometry_cookie;
+		wl_list_insert(&xwm->pending_reads, &surface->pending_reads.link);
+	} else {
+		xcb_get_geometry_reply_t *geometry_reply =
+			xcb_get_geometry_reply(xwm->xcb_conn, geometry_cookie, NULL);
+		if (geometry_reply != NULL) {
+			surface->has_alpha = geometry_reply->depth == 32;
+		}
+		free(geometry_reply);
 	}
-	free(geometry_reply);
 
 	struct wl_display *display = xwm->xwayland->wl_display;
 	struct wl_event_loop *loop = wl_display_get_event_loop(display);
 	surface->ping_timer = wl_event_loop_add_timer(loop,
 		xwayland_surface_handle_ping_timeout, surface);
 	if (surface->ping_timer == NULL) {
+		xsurface_finish_pending_reads(surface);
+		xwm_remove_surface(xwm, surface);
 		free(surface);
 		wlr_log(WLR_ERROR, "Could not add timer to event loop");
 		return NULL;
@@ -213,26 +344,52 @@ static void xwm_send_wm_message(struct wlr_xwayland_surface *surface,
 	xcb_flush(xwm->xcb_conn);
 }
 
-static void xwm_set_net_client_list(struct wlr_xwm *xwm) {
-	size_t mapped_surfaces = 0;
-	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->mapped) {
-			mapped_surfaces++;
-		}
+static void xwm_handle_client_list_idle(void *data) {
+	struct wlr_xwm *xwm = data;
+	xwm->client_list_idle = NULL;
+
+	xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
+			xwm->screen->root, xwm->atoms[_NET_CLIENT_LIST],
+			XCB_ATOM_WINDOW, 32,
+			xwm->client_list.size / sizeof(xcb_window_t),
+			xwm->client_list.data);
+	xcb_flush(xwm->xcb_conn);
+}
+
+static void xwm_schedule_client_list_update(struct wlr_xwm *xwm) {
+	// Maps and unmaps often come in bursts, only send the final list
+	if (xwm->client_list_idle != NULL) {
+		return;
 	}
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(xwm->xwayland->wl_display);
+	xwm->client_list_idle =
+		wl_event_loop_add_idle(loop, xwm_handle_client_list_idle, xwm);
+}
 
-	xcb_window_t windows[mapped_surfaces + 1];
-	size_t index = 0;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->mapped) {
-			windows[index++] = surface->window_id;
-		}
+static void xwm_client_list_add(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *entry = wl_array_add(&xwm->client_list, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
 	}
+	*entry = window;
+	xwm_schedule_client_list_update(xwm);
+}
 
-	xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
-			xwm->screen->root, xwm->atoms[_NET_CLIENT_LIST],
-			XCB_ATOM_WINDOW, 32, mapped_surfaces, windows);
+static void xwm_client_list_remove(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *windows = xwm->client_list.data;
+	size_t len = xwm->client_list.size / sizeof(xcb_window_t);
+	for (size_t i = 0; i < len; ++i) {
+		if (windows[i] == window) {
+			// Keep the mapping order
+			memmove(&windows[i], &windows[i + 1],
+				(len - i - 1) * sizeof(xcb_window_t));
+			xwm->client_list.size -= sizeof(xcb_window_t);
+			xwm_schedule_client_list_update(xwm);
+			return;
+		}
+	}
 }
 
 static void xwm_send_focus_window(struct wlr_xwm *xwm,
@@ -329,8 +486,9 @@ static void xwayland_surface_destroy(
 		xwm_surface_activate(xsurface->xwm, NULL);
 	}
 
-	wl_list_remove(&xsurface->link);
+	xwm_remove_surface(xsurface->xwm, xsurface);
 	wl_list_remove(&xsurface->parent_link);
+	wl_list_remove(&xsurface->configure.link);
 
 	struct wlr_xwayland_surface *child, *next;
 	wl_list_for_each_safe(child, next, &xsurface->children, parent_link) {
@@ -340,7 +498,7 @@ static void xwayland_surface_destroy(
 	}
 
 	if (xsurface->surface_id) {
-		wl_list_remove(&xsurface->unpaired_link);
+		xwm_remove_unpaired_surface(xsurface->xwm, xsurface);
 	}
 
 	if (xsurface->surface) {
@@ -349,6 +507,7 @@ static void xwayland_surface_destroy(
 	}
 
 	wl_event_source_remove(xsurface->ping_timer);
+	xsurface_finish_pending_reads(xsurface);
 
 	free(xsurface->title);
 	free(xsurface->class);
@@ -684,12 +843,16 @@ char *xwm_get_atom_name(struct wlr_xwm *xwm, xcb_atom_t atom) {
 	return name;
 }
 
-static void read_surface_property(struct wlr_xwm *xwm,
+static xcb_get_property_cookie_t get_surface_property(struct wlr_xwm *xwm,
 		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn, 0,
-		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t *reply = xcb_get_property_reply(xwm->xcb_conn,
-		cookie, NULL);
+	return xcb_get_property(xwm->xcb_conn, 0, xsurface->window_id, property,
+		XCB_ATOM_ANY, 0, 2048);
+}
+
+// Takes ownership of the reply
+static void handle_surface_property_reply(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property,
+		xcb_get_property_reply_t *reply) {
 	if (reply == NULL) {
 		return;
 	}
@@ -727,6 +890,95 @@ static void read_surface_property(struct wlr_xwm *xwm,
 	free(reply);
 }
 
+static void read_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
+	xcb_get_property_cookie_t cookie =
+		get_surface_property(xwm, xsurface, property);
+	xcb_get_property_reply_t *reply =
+		xcb_get_property_reply(xwm->xcb_conn, cookie, NULL);
+	handle_surface_property_reply(xwm, xsurface, property, reply);
+}
+
+static void xsurface_discard_pending_properties(
+		struct wlr_xwayland_surface *xsurface) {
+	for (size_t i = 0; i < xsurface->pending_reads.len; i++) {
+		if (xsurface->pending_reads.atoms[i] != XCB_ATOM_NONE) {
+			xcb_discard_reply(xsurface->xwm->xcb_conn,
+				xsurface->pending_reads.cookies[i].sequence);
+		}
+	}
+	free(xsurface->pending_reads.atoms);
+	free(xsurface->pending_reads.cookies);
+	xsurface->pending_reads.atoms = NULL;
+	xsurface->pending_reads.cookies = NULL;
+	xsurface->pending_reads.len = 0;
+}
+
+static void xsurface_finish_pending_reads(
+		struct wlr_xwayland_surface *xsurface) {
+	if (xsurface->pending_reads.geometry) {
+		xcb_discard_reply(xsurface->xwm->xcb_conn,
+			xsurface->pending_reads.geometry_cookie.sequence);
+		xsurface->pending_reads.geometry = false;
+	}
+	xsurface_discard_pending_properties(xsurface);
+	wl_list_remove(&xsurface->pending_reads.link);
+	wl_list_init(&xsurface->pending_reads.link);
+}
+
+// Handles the replies which have already arrived, without blocking
+static void xsurface_poll_pending_reads(struct wlr_xwayland_surface *xsurface) {
+	struct wlr_xwm *xwm = xsurface->xwm;
+	void *reply;
+	xcb_generic_error_t *error;
+
+	if (xsurface->pending_reads.geometry) {
+		reply = NULL;
+		error = NULL;
+		if (xcb_poll_for_reply(xwm->xcb_conn,
+				xsurface->pending_reads.geometry_cookie.sequence,
+				&reply, &error)) {
+			xcb_get_geometry_reply_t *geometry_reply = reply;
+			if (geometry_reply != NULL) {
+				xsurface->has_alpha = geometry_reply->depth == 32;
+			}
+			free(geometry_reply);
+			free(error);
+			xsurface->pending_reads.geometry = false;
+		}
+	}
+
+	bool pending = xsurface->pending_reads.geometry;
+	for (size_t i = 0; i < xsurface->pending_reads.len; i++) {
+		xcb_atom_t atom = xsurface->pending_reads.atoms[i];
+		if (atom == XCB_ATOM_NONE) {
+			continue;
+		}
+		reply = NULL;
+		error = NULL;
+		if (!xcb_poll_for_reply(xwm->xcb_conn,
+				xsurface->pending_reads.cookies[i].sequence, &reply, &error)) {
+			pending = true;
+			continue;
+		}
+		xsurface->pending_reads.atoms[i] = XCB_ATOM_NONE;
+		free(error);
+		handle_surface_property_reply(xwm, xsurface, atom, reply);
+	}
+
+	if (!pending) {
+		xsurface_finish_pending_reads(xsurface);
+	}
+}
+
+static void xwm_poll_pending_reads(struct wlr_xwm *xwm) {
+	struct wlr_xwayland_surface *xsurface, *tmp;
+	wl_list_for_each_safe(xsurface, tmp, &xwm->pending_reads,
+			pending_reads.link) {
+		xsurface_poll_pending_reads(xsurface);
+	}
+}
+
 static void xwayland_surface_role_commit(struct wlr_surface *wlr_surface) {
 	assert(wlr_surface->role == &xwayland_surface_role);
 	struct wlr_xwayland_surface *surface = wlr_surface->role_data;
@@ -737,7 +989,7 @@ static void xwayland_surface_role_commit(struct wlr_surface *wlr_surface) {
 	if (!surface->mapped && wlr_surface_has_buffer(surface->surface)) {
 		wlr_signal_emit_safe(&surface->events.map, surface);
 		surface->mapped = true;
-		xwm_set_net_client_list(surface->xwm);
+		xwm_client_list_add(surface->xwm, surface->window_id);
 	}
 }
 
@@ -754,7 +1006,7 @@ static void xwayland_surface_role_precommit(struct wlr_surface *wlr_surface) {
 		if (surface->mapped) {
 			wlr_signal_emit_safe(&surface->events.unmap, surface);
 			surface->mapped = false;
-			xwm_set_net_client_list(surface->xwm);
+			xwm_client_list_remove(surface->xwm, surface->window_id);
 		}
 	}
 }
@@ -795,8 +1047,44 @@ static void xwm_map_shell_surface(struct wlr_xwm *xwm,
 		xwm->atoms[NET_WM_NAME],
 		xwm->atoms[NET_WM_PID],
 	};
-	for (size_t i = 0; i < sizeof(props)/sizeof(xcb_atom_t); i++) {
-		read_surface_property(xwm, xsurface, props[i]);
+	const size_t props_len = sizeof(props) / sizeof(props[0]);
+
+	// Send all requests before waiting for the first reply, so that reading
+	// the properties only takes a single round-trip
+	xcb_get_property_cookie_t cookies[sizeof(props) / sizeof(props[0])];
+	for (size_t i = 0; i < props_len; i++) {
+		cookies[i] = get_surface_property(xwm, xsurface, props[i]);
+	}
+
+	// Menus and tooltips are placed by their client and don't need any of
+	// these to be shown, handle the replies as they arrive
+	bool deferred = false;
+	if (xsurface->override_redirect) {
+		xsurface_discard_pending_properties(xsurface);
+		xcb_atom_t *atoms = calloc(props_len, sizeof(xcb_atom_t));
+		xcb_get_property_cookie_t *pending_cookies =
+			calloc(props_len, sizeof(xcb_get_property_cookie_t));
+		if (atoms != NULL && pending_cookies != NULL) {
+			memcpy(atoms, props, sizeof(props));
+			memcpy(pending_cookies, cookies, sizeof(cookies));
+			xsurface->pending_reads.atoms = atoms;
+			xsurface->pending_reads.cookies = pending_cookies;
+			xsurface->pending_reads.len = props_len;
+			wl_list_remove(&xsurface->pending_reads.link);
+			wl_list_insert(&xwm->pending_reads, &xsurface->pending_reads.link);
+			xcb_flush(xwm->xcb_conn);
+			deferred = true;
+		} else {
+			free(atoms);
+			free(pending_cookies);
+		}
+	}
+	if (!deferred) {
+		for (size_t i = 0; i < props_len; i++) {
+			xcb_get_property_reply_t *reply =
+				xcb_get_property_reply(xwm->xcb_conn, cookies[i], NULL);
+			handle_surface_property_reply(xwm, xsurface, props[i], reply);
+		}
 	}
 
 	xsurface->surface_destroy.notify = handle_surface_destroy;
@@ -807,14 +1095,14 @@ static void xsurface_unmap(struct wlr_xwayland_surface *surface) {
 	if (surface->mapped) {
 		wlr_signal_emit_safe(&surface->events.unmap, surface);
 		surface->mapped = false;
-		xwm_set_net_client_list(surface->xwm);
+		xwm_client_list_remove(surface->xwm, surface->window_id);
 	}
 
 	if (surface->surface_id) {
 		// Make sure we're not on the unpaired surface list or we
 		// could be assigned a surface during surface creation that
 		// was mapped before this unmap request.
-		wl_list_remove(&surface->unpaired_link);
+		xwm_remove_unpaired_surface(surface->xwm, surface);
 		surface->surface_id = 0;
 	}
 
@@ -878,6 +1166,8 @@ static void xwm_handle_configure_request(struct wlr_xwm *xwm,
 	wlr_signal_emit_safe(&surface->events.request_configure, &wlr_event);
 }
 
+static void xwm_schedule_configure(struct wlr_xwm *xwm);
+
 static void xwm_handle_configure_notify(struct wlr_xwm *xwm,
 		xcb_configure_notify_event_t *ev) {
 	struct wlr_xwayland_surface *xsurface = lookup_surface(xwm, ev->window);
@@ -885,10 +1175,20 @@ static void xwm_handle_configure_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
-	xsurface->x = ev->x;
-	xsurface->y = ev->y;
-	xsurface->width = ev->width;
-	xsurface->height = ev->height;
+	xsurface->configure.in_flight = false;
+	xsurface->configure.sent.x = ev->x;
+	xsurface->configure.sent.y = ev->y;
+	xsurface->configure.sent.width = ev->width;
+	xsurface->configure.sent.height = ev->height;
+	if (xsurface->configure.pending) {
+		// The geometry set since then takes precedence
+		xwm_schedule_configure(xwm);
+	} else {
+		xsurface->x = ev->x;
+		xsurface->y = ev->y;
+		xsurface->width = ev->width;
+		xsurface->height = ev->height;
+	}
 
 	if (xsurface->override_redirect != ev->override_redirect) {
 		xsurface->override_redirect = ev->override_redirect;
@@ -962,15 +1262,37 @@ static void xwm_handle_unmap_notify(struct wlr_xwm *xwm,
 	xsurface_set_wm_state(xsurface, ICCCM_WITHDRAWN_STATE);
 }
 
+/**
+ * If cookie isn't NULL, it's a request for the property that has been sent
+ * ahead of time.
+ */
 static void xwm_handle_property_notify(struct wlr_xwm *xwm,
-		xcb_property_notify_event_t *ev) {
+		xcb_property_notify_event_t *ev, xcb_get_property_cookie_t *cookie) {
 	wlr_log(WLR_DEBUG, "XCB_PROPERTY_NOTIFY (%u)", ev->window);
 	struct wlr_xwayland_surface *xsurface = lookup_surface(xwm, ev->window);
 	if (xsurface == NULL) {
+		if (cookie != NULL) {
+			xcb_discard_reply(xwm->xcb_conn, cookie->sequence);
+		}
 		return;
 	}
 
-	read_surface_property(xwm, xsurface, ev->atom);
+	// An initial read of the property still in flight would be stale
+	for (size_t i = 0; i < xsurface->pending_reads.len; i++) {
+		if (xsurface->pending_reads.atoms[i] == ev->atom) {
+			xcb_discard_reply(xwm->xcb_conn,
+				xsurface->pending_reads.cookies[i].sequence);
+			xsurface->pending_reads.atoms[i] = XCB_ATOM_NONE;
+		}
+	}
+
+	if (cookie == NULL) {
+		read_surface_property(xwm, xsurface, ev->atom);
+		return;
+	}
+	xcb_get_property_reply_t *reply =
+		xcb_get_property_reply(xwm->xcb_conn, *cookie, NULL);
+	handle_surface_property_reply(xwm, xsurface, ev->atom, reply);
 }
 
 static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
@@ -992,7 +1314,7 @@ static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
 		xwm_map_shell_surface(xwm, xsurface, surface);
 	} else {
 		xsurface->surface_id = id;
-		wl_list_insert(&xwm->unpaired_surfaces, &xsurface->unpaired_link);
+		xwm_add_unpaired_surface(xwm, xsurface);
 	}
 }
 
@@ -1294,75 +1616,277 @@ static void xwm_handle_unhandled_event(struct wlr_xwm *xwm, xcb_generic_event_t
 #endif
 }
 
-static int x11_event_handler(int fd, uint32_t mask, void *data) {
-	int count = 0;
-	xcb_generic_event_t *event;
-	struct wlr_xwm *xwm = data;
+// Maximum number of events read from the X11 connection at once
+#define XWM_EVENT_BATCH_LEN 64
+// Time spent processing events before yielding to the event loop
+#define XWM_EVENT_BUDGET_NSEC (4 * 1000000)
+
+static bool event_get_window(xcb_generic_event_t *event,
+		xcb_window_t *window) {
+	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		*window = ((xcb_create_notify_event_t *)event)->window;
+		return true;
+	case XCB_DESTROY_NOTIFY:
+		*window = ((xcb_destroy_notify_event_t *)event)->window;
+		return true;
+	case XCB_CONFIGURE_REQUEST:
+		*window = ((xcb_configure_request_event_t *)event)->window;
+		return true;
+	case XCB_CONFIGURE_NOTIFY:
+		*window = ((xcb_configure_notify_event_t *)event)->window;
+		return true;
+	case XCB_MAP_REQUEST:
+		*window = ((xcb_map_request_event_t *)event)->window;
+		return true;
+	case XCB_MAP_NOTIFY:
+		*window = ((xcb_map_notify_event_t *)event)->window;
+		return true;
+	case XCB_UNMAP_NOTIFY:
+		*window = ((xcb_unmap_notify_event_t *)event)->window;
+		return true;
+	case XCB_PROPERTY_NOTIFY:
+		*window = ((xcb_property_notify_event_t *)event)->window;
+		return true;
+	case XCB_CLIENT_MESSAGE:
+		*window = ((xcb_client_message_event_t *)event)->window;
+		return true;
+	case XCB_FOCUS_IN:
+		*window = ((xcb_focus_in_event_t *)event)->event;
+		return true;
+	}
+	return false;
+}
 
-	while ((event = xcb_poll_for_event(xwm->xcb_conn))) {
-		count++;
+/**
+ * Returns true if the event is superseded by a later event of the batch:
+ * only the last ConfigureNotify of a window and the last PropertyNotify of a
+ * window property matter. Events are never merged across another event for
+ * the same window, so that e.g. a property change before an unmap is still
+ * seen before the unmap.
+ */
+static bool event_is_superseded(struct wlr_xwm *xwm,
+		xcb_generic_event_t **events, size_t len, size_t i) {
+	uint8_t type = events[i]->response_type & XCB_EVENT_RESPONSE_TYPE_MASK;
+	if (type != XCB_CONFIGURE_NOTIFY && type != XCB_PROPERTY_NOTIFY) {
+		return false;
+	}
+
+	xcb_window_t window;
+	event_get_window(events[i], &window);
+	// Events for the selection windows are part of transfer protocols, every
+	// one of them needs to be handled
+	if (lookup_surface(xwm, window) == NULL) {
+		return false;
+	}
+
+	for (size_t j = i + 1; j < len; ++j) {
+		xcb_window_t other_window;
+		if (!event_get_window(events[j], &other_window) ||
+				other_window != window) {
+			continue;
+		}
+		uint8_t other_type =
+			events[j]->response_type & XCB_EVENT_RESPONSE_TYPE_MASK;
+		if (other_type != type) {
+			return false;
+		}
+		if (type == XCB_CONFIGURE_NOTIFY) {
+			return true;
+		}
+		if (((xcb_property_notify_event_t *)events[j])->atom ==
+				((xcb_property_notify_event_t *)events[i])->atom) {
+			return true;
+		}
+	}
+	return false;
+}
 
-		if (xwm->xwayland->user_event_handler &&
-				xwm->xwayland->user_event_handler(xwm, event)) {
-			break;
+static size_t coalesce_events(struct wlr_xwm *xwm,
+		xcb_generic_event_t **events, size_t len) {
+	size_t n = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (event_is_superseded(xwm, events, len, i)) {
+			free(events[i]);
+		} else {
+			events[n++] = events[i];
 		}
+	}
+	return n;
+}
 
-		if (xwm_handle_selection_event(xwm, event)) {
-			free(event);
-			continue;
+/**
+ * Handles an event. Returns false if the user event handler consumed it,
+ * event processing then stops until the connection is readable again.
+ */
+static bool dispatch_event(struct wlr_xwm *xwm, xcb_generic_event_t *event,
+		xcb_get_property_cookie_t *cookie) {
+	wlr_trace(xwm_event, xwm, event->response_type);
+
+	if (xwm->xwayland->user_event_handler &&
+			xwm->xwayland->user_event_handler(xwm, event)) {
+		if (cookie != NULL) {
+			xcb_discard_reply(xwm->xcb_conn, cookie->sequence);
 		}
+		return false;
+	}
 
-		switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
-		case XCB_CREATE_NOTIFY:
-			xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
-			break;
-		case XCB_CONFIGURE_REQUEST:
-			xwm_handle_configure_request(xwm,
-				(xcb_configure_request_event_t *)event);
-			break;
-		case XCB_CONFIGURE_NOTIFY:
-			xwm_handle_configure_notify(xwm,
-				(xcb_configure_notify_event_t *)event);
-			break;
-		case XCB_MAP_REQUEST:
-			xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
-			break;
-		case XCB_MAP_NOTIFY:
-			xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
-			break;
-		case XCB_UNMAP_NOTIFY:
-			xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
-			break;
-		case XCB_PROPERTY_NOTIFY:
-			xwm_handle_property_notify(xwm,
-				(xcb_property_notify_event_t *)event);
-			break;
-		case XCB_CLIENT_MESSAGE:
-			xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
-			break;
-		case XCB_FOCUS_IN:
-			xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
-			break;
-		case 0:
-			xwm_handle_xcb_error(xwm, (xcb_value_error_t *)event);
-			break;
-		default:
-			xwm_handle_unhandled_event(xwm, event);
-			break;
+	if (xwm_handle_selection_event(xwm, event)) {
+		if (cookie != NULL) {
+			xcb_discard_reply(xwm->xcb_conn, cookie->sequence);
 		}
 		free(event);
+		return true;
 	}
 
+	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		xwm_handle_configure_request(xwm,
+			(xcb_configure_request_event_t *)event);
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		xwm_handle_configure_notify(xwm,
+			(xcb_configure_notify_event_t *)event);
+		break;
+	case XCB_MAP_REQUEST:
+		xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
+		break;
+	case XCB_MAP_NOTIFY:
+		xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
+		break;
+	case XCB_UNMAP_NOTIFY:
+		xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		xwm_handle_property_notify(xwm,
+			(xcb_property_notify_event_t *)event, cookie);
+		break;
+	case XCB_CLIENT_MESSAGE:
+		xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
+		break;
+	case XCB_FOCUS_IN:
+		xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
+		break;
+	case 0:
+		xwm_handle_xcb_error(xwm, (xcb_value_error_t *)event);
+		break;
+	default:
+		xwm_handle_unhandled_event(xwm, event);
+		break;
+	}
+	free(event);
+	return true;
+}
+
+static int64_t timespec_diff_nsec(const struct timespec *a,
+		const struct timespec *b) {
+	return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 +
+		(a->tv_nsec - b->tv_nsec);
+}
+
+/**
+ * Handles a batch of events. Returns false if the event queue has been
+ * drained or if the user event handler stopped the dispatch.
+ */
+static bool dispatch_event_batch(struct wlr_xwm *xwm, int *count) {
+	// The user event handler expects to see every event, and stops the
+	// dispatch when it consumes one: read events one at a time then, so that
+	// the following ones stay queued
+	bool user_handler = xwm->xwayland->user_event_handler != NULL;
+	size_t batch_len = user_handler ? 1 : XWM_EVENT_BATCH_LEN;
+
+	xcb_generic_event_t *events[XWM_EVENT_BATCH_LEN];
+	size_t len = 0;
+	while (len < batch_len &&
+			(events[len] = xcb_poll_for_event(xwm->xcb_conn)) != NULL) {
+		len++;
+	}
+	*count += len;
+	bool drained = len < batch_len;
+
+	if (!user_handler) {
+		len = coalesce_events(xwm, events, len);
+	}
+
+	// Request all changed properties at once instead of waiting for each
+	// reply in turn
+	xcb_get_property_cookie_t cookies[XWM_EVENT_BATCH_LEN];
+	bool has_cookie[XWM_EVENT_BATCH_LEN] = {0};
+	for (size_t i = 0; i < len; ++i) {
+		if ((events[i]->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) !=
+				XCB_PROPERTY_NOTIFY) {
+			continue;
+		}
+		xcb_property_notify_event_t *ev =
+			(xcb_property_notify_event_t *)events[i];
+		struct wlr_xwayland_surface *xsurface =
+			lookup_surface(xwm, ev->window);
+		if (xsurface != NULL) {
+			cookies[i] = get_surface_property(xwm, xsurface, ev->atom);
+			has_cookie[i] = true;
+		}
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		if (!dispatch_event(xwm, events[i],
+				has_cookie[i] ? &cookies[i] : NULL)) {
+			assert(len == 1);
+			return false;
+		}
+	}
+
+	return !drained;
+}
+
+static void schedule_event_dispatch(struct wlr_xwm *xwm) {
+	// Events already read by xcb don't make the fd readable again
+	wl_event_source_timer_update(xwm->event_timer, 1);
+}
+
+static int x11_event_handler(int fd, uint32_t mask, void *data) {
+	struct wlr_xwm *xwm = data;
+	int count = 0;
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bool pending;
+	do {
+		pending = dispatch_event_batch(xwm, &count);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (pending &&
+		timespec_diff_nsec(&now, &start) < XWM_EVENT_BUDGET_NSEC);
+
 	if (count) {
 		xcb_flush(xwm->xcb_conn);
 	}
 
+	xwm_poll_pending_reads(xwm);
+	if (!wl_list_empty(&xwm->pending_reads)) {
+		// Replies already read by xcb don't make the fd readable again
+		schedule_event_dispatch(xwm);
+	}
+
+	if (pending) {
+		// Out of budget, let the compositor handle its other clients before
+		// carrying on
+		schedule_event_dispatch(xwm);
+		return 0;
+	}
 	return count;
 }
 
+static int x11_event_timer_handler(void *data) {
+	struct wlr_xwm *xwm = data;
+	x11_event_handler(-1, 0, xwm);
+	return 0;
+}
+
 static void handle_compositor_new_surface(struct wl_listener *listener,
 		void *data) {
 	struct wlr_xwm *xwm =
@@ -1375,15 +1899,13 @@ static void handle_compositor_new_surface(struct wl_listener *listener,
 	wlr_log(WLR_DEBUG, "New xwayland surface: %p", surface);
 
 	uint32_t surface_id = wl_resource_get_id(surface->resource);
-	struct wlr_xwayland_surface *xsurface;
-	wl_list_for_each(xsurface, &xwm->unpaired_surfaces, unpaired_link) {
-		if (xsurface->surface_id == surface_id) {
-			xwm_map_shell_surface(xwm, xsurface, surface);
-			xsurface->surface_id = 0;
-			wl_list_remove(&xsurface->unpaired_link);
-			xcb_flush(xwm->xcb_conn);
-			return;
-		}
+	struct wlr_xwayland_surface *xsurface =
+		lookup_unpaired_surface(xwm, surface_id);
+	if (xsurface != NULL) {
+		xwm_map_shell_surface(xwm, xsurface, surface);
+		xsurface->surface_id = 0;
+		xwm_remove_unpaired_surface(xwm, xsurface);
+		xcb_flush(xwm->xcb_conn);
 	}
 }
 
@@ -1407,6 +1929,62 @@ void wlr_xwayland_surface_activate(struct wlr_xwayland_surface *xsurface,
 	}
 }
 
+static void xwm_handle_configure_idle(void *data) {
+	struct wlr_xwm *xwm = data;
+	xwm->configure_idle = NULL;
+
+	bool throttle = xwm->xwayland->throttle_configures;
+	bool flush = false;
+	struct wlr_xwayland_surface *xsurface, *tmp;
+	wl_list_for_each_safe(xsurface, tmp, &xwm->configure_queue,
+			configure.link) {
+		if (throttle && xsurface->configure.in_flight) {
+			// Sent once its ConfigureNotify is received
+			continue;
+		}
+		wl_list_remove(&xsurface->configure.link);
+		wl_list_init(&xsurface->configure.link);
+		xsurface->configure.pending = false;
+
+		// The X server doesn't send a ConfigureNotify for a geometry it
+		// already has
+		if (xsurface->x == xsurface->configure.sent.x &&
+				xsurface->y == xsurface->configure.sent.y &&
+				xsurface->width == xsurface->configure.sent.width &&
+				xsurface->height == xsurface->configure.sent.height) {
+			continue;
+		}
+
+		uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+			XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+			XCB_CONFIG_WINDOW_BORDER_WIDTH;
+		uint32_t values[] = {xsurface->x, xsurface->y,
+			xsurface->width, xsurface->height, 0};
+		xcb_configure_window(xwm->xcb_conn, xsurface->window_id, mask,
+			values);
+		xsurface->configure.sent.x = xsurface->x;
+		xsurface->configure.sent.y = xsurface->y;
+		xsurface->configure.sent.width = xsurface->width;
+		xsurface->configure.sent.height = xsurface->height;
+		xsurface->configure.in_flight = true;
+		flush = true;
+	}
+
+	if (flush) {
+		xcb_flush(xwm->xcb_conn);
+	}
+}
+
+static void xwm_schedule_configure(struct wlr_xwm *xwm) {
+	if (xwm->configure_idle != NULL) {
+		return;
+	}
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(xwm->xwayland->wl_display);
+	xwm->configure_idle =
+		wl_event_loop_add_idle(loop, xwm_handle_configure_idle, xwm);
+}
+
 void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
 		int16_t x, int16_t y, uint16_t width, uint16_t height) {
 	xsurface->x = x;
@@ -1414,13 +1992,14 @@ void wlr_xwayland_surface_configure(struct wlr_xwayland_surface *xsurface,
 	xsurface->width = width;
 	xsurface->height = height;
 
+	// Interactive resizes configure on each pointer motion, only send the
+	// latest geometry
 	struct wlr_xwm *xwm = xsurface->xwm;
-	uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-		XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
-		XCB_CONFIG_WINDOW_BORDER_WIDTH;
-	uint32_t values[] = {x, y, width, height, 0};
-	xcb_configure_window(xwm->xcb_conn, xsurface->window_id, mask, values);
-	xcb_flush(xwm->xcb_conn);
+	if (!xsurface->configure.pending) {
+		xsurface->configure.pending = true;
+		wl_list_insert(xwm->configure_queue.prev, &xsurface->configure.link);
+	}
+	xwm_schedule_configure(xwm);
 }
 
 void wlr_xwayland_surface_close(struct wlr_xwayland_surface *xsurface) {
@@ -1445,13 +2024,94 @@ void wlr_xwayland_surface_close(struct wlr_xwayland_surface *xsurface) {
 	}
 }
 
+// Number of cursor images kept around in the X server
+#define XWM_CURSOR_CACHE_LEN 16
+
+struct xwm_cursor {
+	uint32_t hash;
+	uint32_t stride, width, height;
+	int32_t hotspot_x, hotspot_y;
+	uint8_t *pixels;
+	xcb_cursor_t cursor;
+	struct wl_list link; // wlr_xwm::cursors
+};
+
+static uint32_t cursor_hash(const uint8_t *pixels, size_t size) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ pixels[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static void xwm_cursor_destroy(struct wlr_xwm *xwm,
+		struct xwm_cursor *cursor) {
+	xcb_free_cursor(xwm->xcb_conn, cursor->cursor);
+	wl_list_remove(&cursor->link);
+	free(cursor->pixels);
+	free(cursor);
+	xwm->cursors_len--;
+}
+
+static struct xwm_cursor *xwm_cursor_create(struct wlr_xwm *xwm,
+		const uint8_t *pixels, uint32_t stride, uint32_t width,
+		uint32_t height, int32_t hotspot_x, int32_t hotspot_y, uint32_t hash) {
+	struct xwm_cursor *cursor = calloc(1, sizeof(struct xwm_cursor));
+	if (cursor == NULL) {
+		return NULL;
+	}
+	size_t size = stride * height;
+	cursor->pixels = malloc(size);
+	if (cursor->pixels == NULL) {
+		free(cursor);
+		return NULL;
+	}
+	memcpy(cursor->pixels, pixels, size);
+	cursor->hash = hash;
+	cursor->stride = stride;
+	cursor->width = width;
+	cursor->height = height;
+	cursor->hotspot_x = hotspot_x;
+	cursor->hotspot_y = hotspot_y;
+
+	int depth = 32;
+
+	xcb_pixmap_t pix = xcb_generate_id(xwm->xcb_conn);
+	xcb_create_pixmap(xwm->xcb_conn, depth, pix, xwm->screen->root, width,
+		height);
+
+	xcb_render_picture_t pic = xcb_generate_id(xwm->xcb_conn);
+	xcb_render_create_picture(xwm->xcb_conn, pic, pix, xwm->render_format_id,
+		0, 0);
+
+	xcb_gcontext_t gc = xcb_generate_id(xwm->xcb_conn);
+	xcb_create_gc(xwm->xcb_conn, gc, pix, 0, NULL);
+
+	xcb_put_image(xwm->xcb_conn, XCB_IMAGE_FORMAT_Z_PIXMAP, pix, gc,
+		width, height, 0, 0, 0, depth, stride * height * sizeof(uint8_t),
+		pixels);
+	xcb_free_gc(xwm->xcb_conn, gc);
+
+	cursor->cursor = xcb_generate_id(xwm->xcb_conn);
+	xcb_render_create_cursor(xwm->xcb_conn, cursor->cursor, pic, hotspot_x,
+		hotspot_y);
+	xcb_render_free_picture(xwm->xcb_conn, pic);
+	xcb_free_pixmap(xwm->xcb_conn, pix);
+
+	wl_list_insert(&xwm->cursors, &cursor->link);
+	xwm->cursors_len++;
+	return cursor;
+}
+
 void xwm_destroy(struct wlr_xwm *xwm) {
 	if (!xwm) {
 		return;
 	}
 	xwm_selection_finish(xwm);
-	if (xwm->cursor) {
-		xcb_free_cursor(xwm->xcb_conn, xwm->cursor);
+	struct xwm_cursor *cursor, *cursor_tmp;
+	wl_list_for_each_safe(cursor, cursor_tmp, &xwm->cursors, link) {
+		xwm_cursor_destroy(xwm, cursor);
 	}
 	if (xwm->colormap) {
 		xcb_free_colormap(xwm->xcb_conn, xwm->colormap);
@@ -1462,6 +2122,9 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	if (xwm->event_source) {
 		wl_event_source_remove(xwm->event_source);
 	}
+	if (xwm->event_timer) {
+		wl_event_source_remove(xwm->event_timer);
+	}
 #if WLR_HAS_XCB_ERRORS
 	if (xwm->errors_context) {
 		xcb_errors_context_free(xwm->errors_context);
@@ -1471,9 +2134,19 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	wl_list_for_each_safe(xsurface, tmp, &xwm->surfaces, link) {
 		xwayland_surface_destroy(xsurface);
 	}
-	wl_list_for_each_safe(xsurface, tmp, &xwm->unpaired_surfaces, link) {
+	wl_list_for_each_safe(xsurface, tmp, &xwm->unpaired_surfaces,
+			unpaired_link) {
 		xwayland_surface_destroy(xsurface);
 	}
+	if (xwm->client_list_idle) {
+		wl_event_source_remove(xwm->client_list_idle);
+	}
+	if (xwm->configure_idle) {
+		wl_event_source_remove(xwm->configure_idle);
+	}
+	wl_array_release(&xwm->client_list);
+	free(xwm->surface_buckets);
+	free(xwm->unpaired_buckets);
 	wl_list_remove(&xwm->compositor_new_surface.link);
 	wl_list_remove(&xwm->compositor_destroy.link);
 	xcb_disconnect(xwm->xcb_conn);
@@ -1649,32 +2322,44 @@ void xwm_set_cursor(struct wlr_xwm *xwm, const uint8_t *pixels, uint32_t stride,
 		wlr_log(WLR_ERROR, "Cannot set xwm cursor: no render format available");
 		return;
 	}
-	if (xwm->cursor) {
-		xcb_free_cursor(xwm->xcb_conn, xwm->cursor);
-	}
 
-	int depth = 32;
-
-	xcb_pixmap_t pix = xcb_generate_id(xwm->xcb_conn);
-	xcb_create_pixmap(xwm->xcb_conn, depth, pix, xwm->screen->root, width,
-		height);
+	size_t size = stride * height;
+	uint32_t hash = cursor_hash(pixels, size);
 
-	xcb_render_picture_t pic = xcb_generate_id(xwm->xcb_conn);
-	xcb_render_create_picture(xwm->xcb_conn, pic, pix, xwm->render_format_id,
-		0, 0);
-
-	xcb_gcontext_t gc = xcb_generate_id(xwm->xcb_conn);
-	xcb_create_gc(xwm->xcb_conn, gc, pix, 0, NULL);
+	struct xwm_cursor *cursor, *found = NULL;
+	wl_list_for_each(cursor, &xwm->cursors, link) {
+		if (cursor->hash == hash && cursor->stride == stride &&
+				cursor->width == width && cursor->height == height &&
+				cursor->hotspot_x == hotspot_x &&
+				cursor->hotspot_y == hotspot_y &&
+				memcmp(cursor->pixels, pixels, size) == 0) {
+			found = cursor;
+			break;
+		}
+	}
 
-	xcb_put_image(xwm->xcb_conn, XCB_IMAGE_FORMAT_Z_PIXMAP, pix, gc,
-		width, height, 0, 0, 0, depth, stride * height * sizeof(uint8_t),
-		pixels);
-	xcb_free_gc(xwm->xcb_conn, gc);
+	if (found != NULL) {
+		// Keep the list in most recently used order
+		wl_list_remove(&found->link);
+		wl_list_insert(&xwm->cursors, &found->link);
+	} else {
+		found = xwm_cursor_create(xwm, pixels, stride, width, height,
+			hotspot_x, hotspot_y, hash);
+		if (found == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return;
+		}
+		if (xwm->cursors_len > XWM_CURSOR_CACHE_LEN) {
+			struct xwm_cursor *oldest =
+				wl_container_of(xwm->cursors.prev, oldest, link);
+			xwm_cursor_destroy(xwm, oldest);
+		}
+	}
 
-	xwm->cursor = xcb_generate_id(xwm->xcb_conn);
-	xcb_render_create_cursor(xwm->xcb_conn, xwm->cursor, pic, hotspot_x,
-		hotspot_y);
-	xcb_free_pixmap(xwm->xcb_conn, pix);
+	if (xwm->cursor == found->cursor) {
+		return;
+	}
+	xwm->cursor = found->cursor;
 
 	uint32_t values[] = {xwm->cursor};
 	xcb_change_window_attributes(xwm->xcb_conn, xwm->screen->root,
@@ -1691,6 +2376,20 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 	xwm->xwayland = wlr_xwayland;
 	wl_list_init(&xwm->surfaces);
 	wl_list_init(&xwm->unpaired_surfaces);
+	wl_list_init(&xwm->configure_queue);
+	wl_list_init(&xwm->pending_reads);
+	wl_array_init(&xwm->client_list);
+	wl_list_init(&xwm->cursors);
+	xwm->surface_buckets = create_buckets(XWM_BUCKETS_MIN_LEN);
+	xwm->unpaired_buckets = create_buckets(XWM_BUCKETS_MIN_LEN);
+	if (xwm->surface_buckets == NULL || xwm->unpaired_buckets == NULL) {
+		free(xwm->surface_buckets);
+		free(xwm->unpaired_buckets);
+		free(xwm);
+		return NULL;
+	}
+	xwm->surface_buckets_len = XWM_BUCKETS_MIN_LEN;
+	xwm->unpaired_buckets_len = XWM_BUCKETS_MIN_LEN;
 	xwm->ping_timeout = 10000;
 
 	xwm->xcb_conn = xcb_connect_to_fd(wlr_xwayland->wm_fd[0], NULL);
@@ -1699,6 +2398,8 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 	if (rc) {
 		wlr_log(WLR_ERROR, "xcb connect failed: %d", rc);
 		close(wlr_xwayland->wm_fd[0]);
+		free(xwm->surface_buckets);
+		free(xwm->unpaired_buckets);
 		free(xwm);
 		return NULL;
 	}
@@ -1723,6 +2424,13 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 			x11_event_handler,
 			xwm);
 	wl_event_source_check(xwm->event_source);
+	xwm->event_timer = wl_event_loop_add_timer(event_loop,
+		x11_event_timer_handler, xwm);
+	if (xwm->event_timer == NULL) {
+		wlr_log(WLR_ERROR, "Could not create event timer");
+		xwm_destroy(xwm);
+		return NULL;
+	}
 
 	xwm_get_resources(xwm);
 	xwm_get_visual_and_colormap(xwm);